@@ -197,6 +197,17 @@ def pretrain(args):
     print(f'{local_device}: build dataset begin...')
     train_dataset = train_dataset_provider(args)
     print(f'{local_device}: build dataset end...')
+
+    if args.shape_bucket_ratio > 0:
+        # padding的label为-1，即loss的ignored_index
+        train_op.graph.set_shape_buckets(
+            ratio=args.shape_bucket_ratio,
+            min_size=alignment,
+            alignment=alignment,
+            token_feeds=[input_ids, masked_lm_labels],
+            pad_values=[train_dataset.pad_id(), -1],
+            cu_seqlens=config.cu_seqlens_list
+        )
     
     def get_strategy_info(
         strategy_id
@@ -230,7 +241,8 @@ def pretrain(args):
                 num_micro_batches=num_micro_batches, 
                 compute_strategy_id=compute_strategy_id,
                 optimize_strategy_id=optimize_strategy_id,
-                run_level = run_level
+                run_level = run_level,
+                micro_batch_cu_seqlens=config.cu_seqlens_list[0] if args.schedule_micro_batches else None
             )
         except RuntimeError as e:
             print(e)
@@ -316,6 +328,18 @@ def pretrain(args):
                 sorted_batch, sorted_len = get_sorted_batch_and_len(global_batch, train_dataset.pad_id())
             print(f"{local_device}: {len(sorted_batch)} seqs sorted lens is {sorted_len}")
             
+            # 回放时直接使用log中记录的策略与run level，不再依赖代价模型
+            # exec plan与热切换由这些决策确定，graph在Run中逐step核对
+            strategy_candidates = compute_strategy_id_list
+            run_level = hydraulis.run_level("compute_only") if compute_only else hydraulis.run_level("update")
+            replay_step = train_op.graph.replay_expected_step()
+            if replay_step is not None:
+                strategy_candidates = [replay_step["compute_strategy_id"]]
+                optimize_strategy_id = replay_step["optimize_strategy_id"]
+                run_level = replay_step["run_level"]
+                optimal_compute_strategy_id = replay_step["compute_strategy_id"]
+                dp_size, cp_tp_pp_list, max_seqlen_list, dp_id, stage_id = get_strategy_info(optimal_compute_strategy_id)
+            
             # packing
             if batching_method > 0:
                 # unbalanced seqs assignment
@@ -326,7 +350,7 @@ def pretrain(args):
                     batching_option_matrix = None
                 if batching_method >= 2:
                     optimal_compute_strategy_id, estimated_cost_1, batch_indices, estimated_cost_2, batching_option_matrix = find_optimal_strategy(
-                        compute_strategy_id_list, multi_dp_size, multi_cp_tp_pp_list, multi_max_seqlen_list, 
+                        strategy_candidates, multi_dp_size, multi_cp_tp_pp_list, multi_max_seqlen_list, 
                         multi_match_id_list, multi_gpu_pos, multi_dp_representive_gpu, 
                         all_devices.get_index(local_device), batching_method, strategy_pool, sorted_len
                     )
@@ -380,10 +404,10 @@ def pretrain(args):
             start_time = time.time()
             if args.torch_profile != 0 and step == 0:
                 with profile(activities=[ProfilerActivity.CUDA]) as prof:
-                    results = hydraulis_train(feed_dict, len(input_batch), optimal_compute_strategy_id, optimize_strategy_id, run_level=hydraulis.run_level("compute_only") if compute_only else hydraulis.run_level("update"))
+                    results = hydraulis_train(feed_dict, len(input_batch), optimal_compute_strategy_id, optimize_strategy_id, run_level=run_level)
                 prof.export_chrome_trace(f"trace/trace_{local_device}.json")
             else:
-                results = hydraulis_train(feed_dict, len(input_batch), optimal_compute_strategy_id, optimize_strategy_id, run_level=hydraulis.run_level("compute_only") if compute_only else hydraulis.run_level("update"))
+                results = hydraulis_train(feed_dict, len(input_batch), optimal_compute_strategy_id, optimize_strategy_id, run_level=run_level)
             end_time = time.time()
             
             consumed_samples += len(sorted_batch)
@@ -391,6 +415,10 @@ def pretrain(args):
             if stage_id == cp_tp_pp_list[dp_id][2] - 1 and len(results) > 0:
                 loss_out = results[0].numpy(force=True).mean()
                 print(f"{local_device}: [Epoch {epoch}] (step {step}, consumed_samples = {consumed_samples}): loss = {loss_out:.3f}, time = {end_time - start_time:.4f}")
+            # 只在world rank 0上每隔shape_plan_stats_interval个step打印一次累计的命中率与padding开销
+            if args.shape_plan_stats_interval > 0 and (step + 1) % args.shape_plan_stats_interval == 0 \
+                and all_devices.get_index(local_device) == 0:
+                print(f"{local_device}: (step {step}) shape plan stats = {train_op.graph.shape_plan_stats()}")
         
         return consumed_samples
     
@@ -513,6 +541,15 @@ if __name__ == '__main__':
     parser.add_argument(
         "--bf16", action="store_true", help="use bfloat16."
     )
+    parser.add_argument(
+        "--schedule_micro_batches", action="store_true", help="reorder micro batches by their token load to reduce pipeline bubbles."
+    )
+    parser.add_argument(
+        "--shape_bucket_ratio", type=float, default=0, help="round packed lengths up to a ladder of this ratio to reuse shape plans, 0 means disabled."
+    )
+    parser.add_argument(
+        "--shape_plan_stats_interval", type=int, default=0, help="print the shape plan hit rate on rank 0 every this many steps, 0 means never."
+    )
     parser.add_argument(
         "--server_addr", type=str, default='127.0.0.1', help="server's address"
     )
@@ -11,6 +11,8 @@ from typing import List
 from .cost_model import dynamic_strategy_time_cost
 
 MAX_WORKERS = 1
+# 使用hydraulis.pack_sequences（C++的LPT/Karmarkar-Karp + 局部搜索）代替PuLP求解micro batch的划分
+NATIVE_PACKING = True
 TRIAL_WORKERS = 1
 MINI_TRIAL_NUM = 50
 
@@ -376,6 +378,17 @@ def solve_v_micro_batches(seqs: List[int], costs: List[float], max_seqlen: int,
         # print(f"cannot put {seqs} into {v} micro batches and reach the full utilization")
         return float('inf'), None
 
+def solve_v_micro_batches_native(seqs: List[int], strategy, max_seqlen: int, util_seqlen: int, v: int):
+    import hydraulis
+    # 代价与dynamic_strategy_time_cost一致：a * s^2 + b * s
+    result = hydraulis.pack_sequences([int(seq) for seq in seqs], v, quadratic=strategy['a'], linear=strategy['b'],
+                                      max_tokens_per_bin=max_seqlen)
+    if not result['feasible']:
+        return float('inf'), None
+    o_values = np.zeros((len(seqs), v))
+    o_values[np.arange(len(seqs)), result['assignment']] = 1
+    return result['max_cost'], o_values
+
 def batching_strategy(strategy_pool, strategy_id: int, seqs: List[int], max_seqlen: int):
     strategy = strategy_pool['strategies'][strategy_id]
     tp = strategy['tp']
@@ -389,7 +402,9 @@ def batching_strategy(strategy_pool, strategy_id: int, seqs: List[int], max_seql
     costs = [dynamic_strategy_time_cost(strategy_pool, strategy_id, seq) for seq in seqs]
     results = []
     start_time = time.time()
-    if MAX_WORKERS == 1:
+    if NATIVE_PACKING:
+        results = [solve_v_micro_batches_native(seqs, strategy, max_seqlen, util_seqlen, v) for v in num_micro_batches_enum]
+    elif MAX_WORKERS == 1:
         results = []
         for v in num_micro_batches_enum:
             result = solve_v_micro_batches(seqs, costs, max_seqlen, util_seqlen, v)
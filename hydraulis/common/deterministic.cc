@@ -0,0 +1,38 @@
+#include "hydraulis/common/deterministic.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+namespace hydraulis {
+
+namespace {
+
+std::atomic<bool>& DeterministicFlag() {
+  static std::atomic<bool> flag([]() {
+    const char* env = std::getenv("HYDRAULIS_DETERMINISTIC");
+    return env != nullptr && std::strcmp(env, "ON") == 0;
+  }());
+  return flag;
+}
+
+} // namespace
+
+bool IsDeterministic() {
+  return DeterministicFlag().load(std::memory_order_relaxed);
+}
+
+void SetDeterministic(bool deterministic) {
+  DeterministicFlag().store(deterministic, std::memory_order_relaxed);
+}
+
+uint64_t DeterministicSeed() {
+  static uint64_t seed = []() -> uint64_t {
+    const char* env = std::getenv("HYDRAULIS_DETERMINISTIC_SEED");
+    uint64_t value = env != nullptr ? std::strtoull(env, nullptr, 10) : 0;
+    // 0表示未设置种子
+    return value != 0 ? value : 1;
+  }();
+  return seed;
+}
+
+} // namespace hydraulis
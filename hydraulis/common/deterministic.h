@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hydraulis {
+
+/******************************************************
+ * 确定性模式
+ *
+ * 开启后CPU kernel使用固定顺序的归约以及无竞争的scatter-add，
+ * 结果与OpenMP的线程数和调度无关；未设置随机种子时使用固定的种子，
+ * 因此数据的shuffle、dropout以及初始化在相同种子的两次运行中完全一致。
+ * 默认由HYDRAULIS_DETERMINISTIC=ON开启，种子由HYDRAULIS_DETERMINISTIC_SEED指定。
+ ******************************************************/
+
+bool IsDeterministic();
+
+// 只影响之后发射的kernel
+void SetDeterministic(bool deterministic);
+
+uint64_t DeterministicSeed();
+
+} // namespace hydraulis
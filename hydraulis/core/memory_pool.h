@@ -65,6 +65,24 @@ class MemoryPool {
                                           bool async = true) = 0;
 
   virtual void PrintSummary() = 0;
+
+  // Memory statistics in bytes, used by the memory profilers.
+  // Pools without a cache simply report the allocated bytes as reserved.
+  virtual size_t GetCurrAllocated() {
+    return 0;
+  }
+
+  virtual size_t GetCurrReserved() {
+    return GetCurrAllocated();
+  }
+
+  virtual size_t GetPeakAllocated() {
+    return 0;
+  }
+
+  virtual size_t GetPeakReserved() {
+    return GetPeakAllocated();
+  }
   
   const Device& device() const {
     return _device;
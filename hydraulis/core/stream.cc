@@ -29,4 +29,11 @@ void SynchronizeAllStreams(const Device& device) {
   }
 }
 
+std::unique_ptr<Event> CreateEvent(const Device& device, bool enable_timing) {
+  if (device.is_cuda())
+    return std::make_unique<hydraulis::impl::CUDAEvent>(device, enable_timing);
+  HT_ASSERT(device.is_cpu()) << "Cannot create event for device " << device;
+  return std::make_unique<hydraulis::impl::CPUEvent>(enable_timing);
+}
+
 } // namespace hydraulis
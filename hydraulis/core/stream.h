@@ -1,6 +1,7 @@
 #pragma once
 
 #include "hydraulis/core/device.h"
+#include <memory>
 
 namespace hydraulis {
 
@@ -127,6 +128,10 @@ class Event {
   const bool _enable_timing;
 };
 
+// Create an event of the corresponding type (CPUEvent or CUDAEvent).
+std::unique_ptr<Event> CreateEvent(const Device& device,
+                                   bool enable_timing = true);
+
 } // namespace hydraulis
 
 namespace std {
@@ -0,0 +1,397 @@
+#include "hydraulis/graph/checkpoint/safetensors.h"
+#include "hydraulis/impl/utils/dispatch.h"
+#include "hydraulis/utils/json/json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hydraulis {
+namespace graph {
+
+using json = nlohmann::json;
+
+namespace {
+
+// 单个拷贝任务的最大字节数，过长的连续区间会被切开以便多线程并行
+constexpr size_t kMaxChunkBytes = 4 * 1024 * 1024;
+
+struct CopyRun {
+  size_t src; // 全局tensor中的元素偏移
+  size_t dst; // 切片中的元素偏移
+  size_t numel;
+};
+
+std::string DataType2SafeTensorsDtype(DataType dtype) {
+  switch (dtype) {
+    case kUInt8: return "U8";
+    case kInt8: return "I8";
+    case kInt16: return "I16";
+    case kInt32: return "I32";
+    case kInt64: return "I64";
+    case kFloat16: return "F16";
+    case kBFloat16: return "BF16";
+    case kFloat32: return "F32";
+    case kFloat64: return "F64";
+    case kBool: return "BOOL";
+    default:
+      HT_NOT_IMPLEMENTED << "Cannot save " << dtype << " to safetensors";
+      __builtin_unreachable();
+  }
+}
+
+DataType SafeTensorsDtype2DataType(const std::string& dtype) {
+  if (dtype == "U8") return kUInt8;
+  if (dtype == "I8") return kInt8;
+  if (dtype == "I16") return kInt16;
+  if (dtype == "I32") return kInt32;
+  if (dtype == "I64") return kInt64;
+  if (dtype == "F16") return kFloat16;
+  if (dtype == "BF16") return kBFloat16;
+  if (dtype == "F32") return kFloat32;
+  if (dtype == "F64") return kFloat64;
+  if (dtype == "BOOL") return kBool;
+  HT_NOT_IMPLEMENTED << "Unsupported safetensors dtype " << dtype;
+  __builtin_unreachable();
+}
+
+int DefaultNumThreads(int num_threads) {
+  if (num_threads > 0)
+    return num_threads;
+  return std::max<int>(1, std::min<int>(16, std::thread::hardware_concurrency()));
+}
+
+// 将切片拆成若干段在全局tensor中连续的区间
+// 最内侧与全局shape相同的若干维可以合并成一段
+std::vector<CopyRun> MakeSliceRuns(const HTShape& global_shape,
+                                   const TensorSlice& slice,
+                                   size_t item_size) {
+  size_t ndim = global_shape.size();
+  HT_VALUE_ERROR_IF(slice.begin.size() != ndim || slice.shape.size() != ndim)
+    << "Slice " << slice.begin << ", " << slice.shape
+    << " mismatches with shape " << global_shape;
+  for (size_t d = 0; d < ndim; d++) {
+    HT_VALUE_ERROR_IF(slice.begin[d] < 0 || slice.shape[d] < 0 ||
+                      slice.begin[d] + slice.shape[d] > global_shape[d])
+      << "Slice " << slice.begin << ", " << slice.shape
+      << " is out of range of shape " << global_shape;
+  }
+  std::vector<CopyRun> runs;
+  if (NumEl(slice.shape) == 0)
+    return runs;
+  auto global_stride = Shape2Stride(global_shape);
+  // [k, ndim)维完整，第k-1维（若存在）部分连续
+  size_t k = ndim;
+  size_t inner = 1;
+  while (k > 0 && slice.shape[k - 1] == global_shape[k - 1]) {
+    inner *= global_shape[k - 1];
+    k--;
+  }
+  size_t run_len = k > 0 ? slice.shape[k - 1] * inner : inner;
+  size_t num_outer_dims = k > 0 ? k - 1 : 0;
+  size_t base = k > 0 ? slice.begin[k - 1] * global_stride[k - 1] : 0;
+  size_t num_runs = 1;
+  for (size_t d = 0; d < num_outer_dims; d++)
+    num_runs *= slice.shape[d];
+  size_t max_chunk = std::max<size_t>(1, kMaxChunkBytes / item_size);
+  HTShape index(num_outer_dims, 0);
+  for (size_t r = 0; r < num_runs; r++) {
+    size_t src = base;
+    for (size_t d = 0; d < num_outer_dims; d++)
+      src += (slice.begin[d] + index[d]) * global_stride[d];
+    for (size_t off = 0; off < run_len; off += max_chunk) {
+      runs.push_back({src + off, r * run_len + off, std::min(max_chunk, run_len - off)});
+    }
+    for (int64_t d = static_cast<int64_t>(num_outer_dims) - 1; d >= 0; d--) {
+      if (++index[d] < slice.shape[d])
+        break;
+      index[d] = 0;
+    }
+  }
+  return runs;
+}
+
+} // namespace
+
+TensorSlice GetLocalTensorSlice(const HTShape& global_shape,
+                                const DistributedStates& ds,
+                                int32_t device_index) {
+  TensorSlice slice{HTShape(global_shape.size(), 0), global_shape};
+  if (!ds.is_valid())
+    return slice;
+  HT_VALUE_ERROR_IF(ds.get_dim(-2) > 1)
+    << "Cannot map partial tensors to a slice, ds = " << ds.ds_info();
+  auto state_index = ds.map_device_to_state_index(device_index);
+  for (size_t d = 0; d < global_shape.size(); d++) {
+    int32_t splits = ds.get_dim(d);
+    if (splits <= 1)
+      continue;
+    HT_VALUE_ERROR_IF(global_shape[d] % splits != 0)
+      << "Dim " << d << " of shape " << global_shape
+      << " cannot be evenly split into " << splits << " parts";
+    slice.shape[d] = global_shape[d] / splits;
+    slice.begin[d] = state_index[d] * slice.shape[d];
+  }
+  return slice;
+}
+
+void ConvertDataType(const void* src, DataType src_dtype,
+                     void* dst, DataType dst_dtype, size_t numel) {
+  if (src_dtype == dst_dtype) {
+    if (numel > 0)
+      std::memcpy(dst, src, numel * DataType2Size(src_dtype));
+    return;
+  }
+  HT_DISPATCH_PAIRED_SIGNED_INTEGER_AND_FLOATING_TYPES(
+    src_dtype, dst_dtype, spec_a_t, spec_b_t, "ConvertDataType", [&]() {
+      auto* typed_src = reinterpret_cast<const spec_a_t*>(src);
+      auto* typed_dst = reinterpret_cast<spec_b_t*>(dst);
+      // 简单的逐元素循环，编译器可以向量化
+      for (size_t i = 0; i < numel; i++)
+        typed_dst[i] = static_cast<spec_b_t>(typed_src[i]);
+    });
+}
+
+/******************************************************
+ * SafeTensorsReader
+ ******************************************************/
+
+SafeTensorsReader::SafeTensorsReader(const std::string& path, int num_threads)
+: _path(path), _num_threads(DefaultNumThreads(num_threads)) {
+  _fd = open(path.c_str(), O_RDONLY);
+  HT_RUNTIME_ERROR_IF(_fd < 0)
+    << "Failed to open " << path << ": " << std::strerror(errno);
+  struct stat st;
+  HT_RUNTIME_ERROR_IF(fstat(_fd, &st) != 0)
+    << "Failed to stat " << path << ": " << std::strerror(errno);
+  _file_size = st.st_size;
+  HT_RUNTIME_ERROR_IF(_file_size < sizeof(uint64_t))
+    << path << " is not a valid safetensors file";
+  _mapped = mmap(nullptr, _file_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+  HT_RUNTIME_ERROR_IF(_mapped == MAP_FAILED)
+    << "Failed to mmap " << path << ": " << std::strerror(errno);
+
+  uint64_t header_size;
+  std::memcpy(&header_size, _mapped, sizeof(uint64_t));
+  HT_RUNTIME_ERROR_IF(sizeof(uint64_t) + header_size > _file_size)
+    << "Invalid header size " << header_size << " of " << path;
+  auto* header_begin = static_cast<const char*>(_mapped) + sizeof(uint64_t);
+  _data = header_begin + header_size;
+  _data_size = _file_size - sizeof(uint64_t) - header_size;
+
+  auto header = json::parse(header_begin, header_begin + header_size);
+  for (auto it = header.begin(); it != header.end(); ++it) {
+    if (it.key() == "__metadata__") {
+      for (auto meta_it = it.value().begin(); meta_it != it.value().end(); ++meta_it)
+        _metadata[meta_it.key()] = meta_it.value().get<std::string>();
+      continue;
+    }
+    SafeTensorInfo info;
+    info.dtype = SafeTensorsDtype2DataType(it.value().at("dtype").get<std::string>());
+    info.shape = it.value().at("shape").get<HTShape>();
+    const auto& offsets = it.value().at("data_offsets");
+    info.begin = offsets.at(0).get<size_t>();
+    info.end = offsets.at(1).get<size_t>();
+    HT_RUNTIME_ERROR_IF(info.end < info.begin || info.end > _data_size ||
+                        info.end - info.begin != NumEl(info.shape) * DataType2Size(info.dtype))
+      << "Invalid data offsets [" << info.begin << ", " << info.end << ") of "
+      << it.key() << " in " << path;
+    _infos[it.key()] = std::move(info);
+  }
+  HT_LOG_DEBUG << "[Checkpoint] mmap " << path << " with " << _infos.size() << " tensors";
+}
+
+SafeTensorsReader::~SafeTensorsReader() {
+  if (_mapped != nullptr && _mapped != MAP_FAILED)
+    munmap(_mapped, _file_size);
+  if (_fd >= 0)
+    close(_fd);
+}
+
+std::vector<std::string> SafeTensorsReader::keys() const {
+  std::vector<std::string> ret;
+  ret.reserve(_infos.size());
+  for (const auto& kv : _infos)
+    ret.push_back(kv.first);
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+void SafeTensorsReader::ReadSlice(const std::string& name, const TensorSlice& slice,
+                                  void* dst, DataType dst_dtype) const {
+  const auto& info = GetInfo(name);
+  auto src_item_size = DataType2Size(info.dtype);
+  auto dst_item_size = DataType2Size(dst_dtype);
+  // 提前检查dtype能否转换，避免在多线程中抛出异常
+  ConvertDataType(nullptr, info.dtype, nullptr, dst_dtype, 0);
+  auto runs = MakeSliceRuns(info.shape, slice, src_item_size);
+  if (runs.empty())
+    return;
+  const char* src = _data + info.begin;
+  // 预读shard覆盖的页
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t first = reinterpret_cast<size_t>(src + runs.front().src * src_item_size);
+  size_t last = reinterpret_cast<size_t>(src + (runs.back().src + runs.back().numel) * src_item_size);
+  first = first / page_size * page_size;
+  madvise(reinterpret_cast<void*>(first), last - first, MADV_WILLNEED);
+
+  auto* dst_bytes = static_cast<char*>(dst);
+  int64_t num_runs = runs.size();
+  #pragma omp parallel for num_threads(_num_threads) schedule(dynamic)
+  for (int64_t i = 0; i < num_runs; i++) {
+    const auto& run = runs[i];
+    ConvertDataType(src + run.src * src_item_size, info.dtype,
+                    dst_bytes + run.dst * dst_item_size, dst_dtype, run.numel);
+  }
+}
+
+void SafeTensorsReader::LoadShard(const std::string& name, const DistributedStates& ds,
+                                  int32_t device_index, NDArray& dst) const {
+  const auto& info = GetInfo(name);
+  auto slice = GetLocalTensorSlice(info.shape, ds, device_index);
+  HT_VALUE_ERROR_IF(slice.shape != dst->shape())
+    << "Shard of " << name << " has shape " << slice.shape
+    << " under ds " << ds.ds_info() << ", but the destination has shape " << dst->shape();
+  if (dst->is_cpu() && dst->is_contiguous()) {
+    ReadSlice(name, slice, dst->raw_data_ptr(), dst->dtype());
+    return;
+  }
+  auto host = NDArray::empty(slice.shape, Device(kCPU), dst->dtype(), kBlockingStream);
+  ReadSlice(name, slice, host->raw_data_ptr(), dst->dtype());
+  NDArray::copy(host, kBlockingStream, dst);
+}
+
+/******************************************************
+ * SafeTensorsWriter
+ ******************************************************/
+
+SafeTensorsWriter::SafeTensorsWriter(const std::string& path,
+                                     const std::vector<std::pair<std::string, NDArrayMeta>>& global_metas,
+                                     const std::unordered_map<std::string, std::string>& metadata,
+                                     int num_threads)
+: _path(path), _num_threads(DefaultNumThreads(num_threads)) {
+  // 按名字排序以保证所有rank生成的header完全相同
+  auto sorted_metas = global_metas;
+  std::sort(sorted_metas.begin(), sorted_metas.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+  json header = json::object();
+  if (!metadata.empty()) {
+    json meta_json = json::object();
+    for (const auto& kv : metadata)
+      meta_json[kv.first] = kv.second;
+    header["__metadata__"] = meta_json;
+  }
+  size_t offset = 0;
+  for (const auto& kv : sorted_metas) {
+    HT_VALUE_ERROR_IF(_infos.find(kv.first) != _infos.end())
+      << "Duplicate tensor " << kv.first << " in " << path;
+    SafeTensorInfo info;
+    info.dtype = kv.second.dtype;
+    info.shape = kv.second.shape;
+    info.begin = offset;
+    info.end = offset + NumEl(info.shape) * DataType2Size(info.dtype);
+    offset = info.end;
+    header[kv.first] = {
+      {"dtype", DataType2SafeTensorsDtype(info.dtype)},
+      {"shape", info.shape},
+      {"data_offsets", {info.begin, info.end}}
+    };
+    _infos[kv.first] = std::move(info);
+  }
+  auto header_str = header.dump();
+  // 数据段按8字节对齐
+  header_str.append((8 - header_str.size() % 8) % 8, ' ');
+  uint64_t header_size = header_str.size();
+  _data_offset = sizeof(uint64_t) + header_size;
+
+  _fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+  HT_RUNTIME_ERROR_IF(_fd < 0)
+    << "Failed to open " << path << ": " << std::strerror(errno);
+  HT_RUNTIME_ERROR_IF(ftruncate(_fd, _data_offset + offset) != 0)
+    << "Failed to resize " << path << ": " << std::strerror(errno);
+  HT_RUNTIME_ERROR_IF(pwrite(_fd, &header_size, sizeof(uint64_t), 0) != sizeof(uint64_t) ||
+                      pwrite(_fd, header_str.data(), header_size, sizeof(uint64_t)) != header_size)
+    << "Failed to write the header of " << path << ": " << std::strerror(errno);
+}
+
+SafeTensorsWriter::~SafeTensorsWriter() {
+  if (_fd >= 0)
+    close(_fd);
+}
+
+void SafeTensorsWriter::WriteSlice(const std::string& name, const TensorSlice& slice,
+                                   const void* src, DataType src_dtype) {
+  HT_RUNTIME_ERROR_IF(_fd < 0) << _path << " has been closed";
+  const auto& info = GetInfo(name);
+  auto src_item_size = DataType2Size(src_dtype);
+  auto dst_item_size = DataType2Size(info.dtype);
+  ConvertDataType(nullptr, src_dtype, nullptr, info.dtype, 0);
+  auto runs = MakeSliceRuns(info.shape, slice, dst_item_size);
+  const auto* src_bytes = static_cast<const char*>(src);
+  size_t file_offset = _data_offset + info.begin;
+  bool need_convert = src_dtype != info.dtype;
+  std::atomic<bool> failed{false};
+  int64_t num_runs = runs.size();
+  #pragma omp parallel num_threads(_num_threads)
+  {
+    std::vector<char> staging;
+    #pragma omp for schedule(dynamic)
+    for (int64_t i = 0; i < num_runs; i++) {
+      const auto& run = runs[i];
+      const char* data = src_bytes + run.dst * src_item_size;
+      size_t num_bytes = run.numel * dst_item_size;
+      if (need_convert) {
+        staging.resize(num_bytes);
+        ConvertDataType(data, src_dtype, staging.data(), info.dtype, run.numel);
+        data = staging.data();
+      }
+      size_t written = 0;
+      while (written < num_bytes) {
+        auto ret = pwrite(_fd, data + written, num_bytes - written,
+                          file_offset + run.src * dst_item_size + written);
+        if (ret <= 0) {
+          failed = true;
+          break;
+        }
+        written += ret;
+      }
+    }
+  }
+  HT_RUNTIME_ERROR_IF(failed)
+    << "Failed to write " << name << " to " << _path << ": " << std::strerror(errno);
+}
+
+void SafeTensorsWriter::SaveShard(const std::string& name, const DistributedStates& ds,
+                                  int32_t device_index, const NDArray& src) {
+  const auto& info = GetInfo(name);
+  // duplicate的shard只写一份
+  if (ds.is_valid() && ds.get_dim(-1) > 1 &&
+      ds.map_device_to_state_index(device_index)[-1] != 0)
+    return;
+  auto slice = GetLocalTensorSlice(info.shape, ds, device_index);
+  HT_VALUE_ERROR_IF(slice.shape != src->shape())
+    << "Shard of " << name << " has shape " << slice.shape
+    << " under ds " << ds.ds_info() << ", but the source has shape " << src->shape();
+  NDArray host = src;
+  if (!host->is_cpu())
+    host = NDArray::cpu(host, kBlockingStream);
+  if (!host->is_contiguous())
+    host = NDArray::contiguous(host, kBlockingStream);
+  WriteSlice(name, slice, host->raw_data_ptr(), host->dtype());
+}
+
+void SafeTensorsWriter::Finish() {
+  if (_fd < 0)
+    return;
+  HT_RUNTIME_ERROR_IF(fsync(_fd) != 0)
+    << "Failed to flush " << _path << ": " << std::strerror(errno);
+  close(_fd);
+  _fd = -1;
+}
+
+} // namespace graph
+} // namespace hydraulis
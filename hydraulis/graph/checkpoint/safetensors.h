@@ -0,0 +1,159 @@
+#pragma once
+
+#include "hydraulis/graph/common.h"
+#include "hydraulis/graph/distributed_states.h"
+#include "hydraulis/graph/init/initializer.h"
+#include "hydraulis/core/ndarray.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+// safetensors格式：8字节（小端）的header长度 + json header + 数据
+// 数据按照header中的data_offsets（相对于数据段起始位置）存放，每个tensor都是行优先连续的
+struct SafeTensorInfo {
+  DataType dtype;
+  HTShape shape;
+  size_t begin;
+  size_t end;
+};
+
+// 全局tensor中的一个切片，begin与shape均为全局坐标
+struct TensorSlice {
+  HTShape begin;
+  HTShape shape;
+};
+
+// 根据ds计算device_index上的rank持有的切片（与Split算子的切分方式一致，均匀切分）
+TensorSlice GetLocalTensorSlice(const HTShape& global_shape,
+                                const DistributedStates& ds,
+                                int32_t device_index);
+
+// 将n个src_dtype的元素转换为dst_dtype写入dst
+void ConvertDataType(const void* src, DataType src_dtype,
+                     void* dst, DataType dst_dtype, size_t numel);
+
+// 通过mmap读取safetensors文件，每个rank只读取自己的shard所在的字节区间
+// 读取与dtype转换按照连续的行划分后多线程执行，直接写入目标内存
+class SafeTensorsReader {
+ public:
+  explicit SafeTensorsReader(const std::string& path, int num_threads = 0);
+
+  ~SafeTensorsReader();
+
+  SafeTensorsReader(const SafeTensorsReader&) = delete;
+  SafeTensorsReader& operator=(const SafeTensorsReader&) = delete;
+
+  bool HasTensor(const std::string& name) const {
+    return _infos.find(name) != _infos.end();
+  }
+
+  const SafeTensorInfo& GetInfo(const std::string& name) const {
+    auto it = _infos.find(name);
+    HT_VALUE_ERROR_IF(it == _infos.end())
+      << "Cannot find tensor " << name << " in " << _path;
+    return it->second;
+  }
+
+  std::vector<std::string> keys() const;
+
+  const std::unordered_map<std::string, std::string>& metadata() const {
+    return _metadata;
+  }
+
+  // 读取切片并转换为dst_dtype，dst为行优先连续的host内存
+  void ReadSlice(const std::string& name, const TensorSlice& slice,
+                 void* dst, DataType dst_dtype) const;
+
+  // 读取ds下device_index对应的shard写入dst（shape须等于shard的shape）
+  // dst不在host上或不连续时先读入host上的buffer再拷贝
+  void LoadShard(const std::string& name, const DistributedStates& ds,
+                 int32_t device_index, NDArray& dst) const;
+
+ protected:
+  std::string _path;
+  int _num_threads;
+  int _fd{-1};
+  void* _mapped{nullptr};
+  size_t _file_size{0};
+  const char* _data{nullptr};
+  size_t _data_size{0};
+  std::unordered_map<std::string, SafeTensorInfo> _infos;
+  std::unordered_map<std::string, std::string> _metadata;
+};
+
+// 延迟到variable真正alloc时才读取的initializer
+// exec graph在param bucket分配之后对其中的view调用Init，shard直接写入bucket的storage，
+// 不需要先读入一份完整的host NDArray再拷贝；reader（以及mmap）由所有副本共享
+class SafeTensorsShardInitializer : public Initializer {
+ public:
+  SafeTensorsShardInitializer(std::shared_ptr<const SafeTensorsReader> reader,
+                              std::string name, DistributedStates ds, int32_t device_index)
+  : Initializer(), _reader(std::move(reader)), _name(std::move(name)),
+    _ds(std::move(ds)), _device_index(device_index) {}
+
+  void Init(NDArray& data, uint64_t seed = 0, const HTShape& global_shape = HTShape(),
+            StreamIndex stream_id = NDArray::DEFAULT_STREAM) const override {
+    (void) seed;
+    (void) global_shape;
+    (void) stream_id;
+    _reader->LoadShard(_name, _ds, _device_index, data);
+  }
+
+  Initializer* copy() const override {
+    return new SafeTensorsShardInitializer(_reader, _name, _ds, _device_index);
+  }
+
+ protected:
+  std::shared_ptr<const SafeTensorsReader> _reader;
+  std::string _name;
+  DistributedStates _ds;
+  int32_t _device_index;
+};
+
+// 与SafeTensorsReader对应的分片写入
+// 所有rank使用相同的全局tensor列表构造，header完全相同，每个rank通过pwrite把自己的shard写入对应的字节区间
+// 对于duplicate的shard，只有dup group index为0的rank写入
+class SafeTensorsWriter {
+ public:
+  SafeTensorsWriter(const std::string& path,
+                    const std::vector<std::pair<std::string, NDArrayMeta>>& global_metas,
+                    const std::unordered_map<std::string, std::string>& metadata = {},
+                    int num_threads = 0);
+
+  ~SafeTensorsWriter();
+
+  SafeTensorsWriter(const SafeTensorsWriter&) = delete;
+  SafeTensorsWriter& operator=(const SafeTensorsWriter&) = delete;
+
+  const SafeTensorInfo& GetInfo(const std::string& name) const {
+    auto it = _infos.find(name);
+    HT_VALUE_ERROR_IF(it == _infos.end())
+      << "Tensor " << name << " is not declared in " << _path;
+    return it->second;
+  }
+
+  // 将行优先连续的src（src_dtype）写入切片，转换为文件中的dtype
+  void WriteSlice(const std::string& name, const TensorSlice& slice,
+                  const void* src, DataType src_dtype);
+
+  // 写入ds下device_index对应的shard，src不在host上时先拷贝到host
+  void SaveShard(const std::string& name, const DistributedStates& ds,
+                 int32_t device_index, const NDArray& src);
+
+  // 刷盘并关闭文件
+  void Finish();
+
+ protected:
+  std::string _path;
+  int _num_threads;
+  int _fd{-1};
+  size_t _data_offset{0};
+  std::unordered_map<std::string, SafeTensorInfo> _infos;
+};
+
+} // namespace graph
+} // namespace hydraulis
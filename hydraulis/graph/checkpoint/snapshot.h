@@ -0,0 +1,100 @@
+#pragma once
+
+#include "hydraulis/graph/common.h"
+#include "hydraulis/utils/task_queue.h"
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+struct SnapshotStats {
+  int64_t step{0};
+  size_t num_bytes{0};
+  double stall_ms{0}; // 训练被阻塞的时间（等待空闲的staging buffer以及完成D2H拷贝）
+  double save_ms{0}; // 后台序列化与fsync的时间
+};
+
+std::ostream& operator<<(std::ostream& os, const SnapshotStats& stats);
+
+// buffer中的一个tensor：在buffer中的字节偏移以及其本地shard在全局tensor中的位置
+struct SnapshotEntry {
+  std::string name;
+  DataType dtype;
+  HTShape shape;
+  HTShape global_shape;
+  HTShape slice_begin;
+  size_t byte_offset;
+};
+
+// 一块连续的buffer（如param bucket）以及其中的各个tensor
+struct SnapshotBuffer {
+  NDArray data;
+  std::vector<SnapshotEntry> entries;
+};
+
+// 异步snapshot checkpoint
+// 1、在step边界把param与opt-states的buckets在专用stream（kD2HStream）上拷贝到host上的staging buffer
+// 2、host等待拷贝完成后才返回，之后的更新不会改写staging buffer中的数据
+// 3、后台线程把各个tensor的本地shard序列化为safetensors文件并fsync
+// staging buffer共有num_slots份（默认double buffer），都在使用中时需要等待最早的一次保存完成
+class SnapshotCheckpointer {
+ public:
+  SnapshotCheckpointer(size_t num_slots = 2, int num_io_threads = 0);
+
+  ~SnapshotCheckpointer();
+
+  // 发起一次snapshot，文件写入dir/step_<step>/rank_<rank>.safetensors
+  // 返回本次snapshot阻塞训练的时间（ms）
+  double Snapshot(const std::unordered_map<DataType, std::shared_ptr<ParamBuckets>>& buckets_map,
+                  const std::string& dir, int64_t step);
+
+  // 发起一次snapshot，buffers（均在device上）写入path.safetensors
+  double Snapshot(const std::vector<SnapshotBuffer>& buffers, const Device& device,
+                  const std::string& path, int64_t step);
+
+  // 从已完成的snapshot（path.safetensors）中把各个entry读回buffers
+  static void Restore(const std::vector<SnapshotBuffer>& buffers, const std::string& path,
+                      int num_threads = 0);
+
+  // 等待所有后台的保存完成
+  void Wait();
+
+  std::vector<SnapshotStats> stats() const {
+    std::lock_guard<std::mutex> lock(_stats_mutex);
+    return _stats;
+  }
+
+ protected:
+  struct Slot {
+    std::shared_ptr<NDArrayStorage> storage;
+    size_t capacity{0};
+    std::shared_future<void> done;
+  };
+
+  std::shared_ptr<NDArrayStorage> AllocHostStorage(const Device& device, size_t num_bytes);
+
+  // entries的byte_offset为在slot的storage中的偏移
+  void Save(const Slot& slot, const std::vector<SnapshotEntry>& entries,
+            const std::string& path, int64_t step, size_t stats_idx);
+
+  static constexpr size_t kHostAlignment = 256;
+
+  std::vector<Slot> _slots;
+  size_t _next_slot{0};
+  int _num_io_threads;
+  std::unique_ptr<TaskQueue> _io_queue;
+  mutable std::mutex _stats_mutex;
+  std::vector<SnapshotStats> _stats;
+};
+
+// 在CPU上检查snapshot/restore的往返：不依赖图与通信，直接构造host上的buffer，
+// snapshot之后读回到清零的buffer中逐字节比较，并检查没有完成标记的snapshot不能被加载
+// dir为存放snapshot的目录，不一致时直接报错，返回本次snapshot的统计
+SnapshotStats CheckSnapshotRoundTrip(const std::string& dir);
+
+} // namespace graph
+} // namespace hydraulis
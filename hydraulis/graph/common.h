@@ -88,6 +88,8 @@ class SwitchExecGraph;
 
 class ParamBuffer;
 class ParamBuckets;
+enum class SWITCH_MODE : int8_t;
+enum class SWITCH_LEVEL : int8_t;
 
 #define HT_MAX_NUM_MICRO_BATCHES (64)
 } // namespace graph
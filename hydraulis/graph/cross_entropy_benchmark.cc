@@ -0,0 +1,197 @@
+#include "hydraulis/graph/cross_entropy_benchmark.h"
+#include "hydraulis/core/ndarray.h"
+#include "hydraulis/graph/ops/kernel_links.h"
+#include "hydraulis/impl/utils/omp_utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+namespace hydraulis {
+namespace graph {
+
+CrossEntropyBenchmarkResult BenchmarkCrossEntropyKernels(size_t num_tokens, size_t vocab,
+                                                         size_t token_chunk, size_t num_iters) {
+  HT_VALUE_ERROR_IF(num_tokens == 0 || vocab == 0 || num_iters == 0)
+    << "Cannot benchmark the cross entropy kernels with num_tokens = " << num_tokens
+    << ", vocab = " << vocab << " and num_iters = " << num_iters;
+  Device cpu(kCPU);
+  Stream stream(cpu, kBlockingStream);
+  int64_t n = num_tokens, v = vocab;
+  int64_t chunk = token_chunk == 0 ? n : std::min<int64_t>(token_chunk, n);
+  const int64_t ignored_index = -100;
+  using Clock = std::chrono::steady_clock;
+
+  auto logits = NDArray::randn({n, v}, cpu, kFloat32, 0, 2, 1, kBlockingStream);
+  auto labels = NDArray::empty({n}, cpu, kInt64, kBlockingStream);
+  std::mt19937_64 engine(7);
+  std::uniform_int_distribution<int64_t> dist(0, v - 1);
+  for (int64_t i = 0; i < n; i++) {
+    // 每16个token中有一个被忽略（例如padding）
+    labels->data_ptr<int64_t>()[i] = i % 16 == 15 ? ignored_index : dist(engine);
+  }
+  auto grad_loss = NDArray::full({n}, 1.0 / n, cpu, kFloat32, kBlockingStream);
+
+  auto separate_loss = NDArray::empty({n}, cpu, kFloat32, kBlockingStream);
+  auto separate_grad = NDArray::empty({n, v}, cpu, kFloat32, kBlockingStream);
+  auto fused_loss = NDArray::empty({n}, cpu, kFloat32, kBlockingStream);
+  auto workspace = NDArray::empty({n, v}, cpu, kFloat32, kBlockingStream);
+
+  auto run_separate = [&]() {
+    hydraulis::impl::SoftmaxCrossEntropySparseCpu(logits, labels, separate_loss, ignored_index, stream);
+    hydraulis::impl::SoftmaxCrossEntropySparseGradientCpu(logits, labels, grad_loss, separate_grad,
+                                                          ignored_index, stream);
+  };
+  // workspace模拟由lm head产生、之后不再需要的logits，梯度直接覆盖在上面
+  auto run_fused = [&]() {
+    for (int64_t begin = 0; begin < n; begin += chunk) {
+      int64_t rows = std::min(chunk, n - begin);
+      auto logits_chunk = NDArray::slice(workspace, {begin, 0}, {rows, v});
+      auto labels_chunk = NDArray::slice(labels, {begin}, {rows});
+      auto loss_chunk = NDArray::slice(fused_loss, {begin}, {rows});
+      hydraulis::impl::SoftmaxCrossEntropySparseFusedCpu(logits_chunk, labels_chunk, loss_chunk,
+                                                         logits_chunk, ignored_index, 1.0 / n, stream);
+    }
+  };
+  auto reset_workspace = [&]() {
+    std::copy(logits->data_ptr<float>(), logits->data_ptr<float>() + n * v,
+              workspace->data_ptr<float>());
+  };
+
+  CrossEntropyBenchmarkResult result;
+  result.num_threads = hydraulis::omp::OMP_GET_NUM_THREADS();
+  result.separate_extra_bytes = static_cast<size_t>(n * v) * sizeof(float);
+  result.fused_extra_bytes = 0;
+
+  // 预热
+  run_separate();
+  auto start = Clock::now();
+  for (size_t i = 0; i < num_iters; i++)
+    run_separate();
+  result.separate_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / num_iters;
+
+  // 每次运行前都需要恢复logits，恢复的耗时不计入
+  double fused_total_ms = 0;
+  for (size_t i = 0; i <= num_iters; i++) {
+    reset_workspace();
+    start = Clock::now();
+    run_fused();
+    if (i > 0)
+      fused_total_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+  result.fused_ms = fused_total_ms / num_iters;
+
+  const float* loss_a = separate_loss->data_ptr<float>();
+  const float* loss_b = fused_loss->data_ptr<float>();
+  for (int64_t i = 0; i < n; i++)
+    result.max_loss_diff = std::max(result.max_loss_diff, static_cast<double>(std::abs(loss_a[i] - loss_b[i])));
+  const float* grad_a = separate_grad->data_ptr<float>();
+  const float* grad_b = workspace->data_ptr<float>();
+  for (int64_t i = 0; i < n * v; i++)
+    result.max_grad_diff = std::max(result.max_grad_diff, static_cast<double>(std::abs(grad_a[i] - grad_b[i])));
+  return result;
+}
+
+std::vector<CrossEntropyKernelCheck> CheckCrossEntropyKernels(size_t num_tokens, size_t vocab,
+                                                              size_t num_ranks) {
+  HT_VALUE_ERROR_IF(num_tokens == 0 || num_ranks == 0 || vocab < num_ranks)
+    << "Cannot check the cross entropy kernels with num_tokens = " << num_tokens
+    << ", vocab = " << vocab << " and num_ranks = " << num_ranks;
+  Device cpu(kCPU);
+  Stream stream(cpu, kBlockingStream);
+  int64_t n = num_tokens, v = vocab;
+  const int64_t ignored_index = -100;
+
+  auto logits = NDArray::randn({n, v}, cpu, kFloat32, 0, 2, 3, kBlockingStream);
+  auto labels = NDArray::empty({n}, cpu, kInt64, kBlockingStream);
+  std::mt19937_64 engine(11);
+  std::uniform_int_distribution<int64_t> dist(0, v - 1);
+  for (int64_t i = 0; i < n; i++)
+    labels->data_ptr<int64_t>()[i] = i % 7 == 6 ? ignored_index : dist(engine);
+  // kNONE时每行的grad_output不同
+  auto row_grad_output = NDArray::randn({n}, cpu, kFloat32, 0, 1, 5, kBlockingStream);
+  const float grad_output = 0.75f;
+
+  auto max_diff = [](const NDArray& a, const NDArray& b) {
+    const float* x = a->data_ptr<float>();
+    const float* y = b->data_ptr<float>();
+    double diff = 0;
+    for (int64_t i = 0; i < a->numel(); i++)
+      diff = std::max(diff, static_cast<double>(std::abs(x[i] - y[i])));
+    return diff;
+  };
+
+  // 参照：分开的前向与反向
+  auto ref_loss = NDArray::empty({n}, cpu, kFloat32, kBlockingStream);
+  hydraulis::impl::SoftmaxCrossEntropySparseCpu(logits, labels, ref_loss, ignored_index, stream);
+
+  std::vector<CrossEntropyKernelCheck> checks;
+  for (auto reduction : {kNONE, kSUM, kMEAN}) {
+    // 每行对loss的梯度，与SoftmaxCrossEntropySparseGradientOp中broadcast之后的结果相同
+    auto grad_loss = NDArray::empty({n}, cpu, kFloat32, kBlockingStream);
+    for (int64_t i = 0; i < n; i++) {
+      grad_loss->data_ptr<float>()[i] = reduction == kNONE ? row_grad_output->data_ptr<float>()[i]
+                                      : reduction == kSUM ? grad_output : grad_output / n;
+    }
+    std::string reduction_name = reduction == kNONE ? "none" : (reduction == kSUM ? "sum" : "mean");
+    auto ref_grad = NDArray::empty({n, v}, cpu, kFloat32, kBlockingStream);
+    hydraulis::impl::SoftmaxCrossEntropySparseGradientCpu(logits, labels, grad_loss, ref_grad,
+                                                          ignored_index, stream);
+
+    // 融合kernel的梯度只带一个标量系数，kNONE时再逐行乘上grad_output
+    double grad_scale = reduction == kNONE ? 1.0 : grad_loss->data_ptr<float>()[0];
+    auto scale_rows = [&](NDArray& grad) {
+      if (reduction != kNONE)
+        return;
+      float* g = grad->data_ptr<float>();
+      for (int64_t i = 0; i < n; i++)
+        for (int64_t j = 0; j < v; j++)
+          g[i * v + j] *= grad_loss->data_ptr<float>()[i];
+    };
+    for (bool in_place : {false, true}) {
+      auto loss = NDArray::empty({n}, cpu, kFloat32, kBlockingStream);
+      auto pred = NDArray::empty({n, v}, cpu, kFloat32, kBlockingStream);
+      std::copy(logits->data_ptr<float>(), logits->data_ptr<float>() + n * v, pred->data_ptr<float>());
+      auto grad = in_place ? pred : NDArray::empty({n, v}, cpu, kFloat32, kBlockingStream);
+      hydraulis::impl::SoftmaxCrossEntropySparseFusedCpu(pred, labels, loss, grad, ignored_index,
+                                                         grad_scale, stream);
+      scale_rows(grad);
+      checks.push_back({in_place ? "in_place" : "fused", reduction_name,
+                        max_diff(loss, ref_loss), max_diff(grad, ref_grad)});
+    }
+
+    // 按rank切分词表，每个rank单独计算stats，合并后由每行的lse计算本rank的梯度
+    std::vector<NDArray> shards;
+    auto gathered_stats = NDArray::empty({static_cast<int64_t>(num_ranks) * n, 3}, cpu, kFloat32, kBlockingStream);
+    for (size_t r = 0; r < num_ranks; r++) {
+      int64_t begin = v * r / num_ranks, end = v * (r + 1) / num_ranks;
+      auto shard = NDArray::empty({n, end - begin}, cpu, kFloat32, kBlockingStream);
+      for (int64_t i = 0; i < n; i++)
+        std::copy(logits->data_ptr<float>() + i * v + begin, logits->data_ptr<float>() + i * v + end,
+                  shard->data_ptr<float>() + i * (end - begin));
+      auto stats = NDArray::slice(gathered_stats, {static_cast<int64_t>(r) * n, 0}, {n, 3});
+      hydraulis::impl::VocabParallelCrossEntropyStatsCpu(shard, labels, begin, end, ignored_index, stats, stream);
+      shards.push_back(shard);
+    }
+    auto loss = NDArray::empty({n}, cpu, kFloat32, kBlockingStream);
+    auto log_sum_exp = NDArray::empty({n}, cpu, kFloat32, kBlockingStream);
+    hydraulis::impl::VocabParallelCrossEntropyCombineCpu(gathered_stats, labels, ignored_index,
+                                                         loss, log_sum_exp, stream);
+    auto grad = NDArray::empty({n, v}, cpu, kFloat32, kBlockingStream);
+    for (size_t r = 0; r < num_ranks; r++) {
+      int64_t begin = v * r / num_ranks, end = v * (r + 1) / num_ranks;
+      auto shard_grad = NDArray::empty({n, end - begin}, cpu, kFloat32, kBlockingStream);
+      hydraulis::impl::VocabParallelCrossEntropyLogitsGradientCpu(shards[r], log_sum_exp, labels, begin,
+                                                                  ignored_index, grad_loss, shard_grad, stream);
+      for (int64_t i = 0; i < n; i++)
+        std::copy(shard_grad->data_ptr<float>() + i * (end - begin),
+                  shard_grad->data_ptr<float>() + (i + 1) * (end - begin),
+                  grad->data_ptr<float>() + i * v + begin);
+    }
+    checks.push_back({"vocab_parallel", reduction_name, max_diff(loss, ref_loss), max_diff(grad, ref_grad)});
+  }
+  return checks;
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include <string>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+struct CrossEntropyBenchmarkResult {
+  int num_threads{1};
+  // 分开的前向（SoftmaxCrossEntropySparse）与反向（SoftmaxCrossEntropySparseGradient）
+  double separate_ms{0};
+  // 融合kernel按token分块计算loss，梯度原地写在logits上
+  double fused_ms{0};
+  // 分开计算时额外需要的与logits同样大小的梯度buffer，融合计算时为0
+  size_t separate_extra_bytes{0};
+  size_t fused_extra_bytes{0};
+  double max_loss_diff{0};
+  double max_grad_diff{0};
+
+  double speedup() const {
+    return fused_ms == 0 ? 0 : separate_ms / fused_ms;
+  }
+};
+
+// 在CPU上对[num_tokens, vocab]的logits比较分开的前向/反向与融合kernel的耗时，
+// 融合kernel每次处理token_chunk个token（0表示一次处理全部），并核对两者的loss与梯度
+CrossEntropyBenchmarkResult BenchmarkCrossEntropyKernels(size_t num_tokens = 2048,
+                                                         size_t vocab = 131072,
+                                                         size_t token_chunk = 512,
+                                                         size_t num_iters = 3);
+
+struct CrossEntropyKernelCheck {
+  std::string kernel;    // fused、in_place或vocab_parallel
+  std::string reduction; // none、sum或mean
+  double max_loss_diff{0};
+  double max_grad_diff{0};
+};
+
+// 在CPU上核对各个sparse cross entropy kernel与分开的前向/反向kernel的loss与梯度，
+// 每种reduction分别检查：融合kernel（单独的梯度buffer与原地覆盖logits）、
+// 按num_ranks切分词表后由stats合并lse再重新计算梯度（即VocabParallel与CPU上SoftmaxCrossEntropySparseOp的路径）
+// 每7个token中有一个label为ignored_index
+std::vector<CrossEntropyKernelCheck> CheckCrossEntropyKernels(size_t num_tokens = 64,
+                                                              size_t vocab = 1000,
+                                                              size_t num_ranks = 4);
+
+} // namespace graph
+} // namespace hydraulis
@@ -5,8 +5,11 @@
 #include "hydraulis/graph/ops/kernel_links.h"
 #include "hydraulis/graph/ops/variable.h"
 #include "hydraulis/impl/stream/CPUStream.h"
+#include "hydraulis/impl/random/CPURandomState.h"
+#include <algorithm>
 #include <cmath>
 #include <numeric>
+#include <random>
 
 namespace hydraulis {
 namespace graph {
@@ -47,7 +50,9 @@ void Dataloader::init_states() {
   if (_shuffle) {
     shuffled.resize(_batch_num);
     std::iota(shuffled.begin(), shuffled.end(), 0);
-    std::random_shuffle(shuffled.begin(), shuffled.end());
+    // 使用CPU的随机种子，设置种子（或开启确定性模式）后shuffle的结果可以复现
+    std::mt19937_64 engine(hydraulis::impl::GenNextRandomSeed());
+    std::shuffle(shuffled.begin(), shuffled.end(), engine);
     HT_LOG_INFO << shuffled;
   }
   for (int i = 0; i < _queue_size; ++i) {
@@ -0,0 +1,427 @@
+#include "hydraulis/graph/data/sequence_packing.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <set>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+  // 每步局部搜索中尝试swap的（代价最小的）bin的个数
+  constexpr size_t kSwapTargets = 8;
+  constexpr double kRelativeEps = 1e-12;
+
+  struct PackingState {
+    std::vector<int32_t> assignment;
+    std::vector<double> bin_costs; // 不含fixed
+    std::vector<int64_t> bin_tokens;
+    std::vector<int64_t> bin_seqs;
+
+    explicit PackingState(size_t num_bins)
+    : bin_costs(num_bins, 0), bin_tokens(num_bins, 0), bin_seqs(num_bins, 0) {}
+
+    double MaxCost() const {
+      return bin_costs.empty() ? 0 : *std::max_element(bin_costs.begin(), bin_costs.end());
+    }
+  };
+
+  class Packer {
+   public:
+    Packer(const std::vector<int64_t>& seqlens,
+           const SequencePackingCostModel& model,
+           const SequencePackingConstraints& constraints)
+    : _tokens(seqlens), _constraints(constraints), _costs(seqlens.size()),
+      _order(seqlens.size()) {
+      for (size_t i = 0; i < seqlens.size(); i++)
+        _costs[i] = model.SeqCost(seqlens[i]);
+      // 按代价从大到小，代价相同时按token数从大到小
+      std::iota(_order.begin(), _order.end(), 0);
+      std::sort(_order.begin(), _order.end(), [&](int32_t a, int32_t b) {
+        return _costs[a] != _costs[b] ? _costs[a] > _costs[b] : _tokens[a] > _tokens[b];
+      });
+    }
+
+    // 加入d_tokens个token与d_seqs个序列后是否仍满足容量约束
+    // 已经超出容量的bin允许不增加的改动
+    bool Fits(const PackingState& state, int32_t bin, int64_t d_tokens, int64_t d_seqs) const {
+      if (_constraints.max_tokens_per_bin > 0 && d_tokens > 0 &&
+          state.bin_tokens[bin] + d_tokens > _constraints.max_tokens_per_bin)
+        return false;
+      if (_constraints.max_seqs_per_bin > 0 && d_seqs > 0 &&
+          state.bin_seqs[bin] + d_seqs > _constraints.max_seqs_per_bin)
+        return false;
+      return true;
+    }
+
+    bool Feasible(const PackingState& state) const {
+      for (size_t bin = 0; bin < _constraints.num_bins; bin++) {
+        if (_constraints.max_tokens_per_bin > 0 && state.bin_tokens[bin] > _constraints.max_tokens_per_bin)
+          return false;
+        if (_constraints.max_seqs_per_bin > 0 && state.bin_seqs[bin] > _constraints.max_seqs_per_bin)
+          return false;
+      }
+      return true;
+    }
+
+    void Assign(PackingState& state, int32_t seq, int32_t bin) const {
+      state.assignment[seq] = bin;
+      state.bin_costs[bin] += _costs[seq];
+      state.bin_tokens[bin] += _tokens[seq];
+      state.bin_seqs[bin]++;
+    }
+
+    void Unassign(PackingState& state, int32_t seq) const {
+      int32_t bin = state.assignment[seq];
+      state.bin_costs[bin] -= _costs[seq];
+      state.bin_tokens[bin] -= _tokens[seq];
+      state.bin_seqs[bin]--;
+      state.assignment[seq] = -1;
+    }
+
+    PackingState LPT() const {
+      size_t num_bins = _constraints.num_bins;
+      PackingState state(num_bins);
+      state.assignment.assign(_tokens.size(), -1);
+      using Entry = std::pair<double, int32_t>;
+      std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+      for (size_t bin = 0; bin < num_bins; bin++)
+        heap.push({0, static_cast<int32_t>(bin)});
+      std::vector<Entry> skipped;
+      for (int32_t seq : _order) {
+        // 代价最小且放得下的bin，都放不下时放入代价最小的bin（之后由Repair处理）
+        int32_t target = -1;
+        while (!heap.empty()) {
+          auto entry = heap.top();
+          heap.pop();
+          if (Fits(state, entry.second, _tokens[seq], 1)) {
+            target = entry.second;
+            break;
+          }
+          skipped.push_back(entry);
+        }
+        if (target == -1) {
+          target = skipped.front().second;
+          skipped.erase(skipped.begin());
+        }
+        Assign(state, seq, target);
+        heap.push({state.bin_costs[target], target});
+        for (const auto& entry : skipped)
+          heap.push(entry);
+        skipped.clear();
+      }
+      return state;
+    }
+
+    // Balanced largest differencing method (Michiels et al.)：
+    // 将排好序的序列每num_bins个一组作为初始的划分（每个bin一个序列），
+    // 每次取出max - min最大的两个划分，将一个的大bin与另一个的小bin合并，直到只剩一个划分。
+    // 每个子集的序列用链表串起来，合并为O(1)。不考虑容量约束。
+    PackingState KarmarkarKarp() const {
+      size_t num_bins = _constraints.num_bins;
+      size_t num_seqs = _tokens.size();
+      struct Subset {
+        double cost{0};
+        int32_t head{-1};
+        int32_t tail{-1};
+      };
+      using Partition = std::vector<Subset>; // 按cost从大到小
+      std::vector<int32_t> next(num_seqs, -1);
+      std::vector<Partition> partitions;
+      partitions.reserve((num_seqs + num_bins - 1) / num_bins + 1);
+      for (size_t begin = 0; begin < num_seqs; begin += num_bins) {
+        Partition partition(num_bins);
+        for (size_t i = 0; i < num_bins && begin + i < num_seqs; i++) {
+          int32_t seq = _order[begin + i];
+          partition[i] = {_costs[seq], seq, seq};
+        }
+        partitions.push_back(std::move(partition));
+      }
+      auto spread = [](const Partition& p) {
+        return p.front().cost - p.back().cost;
+      };
+      using Entry = std::pair<double, size_t>;
+      std::priority_queue<Entry> heap;
+      for (size_t i = 0; i < partitions.size(); i++)
+        heap.push({spread(partitions[i]), i});
+      while (heap.size() > 1) {
+        auto& a = partitions[heap.top().second];
+        heap.pop();
+        size_t b_id = heap.top().second;
+        auto& b = partitions[b_id];
+        heap.pop();
+        for (size_t i = 0; i < num_bins; i++) {
+          auto& dst = b[num_bins - 1 - i];
+          const auto& src = a[i];
+          if (src.head == -1)
+            continue;
+          if (dst.head == -1) {
+            dst.head = src.head;
+          } else {
+            next[dst.tail] = src.head;
+          }
+          dst.tail = src.tail;
+          dst.cost += src.cost;
+        }
+        std::sort(b.begin(), b.end(), [](const Subset& x, const Subset& y) {
+          return x.cost > y.cost;
+        });
+        Partition().swap(a);
+        heap.push({spread(b), b_id});
+      }
+      PackingState state(num_bins);
+      state.assignment.assign(num_seqs, -1);
+      if (!heap.empty()) {
+        const auto& partition = partitions[heap.top().second];
+        for (size_t bin = 0; bin < num_bins; bin++)
+          for (int32_t seq = partition[bin].head; seq != -1; seq = next[seq])
+            Assign(state, seq, static_cast<int32_t>(bin));
+      }
+      return state;
+    }
+
+    // 将超出容量的bin中token数最多的序列移到代价最小且放得下的bin中
+    void Repair(PackingState& state) const {
+      if (_constraints.max_tokens_per_bin <= 0 && _constraints.max_seqs_per_bin <= 0)
+        return;
+      size_t num_bins = _constraints.num_bins;
+      std::vector<std::vector<int32_t>> members(num_bins);
+      for (int32_t seq : _order)
+        members[state.assignment[seq]].push_back(seq);
+      auto overflows = [&](size_t bin) {
+        return (_constraints.max_tokens_per_bin > 0 && state.bin_tokens[bin] > _constraints.max_tokens_per_bin) ||
+          (_constraints.max_seqs_per_bin > 0 && state.bin_seqs[bin] > _constraints.max_seqs_per_bin);
+      };
+      for (size_t src = 0; src < num_bins; src++) {
+        if (!overflows(src))
+          continue;
+        auto& seqs = members[src];
+        std::sort(seqs.begin(), seqs.end(), [&](int32_t a, int32_t b) {
+          return _tokens[a] != _tokens[b] ? _tokens[a] > _tokens[b] : a < b;
+        });
+        for (int32_t seq : seqs) {
+          if (!overflows(src))
+            break;
+          int32_t target = -1;
+          for (size_t bin = 0; bin < num_bins; bin++) {
+            if (bin == src || !Fits(state, bin, _tokens[seq], 1))
+              continue;
+            if (target == -1 || state.bin_costs[bin] < state.bin_costs[target])
+              target = static_cast<int32_t>(bin);
+          }
+          if (target == -1)
+            continue;
+          Unassign(state, seq);
+          Assign(state, seq, target);
+        }
+      }
+    }
+
+    // 不断降低代价最大的bin：先尝试将其中一个序列移到代价较小的bin，再尝试与代价较小的bin交换一对序列。
+    // 每次改动都使两个bin的代价的最大值严格下降，因此一定会终止。
+    size_t LocalSearch(PackingState& state, size_t max_steps) const {
+      size_t num_bins = _constraints.num_bins;
+      if (num_bins <= 1)
+        return 0;
+      // 每个bin中的序列按(cost, seq)有序存放，move时的插入与删除为O(n / num_bins)的memmove，
+      // 比逐个节点分配的std::set快得多
+      using Entry = std::pair<double, int32_t>;
+      std::vector<std::vector<Entry>> members(num_bins);
+      for (size_t seq = 0; seq < _tokens.size(); seq++)
+        members[state.assignment[seq]].push_back({_costs[seq], static_cast<int32_t>(seq)});
+      for (auto& entries : members)
+        std::sort(entries.begin(), entries.end());
+      std::set<Entry> bins;
+      for (size_t bin = 0; bin < num_bins; bin++)
+        bins.insert({state.bin_costs[bin], static_cast<int32_t>(bin)});
+
+      auto move = [&](int32_t seq, int32_t dst) {
+        int32_t src = state.assignment[seq];
+        Entry entry{_costs[seq], seq};
+        bins.erase({state.bin_costs[src], src});
+        bins.erase({state.bin_costs[dst], dst});
+        auto& src_entries = members[src];
+        src_entries.erase(std::lower_bound(src_entries.begin(), src_entries.end(), entry));
+        Unassign(state, seq);
+        Assign(state, seq, dst);
+        auto& dst_entries = members[dst];
+        dst_entries.insert(std::lower_bound(dst_entries.begin(), dst_entries.end(), entry), entry);
+        bins.insert({state.bin_costs[src], src});
+        bins.insert({state.bin_costs[dst], dst});
+      };
+      // 对与key最接近的（至多）两个元素调用fn
+      auto for_neighbors = [](const std::vector<Entry>& entries, double key, auto&& fn) {
+        auto it = std::lower_bound(entries.begin(), entries.end(), Entry{key, -1});
+        if (it != entries.end())
+          fn(it->first, it->second);
+        if (it != entries.begin())
+          fn(std::prev(it)->first, std::prev(it)->second);
+      };
+
+      size_t step = 0;
+      for (; step < max_steps; step++) {
+        int32_t max_bin = std::prev(bins.end())->second;
+        double max_cost = state.bin_costs[max_bin];
+        double eps = kRelativeEps * std::max(1.0, max_cost);
+        bool improved = false;
+
+        // move：序列的代价x需要满足0 < x < gap，x越接近gap / 2越好
+        for (const auto& entry : bins) {
+          double cost = entry.first;
+          int32_t bin = entry.second;
+          double gap = max_cost - cost;
+          if (bin == max_bin || gap <= eps)
+            break;
+          int32_t best = -1;
+          double best_max = max_cost;
+          for_neighbors(members[max_bin], gap / 2, [&](double x, int32_t seq) {
+            if (x <= eps || x >= gap - eps || !Fits(state, bin, _tokens[seq], 1))
+              return;
+            double new_max = std::max(max_cost - x, cost + x);
+            if (new_max < best_max) {
+              best_max = new_max;
+              best = seq;
+            }
+          });
+          if (best != -1) {
+            move(best, bin);
+            improved = true;
+            break;
+          }
+        }
+
+        // swap：max_bin中的a与bin中的b交换，需要满足0 < a - b < gap
+        if (!improved) {
+          size_t num_tried = 0;
+          for (auto it = bins.begin(); it != bins.end() && num_tried < kSwapTargets; ++it, num_tried++) {
+            int32_t bin = it->second;
+            double gap = max_cost - it->first;
+            if (bin == max_bin || gap <= eps)
+              break;
+            int32_t best_a = -1, best_b = -1;
+            double best_max = max_cost;
+            for (const auto& entry : members[max_bin]) {
+              double a_cost = entry.first;
+              int32_t a = entry.second;
+              if (a_cost <= eps)
+                continue;
+              for_neighbors(members[bin], a_cost - gap / 2, [&](double b_cost, int32_t b) {
+                double delta = a_cost - b_cost;
+                if (delta <= eps || delta >= gap - eps)
+                  return;
+                int64_t d_tokens = _tokens[a] - _tokens[b];
+                if (!Fits(state, bin, d_tokens, 0) || !Fits(state, max_bin, -d_tokens, 0))
+                  return;
+                double new_max = std::max(max_cost - delta, it->first + delta);
+                if (new_max < best_max) {
+                  best_max = new_max;
+                  best_a = a;
+                  best_b = b;
+                }
+              });
+            }
+            if (best_a != -1) {
+              move(best_a, bin);
+              move(best_b, max_bin);
+              improved = true;
+              break;
+            }
+          }
+        }
+
+        if (!improved)
+          break;
+      }
+      return step;
+    }
+
+    // 先比较是否满足容量约束，再比较最大代价
+    bool Better(const PackingState& a, bool a_feasible, const PackingState& b, bool b_feasible) const {
+      if (a_feasible != b_feasible)
+        return a_feasible;
+      return a.MaxCost() < b.MaxCost();
+    }
+
+    const std::vector<double>& costs() const {
+      return _costs;
+    }
+
+   private:
+    const std::vector<int64_t>& _tokens;
+    const SequencePackingConstraints& _constraints;
+    std::vector<double> _costs;
+    std::vector<int32_t> _order;
+  };
+} // namespace
+
+std::ostream& operator<<(std::ostream& os, const SequencePackingAlgorithm& algorithm) {
+  switch (algorithm) {
+    case SequencePackingAlgorithm::AUTO: os << "AUTO"; break;
+    case SequencePackingAlgorithm::LPT: os << "LPT"; break;
+    case SequencePackingAlgorithm::KARMARKAR_KARP: os << "KARMARKAR_KARP"; break;
+    default: os << "UNKNOWN(" << static_cast<int>(algorithm) << ")";
+  }
+  return os;
+}
+
+SequencePackingResult PackSequences(const std::vector<int64_t>& seqlens,
+                                    const SequencePackingCostModel& model,
+                                    const SequencePackingConstraints& constraints,
+                                    SequencePackingAlgorithm algorithm,
+                                    size_t max_local_search_steps) {
+  auto start = std::chrono::steady_clock::now();
+  HT_VALUE_ERROR_IF(constraints.num_bins == 0)
+    << "num_bins should be positive";
+  HT_VALUE_ERROR_IF(constraints.num_bins > static_cast<size_t>(std::numeric_limits<int32_t>::max()) ||
+                    seqlens.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max()))
+    << "Too many sequences or bins: " << seqlens.size() << " sequences and " << constraints.num_bins << " bins";
+  for (auto seqlen : seqlens)
+    HT_VALUE_ERROR_IF(seqlen < 0)
+      << "Sequence lengths should be non-negative, got " << seqlen;
+
+  Packer packer(seqlens, model, constraints);
+  std::vector<SequencePackingAlgorithm> candidates;
+  if (algorithm == SequencePackingAlgorithm::AUTO)
+    candidates = {SequencePackingAlgorithm::LPT, SequencePackingAlgorithm::KARMARKAR_KARP};
+  else
+    candidates = {algorithm};
+
+  SequencePackingResult result;
+  PackingState best(constraints.num_bins);
+  bool best_feasible = false;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    PackingState state = candidates[i] == SequencePackingAlgorithm::LPT ? packer.LPT() : packer.KarmarkarKarp();
+    packer.Repair(state);
+    size_t steps = packer.LocalSearch(state, max_local_search_steps);
+    bool feasible = packer.Feasible(state);
+    if (i == 0 || packer.Better(state, feasible, best, best_feasible)) {
+      best = std::move(state);
+      best_feasible = feasible;
+      result.algorithm = candidates[i];
+      result.local_search_steps = steps;
+    }
+  }
+
+  double total_cost = 0, max_seq_cost = 0;
+  for (double cost : packer.costs()) {
+    total_cost += cost;
+    max_seq_cost = std::max(max_seq_cost, cost);
+  }
+  result.assignment = std::move(best.assignment);
+  result.bin_costs = std::move(best.bin_costs);
+  for (auto& cost : result.bin_costs)
+    cost += model.fixed;
+  result.bin_tokens = std::move(best.bin_tokens);
+  result.bin_seqs = std::move(best.bin_seqs);
+  result.max_cost = *std::max_element(result.bin_costs.begin(), result.bin_costs.end());
+  result.lower_bound = std::max(total_cost / constraints.num_bins, max_seq_cost) + model.fixed;
+  result.feasible = best_feasible;
+  result.elapsed_ms = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+// 一个packed sequence（即一个bin）的代价 = fixed + Σ (quadratic * s^2 + linear * s)
+// varlen attention中每个序列只与自身做attention，因此平方项按照packing前的每个序列分别计算
+struct SequencePackingCostModel {
+  double quadratic{0};
+  double linear{1};
+  double fixed{0};
+
+  double SeqCost(int64_t seqlen) const {
+    return quadratic * static_cast<double>(seqlen) * seqlen + linear * seqlen;
+  }
+};
+
+struct SequencePackingConstraints {
+  size_t num_bins{1};
+  int64_t max_tokens_per_bin{0}; // 0表示不限制
+  int64_t max_seqs_per_bin{0};   // 0表示不限制
+};
+
+enum class SequencePackingAlgorithm : int8_t {
+  AUTO = 0,       // 两种初始解都做局部搜索，取更好的
+  LPT,            // 按代价从大到小放入当前代价最小（且放得下）的bin
+  KARMARKAR_KARP, // balanced largest differencing，每次合并差值最大的两个划分
+};
+
+std::ostream& operator<<(std::ostream& os, const SequencePackingAlgorithm& algorithm);
+
+struct SequencePackingResult {
+  std::vector<int32_t> assignment; // 每个序列所在的bin
+  std::vector<double> bin_costs;
+  std::vector<int64_t> bin_tokens;
+  std::vector<int64_t> bin_seqs;
+  double max_cost{0};
+  double lower_bound{0};           // max(平均代价, 最大的单个序列) + fixed
+  bool feasible{true};             // 是否满足容量约束
+  SequencePackingAlgorithm algorithm{SequencePackingAlgorithm::AUTO}; // 最终结果的初始解
+  size_t local_search_steps{0};
+  double elapsed_ms{0};
+};
+
+// 将序列分配到num_bins个bin中，使得代价最大的bin的代价最小
+// 先用LPT与Karmarkar-Karp得到初始解，再对代价最大的bin做move与swap的局部搜索；
+// 容量约束无法满足时尽量减少超出的部分，并将feasible置为false。
+// 时间复杂度约为O(n log n + steps * (n / num_bins) * log n)，10^5个序列时在毫秒级
+SequencePackingResult PackSequences(const std::vector<int64_t>& seqlens,
+                                    const SequencePackingCostModel& model,
+                                    const SequencePackingConstraints& constraints,
+                                    SequencePackingAlgorithm algorithm = SequencePackingAlgorithm::AUTO,
+                                    size_t max_local_search_steps = 10000);
+
+} // namespace graph
+} // namespace hydraulis
@@ -1,6 +1,7 @@
 #include "hydraulis/graph/define_and_run_graph.h"
 #include "hydraulis/graph/executable_graph.h"
 #include "hydraulis/graph/switch_exec_graph.h"
+#include "hydraulis/graph/host_overhead.h"
 #include "hydraulis/graph/ops/variable.h"
 #include "hydraulis/graph/ops/Quantization.h"
 #include "hydraulis/graph/ops/optimizer_update.h"
@@ -10,6 +11,9 @@
 #include "hydraulis/impl/communication/nccl_comm_group.h"
 #include "hydraulis/graph/recompute/recompute.h"
 #include "hydraulis/graph/offload/activation_cpu_offload.h"
+#include "hydraulis/graph/offload/optimizer_cpu_offload.h"
+#include "hydraulis/graph/grad_bucket.h"
+#include "hydraulis/graph/micro_batch_scheduler.h"
 #include "hydraulis/impl/memory/CUDACachingMemoryPool.cuh"
 #include <queue>
 
@@ -299,6 +303,7 @@ void DefineAndRunGraph::DeducePipeline(size_t compute_strategy_id, int32_t pipel
 void DefineAndRunGraph::DeduceShapePlan(ExecGraphPlan& exec_graph_plan,
                                         const FeedDict& feed_dict,
                                         Tensor2ShapeMap& feed_dict_shape) {
+  HostPhaseTimer phase_timer(HostPhase::DEDUCE_SHAPE_PLAN);
   // *the logic of inferring the very first shape plan is in Instantiate()
   // that is because MakeOp can handle most of the cases automatically
   // InferShapePlan just aims to expand the shape plan pool for the data packing setting
@@ -548,6 +553,7 @@ DeviceGroupUnion DefineAndRunGraph::DeducePlacementGroup(Operator& op, Op2DGUnio
 void DefineAndRunGraph::Instantiate(OpRefList&& global_topo,
                                     Tensor2ShapeMap&& shape_plan,
                                     int32_t pipeline_num) {
+  HostPhaseTimer phase_timer(HostPhase::INSTANTIATE);
 
   // deprecated: Test Case - 手动切换并行方案（验证切换时间）
   char* env = std::getenv("HYDRAULIS_PARALLEL_CHANGE_TEST");
@@ -575,6 +581,8 @@ void DefineAndRunGraph::Instantiate(OpRefList&& global_topo,
   */
   // TODO: better compatibility with hot switch and quantization
   std::unordered_map<DataType, std::shared_ptr<ParamBuckets>> origin_param_and_optimizer_buckets_map;
+  std::unordered_map<DataType, std::shared_ptr<ParamBuckets>> host_optimizer_buckets_map;
+  bool optimizer_offload = OptimizerCPUOffload::enabled();
   std::unordered_map<DataType, std::shared_ptr<ParamBuffer>> transfer_param_buffer_map;
   std::unordered_map<DataType, std::shared_ptr<ParamBuffer>> current_grad_buffer_map;
   std::unordered_map<DataType, std::shared_ptr<ParamBuffer>> accumulate_grad_buffer_map;
@@ -595,6 +603,8 @@ void DefineAndRunGraph::Instantiate(OpRefList&& global_topo,
     DataType dtype = static_cast<DataType>(i);
     origin_param_and_optimizer_buckets_map[dtype] = std::make_shared<ParamBuckets>("origin_param_and_optimizer_buckets_" + 
                                                                                    DataType2Str(dtype));
+    if (optimizer_offload)
+      host_optimizer_buckets_map[dtype] = std::make_shared<ParamBuckets>("host_optimizer_buckets_" + DataType2Str(dtype));
     transfer_param_buffer_map[dtype] = std::make_shared<ParamBuffer>("transfer_param_buffer_" + DataType2Str(dtype));
     current_grad_buffer_map[dtype] = std::make_shared<ParamBuffer>("current_grad_buffer_" + DataType2Str(dtype));
     accumulate_grad_buffer_map[dtype] = std::make_shared<ParamBuffer>("accumulate_grad_buffer_" + DataType2Str(dtype));
@@ -691,7 +701,11 @@ void DefineAndRunGraph::Instantiate(OpRefList&& global_topo,
       // origin_param_and_optimizer_buffer->AddTensor(exec_tensor); // deprecated
       // origin_param_and_optimizer_buckets->AddTensor(exec_tensor);
       // TODO: better compatibility with hot switch and quantization
-      origin_param_and_optimizer_buckets_map[exec_tensor->dtype()]->AddTensor(exec_tensor);
+      // ZeRO-Offload时optimizer states放到host上
+      if (optimizer_offload && _optimizer_variable_ops.find(tensor->producer()->id()) != _optimizer_variable_ops.end())
+        host_optimizer_buckets_map[exec_tensor->dtype()]->AddTensor(exec_tensor);
+      else
+        origin_param_and_optimizer_buckets_map[exec_tensor->dtype()]->AddTensor(exec_tensor);
     }
   };
 
@@ -1090,6 +1104,7 @@ void DefineAndRunGraph::Instantiate(OpRefList&& global_topo,
   */
   // TODO: better compatibility with hot switch and quantization
   exec_graph->_origin_param_and_optimizer_buckets_map = std::move(origin_param_and_optimizer_buckets_map);
+  exec_graph->_host_optimizer_buckets_map = std::move(host_optimizer_buckets_map);
   exec_graph->_transfer_param_buffer_map = std::move(transfer_param_buffer_map);
   exec_graph->_current_grad_buffer_map = std::move(current_grad_buffer_map);
   exec_graph->_accumulate_grad_buffer_map = std::move(accumulate_grad_buffer_map);
@@ -1116,6 +1131,160 @@ void DefineAndRunGraph::Instantiate(OpRefList&& global_topo,
   }
 }
 
+void DefineAndRunGraph::GetOrCreateSwitcherPool(const std::pair<size_t, size_t>& key) {
+  if (_param_switcher_pool.find(key) != _param_switcher_pool.end()) {
+    return;
+  }
+  _param_and_opt_var_bucket_switcher_pool[key] = std::unordered_map<DataType, std::vector<std::shared_ptr<SwitchExecGraph>>>();
+  _param_switcher_pool[key] = std::unordered_map<DataType, std::shared_ptr<SwitchExecGraph>>();
+  _grad_switcher_pool[key] = std::unordered_map<DataType, std::shared_ptr<SwitchExecGraph>>();
+  for (int i = 0; i < static_cast<int>(DataType::NUM_DATA_TYPES); i++) {
+    DataType dtype = static_cast<DataType>(i);
+    _param_and_opt_var_bucket_switcher_pool[key][dtype] = std::vector<std::shared_ptr<SwitchExecGraph>>();
+    _param_switcher_pool[key][dtype] = std::make_shared<SwitchExecGraph>(this, key.first, key.second, dtype, -1, std::unordered_set<Device>{}, std::unordered_map<DataType, DataType>{{DataType::BFLOAT16, DataType::FLOAT32}});
+    _grad_switcher_pool[key][dtype] = std::make_shared<SwitchExecGraph>(this, key.first, key.second, dtype, -1, std::unordered_set<Device>{}, std::unordered_map<DataType, DataType>{{DataType::BFLOAT16, DataType::FLOAT32}});
+  }
+}
+
+void DefineAndRunGraph::SwitchParamsAndOptVarBuckets(const std::pair<size_t, size_t>& key,
+                                                     SWITCH_MODE param_switch_mode,
+                                                     SWITCH_LEVEL param_switch_level) {
+  auto& old_exec_graph = _exec_graph_plan_pool[key.first].exec_graph;
+  HT_RUNTIME_ERROR_IF(old_exec_graph->_optimizer_offload != nullptr)
+    << "Hot switch does not support opt-states offloaded by ZeRO-Offload yet";
+  for (int i = 0; i < static_cast<int>(DataType::NUM_DATA_TYPES); i++) {
+    DataType dtype = static_cast<DataType>(i);
+    size_t buckets_size = old_exec_graph->_origin_param_and_optimizer_buckets_map[dtype]->buckets_size();
+    if (_param_and_opt_var_bucket_switcher_pool[key][dtype].empty()) {
+      // 统一使用全局的通信组
+      // TODO: 后续使用实际参与的所有device
+      std::unordered_set<Device> comm_set = {};
+      const auto& global_device_group = hydraulis::impl::comm::GetGlobalDeviceGroup();
+      for (const auto& device : global_device_group.devices()) {
+        comm_set.emplace(device);
+      }
+      for (int32_t bucket_num = 0; bucket_num < buckets_size; bucket_num++) {
+        _param_and_opt_var_bucket_switcher_pool[key][dtype].emplace_back(std::make_shared<SwitchExecGraph>(this, key.first, key.second, dtype, bucket_num, comm_set, std::unordered_map<DataType, DataType>{{DataType::FLOAT32, DataType::FLOAT32}}));
+      }
+    }
+    // 实际bucket热切换
+    for (int32_t bucket_num = 0; bucket_num < buckets_size; bucket_num++) {
+      _param_and_opt_var_bucket_switcher_pool[key][dtype][bucket_num]->SwitchParams(param_switch_mode, param_switch_level, "switch params and opt-states dtype " + DataType2Str(dtype) + " bucket " + std::to_string(bucket_num));
+    }
+  }
+}
+
+// 预切换
+// 下一个step的策略通常由planner提前决定
+// 因此可以在当前step（RunLevel::UPDATE）的Run返回后立即开始切换
+// 每个param只会等待其在当前step中的update完成（_run_param_events）
+// 切换的通信在kSwitchCollectiveStream上进行，新的exec graph只会等待其实际用到的param的event（_switch_param_events）
+bool DefineAndRunGraph::PreSwitch(const int compute_strategy_id, const int optimize_strategy_id) {
+  auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  if (!_is_active || _is_pre_switched) {
+    return false;
+  }
+  auto& old_exec_graph = _exec_graph_plan_pool[_active_exec_plan].exec_graph;
+  // 没有RequestPreSwitch时当前step不会记录param的event，无法与其尾部overlap
+  if (!old_exec_graph->_record_run_param_events) {
+    HT_LOG_DEBUG << local_device << ": pre-switch is not requested before the current step";
+    return false;
+  }
+  // 只有update后的param和opt-states是完整的
+  if (old_exec_graph->_run_level != RunLevel::UPDATE
+      || !old_exec_graph->_use_origin_param_and_optimizer_buckets) {
+    HT_LOG_DEBUG << local_device << ": pre-switch is only supported after RunLevel::UPDATE with origin param and optimizer buckets";
+    return false;
+  }
+  // 预切换只针对已经在pool中的exec graph
+  // 且要求strategy唯一确定一个exec graph
+  size_t next_active_exec_plan = _exec_graph_plan_pool.size();
+  for (size_t i = 0; i < _exec_graph_plan_pool.size(); i++) {
+    const auto& exec_graph_plan = _exec_graph_plan_pool[i];
+    if (static_cast<size_t>(compute_strategy_id) != exec_graph_plan.compute_strategy_id
+        || static_cast<size_t>(optimize_strategy_id) != exec_graph_plan.optimize_strategy_id) {
+      continue;
+    }
+    if (next_active_exec_plan != _exec_graph_plan_pool.size()) {
+      HT_LOG_DEBUG << local_device << ": multiple exec plans match the strategy, skip pre-switch";
+      return false;
+    }
+    next_active_exec_plan = i;
+  }
+  if (next_active_exec_plan == _exec_graph_plan_pool.size() || next_active_exec_plan == _active_exec_plan) {
+    return false;
+  }
+  auto key = std::make_pair(_active_exec_plan, next_active_exec_plan);
+  GetOrCreateSwitcherPool(key);
+  auto& new_exec_graph = _exec_graph_plan_pool[next_active_exec_plan].exec_graph;
+  auto param_switch_level = SWITCH_LEVEL::EXEC;
+  if (old_exec_graph->OPTIMIZE_STRATEGY_ID == new_exec_graph->OPTIMIZE_STRATEGY_ID) {
+    param_switch_level = SWITCH_LEVEL::DIRECT_BIND;
+  }
+  HT_LOG_DEBUG << local_device << ": pre-switch from " << old_exec_graph->name() << " to " << new_exec_graph->name();
+  SwitchParamsAndOptVarBuckets(key, SWITCH_MODE::SWITCH_ORIGIN_PARAM_AND_OPTIMIZER, param_switch_level);
+  _is_pre_switched = true;
+  _pre_switch_key = key;
+  return true;
+}
+
+double DefineAndRunGraph::Snapshot(const std::string& dir, int64_t step) {
+  HT_RUNTIME_ERROR_IF(!_is_active)
+    << "Snapshot should be called after at least one step";
+  HT_RUNTIME_ERROR_IF(_is_pre_switched)
+    << "Snapshot should be called before pre-switching the params";
+  auto& exec_graph = _exec_graph_plan_pool[_active_exec_plan].exec_graph;
+  HT_RUNTIME_ERROR_IF(!exec_graph->_use_origin_param_and_optimizer_buckets)
+    << "Snapshot only supports params and opt-states in the origin buckets";
+  HT_RUNTIME_ERROR_IF(exec_graph->_optimizer_offload != nullptr)
+    << "Snapshot does not support opt-states offloaded by ZeRO-Offload yet";
+  HT_LOG_WARN_IF(exec_graph->_run_level != RunLevel::UPDATE)
+    << "Snapshot after run level " << static_cast<int>(exec_graph->_run_level) << " may save params that are not updated yet";
+  if (_snapshot_checkpointer == nullptr) {
+    size_t num_slots = 2;
+    const char* env = std::getenv("HYDRAULIS_SNAPSHOT_SLOTS");
+    if (env != nullptr)
+      num_slots = std::max(1, std::atoi(env));
+    _snapshot_checkpointer = std::make_unique<SnapshotCheckpointer>(num_slots);
+  }
+  return _snapshot_checkpointer->Snapshot(exec_graph->_origin_param_and_optimizer_buckets_map, dir, step);
+}
+
+void DefineAndRunGraph::WaitSnapshots() {
+  if (_snapshot_checkpointer != nullptr)
+    _snapshot_checkpointer->Wait();
+}
+
+std::vector<size_t> DefineAndRunGraph::ScheduleMicroBatches(const ExecutableGraph& exec_graph,
+                                                            const Tensor& micro_batch_cu_seqlens,
+                                                            const FeedDict& feed_dict,
+                                                            int num_micro_batches) {
+  auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  auto feed_it = feed_dict.find(micro_batch_cu_seqlens->id());
+  HT_VALUE_ERROR_IF(feed_it == feed_dict.end() || feed_it->second.size() != num_micro_batches)
+    << "Scheduling micro batches requires the cu_seqlens of each micro batch"
+    << ", but " << micro_batch_cu_seqlens << " is fed with "
+    << (feed_it == feed_dict.end() ? 0 : feed_it->second.size()) << " arrays for " << num_micro_batches << " micro batches";
+  auto pipeline_it = exec_graph._pipeline_map.find(local_device);
+  if (pipeline_it == exec_graph._pipeline_map.end()) {
+    return {};
+  }
+  // pipeline中的所有rank都有相同的cu_seqlens，因此得到相同的顺序
+  std::vector<MicroBatchCost> costs;
+  costs.reserve(num_micro_batches);
+  for (const auto& cu_seqlens : feed_it->second) {
+    costs.push_back(MicroBatchCost::FromCuSeqlens(cu_seqlens));
+  }
+  auto schedule = MicroBatchScheduler::FromEnv(pipeline_it->second.size()).Schedule(costs);
+  HT_LOG_DEBUG << local_device << ": [Micro Batch Schedule] " << schedule;
+  for (size_t i = 0; i < schedule.order.size(); i++) {
+    if (schedule.order[i] != i) {
+      return std::move(schedule.order);
+    }
+  }
+  return {};
+}
+
 // 每次调用run都会从当前的define graph中
 // 生成/使用之前生成过的一个exec graph
 // 而只有当：
@@ -1126,15 +1295,26 @@ void DefineAndRunGraph::Instantiate(OpRefList&& global_topo,
 // 目前一个exec graph支持多个shape plan
 // 即允许feed_dict的shape（包括batch_size以及seq_len等）可变
 NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches,
-                                   const FeedDict& feed_dict, const int num_micro_batches,
+                                   const FeedDict& raw_feed_dict, const int num_micro_batches,
                                    const int compute_strategy_id, const int optimize_strategy_id, RunLevel run_level,
-                                   bool save_checkpoint, const double grad_scale) {
+                                   bool save_checkpoint, const double grad_scale,
+                                   const Tensor& micro_batch_cu_seqlens) {
   _run_level = run_level;
   COMPUTE_STRATEGY_ID = static_cast<size_t>(compute_strategy_id);
   OPTIMIZE_STRATEGY_ID = static_cast<size_t>(optimize_strategy_id);
   CUR_STRATEGY_ID = static_cast<size_t>(compute_strategy_id);
   auto local_device = hydraulis::impl::comm::GetLocalDevice(); // only for debug use
   HT_LOG_DEBUG << local_device << ": [Graph Plan] obtain exec graph begin...";
+  // 各个阶段host侧的开销，嵌套在其中的阶段会从外层阶段的self时间中扣除
+  HostPhaseTimer step_timer(HostPhase::STEP);
+  HostPhaseTimer plan_match_timer(HostPhase::PLAN_MATCH);
+
+  // 将feed的长度向上padding到bucket，使得不同的长度可以命中同一个shape plan
+  FeedDict bucketed_feed_dict;
+  if (_shape_bucket_policy) {
+    bucketed_feed_dict = _shape_bucket_policy->Apply(raw_feed_dict, num_micro_batches, _shape_plan_stats);
+  }
+  const FeedDict& feed_dict = _shape_bucket_policy ? bucketed_feed_dict : raw_feed_dict;
 
   // get feed dict shape
   Tensor2ShapeMapList feed_dict_shape_list(num_micro_batches);
@@ -1237,6 +1417,7 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
     // 新的shape plan就是shape plan pool中的第一个
     next_active_shape_plan_list[micro_batch_idx] = 0;
     micro_batch_idx++; 
+    _shape_plan_stats.num_lookups++;
     HT_LOG_DEBUG << local_device << ": [Graph Plan] add a new shape plan and an exec graph to the pool end...";
   } 
   // 命中pool中已有的exec graph
@@ -1270,11 +1451,13 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
       }
       if (shape_plan_matched) {
         in_shape_plan_pool = true;
+        _shape_plan_stats.num_hits++;
         next_active_shape_plan_list[idx] = i;
         HT_LOG_DEBUG << next_active_shape_plan_list[idx] << "-th shape plan is matched for micro batch " << idx;
         break;
       }
     }
+    _shape_plan_stats.num_lookups++;
     // 如果不在shape_plan_pool中
     // 需要推导新的shape plan
     if (!in_shape_plan_pool) {
@@ -1285,6 +1468,9 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
     }
   }
 
+  HT_LOG_DEBUG << local_device << ": [Graph Plan] " << _shape_plan_stats;
+  plan_match_timer.Stop();
+
   // 准备运行挑选出的active exec graph
   auto& exec_graph = _exec_graph_plan_pool[next_active_exec_plan].exec_graph;
   auto& op_to_exec_op_mapping = _exec_graph_plan_pool[next_active_exec_plan].op_to_exec_op_mapping;
@@ -1293,6 +1479,44 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
   TensorList exec_fetches;
   FeedDict exec_feed_dict;
 
+  // 记录（或回放时核对）当前step的决策
+  ReplayStep replay_step;
+  if (_replay_log != nullptr) {
+    replay_step.compute_strategy_id = compute_strategy_id;
+    replay_step.optimize_strategy_id = optimize_strategy_id;
+    replay_step.run_level = static_cast<int>(run_level);
+    replay_step.num_micro_batches = num_micro_batches;
+    replay_step.exec_plan = next_active_exec_plan;
+    replay_step.shape_plans = next_active_shape_plan_list;
+    replay_step.feed_shapes.reserve(num_micro_batches);
+    for (const auto& feed_dict_shape : feed_dict_shape_list) {
+      replay_step.feed_shapes.push_back(FeedShapesToString(feed_dict_shape));
+    }
+  }
+
+  // 重排micro batch的执行顺序
+  // shape plan与feed dict都按照新的顺序排列，fetch的结果仍按照原来的顺序返回
+  std::vector<size_t> micro_batch_order;
+  if (_replay_log != nullptr && _replay_log->mode() == ReplayMode::REPLAY) {
+    // 直接使用log中的顺序，不依赖调度器的代价模型
+    micro_batch_order = _replay_log->Expected().micro_batch_order;
+    HT_RUNTIME_ERROR_IF(!micro_batch_order.empty() &&
+                        (micro_batch_order.size() != static_cast<size_t>(num_micro_batches) ||
+                         *std::max_element(micro_batch_order.begin(), micro_batch_order.end())
+                           >= static_cast<size_t>(num_micro_batches)))
+      << "The replay log orders micro batches as " << micro_batch_order
+      << ", but step " << _replay_log->step() << " has " << num_micro_batches << " micro batches";
+  } else if (micro_batch_cu_seqlens.is_defined() && num_micro_batches > 1) {
+    micro_batch_order = ScheduleMicroBatches(*exec_graph, micro_batch_cu_seqlens, feed_dict, num_micro_batches);
+  }
+  if (!micro_batch_order.empty()) {
+    std::vector<size_t> scheduled_shape_plan_list(num_micro_batches);
+    for (int i = 0; i < num_micro_batches; i++) {
+      scheduled_shape_plan_list[i] = next_active_shape_plan_list[micro_batch_order[i]];
+    }
+    next_active_shape_plan_list = std::move(scheduled_shape_plan_list);
+  }
+
   // 设置shape plan
   HT_LOG_DEBUG << exec_graph->name() << " use shape plan " << next_active_shape_plan_list;
   exec_graph->SetShapePlan(next_active_shape_plan_list[0]);
@@ -1311,8 +1535,22 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
         << ", so we just skipped it";
       continue;
     }
-    exec_feed_dict[tensor_to_exec_tensor_mapping[kv.first]->id()] = kv.second;
+    auto& exec_feed = exec_feed_dict[tensor_to_exec_tensor_mapping[kv.first]->id()];
+    if (micro_batch_order.empty() || kv.second.empty()) {
+      exec_feed = kv.second;
+      continue;
+    }
+    // 只有一个NDArray时按照executor中的方式先切分为各个micro batch
+    auto micro_batches = kv.second.size() == 1 ? NDArray::split(kv.second[0], num_micro_batches) : kv.second;
+    exec_feed.reserve(num_micro_batches);
+    for (auto idx : micro_batch_order) {
+      exec_feed.push_back(micro_batches[idx]);
+    }
   }
+  if (_replay_log != nullptr) {
+    replay_step.micro_batch_order = micro_batch_order;
+  }
+  exec_graph->SetMicroBatchOrder(std::move(micro_batch_order));
 
   // 2024.10.4 Update
   // 这里先将exec graph的topo运行出来
@@ -1326,6 +1564,20 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
     Graph::pop_graph_ctx();
   }
 
+  // 预切换之后param和opt-states已经位于预切换的exec graph中
+  // 因此只能运行该exec graph
+  if (_is_pre_switched) {
+    HT_RUNTIME_ERROR_IF(next_active_exec_plan != _pre_switch_key.second || save_checkpoint)
+      << "params are pre-switched to exec plan " << _pre_switch_key.second
+      << ", but the run requires exec plan " << next_active_exec_plan
+      << (save_checkpoint ? " with save_checkpoint" : "");
+  }
+  if (_replay_log != nullptr) {
+    replay_step.switch_from = _is_active && !save_checkpoint && _active_exec_plan != next_active_exec_plan
+                              ? static_cast<int64_t>(_active_exec_plan) : -1;
+    replay_step.pre_switched = _is_pre_switched;
+    _replay_log->Commit(std::move(replay_step));
+  }
   bool is_transfer_param_hot_switch = false;
   bool is_empty_cache = false;
   // 需要切换exec graph
@@ -1334,22 +1586,13 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
     _is_active = false;
   }
   if (!_is_active || _active_exec_plan != next_active_exec_plan) {
+    HostPhaseTimer switch_timer(HostPhase::SWITCH_SETUP);
     HT_LOG_DEBUG << local_device << ": [Graph Plan] Context switch to the new exec plan begin...";
     // 热切换
     if (_is_active) {
       bool need_hot_switch = true;
       auto key = std::make_pair(_active_exec_plan, next_active_exec_plan);
-      if (_param_switcher_pool.find(key) == _param_switcher_pool.end()) {
-        _param_and_opt_var_bucket_switcher_pool[key] = std::unordered_map<DataType, std::vector<std::shared_ptr<SwitchExecGraph>>>();
-        _param_switcher_pool[key] = std::unordered_map<DataType, std::shared_ptr<SwitchExecGraph>>();
-        _grad_switcher_pool[key] = std::unordered_map<DataType, std::shared_ptr<SwitchExecGraph>>();
-        for (int i = 0; i < static_cast<int>(DataType::NUM_DATA_TYPES); i++) {
-          DataType dtype = static_cast<DataType>(i);
-          _param_and_opt_var_bucket_switcher_pool[key][dtype] = std::vector<std::shared_ptr<SwitchExecGraph>>();
-          _param_switcher_pool[key][dtype] = std::make_shared<SwitchExecGraph>(this, _active_exec_plan, next_active_exec_plan, dtype, -1, std::unordered_set<Device>{}, std::unordered_map<DataType, DataType>{{DataType::BFLOAT16, DataType::FLOAT32}});
-          _grad_switcher_pool[key][dtype] = std::make_shared<SwitchExecGraph>(this, _active_exec_plan, next_active_exec_plan, dtype, -1, std::unordered_set<Device>{}, std::unordered_map<DataType, DataType>{{DataType::BFLOAT16, DataType::FLOAT32}});
-        }
-      }
+      GetOrCreateSwitcherPool(key);
       // 旧的exec graph
       auto& old_exec_graph = _exec_graph_plan_pool[_active_exec_plan].exec_graph;
       auto& new_exec_graph = _exec_graph_plan_pool[next_active_exec_plan].exec_graph;
@@ -1454,6 +1697,16 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
           }
         }
       }
+      // grad bucketing时current grad buffer在PreRun中alloc（只有含bucket的dtype）
+      if (old_exec_graph->_grad_bucket_reducer != nullptr) {
+        old_exec_graph->_grad_bucket_reducer->Unbind();
+        for (auto it = old_exec_graph->_current_grad_buffer_map.begin(); 
+             it != old_exec_graph->_current_grad_buffer_map.end(); ++it) {
+          if (it->second->IsAllocated()) {
+            it->second->Free();
+          }
+        }
+      }
       if (old_exec_graph->_run_level == RunLevel::UPDATE || old_exec_graph->_run_level == RunLevel::COMPUTE_ONLY) {
         for (auto it = old_exec_graph->_transfer_param_buffer_map.begin(); 
              it != old_exec_graph->_transfer_param_buffer_map.end(); ++it) {
@@ -1517,29 +1770,17 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
         }
         // 按buckets的顺序进行switch
         else {
-          // 策略一样的情况下单独特判直接复用显存即可
-          if (param_switch_level == SWITCH_LEVEL::EXEC && old_exec_graph->OPTIMIZE_STRATEGY_ID == new_exec_graph->OPTIMIZE_STRATEGY_ID) {
-            param_switch_level = SWITCH_LEVEL::DIRECT_BIND;
-          }
-          for (int i = 0; i < static_cast<int>(DataType::NUM_DATA_TYPES); i++) {
-            DataType dtype = static_cast<DataType>(i);
-            size_t buckets_size = old_exec_graph->_origin_param_and_optimizer_buckets_map[dtype]->buckets_size();
-            if (_param_and_opt_var_bucket_switcher_pool[key][dtype].empty()) {
-              // 统一使用全局的通信组
-              // TODO: 后续使用实际参与的所有device
-              std::unordered_set<Device> comm_set = {};
-              const auto& global_device_group = hydraulis::impl::comm::GetGlobalDeviceGroup();
-              for (const auto& device : global_device_group.devices()) {
-                comm_set.emplace(device);
-              }
-              for (int32_t bucket_num = 0; bucket_num < buckets_size; bucket_num++) {
-                _param_and_opt_var_bucket_switcher_pool[key][dtype].emplace_back(std::make_shared<SwitchExecGraph>(this, _active_exec_plan, next_active_exec_plan, dtype, bucket_num, comm_set, std::unordered_map<DataType, DataType>{{DataType::FLOAT32, DataType::FLOAT32}}));
-              }
-            }
-            // 实际bucket热切换
-            for (int32_t bucket_num = 0; bucket_num < buckets_size; bucket_num++) {
-              _param_and_opt_var_bucket_switcher_pool[key][dtype][bucket_num]->SwitchParams(param_switch_mode, param_switch_level, "switch params and opt-states dtype " + DataType2Str(dtype) + " bucket " + std::to_string(bucket_num));
+          // 已经在上一个step的尾部完成了预切换
+          if (_is_pre_switched) {
+            HT_ASSERT(key == _pre_switch_key && param_switch_mode == SWITCH_MODE::SWITCH_ORIGIN_PARAM_AND_OPTIMIZER)
+              << "pre-switch mismatches the actual switch";
+            HT_LOG_DEBUG << local_device << ": params and opt-states are already pre-switched to " << new_exec_graph->name();
+          } else {
+            // 策略一样的情况下单独特判直接复用显存即可
+            if (param_switch_level == SWITCH_LEVEL::EXEC && old_exec_graph->OPTIMIZE_STRATEGY_ID == new_exec_graph->OPTIMIZE_STRATEGY_ID) {
+              param_switch_level = SWITCH_LEVEL::DIRECT_BIND;
             }
+            SwitchParamsAndOptVarBuckets(key, param_switch_mode, param_switch_level);
           }
           // old version w/o dtype (Malleus exp only)
           /*
@@ -1569,6 +1810,7 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
       } 
     }
     _is_active = true;
+    _is_pre_switched = false;
     _active_exec_plan = next_active_exec_plan;
     HT_LOG_DEBUG << local_device << ": [Graph Plan] Context switch to the new exec plan end...";
   }
@@ -1578,6 +1820,8 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
   char* env = std::getenv("HYDRAULIS_PARALLEL_CHANGE_TEST");
   if (env != nullptr) {
     if (std::string(env) == "COST" && change_parallel_test_case >= 1) {
+      step_timer.Stop();
+      HostOverheadStats::Get().EndStep();
       return {};
     }
   }
@@ -1592,6 +1836,8 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
   }
   HT_LOG_DEBUG << exec_graph->name() << " start running..." ;
   exec_graph->_is_transfer_param_hot_switch = is_transfer_param_hot_switch;
+  exec_graph->_record_run_param_events = _pre_switch_requested && run_level == RunLevel::UPDATE;
+  _pre_switch_requested = false;
   NDArrayList ret;
   if (exec_graph->NeedRank(hydraulis::impl::comm::DeviceToWorldRank(local_device))) {
     Graph::push_graph_ctx(exec_graph->id()); // 防止exec graph run内部MakeOp时忘记加
@@ -1606,6 +1852,8 @@ NDArrayList DefineAndRunGraph::Run(const Tensor& loss, const TensorList& fetches
   // 验证mempool是否能释放干净
   // hydraulis::impl::ProfileAfterEmptyAllCUDACache(local_device);
   // GetCUDAProfiler(local_device)->PrintCurrMemoryInfo(name() + " after empty cache");
+  step_timer.Stop();
+  HostOverheadStats::Get().EndStep();
   return ret;
 }
 
@@ -3,6 +3,9 @@
 #include "hydraulis/graph/graph.h"
 #include "hydraulis/graph/executable_graph.h"
 #include "hydraulis/graph/init/initializer.h"
+#include "hydraulis/graph/checkpoint/snapshot.h"
+#include "hydraulis/graph/shape_bucketing.h"
+#include "hydraulis/graph/replay_log.h"
 
 namespace std {
 
@@ -83,7 +86,8 @@ class DefineAndRunGraph : public Graph {
 
   DefineAndRunGraph(GraphName name, size_t init_capacity)
   : Graph(name, init_capacity),
-    _init_capacity(init_capacity) {
+    _init_capacity(init_capacity),
+    _replay_log(ReplayLog::FromEnv()) {
     std::srand(std::time(0));
   }
 
@@ -97,7 +101,50 @@ class DefineAndRunGraph : public Graph {
   NDArrayList Run(const Tensor& loss, const TensorList& fetches, 
                   const FeedDict& feed_dict = {}, const int num_micro_batches = 1,
                   const int compute_strategy_id = 0, const int optimize_strategy_id = 0, RunLevel run_level = RunLevel::UPDATE,
-                  bool save_checkpoint = false, const double grad_scale = 1);
+                  bool save_checkpoint = false, const double grad_scale = 1,
+                  const Tensor& micro_batch_cu_seqlens = Tensor());
+
+  // 声明在下一个step（RunLevel::UPDATE）之后会进行预切换
+  // 需要在该step的Run之前调用，这样update时才会记录每个param的event
+  void RequestPreSwitch() {
+    _pre_switch_requested = true;
+  }
+
+  // 在当前step（RunLevel::UPDATE）之后提前异步地切换到下一个step的策略
+  // 当前step之前须已调用RequestPreSwitch，返回是否实际进行了预切换
+  bool PreSwitch(const int compute_strategy_id, const int optimize_strategy_id);
+
+  // 在当前step（RunLevel::UPDATE）之后异步地保存param和opt-states的snapshot
+  // 返回阻塞训练的时间（ms）
+  double Snapshot(const std::string& dir, int64_t step);
+
+  // 等待所有后台的snapshot保存完成
+  void WaitSnapshots();
+
+  // 开启（policy为nullptr时关闭）feed的shape bucketing，只影响之后的run
+  void SetShapeBucketPolicy(std::unique_ptr<ShapeBucketPolicy> policy) {
+    _shape_bucket_policy = std::move(policy);
+  }
+
+  const ShapeBucketPolicy* shape_bucket_policy() const {
+    return _shape_bucket_policy.get();
+  }
+
+  // 累计的shape plan命中率与bucketing的padding开销
+  const ShapePlanStats& shape_plan_stats() const {
+    return _shape_plan_stats;
+  }
+
+  void ResetShapePlanStats() {
+    _shape_plan_stats = ShapePlanStats();
+  }
+
+  // 回放时下一个step在log中的记录，供driver按照记录选择策略；不在回放时返回nullptr
+  const ReplayStep* replay_expected_step() {
+    if (_replay_log == nullptr || _replay_log->mode() != ReplayMode::REPLAY)
+      return nullptr;
+    return &_replay_log->Expected();
+  }
 
   GraphType type() const {
     return GraphType::DEFINE_AND_RUN;
@@ -124,10 +171,22 @@ class DefineAndRunGraph : public Graph {
 
   void DeducePipeline(size_t cur_strategy_id, int32_t pipeline_num);
 
+  void GetOrCreateSwitcherPool(const std::pair<size_t, size_t>& key);
+
+  void SwitchParamsAndOptVarBuckets(const std::pair<size_t, size_t>& key,
+                                    SWITCH_MODE param_switch_mode,
+                                    SWITCH_LEVEL param_switch_level);
+
   void DeduceShapePlan(ExecGraphPlan& exec_graph_plan,
                        const FeedDict& feed_dict,
                        Tensor2ShapeMap& feed_dict_shape);
 
+  // 按照各个micro batch的cu_seqlens重排pipeline中micro batch的执行顺序，不需要重排时返回空
+  std::vector<size_t> ScheduleMicroBatches(const ExecutableGraph& exec_graph,
+                                           const Tensor& micro_batch_cu_seqlens,
+                                           const FeedDict& feed_dict,
+                                           int num_micro_batches);
+
   DeviceGroupUnion DeducePlacementGroup(Operator& op, Op2DGUnionMap& dg_union_map);
 
   void Instantiate(OpRefList&& global_topo,
@@ -189,6 +248,17 @@ class DefineAndRunGraph : public Graph {
   // std::vector<Tensor2ShapeMap> _shape_plan_pool; 
   size_t _active_exec_plan;
   bool _is_active = false;
+  // 预切换相关
+  bool _pre_switch_requested = false; // 下一个step的Run是否需要记录param的event
+  bool _is_pre_switched = false; // param和opt-states是否已经预切换
+  std::pair<size_t, size_t> _pre_switch_key; // 预切换的(before plan, after plan)
+  // snapshot相关（第一次snapshot时创建）
+  std::unique_ptr<SnapshotCheckpointer> _snapshot_checkpointer;
+  // shape bucketing相关
+  std::unique_ptr<ShapeBucketPolicy> _shape_bucket_policy;
+  ShapePlanStats _shape_plan_stats;
+  // micro batch plan与策略切换的record/replay（由环境变量开启）
+  std::unique_ptr<ReplayLog> _replay_log;
 
   // 如果判断不需要进行grad的热切换
   // 此值为true时仍会进行grad热切换的topo计算
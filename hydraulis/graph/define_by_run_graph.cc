@@ -192,7 +192,8 @@ void DefineByRunGraph::PruneTensor(const Tensor& tensor) {
 NDArrayList DefineByRunGraph::Run(const Tensor& loss, const TensorList& fetches,
                                   const FeedDict& feed_dict, const int num_micro_batches,
                                   const int compute_strategy_id, const int optimize_strategy_id, RunLevel run_level, 
-                                  bool save_checkpoint, const double grad_scale) {
+                                  bool save_checkpoint, const double grad_scale,
+                                  const Tensor& micro_batch_cu_seqlens) {
   TensorList referred_tensors, exec_referred_tensors;
   FeedDict exec_feed_dict;
   std::tie(referred_tensors, exec_referred_tensors, exec_feed_dict) =
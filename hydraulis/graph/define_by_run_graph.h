@@ -31,7 +31,8 @@ class DefineByRunGraph : public Graph {
   NDArrayList Run(const Tensor& loss, const TensorList& fetches, 
                   const FeedDict& feed_dict = {}, const int num_micro_batches = 1,
                   const int compute_strategy_id = 0, const int optimize_strategy_id = 0, RunLevel run_level = RunLevel::UPDATE, 
-                  bool save_checkpoint = false, const double grad_scale = 1);
+                  bool save_checkpoint = false, const double grad_scale = 1,
+                  const Tensor& micro_batch_cu_seqlens = Tensor());
 
   GraphType type() const {
     return GraphType::DEFINE_BY_RUN;
@@ -0,0 +1,134 @@
+#include "hydraulis/graph/deterministic_benchmark.h"
+#include "hydraulis/core/ndarray.h"
+#include "hydraulis/core/reduction_type.h"
+#include "hydraulis/graph/ops/kernel_links.h"
+#include "hydraulis/common/deterministic.h"
+#include "hydraulis/impl/utils/omp_utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <random>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+
+struct BenchmarkCase {
+  std::string kernel;
+  std::function<void()> run;
+  NDArrayList outputs;
+};
+
+std::vector<std::vector<float>> CopyOutputs(const NDArrayList& outputs) {
+  std::vector<std::vector<float>> copies;
+  copies.reserve(outputs.size());
+  for (const auto& output : outputs) {
+    const float* ptr = output->data_ptr<float>();
+    copies.emplace_back(ptr, ptr + output->numel());
+  }
+  return copies;
+}
+
+} // namespace
+
+DeterministicBenchmarkResult BenchmarkDeterministicKernels(size_t num_tokens, size_t hidden,
+                                                           size_t vocab, size_t num_iters) {
+  HT_VALUE_ERROR_IF(num_tokens == 0 || hidden == 0 || vocab == 0 || num_iters == 0)
+    << "Cannot benchmark the deterministic mode with num_tokens = " << num_tokens
+    << ", hidden = " << hidden << ", vocab = " << vocab << " and num_iters = " << num_iters;
+  Device cpu(kCPU);
+  Stream stream(cpu, kBlockingStream);
+  int64_t n = num_tokens, h = hidden, v = vocab;
+  using Clock = std::chrono::steady_clock;
+
+  auto x = NDArray::randn({n, h}, cpu, kFloat32, 0, 1, 1, kBlockingStream);
+  auto dy = NDArray::randn({n, h}, cpu, kFloat32, 0, 1, 2, kBlockingStream);
+  // LayerNorm的CPU kernel只支持4维的输入
+  auto ln_x = NDArray::randn({1, 1, n, h}, cpu, kFloat32, 0, 1, 3, kBlockingStream);
+  auto ln_dy = NDArray::randn({1, 1, n, h}, cpu, kFloat32, 0, 1, 4, kBlockingStream);
+  auto ln_scale = NDArray::randn({h}, cpu, kFloat32, 1, 0.02, 5, kBlockingStream);
+  auto ln_bias = NDArray::randn({h}, cpu, kFloat32, 0, 0.02, 6, kBlockingStream);
+  auto ids = NDArray::empty({n}, cpu, kInt64, kBlockingStream);
+  // 有重复的id，反向时多个位置会累加到同一行
+  std::mt19937_64 engine(7);
+  std::uniform_int_distribution<int64_t> dist(0, std::min<int64_t>(v, 1024) - 1);
+  for (int64_t i = 0; i < n; i++)
+    ids->data_ptr<int64_t>()[i] = dist(engine);
+
+  auto row_sum = NDArray::empty({n, 1}, cpu, kFloat32, kBlockingStream);
+  auto col_sum = NDArray::empty({1, h}, cpu, kFloat32, kBlockingStream);
+  auto ln_mean = NDArray::empty({1, 1, n, 1}, cpu, kFloat32, kBlockingStream);
+  auto ln_var = NDArray::empty({1, 1, n, 1}, cpu, kFloat32, kBlockingStream);
+  auto ln_y = NDArray::empty({1, 1, n, h}, cpu, kFloat32, kBlockingStream);
+  auto ln_dx = NDArray::empty({1, 1, n, h}, cpu, kFloat32, kBlockingStream);
+  auto ln_dscale = NDArray::empty({h}, cpu, kFloat32, kBlockingStream);
+  auto ln_dbias = NDArray::empty({h}, cpu, kFloat32, kBlockingStream);
+  auto softmax_y = NDArray::empty({n, h}, cpu, kFloat32, kBlockingStream);
+  auto softmax_dx = NDArray::empty({n, h}, cpu, kFloat32, kBlockingStream);
+  auto embedding_grad = NDArray::empty({v, h}, cpu, kFloat32, kBlockingStream);
+
+  std::vector<BenchmarkCase> cases;
+  cases.push_back({"reduce_sum_rows", [&]() {
+    hydraulis::impl::ReduceCpu(x, row_sum, {1}, ReductionType::SUM, stream);
+  }, {row_sum}});
+  cases.push_back({"reduce_sum_cols", [&]() {
+    hydraulis::impl::ReduceCpu(x, col_sum, {0}, ReductionType::SUM, stream);
+  }, {col_sum}});
+  cases.push_back({"layer_norm", [&]() {
+    hydraulis::impl::LayerNormCpu(ln_x, ln_scale, ln_bias, ln_mean, ln_var, ln_y, 1, 1e-5f, stream);
+  }, {ln_mean, ln_var, ln_y}});
+  cases.push_back({"layer_norm_gradient", [&]() {
+    hydraulis::impl::LayerNormGradientCpu(ln_dy, ln_x, ln_scale, ln_dx, ln_dscale, ln_dbias,
+                                          ln_mean, ln_var, 1, 1e-5f, stream);
+  }, {ln_dx, ln_dscale, ln_dbias}});
+  cases.push_back({"softmax", [&]() {
+    hydraulis::impl::SoftmaxCpu(x, softmax_y, 1, stream);
+  }, {softmax_y}});
+  cases.push_back({"softmax_gradient", [&]() {
+    hydraulis::impl::SoftmaxGradientCpu(softmax_y, dy, softmax_dx, 1, stream);
+  }, {softmax_dx}});
+  cases.push_back({"embedding_lookup_gradient", [&]() {
+    hydraulis::impl::EmbeddingLookupGradientCpu(dy, ids, embedding_grad, stream);
+  }, {embedding_grad}});
+
+  bool origin_deterministic = IsDeterministic();
+  DeterministicBenchmarkResult result;
+  result.num_threads = hydraulis::omp::OMP_GET_NUM_THREADS();
+  for (auto& bench : cases) {
+    DeterministicKernelTiming timing;
+    timing.kernel = bench.kernel;
+    for (bool deterministic : {false, true}) {
+      SetDeterministic(deterministic);
+      // 预热（layer_norm_gradient依赖layer_norm的mean与var，按顺序运行即可满足）
+      bench.run();
+      auto start = Clock::now();
+      for (size_t i = 0; i < num_iters; i++)
+        bench.run();
+      double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / num_iters;
+      (deterministic ? timing.deterministic_ms : timing.default_ms) = ms;
+    }
+    // 确定性模式下换一个线程数再运行一次，结果应当逐位一致
+    auto expected = CopyOutputs(bench.outputs);
+    hydraulis::omp::OMP_SET_NUM_THREADS(std::max(1, result.num_threads / 2));
+    bench.run();
+    hydraulis::omp::OMP_SET_NUM_THREADS(result.num_threads);
+    auto actual = CopyOutputs(bench.outputs);
+    timing.bitwise_reproducible = true;
+    for (size_t i = 0; i < expected.size(); i++) {
+      if (std::memcmp(expected[i].data(), actual[i].data(), expected[i].size() * sizeof(float)) != 0) {
+        timing.bitwise_reproducible = false;
+        break;
+      }
+    }
+    result.default_ms += timing.default_ms;
+    result.deterministic_ms += timing.deterministic_ms;
+    result.timings.push_back(std::move(timing));
+  }
+  SetDeterministic(origin_deterministic);
+  return result;
+}
+
+} // namespace graph
+} // namespace hydraulis
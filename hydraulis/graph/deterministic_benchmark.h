@@ -0,0 +1,39 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include <string>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+struct DeterministicKernelTiming {
+  std::string kernel;
+  double default_ms{0};
+  double deterministic_ms{0};
+  // 确定性模式下使用不同的线程数得到的结果是否逐位一致
+  bool bitwise_reproducible{false};
+};
+
+struct DeterministicBenchmarkResult {
+  int num_threads{1};
+  double default_ms{0};
+  double deterministic_ms{0};
+  std::vector<DeterministicKernelTiming> timings;
+
+  // 确定性模式相对于默认模式的吞吐量开销
+  double slowdown() const {
+    return default_ms == 0 ? 0 : deterministic_ms / default_ms;
+  }
+};
+
+// 在CPU上分别以默认模式与确定性模式运行受影响的kernel（Reduce、LayerNorm、Softmax
+// 及其反向、EmbeddingLookup的反向），输入为[num_tokens, hidden]的激活以及vocab行的embedding，
+// 返回每个kernel在两种模式下的平均耗时，并用一半的线程再运行一次确定性模式以检查结果是否逐位一致
+DeterministicBenchmarkResult BenchmarkDeterministicKernels(size_t num_tokens = 4096,
+                                                           size_t hidden = 1024,
+                                                           size_t vocab = 32000,
+                                                           size_t num_iters = 5);
+
+} // namespace graph
+} // namespace hydraulis
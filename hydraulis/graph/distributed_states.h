@@ -291,7 +291,7 @@ class DistributedStatesUnion {
     return _union.size();
   }
 
-  bool check_equal(const DistributedStatesUnion& another) {
+  bool check_equal(const DistributedStatesUnion& another) const {
     if (is_hetero() != another.is_hetero() 
         || _hetero_dim != another.hetero_dim()
         || _union.size() != another.size()
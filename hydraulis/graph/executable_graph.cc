@@ -3,10 +3,16 @@
 #include "hydraulis/graph/ops/op_headers.h"
 #include "hydraulis/graph/autocast/autocast.h"
 #include "hydraulis/graph/recompute/recompute.h"
+#include "hydraulis/graph/recompute/memory_budget_planner.h"
 #include "hydraulis/graph/offload/activation_cpu_offload.h"
+#include "hydraulis/graph/offload/optimizer_cpu_offload.h"
+#include "hydraulis/graph/grad_bucket.h"
+#include "hydraulis/graph/fusion/elewise_fusion.h"
+#include "hydraulis/graph/host_overhead.h"
 #include "hydraulis/impl/communication/comm_group.h"
 #include "hydraulis/impl/communication/nccl_comm_group.h"
 #include "hydraulis/impl/profiler/profiler.h"
+#include "hydraulis/impl/profiler/trace.h"
 #include "hydraulis/impl/utils/cuda_utils.h"
 #include "hydraulis/core/symbol.h"
 #include "hydraulis/core/ndarray_storage.h"
@@ -14,6 +20,7 @@
 #include <ctime>
 #include <iostream>
 #include <fstream>
+#include <numeric>
 
 namespace hydraulis {
 namespace graph {
@@ -97,6 +104,7 @@ Operator& ExecutableGraph::MakeOpInner(std::shared_ptr<OpInterface> body,
 
 bool ExecutableGraph::Instantiate(const TensorList& fetches,
                                   const Device& preferred_device) {
+  HostPhaseTimer phase_timer(HostPhase::EXEC_INSTANTIATE);
   auto is_op_instantiated = [&](const Operator& op) -> bool {
     return !op->placement().is_undetermined();
   };
@@ -277,6 +285,7 @@ bool ExecutableGraph::Instantiate(const TensorList& fetches,
 }
 
 void ExecutableGraph::InsertContiguousOp(const OpRefList& topo_order) {
+  HostPhaseTimer phase_timer(HostPhase::INSERT_CONTIGUOUS_OP);
   auto& local_device = hydraulis::impl::comm::GetLocalDevice();
   for (auto& op_ref : topo_order) {
     auto& op = op_ref.get();
@@ -323,6 +332,7 @@ void ExecutableGraph::InsertContiguousOp(const OpRefList& topo_order) {
 }
 
 void ExecutableGraph::SubstituteCommOp(const OpRefList& topo_order) {
+  HostPhaseTimer phase_timer(HostPhase::SUBSTITUTE_COMM_OP);
   auto& local_device = hydraulis::impl::comm::GetLocalDevice();
   // std::unordered_map<OpId, OpId> old_comm_to_new;
   for (auto& op_ref : topo_order) {
@@ -805,6 +815,7 @@ void ExecutableGraph::ComputeFunc(size_t& micro_batch_id, const OpRefList& topo,
                                   Tensor2NDArrayMap& grad_accumulation, bool grad_accumulation_finished,
                                   const FeedDict& feed_dict, const TensorList& fetches,
                                   const std::unordered_map<TensorId, size_t>& fetch_indices, bool& is_continuous_p2p) {
+  HostPhaseTimer phase_timer(HostPhase::DISPATCH);
   const TensorIdSet& dtype_transfer_tensor = _execute_plan.dtype_transfer_tensor;
   const TensorIdSet& shared_weight_tensor = _execute_plan.shared_weight_tensor;
   const OpIdSet& shared_weight_p2p = _execute_plan.shared_weight_p2p;
@@ -944,7 +955,28 @@ void ExecutableGraph::ComputeFunc(size_t& micro_batch_id, const OpRefList& topo,
     }
 
     // **** 调用op计算 ****
+    // 记录的是host上发射op的时间，pipeline的send/recv单独归为p2p
+    HT_TRACE_SPAN(op_span, is_pipeline_stage_send_op(op) || is_pipeline_stage_recv_op(op) ? "p2p" : "op",
+                  op->name());
+    if (op_span.active()) {
+      op_span.AddArg("type", op->type());
+      op_span.AddArg("micro_batch", micro_batch_id);
+      op_span.AddArg("stream", op->stream_index());
+      auto subgraph = op->graph().GetSubGraph(op);
+      if (subgraph != nullptr)
+        op_span.AddArg("subgraph", subgraph->global_name());
+    }
+    // MICRO_BATCH级别的memory profile会把allocated的变化归因到每个op上
+    std::shared_ptr<MemoryProfiler> memory_profiler = nullptr;
+    size_t allocated_before = 0;
+    if (_memory_profile_level == MEMORY_PROFILE_LEVEL::MICRO_BATCH) {
+      memory_profiler = GetMemoryProfiler(hydraulis::impl::comm::GetLocalDevice());
+      allocated_before = memory_profiler->GetCurrAllocatedBytes();
+    }
     NDArrayList output_vals = op->Compute(input_vals, runtime_ctx, micro_batch_id);
+    op_span.End();
+    if (memory_profiler != nullptr)
+      memory_profiler->RecordOp(op, micro_batch_id, allocated_before, input_vals, output_vals);
     checkOutputsMemory(op, micro_batch_id, input_vals, output_vals);
 
     // auto output_vals = op->Compute(input_vals, runtime_ctx, micro_batch_id);
@@ -983,6 +1015,13 @@ void ExecutableGraph::ComputeFunc(size_t& micro_batch_id, const OpRefList& topo,
     for (auto& output : op->outputs()) {
       auto grad_reduce_subgraph_it = _grad_reduce_subgraph_map.find(output->id());
       if (grad_accumulation_finished && _overlap_grad_reduce && grad_reduce_subgraph_it != _grad_reduce_subgraph_map.end()) {
+        // 开启grad bucketing时放入bucket中，bucket满了再统一通信
+        auto grad_bucket_it = _grad_bucket_indices.find(output->id());
+        if (_grad_bucket_reducer != nullptr && _run_level != RunLevel::COMPUTE_ONLY
+            && grad_bucket_it != _grad_bucket_indices.end()) {
+          ReduceGradInBucket(grad_bucket_it->second, tensor2data, runtime_ctx, micro_batch_id);
+          continue;
+        }
         // HT_LOG_INFO << "execute grad reduce for " << output << " begin...";
         grad_reduce_subgraph_it->second->run(tensor2data, _preserved_data, runtime_ctx, micro_batch_id, SubGraphOpType::UPDATE, false,
           [this](Operator& op, Tensor2NDArrayMap& tensor2data, size_t micro_batch_id) {
@@ -999,6 +1038,122 @@ void ExecutableGraph::ComputeFunc(size_t& micro_batch_id, const OpRefList& topo,
   }
 }
 
+void ExecutableGraph::BuildGradBuckets(const OpRefList& local_bw_topo) {
+  _grad_bucket_reducer = nullptr;
+  _grad_bucket_indices.clear();
+  _grad_bucket_ops.clear();
+  auto reducer = GradBucketReducer::FromEnv();
+  if (reducer == nullptr) {
+    return;
+  }
+  auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  // 反向的拓扑序即grad产生的顺序
+  for (auto& op_ref : local_bw_topo) {
+    for (auto& output : op_ref.get()->outputs()) {
+      auto it = _grad_reduce_subgraph_map.find(output->id());
+      if (it == _grad_reduce_subgraph_map.end()) {
+        continue;
+      }
+      auto& reduce_op = it->second->update_ops_topo().front().get();
+      auto& grad = reduce_op->output(0);
+      // 只对结果直接放在current grad buffer中的all-reduce与reduce-scatter做bucketing
+      // split（hetero）的情形仍然逐个通信
+      if (reduce_op->placement() != local_device
+          || !_current_grad_buffer_map[grad->dtype()]->HasTensor(grad)) {
+        continue;
+      }
+      GradBucketSpec spec;
+      spec.dtype = grad->dtype();
+      spec.stream_index = reduce_op->instantiation_ctx().stream_index;
+      if (is_all_reduce_op(reduce_op)) {
+        auto& impl = dynamic_cast<AllReduceOpImpl&>(reduce_op->body());
+        spec.comm_group = impl.comm_group();
+        spec.red_type = impl.reduction_type();
+        spec.reduce_scatter = false;
+      } else if (is_reduce_scatter_op(reduce_op)) {
+        auto& impl = dynamic_cast<ReduceScatterOpImpl&>(reduce_op->body());
+        // 只有沿着第0维scatter时每个shard才是连续的
+        if (impl.get_scatter_dim() != 0) {
+          continue;
+        }
+        spec.comm_group = impl.comm_group();
+        spec.red_type = impl.reduction_type();
+        spec.reduce_scatter = true;
+      } else {
+        continue;
+      }
+      _grad_bucket_indices[output->id()] = reducer->AddGrad(spec, reduce_op->input(0)->numel());
+      _grad_bucket_ops.push_back(reduce_op);
+    }
+  }
+  if (_grad_bucket_ops.empty()) {
+    return;
+  }
+  reducer->Build();
+  // current grad buffer中先按照bucket的顺序放置bucket中的grad，其余的grad放在后面
+  for (int i = 0; i < static_cast<int>(DataType::NUM_DATA_TYPES); i++) {
+    DataType dtype = static_cast<DataType>(i);
+    auto order = reducer->OutputOrder(dtype);
+    if (order.empty()) {
+      continue;
+    }
+    auto& old_buffer = _current_grad_buffer_map[dtype];
+    HT_ASSERT(!old_buffer->IsAllocated())
+      << "current grad buffer should be reordered before allocation";
+    auto new_buffer = std::make_shared<ParamBuffer>("bucketed_current_grad_buffer_" + DataType2Str(dtype));
+    TensorIdSet bucketed_grads;
+    for (auto grad_id : order) {
+      auto& grad = _grad_bucket_ops[grad_id]->output(0);
+      new_buffer->AddTensor(grad);
+      HT_ASSERT(new_buffer->GetElementOffest(grad) == reducer->OutputOffset(grad_id))
+        << "the layout of " << grad << " in the current grad buffer mismatches its grad bucket";
+      bucketed_grads.insert(grad->id());
+    }
+    for (const auto& grad : old_buffer->tensor_list()) {
+      if (bucketed_grads.find(grad->id()) == bucketed_grads.end()) {
+        new_buffer->AddTensor(grad);
+      }
+    }
+    HT_ASSERT(new_buffer->size() == old_buffer->size())
+      << "buffer size should be equal";
+    old_buffer = std::move(new_buffer);
+  }
+  HT_LOG_INFO << local_device << ": [GradBucket] " << _grad_bucket_ops.size() << " grads are reduced in "
+    << reducer->num_buckets() << " buckets";
+  _grad_bucket_reducer = std::move(reducer);
+}
+
+void ExecutableGraph::ReduceGradInBucket(size_t grad_id, Tensor2NDArrayMap& tensor2data,
+                                         RuntimeContext& runtime_ctx, size_t micro_batch_id) {
+  auto& reduce_op = _grad_bucket_ops.at(grad_id);
+  auto& input = reduce_op->input(0);
+  // 与reduce op自己执行时一样，在其stream上等待grad算完
+  reduce_op->BlockOrSyncAllInputs(runtime_ctx, micro_batch_id);
+  auto data_it = tensor2data.find(input->id());
+  HT_ASSERT(data_it != tensor2data.end())
+    << "cannot find the data of " << input << " for grad bucketing";
+  auto launched = _grad_bucket_reducer->Ready(grad_id, data_it->second);
+  // 已经拷贝进bucket，grad reduce op是其唯一的consumer时可以提前释放
+  if (input->num_consumers() == 1) {
+    tensor2data.erase(data_it);
+  }
+  RecordGradBuckets(launched, tensor2data, micro_batch_id);
+}
+
+void ExecutableGraph::RecordGradBuckets(const std::vector<size_t>& buckets, Tensor2NDArrayMap& tensor2data,
+                                        size_t micro_batch_id) {
+  for (auto bucket_id : buckets) {
+    for (auto grad_id : _grad_bucket_reducer->bucket_grads(bucket_id)) {
+      auto& reduce_op = _grad_bucket_ops.at(grad_id);
+      auto& output = reduce_op->output(0);
+      tensor2data[output->id()] = _grad_bucket_reducer->GetOutput(grad_id, output->shape());
+      // 后续算子会等待reduce op的stop event
+      reduce_op->instantiation_ctx().start[micro_batch_id]->Record(reduce_op->instantiation_ctx().stream());
+      reduce_op->instantiation_ctx().stop[micro_batch_id]->Record(reduce_op->instantiation_ctx().stream());
+    }
+  }
+}
+
 void ExecutableGraph::GetExecEnvs() {
   char* env = std::getenv("HYDRAULIS_P2P");
   if (env != nullptr) {
@@ -1097,6 +1252,7 @@ void ExecutableGraph::GetExecEnvs() {
     if (std::string(env) == "MICRO_BATCH") {
       _memory_profile_level = MEMORY_PROFILE_LEVEL::MICRO_BATCH;
       _all_micro_batches_memory_info.clear();
+      GetMemoryProfiler(hydraulis::impl::comm::GetLocalDevice())->ClearOpRecords();
     } else if (std::string(env) == "INFO") {
       _memory_profile_level = MEMORY_PROFILE_LEVEL::INFO;
     } else if (std::string(env) == "WARN") {
@@ -1117,6 +1273,20 @@ void ExecutableGraph::GetExecEnvs() {
     _memory_log_file_path = "";
   }
 
+  env = std::getenv("HYDRAULIS_MEMORY_AWARE_TOPO");
+  if (env != nullptr) {
+    if (std::string(env) == "ON") {
+      _memory_aware_topo = true;
+    } else if (std::string(env) == "OFF") {
+      _memory_aware_topo = false;
+    } else {
+      HT_RUNTIME_ERROR << "Unknown hydraulis memory aware topo setting: " + std::string(env);
+    }
+  } else {
+    // 默认按照原先的启发式排序
+    _memory_aware_topo = false;
+  }
+
   env = std::getenv("HYDRAULIS_PARALLEL_ATTN");
   if (env != nullptr) {
     if (std::string(env) == "ANALYSIS") {
@@ -1146,6 +1316,11 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
                                         const FeedDict& feed_dict, 
                                         const int num_micro_batches) {
   auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  HT_TRACE_SPAN(step_span, "step", name() + " run");
+  if (step_span.active()) {
+    hydraulis::impl::Tracer::SetProcessRank(hydraulis::impl::comm::GetWorldRank());
+    step_span.AddArg("num_micro_batches", num_micro_batches);
+  }
   // calculate params
   bool is_calculate_params = false;
   if (is_calculate_params) {
@@ -1219,7 +1394,7 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
   }
   auto& pipeline = _pipeline_map[local_device];
   int num_stages = pipeline.size();
-  bool is_inference = (_execute_plan.local_bw_topo.size() == 0);
+  bool is_inference = this->is_inference();
   HT_LOG_DEBUG << local_device << ": num_stages = " << num_stages << ", stages = " << pipeline 
     << ", num_micro_batches = " << num_micro_batches << ", is_inference = " << is_inference;
   // get task schedule table for pipedream-flush, also suitable for non-pipeline cases
@@ -1242,6 +1417,9 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
   HT_LOG_DEBUG << local_device << ": 1. pipeline init[end]";
 
   HT_LOG_DEBUG << local_device << ": 2. alloc and compute buffer[begin]";
+  if (!_offload_host_tensors.empty()) {
+    AssignOffloadHostSlots(tasks, num_micro_batches);
+  }
   // alloc origin/transfer params and pre-compute, alloc grads
   PreRun(runtime_ctx_list);
   HT_LOG_DEBUG << local_device << ": 2. alloc and compute buffer[end]";
@@ -1252,7 +1430,7 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
     // memory debug use
     // hydraulis::impl::comm::EmptyNCCLCache();
     if (_memory_profile_level == MEMORY_PROFILE_LEVEL::INFO)
-      GetCUDAProfiler(local_device)->PrintCurrMemoryInfo(name() + " run ALLOC end");
+      GetMemoryProfiler(local_device)->PrintCurrMemoryInfo(name() + " run ALLOC end");
     return {};
   }
   // ********************** Run Level Check Point **********************
@@ -1265,7 +1443,7 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
   auto memory_space = NDArray::empty({memory_size}, local_device, kInt64, kComputingStream);
   HT_LOG_DEBUG << "Memory plan is generated and allocated";
   if (_memory_profile_level == MEMORY_PROFILE_LEVEL::INFO)
-    GetCUDAProfiler(local_device)->PrintCurrMemoryInfo(name() + " alloc memory according to plan end");
+    GetMemoryProfiler(local_device)->PrintCurrMemoryInfo(name() + " alloc memory according to plan end");
   for (auto& op_ref : _execute_plan.local_topo) {
     auto& op = op_ref.get();
     for (auto& tensor : op->outputs()) {
@@ -1348,10 +1526,14 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
       micro_batch_memory_info->is_forward = is_forward;
       micro_batch_memory_info->stage_id = stage_id;
       micro_batch_memory_info->micro_batch_id = micro_batch_id;
-      micro_batch_memory_info->begin_memory_info = GetCUDAProfiler(local_device)->GetCurrMemoryInfo();
+      micro_batch_memory_info->begin_memory_info = GetMemoryProfiler(local_device)->GetCurrMemoryInfo();
       _all_micro_batches_memory_info.emplace_back(micro_batch_memory_info);
     }
     // micro batch i: execute fw/bw
+    HT_TRACE_SPAN(micro_batch_span, "micro_batch", std::string(is_forward ? "forward" : "backward")
+                                                   + " mb " + std::to_string(micro_batch_id));
+    micro_batch_span.AddArg("micro_batch", micro_batch_id);
+    micro_batch_span.AddArg("stage", stage_id);
     if (is_forward) {
       // HT_LOG_INFO << "fw topo: " << _execute_plan.local_fw_topo;
       ComputeFunc(micro_batch_id, _execute_plan.local_fw_topo, runtime_ctx,
@@ -1364,9 +1546,10 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
                   tensor2data, tensor2degrees, grad_accumulation, grad_accumulation_finished, 
                   feed_dict, fetches, fetch_indices, is_continuous_p2p);
     }
+    micro_batch_span.End();
     // micro batch i: profile memory end
     if (_memory_profile_level == MEMORY_PROFILE_LEVEL::MICRO_BATCH) {
-      _all_micro_batches_memory_info.back()->end_memory_info = GetCUDAProfiler(local_device)->GetCurrMemoryInfo();
+      _all_micro_batches_memory_info.back()->end_memory_info = GetMemoryProfiler(local_device)->GetCurrMemoryInfo();
       // HT_LOG_INFO << *_all_micro_batches_memory_info.back();
     }
     if (is_forward) {
@@ -1390,14 +1573,27 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
   if (_run_level == RunLevel::COMPUTE_ONLY) {
     SynchronizeAllStreams();
     if (_memory_profile_level == MEMORY_PROFILE_LEVEL::INFO)
-      GetCUDAProfiler(local_device)->PrintCurrMemoryInfo(name() + " run COMPUTE_ONLY end");
+      GetMemoryProfiler(local_device)->PrintCurrMemoryInfo(name() + " run COMPUTE_ONLY end");
     return {};
   }
   // ********************** Run Level Check Point **********************
 
   HT_LOG_DEBUG << local_device << ": 4. reduce grad and update[begin]";
-  PostRun(runtime_ctx_list, tensor2data_list[num_micro_batches - 1]);
+  {
+    HostPhaseTimer phase_timer(HostPhase::POST_RUN);
+    HT_TRACE_SPAN(update_span, "step", "reduce grad and update");
+    PostRun(runtime_ctx_list, tensor2data_list[num_micro_batches - 1]);
+  }
   HT_LOG_DEBUG << local_device << ": 4. reduce grad and update[end]";
+  if (_grad_bucket_reducer != nullptr && _overlap_grad_reduce && _grad_bucket_reducer->profiling()) {
+    auto timings = _grad_bucket_reducer->Timings();
+    for (size_t i = 0; i < timings.size(); i++) {
+      HT_LOG_INFO << local_device << ": [GradBucket] bucket " << i
+        << ", grads = " << timings[i].num_grads
+        << ", size = " << timings[i].num_bytes / (1024.0 * 1024.0) << " MiB"
+        << ", launch to finish = " << timings[i].launch_to_finish_ms << " ms";
+    }
+  }
 
   // ********************** Run Level Check Point **********************
   // 仅仅是算出grad但不更新
@@ -1460,10 +1656,15 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
     }
     _p2p_events.clear();
     if (_memory_profile_level == MEMORY_PROFILE_LEVEL::INFO)
-      GetCUDAProfiler(local_device)->PrintCurrMemoryInfo(name() + " run GRAD end");
+      GetMemoryProfiler(local_device)->PrintCurrMemoryInfo(name() + " run GRAD end");
     return {};
   }
   // 说明是RunLevel::UPDATE了
+  // ZeRO-Offload: 等待所有param写回device
+  if (_optimizer_offload != nullptr) {
+    HT_TRACE_SPAN(offload_span, "step", "zero offload finish");
+    _optimizer_offload->Finish();
+  }
   // 提前进行一些固有map的清空（sync结果前）
   // 这样CPU和GPU可以异步进行
   _run_grad_events.clear();
@@ -1497,6 +1698,16 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
 
   HT_LOG_DEBUG << local_device << ": 5. get results[begin]";
   NDArrayList results(fetches.size(), NDArray());
+  // micro batch重排过时按照原来的顺序拼接结果
+  std::vector<size_t> micro_batch_position(num_micro_batches);
+  std::iota(micro_batch_position.begin(), micro_batch_position.end(), 0);
+  if (!_micro_batch_order.empty()) {
+    HT_ASSERT(_micro_batch_order.size() == num_micro_batches)
+      << "micro batch order " << _micro_batch_order << " mismatches the number of micro batches " << num_micro_batches;
+    for (size_t i = 0; i < _micro_batch_order.size(); i++) {
+      micro_batch_position[_micro_batch_order[i]] = i;
+    }
+  }
   std::unordered_set<OpId> to_sync_op_ids;
   to_sync_op_ids.reserve(fetches.size());
   for (auto& op_ref : _execute_plan.local_topo) {
@@ -1511,12 +1722,13 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
           } else if (is_placeholder_op(op)) {
             auto feed_it = feed_dict.find(output->id());
             if (feed_it != feed_dict.end()) {
-              results[it->second] = feed_it->second[num_micro_batches - 1];
+              results[it->second] = feed_it->second[micro_batch_position[num_micro_batches - 1]];
             }
           } else {
             NDArrayList result;
             result.reserve(num_micro_batches);
-            for (auto& tensor2data : tensor2data_list) {
+            for (auto position : micro_batch_position) {
+              auto& tensor2data = tensor2data_list[position];
               auto it = tensor2data.find(output->id());
               HT_ASSERT (it != tensor2data.end()) << "Something wrong! Can't find the data to fetch.";
               result.push_back(tensor2data[output->id()]);
@@ -1567,7 +1779,7 @@ NDArrayList ExecutableGraph::CrucialRun(const TensorList& fetches,
       // _current_grad_buffer->Free();
     }
     if (_memory_profile_level == MEMORY_PROFILE_LEVEL::INFO)
-      GetCUDAProfiler(local_device)->PrintCurrMemoryInfo(name() + " run UPDATE end");
+      GetMemoryProfiler(local_device)->PrintCurrMemoryInfo(name() + " run UPDATE end");
     return results;
   }
   // ********************** Run Level Check Point **********************
@@ -1584,7 +1796,7 @@ NDArrayList ExecutableGraph::Run(const Tensor& loss, const TensorList& fetches,
   auto& local_device = hydraulis::impl::comm::GetLocalDevice();
   HT_LOG_DEBUG << local_device << ": exec graph run begin .............";
   if (_memory_profile_level == MEMORY_PROFILE_LEVEL::INFO)
-    GetCUDAProfiler(local_device)->PrintCurrMemoryInfo(name() + " run begin");
+    GetMemoryProfiler(local_device)->PrintCurrMemoryInfo(name() + " run begin");
 
   // TODO: For each pair of `fetches` and `feed_dict`,
   // deduce the optimal execution plan, and cache it.
@@ -1617,6 +1829,17 @@ NDArrayList ExecutableGraph::Run(const Tensor& loss, const TensorList& fetches,
       OpRefList topo_before_recompute = Graph::TopoSort(fetches, num_ops(), is_op_computed);
       HT_LOG_DEBUG << local_device << ": global topo before recompute pass: " << topo_before_recompute;
 
+      // choose recompute and offload ops under the memory budget
+      if (MemoryBudgetPlanner::enabled()) {
+        HT_LOG_INFO << local_device << ": [Execution Plan] memory budget pass begin...";
+        const Tensor2ShapeMap empty_shape_plan;
+        const auto& shape_plan = _shape_plan_pool.empty() ? empty_shape_plan
+                                 : _active_shape_plan_list.empty() ? _shape_plan_pool.front()
+                                 : _shape_plan_pool.at(_active_shape_plan);
+        MemoryBudgetPlanner::ApplyMemoryBudget(topo_before_recompute, shape_plan);
+        HT_LOG_INFO << local_device << ": [Execution Plan] memory budget pass end...";
+      }
+
       // add recompute pass
       HT_LOG_INFO << local_device << ": [Execution Plan] recompute pass begin...";
       Graph::push_graph_ctx(id());
@@ -1647,6 +1870,27 @@ NDArrayList ExecutableGraph::Run(const Tensor& loss, const TensorList& fetches,
       Graph::pop_graph_ctx();
       HT_LOG_INFO << local_device << ": [Execution Plan] substitute comm_op end...";
 
+      // fuse elementwise ops
+      if (ElewiseFusion::enabled()) {
+        OpRefList topo_before_fusion = Graph::TopoSort(fetches, num_ops(), is_op_computed);
+        HT_LOG_DEBUG << local_device << ": global topo before elementwise fusion: " << topo_before_fusion;
+        // fetch、grad与transfer param需要保留
+        TensorIdSet excluded;
+        for (auto& fetch : fetches)
+          excluded.insert(fetch->id());
+        for (auto& kv : _grad_map)
+          if (kv.second.is_defined())
+            excluded.insert(kv.second->id());
+        for (auto& kv : _transfer_map)
+          if (kv.second.is_defined())
+            excluded.insert(kv.second->id());
+        HT_LOG_INFO << local_device << ": [Execution Plan] elementwise fusion pass begin...";
+        Graph::push_graph_ctx(id()); // ensure the new ops created in execute_graph
+        ElewiseFusion::FuseElewiseOps(topo_before_fusion, excluded);
+        Graph::pop_graph_ctx();
+        HT_LOG_INFO << local_device << ": [Execution Plan] elementwise fusion pass end...";
+      }
+
       // update topo with substituted comm_ops
       OpRefList topo_before_contiguous = Graph::TopoSort(fetches, num_ops(), is_op_computed);
       HT_LOG_DEBUG << local_device << ": global topo before add contiguous op: " << topo_before_contiguous;
@@ -1672,7 +1916,20 @@ NDArrayList ExecutableGraph::Run(const Tensor& loss, const TensorList& fetches,
     // execute in each iteration, should be cached 
     HT_LOG_DEBUG << local_device << ": [Execution Plan] get local fw/bw topo begin...";
     // update topo
-    OpRefList updated_topo = Graph::TopoSort(fetches, -1, is_op_computed);
+    // 按照显存排序时使用当前shape plan中tensor的大小，parameter一直存活，不计入
+    std::function<int64_t(const Tensor&)> tensor_bytes;
+    const Tensor2ShapeMap empty_shape_plan;
+    const auto& shape_plan = _shape_plan_pool.empty() ? empty_shape_plan
+                             : _active_shape_plan_list.empty() ? _shape_plan_pool.front()
+                             : _shape_plan_pool.at(_active_shape_plan);
+    if (_memory_aware_topo) {
+      tensor_bytes = [&shape_plan](const Tensor& tensor) -> int64_t {
+        if (is_variable_op(tensor->producer()))
+          return 0;
+        return MemoryBudgetPlanner::TensorBytes(tensor, shape_plan);
+      };
+    }
+    OpRefList updated_topo = Graph::TopoSort(fetches, -1, is_op_computed, tensor_bytes);
     // HT_LOG_DEBUG << local_device << ": updated global topo after substitute comm_op: " << updated_topo;
 
     // split into fw_topo and bw_topo
@@ -2019,6 +2276,12 @@ NDArrayList ExecutableGraph::Run(const Tensor& loss, const TensorList& fetches,
     }
     HT_LOG_DEBUG << local_device << ": [Execution Plan] get transfer & grad map and running-once tensor & op end...";
     
+    if (_overlap_grad_reduce) {
+      HT_LOG_DEBUG << local_device << ": [Execution Plan] build grad buckets begin...";
+      BuildGradBuckets(local_bw_topo);
+      HT_LOG_DEBUG << local_device << ": [Execution Plan] build grad buckets end...";
+    }
+    
     HT_ASSERT(shared_weight_tensor.empty() && shared_weight_p2p.empty() && shared_weight_grad_p2p.empty())
       << "currently subgraph & ds hierarchy may not be compatible with the share weight, please don't use the share weight at this moment";
     // update & cached execute plan 
@@ -2076,6 +2339,14 @@ NDArrayList ExecutableGraph::Run(const Tensor& loss, const TensorList& fetches,
     return results;
   }
   
+  if (hydraulis::impl::Tracer::enabled()) {
+    auto memory_info = GetMemoryProfiler(local_device)->GetCurrMemoryInfo();
+    hydraulis::impl::Tracer::Counter("memory", "all reserved (MiB)", memory_info.all_reserved);
+    hydraulis::impl::Tracer::Counter("memory", "mempool reserved (MiB)", memory_info.mempool_reserved);
+    hydraulis::impl::Tracer::Counter("memory", "mempool peak reserved (MiB)", memory_info.mempool_peak_reserved);
+    hydraulis::impl::Tracer::Counter("memory", "mempool allocated (MiB)", memory_info.mempool_allocated);
+  }
+
   // get all micro batches memory consumption
   if (_memory_profile_level == MEMORY_PROFILE_LEVEL::MICRO_BATCH && _memory_log_file_path != "") {
     std::ofstream file;
@@ -2096,6 +2367,12 @@ NDArrayList ExecutableGraph::Run(const Tensor& loss, const TensorList& fetches,
     }
     file << "]";
     file.close();
+    // op粒度的峰值、top-k以及timeline
+    std::ofstream op_file(_memory_log_file_path + "_ops" + suffix, std::ios_base::app);
+    HT_RUNTIME_ERROR_IF(!op_file.is_open()) << "Error opening the file";
+    GetMemoryProfiler(local_device)->DumpOpRecords(op_file);
+    op_file << std::endl;
+    op_file.close();
   }
 
   // get op execute time, sort and analysis
@@ -2185,6 +2462,23 @@ NDArrayList ExecutableGraph::Run(const Tensor& loss, const TensorList& fetches,
         pp_p2p_time += op_time.second * 1.0 / 1e6;
       }
     }
+    // 开启tracing时同样作为counter写入trace
+    if (hydraulis::impl::Tracer::enabled()) {
+      const std::vector<std::pair<const char*, double>> breakdown = {
+        {"total run time (ms)", COST_MSEC(crucial_run)},
+        {"attn fwd time (ms)", attn_fwd_time},
+        {"attn bwd time (ms)", attn_bwd_time},
+        {"optimizer time (ms)", optimizer_time},
+        {"other compute time (ms)", other_compute_time},
+        {"tp collective time (ms)", tp_collective_time},
+        {"pp p2p time (ms)", pp_p2p_time},
+        {"dp param gather time (ms)", dp_param_gather_time},
+        {"dp grad reduce time (ms)", dp_grad_reduce_time},
+        {"blocking time (ms)", blocking_time},
+        {"other time (ms)", other_time}};
+      for (const auto& kv : breakdown)
+        hydraulis::impl::Tracer::Counter("straggler", kv.first, kv.second);
+    }
     if (is_analysis_perf) {
       HT_LOG_INFO << local_device << ": " 
                   << "\ntotal run time: " << COST_MSEC(crucial_run) << " ms, "
@@ -2244,7 +2538,7 @@ NDArrayList ExecutableGraph::Run(const Tensor& loss, const TensorList& fetches,
                 << "dp grad reduce time: " << dp_grad_reduce_time << " ms, "
                 << "blocking time: " << blocking_time << " ms, "
                 << "other time: " << other_time << " ms" << std::endl;
-              auto memory_info = GetCUDAProfiler(local_device)->GetCurrMemoryInfo();
+              auto memory_info = GetMemoryProfiler(local_device)->GetCurrMemoryInfo();
               file << "all reserved: " << memory_info.all_reserved << " mb, "
                 << "mempool reserved: " << memory_info.mempool_reserved << " mb, "
                 << "mempool peak reserved: " << memory_info.mempool_peak_reserved << " mb, "
@@ -10,6 +10,9 @@
 namespace hydraulis {
 namespace graph {
 
+class OptimizerCPUOffload;
+class GradBucketReducer;
+
 struct ExecutePlan {
   OpRefList local_placeholder_variable_ops;
   OpRefList local_fw_topo;
@@ -122,6 +125,12 @@ class ExecutableGraph : public Graph {
     _active_shape_plan_list = std::move(micro_batch_plan_list);
   }
 
+  // feed dict中的micro batch已经按照order重排（order[i]为第i个执行的micro batch原来的编号）
+  // fetch的结果会按照原来的顺序返回，为空时即不重排
+  void SetMicroBatchOrder(std::vector<size_t>&& micro_batch_order) {
+    _micro_batch_order = std::move(micro_batch_order);
+  }
+
   void AddShapePlan(const Tensor2ShapeMap& shape_plan) {
     _shape_plan_pool.emplace_back(shape_plan);
   }
@@ -229,6 +238,21 @@ class ExecutableGraph : public Graph {
     _leaf_symbolic_tensor_list.emplace_back(tensor);
   }
 
+  void SetOffloadHostTensors(TensorList&& offload_host_tensors, size_t host_alignment) {
+    _offload_host_tensors = std::move(offload_host_tensors);
+    _offload_host_alignment = host_alignment;
+  }
+
+  // ZeRO-Offload开启时非空
+  OptimizerCPUOffload* optimizer_offload() const {
+    return _optimizer_offload.get();
+  }
+
+  // 本次执行只有前向（不需要为反向保存中间结果）
+  bool is_inference() const {
+    return _execute_plan.local_bw_topo.empty();
+  }
+
  protected:
   DeviceGroup GetPrevStage();
 
@@ -269,12 +293,33 @@ class ExecutableGraph : public Graph {
     const Tensor& tensor, NDArray data,
     const Initializer& init = VoidifiedInitializer()) override;
 
+  // 按照当前stage的调度为每个micro batch分配activation offload的host buffer
+  // micro batch的backward结束后其buffer即可给之后forward的micro batch复用
+  void AssignOffloadHostSlots(const std::vector<std::pair<int32_t, size_t>>& tasks,
+                              size_t num_micro_batches);
+
   void PreRun(std::vector<RuntimeContext>& runtime_ctx_list);
 
   void PostRun(std::vector<RuntimeContext>& runtime_ctx_list, Tensor2NDArrayMap& tensor2data);
 
   OpHandlerStatus PostOpHandler(Operator& op, Tensor2NDArrayMap& tensor2data, size_t micro_batch_id);
 
+  // grad bucketing相关
+  // 按照反向中grad产生的顺序划分bucket，并按照bucket的顺序重排current grad buffer
+  void BuildGradBuckets(const OpRefList& local_bw_topo);
+
+  // grad reduce op的输入已经产生，放入bucket中
+  void ReduceGradInBucket(size_t grad_id, Tensor2NDArrayMap& tensor2data,
+                          RuntimeContext& runtime_ctx, size_t micro_batch_id);
+
+  // 记录已经发起通信的bucket中各个grad reduce op的输出与event
+  void RecordGradBuckets(const std::vector<size_t>& buckets, Tensor2NDArrayMap& tensor2data,
+                         size_t micro_batch_id);
+
+  // 记录subgraph中optimizer update算子所更新的variables的event
+  // update是param在当前step中的最后一次使用，之后即可开始（预）切换
+  void RecordRunParamEvents(const SubGraph& subgraph);
+
   NDArrayList CrucialRun(const TensorList& fetches, 
                          const FeedDict& feed_dict, 
                          const int num_micro_batches);
@@ -298,6 +343,7 @@ class ExecutableGraph : public Graph {
   std::vector<Tensor2ShapeMap> _shape_plan_pool;
   size_t _active_shape_plan;
   std::vector<size_t> _active_shape_plan_list;
+  std::vector<size_t> _micro_batch_order;
   std::vector<Tensor> _record_exec_tensors;
 
   // run相关
@@ -307,6 +353,19 @@ class ExecutableGraph : public Graph {
   int _num_micro_batches;
   std::vector<std::unique_ptr<Event>> _p2p_events;
 
+  // activation offload相关
+  // offload到host上的tensor，按照其在host buffer中的布局排序
+  TensorList _offload_host_tensors;
+  size_t _offload_host_alignment{256};
+  // pinned host buffer的ring，个数为调度中同时存活的micro batch数，跨step复用
+  std::vector<std::shared_ptr<NDArrayStorage>> _offload_host_buffers;
+  std::vector<size_t> _offload_host_slots; // 每个micro batch使用的buffer
+
+  // ZeRO-Offload相关
+  // optimizer states放在host上的buckets中，param仍然在_origin_param_and_optimizer_buckets_map中
+  std::unordered_map<DataType, std::shared_ptr<ParamBuckets>> _host_optimizer_buckets_map;
+  std::shared_ptr<OptimizerCPUOffload> _optimizer_offload;
+
   // switch相关
   /*
   std::shared_ptr<ParamBuffer> _origin_param_buffer;
@@ -335,7 +394,9 @@ class ExecutableGraph : public Graph {
   std::unordered_map<TensorId, std::unique_ptr<Event>> _switch_grad_events; // 注意这里的TensorId是未substitue comm op前的grad
   // 记录当前图的param不再用的event
   // 即意味着可以开始切换param了
+  // 只有请求了预切换的step才会记录
   std::unordered_map<TensorId, std::unique_ptr<Event>> _run_param_events; 
+  bool _record_run_param_events{false};
   // 记录当前图的grad计算完的event
   // 即意味着可以开始切换grad了
   std::unordered_map<TensorId, std::unique_ptr<Event>> _run_grad_events; // 注意这里的TensorId是未substitue comm op后的grad
@@ -352,6 +413,11 @@ class ExecutableGraph : public Graph {
   // grad reduce算子的input到compute_optimize_bridge_subgraph的映射
   // 用于overlap grad reduce
   std::unordered_map<TensorId, std::shared_ptr<SubGraph>> _grad_reduce_subgraph_map;
+  // 开启HYDRAULIS_GRAD_BUCKET_SIZE时非空
+  // _grad_bucket_indices为grad reduce op的输入到bucket中grad编号的映射
+  std::shared_ptr<GradBucketReducer> _grad_bucket_reducer;
+  std::unordered_map<TensorId, size_t> _grad_bucket_indices;
+  OpList _grad_bucket_ops;
 
   // env相关
   bool _p2p_single_communicator;
@@ -363,6 +429,7 @@ class ExecutableGraph : public Graph {
   MEMORY_PROFILE_LEVEL _memory_profile_level;
   std::string _memory_log_file_path;
   std::vector<std::shared_ptr<MicroBatchMemoryInfo>> _all_micro_batches_memory_info;
+  bool _memory_aware_topo;
   int32_t _parallel_attn_flag;
   std::string _parallel_attn_log_file_path;
 };
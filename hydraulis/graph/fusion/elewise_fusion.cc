@@ -0,0 +1,233 @@
+#include "hydraulis/graph/fusion/elewise_fusion.h"
+#include "hydraulis/graph/ops/Arithmetics.h"
+#include "hydraulis/impl/communication/comm_group.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace hydraulis {
+namespace graph {
+
+bool ElewiseFusion::enabled() {
+  static bool enabled = []() {
+    const char* env = std::getenv("HYDRAULIS_ELEWISE_FUSION");
+    return env != nullptr && std::strcmp(env, "ON") == 0;
+  }();
+  return enabled;
+}
+
+bool ElewiseFusion::IsFusibleOp(Operator& op, const TensorIdSet& excluded) {
+  if (op->num_outputs() != 1 || op->op_indicator() & INPLACE_OP)
+    return false;
+  if (OpType2FusedType(op) == FusedType::UNKNOWN)
+    return false;
+  if (op->placement().is_undetermined() || !op->placement().is_cpu())
+    return false;
+  const auto& output = op->output(0);
+  if (excluded.find(output->id()) != excluded.end())
+    return false;
+  auto dtype = output->dtype();
+  if (dtype != kFloat32 && dtype != kFloat64 && dtype != kFloat16 && dtype != kBFloat16)
+    return false;
+  for (auto dim : output->shape()) {
+    if (dim < 0)
+      return false;
+  }
+  for (const auto& input : op->inputs()) {
+    if (input->dtype() != dtype || input->placement() != op->placement())
+      return false;
+  }
+  return true;
+}
+
+void ElewiseFusion::ReplaceGroup(const FusionGroup& group) {
+  auto& cur_exec_graph = reinterpret_cast<ExecutableGraph&>(Graph::GetGraph(Graph::cur_graph_ctx()));
+  auto& first_op = group.ops.front().get();
+  auto& last_op = group.ops.back().get();
+
+  // 前num_inputs个寄存器为外部输入，之后每个算子一个寄存器
+  OpIdSet group_op_ids;
+  for (auto& op_ref : group.ops)
+    group_op_ids.insert(op_ref.get()->id());
+  std::unordered_map<TensorId, int32_t> tensor_to_register;
+  TensorList inputs;
+  for (auto& op_ref : group.ops) {
+    for (const auto& input : op_ref.get()->inputs()) {
+      if (group_op_ids.find(input->producer()->id()) != group_op_ids.end() ||
+          tensor_to_register.find(input->id()) != tensor_to_register.end())
+        continue;
+      tensor_to_register[input->id()] = inputs.size();
+      inputs.push_back(input);
+    }
+  }
+  FusedProgram program;
+  program.num_inputs = inputs.size();
+  program.num_registers = inputs.size() + group.ops.size();
+  TensorList orig_outputs;
+  std::vector<NDArrayMeta> output_metas;
+  for (size_t k = 0; k < group.ops.size(); k++) {
+    auto& op = group.ops[k].get();
+    FusedInstr instr;
+    instr.type = OpType2FusedType(op);
+    instr.src0 = tensor_to_register.at(op->input(0)->id());
+    if (IsBinaryFusedType(instr.type))
+      instr.src1 = tensor_to_register.at(op->input(1)->id());
+    switch (instr.type) {
+      case FusedType::ADDCONST:
+        instr.value = reinterpret_cast<const AddByConstOpImpl&>(op->body()).const_value();
+        break;
+      case FusedType::SUBCONST:
+        instr.value = reinterpret_cast<const SubByConstOpImpl&>(op->body()).const_value();
+        break;
+      case FusedType::SUBFROMCONST:
+        instr.value = reinterpret_cast<const SubFromConstOpImpl&>(op->body()).const_value();
+        break;
+      case FusedType::MULCONST:
+        instr.value = reinterpret_cast<const MulByConstOpImpl&>(op->body()).const_value();
+        break;
+      case FusedType::DIVCONST:
+        instr.value = reinterpret_cast<const DivByConstOpImpl&>(op->body()).const_value();
+        break;
+      case FusedType::DIVFROMCONST:
+        instr.value = reinterpret_cast<const DivFromConstOpImpl&>(op->body()).const_value();
+        break;
+      default:
+        break;
+    }
+    instr.dst = inputs.size() + k;
+    program.instrs.push_back(instr);
+    auto& output = op->output(0);
+    tensor_to_register[output->id()] = instr.dst;
+    // 被group外的算子使用的中间结果需要写回内存
+    bool used_outside = false;
+    for (auto& consumer_ref : output->consumers()) {
+      if (group_op_ids.find(consumer_ref.get()->id()) == group_op_ids.end()) {
+        used_outside = true;
+        break;
+      }
+    }
+    if (used_outside) {
+      program.output_registers.push_back(instr.dst);
+      orig_outputs.push_back(output);
+      output_metas.push_back(output->meta());
+    }
+  }
+  if (orig_outputs.empty())
+    return;
+
+  auto fused_outputs = MakeFusedGroupOp(
+    inputs, std::move(program), std::move(output_metas),
+    OpMeta().set_name(first_op->name() + "_fused").set_is_deduce_states(false));
+  auto& fused_op = fused_outputs.front()->producer();
+  for (size_t k = 0; k < fused_outputs.size(); k++) {
+    cur_exec_graph.RecordExecTensor(fused_outputs[k]);
+    if (orig_outputs[k]->has_cur_ds_union())
+      fused_outputs[k]->set_cur_ds_union(orig_outputs[k]->cur_ds_union());
+  }
+  if (last_op->output(0)->placement_group_union().size() != 0)
+    fused_op->MapToParallelDevices(last_op->output(0)->placement_group_union());
+  fused_op->Instantiate(last_op->placement(), last_op->stream_index());
+  auto subgraph = cur_exec_graph.GetSubGraph(first_op);
+  if (subgraph != nullptr) {
+    cur_exec_graph.AddOpToSubGraph(fused_op, subgraph->global_name(), cur_exec_graph.GetSubGraphOpType(first_op));
+  }
+  HT_LOG_DEBUG << "[Fusion] fuse " << group.ops.size() << " ops " << group.ops
+               << " into " << fused_op;
+
+  for (size_t k = 0; k < orig_outputs.size(); k++) {
+    // ReplaceInput会修改consumers，因此先拷贝一份
+    OpRefList consumers = orig_outputs[k]->consumers();
+    for (auto& consumer_ref : consumers) {
+      auto& consumer = consumer_ref.get();
+      if (group_op_ids.find(consumer->id()) != group_op_ids.end())
+        continue;
+      for (size_t j = 0; j < consumer->num_inputs(); j++) {
+        if (consumer->input(j)->id() == orig_outputs[k]->id())
+          Graph::ReplaceInput(consumer, j, fused_outputs[k]);
+      }
+    }
+  }
+  for (auto& op_ref : group.ops)
+    cur_exec_graph.DeleteExecOp(op_ref.get());
+}
+
+// 按照拓扑序贪心地将算子加入其输入的producer所在的group
+// 为了保证融合后不会成环，加入的算子的其余输入必须来自该group，或者来自拓扑序在group之前的算子
+void ElewiseFusion::FuseElewiseOps(const OpRefList& topo_order, const TensorIdSet& excluded) {
+  auto& cur_exec_graph = reinterpret_cast<ExecutableGraph&>(Graph::GetGraph(Graph::cur_graph_ctx()));
+  std::unordered_map<OpId, size_t> topo_idx;
+  for (size_t i = 0; i < topo_order.size(); i++)
+    topo_idx[topo_order[i].get()->id()] = i;
+
+  std::vector<FusionGroup> groups;
+  std::vector<TensorIdSet> group_inputs;
+  std::unordered_map<OpId, size_t> op_to_group;
+  auto is_internal = [&](const Tensor& tensor, size_t g) {
+    auto it = op_to_group.find(tensor->producer()->id());
+    return it != op_to_group.end() && it->second == g;
+  };
+  for (size_t i = 0; i < topo_order.size(); i++) {
+    auto& op = topo_order[i].get();
+    if (!IsFusibleOp(op, excluded))
+      continue;
+    auto subgraph = cur_exec_graph.GetSubGraph(op);
+    int64_t target = -1;
+    for (const auto& input : op->inputs()) {
+      auto it = op_to_group.find(input->producer()->id());
+      if (it == op_to_group.end())
+        continue;
+      size_t g = it->second;
+      auto& group_op = groups[g].ops.back().get();
+      if (group_op->output(0)->shape() != op->output(0)->shape() ||
+          group_op->stream_index() != op->stream_index() ||
+          groups[g].ops.size() >= kMaxGroupInstrs)
+        continue;
+      // 同一个subgraph中的算子才可以融合，以保证memory plan的正确性
+      auto group_subgraph = cur_exec_graph.GetSubGraph(group_op);
+      if (group_subgraph != subgraph || (subgraph != nullptr &&
+          cur_exec_graph.GetSubGraphOpType(group_op) != cur_exec_graph.GetSubGraphOpType(op)))
+        continue;
+      bool acyclic = true;
+      size_t num_new_inputs = 0;
+      for (const auto& other : op->inputs()) {
+        if (is_internal(other, g))
+          continue;
+        auto idx_it = topo_idx.find(other->producer()->id());
+        if (idx_it != topo_idx.end() && idx_it->second >= groups[g].min_topo_idx) {
+          acyclic = false;
+          break;
+        }
+        if (group_inputs[g].find(other->id()) == group_inputs[g].end())
+          num_new_inputs++;
+      }
+      if (!acyclic || group_inputs[g].size() + num_new_inputs > kMaxGroupInputs)
+        continue;
+      target = g;
+      break;
+    }
+    if (target < 0) {
+      target = groups.size();
+      groups.push_back({OpRefList(), i});
+      group_inputs.emplace_back();
+    }
+    for (const auto& input : op->inputs()) {
+      if (!is_internal(input, target))
+        group_inputs[target].insert(input->id());
+    }
+    groups[target].ops.push_back(topo_order[i]);
+    op_to_group[op->id()] = target;
+  }
+
+  size_t num_fused_ops = 0, num_fused_groups = 0;
+  for (const auto& group : groups) {
+    if (group.ops.size() < 2)
+      continue;
+    num_fused_ops += group.ops.size();
+    num_fused_groups++;
+    ReplaceGroup(group);
+  }
+  HT_LOG_DEBUG << hydraulis::impl::comm::GetLocalDevice() << ": [Fusion] fuse "
+               << num_fused_ops << " elementwise ops into " << num_fused_groups << " groups";
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "hydraulis/graph/common.h"
+#include "hydraulis/graph/executable_graph.h"
+#include "hydraulis/graph/graph.h"
+#include "hydraulis/graph/ops/FusedGroup.h"
+
+namespace hydraulis {
+namespace graph {
+
+// 将exec graph中相邻的elementwise算子融合成一个FusedGroupOp
+// 融合后每个tile只需读写一次内存，中间结果保存在寄存器（即cache）中
+// 目前只有CPU的融合kernel，因此只融合placement为CPU的算子
+class ElewiseFusion {
+ public:
+  // 通过环境变量HYDRAULIS_ELEWISE_FUSION=ON开启
+  static bool enabled();
+
+  // excluded中的tensor（例如fetch、grad与transfer param）必须保留，其producer不参与融合
+  static void FuseElewiseOps(const OpRefList& topo_order, const TensorIdSet& excluded);
+
+ protected:
+  struct FusionGroup {
+    OpRefList ops;
+    size_t min_topo_idx;
+  };
+
+  static bool IsFusibleOp(Operator& op, const TensorIdSet& excluded);
+
+  static void ReplaceGroup(const FusionGroup& group);
+
+  static constexpr size_t kMaxGroupInstrs = 64;
+  static constexpr size_t kMaxGroupInputs = 16;
+};
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,400 @@
+#include "hydraulis/graph/grad_bucket.h"
+#include "hydraulis/graph/ops/kernel_links.h"
+#include "hydraulis/impl/communication/comm_group.h"
+#include "hydraulis/impl/communication/threaded_world.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+  constexpr size_t MiB = 1024 * 1024;
+
+  inline NDArray flat_view(const NDArray& array, size_t offset, size_t numel) {
+    auto meta = NDArrayMeta().set_dtype(array->dtype())
+                             .set_device(array->device())
+                             .set_shape({static_cast<int64_t>(numel)});
+    return NDArray(meta, array->storage(), array->storage_offset() + offset);
+  }
+} // namespace
+
+std::vector<std::vector<size_t>> PlanGradBuckets(const std::vector<GradBucketSpec>& specs,
+                                                 const std::vector<size_t>& num_bytes,
+                                                 size_t bucket_bytes,
+                                                 size_t first_bucket_bytes) {
+  HT_ASSERT(specs.size() == num_bytes.size())
+    << "Each grad should have its size";
+  struct OpenBucket {
+    GradBucketSpec spec;
+    std::vector<size_t> grads;
+    size_t bytes{0};
+    bool is_first{true};
+  };
+  std::vector<std::vector<size_t>> buckets;
+  std::vector<OpenBucket> open_buckets;
+  for (size_t i = 0; i < specs.size(); i++) {
+    auto it = std::find_if(open_buckets.begin(), open_buckets.end(),
+                           [&](const OpenBucket& b) { return b.spec == specs[i]; });
+    if (it == open_buckets.end()) {
+      open_buckets.push_back({specs[i], {}, 0, true});
+      it = open_buckets.end() - 1;
+    }
+    it->grads.push_back(i);
+    it->bytes += num_bytes[i];
+    if (it->bytes >= (it->is_first ? first_bucket_bytes : bucket_bytes)) {
+      buckets.push_back(std::move(it->grads));
+      it->grads.clear();
+      it->bytes = 0;
+      it->is_first = false;
+    }
+  }
+  // 未满的bucket在其最后一个grad到达时发起
+  std::vector<std::vector<size_t>> remains;
+  for (auto& b : open_buckets) {
+    if (!b.grads.empty())
+      remains.push_back(std::move(b.grads));
+  }
+  std::sort(remains.begin(), remains.end(),
+            [](const std::vector<size_t>& x, const std::vector<size_t>& y) {
+              return x.back() < y.back();
+            });
+  buckets.insert(buckets.end(), std::make_move_iterator(remains.begin()),
+                 std::make_move_iterator(remains.end()));
+  return buckets;
+}
+
+std::unique_ptr<GradBucketReducer> GradBucketReducer::FromEnv() {
+  const char* env = std::getenv("HYDRAULIS_GRAD_BUCKET_SIZE");
+  if (env == nullptr || std::atof(env) <= 0)
+    return nullptr;
+  size_t bucket_bytes = static_cast<size_t>(std::atof(env) * MiB);
+  size_t first_bucket_bytes = MiB;
+  env = std::getenv("HYDRAULIS_GRAD_FIRST_BUCKET_SIZE");
+  if (env != nullptr)
+    first_bucket_bytes = static_cast<size_t>(std::max(0.0, std::atof(env)) * MiB);
+  auto reducer = std::make_unique<GradBucketReducer>(bucket_bytes, first_bucket_bytes);
+  env = std::getenv("HYDRAULIS_GRAD_BUCKET_PROFILE");
+  if (env != nullptr) {
+    if (std::string(env) == "ON") {
+      reducer->_profiling = true;
+    } else {
+      HT_VALUE_ERROR_IF(std::string(env) != "OFF")
+        << "Unknown hydraulis grad bucket profile setting: " << env;
+    }
+  }
+  return reducer;
+}
+
+size_t GradBucketReducer::AddGrad(const GradBucketSpec& spec, size_t numel) {
+  HT_ASSERT(!_is_built)
+    << "Cannot add grads after the buckets are built";
+  size_t num_ranks = spec.comm_group.num_devices();
+  HT_ASSERT(num_ranks >= 2)
+    << "Grad reduce requires two or more devices, got " << spec.comm_group;
+  HT_ASSERT(!spec.reduce_scatter || numel % num_ranks == 0)
+    << "Grad of " << numel << " elements cannot be reduce-scattered to " << num_ranks << " devices";
+  Grad grad;
+  grad.spec = spec;
+  grad.numel = numel;
+  grad.out_numel = spec.reduce_scatter ? numel / num_ranks : numel;
+  _grads.push_back(std::move(grad));
+  return _grads.size() - 1;
+}
+
+void GradBucketReducer::Build() {
+  HT_ASSERT(!_is_built)
+    << "The buckets are already built";
+  std::vector<GradBucketSpec> specs;
+  std::vector<size_t> num_bytes;
+  specs.reserve(_grads.size());
+  num_bytes.reserve(_grads.size());
+  for (const auto& grad : _grads) {
+    specs.push_back(grad.spec);
+    num_bytes.push_back(grad.numel * DataType2Size(grad.spec.dtype));
+  }
+  auto plan = PlanGradBuckets(specs, num_bytes, _bucket_bytes, _first_bucket_bytes);
+  // output按照bucket的顺序在各自dtype的buffer中连续存放
+  std::unordered_map<DataType, size_t> out_offsets;
+  _buckets.resize(plan.size());
+  for (size_t b = 0; b < plan.size(); b++) {
+    auto& bucket = _buckets[b];
+    auto dtype = _grads[plan[b].front()].spec.dtype;
+    bucket.grads = std::move(plan[b]);
+    bucket.out_offset = out_offsets[dtype];
+    for (auto i : bucket.grads) {
+      auto& grad = _grads[i];
+      grad.bucket = b;
+      grad.out_offset = bucket.out_offset + bucket.out_numel;
+      grad.staging_offset = bucket.out_numel;
+      bucket.out_numel += grad.out_numel;
+    }
+    out_offsets[dtype] += bucket.out_numel;
+  }
+  _is_built = true;
+  HT_LOG_DEBUG << "[GradBucket] " << _grads.size() << " grads are fused into "
+    << _buckets.size() << " buckets, bucket size = " << _bucket_bytes / MiB
+    << " MiB, first bucket size = " << _first_bucket_bytes / MiB << " MiB";
+}
+
+std::vector<size_t> GradBucketReducer::OutputOrder(DataType dtype) const {
+  HT_ASSERT(_is_built)
+    << "Please build the buckets first";
+  std::vector<size_t> order;
+  for (const auto& bucket : _buckets) {
+    if (_grads[bucket.grads.front()].spec.dtype != dtype)
+      continue;
+    order.insert(order.end(), bucket.grads.begin(), bucket.grads.end());
+  }
+  return order;
+}
+
+size_t GradBucketReducer::OutputNumel(DataType dtype) const {
+  size_t numel = 0;
+  for (const auto& bucket : _buckets) {
+    if (_grads[bucket.grads.front()].spec.dtype == dtype)
+      numel += bucket.out_numel;
+  }
+  return numel;
+}
+
+void GradBucketReducer::Bind(DataType dtype, const NDArray& output) {
+  HT_ASSERT(_is_built)
+    << "Please build the buckets first";
+  HT_ASSERT(output->dtype() == dtype && output->is_contiguous()
+            && static_cast<size_t>(output->numel()) >= OutputNumel(dtype))
+    << "Output of dtype " << dtype << " should be a contiguous array of at least "
+    << OutputNumel(dtype) << " elements, got " << output->meta();
+  _outputs[dtype] = output;
+  for (auto& bucket : _buckets) {
+    const auto& spec = _grads[bucket.grads.front()].spec;
+    if (spec.dtype != dtype || !spec.reduce_scatter)
+      continue;
+    bucket.staging = NDArray::empty({static_cast<int64_t>(bucket.out_numel * spec.comm_group.num_devices())},
+                                    output->device(), dtype, kBlockingStream);
+  }
+}
+
+void GradBucketReducer::Unbind() {
+  _outputs.clear();
+  for (auto& bucket : _buckets)
+    bucket.staging = NDArray();
+}
+
+void GradBucketReducer::CopyIn(size_t grad_id, const NDArray* data) {
+  const auto& grad = _grads[grad_id];
+  const auto& output = _outputs.at(grad.spec.dtype);
+  auto stream_index = grad.spec.stream_index;
+  NDArray src;
+  if (data != nullptr) {
+    src = (*data)->is_contiguous() ? *data : NDArray::contiguous(*data, stream_index);
+  }
+  if (!grad.spec.reduce_scatter) {
+    // all-reduce直接在output上in-place进行
+    auto dst = flat_view(output, grad.out_offset, grad.out_numel);
+    if (data != nullptr)
+      NDArray::copy(flat_view(src, 0, grad.numel), stream_index, dst);
+    else
+      NDArray::full_(dst, 0, stream_index);
+    return;
+  }
+  // reduce-scatter: 第j个shard放到staging的第j个rank区域中
+  auto& bucket = _buckets[grad.bucket];
+  size_t num_ranks = grad.spec.comm_group.num_devices();
+  for (size_t j = 0; j < num_ranks; j++) {
+    auto dst = flat_view(bucket.staging, j * bucket.out_numel + grad.staging_offset, grad.out_numel);
+    if (data != nullptr)
+      NDArray::copy(flat_view(src, j * grad.out_numel, grad.out_numel), stream_index, dst);
+    else
+      NDArray::full_(dst, 0, stream_index);
+  }
+}
+
+void GradBucketReducer::Launch(size_t bucket_id) {
+  auto& bucket = _buckets[bucket_id];
+  const auto& spec = _grads[bucket.grads.front()].spec;
+  const auto& output = _outputs.at(spec.dtype);
+  Stream stream(output->device(), spec.stream_index);
+  if (bucket.start == nullptr) {
+    bucket.start = CreateEvent(output->device(), true);
+    bucket.end = CreateEvent(output->device(), true);
+  }
+  auto out = flat_view(output, bucket.out_offset, bucket.out_numel);
+  bucket.start->Record(stream);
+  if (spec.reduce_scatter) {
+    HT_DISPATCH_KERNEL_CPU_AND_CUDA(output->device().type(), "GradBucketReduceScatter",
+                                    hydraulis::impl::ReduceScatter, bucket.staging, out,
+                                    spec.red_type, spec.comm_group, 0, stream);
+  } else {
+    HT_DISPATCH_KERNEL_CPU_AND_CUDA(output->device().type(), "GradBucketAllReduce",
+                                    hydraulis::impl::AllReduce, out, out,
+                                    spec.red_type, spec.comm_group, stream);
+  }
+  bucket.end->Record(stream);
+  bucket.launched = true;
+}
+
+std::vector<size_t> GradBucketReducer::LaunchInOrder() {
+  // 所有rank上bucket的发起顺序必须一致
+  std::vector<size_t> launched;
+  while (_next_launch < _buckets.size()
+         && _buckets[_next_launch].num_ready == _buckets[_next_launch].grads.size()) {
+    Launch(_next_launch);
+    launched.push_back(_next_launch);
+    _next_launch++;
+  }
+  return launched;
+}
+
+std::vector<size_t> GradBucketReducer::Ready(size_t grad_id, const NDArray& data) {
+  HT_ASSERT(_is_built)
+    << "Please build the buckets first";
+  auto& grad = _grads.at(grad_id);
+  HT_ASSERT(!grad.ready)
+    << "Grad " << grad_id << " is ready twice in a step";
+  HT_ASSERT(static_cast<size_t>(data->numel()) == grad.numel && data->dtype() == grad.spec.dtype)
+    << "Grad " << grad_id << " should have " << grad.numel << " elements of " << grad.spec.dtype
+    << ", got " << data->meta();
+  CopyIn(grad_id, &data);
+  grad.ready = true;
+  _buckets[grad.bucket].num_ready++;
+  return LaunchInOrder();
+}
+
+std::vector<size_t> GradBucketReducer::Flush() {
+  std::vector<size_t> launched;
+  for (size_t b = _next_launch; b < _buckets.size(); b++) {
+    auto& bucket = _buckets[b];
+    for (auto i : bucket.grads) {
+      if (!_grads[i].ready) {
+        HT_LOG_WARN << "[GradBucket] grad " << i << " of bucket " << b
+          << " is not produced in this step, reduce it as zeros";
+        CopyIn(i, nullptr);
+      }
+    }
+    Launch(b);
+    launched.push_back(b);
+  }
+  for (auto& grad : _grads)
+    grad.ready = false;
+  for (auto& bucket : _buckets) {
+    bucket.num_ready = 0;
+    bucket.launched = false;
+  }
+  _next_launch = 0;
+  return launched;
+}
+
+NDArray GradBucketReducer::GetOutput(size_t grad_id, const HTShape& shape) const {
+  const auto& grad = _grads.at(grad_id);
+  const auto& output = _outputs.at(grad.spec.dtype);
+  auto meta = NDArrayMeta().set_dtype(grad.spec.dtype)
+                           .set_device(output->device())
+                           .set_shape(shape);
+  HT_ASSERT(static_cast<size_t>(meta.numel()) == grad.out_numel)
+    << "Shape " << shape << " mismatches the " << grad.out_numel << " reduced elements of grad " << grad_id;
+  return NDArray(meta, output->storage(), output->storage_offset() + grad.out_offset);
+}
+
+std::vector<GradBucketTiming> GradBucketReducer::Timings() const {
+  std::vector<GradBucketTiming> timings;
+  timings.reserve(_buckets.size());
+  for (const auto& bucket : _buckets) {
+    GradBucketTiming timing;
+    timing.num_grads = bucket.grads.size();
+    for (auto i : bucket.grads)
+      timing.num_bytes += _grads[i].numel * DataType2Size(_grads[i].spec.dtype);
+    if (bucket.end != nullptr) {
+      bucket.end->Sync();
+      timing.launch_to_finish_ms = bucket.end->TimeSince(*bucket.start) / 1e6;
+    }
+    timings.push_back(timing);
+  }
+  return timings;
+}
+
+GradBucketBenchmarkResult BenchmarkGradBucketing(size_t num_grads, size_t numel_per_grad,
+                                                 size_t bucket_mb, size_t first_bucket_mb,
+                                                 bool reduce_scatter, int threaded_world_size) {
+  HT_VALUE_ERROR_IF(num_grads == 0 || numel_per_grad == 0 || bucket_mb == 0)
+    << "Invalid arguments for grad bucketing benchmark";
+  if (threaded_world_size > 0) {
+    GradBucketBenchmarkResult result;
+    hydraulis::impl::comm::ThreadedWorld::Run(threaded_world_size, [&](int rank) {
+      auto ret = BenchmarkGradBucketing(num_grads, numel_per_grad, bucket_mb,
+                                        first_bucket_mb, reduce_scatter, 0);
+      if (rank == 0)
+        result = std::move(ret);
+    });
+    return result;
+  }
+  const auto& device_group = hydraulis::impl::comm::GetGlobalDeviceGroup();
+  const auto& local_device = hydraulis::impl::comm::GetLocalDevice();
+  HT_VALUE_ERROR_IF(!local_device.is_cpu())
+    << "Grad bucketing benchmark runs on CPU devices, got " << local_device;
+  size_t num_ranks = device_group.num_devices();
+  HT_VALUE_ERROR_IF(num_ranks < 2)
+    << "Grad bucketing benchmark requires two or more ranks";
+  size_t rank = device_group.get_index(local_device);
+  // reduce-scatter时每个grad的大小向上取整到rank数的倍数
+  size_t numel = reduce_scatter ? DIVUP(numel_per_grad, num_ranks) * num_ranks : numel_per_grad;
+  size_t out_numel = reduce_scatter ? numel / num_ranks : numel;
+  Stream stream(local_device, kCollectiveStream);
+  auto comm_group = hydraulis::impl::comm::GetOrCreateCommGroup(
+    hydraulis::impl::comm::DeviceGroupToWorldRanks(device_group), stream);
+  using Clock = std::chrono::steady_clock;
+  auto elapsed_ms = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  };
+
+  NDArrayList grads, refs;
+  for (size_t i = 0; i < num_grads; i++) {
+    grads.push_back(NDArray::randn({static_cast<int64_t>(numel)}, local_device, kFloat32,
+                                   0, 1, 1000 * rank + i, kBlockingStream));
+    refs.push_back(NDArray::empty({static_cast<int64_t>(out_numel)}, local_device, kFloat32, kBlockingStream));
+  }
+
+  // 参照：每个grad各自通信
+  GradBucketBenchmarkResult result;
+  comm_group->Barrier(true);
+  auto start = Clock::now();
+  for (size_t i = 0; i < num_grads; i++) {
+    if (reduce_scatter)
+      hydraulis::impl::ReduceScatterCpu(grads[i], refs[i], kSUM, device_group, 0, stream);
+    else
+      hydraulis::impl::AllReduceCpu(grads[i], refs[i], kSUM, device_group, stream);
+  }
+  stream.Sync();
+  result.per_tensor_ms = elapsed_ms(start);
+
+  GradBucketReducer reducer(bucket_mb * MiB, first_bucket_mb * MiB);
+  GradBucketSpec spec{kFloat32, device_group, kSUM, reduce_scatter, kCollectiveStream};
+  for (size_t i = 0; i < num_grads; i++)
+    reducer.AddGrad(spec, numel);
+  reducer.Build();
+  reducer.Bind(kFloat32, NDArray::empty({static_cast<int64_t>(reducer.OutputNumel(kFloat32))},
+                                        local_device, kFloat32, kBlockingStream));
+  result.num_buckets = reducer.num_buckets();
+  comm_group->Barrier(true);
+  start = Clock::now();
+  for (size_t i = 0; i < num_grads; i++)
+    reducer.Ready(i, grads[i]);
+  reducer.Flush();
+  stream.Sync();
+  result.bucketed_ms = elapsed_ms(start);
+  result.timings = reducer.Timings();
+
+  for (size_t i = 0; i < num_grads; i++) {
+    auto out = reducer.GetOutput(i, {static_cast<int64_t>(out_numel)});
+    const float* x = out->data_ptr<float>();
+    const float* y = refs[i]->data_ptr<float>();
+    for (size_t k = 0; k < out_numel; k++)
+      result.max_abs_error = std::max(result.max_abs_error, static_cast<double>(std::abs(x[k] - y[k])));
+  }
+  return result;
+}
+
+} // namespace graph
+} // namespace hydraulis
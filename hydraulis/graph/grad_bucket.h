@@ -0,0 +1,183 @@
+#pragma once
+
+#include "hydraulis/core/ndarray.h"
+#include "hydraulis/core/stream.h"
+#include "hydraulis/core/reduction_type.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+// 一个grad reduce的通信属性，只有spec相同的grad才能放入同一个bucket
+struct GradBucketSpec {
+  DataType dtype;
+  DeviceGroup comm_group;
+  ReductionType red_type;
+  bool reduce_scatter; // 否则为all-reduce
+  StreamIndex stream_index;
+
+  bool operator==(const GradBucketSpec& other) const {
+    return dtype == other.dtype && comm_group == other.comm_group
+      && red_type == other.red_type && reduce_scatter == other.reduce_scatter
+      && stream_index == other.stream_index;
+  }
+};
+
+struct GradBucketTiming {
+  size_t num_grads{0};
+  size_t num_bytes{0};
+  double launch_to_finish_ms{0};
+};
+
+// 按照grad产生的顺序（即反向的拓扑序）将grad划分为bucket
+// 每个spec同时只有一个未满的bucket，grad不小于bucket_bytes时该bucket关闭，
+// 第一个bucket的上限为first_bucket_bytes，使得反向刚开始时就有通信可以overlap
+// 返回按照关闭（即全部grad到达）顺序排列的bucket，bucket中为grad的编号
+std::vector<std::vector<size_t>> PlanGradBuckets(const std::vector<GradBucketSpec>& specs,
+                                                 const std::vector<size_t>& num_bytes,
+                                                 size_t bucket_bytes,
+                                                 size_t first_bucket_bytes);
+
+/******************************************************
+ * Data parallel下的grad bucketing
+ *
+ * 每个bucket只发起一次all-reduce或reduce-scatter：
+ * grad ready后拷贝到bucket中，bucket的grad全部到达后（且之前的bucket都已发起）立即发起通信。
+ * reduce后的grad在output buffer（即current grad buffer）中按照bucket的顺序连续存放，
+ * 因此all-reduce直接在output上in-place进行；
+ * reduce-scatter的输入则按照rank重排到staging buffer中，使得每个rank收到的正好是各个grad的shard。
+ * 只依赖于NDArray与通信kernel，device为CPU时走MPI/SHM/THREAD backend。
+ ******************************************************/
+class GradBucketReducer {
+ public:
+  GradBucketReducer(size_t bucket_bytes, size_t first_bucket_bytes = 1024 * 1024)
+  : _bucket_bytes(bucket_bytes), _first_bucket_bytes(first_bucket_bytes) {}
+
+  // HYDRAULIS_GRAD_BUCKET_SIZE: bucket的大小（MiB），不设置或为0时不开启
+  // HYDRAULIS_GRAD_FIRST_BUCKET_SIZE: 第一个bucket的大小（MiB），默认为1
+  // HYDRAULIS_GRAD_BUCKET_PROFILE=ON: 每个step打印各个bucket从发起到完成的时间
+  static std::unique_ptr<GradBucketReducer> FromEnv();
+
+  // 按照grad产生的顺序登记，返回grad的编号
+  // numel为reduce前的元素个数，reduce-scatter时需要能被comm group的大小整除
+  size_t AddGrad(const GradBucketSpec& spec, size_t numel);
+
+  // 划分bucket并确定output的布局
+  void Build();
+
+  bool IsBuilt() const {
+    return _is_built;
+  }
+
+  size_t num_grads() const {
+    return _grads.size();
+  }
+
+  size_t num_buckets() const {
+    return _buckets.size();
+  }
+
+  const std::vector<size_t>& bucket_grads(size_t bucket_id) const {
+    return _buckets.at(bucket_id).grads;
+  }
+
+  // 按照output布局排列的grad编号（同一dtype中）
+  std::vector<size_t> OutputOrder(DataType dtype) const;
+
+  // reduce后的grad在其dtype的output buffer中的元素偏移与元素个数
+  size_t OutputOffset(size_t grad) const {
+    return _grads.at(grad).out_offset;
+  }
+
+  size_t OutputNumel(size_t grad) const {
+    return _grads.at(grad).out_numel;
+  }
+
+  size_t OutputNumel(DataType dtype) const;
+
+  // 绑定每个dtype的output buffer（一维），之后才能使用Ready
+  void Bind(DataType dtype, const NDArray& output);
+
+  bool IsBound(DataType dtype) const {
+    return _outputs.find(dtype) != _outputs.end();
+  }
+
+  // 释放对output buffer与staging buffer的引用（例如热切换释放current grad buffer时）
+  void Unbind();
+
+  // grad的数据已经可以在其stream上使用（调用者负责同步）
+  // 返回因此而发起通信的bucket
+  std::vector<size_t> Ready(size_t grad, const NDArray& data);
+
+  // 发起剩余的bucket（没有ready的grad视为0），并开始新的一轮
+  std::vector<size_t> Flush();
+
+  // reduce后的grad（output buffer上的view）
+  NDArray GetOutput(size_t grad, const HTShape& shape) const;
+
+  // 最近一轮各个bucket从发起到完成的时间，会等待通信完成
+  std::vector<GradBucketTiming> Timings() const;
+
+  bool profiling() const {
+    return _profiling;
+  }
+
+ protected:
+  struct Grad {
+    GradBucketSpec spec;
+    size_t numel;
+    size_t out_numel;
+    size_t out_offset{0};
+    size_t bucket{0};
+    size_t staging_offset{0}; // reduce-scatter时在staging的每个rank区域中的偏移
+    bool ready{false};
+  };
+
+  struct Bucket {
+    std::vector<size_t> grads;
+    size_t out_offset{0};
+    size_t out_numel{0};
+    NDArray staging; // reduce-scatter的输入
+    size_t num_ready{0};
+    bool launched{false};
+    std::unique_ptr<Event> start;
+    std::unique_ptr<Event> end;
+  };
+
+  void CopyIn(size_t grad, const NDArray* data);
+
+  void Launch(size_t bucket_id);
+
+  std::vector<size_t> LaunchInOrder();
+
+  size_t _bucket_bytes;
+  size_t _first_bucket_bytes;
+  bool _profiling{false};
+  bool _is_built{false};
+  std::vector<Grad> _grads;
+  std::vector<Bucket> _buckets;
+  std::unordered_map<DataType, NDArray> _outputs;
+  size_t _next_launch{0};
+};
+
+struct GradBucketBenchmarkResult {
+  size_t num_buckets{0};
+  double per_tensor_ms{0};
+  double bucketed_ms{0};
+  double max_abs_error{0};
+  std::vector<GradBucketTiming> timings;
+};
+
+// 在CPU上比较逐个grad通信与bucketing，每个rank（或threaded world中的每个线程）都要调用
+// threaded_world_size > 0时在当前进程中起相应数目的线程作为rank，返回rank 0的结果
+GradBucketBenchmarkResult BenchmarkGradBucketing(size_t num_grads = 256,
+                                                 size_t numel_per_grad = 16384,
+                                                 size_t bucket_mb = 25,
+                                                 size_t first_bucket_mb = 1,
+                                                 bool reduce_scatter = false,
+                                                 int threaded_world_size = 0);
+
+} // namespace graph
+} // namespace hydraulis
@@ -15,6 +15,7 @@ namespace hydraulis {
 namespace graph {
 
 std::once_flag Graph::_init_flag;
+std::recursive_mutex Graph::_global_graphs_mutex;
 std::vector<std::shared_ptr<Graph>> Graph::_global_graphs;
 std::unordered_map<GraphName, std::shared_ptr<Graph>> Graph::_name_to_graphs;
 std::shared_ptr<Graph> Graph::_default_eager_graph;
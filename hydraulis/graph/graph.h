@@ -7,6 +7,7 @@
 #include "hydraulis/graph/operator.h"
 #include "hydraulis/graph/ops/group.h"
 #include "hydraulis/graph/subgraph.h"
+#include "hydraulis/graph/topo_sort.h"
 #include "hydraulis/graph/init/initializer.h"
 #include <mutex>
 #include <stack>
@@ -79,7 +80,8 @@ class Graph {
   virtual NDArrayList Run(const Tensor& loss, const TensorList& fetches, 
                           const FeedDict& feed_dict = {}, const int num_micro_batches = 1,
                           const int compute_strategy_id = 0, const int optimize_strategy_id = 0, RunLevel run_level = RunLevel::UPDATE,
-                          bool save_checkpoint = false, const double grad_scale = 1) {}                          
+                          bool save_checkpoint = false, const double grad_scale = 1,
+                          const Tensor& micro_batch_cu_seqlens = Tensor()) {}                          
 
   GraphId id() const noexcept {
     return _id;
@@ -521,12 +523,14 @@ class Graph {
   }
 
   static inline Graph& GetGraph(GraphId graph_id) {
+    std::lock_guard<std::recursive_mutex> lock(Graph::_global_graphs_mutex);
     HT_VALUE_ERROR_IF(graph_id >= Graph::_global_graphs.size())
       << "Graph with id " << graph_id << " does not exist";
     return *Graph::_global_graphs[graph_id];
   }
 
   static inline Graph& GetGraph(const GraphName& graph_name) {
+    std::lock_guard<std::recursive_mutex> lock(Graph::_global_graphs_mutex);
     auto it = Graph::_name_to_graphs.find(graph_name);
     HT_VALUE_ERROR_IF(it == Graph::_name_to_graphs.end())
       << "Graph with name \"" << graph_name << "\" does not exist";
@@ -534,6 +538,7 @@ class Graph {
   }
 
   static void DeleteGraph(GraphId graph_id) {
+    std::lock_guard<std::recursive_mutex> lock(Graph::_global_graphs_mutex);
     HT_VALUE_ERROR_IF(graph_id >= Graph::_global_graphs.size())
       << "Graph with id " << graph_id << " does not exist";
     const auto& graph_name = Graph::_global_graphs[graph_id]->name();
@@ -546,6 +551,7 @@ class Graph {
   }
  
   static void DeleteGraph(const GraphName& graph_name) {
+    std::lock_guard<std::recursive_mutex> lock(Graph::_global_graphs_mutex);
     auto it = Graph::_name_to_graphs.find(graph_name);
     HT_VALUE_ERROR_IF(it == Graph::_name_to_graphs.end())
       << "Graph with name \"" << graph_name << "\" does not exist";
@@ -573,6 +579,7 @@ class Graph {
   }
 
   static void push_graph_ctx(GraphId id) {
+    std::lock_guard<std::recursive_mutex> lock(Graph::_global_graphs_mutex);
     HT_VALUE_ERROR_IF(id >= Graph::_global_graphs.size())
       << "Graph with id " << id << " does not exist";
     Graph::_cur_graph_ctx.push(id);
@@ -620,24 +627,29 @@ class Graph {
     return ret;
   }
 
+  // 给定tensor_bytes时按照显存排序：在依赖关系允许的范围内尽量降低存活tensor大小之和的峰值
+  // （见DenseTopoSort），tensor_bytes返回0的tensor（例如parameter）不计入
   static OpRefList TopoSort(const OpRefList& ops, int32_t num_ops_hint = -1,
-                            std::function<bool(const Operator&)> stop_at = {});
+                            std::function<bool(const Operator&)> stop_at = {},
+                            std::function<int64_t(const Tensor&)> tensor_bytes = {});
 
   static OpRefList TopoSort(const TensorList& tensors,
                             int32_t num_ops_hint = -1,
-                            std::function<bool(const Operator&)> stop_at = {}) {
+                            std::function<bool(const Operator&)> stop_at = {},
+                            std::function<int64_t(const Tensor&)> tensor_bytes = {}) {
     OpRefList ops;
     ops.reserve(tensors.size());
     for (const auto& tensor : tensors)
       ops.push_back(std::ref(tensor->producer()));
-    return Graph::TopoSort(ops, num_ops_hint, stop_at);
+    return Graph::TopoSort(ops, num_ops_hint, stop_at, tensor_bytes);
   }
 
   static OpRefList TopoSort(const Tensor& tensor, int32_t num_ops_hint = -1,
-                            std::function<bool(const Operator&)> stop_at = {}) {
+                            std::function<bool(const Operator&)> stop_at = {},
+                            std::function<int64_t(const Tensor&)> tensor_bytes = {}) {
     OpRefList ops;
     ops.push_back(std::ref(tensor->producer()));
-    return Graph::TopoSort(ops, num_ops_hint, stop_at);
+    return Graph::TopoSort(ops, num_ops_hint, stop_at, tensor_bytes);
   }
 
   static std::tuple<OpRefList, OpRefList> disentangle_forward_and_backward_ops_by_loss(
@@ -817,6 +829,9 @@ class Graph {
   static std::shared_ptr<T>& _make_new_graph(Args&&... args) {
     static_assert(std::is_base_of<Graph, T>::value,
                   "Template class is not derived from Graph");
+    // graphs could be made concurrently by ranks of a threaded world,
+    // so ids must be assigned in the same order as the insertion
+    std::lock_guard<std::recursive_mutex> lock(Graph::_global_graphs_mutex);
     auto graph = std::make_shared<T>(Graph::constructor_access_key(),
                                      std::forward<Args>(args)...);
     HT_LOG_DEBUG << "make a new graph named " << graph->name() << ", whose id is " << graph->id();
@@ -835,6 +850,7 @@ class Graph {
   }
 
   static std::once_flag _init_flag;
+  static std::recursive_mutex _global_graphs_mutex;
   static std::vector<std::shared_ptr<Graph>> _global_graphs;
   static std::unordered_map<GraphName, std::shared_ptr<Graph>> _name_to_graphs;
   static std::shared_ptr<Graph> _default_eager_graph;
@@ -844,207 +860,114 @@ class Graph {
 };
 
 inline OpRefList Graph::TopoSort(const OpRefList& ops, int32_t num_ops_hint,
-                                 std::function<bool(const Operator&)> stop_at) {
-  std::unordered_map<OpId, int32_t> in_degrees;
-  std::unordered_map<OpId, int32_t> heuristic_deps;
-  std::unordered_set<OpId> visited;
-  std::unordered_map<OpId, OpIdSet> extra_edges;
-  OpRefList zero_in_degree_ops;
-  OpRefList inplace_ops;
-
-  OpRefDeque traverse_queue;
-  // OpRefDeque topo_queue;
-  // 按照heuristic_dep从小到大的优先队列比较器
-  auto cmp = [&heuristic_deps](const OpRef& lhs, const OpRef& rhs) {
-    HT_ASSERT(heuristic_deps.find(lhs.get()->id()) != heuristic_deps.end())
-      << "cannot find " << lhs << " in heuristic deps";
-    HT_ASSERT(heuristic_deps.find(rhs.get()->id()) != heuristic_deps.end())
-      << "cannot find " << rhs << " in heuristic deps";
-    return heuristic_deps[lhs.get()->id()] > heuristic_deps[rhs.get()->id()];
-  };
-  // std::priority_queue<OpRef, std::vector<OpRef>, decltype(cmp)> traverse_queue(cmp);
-  std::priority_queue<OpRef, std::vector<OpRef>, decltype(cmp)> topo_queue(cmp);
-
-  OpRefList ret;
+                                 std::function<bool(const Operator&)> stop_at,
+                                 std::function<int64_t(const Tensor&)> tensor_bytes) {
+  // op按照被发现的顺序（从目标op出发的BFS）编号，之后全部在稠密下标上计算
+  // 只有建图时需要以OpId查表
+  std::unordered_map<OpId, int32_t> op_indices;
+  OpRefList nodes;
+  std::vector<bool> stopped;
+  DenseTopoGraph dense;
   if (num_ops_hint != -1) {
-    in_degrees.reserve(num_ops_hint);
-    visited.reserve(num_ops_hint);
-    ret.reserve(num_ops_hint);
-  }
-
-  // traverse all ops that are connected with the target ops
-  // and enqueue source ops into the topo queue
-  /*
-  for (auto& op_ref : ops) {
-    if (visited.find(op_ref.get()->id()) == visited.end()) {
-      heuristic_deps[op_ref.get()->id()] = 0;
-      traverse_queue.push_back(op_ref);
-      visited.insert(op_ref.get()->id());
-    }
+    op_indices.reserve(num_ops_hint);
+    nodes.reserve(num_ops_hint);
+    dense.pred_offsets.reserve(num_ops_hint + 1);
   }
-  while (!traverse_queue.empty()) {
-    auto& op_ref = traverse_queue.front();
-    traverse_queue.pop_front();
-    auto& op = op_ref.get();
-    auto op_in_degrees = (stop_at && stop_at(op)) ? 0 : op->in_degrees();
-    if (op_in_degrees != op->in_degrees()) {
-      HT_LOG_DEBUG << "make topo: " << op << " is forced to be stopped "
-        << op_in_degrees << " " << op->in_degrees();
-    }
-    in_degrees[op->id()] = op_in_degrees;
-    if (op_in_degrees == 0) {
-      topo_queue.push(op_ref);
+  auto get_or_add = [&](Operator& op) -> int32_t {
+    auto it = op_indices.find(op->id());
+    if (it != op_indices.end())
+      return it->second;
+    int32_t index = static_cast<int32_t>(nodes.size());
+    op_indices.emplace(op->id(), index);
+    nodes.push_back(std::ref(op));
+    return index;
+  };
+  for (auto& op_ref : ops)
+    get_or_add(op_ref.get());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    auto& op = nodes[i].get();
+    bool is_stopped = stop_at && stop_at(op);
+    if (is_stopped) {
+      HT_LOG_DEBUG_IF(op->in_degrees() > 0) << "make topo: " << op
+        << " is forced to be stopped, in degrees = " << op->in_degrees();
     } else {
       Operator::for_each_input_tensor(op, [&](Tensor& tensor) {
-        if (visited.find(tensor->producer_id()) == visited.end()) {
-          heuristic_deps[tensor->producer()->id()] = heuristic_deps[op->id()] + 1;
-          traverse_queue.push_back(std::ref(tensor->producer()));
-          visited.insert(tensor->producer_id());
-        }
+        dense.preds.push_back(get_or_add(tensor->producer()));
       });
     }
-  }
-  */
-
-  std::function<void(OpRef)> traverse_dfs = [&](OpRef op_ref) -> void {
-    auto& op = op_ref.get();
-    auto op_in_degrees = (stop_at && stop_at(op)) ? 0 : op->in_degrees();
-    if (op_in_degrees != op->in_degrees()) {
-      HT_LOG_DEBUG << "make topo: " << op << " is forced to be stopped "
-        << op_in_degrees << " " << op->in_degrees();
-    }
-    in_degrees[op->id()] = op_in_degrees;
-    if (op_in_degrees == 0) {
-      if (visited.find(op->id()) == visited.end()) {
-        zero_in_degree_ops.push_back(op_ref);
-        visited.insert(op->id());
-      }
-      return;
-    }
-    Operator::for_each_input_tensor(op, [&](Tensor& tensor) {
-      if (heuristic_deps.find(tensor->producer()->id()) == heuristic_deps.end()
-          || heuristic_deps[tensor->producer()->id()] < heuristic_deps[op->id()] + 1) {
-        heuristic_deps[tensor->producer()->id()] = heuristic_deps[op->id()] + 1;
-        traverse_dfs(std::ref(tensor->producer()));
-      }
-    });
-  };
-
-  // traverse bfs can handle larger topo
-  std::function<void(OpRef)> traverse_bfs = [&](OpRef op_ref) -> void {
-    std::queue<OpRef> bfs_queue;
-    bfs_queue.push(op_ref);
-    while (!bfs_queue.empty()) {
-      OpRef current_op_ref = bfs_queue.front();
-      bfs_queue.pop();
-      auto& current_op = current_op_ref.get();
-      auto op_in_degrees = (stop_at && stop_at(current_op)) ? 0 : current_op->in_degrees();
-      if (op_in_degrees != current_op->in_degrees()) {
-        HT_LOG_DEBUG << "make topo: " << current_op << " is forced to be stopped "
-          << op_in_degrees << " " << current_op->in_degrees();
-      }
-      in_degrees[current_op->id()] = op_in_degrees;
-      if (op_in_degrees == 0 && visited.find(current_op->id()) == visited.end()) {
-        zero_in_degree_ops.push_back(current_op_ref);
-        visited.insert(current_op->id());
-        continue;
-      }
-      Operator::for_each_input_tensor(current_op, [&](Tensor& tensor) {
-        if (heuristic_deps.find(tensor->producer()->id()) == heuristic_deps.end() || 
-            heuristic_deps[tensor->producer()->id()] < heuristic_deps[current_op->id()] + 1) {
-          heuristic_deps[tensor->producer()->id()] = heuristic_deps[current_op->id()] + 1;
-          bfs_queue.push(std::ref(tensor->producer()));  // Enqueue the producer            
-        }
-      });
-    }
-  };
-
-  for (auto& op_ref : ops) {
-    if (heuristic_deps.find(op_ref.get()->id()) != heuristic_deps.end()) {
-      continue;
-    }
-    heuristic_deps[op_ref.get()->id()] = 0;
-    // traverse_dfs(op_ref); // dfs may cause stack overflow and segmentation fault
-    traverse_bfs(op_ref);
-  }
-  for (auto& op_ref : zero_in_degree_ops) {
-    topo_queue.push(op_ref);
-  }
-
-  // iteratively find the topo order
-  while (!topo_queue.empty()) {
-    auto op_ref = topo_queue.top();
-    topo_queue.pop();
-    ret.push_back(op_ref);
-    Operator::for_each_output_tensor(op_ref.get(), [&](Tensor& tensor) {
-      // Place inplace ops after other ops
-      // Step 1. Find all inplace ops.
-      int64_t num_inplace_consumers = 0;
-      int64_t num_consumers = tensor->num_consumers();
-      OpIdSet inplace_ids;
+    stopped.push_back(is_stopped);
+    dense.pred_offsets.push_back(static_cast<int32_t>(dense.preds.size()));
+  }
+
+  // Place inplace ops after other ops
+  // 若某个tensor同时有inplace与其他的消费者，则从其他消费者向inplace op加边
+  // NOTE: Only inplace ops that do operation on `tensor` directly
+  // are considered.
+  // For example, for `where` op, its inplace tensor is the 1st
+  // input tensor, not the 2nd input tensor. So for the 2nd input,
+  // we should not consider `where` as its inplace op.
+  std::vector<int32_t> inplace_indices;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    Operator::for_each_output_tensor(nodes[i].get(), [&](Tensor& tensor) {
+      inplace_indices.clear();
+      size_t num_inplace_consumers = 0;
       Tensor::for_each_consumer(tensor, [&](Operator& consumer_op) {
-        if (in_degrees.find(consumer_op->id()) == in_degrees.end())
+        if (!is_inplace_op(consumer_op) || tensor->id() != consumer_op->inplace_tensor_id())
           return;
-        // NOTE: Only inplace ops that do operation on `tensor` directly
-        // are considered.
-        // For example, for `where` op, its inplace tensor is the 1st
-        // input tensor, not the 2nd input tensor. So for the 2nd input,
-        // we should not consider `where` as its inplace op.
-        if (is_inplace_op(std::ref(consumer_op)) &&
-            tensor->id() == consumer_op->inplace_tensor_id()) {
-          inplace_ids.insert(consumer_op->id());
-          inplace_ops.push_back(std::ref(consumer_op));
-          num_inplace_consumers++;
+        auto it = op_indices.find(consumer_op->id());
+        if (it == op_indices.end())
           return;
-        }
+        num_inplace_consumers++;
+        // 已经计算过的op不需要再排序
+        if (!stopped[it->second])
+          inplace_indices.push_back(it->second);
       });
-      bool has_extra_edge = num_inplace_consumers > 0 &&
-                            num_inplace_consumers < num_consumers;
-      // Step 2. If there are both inplace and other ops,
-      // add extra edges from others to inplace ops and add in_degrees.
-      if (has_extra_edge) {
-        Tensor::for_each_consumer(tensor, [&](Operator& consumer_op) {
-          if (in_degrees.find(consumer_op->id()) == in_degrees.end() ||
-              is_inplace_op(std::ref(consumer_op)))
-            return;
-          // NOTE: Check if the extra edge already exists.
-          for (auto inplace_id : inplace_ids) {
-            if (extra_edges[consumer_op->id()].insert(inplace_id).second)
-              in_degrees[inplace_id]++;
-          }
-        });
-      }
-      // Step 3. Check extra_edges and decrease in_degrees of inplace ops.
-      // OpRefList dfs_list;
+      if (inplace_indices.empty() || num_inplace_consumers >= tensor->num_consumers())
+        return;
       Tensor::for_each_consumer(tensor, [&](Operator& consumer_op) {
-        if (in_degrees.find(consumer_op->id()) == in_degrees.end())
+        if (is_inplace_op(consumer_op))
           return;
-        if ((--in_degrees[consumer_op->id()]) == 0) {
-          topo_queue.push(std::ref(consumer_op));
-          // dfs_list.push_back(std::ref(consumer_op));
-          if (has_extra_edge && !is_inplace_op(std::ref(consumer_op))) {
-            for (auto inplace_id : extra_edges[consumer_op->id()]) {
-              if (--in_degrees[inplace_id] == 0) {
-                auto inplace_op = std::find_if(inplace_ops.begin(), inplace_ops.end(),
-                  [&](const OpRef& op_ref) { return op_ref.get()->id() == inplace_id; });
-                if (inplace_op != inplace_ops.end()) {
-                  topo_queue.push(*inplace_op);
-                  // dfs_list.push_back(*inplace_op);
-                }
-              }
-            }
-          }
-        }
+        auto it = op_indices.find(consumer_op->id());
+        if (it == op_indices.end())
+          return;
+        for (auto inplace_index : inplace_indices)
+          dense.extra_edges.emplace_back(it->second, inplace_index);
       });
-      /*
-      for (auto it = dfs_list.rbegin(); it != dfs_list.rend(); ++it) {
-        topo_queue.push_back(*it);
-      }
-      */
     });
   }
 
-  visited.clear();
+  bool memory_aware = static_cast<bool>(tensor_bytes);
+  if (memory_aware) {
+    for (size_t i = 0; i < nodes.size(); i++) {
+      auto& op = nodes[i].get();
+      for (auto& output : op->outputs())
+        dense.tensor_bytes.push_back(std::max<int64_t>(tensor_bytes(output), 0));
+      dense.tensor_offsets.push_back(dense.num_tensors());
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+      auto& op = nodes[i].get();
+      size_t begin = dense.inputs.size();
+      if (!stopped[i]) {
+        // for_each_input_tensor先遍历inputs，因此前num_inputs个前驱就是各个输入的producer
+        for (size_t k = 0; k < op->num_inputs(); k++) {
+          int32_t producer_index = dense.preds[dense.pred_offsets[i] + k];
+          dense.inputs.push_back(dense.tensor_offsets[producer_index] + op->input(k)->output_id());
+        }
+        std::sort(dense.inputs.begin() + begin, dense.inputs.end());
+        dense.inputs.erase(std::unique(dense.inputs.begin() + begin, dense.inputs.end()),
+                           dense.inputs.end());
+      }
+      dense.input_offsets.push_back(static_cast<int32_t>(dense.inputs.size()));
+    }
+  }
+
+  dense.Finalize();
+  auto order = DenseTopoSort(dense, memory_aware);
+  OpRefList ret;
+  ret.reserve(order.size());
+  for (auto index : order)
+    ret.push_back(nodes[index]);
+
   for (size_t i = 0; i < ret.size(); i++) {
     // BatchISendIRecvOp must be directly after nearest SplitOp
     if (is_batched_isend_irecv_op(ret[i])) {
@@ -0,0 +1,170 @@
+#include "hydraulis/graph/host_overhead.h"
+#include "hydraulis/impl/communication/threaded_world.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+
+// 当前线程最内层的计时器
+thread_local HostPhaseTimer* cur_host_phase_timer = nullptr;
+
+} // namespace
+
+std::string HostPhase2Str(HostPhase phase) {
+  switch (phase) {
+    case HostPhase::STEP: return "step";
+    case HostPhase::PLAN_MATCH: return "plan_match";
+    case HostPhase::DEDUCE_SHAPE_PLAN: return "deduce_shape_plan";
+    case HostPhase::INSTANTIATE: return "instantiate";
+    case HostPhase::EXEC_INSTANTIATE: return "exec_instantiate";
+    case HostPhase::SUBSTITUTE_COMM_OP: return "substitute_comm_op";
+    case HostPhase::INSERT_CONTIGUOUS_OP: return "insert_contiguous_op";
+    case HostPhase::SWITCH_SETUP: return "switch_setup";
+    case HostPhase::DISPATCH: return "dispatch";
+    case HostPhase::POST_RUN: return "post_run";
+    default:
+      HT_VALUE_ERROR << "Unknown host phase " << static_cast<int>(phase);
+      __builtin_unreachable();
+  }
+}
+
+void HostPhaseStats::Add(uint64_t step_ns, uint64_t step_self_ns, uint64_t step_calls) {
+  min_ns = num_steps == 0 ? step_ns : std::min(min_ns, step_ns);
+  max_ns = std::max(max_ns, step_ns);
+  last_ns = step_ns;
+  total_ns += step_ns;
+  self_ns += step_self_ns;
+  num_calls += step_calls;
+  num_steps++;
+  size_t bucket = 0;
+  uint64_t us = step_ns / 1000;
+  while (us > 1 && bucket + 1 < kNumBuckets) {
+    us >>= 1;
+    bucket++;
+  }
+  histogram[bucket]++;
+}
+
+double HostPhaseStats::PercentileMs(double p) const {
+  if (num_steps == 0)
+    return 0;
+  auto target = static_cast<uint64_t>(std::ceil(p * num_steps));
+  uint64_t cnt = 0;
+  for (size_t i = 0; i < kNumBuckets; i++) {
+    cnt += histogram[i];
+    if (cnt >= std::max<uint64_t>(target, 1))
+      return std::min<double>((1ULL << (i + 1)) * 1e-3, max_ns * 1e-6);
+  }
+  return max_ns * 1e-6;
+}
+
+HostOverheadStats& HostOverheadStats::Get() {
+  return Get(hydraulis::impl::comm::ThreadedWorld::CurrentRank());
+}
+
+HostOverheadStats& HostOverheadStats::Get(int rank) {
+  // threaded world中的每个rank单独统计
+  static HostOverheadStats process_instance;
+  static std::mutex rank_instances_mutex;
+  static std::map<int, std::unique_ptr<HostOverheadStats>> rank_instances;
+  if (rank < 0)
+    return process_instance;
+  std::lock_guard<std::mutex> lock(rank_instances_mutex);
+  auto& instance = rank_instances[rank];
+  if (instance == nullptr)
+    instance.reset(new HostOverheadStats());
+  return *instance;
+}
+
+HostOverheadStats::HostOverheadStats() {
+  const char* env = std::getenv("HYDRAULIS_HOST_OVERHEAD_DUMP_STEPS");
+  if (env != nullptr)
+    _dump_interval = std::max(0, std::atoi(env));
+}
+
+void HostOverheadStats::Record(HostPhase phase, uint64_t ns, uint64_t self_ns) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto& acc = _cur_step[static_cast<size_t>(phase)];
+  acc.ns += ns;
+  acc.self_ns += self_ns;
+  acc.calls++;
+}
+
+void HostOverheadStats::EndStep() {
+  bool dump = false;
+  uint64_t num_steps;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _cur_step.size(); i++) {
+      auto& acc = _cur_step[i];
+      if (acc.calls > 0)
+        _stats[i].Add(acc.ns, acc.self_ns, acc.calls);
+      acc = StepAccumulator();
+    }
+    num_steps = ++_num_steps;
+    dump = _dump_interval > 0 && _num_steps % _dump_interval == 0;
+  }
+  if (dump)
+    HT_LOG_INFO << "[Host Overhead] after " << num_steps << " steps:\n" << Summary();
+}
+
+void HostOverheadStats::Reset() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _num_steps = 0;
+  _cur_step.fill(StepAccumulator());
+  _stats.fill(HostPhaseStats());
+}
+
+std::string HostOverheadStats::Summary() const {
+  auto all_stats = stats();
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(3);
+  os << std::left << std::setw(24) << "phase"
+     << std::right << std::setw(8) << "steps" << std::setw(10) << "calls"
+     << std::setw(12) << "mean(ms)" << std::setw(12) << "self(ms)"
+     << std::setw(12) << "p50(ms)" << std::setw(12) << "p99(ms)"
+     << std::setw(12) << "max(ms)" << std::setw(12) << "last(ms)";
+  for (size_t i = 0; i < all_stats.size(); i++) {
+    const auto& s = all_stats[i];
+    if (s.num_steps == 0)
+      continue;
+    os << "\n" << std::left << std::setw(24) << HostPhase2Str(static_cast<HostPhase>(i))
+       << std::right << std::setw(8) << s.num_steps << std::setw(10) << s.num_calls
+       << std::setw(12) << s.MeanMs() << std::setw(12) << s.self_ns * 1e-6 / s.num_steps
+       << std::setw(12) << s.PercentileMs(0.5) << std::setw(12) << s.PercentileMs(0.99)
+       << std::setw(12) << s.max_ns * 1e-6 << std::setw(12) << s.last_ns * 1e-6;
+  }
+  return os.str();
+}
+
+HostPhaseTimer::HostPhaseTimer(HostPhase phase)
+: _phase(phase), _parent(cur_host_phase_timer) {
+  cur_host_phase_timer = this;
+  _phase_start = std::chrono::steady_clock::now();
+}
+
+void HostPhaseTimer::Stop() {
+  if (_stopped)
+    return;
+  TOK(_phase);
+  _stopped = true;
+  uint64_t ns = COST_NANOSEC(_phase);
+  // 只有最内层的计时器可以先于外层结束（Stop也会在析构时调用，因此这里不抛异常）
+  HT_LOG_WARN_IF(cur_host_phase_timer != this)
+    << "Host phase timers of " << HostPhase2Str(_phase) << " are not properly nested";
+  cur_host_phase_timer = _parent;
+  if (_parent != nullptr)
+    _parent->_children_ns += ns;
+  HostOverheadStats::Get().Record(_phase, ns, ns - std::min(ns, _children_ns));
+}
+
+} // namespace graph
+} // namespace hydraulis
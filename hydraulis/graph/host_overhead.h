@@ -0,0 +1,125 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include "hydraulis/common/timing.h"
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+// executor每个step中host侧的各个阶段
+enum class HostPhase : int8_t {
+  STEP = 0, // DefineAndRunGraph::Run整体
+  PLAN_MATCH, // 在exec plan pool与shape plan pool中查找
+  DEDUCE_SHAPE_PLAN,
+  INSTANTIATE, // 创建新的exec graph（DefineAndRunGraph::Instantiate）
+  EXEC_INSTANTIATE, // exec graph中op的instantiate（ExecutableGraph::Instantiate）
+  SUBSTITUTE_COMM_OP,
+  INSERT_CONTIGUOUS_OP,
+  SWITCH_SETUP, // 热切换（包括建图、topo以及发起通信）
+  DISPATCH, // ComputeFunc中逐个发射op
+  POST_RUN, // grad reduce与update
+  NUM_PHASES
+};
+
+std::string HostPhase2Str(HostPhase phase);
+
+// 单个阶段的统计
+// 每个step内同一阶段的多次调用先累加，step结束时再计入直方图
+struct HostPhaseStats {
+  // 直方图的第i个桶记录[2^i, 2^(i+1)) us，第0个桶还包括不足1us的情形
+  static constexpr size_t kNumBuckets = 24;
+
+  uint64_t num_steps{0}; // 出现该阶段的step数
+  uint64_t num_calls{0};
+  uint64_t total_ns{0};
+  uint64_t self_ns{0}; // 去掉嵌套在其中的其他阶段的时间
+  uint64_t min_ns{0};
+  uint64_t max_ns{0};
+  uint64_t last_ns{0}; // 最近一个step
+  std::array<uint64_t, kNumBuckets> histogram{};
+
+  void Add(uint64_t step_ns, uint64_t step_self_ns, uint64_t step_calls);
+
+  // 根据直方图估计分位数（取所在桶的上界）
+  double PercentileMs(double p) const;
+
+  double MeanMs() const {
+    return num_steps == 0 ? 0 : total_ns * 1e-6 / num_steps;
+  }
+};
+
+// 各个阶段的统计
+// 计时本身总是开启（每个阶段只有两次读时钟）
+// HYDRAULIS_HOST_OVERHEAD_DUMP_STEPS=N时每N个step打印一次
+class HostOverheadStats {
+ public:
+  // 当前线程所属rank（threaded world）或当前进程的统计
+  static HostOverheadStats& Get();
+
+  static HostOverheadStats& Get(int rank);
+
+  void Record(HostPhase phase, uint64_t ns, uint64_t self_ns);
+
+  // 把当前step中累加的时间计入各阶段的统计
+  void EndStep();
+
+  void Reset();
+
+  uint64_t num_steps() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _num_steps;
+  }
+
+  std::vector<HostPhaseStats> stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return {_stats.begin(), _stats.end()};
+  }
+
+  std::string Summary() const;
+
+ protected:
+  HostOverheadStats();
+
+  struct StepAccumulator {
+    uint64_t ns{0};
+    uint64_t self_ns{0};
+    uint64_t calls{0};
+  };
+
+  mutable std::mutex _mutex;
+  uint64_t _num_steps{0};
+  uint64_t _dump_interval{0};
+  std::array<StepAccumulator, static_cast<size_t>(HostPhase::NUM_PHASES)> _cur_step{};
+  std::array<HostPhaseStats, static_cast<size_t>(HostPhase::NUM_PHASES)> _stats{};
+};
+
+// 作用域计时器，可以嵌套
+// 父计时器的self时间会扣除其中嵌套的子计时器的时间
+class HostPhaseTimer {
+ public:
+  explicit HostPhaseTimer(HostPhase phase);
+
+  ~HostPhaseTimer() {
+    Stop();
+  }
+
+  HostPhaseTimer(const HostPhaseTimer&) = delete;
+  HostPhaseTimer& operator=(const HostPhaseTimer&) = delete;
+
+  void Stop();
+
+ protected:
+  HostPhase _phase;
+  bool _stopped{false};
+  uint64_t _children_ns{0};
+  HostPhaseTimer* _parent;
+  std::chrono::steady_clock::time_point _phase_start;
+  std::chrono::steady_clock::time_point _phase_stop;
+};
+
+} // namespace graph
+} // namespace hydraulis
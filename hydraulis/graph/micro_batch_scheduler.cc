@@ -0,0 +1,250 @@
+#include "hydraulis/graph/micro_batch_scheduler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include <sstream>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+  // makespan的相对差小于该值时视为相同，此时保留更早的（更接近原顺序的）候选
+  constexpr double kRelativeEps = 1e-9;
+  // 局部搜索只交换距离不超过该值的两个micro batch，大范围的调整由排序得到的初始候选完成
+  constexpr size_t kSwapWindow = 16;
+} // namespace
+
+MicroBatchCost MicroBatchCost::FromCuSeqlens(const NDArray& cu_seqlens) {
+  HT_VALUE_ERROR_IF(cu_seqlens->ndim() != 1 || cu_seqlens->numel() < 1)
+    << "cu_seqlens should be a non-empty 1-D array, got " << cu_seqlens->shape();
+  auto host = NDArray::to(cu_seqlens, Device(kCPU), kInt64, kBlockingStream);
+  Stream(host->device(), kBlockingStream).Sync();
+  const int64_t* ptr = host->data_ptr<int64_t>();
+  MicroBatchCost cost;
+  for (int64_t i = 1; i < host->numel(); i++) {
+    int64_t seqlen = ptr[i] - ptr[i - 1];
+    HT_VALUE_ERROR_IF(seqlen < 0)
+      << "cu_seqlens should be non-decreasing, but " << ptr[i - 1] << " is followed by " << ptr[i];
+    cost.num_tokens += seqlen;
+    cost.attn_flops += static_cast<double>(seqlen) * seqlen;
+  }
+  return cost;
+}
+
+std::ostream& operator<<(std::ostream& os, const MicroBatchSchedule& schedule) {
+  os << "order = " << schedule.order
+     << ", makespan = " << schedule.makespan
+     << " (originally " << schedule.original_makespan << ")"
+     << ", peak inflight tokens = " << schedule.peak_inflight_tokens
+     << " (originally " << schedule.original_peak_inflight_tokens << ")";
+  return os;
+}
+
+MicroBatchScheduler MicroBatchScheduler::FromEnv(size_t num_stages) {
+  StageCostModel model;
+  model.per_attn = 1.0 / (6 * 4096);
+  const char* env = std::getenv("HYDRAULIS_MICRO_BATCH_ATTN_COST");
+  if (env != nullptr)
+    model.per_attn = std::atof(env);
+  env = std::getenv("HYDRAULIS_MICRO_BATCH_FIXED_COST");
+  if (env != nullptr)
+    model.fixed = std::atof(env);
+  env = std::getenv("HYDRAULIS_MICRO_BATCH_BACKWARD_RATIO");
+  if (env != nullptr)
+    model.backward_ratio = std::atof(env);
+  std::vector<StageCostModel> stage_models(num_stages, model);
+  env = std::getenv("HYDRAULIS_MICRO_BATCH_STAGE_WEIGHTS");
+  if (env != nullptr) {
+    std::vector<double> weights;
+    std::stringstream ss(env);
+    std::string item;
+    while (std::getline(ss, item, ','))
+      weights.push_back(std::atof(item.c_str()));
+    HT_LOG_WARN_IF(weights.size() != num_stages)
+      << "HYDRAULIS_MICRO_BATCH_STAGE_WEIGHTS has " << weights.size()
+      << " weights but the pipeline has " << num_stages << " stages";
+    for (size_t i = 0; i < num_stages && i < weights.size(); i++) {
+      stage_models[i].fixed *= weights[i];
+      stage_models[i].per_token *= weights[i];
+      stage_models[i].per_attn *= weights[i];
+    }
+  }
+  size_t max_inflight_tokens = 0;
+  env = std::getenv("HYDRAULIS_MICRO_BATCH_MAX_INFLIGHT_TOKENS");
+  if (env != nullptr)
+    max_inflight_tokens = std::max(0LL, std::atoll(env));
+  return MicroBatchScheduler(std::move(stage_models), max_inflight_tokens);
+}
+
+std::vector<std::vector<std::pair<bool, size_t>>>
+MicroBatchScheduler::StageTasks(size_t num_micro_batches) const {
+  size_t num_stages = _stage_models.size();
+  std::vector<std::vector<std::pair<bool, size_t>>> tasks(num_stages);
+  for (size_t stage_id = 0; stage_id < num_stages; stage_id++) {
+    auto& stage_tasks = tasks[stage_id];
+    stage_tasks.reserve(2 * num_micro_batches);
+    size_t num_warmup = std::min(num_micro_batches, num_stages - stage_id - 1);
+    size_t num_remaining = num_micro_batches - num_warmup;
+    for (size_t i = 0; i < num_warmup; i++)
+      stage_tasks.push_back({true, i});
+    for (size_t i = 0; i < num_remaining; i++) {
+      stage_tasks.push_back({true, num_warmup + i});
+      stage_tasks.push_back({false, i});
+    }
+    for (size_t i = 0; i < num_warmup; i++)
+      stage_tasks.push_back({false, num_remaining + i});
+  }
+  return tasks;
+}
+
+double MicroBatchScheduler::Simulate(const std::vector<MicroBatchCost>& costs,
+                                     const std::vector<size_t>& order) const {
+  size_t num_stages = _stage_models.size();
+  size_t num_micro_batches = order.size();
+  auto tasks = StageTasks(num_micro_batches);
+  // 未完成的任务记为-1
+  std::vector<std::vector<double>> fw_end(num_stages, std::vector<double>(num_micro_batches, -1));
+  std::vector<std::vector<double>> bw_end(num_stages, std::vector<double>(num_micro_batches, -1));
+  std::vector<size_t> next(num_stages, 0);
+  std::vector<double> stage_free(num_stages, 0);
+  size_t num_remaining = 2 * num_stages * num_micro_batches;
+  while (num_remaining > 0) {
+    bool progressed = false;
+    for (size_t stage_id = 0; stage_id < num_stages; stage_id++) {
+      const auto& model = _stage_models[stage_id];
+      while (next[stage_id] < tasks[stage_id].size()) {
+        auto [is_forward, k] = tasks[stage_id][next[stage_id]];
+        const auto& cost = costs[order[k]];
+        double ready;
+        if (is_forward) {
+          // forward依赖上一个stage的forward
+          ready = stage_id == 0 ? 0 : fw_end[stage_id - 1][k];
+        } else {
+          // backward依赖下一个stage的backward（最后一个stage依赖自己的forward）
+          ready = stage_id + 1 == num_stages ? fw_end[stage_id][k] : bw_end[stage_id + 1][k];
+        }
+        if (ready < 0)
+          break;
+        double start = std::max(stage_free[stage_id], ready);
+        double end = start + (is_forward ? model.ForwardTime(cost) : model.BackwardTime(cost));
+        (is_forward ? fw_end : bw_end)[stage_id][k] = end;
+        stage_free[stage_id] = end;
+        next[stage_id]++;
+        num_remaining--;
+        progressed = true;
+      }
+    }
+    HT_ASSERT(progressed)
+      << "1F1B simulation deadlocks, which should never happen";
+  }
+  return *std::max_element(stage_free.begin(), stage_free.end());
+}
+
+std::vector<size_t> MicroBatchScheduler::PeakInflightTokens(const std::vector<MicroBatchCost>& costs,
+                                                            const std::vector<size_t>& order) const {
+  auto tasks = StageTasks(order.size());
+  std::vector<size_t> peaks(tasks.size(), 0);
+  for (size_t stage_id = 0; stage_id < tasks.size(); stage_id++) {
+    size_t inflight = 0;
+    for (const auto& [is_forward, k] : tasks[stage_id]) {
+      if (is_forward) {
+        inflight += costs[order[k]].num_tokens;
+        peaks[stage_id] = std::max(peaks[stage_id], inflight);
+      } else {
+        inflight -= costs[order[k]].num_tokens;
+      }
+    }
+  }
+  return peaks;
+}
+
+MicroBatchSchedule MicroBatchScheduler::Schedule(const std::vector<MicroBatchCost>& costs) const {
+  size_t num_micro_batches = costs.size();
+  MicroBatchSchedule schedule;
+  schedule.order.resize(num_micro_batches);
+  std::iota(schedule.order.begin(), schedule.order.end(), 0);
+  schedule.original_makespan = schedule.makespan = Simulate(costs, schedule.order);
+  schedule.original_peak_inflight_tokens = schedule.peak_inflight_tokens
+    = PeakInflightTokens(costs, schedule.order);
+  if (num_micro_batches <= 1)
+    return schedule;
+
+  std::vector<size_t> caps = schedule.original_peak_inflight_tokens;
+  if (_max_inflight_tokens > 0)
+    std::fill(caps.begin(), caps.end(), _max_inflight_tokens);
+  // 先比较超出显存上限的token数，再比较makespan
+  auto overflow_of = [&](const std::vector<size_t>& peaks) {
+    size_t overflow = 0;
+    for (size_t i = 0; i < peaks.size(); i++)
+      if (peaks[i] > caps[i])
+        overflow = std::max(overflow, peaks[i] - caps[i]);
+    return overflow;
+  };
+  size_t best_overflow = overflow_of(schedule.peak_inflight_tokens);
+  auto try_order = [&](const std::vector<size_t>& order) {
+    auto peaks = PeakInflightTokens(costs, order);
+    size_t overflow = overflow_of(peaks);
+    if (overflow > best_overflow)
+      return false;
+    double makespan = Simulate(costs, order);
+    if (overflow == best_overflow && makespan >= schedule.makespan * (1 - kRelativeEps))
+      return false;
+    best_overflow = overflow;
+    schedule.order = order;
+    schedule.makespan = makespan;
+    schedule.peak_inflight_tokens = std::move(peaks);
+    return true;
+  };
+
+  // 候选的初始顺序：按总计算量从大到小、从小到大、大小交替，以及按1F1B的配对长短搭配
+  std::vector<double> work(num_micro_batches, 0);
+  for (size_t i = 0; i < num_micro_batches; i++)
+    for (const auto& model : _stage_models)
+      work[i] += model.ForwardTime(costs[i]) + model.BackwardTime(costs[i]);
+  std::vector<size_t> descending(num_micro_batches);
+  std::iota(descending.begin(), descending.end(), 0);
+  std::stable_sort(descending.begin(), descending.end(),
+                   [&](size_t a, size_t b) { return work[a] > work[b]; });
+  std::vector<size_t> ascending(descending.rbegin(), descending.rend());
+  std::vector<size_t> interleaved;
+  interleaved.reserve(num_micro_batches);
+  for (size_t l = 0, r = num_micro_batches - 1; l <= r && r < num_micro_batches; l++, r--) {
+    interleaved.push_back(descending[l]);
+    if (l != r)
+      interleaved.push_back(descending[r]);
+  }
+  // 第一个stage的steady阶段中，第k + num_stages - 1个micro batch的forward与第k个的backward成对执行，
+  // 因此按num_stages - 1个一组，交替从最长与最短的一端取micro batch，使每一对forward/backward一长一短
+  size_t pair_distance = std::max<size_t>(_stage_models.size() - 1, 1);
+  std::vector<size_t> paired;
+  paired.reserve(num_micro_batches);
+  for (size_t l = 0, r = num_micro_batches, group = 0; l < r; group++) {
+    for (size_t i = 0; i < pair_distance && l < r; i++)
+      paired.push_back(group % 2 == 0 ? descending[l++] : descending[--r]);
+  }
+  try_order(descending);
+  try_order(ascending);
+  try_order(interleaved);
+  try_order(paired);
+
+  // 在最好的候选上做两两交换的局部搜索
+  for (size_t pass = 0; pass < _max_search_passes; pass++) {
+    bool improved = false;
+    auto order = schedule.order;
+    for (size_t i = 0; i < num_micro_batches; i++) {
+      for (size_t j = i + 1; j < num_micro_batches && j <= i + kSwapWindow; j++) {
+        std::swap(order[i], order[j]);
+        if (try_order(order))
+          improved = true;
+        else
+          std::swap(order[i], order[j]);
+      }
+    }
+    if (!improved)
+      break;
+  }
+  return schedule;
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "hydraulis/graph/common.h"
+#include "hydraulis/core/ndarray.h"
+#include <ostream>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+// 一个（packing后的）micro batch的计算量
+struct MicroBatchCost {
+  size_t num_tokens{0};
+  // attention的计算量与每个序列长度的平方成正比，即cu_seqlens中每一段长度的平方和
+  double attn_flops{0};
+
+  // cu_seqlens为[0, l0, l0 + l1, ...]
+  static MicroBatchCost FromCuSeqlens(const NDArray& cu_seqlens);
+};
+
+// 一个pipeline stage处理一个micro batch的耗时
+// forward = fixed + per_token * num_tokens + per_attn * attn_flops，backward为forward的backward_ratio倍
+// 只需要stage之间与micro batch之间的相对大小，因此默认以一个token的线性层开销为单位
+struct StageCostModel {
+  double fixed{0};
+  double per_token{1};
+  double per_attn{0};
+  double backward_ratio{2};
+
+  double ForwardTime(const MicroBatchCost& cost) const {
+    return fixed + per_token * cost.num_tokens + per_attn * cost.attn_flops;
+  }
+
+  double BackwardTime(const MicroBatchCost& cost) const {
+    return backward_ratio * ForwardTime(cost);
+  }
+};
+
+struct MicroBatchSchedule {
+  // order[i]为第i个执行的micro batch（原来的编号）
+  std::vector<size_t> order;
+  double makespan{0};
+  double original_makespan{0};
+  // 每个stage同时存活（已forward未backward）的token数的峰值
+  std::vector<size_t> peak_inflight_tokens;
+  std::vector<size_t> original_peak_inflight_tokens;
+};
+
+std::ostream& operator<<(std::ostream& os, const MicroBatchSchedule& schedule);
+
+// pipeline内micro batch的执行顺序
+// executor按照1F1B（pipedream-flush）执行，micro batch的顺序决定了warmup与cooldown中暴露的bubble，
+// 以及steady阶段每一对forward/backward的长短搭配。
+// 这里在每个stage的cost model下模拟1F1B的时间线，以长短micro batch配对的顺序等作为初始候选，
+// 再通过两两交换的局部搜索得到makespan最小的顺序，
+// 同时每个stage存活的token数（即激活的显存）不能超过上限：
+// 默认为原顺序下的峰值，即重排不会增加任何stage的峰值显存。
+// 只依赖于每个micro batch的计算量，pipeline中的所有rank得到相同的顺序。
+class MicroBatchScheduler {
+ public:
+  MicroBatchScheduler(std::vector<StageCostModel> stage_models,
+                      size_t max_inflight_tokens = 0,
+                      size_t max_search_passes = 8)
+  : _stage_models(std::move(stage_models)),
+    _max_inflight_tokens(max_inflight_tokens),
+    _max_search_passes(max_search_passes) {
+    HT_ASSERT(!_stage_models.empty())
+      << "At least one stage is required";
+  }
+
+  // HYDRAULIS_MICRO_BATCH_ATTN_COST: 单位attention计算量（seqlen^2）相对一个token的开销，
+  //   约为1 / (6 * hidden_size)，默认按hidden_size = 4096计
+  // HYDRAULIS_MICRO_BATCH_FIXED_COST: 每个micro batch的固定开销（token数），默认为0
+  // HYDRAULIS_MICRO_BATCH_BACKWARD_RATIO: backward相对forward的倍数，默认为2
+  // HYDRAULIS_MICRO_BATCH_STAGE_WEIGHTS: 逗号分隔的各个stage的相对开销（例如最后一个stage有lm head），默认均为1
+  // HYDRAULIS_MICRO_BATCH_MAX_INFLIGHT_TOKENS: 每个stage存活token数的上限，默认为原顺序下的峰值
+  static MicroBatchScheduler FromEnv(size_t num_stages);
+
+  MicroBatchSchedule Schedule(const std::vector<MicroBatchCost>& costs) const;
+
+  // 按照order模拟1F1B，返回最后一个backward完成的时刻
+  double Simulate(const std::vector<MicroBatchCost>& costs,
+                  const std::vector<size_t>& order) const;
+
+  // 每个stage存活token数的峰值，与时间无关，只取决于1F1B中每个stage的任务顺序
+  std::vector<size_t> PeakInflightTokens(const std::vector<MicroBatchCost>& costs,
+                                         const std::vector<size_t>& order) const;
+
+  size_t num_stages() const {
+    return _stage_models.size();
+  }
+
+  const std::vector<StageCostModel>& stage_models() const {
+    return _stage_models;
+  }
+
+ protected:
+  // 每个stage的任务，与ExecutableGraph::GeneratePipedreamFlushSchedule一致
+  // <is_forward, 第几个执行的micro batch>
+  std::vector<std::vector<std::pair<bool, size_t>>> StageTasks(size_t num_micro_batches) const;
+
+  std::vector<StageCostModel> _stage_models;
+  size_t _max_inflight_tokens;
+  size_t _max_search_passes;
+};
+
+} // namespace graph
+} // namespace hydraulis
@@ -1,16 +1,38 @@
 #include "hydraulis/graph/ops/data_transfer.h"
 #include "hydraulis/graph/offload/activation_cpu_offload.h"
+#include "hydraulis/impl/communication/comm_group.h"
+#include "hydraulis/impl/stream/CUDAStream.h"
+#include "hydraulis/impl/utils/cuda_utils.h"
+#include <mutex>
 
 namespace hydraulis {
 namespace graph {
 
 bool ActivationCPUOffload::_enabled = false;
 
+// helper functions
+namespace {
+  // 没有profile结果时，按照访存带宽估计计算的时间（bytes per ms）
+  constexpr double kEstimatedHBMBytesPerMs = 1e9;
+
+  inline size_t tensor_bytes(const Tensor& tensor) {
+    int64_t numel = 1;
+    for (auto dim : tensor->shape()) {
+      // 无法确定的shape不计入
+      if (dim < 0)
+        return 0;
+      numel *= dim;
+    }
+    return static_cast<size_t>(numel) * DataType2Size(tensor->dtype());
+  }
+} // namespace
+
 bool ActivationCPUOffload::IsNoOffloadOp(Operator& op) {
   return is_comm_op(op);
 }
 
-void ActivationCPUOffload::OffloadTensorToCPU(const OpRefList& topo_order, const Tensor& tensor) {
+Tensor ActivationCPUOffload::OffloadTensorToCPU(const OpRefList& topo_order, const Tensor& tensor,
+                                                const TensorList& load_deps) {
   auto& cur_exec_graph = reinterpret_cast<ExecutableGraph&>(Graph::GetGraph(Graph::cur_graph_ctx()));
   Op2OpRefMap mapped_grad_ops;
   for (auto& consumer : tensor->consumers()) {
@@ -20,7 +42,7 @@ void ActivationCPUOffload::OffloadTensorToCPU(const OpRefList& topo_order, const
     mapped_grad_ops.insert({consumer.get()->id(), consumer});
   }
   if (tensor->placement().is_cpu() || mapped_grad_ops.empty()) {
-    return;
+    return Tensor();
   }
 
   auto& op = tensor->producer();
@@ -35,9 +57,13 @@ void ActivationCPUOffload::OffloadTensorToCPU(const OpRefList& topo_order, const
     offload_op->MapToParallelDevices(tensor->placement_group_union());
   offload_op->Instantiate(Device(kCPU), kOffloadStream);
 
-  // Find the first grad consumer of the tensor and build execution dependency
-  TensorList in_deps;
+  // Use the dependency given by the scheduler,
+  // otherwise find the first grad consumer of the tensor and build execution dependency
+  TensorList in_deps = load_deps;
   for (auto& op_ref : topo_order) {
+    if (!in_deps.empty()) {
+      break;
+    }
     if (mapped_grad_ops.find(op_ref.get()->id()) == mapped_grad_ops.end()) {
       continue;
     }
@@ -93,9 +119,12 @@ void ActivationCPUOffload::OffloadTensorToCPU(const OpRefList& topo_order, const
   }
   HT_LOG_DEBUG << "[Offload] insert offload ops to output " << tensor
                << " whose new consumers are\n\t\t" << tensor->consumers();
+  return offload_tensor;
 }
 
 void ActivationCPUOffload::OffloadToCPU(const OpRefList& topo_order) {
+  auto& local_device = hydraulis::impl::comm::GetLocalDevice();
+  auto& cur_exec_graph = reinterpret_cast<ExecutableGraph&>(Graph::GetGraph(Graph::cur_graph_ctx()));
   auto has_grad_consumer = [](const Tensor& tensor) {
     return Tensor::any_consumer_of(tensor, [](const OpRef& op_ref) -> bool {
       return op_ref.get()->is_bw_op();
@@ -115,14 +144,148 @@ void ActivationCPUOffload::OffloadToCPU(const OpRefList& topo_order) {
   }
   HT_LOG_DEBUG << "[Offload] found " << candidate_offload_ops.size()
                << " candidate offload ops: " << candidate_offload_ops;
+  if (candidate_offload_ops.empty()) {
+    return;
+  }
+
+  // Split forward ops into layers by their subgraphs,
+  // and find the first grad inputs of each layer as the dependency of prefetching.
+  auto layer_name_of = [](Operator& op) -> std::string {
+    auto subgraph = op->graph().GetSubGraph(op);
+    return subgraph != nullptr ? subgraph->global_name() : "";
+  };
+  std::unordered_map<std::string, size_t> layer_idx;
+  std::vector<double> bwd_compute_ms;
+  std::vector<size_t> layer_fwd_bytes;
+  for (auto& op_ref : topo_order) {
+    auto& op = op_ref.get();
+    if (op->is_bw_op() || is_variable_op(op) || is_placeholder_op(op)) {
+      continue;
+    }
+    auto name = layer_name_of(op);
+    auto it = layer_idx.find(name);
+    if (it == layer_idx.end()) {
+      it = layer_idx.emplace(name, bwd_compute_ms.size()).first;
+      auto subgraph = op->graph().GetSubGraph(op);
+      bwd_compute_ms.push_back(subgraph != nullptr && subgraph->already_profiled()
+                               ? subgraph->bwd_time() * 1.0 / 1e6 : -1);
+      layer_fwd_bytes.push_back(0);
+    }
+    Operator::for_each_output_tensor(op, [&](const Tensor& tensor) {
+      layer_fwd_bytes[it->second] += tensor_bytes(tensor);
+    });
+  }
+  for (size_t i = 0; i < bwd_compute_ms.size(); i++) {
+    // 没有profile结果时，按照访存带宽粗略估计反向时间
+    if (bwd_compute_ms[i] < 0)
+      bwd_compute_ms[i] = 4.0 * layer_fwd_bytes[i] / kEstimatedHBMBytesPerMs;
+  }
+  size_t num_layers = bwd_compute_ms.size();
+  std::vector<TensorList> layer_grad_inputs(num_layers + 1);
+  for (auto& op_ref : topo_order) {
+    auto& op = op_ref.get();
+    if (!op->is_bw_op()) {
+      continue;
+    }
+    auto it = layer_idx.find(layer_name_of(op));
+    TensorList grad_inputs;
+    for (auto& input : op->inputs()) {
+      if (input->producer()->is_bw_op()) {
+        grad_inputs.push_back(input);
+      }
+    }
+    if (grad_inputs.empty()) {
+      continue;
+    }
+    // layer_grad_inputs[num_layers]对应整个反向的开始
+    if (layer_grad_inputs[num_layers].empty()) {
+      layer_grad_inputs[num_layers] = grad_inputs;
+    }
+    if (it != layer_idx.end() && layer_grad_inputs[it->second].empty()) {
+      layer_grad_inputs[it->second] = grad_inputs;
+    }
+  }
+
+  // Schedule the offloaded tensors
+  TensorList offload_candidates;
+  std::vector<OffloadItem> items;
   for (auto& op_ref : candidate_offload_ops) {
     auto& op = op_ref.get();
-    HT_LOG_DEBUG << "[Offload] Offload outputs of op " << op << " with outputs: " << op->outputs();
-    Operator::for_each_output_tensor(op, [&topo_order](const Tensor& tensor) {
-      OffloadTensorToCPU(topo_order, tensor);
+    size_t layer = layer_idx.at(layer_name_of(op));
+    Operator::for_each_output_tensor(op, [&](const Tensor& tensor) {
+      if (tensor->placement().is_cpu() || !has_grad_consumer(tensor)) {
+        return;
+      }
+      offload_candidates.push_back(tensor);
+      items.push_back({tensor_bytes(tensor), layer});
     });
   }
+  auto scheduler = OffloadScheduler::FromEnv(GetBandwidthModel(local_device));
+  auto schedule = scheduler.Schedule(items, bwd_compute_ms);
+  HT_LOG_INFO << local_device << ": [Offload] " << schedule;
+
+  // Insert offload ops group by group, so that the tensors of a group
+  // are transferred back to back and laid out contiguously in the host buffer
+  TensorList offload_host_tensors;
+  for (auto& group : schedule.groups) {
+    const auto& load_deps = layer_grad_inputs[group.load_after_layer];
+    for (auto item_idx : group.items) {
+      auto& tensor = offload_candidates[item_idx];
+      HT_LOG_DEBUG << "[Offload] Offload tensor " << tensor << " of layer " << group.layer
+                   << ", prefetched when backward reaches layer " << group.load_after_layer;
+      auto offload_tensor = OffloadTensorToCPU(topo_order, tensor, load_deps);
+      if (offload_tensor.is_defined()) {
+        offload_host_tensors.push_back(offload_tensor);
+      }
+    }
+  }
+  cur_exec_graph.SetOffloadHostTensors(std::move(offload_host_tensors), scheduler.host_alignment());
+}
+
+const OffloadBandwidthModel& ActivationCPUOffload::GetBandwidthModel(const Device& device) {
+  static std::mutex models_mutex;
+  static std::unordered_map<Device, OffloadBandwidthModel> models;
+  std::lock_guard<std::mutex> lock(models_mutex);
+  auto it = models.find(device);
+  if (it != models.end()) {
+    return it->second;
+  }
+  auto model = OffloadBandwidthModel::FromEnv();
+  if (device.is_cuda() && !OffloadBandwidthModel::SpecifiedByEnv()) {
+    constexpr size_t probe_bytes = 64 * 1024 * 1024;
+    HTShape probe_shape = {static_cast<int64_t>(probe_bytes)};
+    auto device_array = NDArray::empty(probe_shape, device, kByte, kOffloadStream);
+    auto host_array = NDArray(NDArrayMeta().set_shape(probe_shape)
+                                           .set_dtype(kByte)
+                                           .set_device(Device(kCPU)),
+                              AllocPinnedHostStorage(probe_bytes));
+    Stream stream(device, kOffloadStream);
+    hydraulis::impl::CUDAEvent start(device), stop(device);
+    for (bool is_h2d : {false, true}) {
+      start.Record(stream);
+      if (is_h2d) {
+        NDArray::to(host_array, device, kUndeterminedDataType, kOffloadStream, device_array);
+      } else {
+        NDArray::to(device_array, Device(kCPU), kUndeterminedDataType, kOffloadStream, host_array);
+      }
+      stop.Record(stream);
+      stop.Sync();
+      model.Observe(is_h2d, probe_bytes, stop.TimeSince(start) * 1.0 / 1e6);
+    }
+    HT_LOG_INFO << device << ": [Offload] measured bandwidth: D2H = " << model.d2h_bandwidth()
+                << " GB/s, H2D = " << model.h2d_bandwidth() << " GB/s";
+  }
+  return models.emplace(device, std::move(model)).first->second;
+}
+
+std::shared_ptr<NDArrayStorage> ActivationCPUOffload::AllocPinnedHostStorage(size_t num_bytes) {
+  void* ptr = nullptr;
+  CUDA_CALL(cudaMallocHost(&ptr, num_bytes));
+  return std::make_shared<NDArrayStorage>(BorrowToMemoryPool(
+    Device(kCPU), ptr, num_bytes, [](DataPtr data_ptr) {
+      CUDA_CALL(cudaFreeHost(data_ptr.ptr));
+    }));
 }
 
 } // namespace graph
-} // namespace hydraulis
\ No newline at end of file
+} // namespace hydraulis
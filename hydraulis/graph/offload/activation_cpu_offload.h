@@ -3,6 +3,7 @@
 #include "hydraulis/graph/common.h"
 #include "hydraulis/graph/executable_graph.h"
 #include "hydraulis/graph/graph.h"
+#include "hydraulis/graph/offload/offload_scheduler.h"
 #include <functional>
 
 namespace hydraulis {
@@ -24,11 +25,19 @@ class ActivationCPUOffload {
 
   static void OffloadToCPU(const OpRefList& topo_order);
 
+  // 首次调用时测量device与host之间的带宽（环境变量中指定了带宽则不测量）
+  static const OffloadBandwidthModel& GetBandwidthModel(const Device& device);
+
+  // offload的host buffer使用pinned memory，这样D2H与H2D才能真正与计算overlap
+  static std::shared_ptr<NDArrayStorage> AllocPinnedHostStorage(size_t num_bytes);
+
  protected:
 
   static bool IsNoOffloadOp(Operator& op);
 
-  static void OffloadTensorToCPU(const OpRefList& topo_order, const Tensor& tensor);
+  // 返回offload到host上的tensor，不需要offload时返回空tensor
+  static Tensor OffloadTensorToCPU(const OpRefList& topo_order, const Tensor& tensor,
+                                   const TensorList& load_deps = {});
 
   static bool _enabled;
 };
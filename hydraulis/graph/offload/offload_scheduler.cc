@@ -0,0 +1,244 @@
+#include "hydraulis/graph/offload/offload_scheduler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+  constexpr size_t MiB = 1024 * 1024;
+  // 滑动平均中新观测的权重
+  constexpr double kObserveWeight = 0.25;
+
+  inline size_t align_up(size_t bytes, size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
+  }
+} // namespace
+
+OffloadBandwidthModel OffloadBandwidthModel::FromEnv() {
+  OffloadBandwidthModel model;
+  const char* env = std::getenv("HYDRAULIS_OFFLOAD_D2H_BW");
+  if (env != nullptr)
+    model.set_d2h_bandwidth(std::atof(env));
+  env = std::getenv("HYDRAULIS_OFFLOAD_H2D_BW");
+  if (env != nullptr)
+    model.set_h2d_bandwidth(std::atof(env));
+  env = std::getenv("HYDRAULIS_OFFLOAD_LATENCY");
+  if (env != nullptr)
+    model.set_latency(std::atof(env));
+  return model;
+}
+
+bool OffloadBandwidthModel::SpecifiedByEnv() {
+  return std::getenv("HYDRAULIS_OFFLOAD_D2H_BW") != nullptr
+         && std::getenv("HYDRAULIS_OFFLOAD_H2D_BW") != nullptr;
+}
+
+void OffloadBandwidthModel::Observe(bool is_h2d, size_t bytes, double ms) {
+  // 扣除延迟后太短的传输无法反映带宽
+  double transfer_ms = ms - _latency_ms;
+  if (bytes == 0 || transfer_ms <= 0)
+    return;
+  double bytes_per_ms = bytes / transfer_ms;
+  auto& cur_bytes_per_ms = is_h2d ? _h2d_bytes_per_ms : _d2h_bytes_per_ms;
+  auto& num_observed = is_h2d ? _num_observed_h2d : _num_observed_d2h;
+  if (num_observed == 0)
+    cur_bytes_per_ms = bytes_per_ms;
+  else
+    cur_bytes_per_ms = (1 - kObserveWeight) * cur_bytes_per_ms + kObserveWeight * bytes_per_ms;
+  num_observed++;
+}
+
+std::ostream& operator<<(std::ostream& os, const OffloadSchedule& schedule) {
+  os << "groups = " << schedule.groups.size()
+     << ", prefetch distance = " << schedule.prefetch_distance
+     << ", host buffer = " << schedule.host_bytes / MiB << " MiB"
+     << ", peak prefetched = " << schedule.peak_prefetched_bytes / MiB << " MiB"
+     << ", exposed load time = " << schedule.exposed_load_ms << " ms";
+  return os;
+}
+
+std::vector<size_t> LayoutOffloadHostBuffer(const std::vector<size_t>& bytes, size_t alignment,
+                                            size_t* total_bytes) {
+  HT_ASSERT(alignment > 0) << "host alignment should be positive";
+  std::vector<size_t> offsets;
+  offsets.reserve(bytes.size());
+  size_t offset = 0;
+  for (auto b : bytes) {
+    offsets.push_back(offset);
+    offset += align_up(b, alignment);
+  }
+  if (total_bytes != nullptr)
+    *total_bytes = offset;
+  return offsets;
+}
+
+// activation offload的D2H与H2D都在local device的kOffloadStream上按发起的顺序执行
+// 一个micro batch的backward发起的load一定在之后forward发起的offload之前完成
+// 因此backward结束后即可把其host buffer交给下一个forward的micro batch，不需要额外的event
+// 没有backward（推理）时offload的数据不会再被读取，forward结束后即可复用
+std::vector<size_t> AssignOffloadHostSlots(const std::vector<std::pair<int32_t, size_t>>& tasks,
+                                           size_t num_micro_batches) {
+  bool has_backward = std::any_of(tasks.begin(), tasks.end(),
+                                  [](const std::pair<int32_t, size_t>& task) { return task.first == 1; });
+  std::vector<size_t> slots(num_micro_batches, 0);
+  std::vector<size_t> free_slots;
+  size_t num_slots = 0;
+  for (const auto& [task_type, micro_batch_id] : tasks) {
+    if (task_type == 0) {
+      HT_ASSERT(micro_batch_id < num_micro_batches)
+        << "micro batch " << micro_batch_id << " exceeds " << num_micro_batches << " micro batches";
+      if (free_slots.empty()) {
+        free_slots.push_back(num_slots++);
+      }
+      slots[micro_batch_id] = free_slots.back();
+      free_slots.pop_back();
+      if (!has_backward) {
+        free_slots.push_back(slots[micro_batch_id]);
+      }
+    } else if (task_type == 1) {
+      free_slots.push_back(slots[micro_batch_id]);
+    }
+  }
+  return slots;
+}
+
+OffloadScheduler OffloadScheduler::FromEnv(OffloadBandwidthModel model) {
+  size_t coalesce_bytes = 1024 * 1024;
+  size_t max_prefetch_distance = 2;
+  const char* env = std::getenv("HYDRAULIS_OFFLOAD_COALESCE_KB");
+  if (env != nullptr)
+    coalesce_bytes = static_cast<size_t>(std::atol(env)) * 1024;
+  env = std::getenv("HYDRAULIS_OFFLOAD_MAX_PREFETCH");
+  if (env != nullptr)
+    max_prefetch_distance = static_cast<size_t>(std::atol(env));
+  return OffloadScheduler(std::move(model), coalesce_bytes, max_prefetch_distance);
+}
+
+// 同一个layer中的小activation按照顺序合并，直到合并后的大小超过阈值
+// 大的activation单独成为一个group
+std::vector<OffloadGroup> OffloadScheduler::Coalesce(const std::vector<OffloadItem>& items) const {
+  std::vector<OffloadGroup> groups;
+  std::map<size_t, std::vector<size_t>> layer_to_items;
+  for (size_t i = 0; i < items.size(); i++) {
+    layer_to_items[items[i].layer].push_back(i);
+  }
+  for (auto& kv : layer_to_items) {
+    OffloadGroup small_group;
+    small_group.layer = kv.first;
+    for (auto item_idx : kv.second) {
+      size_t bytes = align_up(items[item_idx].bytes, _host_alignment);
+      if (items[item_idx].bytes >= _coalesce_bytes) {
+        OffloadGroup group;
+        group.layer = kv.first;
+        group.items.push_back(item_idx);
+        group.bytes = bytes;
+        groups.emplace_back(std::move(group));
+        continue;
+      }
+      small_group.items.push_back(item_idx);
+      small_group.bytes += bytes;
+      if (small_group.bytes >= _coalesce_bytes) {
+        groups.emplace_back(std::move(small_group));
+        small_group = OffloadGroup();
+        small_group.layer = kv.first;
+      }
+    }
+    if (!small_group.items.empty())
+      groups.emplace_back(std::move(small_group));
+  }
+  return groups;
+}
+
+double OffloadScheduler::Simulate(const std::vector<OffloadGroup>& groups,
+                                  const std::vector<double>& bwd_compute_ms,
+                                  size_t prefetch_distance,
+                                  size_t* peak_prefetched_bytes) const {
+  size_t num_layers = bwd_compute_ms.size();
+  // 反向中每个layer开始时需要发起的load，以及每个layer需要等待的load
+  std::vector<std::vector<size_t>> issue_at(num_layers + 1);
+  std::vector<std::vector<size_t>> need_at(num_layers);
+  // 反向按layer从后往前，因此后面layer的load先发起
+  std::vector<size_t> order(groups.size());
+  for (size_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return groups[a].layer > groups[b].layer;
+  });
+  for (auto g : order) {
+    HT_ASSERT(groups[g].layer < num_layers)
+      << "layer " << groups[g].layer << " of offload group exceeds " << num_layers << " layers";
+    issue_at[std::min(groups[g].layer + prefetch_distance, num_layers)].push_back(g);
+    need_at[groups[g].layer].push_back(g);
+  }
+
+  std::vector<double> ready(groups.size(), 0);
+  double t = 0, stream_free = 0, exposed = 0;
+  size_t prefetched = 0, peak = 0;
+  auto issue = [&](size_t layer) {
+    for (auto g : issue_at[layer]) {
+      double start = std::max(stream_free, t);
+      ready[g] = start + _model.H2DTime(groups[g].bytes);
+      stream_free = ready[g];
+      prefetched += groups[g].bytes;
+    }
+    peak = std::max(peak, prefetched);
+  };
+  issue(num_layers);
+  for (size_t k = num_layers; k-- > 0;) {
+    issue(k);
+    double need = t;
+    for (auto g : need_at[k])
+      need = std::max(need, ready[g]);
+    exposed += need - t;
+    t = need + bwd_compute_ms[k];
+    // 该layer反向结束后load回来的activation即可释放
+    for (auto g : need_at[k])
+      prefetched -= groups[g].bytes;
+  }
+  if (peak_prefetched_bytes != nullptr)
+    *peak_prefetched_bytes = peak;
+  return exposed;
+}
+
+OffloadSchedule OffloadScheduler::Schedule(const std::vector<OffloadItem>& items,
+                                           const std::vector<double>& bwd_compute_ms) const {
+  OffloadSchedule schedule;
+  schedule.groups = Coalesce(items);
+  schedule.item_to_group.resize(items.size());
+  std::vector<size_t> offload_bytes;
+  offload_bytes.reserve(items.size());
+  for (size_t g = 0; g < schedule.groups.size(); g++) {
+    for (auto item_idx : schedule.groups[g].items) {
+      schedule.item_to_group[item_idx] = g;
+      offload_bytes.push_back(items[item_idx].bytes);
+    }
+  }
+  LayoutOffloadHostBuffer(offload_bytes, _host_alignment, &schedule.host_bytes);
+  if (schedule.groups.empty())
+    return schedule;
+
+  // 选择无法overlap的load时间最少的prefetch distance
+  // 时间相同时选择更小的distance，以减少提前占用的显存
+  constexpr double eps = 1e-6;
+  double best_exposed = -1;
+  for (size_t d = 0; d <= _max_prefetch_distance; d++) {
+    size_t peak = 0;
+    double exposed = Simulate(schedule.groups, bwd_compute_ms, d, &peak);
+    if (best_exposed < 0 || exposed < best_exposed - eps) {
+      best_exposed = exposed;
+      schedule.prefetch_distance = d;
+      schedule.peak_prefetched_bytes = peak;
+    }
+  }
+  schedule.exposed_load_ms = best_exposed;
+  size_t num_layers = bwd_compute_ms.size();
+  for (auto& group : schedule.groups) {
+    group.load_after_layer = std::min(group.layer + schedule.prefetch_distance, num_layers);
+  }
+  return schedule;
+}
+
+} // namespace graph
+} // namespace hydraulis
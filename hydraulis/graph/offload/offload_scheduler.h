@@ -0,0 +1,163 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include <utility>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+// host与device之间的传输模型
+// 只包含带宽与延迟，既可以由环境变量指定，也可以用实际测量到的传输不断修正
+class OffloadBandwidthModel {
+ public:
+  OffloadBandwidthModel(double d2h_gbps = 12, double h2d_gbps = 12, double latency_us = 10) {
+    set_d2h_bandwidth(d2h_gbps);
+    set_h2d_bandwidth(h2d_gbps);
+    set_latency(latency_us);
+  }
+
+  // HYDRAULIS_OFFLOAD_{D2H,H2D}_BW (GB/s)
+  // HYDRAULIS_OFFLOAD_LATENCY (us)
+  static OffloadBandwidthModel FromEnv();
+
+  // 环境变量中是否已经指定了带宽，指定了则不需要测量
+  static bool SpecifiedByEnv();
+
+  // 毫秒
+  double D2HTime(size_t bytes) const {
+    return _latency_ms + bytes / _d2h_bytes_per_ms;
+  }
+
+  double H2DTime(size_t bytes) const {
+    return _latency_ms + bytes / _h2d_bytes_per_ms;
+  }
+
+  // 用一次实际传输（bytes与ms）修正带宽
+  // 第一次观测直接覆盖默认值，之后做指数滑动平均
+  void Observe(bool is_h2d, size_t bytes, double ms);
+
+  double d2h_bandwidth() const {
+    return _d2h_bytes_per_ms / 1e6;
+  }
+
+  double h2d_bandwidth() const {
+    return _h2d_bytes_per_ms / 1e6;
+  }
+
+  void set_d2h_bandwidth(double gbps) {
+    HT_ASSERT(gbps > 0) << "bandwidth should be positive";
+    _d2h_bytes_per_ms = gbps * 1e6;
+  }
+
+  void set_h2d_bandwidth(double gbps) {
+    HT_ASSERT(gbps > 0) << "bandwidth should be positive";
+    _h2d_bytes_per_ms = gbps * 1e6;
+  }
+
+  void set_latency(double us) {
+    HT_ASSERT(us >= 0) << "latency should be non-negative";
+    _latency_ms = us * 1e-3;
+  }
+
+  bool measured() const {
+    return _num_observed_d2h > 0 && _num_observed_h2d > 0;
+  }
+
+ protected:
+  double _d2h_bytes_per_ms;
+  double _h2d_bytes_per_ms;
+  double _latency_ms;
+  size_t _num_observed_d2h{0};
+  size_t _num_observed_h2d{0};
+};
+
+// 一个需要offload的activation
+// layer为该activation所属layer在前向中的顺序，反向则按照相反的顺序使用
+struct OffloadItem {
+  size_t bytes;
+  size_t layer;
+};
+
+// 若干个同一layer中的activation合并为一次传输
+// offload op按照group的顺序插入，因此它们在host buffer中连续存放（见LayoutOffloadHostBuffer），并在同一时刻一起发起load
+struct OffloadGroup {
+  std::vector<size_t> items;
+  size_t layer;
+  size_t bytes{0};
+  // 在反向计算到该layer时发起load，layers.size()表示反向开始时即发起
+  size_t load_after_layer;
+};
+
+struct OffloadSchedule {
+  std::vector<OffloadGroup> groups;
+  std::vector<size_t> item_to_group;
+  size_t prefetch_distance{0};
+  size_t host_bytes{0}; // 按照静态shape估计的每个micro batch需要的host buffer大小
+  size_t peak_prefetched_bytes{0}; // 已经load到device但还未被使用的activation的峰值
+  double exposed_load_ms{0}; // 预测的反向中无法被计算overlap的load时间
+};
+
+std::ostream& operator<<(std::ostream& os, const OffloadSchedule& schedule);
+
+// 一个micro batch的offload tensor在host buffer中按照offload的顺序依次存放，每个tensor按照alignment对齐
+// 返回每个tensor的偏移，total_bytes为所需的buffer大小
+// Schedule按照静态shape估计，PreRun则按照每个micro batch实际的shape排布
+std::vector<size_t> LayoutOffloadHostBuffer(const std::vector<size_t>& bytes, size_t alignment,
+                                            size_t* total_bytes);
+
+// 按照一个stage的pipeline任务（<task type, micro batch id>，0为forward，1为backward）为每个micro batch分配host buffer
+// 返回每个micro batch使用的buffer编号，buffer的数目即同时存活的micro batch数的峰值
+std::vector<size_t> AssignOffloadHostSlots(const std::vector<std::pair<int32_t, size_t>>& tasks,
+                                           size_t num_micro_batches);
+
+// activation offload的调度
+// 只依赖于activation的大小与每个layer的计算时间，不涉及任何device，因此可以单独在CPU上测试
+class OffloadScheduler {
+ public:
+  OffloadScheduler(OffloadBandwidthModel model = OffloadBandwidthModel::FromEnv(),
+                   size_t coalesce_bytes = 1024 * 1024,
+                   size_t max_prefetch_distance = 2,
+                   size_t host_alignment = 256):
+    _model(std::move(model)),
+    _coalesce_bytes(coalesce_bytes),
+    _max_prefetch_distance(max_prefetch_distance),
+    _host_alignment(host_alignment) {
+    HT_ASSERT(_host_alignment > 0)
+      << "host alignment should be positive";
+  }
+
+  // HYDRAULIS_OFFLOAD_COALESCE_KB: 小于该大小的activation会被合并
+  // HYDRAULIS_OFFLOAD_MAX_PREFETCH: 最多提前多少个layer发起load
+  static OffloadScheduler FromEnv(OffloadBandwidthModel model = OffloadBandwidthModel::FromEnv());
+
+  // bwd_compute_ms[i]为第i个layer反向的计算时间
+  OffloadSchedule Schedule(const std::vector<OffloadItem>& items,
+                           const std::vector<double>& bwd_compute_ms) const;
+
+  // 给定prefetch distance，模拟反向中offload stream与compute stream的时间线
+  // 返回无法被overlap的load时间，同时得到prefetch到device上的activation峰值
+  double Simulate(const std::vector<OffloadGroup>& groups,
+                  const std::vector<double>& bwd_compute_ms,
+                  size_t prefetch_distance,
+                  size_t* peak_prefetched_bytes = nullptr) const;
+
+  const OffloadBandwidthModel& model() const {
+    return _model;
+  }
+
+  size_t host_alignment() const {
+    return _host_alignment;
+  }
+
+ protected:
+  std::vector<OffloadGroup> Coalesce(const std::vector<OffloadItem>& items) const;
+
+  OffloadBandwidthModel _model;
+  size_t _coalesce_bytes;
+  size_t _max_prefetch_distance;
+  size_t _host_alignment;
+};
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,485 @@
+#include "hydraulis/graph/offload/optimizer_cpu_offload.h"
+#include "hydraulis/graph/offload/activation_cpu_offload.h"
+#include "hydraulis/graph/ops/kernel_links.h"
+#include "hydraulis/impl/stream/CPUStream.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+  constexpr size_t MiB = 1024 * 1024;
+
+  // grad、param与optimizer states都按照一维连续的数组处理
+  inline NDArray flatten(const NDArray& array) {
+    HT_ASSERT(array->is_contiguous())
+      << "ZeRO-Offload only supports contiguous arrays, got " << array->meta();
+    auto meta = NDArrayMeta().set_dtype(array->dtype())
+                             .set_device(array->device())
+                             .set_shape({array->numel()});
+    return NDArray(meta, array->storage(), array->storage_offset());
+  }
+
+  inline Stream update_stream() {
+    return Stream(Device(kCPU), kOffloadStream);
+  }
+} // namespace
+
+bool OptimizerCPUOffload::enabled() {
+  const char* env = std::getenv("HYDRAULIS_ZERO_OFFLOAD");
+  if (env == nullptr)
+    return false;
+  if (std::string(env) == "ON")
+    return true;
+  HT_VALUE_ERROR_IF(std::string(env) != "OFF")
+    << "Unknown hydraulis zero offload setting: " << env;
+  return false;
+}
+
+std::shared_ptr<NDArrayStorage> OptimizerCPUOffload::AllocHostStorage(const Device& device,
+                                                                      size_t num_bytes) {
+  if (device.is_cuda())
+    return ActivationCPUOffload::AllocPinnedHostStorage(num_bytes);
+  return std::make_shared<NDArrayStorage>(
+    AllocFromMemoryPool(Device(kCPU), num_bytes, Stream(Device(kCPU), kBlockingStream)));
+}
+
+OptimizerCPUOffload::~OptimizerCPUOffload() {
+  // 已经发起的CPU任务仍然引用着event与staging buffer
+  if (_is_allocated)
+    hydraulis::impl::CPUStream(update_stream()).Sync();
+}
+
+NDArray OptimizerCPUOffload::HostView(const std::shared_ptr<NDArrayStorage>& storage,
+                                      DataType dtype, size_t offset, size_t numel) {
+  auto meta = NDArrayMeta().set_dtype(dtype)
+                           .set_device(Device(kCPU))
+                           .set_shape({static_cast<int64_t>(numel)});
+  return NDArray(meta, storage, offset);
+}
+
+void OptimizerCPUOffload::AddParam(int64_t param_id, size_t bucket, size_t numel, DataType dtype) {
+  HT_ASSERT(!_is_allocated)
+    << "Cannot add params after the host buffers are allocated";
+  HT_ASSERT(!HasParam(param_id))
+    << "Param " << param_id << " is added twice";
+  if (bucket >= _buckets.size())
+    _buckets.resize(bucket + 1);
+  auto& b = _buckets[bucket];
+  HT_ASSERT(b.slots.empty() || _slots.back().bucket == bucket)
+    << "Params of bucket " << bucket << " should be added consecutively";
+  HT_ASSERT(b.dtype == DataType::UNDETERMINED || b.dtype == dtype)
+    << "Params of bucket " << bucket << " should have the same dtype"
+    << ", got " << dtype << " and " << b.dtype;
+  b.dtype = dtype;
+  ParamSlot slot;
+  slot.param_id = param_id;
+  slot.bucket = bucket;
+  slot.numel = numel;
+  slot.offset = b.numel;
+  b.numel += numel;
+  b.slots.push_back(_slots.size());
+  _param_indices[param_id] = _slots.size();
+  _slots.emplace_back(std::move(slot));
+}
+
+void OptimizerCPUOffload::BindMaster(size_t bucket, const std::shared_ptr<NDArrayStorage>& storage) {
+  HT_ASSERT(!_is_allocated)
+    << "Cannot bind masters after the host buffers are allocated";
+  HT_ASSERT(bucket < _buckets.size() && !_buckets[bucket].slots.empty())
+    << "Bucket " << bucket << " has no params";
+  auto& b = _buckets[bucket];
+  HT_ASSERT(storage->size() >= b.numel * DataType2Size(kFloat32))
+    << "The master storage of bucket " << bucket << " has " << storage->size()
+    << " bytes, but " << b.numel << " float32 elements are needed";
+  b.master = storage;
+  b.master_bound = true;
+}
+
+void OptimizerCPUOffload::BindDeviceParam(int64_t param_id, const NDArray& device_param) {
+  auto it = _param_indices.find(param_id);
+  HT_ASSERT(it != _param_indices.end())
+    << "Param " << param_id << " is not offloaded";
+  auto& slot = _slots[it->second];
+  HT_ASSERT(device_param->numel() == slot.numel && device_param->device() == _device
+            && device_param->dtype() == _buckets[slot.bucket].dtype)
+    << "Param " << param_id << " has " << slot.numel << " elements of "
+    << _buckets[slot.bucket].dtype << " on " << _device << ", but got " << device_param->meta();
+  slot.device_param = device_param;
+}
+
+bool OptimizerCPUOffload::HasHostMaster(int64_t param_id) const {
+  auto it = _param_indices.find(param_id);
+  return it != _param_indices.end() && _buckets[_slots[it->second].bucket].master_bound;
+}
+
+void OptimizerCPUOffload::InvalidateMaster(int64_t param_id) {
+  auto it = _param_indices.find(param_id);
+  HT_ASSERT(it != _param_indices.end())
+    << "Param " << param_id << " is not offloaded";
+  auto& slot = _slots[it->second];
+  if (_buckets[slot.bucket].master_bound)
+    slot.master_written = false;
+  else
+    slot.master_initialized = false;
+}
+
+void OptimizerCPUOffload::WriteBackMasters() {
+  HT_ASSERT(_is_allocated)
+    << "Host buffers of ZeRO-Offload should be allocated before writing back";
+  for (auto& slot : _slots) {
+    if (slot.master_written)
+      continue;
+    HT_ASSERT(slot.device_param.is_defined())
+      << "Param " << slot.param_id << " has a host master but no device param is bound";
+    auto& bucket = _buckets[slot.bucket];
+    auto master = HostView(bucket.master, kFloat32, slot.offset, slot.numel);
+    auto param_staging = HostView(bucket.param_staging, bucket.dtype, slot.offset, slot.numel);
+    auto device_param = flatten(slot.device_param);
+    NDArray::copy(master, kBlockingStream, param_staging);
+    NDArray::copy(param_staging, kBlockingStream, device_param);
+    slot.master_written = true;
+  }
+}
+
+void OptimizerCPUOffload::Alloc() {
+  HT_ASSERT(!_is_allocated)
+    << "Host buffers of ZeRO-Offload are already allocated";
+  std::vector<OptimizerOffloadItem> items;
+  items.reserve(_slots.size());
+  for (auto& slot : _slots) {
+    size_t bytes = slot.numel * DataType2Size(_buckets[slot.bucket].dtype);
+    items.push_back({slot.bucket, slot.numel, bytes, bytes});
+    slot.grad_ready = CreateEvent(_device, false);
+  }
+  _schedule = _scheduler.Schedule(items);
+  size_t host_bytes = 0;
+  for (size_t c = 0; c < _schedule.chunks.size(); c++) {
+    _buckets[_schedule.chunks[c].bucket].chunks.push_back(c);
+    _chunk_updated.emplace_back(CreateEvent(Device(kCPU), false));
+    _chunk_written.emplace_back(CreateEvent(_device, false));
+  }
+  _chunk_launched.assign(_schedule.chunks.size(), false);
+  _chunk_update_start.resize(_schedule.chunks.size());
+  _chunk_update_ms.assign(_schedule.chunks.size(), 0);
+  _chunk_update_numel.assign(_schedule.chunks.size(), 0);
+  for (auto& bucket : _buckets) {
+    if (bucket.slots.empty())
+      continue;
+    size_t staging_bytes = bucket.numel * DataType2Size(bucket.dtype);
+    if (bucket.master_bound) {
+      // master已经有值，等待写回device
+      for (auto s : bucket.slots) {
+        _slots[s].master_initialized = true;
+        _slots[s].master_written = false;
+      }
+    } else {
+      bucket.master = AllocHostStorage(_device, bucket.numel * DataType2Size(kFloat32));
+    }
+    bucket.grad_staging = AllocHostStorage(_device, staging_bytes);
+    bucket.param_staging = AllocHostStorage(_device, staging_bytes);
+    bucket.arrived = CreateEvent(_device, false);
+    host_bytes += bucket.numel * DataType2Size(kFloat32) + 2 * staging_bytes;
+  }
+  _is_allocated = true;
+  HT_LOG_INFO << _device << ": [ZeRO-Offload] " << _slots.size() << " params, "
+              << host_bytes / MiB << " MiB host buffers (w/o optimizer states), " << _schedule;
+}
+
+NDArray OptimizerCPUOffload::GetMaster(int64_t param_id) const {
+  auto it = _param_indices.find(param_id);
+  HT_ASSERT(it != _param_indices.end())
+    << "Param " << param_id << " is not offloaded";
+  const auto& slot = _slots[it->second];
+  HT_ASSERT(_is_allocated && slot.master_initialized)
+    << "Master of param " << param_id << " is not initialized yet";
+  return HostView(_buckets[slot.bucket].master, kFloat32, slot.offset, slot.numel);
+}
+
+void OptimizerCPUOffload::SubmitAdam(int64_t param_id, const NDArray& grad, NDArray& param,
+                                     NDArray& mean, NDArray& variance, NDArray& step,
+                                     const AdamConfig& config, const Stream& stream) {
+  HT_ASSERT(_is_allocated)
+    << "Host buffers of ZeRO-Offload should be allocated before submitting";
+  auto it = _param_indices.find(param_id);
+  HT_ASSERT(it != _param_indices.end())
+    << "Param " << param_id << " is not offloaded";
+  auto& slot = _slots[it->second];
+  auto& bucket = _buckets[slot.bucket];
+  HT_ASSERT(!slot.submitted)
+    << "Param " << param_id << " is submitted twice in one step";
+  HT_ASSERT(slot.master_written)
+    << "The host master of param " << param_id << " is not written back to the device before submitting";
+  // 绑定了device_param时传入的param（host上的master）不参与拷贝
+  NDArray& device_param = slot.device_param.is_defined() ? slot.device_param : param;
+  HT_ASSERT(grad->numel() == slot.numel && device_param->numel() == slot.numel
+            && mean->numel() == slot.numel && variance->numel() == slot.numel)
+    << "Param " << param_id << " has " << slot.numel << " elements, but got grad " << grad->shape()
+    << ", param " << device_param->shape() << ", mean " << mean->shape() << " and variance " << variance->shape();
+  HT_ASSERT(device_param->device() == _device && grad->device() == _device)
+    << "Param and grad should be on " << _device;
+  HT_ASSERT(mean->is_cpu() && variance->is_cpu() && step->is_cpu())
+    << "Optimizer states of offloaded param " << param_id << " should be on the host";
+  NDArray grad_ = grad->dtype() == bucket.dtype
+                  ? grad : NDArray::to(grad, grad->device(), bucket.dtype, stream.stream_index());
+
+  // D2H在grad产生之后进行
+  slot.grad_ready->Record(stream);
+  slot.grad_ready->Block(Stream(_device, kD2HStream));
+  auto grad_staging = HostView(bucket.grad_staging, bucket.dtype, slot.offset, slot.numel);
+  NDArray::copy(flatten(grad_), kD2HStream, grad_staging);
+  if (!slot.master_initialized) {
+    auto param_staging = HostView(bucket.param_staging, bucket.dtype, slot.offset, slot.numel);
+    NDArray::copy(flatten(device_param), kD2HStream, param_staging);
+  }
+
+  slot.submitted = true;
+  slot.grad = grad_;
+  slot.param = device_param;
+  slot.mean = mean;
+  slot.variance = variance;
+  // 与AdamCuda一致，step在host上，提交即加一
+  slot.step = step->data_ptr<int64_t>()[0];
+  step->data_ptr<int64_t>()[0] = slot.step + 1;
+  slot.config = config;
+  if (++bucket.num_submitted == bucket.slots.size())
+    Launch(slot.bucket);
+}
+
+void OptimizerCPUOffload::Launch(size_t bucket_id) {
+  auto& bucket = _buckets[bucket_id];
+  HT_ASSERT(!bucket.launched)
+    << "Bucket " << bucket_id << " is launched twice in one step";
+  bucket.launched = true;
+  bucket.arrived->Record(Stream(_device, kD2HStream));
+  hydraulis::impl::CPUStream cpu_stream(update_stream());
+  auto* arrived = bucket.arrived.get();
+  cpu_stream.EnqueueTask([arrived]() { arrived->Sync(); }, "ZeroOffload_WaitGrad");
+
+  for (auto c : bucket.chunks) {
+    const auto& chunk = _schedule.chunks[c];
+    std::vector<std::pair<NDArray, NDArray>> writes;
+    // 记录chunk在CPU上实际更新的时间，Finish时用于修正scheduler的吞吐
+    auto* update_start = &_chunk_update_start[c];
+    cpu_stream.EnqueueTask([update_start]() {
+      *update_start = std::chrono::steady_clock::now();
+    }, "ZeroOffload_UpdateStart");
+    _chunk_update_numel[c] = 0;
+    for (size_t i = chunk.begin; i < chunk.end; i++) {
+      auto& slot = _slots[i];
+      if (!slot.submitted)
+        continue;
+      auto master = HostView(bucket.master, kFloat32, slot.offset, slot.numel);
+      auto grad_staging = HostView(bucket.grad_staging, bucket.dtype, slot.offset, slot.numel);
+      auto param_staging = HostView(bucket.param_staging, bucket.dtype, slot.offset, slot.numel);
+      if (!slot.master_initialized) {
+        NDArray::copy(param_staging, kOffloadStream, master);
+        slot.master_initialized = true;
+      }
+      auto mean = flatten(slot.mean);
+      auto variance = flatten(slot.variance);
+      hydraulis::impl::AdamOffloadCpu(grad_staging, master, mean, variance, param_staging,
+                                      slot.step, slot.config.learning_rate, slot.config.beta1,
+                                      slot.config.beta2, slot.config.eps, slot.config.weight_decay,
+                                      update_stream());
+      writes.emplace_back(param_staging, flatten(slot.param));
+      _chunk_update_numel[c] += slot.numel;
+    }
+    if (writes.empty())
+      continue;
+    auto* update_ms = &_chunk_update_ms[c];
+    cpu_stream.EnqueueTask([update_start, update_ms]() {
+      *update_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - *update_start).count();
+    }, "ZeroOffload_UpdateEnd");
+    // 更新完一个chunk即写回device
+    // cuda上的H2D需要在CPU更新完成后才能发起，因此由CPU stream上的任务发起
+    // cpu上则直接让H2D stream等待CPU更新完成
+    if (_device.is_cpu()) {
+      _chunk_updated[c]->Record(update_stream());
+      _chunk_updated[c]->Block(Stream(_device, kH2DStream));
+      for (auto& write : writes)
+        NDArray::copy(write.first, kH2DStream, write.second);
+      _chunk_written[c]->Record(Stream(_device, kH2DStream));
+    } else {
+      auto* written = _chunk_written[c].get();
+      Device device = _device;
+      cpu_stream.EnqueueTask([writes, written, device]() mutable {
+        for (auto& write : writes)
+          NDArray::copy(write.first, kH2DStream, write.second);
+        written->Record(Stream(device, kH2DStream));
+      }, "ZeroOffload_H2D");
+    }
+    _chunk_launched[c] = true;
+  }
+}
+
+void OptimizerCPUOffload::Finish() {
+  if (!_is_allocated)
+    return;
+  for (size_t b = 0; b < _buckets.size(); b++) {
+    auto& bucket = _buckets[b];
+    if (bucket.num_submitted > 0 && !bucket.launched) {
+      HT_LOG_DEBUG << _device << ": [ZeRO-Offload] bucket " << b << " only has "
+                   << bucket.num_submitted << " of " << bucket.slots.size() << " grads";
+      Launch(b);
+    }
+  }
+  // 等待CPU上的更新完成（cuda上的H2D也由此发起）
+  hydraulis::impl::CPUStream(update_stream()).Sync();
+  size_t observed_numel = 0;
+  double observed_ms = 0;
+  for (size_t c = 0; c < _chunk_launched.size(); c++) {
+    if (_chunk_launched[c]) {
+      _chunk_written[c]->Sync();
+      _scheduler.ObserveUpdate(_chunk_update_numel[c], _chunk_update_ms[c]);
+      observed_numel += _chunk_update_numel[c];
+      observed_ms += _chunk_update_ms[c];
+    }
+    _chunk_launched[c] = false;
+  }
+  if (observed_numel > 0) {
+    HT_LOG_DEBUG << _device << ": [ZeRO-Offload] CPU updates of " << observed_numel
+                 << " elements take " << observed_ms << " ms";
+  }
+  for (auto& slot : _slots) {
+    slot.submitted = false;
+    slot.grad = NDArray();
+    slot.param = NDArray();
+    slot.mean = NDArray();
+    slot.variance = NDArray();
+  }
+  for (auto& bucket : _buckets) {
+    bucket.launched = false;
+    bucket.num_submitted = 0;
+  }
+}
+
+OptimizerOffloadBenchmarkResult BenchmarkOptimizerOffload(size_t num_params, size_t numel_per_param,
+                                                          size_t num_buckets, size_t num_steps,
+                                                          bool low_precision, bool host_master) {
+  HT_VALUE_ERROR_IF(num_params == 0 || numel_per_param == 0 || num_buckets == 0 || num_steps == 0)
+    << "Cannot benchmark ZeRO-Offload with num_params = " << num_params
+    << ", numel_per_param = " << numel_per_param << ", num_buckets = " << num_buckets
+    << " and num_steps = " << num_steps;
+  num_buckets = std::min(num_buckets, num_params);
+  Device cpu(kCPU);
+  DataType dtype = low_precision ? kBFloat16 : kFloat32;
+  HTShape shape = {static_cast<int64_t>(numel_per_param)};
+  OptimizerCPUOffload::AdamConfig config{1e-3f, 0.9f, 0.999f, 1e-8f, 0.0f};
+  using Clock = std::chrono::steady_clock;
+  auto elapsed_ms = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  };
+
+  // offload与参照各自的一份param与optimizer states，初始值相同
+  OptimizerCPUOffload offload(cpu);
+  NDArrayList params, masters, means, variances, steps;
+  NDArrayList ref_params, ref_masters, ref_means, ref_variances;
+  std::vector<size_t> buckets(num_params);
+  std::vector<size_t> bucket_numels(num_buckets, 0);
+  std::vector<size_t> offsets(num_params);
+  for (size_t i = 0; i < num_params; i++) {
+    buckets[i] = i * num_buckets / num_params;
+    offsets[i] = bucket_numels[buckets[i]];
+    bucket_numels[buckets[i]] += numel_per_param;
+  }
+  // host_master时每个bucket的param在一块fp32的host storage上连续存放，与graph中host上的origin param bucket相同
+  std::vector<std::shared_ptr<NDArrayStorage>> master_storages;
+  if (host_master) {
+    for (size_t b = 0; b < num_buckets; b++)
+      master_storages.push_back(OptimizerCPUOffload::AllocHostStorage(cpu, bucket_numels[b] * DataType2Size(kFloat32)));
+  }
+  for (size_t i = 0; i < num_params; i++) {
+    auto init = NDArray::randn(shape, cpu, kFloat32, 0, 0.02, 2 * i + 1, kBlockingStream);
+    params.push_back(NDArray::empty(shape, cpu, dtype, kBlockingStream));
+    NDArray::copy(init, kBlockingStream, params.back());
+    ref_params.push_back(NDArray::empty(shape, cpu, dtype, kBlockingStream));
+    NDArray::copy(init, kBlockingStream, ref_params.back());
+    ref_masters.push_back(NDArray::empty(shape, cpu, kFloat32, kBlockingStream));
+    if (host_master) {
+      // master保留fp32的初值，device上的param由WriteBackMasters写入
+      auto meta = NDArrayMeta().set_dtype(kFloat32).set_device(cpu).set_shape(shape);
+      masters.push_back(NDArray(meta, master_storages[buckets[i]], offsets[i]));
+      NDArray::copy(init, kBlockingStream, masters.back());
+      NDArray::copy(init, kBlockingStream, ref_masters.back());
+      NDArray::copy(NDArray::full(shape, 0, cpu, dtype, kBlockingStream), kBlockingStream, params.back());
+    } else {
+      // master在第一次提交时从param初始化
+      masters.push_back(params.back());
+      NDArray::copy(ref_params.back(), kBlockingStream, ref_masters.back());
+    }
+    means.push_back(NDArray::full(shape, 0, cpu, kFloat32, kBlockingStream));
+    variances.push_back(NDArray::full(shape, 0, cpu, kFloat32, kBlockingStream));
+    ref_means.push_back(NDArray::full(shape, 0, cpu, kFloat32, kBlockingStream));
+    ref_variances.push_back(NDArray::full(shape, 0, cpu, kFloat32, kBlockingStream));
+    steps.push_back(NDArray::full({1}, 1, cpu, kInt64, kBlockingStream));
+    offload.AddParam(static_cast<int64_t>(i), buckets[i], numel_per_param, dtype);
+  }
+  if (host_master) {
+    for (size_t b = 0; b < num_buckets; b++)
+      offload.BindMaster(b, master_storages[b]);
+  }
+  offload.Alloc();
+  if (host_master) {
+    for (size_t i = 0; i < num_params; i++)
+      offload.BindDeviceParam(static_cast<int64_t>(i), params[i]);
+    offload.WriteBackMasters();
+  }
+
+  OptimizerOffloadBenchmarkResult result;
+  result.num_chunks = offload.schedule().chunks.size();
+  result.predicted_serial_ms = offload.schedule().serial_ms;
+  result.predicted_pipelined_ms = offload.schedule().pipelined_ms;
+  auto grad_staging = NDArray::empty(shape, cpu, dtype, kBlockingStream);
+  auto param_staging = NDArray::empty(shape, cpu, dtype, kBlockingStream);
+  Stream compute_stream(cpu, kBlockingStream);
+  for (size_t s = 0; s < num_steps; s++) {
+    NDArrayList grads;
+    for (size_t i = 0; i < num_params; i++)
+      grads.push_back(NDArray::randn(shape, cpu, dtype, 0, 1e-2, 1000 * (s + 1) + i, kBlockingStream));
+
+    // 参照：逐个param依次拷贝grad、更新、拷贝param，全部同步进行
+    auto start = Clock::now();
+    for (size_t i = 0; i < num_params; i++) {
+      NDArray::copy(grads[i], kBlockingStream, grad_staging);
+      hydraulis::impl::AdamOffloadCpu(grad_staging, ref_masters[i], ref_means[i], ref_variances[i],
+                                      param_staging, static_cast<int64_t>(s + 1),
+                                      config.learning_rate, config.beta1, config.beta2,
+                                      config.eps, config.weight_decay, compute_stream);
+      NDArray::copy(param_staging, kBlockingStream, ref_params[i]);
+    }
+    result.serial_ms += elapsed_ms(start);
+
+    start = Clock::now();
+    for (size_t i = 0; i < num_params; i++)
+      offload.SubmitAdam(static_cast<int64_t>(i), grads[i], masters[i], means[i], variances[i],
+                         steps[i], config, compute_stream);
+    offload.Finish();
+    result.pipelined_ms += elapsed_ms(start);
+  }
+  result.serial_ms /= num_steps;
+  result.pipelined_ms /= num_steps;
+
+  auto param_f32 = NDArray::empty(shape, cpu, kFloat32, kBlockingStream);
+  auto ref_param_f32 = NDArray::empty(shape, cpu, kFloat32, kBlockingStream);
+  for (size_t i = 0; i < num_params; i++) {
+    NDArray::copy(params[i], kBlockingStream, param_f32);
+    NDArray::copy(ref_params[i], kBlockingStream, ref_param_f32);
+    const float* x = param_f32->data_ptr<float>();
+    const float* y = ref_param_f32->data_ptr<float>();
+    for (size_t k = 0; k < numel_per_param; k++)
+      result.max_abs_error = std::max(result.max_abs_error, static_cast<double>(std::fabs(x[k] - y[k])));
+    const float* master = offload.GetMaster(static_cast<int64_t>(i))->data_ptr<float>();
+    const float* ref_master = ref_masters[i]->data_ptr<float>();
+    for (size_t k = 0; k < numel_per_param; k++)
+      result.max_master_error = std::max(result.max_master_error,
+                                         static_cast<double>(std::fabs(master[k] - ref_master[k])));
+  }
+  return result;
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "hydraulis/core/ndarray.h"
+#include "hydraulis/core/stream.h"
+#include "hydraulis/graph/offload/optimizer_offload_scheduler.h"
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+
+namespace hydraulis {
+namespace graph {
+
+/******************************************************
+ * ZeRO-Offload
+ *
+ * device上只保留参与计算的param，fp32的master param与Adam的mean/variance放在host上。
+ * 混合精度时device上只有低精度的transfer param：fp32的origin param直接作为host上的master（BindMaster），
+ * grad与更新后的param都以低精度传输，param写回transfer param（BindDeviceParam）。
+ * 每个step中grad（已经reduce-scatter）逐个拷贝到host，
+ * 一个bucket的grad全部到达后即在CPU上按chunk更新，更新完一个chunk就把新的param写回device。
+ * D2H、CPU更新与H2D分别在不同的stream上进行，因此在bucket之间流水。
+ * 只依赖于NDArray，device为CPU时D2H与H2D退化为host上的拷贝，从而可以只用CPU测试。
+ ******************************************************/
+class OptimizerCPUOffload {
+ public:
+  struct AdamConfig {
+    float learning_rate;
+    float beta1;
+    float beta2;
+    float eps;
+    float weight_decay;
+  };
+
+  // HYDRAULIS_ZERO_OFFLOAD=ON
+  static bool enabled();
+
+  // device为cuda时使用pinned memory，这样D2H与H2D才能真正与计算overlap
+  static std::shared_ptr<NDArrayStorage> AllocHostStorage(const Device& device, size_t num_bytes);
+
+  OptimizerCPUOffload(const Device& device,
+                      OptimizerOffloadScheduler scheduler = OptimizerOffloadScheduler::FromEnv())
+  : _device(device), _scheduler(std::move(scheduler)) {}
+
+  ~OptimizerCPUOffload();
+
+  // 按照bucket的顺序登记param，同一bucket中的param在host上连续存放
+  // dtype为device上param（以及grad）的类型
+  void AddParam(int64_t param_id, size_t bucket, size_t numel, DataType dtype);
+
+  // 使用已有的host storage（按登记顺序连续存放的fp32 param）作为该bucket的master，需要在Alloc之前调用
+  // storage中的数据即为master的初值，第一次提交时不再从device上的param初始化
+  void BindMaster(size_t bucket, const std::shared_ptr<NDArrayStorage>& storage);
+
+  // 更新后的param写回device_param，而不是SubmitAdam时传入的param
+  void BindDeviceParam(int64_t param_id, const NDArray& device_param);
+
+  // 分配host上的master param与staging buffer，并确定CPU更新的切分
+  void Alloc();
+
+  bool IsAllocated() const {
+    return _is_allocated;
+  }
+
+  bool HasParam(int64_t param_id) const {
+    return _param_indices.find(param_id) != _param_indices.end();
+  }
+
+  bool HasHostMaster(int64_t param_id) const;
+
+  // param的数据在optimizer之外被改写（例如加载checkpoint）
+  // master在host上时之后由WriteBackMasters写回device，否则下一次提交时重新从device上的param初始化
+  void InvalidateMaster(int64_t param_id);
+
+  // 把尚未写回的host master转换为低精度并同步写回device_param
+  void WriteBackMasters();
+
+  // grad在stream上产生后调用
+  // mean/variance为host上的NDArray，param为device上的param（更新后写回，BindDeviceParam时忽略）
+  // 没有BindMaster时master param在第一次提交时从param初始化
+  void SubmitAdam(int64_t param_id, const NDArray& grad, NDArray& param,
+                  NDArray& mean, NDArray& variance, NDArray& step,
+                  const AdamConfig& config, const Stream& stream);
+
+  // 提交尚未开始的bucket（部分param没有grad时），并等待本轮所有param写回device
+  void Finish();
+
+  // param在host上的fp32 master（只读）
+  NDArray GetMaster(int64_t param_id) const;
+
+  const OptimizerOffloadSchedule& schedule() const {
+    return _schedule;
+  }
+
+ protected:
+  struct ParamSlot {
+    int64_t param_id;
+    size_t bucket;
+    size_t numel;
+    size_t offset{0}; // bucket中的元素偏移
+    bool master_initialized{false};
+    bool master_written{true}; // host master已经写回device_param
+    NDArray device_param;
+    // 以下为当前step提交的内容
+    bool submitted{false};
+    NDArray grad;
+    NDArray param;
+    NDArray mean;
+    NDArray variance;
+    int64_t step{0};
+    AdamConfig config;
+    std::unique_ptr<Event> grad_ready;
+  };
+
+  struct Bucket {
+    DataType dtype{DataType::UNDETERMINED};
+    std::vector<size_t> slots;
+    std::vector<size_t> chunks; // 属于该bucket的chunk
+    size_t numel{0};
+    std::shared_ptr<NDArrayStorage> master;
+    bool master_bound{false};
+    std::shared_ptr<NDArrayStorage> grad_staging;
+    std::shared_ptr<NDArrayStorage> param_staging;
+    bool launched{false};
+    size_t num_submitted{0};
+    std::unique_ptr<Event> arrived; // grad全部到达host
+  };
+
+  static NDArray HostView(const std::shared_ptr<NDArrayStorage>& storage, DataType dtype,
+                          size_t offset, size_t numel);
+
+  // 该bucket的grad已经全部发起D2H，开始CPU更新与H2D
+  void Launch(size_t bucket_id);
+
+  Device _device;
+  OptimizerOffloadScheduler _scheduler;
+  OptimizerOffloadSchedule _schedule;
+  std::vector<ParamSlot> _slots;
+  std::vector<Bucket> _buckets;
+  std::unordered_map<int64_t, size_t> _param_indices;
+  // 每个chunk在CPU上更新完成（仅device为cpu时使用）与写回device完成的event
+  std::vector<std::unique_ptr<Event>> _chunk_updated;
+  std::vector<std::unique_ptr<Event>> _chunk_written;
+  std::vector<bool> _chunk_launched;
+  // 每个chunk在CPU上更新的元素数、开始时刻与耗时（后两者由CPU stream上的任务写入）
+  std::vector<std::chrono::steady_clock::time_point> _chunk_update_start;
+  std::vector<double> _chunk_update_ms;
+  std::vector<size_t> _chunk_update_numel;
+  bool _is_allocated{false};
+};
+
+struct OptimizerOffloadBenchmarkResult {
+  size_t num_chunks{0};
+  double serial_ms{0};      // 每个bucket依次D2H、更新、H2D
+  double pipelined_ms{0};   // OptimizerCPUOffload
+  double predicted_serial_ms{0};
+  double predicted_pipelined_ms{0};
+  double max_abs_error{0};  // 与逐个param直接更新的结果相比
+  double max_master_error{0};
+};
+
+// 在CPU上用num_params个param（分为num_buckets个bucket）测试ZeRO-Offload的更新
+// low_precision时device上的param与grad为bf16
+// host_master时master由BindMaster提供（混合精度训练的路径），否则在第一次提交时从param初始化
+OptimizerOffloadBenchmarkResult BenchmarkOptimizerOffload(size_t num_params = 64,
+                                                          size_t numel_per_param = 1 << 20,
+                                                          size_t num_buckets = 8,
+                                                          size_t num_steps = 3,
+                                                          bool low_precision = true,
+                                                          bool host_master = false);
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,136 @@
+#include "hydraulis/graph/offload/optimizer_offload_scheduler.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+  constexpr size_t MiB = 1024 * 1024;
+  // 滑动平均中新观测的权重，与OffloadBandwidthModel一致
+  constexpr double kObserveWeight = 0.25;
+} // namespace
+
+std::ostream& operator<<(std::ostream& os, const OptimizerOffloadSchedule& schedule) {
+  os << "chunks = " << schedule.chunks.size()
+     << ", chunk size = " << schedule.chunk_bytes / MiB << " MiB"
+     << ", serial update time = " << schedule.serial_ms << " ms"
+     << ", pipelined update time = " << schedule.pipelined_ms << " ms";
+  return os;
+}
+
+OptimizerOffloadScheduler OptimizerOffloadScheduler::FromEnv(OffloadBandwidthModel model) {
+  OptimizerOffloadScheduler scheduler(std::move(model));
+  const char* env = std::getenv("HYDRAULIS_OFFLOAD_CPU_ADAM_GELEMS");
+  if (env != nullptr)
+    scheduler.set_cpu_throughput(std::atof(env));
+  env = std::getenv("HYDRAULIS_OFFLOAD_CPU_TASK_OVERHEAD");
+  if (env != nullptr)
+    scheduler.set_cpu_task_overhead(std::atof(env));
+  return scheduler;
+}
+
+void OptimizerOffloadScheduler::ObserveUpdate(size_t numel, double ms) {
+  double update_ms = ms - _cpu_task_overhead_ms;
+  if (numel == 0 || update_ms <= 0)
+    return;
+  double elems_per_ms = numel / update_ms;
+  if (_num_observed_updates == 0)
+    _cpu_elems_per_ms = elems_per_ms;
+  else
+    _cpu_elems_per_ms = (1 - kObserveWeight) * _cpu_elems_per_ms + kObserveWeight * elems_per_ms;
+  _num_observed_updates++;
+}
+
+std::vector<OptimizerOffloadChunk>
+OptimizerOffloadScheduler::Split(const std::vector<OptimizerOffloadItem>& items,
+                                 size_t chunk_bytes) const {
+  std::vector<OptimizerOffloadChunk> chunks;
+  std::vector<bool> finished_buckets;
+  for (size_t i = 0; i < items.size(); i++) {
+    if (chunks.empty() || chunks.back().bucket != items[i].bucket
+        || chunks.back().grad_bytes >= chunk_bytes) {
+      if (!chunks.empty() && chunks.back().bucket != items[i].bucket) {
+        if (chunks.back().bucket >= finished_buckets.size())
+          finished_buckets.resize(chunks.back().bucket + 1, false);
+        finished_buckets[chunks.back().bucket] = true;
+      }
+      HT_ASSERT(items[i].bucket >= finished_buckets.size() || !finished_buckets[items[i].bucket])
+        << "params of bucket " << items[i].bucket << " should be consecutive";
+      OptimizerOffloadChunk chunk;
+      chunk.bucket = items[i].bucket;
+      chunk.begin = i;
+      chunks.push_back(chunk);
+    }
+    auto& chunk = chunks.back();
+    chunk.end = i + 1;
+    chunk.numel += items[i].numel;
+    chunk.grad_bytes += items[i].grad_bytes;
+    chunk.param_bytes += items[i].param_bytes;
+  }
+  return chunks;
+}
+
+double OptimizerOffloadScheduler::Simulate(const std::vector<OptimizerOffloadItem>& items,
+                                           const std::vector<OptimizerOffloadChunk>& chunks) const {
+  // grad都已经reduce-scatter完毕，D2H按照param的顺序依次进行
+  std::vector<double> bucket_arrived;
+  double d2h_free = 0;
+  for (const auto& chunk : chunks) {
+    for (size_t i = chunk.begin; i < chunk.end; i++)
+      d2h_free += _model.D2HTime(items[i].grad_bytes);
+    if (chunk.bucket >= bucket_arrived.size())
+      bucket_arrived.resize(chunk.bucket + 1, 0);
+    bucket_arrived[chunk.bucket] = d2h_free;
+  }
+  double cpu_free = 0, h2d_free = 0;
+  for (const auto& chunk : chunks) {
+    cpu_free = std::max(cpu_free, bucket_arrived[chunk.bucket]) + UpdateTime(chunk.numel);
+    h2d_free = std::max(h2d_free, cpu_free);
+    for (size_t i = chunk.begin; i < chunk.end; i++)
+      h2d_free += _model.H2DTime(items[i].param_bytes);
+  }
+  return h2d_free;
+}
+
+double OptimizerOffloadScheduler::SerialTime(const std::vector<OptimizerOffloadItem>& items) const {
+  double total = 0;
+  for (const auto& item : items)
+    total += _model.D2HTime(item.grad_bytes) + UpdateTime(item.numel) + _model.H2DTime(item.param_bytes);
+  return total;
+}
+
+OptimizerOffloadSchedule OptimizerOffloadScheduler::Schedule(const std::vector<OptimizerOffloadItem>& items) const {
+  OptimizerOffloadSchedule schedule;
+  if (items.empty())
+    return schedule;
+  schedule.serial_ms = SerialTime(items);
+  size_t max_bucket_bytes = 0;
+  std::vector<size_t> bucket_bytes;
+  for (const auto& item : items) {
+    if (item.bucket >= bucket_bytes.size())
+      bucket_bytes.resize(item.bucket + 1, 0);
+    bucket_bytes[item.bucket] += item.grad_bytes;
+    max_bucket_bytes = std::max(max_bucket_bytes, bucket_bytes[item.bucket]);
+  }
+  // 从整个bucket一个chunk开始逐次减半
+  // 时间相同时选择更大的chunk，以减少CPU上的任务数
+  constexpr double eps = 1e-6;
+  double best_ms = -1;
+  for (size_t chunk_bytes = std::max(max_bucket_bytes, _min_chunk_bytes); ; chunk_bytes /= 2) {
+    auto chunks = Split(items, chunk_bytes);
+    double ms = Simulate(items, chunks);
+    if (best_ms < 0 || ms < best_ms - eps) {
+      best_ms = ms;
+      schedule.chunks = std::move(chunks);
+      schedule.chunk_bytes = chunk_bytes;
+    }
+    if (chunk_bytes / 2 < _min_chunk_bytes)
+      break;
+  }
+  schedule.pipelined_ms = best_ms;
+  return schedule;
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "hydraulis/graph/offload/offload_scheduler.h"
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+// ZeRO-Offload中需要在host上更新的一个param
+// bucket为其所在的ParamBucket，同一bucket中的param按照顺序连续存放在host上
+struct OptimizerOffloadItem {
+  size_t bucket;
+  size_t numel;
+  size_t grad_bytes;  // D2H的大小
+  size_t param_bytes; // H2D的大小
+};
+
+// 同一bucket中连续的若干param，作为一次CPU更新的单位
+// grad全部到达host后开始更新，更新完一个chunk即开始写回device
+struct OptimizerOffloadChunk {
+  size_t bucket;
+  size_t begin; // items[begin, end)
+  size_t end;
+  size_t numel{0};
+  size_t grad_bytes{0};
+  size_t param_bytes{0};
+};
+
+struct OptimizerOffloadSchedule {
+  std::vector<OptimizerOffloadChunk> chunks;
+  size_t chunk_bytes{0}; // 选出的切分粒度（按grad的大小）
+  double serial_ms{0};   // D2H、CPU更新、H2D依次进行时的预测时间
+  double pipelined_ms{0};
+};
+
+std::ostream& operator<<(std::ostream& os, const OptimizerOffloadSchedule& schedule);
+
+// ZeRO-Offload中optimizer update的调度
+// D2H、CPU更新与H2D三个阶段在bucket之间流水，
+// 这里只决定CPU更新的粒度：chunk越小首尾暴露的传输越少，但每个chunk都有固定的调度开销
+// 只依赖于param的大小、带宽与CPU的吞吐，不涉及任何device，因此可以单独在CPU上测试
+class OptimizerOffloadScheduler {
+ public:
+  OptimizerOffloadScheduler(OffloadBandwidthModel model = OffloadBandwidthModel::FromEnv(),
+                            double cpu_gelems_per_s = 1,
+                            double cpu_task_overhead_us = 20,
+                            size_t min_chunk_bytes = 1024 * 1024):
+    _model(std::move(model)),
+    _min_chunk_bytes(min_chunk_bytes) {
+    set_cpu_throughput(cpu_gelems_per_s);
+    set_cpu_task_overhead(cpu_task_overhead_us);
+  }
+
+  // HYDRAULIS_OFFLOAD_CPU_ADAM_GELEMS: CPU上Adam的吞吐（G elements/s）
+  // HYDRAULIS_OFFLOAD_CPU_TASK_OVERHEAD: 每个CPU更新任务的固定开销（us）
+  static OptimizerOffloadScheduler FromEnv(OffloadBandwidthModel model = OffloadBandwidthModel::FromEnv());
+
+  OptimizerOffloadSchedule Schedule(const std::vector<OptimizerOffloadItem>& items) const;
+
+  // 将每个bucket中的param按顺序合并为grad不小于chunk_bytes的chunk
+  std::vector<OptimizerOffloadChunk> Split(const std::vector<OptimizerOffloadItem>& items,
+                                           size_t chunk_bytes) const;
+
+  // 模拟三个阶段的时间线，返回最后一次H2D完成的时刻（ms）
+  // 与运行时一致，D2H与H2D按param逐个进行，CPU更新按chunk进行，
+  // bucket的grad全部到达host后才开始其第一个chunk的更新
+  double Simulate(const std::vector<OptimizerOffloadItem>& items,
+                  const std::vector<OptimizerOffloadChunk>& chunks) const;
+
+  double SerialTime(const std::vector<OptimizerOffloadItem>& items) const;
+
+  double UpdateTime(size_t numel) const {
+    return _cpu_task_overhead_ms + numel / _cpu_elems_per_ms;
+  }
+
+  // 用一次实际的CPU更新修正吞吐，与OffloadBandwidthModel::Observe一致
+  void ObserveUpdate(size_t numel, double ms);
+
+  const OffloadBandwidthModel& model() const {
+    return _model;
+  }
+
+  void set_cpu_throughput(double gelems_per_s) {
+    HT_ASSERT(gelems_per_s > 0) << "cpu throughput should be positive";
+    _cpu_elems_per_ms = gelems_per_s * 1e6;
+  }
+
+  void set_cpu_task_overhead(double us) {
+    HT_ASSERT(us >= 0) << "cpu task overhead should be non-negative";
+    _cpu_task_overhead_ms = us * 1e-3;
+  }
+
+ protected:
+  OffloadBandwidthModel _model;
+  double _cpu_elems_per_ms;
+  double _cpu_task_overhead_ms;
+  size_t _min_chunk_bytes;
+  size_t _num_observed_updates{0};
+};
+
+} // namespace graph
+} // namespace hydraulis
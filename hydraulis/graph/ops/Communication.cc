@@ -738,7 +738,7 @@ bool AllReduceOpImpl::DoInstantiate(Operator& op, const Device& placement,
       << " must in placement_group: " << op->output(0)->local_placement_group();
   }
   auto ranks = DeviceGroupToWorldRanks(_comm_group);
-  NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream());
+  GetOrCreateCommGroup(ranks, op->instantiation_ctx().stream());
   return ret;
 }
 
@@ -792,9 +792,9 @@ bool P2PSendOpImpl::DoInstantiate(Operator& op, const Device& placement,
   ranks[0] = std::min(src_rank, dst_rank);
   ranks[1] = std::max(src_rank, dst_rank);
   if (op->graph().type() == GraphType::EXECUTABLE && dynamic_cast<ExecutableGraph&>(op->graph()).p2p_single_communicator()) {
-    NCCLCommunicationGroup::GetOrCreate(_all_ranks, op->instantiation_ctx().stream());
+    GetOrCreateCommGroup(_all_ranks, op->instantiation_ctx().stream());
   } else {
-    NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream());
+    GetOrCreateCommGroup(ranks, op->instantiation_ctx().stream());
   }
   return ret;
 }
@@ -854,9 +854,9 @@ bool P2PRecvOpImpl::DoInstantiate(Operator& op, const Device& placement,
   ranks[0] = std::min(src_rank, dst_rank);
   ranks[1] = std::max(src_rank, dst_rank);
   if (op->graph().type() == GraphType::EXECUTABLE && dynamic_cast<ExecutableGraph&>(op->graph()).p2p_single_communicator()) {
-    NCCLCommunicationGroup::GetOrCreate(_all_ranks, op->instantiation_ctx().stream());
+    GetOrCreateCommGroup(_all_ranks, op->instantiation_ctx().stream());
   } else {
-    NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream());
+    GetOrCreateCommGroup(ranks, op->instantiation_ctx().stream());
   }
   return ret;
 }
@@ -900,7 +900,7 @@ bool BatchedISendIRecvOpImpl::DoInstantiate(Operator& op, const Device& placemen
   std::vector<int> ranks(_comm_devices.size());
   std::transform(_comm_devices.begin(), _comm_devices.end(), ranks.begin(), [&](const Device& device) { return DeviceToWorldRank(device); });
   std::sort(ranks.begin(), ranks.end());
-  NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream());
+  GetOrCreateCommGroup(ranks, op->instantiation_ctx().stream());
   return ret;
 }
 
@@ -976,7 +976,7 @@ bool AllGatherOpImpl::DoInstantiate(Operator& op, const Device& placement,
       << " must in device group: " << op->output(0)->local_placement_group();
   }                                   
   auto ranks = DeviceGroupToWorldRanks(_comm_group);
-  NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream());
+  GetOrCreateCommGroup(ranks, op->instantiation_ctx().stream());
   return ret;
 }
 
@@ -1042,7 +1042,7 @@ bool ReduceScatterOpImpl::DoInstantiate(Operator& op, const Device& placement,
       << " must in device group: " << op->output(0)->local_placement_group();
   }                                    
   auto ranks = DeviceGroupToWorldRanks(_comm_group);
-  NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream());
+  GetOrCreateCommGroup(ranks, op->instantiation_ctx().stream());
   return ret;
 }
 
@@ -1124,7 +1124,7 @@ bool SplitAllGatherOpImpl::DoInstantiate(Operator& op, const Device& placement,
   for (const auto& comm_groups : _comm_groups_list) {
     for (const auto& comm_group : comm_groups) {
       auto ranks = DeviceGroupToWorldRanks(comm_group);
-      NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream());
+      GetOrCreateCommGroup(ranks, op->instantiation_ctx().stream());
     }
   }
   return ret;
@@ -1201,7 +1201,7 @@ bool SplitAllReduceOpImpl::DoInstantiate(Operator& op, const Device& placement,
   for (const auto& comm_groups : _comm_groups_list) {
     for (const auto& comm_group : comm_groups) {
       auto ranks = DeviceGroupToWorldRanks(comm_group);
-      NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream());
+      GetOrCreateCommGroup(ranks, op->instantiation_ctx().stream());
     }
   }
   return ret;
@@ -1260,7 +1260,7 @@ bool SplitReduceScatterOpImpl::DoInstantiate(Operator& op, const Device& placeme
   for (const auto& comm_groups : _comm_groups_list) {
     for (const auto& comm_group : comm_groups) {
       auto ranks = DeviceGroupToWorldRanks(comm_group);
-      NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream());
+      GetOrCreateCommGroup(ranks, op->instantiation_ctx().stream());
     }
   }
   return ret;
@@ -1,8 +1,8 @@
 #include "hydraulis/graph/ops/Einsum.h"
+#include "hydraulis/graph/ops/einsum_planner.h"
 #include "hydraulis/graph/headers.h"
 #include "hydraulis/graph/ops/kernel_links.h"
-#include "hydraulis/impl/stream/CPUStream.h"
-#include <bitset>
+#include <unordered_set>
 
 namespace hydraulis {
 namespace graph {
@@ -23,273 +23,46 @@ bool operator==(const EinsumParameters& l, const EinsumParameters& r) {
             && l.elli_pos == r.elli_pos);
 }
 
-NDArray sumproduct_pair(Operator& op, NDArray& left_, NDArray& right_, HTShape sum_dims_,
-                        bool keepdim) {
-  HT_ASSERT(left_->ndim() == right_->ndim())
-    << "number of dimensions must match";
-  if (sum_dims_.size() == 0)
-    return NDArray::mul(left_, right_, op->instantiation_ctx().stream_index);
-  int64_t dim = left_->ndim();
+namespace {
 
-  constexpr size_t dim_bitset_size = 64;
-  HT_ASSERT(dim <= (int64_t) dim_bitset_size)
-    << "only tensors with up to " << dim_bitset_size << " dims are supported";
-  std::bitset<dim_bitset_size> sum_dims;
-  for (size_t i = 0; i < sum_dims_.size(); ++i) {
-    size_t d = sum_dims_[i];
-    HT_ASSERT(!sum_dims[d])
-      << "dim " << d << " appears multiple times in the list of dims";
-    sum_dims[d] = true;
+// 展开"..."之后的各输入的label
+std::vector<std::vector<std::string>> ExpandInputDims(const EinsumParameters& para,
+                                                      const NDArrayList& inputs,
+                                                      size_t num_inputs) {
+  std::vector<std::vector<std::string>> input_dims;
+  for (size_t i = 0; i < num_inputs; ++i) {
+    input_dims.emplace_back(EinsumPlanner::ExpandEllipsis(para.input_dims[i], inputs.at(i)->ndim(),
+                                                          para.elli_len));
   }
+  return input_dims;
+}
 
-  // dimensions that will be part of the output (i.e. not summed over) in three
-  // vectors dims in lro appear in left, right and output, similarly lo: left
-  // and output, ro: right and output also the sizes are kept track of for
-  // reshaping
-  HTShape lro, lo, ro;
-  int32_t lro_size = 1, lo_size = 1, ro_size = 1, sum_size = 1;
-  NDArray left = NDArray::copy(left_, op->instantiation_ctx().stream_index);
-  NDArray right = NDArray::copy(right_, op->instantiation_ctx().stream_index);
-  for (int i = 0; i < dim; ++i) {
-    auto sl = left->shape(i) > 1;
-    auto sr = right->shape(i) > 1;
-    if (sum_dims[i]) { // first dimensions that will be summed over after
-                       // multiplication
-      if (sl && sr) { // dimensions nontrivially in both left and right must be
-                      // of the same size
-        HT_ASSERT(left->shape(i) == right->shape(i))
-          << "non-broadcast dimensions must match";
-        sum_size *= left->shape(i);
-      } else if (sl) { // if it is only in one of left and right, we can sum
-                       // right away
-        left = NDArray::sum(left, {i}, {true}, op->instantiation_ctx().stream_index);
-      } else if (sr) {
-        right = NDArray::sum(right, {i}, {true}, op->instantiation_ctx().stream_index);
-      }
-    } else if (sl && sr) { // now deal with dimensions  dimensions that will be
-                           // in the output
-      // dimensions nontrivially in both left and right must be of the same size
-      HT_ASSERT(left->shape(i) == right->shape(i))
-        << "non-broadcast dimensions must match";
-      lro.push_back(i);
-      lro_size *= left->shape(i);
-    } else if (sl) { // keep track of dimensions appearing only once
-      lo.push_back(i);
-      lo_size *= left->shape(i);
-    } else {
-      ro.push_back(i);
-      ro_size *= right->shape(i);
-    }
-  }
-
-  HTShape out_size;
-  for (auto& d : lro)
-    out_size.push_back(left->shape(d));
-  for (auto& d : lo)
-    out_size.push_back(left->shape(d));
-  for (auto& d : sum_dims_) {
-    out_size.push_back(1);
-    (void) (d);
-  }; // avoid warning about not using d
-  for (auto& d : ro)
-    out_size.push_back(right->shape(d));
-
-  HTShape lpermutation(lro);
-  lpermutation.insert(lpermutation.end(), lo.begin(), lo.end());
-  lpermutation.insert(lpermutation.end(), sum_dims_.begin(), sum_dims_.end());
-  lpermutation.insert(lpermutation.end(), ro.begin(), ro.end());
-
-  HTShape rpermutation(lro);
-  rpermutation.insert(rpermutation.end(), sum_dims_.begin(), sum_dims_.end());
-  rpermutation.insert(rpermutation.end(), ro.begin(), ro.end());
-  rpermutation.insert(rpermutation.end(), lo.begin(), lo.end());
-
-  HTShape opermutation(lro.size() + lo.size() + sum_dims_.size() + ro.size(),
-                       -1);
-  {
-    int32_t i = 0;
-
-    for (auto it = lro.cbegin(); it != lro.cend(); i++, it++) {
-      opermutation[*it] = i;
-    }
-    for (auto it = lo.cbegin(); it != lo.cend(); i++, it++) {
-      opermutation[*it] = i;
-    }
-    for (auto it = sum_dims_.cbegin(); it != sum_dims_.cend(); i++, it++) {
-      opermutation[*it] = i;
-    }
-    for (auto it = ro.cbegin(); it != ro.cend(); i++, it++) {
-      opermutation[*it] = i;
-    }
-  }
-  // now we can execute the operations above
-  left = NDArray::permute(left, lpermutation, op->instantiation_ctx().stream_index);
-  HTShape ls(3);
-  ls[0] = lro_size;
-  ls[1] = lo_size;
-  ls[2] = sum_size;
-
-  left = NDArray::reshape(left, ls, op->instantiation_ctx().stream_index);
-
-  right = NDArray::permute(right, rpermutation, op->instantiation_ctx().stream_index);
-  HTShape rs(3);
-  rs[0] = lro_size;
-  rs[1] = sum_size;
-  rs[2] = ro_size;
-
-  right = NDArray::reshape(right, rs, op->instantiation_ctx().stream_index);
-
-  NDArray result = NDArray::bmm(left, right, false, false, op->instantiation_ctx().stream_index);
-  HTShape os(out_size.size());
-  for (size_t i = 0; i < out_size.size(); ++i) {
-    os[i] = out_size[i];
-  }
-
-  result = NDArray::reshape(result, os, op->instantiation_ctx().stream_index);
-  result = NDArray::permute(result, opermutation, op->instantiation_ctx().stream_index);
-
-  // finally squeeze summed dimensions if desired
-  if (!keepdim) {
-    HTShape sizes = result->shape();
-    for (int i = dim - 1; i >= 0; i--) {
-      if (sum_dims[i]) {
-        sizes.erase(sizes.begin() + i);
-      }
-    }
-
-    result = NDArray::reshape(result, sizes, op->instantiation_ctx().stream_index);
-  }
-  return result;
+HTShapeList GetInputShapes(const NDArrayList& inputs, size_t num_inputs) {
+  HTShapeList input_shapes;
+  for (size_t i = 0; i < num_inputs; ++i)
+    input_shapes.emplace_back(inputs.at(i)->shape());
+  return input_shapes;
 }
 
+} // namespace
+
 void EinsumOpImpl::DoCompute(Operator& op,
                              const NDArrayList& inputs, NDArrayList& outputs,
                              RuntimeContext& ctx) const {
-  NDArrayList permuted_inputs = {};
   EinsumParameters para = params();
-  for (size_t i = 0; i < inputs.size(); ++i) {
-    HTShape perm_shape(para.num_output_labels, -1);
-    LabelMap label_dim;
-    OpDim input_labels;
-    HTShape input_shape;
-    NDArray input_tensor = NDArray::copy(inputs.at(i), op->instantiation_ctx().stream_index);
-    input_labels = para.input_dims[i];
-    input_shape = inputs.at(i)->shape();
-
-    int j = 0;
-    for (const auto& label : input_labels) {
-      if (label == "...") {
-        // Add missing dimensions covered by the ellipsis
-        int missing_dims =
-          para.elli_len - (input_shape.size() - input_labels.size() + 1);
-        for (int k = 0; k < missing_dims; ++k) {
-          input_tensor = NDArray::unsqueeze(input_tensor, j);
-        }
-        for (int k = 0; k < para.elli_len; ++k) {
-          perm_shape[para.elli_pos + k] = j++;
-        }
-      } else if (label_dim.find(label) != label_dim.end()) {
-        // Repeated label, take diagonal
-        int dim = label_dim[label];
-        HT_ASSERT(input_tensor->shape(j) == input_tensor->shape(dim))
-          << j << ":" << input_tensor->shape(j) << "," << dim << ":"
-          << input_tensor->shape(dim);
-        // HT_LOG_INFO << input_tensor;
-        input_tensor = NDArray::diagonal(input_tensor, dim, j, 0, op->instantiation_ctx().stream_index);
-        // HT_LOG_INFO << input_tensor;
-        input_tensor = NDArray::movedim(input_tensor, -1, dim, op->instantiation_ctx().stream_index);
-      } else {
-        // Lookup output index for label
-        label_dim[label] = j;
-        perm_shape[para.output_labels_idx.find(label)->second] = j++;
-      }
-    }
-
-    // Add dimensions for missing labels
-    for (int64_t& index : perm_shape) {
-      if (index == -1) {
-        input_tensor = NDArray::unsqueeze(input_tensor, -1);
-        index = j++;
-      }
-    }
-    NDArray permuted_input = NDArray::permute(input_tensor, perm_shape, op->instantiation_ctx().stream_index);
-    permuted_inputs.emplace_back(permuted_input);
-  }
-
-
-  // Check if operands broadcast and keep track of last operand with
-  // dimension size != 1 for optimizing reductions
-  std::vector<std::size_t> dim_last_op(para.num_output_labels, 0);
-  bool has_zero_size_dim = false;
-
-  for (int dim = 0; dim < para.num_output_labels; dim++) {
-    int output_dim_size = permuted_inputs[0]->shape(dim);
-    for (size_t i = 1; i < inputs.size(); ++i) {
-      int input_dim_size = permuted_inputs[i]->shape(dim);
-      HT_ASSERT(output_dim_size == input_dim_size || output_dim_size == 1 ||
-                input_dim_size == 1)
-        << "input" << i << "cannot broadcast to outshape."
-        << "input" << i << "'s shape:" << permuted_inputs[i]->shape()
-        << "output shape:" << permuted_inputs[0]->shape();
-      if (input_dim_size != 1) {
-        output_dim_size = input_dim_size;
-        dim_last_op[dim] = i;
-      }
-    }
-    if (output_dim_size == 0)
-      has_zero_size_dim = true;
+  std::vector<std::string> output_dims;
+  if (!para.output_dims.empty()) {
+    OpDim output_labels = para.output_dims.at(0);
+    size_t ndim = para.elli_len;
+    for (const auto& label : output_labels) {
+      if (label != "...")
+        ndim++;
+    }
+    output_dims = EinsumPlanner::ExpandEllipsis(output_labels, ndim, para.elli_len);
   }
-
-  // Compute result
-  // Fast path for when an operand has zero sized dim
-  if (has_zero_size_dim) {
-    return;
-  }
-
-  // Sum out or squeeze dimensions that are size 1 for all later operands
-  NDArray output_tensor = NDArray::copy(permuted_inputs[0], op->instantiation_ctx().stream_index);
-  int dim = para.output_size;
-  for (int i = dim; i < para.num_output_labels; ++i, ++dim) {
-    if (dim_last_op[i] == 0) {
-      if (output_tensor->shape(dim) == 1) {
-        output_tensor = NDArray::squeeze(output_tensor, dim--);
-      } else {
-        output_tensor = NDArray::sum(output_tensor, {dim--}, {false}, op->instantiation_ctx().stream_index);
-      }
-    }
-  }
-
-  for (size_t i = 1; i < inputs.size(); ++i) {
-    NDArray permuted_input = NDArray::copy(permuted_inputs[i], op->instantiation_ctx().stream_index);
-    HTShape sum_dims;
-    // Sum out or squeeze dimensions that are size 1 for all later operands
-    dim = para.output_size;
-    for (int j = dim; j < para.num_output_labels; ++j, ++dim) {
-      if (dim_last_op[j] < i) {
-        permuted_input = NDArray::squeeze(permuted_input, dim--);
-      } else if (dim_last_op[j] == i) {
-        if (output_tensor->shape(dim) == 1) {
-          permuted_input = NDArray::sum(permuted_input, {dim}, {false}, op->instantiation_ctx().stream_index);
-          output_tensor = NDArray::squeeze(output_tensor, dim--);
-        } else {
-          sum_dims.push_back(dim);
-        }
-      }
-    }
-    // Multiply tensors and sum out dimensions in sum_dims
-    if (sum_dims.empty()) {
-      output_tensor = NDArray::mul(output_tensor, permuted_input, op->instantiation_ctx().stream_index);
-    } else if (sum_dims.size() == output_tensor->ndim()) {
-      NDArray flatten_input = NDArray::flatten(permuted_input, 0, -1);
-      NDArray flatten_output = NDArray::flatten(output_tensor, 0, -1);
-      output_tensor =
-        NDArray::sum(NDArray::dot(flatten_input, flatten_output), {0}, {false}, op->instantiation_ctx().stream_index);
-    } else {
-      output_tensor =
-        sumproduct_pair(op, output_tensor, permuted_input, sum_dims, false);
-    }
-  }
-  outputs[0] = NDArray::reshape(output_tensor, op->output(0)->shape(), op->instantiation_ctx().stream_index);
+  auto plan = EinsumPlanner::GetOrCreatePlan(ExpandInputDims(para, inputs, inputs.size()),
+                                             output_dims, GetInputShapes(inputs, inputs.size()));
+  EinsumPlanner::Execute(*plan, inputs, op->instantiation_ctx().stream_index, outputs.at(0));
 }
 
 TensorList EinsumOpImpl::DoGradient(Operator& op,
@@ -389,129 +162,41 @@ void EinsumGradientOpImpl::DoCompute(Operator& op,
                                      const NDArrayList& inputs, NDArrayList& outputs, 
                                      RuntimeContext& ctx) const {
   EinsumParameters para = params();
-  NDArrayList permuted_inputs = {};
-  for (size_t i = 0; i < inputs.size() - 1; ++i) {
-    HTShape perm_shape(para.num_output_labels, -1);
-    LabelMap label_dim;
-    OpDim input_labels;
-    HTShape input_shape;
-    NDArray input_tensor;
-    input_labels = para.input_dims[i];
-    input_shape = inputs.at(i)->shape();
-    input_tensor = NDArray::copy(inputs.at(i), op->instantiation_ctx().stream_index);
-
-    int j = 0;
-    for (const auto& label : input_labels) {
-      if (label == "...") {
-        // Add missing dimensions covered by the ellipsis
-        int missing_dims =
-          para.elli_len - (input_shape.size() - input_labels.size() + 1);
-        for (int k = 0; k < missing_dims; ++k) {
-          input_tensor = NDArray::unsqueeze(input_tensor, j);
-        }
-        for (int k = 0; k < para.elli_len; ++k) {
-          perm_shape[para.elli_pos + k] = j++;
-        }
-      } else if (label_dim.find(label) != label_dim.end()) {
-        // Repeated label, take diagonal
-        int dim = label_dim[label];
-        HT_ASSERT(input_shape[j] == input_shape[dim]);
-
-        input_tensor = NDArray::diagonal(input_tensor, dim, j, 0, op->instantiation_ctx().stream_index);
-
-        input_tensor = NDArray::movedim(input_tensor, -1, dim, op->instantiation_ctx().stream_index);
-      } else {
-        // Lookup output index for label
-        label_dim[label] = j;
-        perm_shape[para.output_labels_idx.find(label)->second] = j++;
-      }
-    }
-
-    // Add dimensions for missing labels
-    for (int64_t& index : perm_shape) {
-      if (index == -1) {
-        input_tensor = NDArray::unsqueeze(input_tensor, -1);
-        index = j++;
-      }
-    }
-    NDArray permuted_input = NDArray::permute(input_tensor, perm_shape, op->instantiation_ctx().stream_index);
-    permuted_inputs.emplace_back(permuted_input);
+  size_t num_inputs = inputs.size() - 1;
+  // 与正向共用planner，结果的前output_size维按照output_labels_idx排列
+  // 输入中不存在的label（undefined labels）在结果中为大小为1的维度
+  std::vector<std::string> output_dims(para.output_size);
+  for (const auto& kv : para.output_labels_idx) {
+    if (kv.second < para.output_size)
+      output_dims[kv.second] = kv.first;
   }
-  // Check if operands broadcast and keep track of last operand with
-  // dimension size != 1 for optimizing reductions
-  std::vector<std::size_t> dim_last_op(para.num_output_labels, 0);
-  bool has_zero_size_dim = false;
-
-  for (int dim = 0; dim < para.num_output_labels; dim++) {
-    int output_dim_size = permuted_inputs[0]->shape(dim);
-    for (size_t i = 1; i < inputs.size() - 1; ++i) {
-      int input_dim_size = permuted_inputs[i]->shape(dim);
-      HT_ASSERT(output_dim_size == input_dim_size || output_dim_size == 1 ||
-                input_dim_size == 1)
-        << "input" << i << "cannot broadcast to outshape."
-        << "input" << i << "'s shape:" << inputs.at(0)->shape()
-        << "output shape:" << outputs.at(0)->shape();
-      if (input_dim_size != 1) {
-        output_dim_size = input_dim_size;
-        dim_last_op[dim] = i;
+  const auto& grad_output_labels = para.output_dims.at(0);
+  bool has_repeat = false;
+  std::unordered_set<std::string> seen;
+  for (const auto& label : grad_output_labels) {
+    if (label == "...") {
+      if (para.elli_pos + para.elli_len <= para.output_size) {
+        for (int k = 0; k < para.elli_len; ++k)
+          output_dims[para.elli_pos + k] = "..." + std::to_string(k);
       }
+    } else if (!seen.insert(label).second) {
+      has_repeat = true;
     }
-    if (output_dim_size == 0)
-      has_zero_size_dim = true;
   }
-
-  if (has_zero_size_dim) {
+  auto plan = EinsumPlanner::GetOrCreatePlan(ExpandInputDims(para, inputs, num_inputs),
+                                             output_dims, GetInputShapes(inputs, num_inputs));
+  NDArrayList operands(inputs.begin(), inputs.begin() + num_inputs);
+  if (para.undefined_labels.empty() && !has_repeat) {
+    EinsumPlanner::Execute(*plan, operands, op->instantiation_ctx().stream_index, outputs.at(0));
     return;
   }
 
-  // Sum out or squeeze dimensions that are size 1 for all later operands
-  NDArray output_tensor = NDArray::copy(permuted_inputs[0], op->instantiation_ctx().stream_index);
-  int dim = para.output_size;
-  for (int i = dim; i < para.num_output_labels; ++i, ++dim) {
-    if (dim_last_op[i] == 0) {
-      if (output_tensor->shape(dim) == 1) {
-        output_tensor = NDArray::squeeze(output_tensor, dim--);
-        // output_tensor.squeeze_(dim--);
-      } else {
-        output_tensor = NDArray::sum(output_tensor, {dim--}, {false}, op->instantiation_ctx().stream_index);
-      }
-    }
-  }
-
-  for (size_t i = 1; i < inputs.size() - 1; ++i) {
-    NDArray permuted_input = permuted_inputs[i];
-    HTShape sum_dims;
-
-    // Sum out or squeeze dimensions that are size 1 for all later operands
-    dim = para.output_size;
-    for (int j = dim; j < para.num_output_labels; ++j, ++dim) {
-      if (dim_last_op[j] < i) {
-        permuted_input = NDArray::squeeze(permuted_input, dim--);
-      } else if (dim_last_op[j] == i) {
-        if (output_tensor->shape(dim) == 1) {
-          permuted_input = NDArray::sum(permuted_input, {dim}, {false}, op->instantiation_ctx().stream_index);
-          output_tensor = NDArray::squeeze(output_tensor, dim--);
-        } else {
-          sum_dims.push_back(dim);
-        }
-      }
-    }
-    // Multiply tensors and sum out dimensions in sum_dims
-    if (sum_dims.empty()) {
-      output_tensor = NDArray::mul(output_tensor, permuted_input, op->instantiation_ctx().stream_index);
-    } else if (sum_dims.size() == output_tensor->ndim()) {
-      NDArray flatten_input = NDArray::flatten(permuted_input, 0, -1);
-      NDArray flatten_output = NDArray::flatten(output_tensor, 0, -1);
-      output_tensor =
-        NDArray::sum(NDArray::dot(flatten_input, flatten_output, op->instantiation_ctx().stream_index), {0}, {false}, op->instantiation_ctx().stream_index);
-    } else {
-      output_tensor =
-        sumproduct_pair(op, output_tensor, permuted_input, sum_dims, false);
-    }
-  }
+  NDArray output_tensor = NDArray::contiguous(
+    EinsumPlanner::Execute(*plan, operands, op->instantiation_ctx().stream_index),
+    op->instantiation_ctx().stream_index);
   LabelMap first_output_idx;
   int output_idx = 0;
-  for (const auto& label : para.output_dims.at(0)) {
+  for (const auto& label : grad_output_labels) {
     if (label == "...") {
       output_idx += para.elli_len;
     } else {
@@ -531,7 +216,7 @@ void EinsumGradientOpImpl::DoCompute(Operator& op,
       output_idx += 1;
     }
   }
-  outputs[0] = NDArray::reshape(output_tensor, op->output(0)->shape(), op->instantiation_ctx().stream_index);
+  NDArray::reshape(output_tensor, outputs.at(0)->shape(), op->instantiation_ctx().stream_index, outputs.at(0));
 }
 
 HTShapeList EinsumGradientOpImpl::DoInferShape(Operator& op,
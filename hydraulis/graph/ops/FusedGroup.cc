@@ -1,92 +1,106 @@
-// #include "hydraulis/graph/ops/FusedGroup.h"
-// #include "hydraulis/graph/headers.h"
-// #include "hydraulis/graph/ops/kernel_links.h"
+#include "hydraulis/graph/ops/FusedGroup.h"
+#include "hydraulis/graph/ops/Arithmetics.h"
+#include "hydraulis/graph/headers.h"
+#include "hydraulis/graph/ops/kernel_links.h"
 
-// namespace hydraulis {
-// namespace graph {
+namespace hydraulis {
+namespace graph {
 
+FusedType OpType2FusedType(const Operator& op) {
+  const auto& optype = op->type();
+  if (optype == "AddElewiseOp")
+    return FusedType::ADD;
+  else if (optype == "SubElewiseOp")
+    return FusedType::SUB;
+  else if (optype == "MulElewiseOp")
+    return FusedType::MUL;
+  else if (optype == "DivElewiseOp")
+    return FusedType::DIV;
+  else if (optype == "AddByConstOp")
+    return FusedType::ADDCONST;
+  else if (optype == "SubByConstOp")
+    return FusedType::SUBCONST;
+  else if (optype == "SubFromConstOp")
+    return FusedType::SUBFROMCONST;
+  else if (optype == "MulByConstOp")
+    return FusedType::MULCONST;
+  else if (optype == "DivByConstOp")
+    return FusedType::DIVCONST;
+  else if (optype == "DivFromConstOp")
+    return FusedType::DIVFROMCONST;
+  else if (optype == "NegateOp")
+    return FusedType::NEGATE;
+  else if (optype == "ReciprocalOp")
+    return FusedType::RECIPROCAL;
+  else if (optype == "ExpOp")
+    return FusedType::EXP;
+  else if (optype == "LogOp")
+    return FusedType::LOG;
+  else if (optype == "SqrtOp")
+    return FusedType::SQRT;
+  else if (optype == "ReciprocalSqrtOp")
+    return FusedType::RSQRT;
+  else if (optype == "AbsOp")
+    return FusedType::ABS;
+  else if (optype == "ReluOp")
+    return FusedType::RELU;
+  else if (optype == "SigmoidOp")
+    return FusedType::SIGMOID;
+  else if (optype == "TanhOp")
+    return FusedType::TANH;
+  else if (optype == "GeluOp")
+    return FusedType::GELU;
+  else if (optype == "SiluOp")
+    return FusedType::SILU;
+  else
+    return FusedType::UNKNOWN;
+}
 
-// FusedType OpType2FusedType(OpType optype){
-//   if (optype == "AddByConstOp")
-//     return FusedType::ADDCONST;
-//   else if (optype == "SubByConstOp")
-//     return FusedType::SUBCONST;
-//   else if (optype == "SubFromConstOp")
-//     return FusedType::SUBFROMCONST;
-//   else if (optype == "MulByConstOp")
-//     return FusedType::MULCONST;
-//   else if (optype == "DivByConstOp")
-//     return FusedType::DIVCONST;
-//   else if (optype == "DivFromConstOp")
-//     return FusedType::DIVFROMCONST;
-//   else if (optype == "PowOp")
-//     return FusedType::POW;
-//   else if (optype == "ExpOp")
-//     return FusedType::EXP;
-//   else if (optype == "LogOp")
-//     return FusedType::LOG;
-//   else if (optype == "AbsOp")
-//     return FusedType::ABS;
-//   else if (optype == "SqrtOp")
-//     return FusedType::SQRT;
-//   else if (optype == "Fused_Output")
-//     return FusedType::OUTPUT;
-//   else
-//     return FusedType::UNKNOWN;
-// }
+void FusedGroupOpImpl::DoCompute(Operator& op,
+                                 const NDArrayList& inputs, NDArrayList& outputs,
+                                 RuntimeContext& ctx) const {
+  HT_DISPATCH_KERNEL_CPU_ONLY(op->instantiation_ctx().placement.type(), type(),
+                              hydraulis::impl::FusedGroup, inputs, program(),
+                              outputs, op->instantiation_ctx().stream());
+}
 
-// void FusedGroupOpImpl::DoCompute(Operator& op,
-//                                  const NDArrayList& inputs, NDArrayList& outputs,
-//                                  RuntimeContext& ctx) const {
-//   // use subgraph to gen compute plan.
-//   SubGraph sub = subgraph();
-//   FusedGroupParam fusedgroup;
-//   fusedgroup.num_tensors = 0;
-//   fusedgroup.num_inputs = sub.num_inputs;
-//   fusedgroup.num_outputs = sub.num_outputs;
-//   fusedgroup.param_info = sub.param_info;
-//   for (int i = 0; i < sub.fetches.size(); ++i) {
-//     fusedgroup.num_input_output.emplace_back(sub.input_idx[i].size());
-//     for (int j = 0; j < sub.input_idx[i].size(); ++j) {
-//       fusedgroup.input_output_idx.emplace_back(sub.input_idx[i][j]);
-//     }
-//     fusedgroup.num_input_output.emplace_back(sub.output_idx[i].size());
-//     for (int j = 0; j < sub.output_idx[i].size(); ++j) {
-//       fusedgroup.input_output_idx.emplace_back(sub.output_idx[i][j]);
-//       if (sub.output_idx[i][j] + 1 > fusedgroup.num_tensors)
-//         fusedgroup.num_tensors = sub.output_idx[i][j] + 1;
-//     }
-//   }
-//   HT_DISPATCH_KERNEL_CUDA_ONLY(op->instantiation_ctx().placement.type(), type(),
-//                                hydraulis::impl::FusedGroup, inputs, fusedgroup,
-//                                outputs, op->instantiation_ctx().stream());
-// }
+HTShapeList FusedGroupOpImpl::DoInferShape(Operator& op,
+                                           const HTShapeList& input_shapes,
+                                           RuntimeContext& ctx) const {
+  HT_ASSERT(!input_shapes.empty())
+    << "FusedGroup should have at least one input";
+  HTShape output_shape = input_shapes.front();
+  for (size_t i = 1; i < input_shapes.size(); i++) {
+    output_shape = Broadcast(output_shape, input_shapes[i]);
+  }
+  return HTShapeList(op->num_outputs(), output_shape);
+}
 
-// HTShapeList FusedGroupOpImpl::DoInferShape(Operator& op,
-//                                            const HTShapeList& input_shapes,
-//                                            RuntimeContext& ctx) const { 
-//   HTShapeList output_shapes;
-//   for (auto& output: op->outputs()) {
-//     output_shapes.emplace_back(output->shape());
-//   }
-//   HT_LOG_INFO << "FUSEDSHAPE:" << output_shapes;
-//   return output_shapes;
-// }
+// 与elementwise算子相同，输出的ds拷贝自与输出shape相同的输入
+void FusedGroupOpImpl::DoDeduceStates(const TensorList& inputs, TensorList& outputs,
+                                      const OpMeta& op_meta) const {
+  for (auto& input : inputs) {
+    if (input->shape() == outputs.front()->shape()) {
+      const auto& input_ds = input->get_distributed_states();
+      HT_ASSERT(input_ds.is_valid())
+        << op_meta.name << ": input states must be valid! and "
+        << "input: " << input << ", input_ds: " << input_ds.ds_info();
+      for (auto& output : outputs) {
+        output->set_distributed_states(input_ds);
+      }
+      return;
+    }
+  }
+  HT_RUNTIME_ERROR << op_meta.name << ": cannot find an input with the same shape as the outputs";
+}
 
-// void FusedGroupOpImpl::DoDeduceStates(const TensorList& inputs, TensorList& outputs, 
-//                                       const OpMeta& op_meta) const {
-//   HT_ASSERT(outputs.size() == _subgraph.ds_list.size());
-//   for (int i = 0; i < outputs.size(); ++i) {
-//     outputs[i]->set_distributed_states(_subgraph.ds_list[i]);
-//   }
-// }
+TensorList MakeFusedGroupOp(TensorList inputs, FusedProgram program,
+                            std::vector<NDArrayMeta> output_metas, OpMeta op_meta) {
+  return Graph::MakeOp(
+          std::make_shared<FusedGroupOpImpl>(std::move(program), std::move(output_metas)),
+          std::move(inputs),
+          std::move(op_meta))->outputs();
+}
 
-// TensorList MakeFusedGroupOp(TensorList inputs, SubGraph subgraph, OpMeta op_meta) {
-//   return Graph::MakeOp(
-//           std::make_shared<FusedGroupOpImpl>(subgraph),
-//           std::move(inputs),
-//           std::move(op_meta))->outputs();
-// }
-
-// } // namespace graph
-// } // namespace hydraulis
+} // namespace graph
+} // namespace hydraulis
@@ -1,66 +1,73 @@
-// #pragma once
-
-// #include "hydraulis/graph/operator.h"
-// #include "hydraulis/graph/utils/tensor_utils.h"
-// #include "hydraulis/graph/graph.h"
-
-// namespace hydraulis {
-// namespace graph {
-
-// class FusedGroupOpImpl;
-// class FusedGroupOp;
-
-
-// FusedType OpType2FusedType(OpType optype);
-
-// class FusedGroupOpImpl final : public OpInterface {
-//  public:
-//   FusedGroupOpImpl(SubGraph subgraph, OpMeta op_meta = OpMeta())
-//   : OpInterface(quote(FusedGroupOp)), _subgraph(subgraph) {
-//   }
-
-//   inline uint64_t op_indicator() const noexcept override {
-//     return FUSED_GROUP_OP;
-//   }
-
-//   SubGraph subgraph() const {
-//     return _subgraph;
-//   }
-
-//  protected:
-//   std::vector<NDArrayMeta>
-//   DoInferMeta(const TensorList& inputs) const override {
-//     return _subgraph.meta_list;
-//   }
-
-//   void DoDeduceStates(const TensorList& inputs, TensorList& outputs, 
-//                       const OpMeta& op_meta) const override;
-
-//   HTShapeList DoInferShape(Operator& op, const HTShapeList& input_shapes,
-//                            RuntimeContext& runtime_ctx) const override;
-
-//   void DoCompute(Operator& op, const NDArrayList& inputs, NDArrayList& outputs,
-//                  RuntimeContext& runtime_ctx) const override;
-
-//   SubGraph _subgraph;
-
-
-//  public:
-//   inline bool require_contig_inputs() const override {
-//     return false;
-//   }
-
-//   bool operator==(const OpInterface& rhs) const override {
-//     if (OpInterface::operator==(rhs)) {
-//       const auto& rhs_ = reinterpret_cast<const FusedGroupOpImpl&>(rhs);
-//       return (subgraph().topo == rhs_.subgraph().topo &&
-//               subgraph().fetches == rhs_.subgraph().fetches);
-//     }
-//     return false;
-//   }
-// };
-
-// TensorList MakeFusedGroupOp(TensorList inputs, SubGraph subgraph, OpMeta op_meta = OpMeta());
-
-// } // namespace graph
-// } // namespace hydraulis
+#pragma once
+
+#include "hydraulis/graph/operator.h"
+#include "hydraulis/graph/utils/tensor_utils.h"
+#include "hydraulis/impl/utils/fused_utils.h"
+
+namespace hydraulis {
+namespace graph {
+
+class FusedGroupOpImpl;
+
+using hydraulis::impl::FusedType;
+using hydraulis::impl::FusedInstr;
+using hydraulis::impl::FusedProgram;
+
+// 返回elementwise算子对应的FusedType，不支持融合时返回UNKNOWN
+FusedType OpType2FusedType(const Operator& op);
+
+// 一串elementwise算子融合成的一个算子
+// 所有输出的shape相同，输入可以broadcast到输出的shape
+class FusedGroupOpImpl final : public OpInterface {
+ public:
+  FusedGroupOpImpl(FusedProgram program, std::vector<NDArrayMeta> output_metas)
+  : OpInterface(quote(FusedGroupOp)),
+    _program(std::move(program)),
+    _output_metas(std::move(output_metas)) {
+  }
+
+  inline uint64_t op_indicator() const noexcept override {
+    return FUSED_GROUP_OP;
+  }
+
+  const FusedProgram& program() const {
+    return _program;
+  }
+
+ protected:
+  std::vector<NDArrayMeta>
+  DoInferMeta(const TensorList& inputs) const override {
+    return _output_metas;
+  }
+
+  void DoDeduceStates(const TensorList& inputs, TensorList& outputs,
+                      const OpMeta& op_meta) const override;
+
+  HTShapeList DoInferShape(Operator& op, const HTShapeList& input_shapes,
+                           RuntimeContext& runtime_ctx) const override;
+
+  void DoCompute(Operator& op, const NDArrayList& inputs, NDArrayList& outputs,
+                 RuntimeContext& runtime_ctx) const override;
+
+  FusedProgram _program;
+  std::vector<NDArrayMeta> _output_metas;
+
+ public:
+  inline bool require_contig_inputs() const override {
+    return true;
+  }
+
+  bool operator==(const OpInterface& rhs) const override {
+    if (OpInterface::operator==(rhs)) {
+      const auto& rhs_ = reinterpret_cast<const FusedGroupOpImpl&>(rhs);
+      return program() == rhs_.program();
+    }
+    return false;
+  }
+};
+
+TensorList MakeFusedGroupOp(TensorList inputs, FusedProgram program,
+                            std::vector<NDArrayMeta> output_metas, OpMeta op_meta = OpMeta());
+
+} // namespace graph
+} // namespace hydraulis
@@ -2,6 +2,7 @@
 #include "hydraulis/graph/executable_graph.h"
 #include "hydraulis/graph/profiler.h"
 #include "hydraulis/graph/ops/kernel_links.h"
+#include "hydraulis/impl/profiler/trace.h"
 
 namespace hydraulis {
 namespace graph {
@@ -103,11 +104,11 @@ static std::tuple<int64_t, DeviceGroupList, std::vector<int64_t>> get_local_ring
   return std::make_tuple(ring_idx, tp_group_list, seq_len_list);
 }
 
-AttnCommRing::AttnCommRing(const Operator& op, const hydraulis::impl::comm::NCCLCommunicationGroup& nccl_comm_group, StreamIndex stream_idx, 
+AttnCommRing::AttnCommRing(const Operator& op, const hydraulis::impl::comm::CommunicationGroup& comm_group, StreamIndex stream_idx, 
                            int64_t ring_idx, const DeviceGroupList& tp_group_list, const std::vector<int64_t>& seq_len_list,
                            int64_t batch_size, int64_t q_num_heads, int64_t kv_num_heads, int64_t head_dim,
                            double softmax_scale, double p_dropout, size_t kv_storage_size)
-  : _nccl_comm_group(nccl_comm_group), _stream_idx(stream_idx), _ring_idx(ring_idx), _tp_group_list(tp_group_list), _seq_len_list(seq_len_list),
+  : _comm_group(comm_group), _stream_idx(stream_idx), _ring_idx(ring_idx), _tp_group_list(tp_group_list), _seq_len_list(seq_len_list),
     _batch_size(batch_size), _q_num_heads(q_num_heads), _kv_num_heads(kv_num_heads), _head_dim(head_dim),
     _softmax_scale(softmax_scale), _p_dropout(p_dropout), _kv_storage_size(kv_storage_size) {
   _ring_size = _tp_group_list.size();
@@ -120,14 +121,14 @@ AttnCommRing::AttnCommRing(const Operator& op, const hydraulis::impl::comm::NCCL
   if (dynamic_cast<ExecutableGraph&>(op->graph())._parallel_attn_flag > 0) {
     _need_profile = true;
     for (size_t i = 0; i < _ring_size; i++) {
-      _comm_profile_start_event_list.emplace_back(std::make_shared<hydraulis::impl::CUDAEvent>(_local_device));
-      _comm_profile_end_event_list.emplace_back(std::make_shared<hydraulis::impl::CUDAEvent>(_local_device));
-      _attn_profile_start_event_list.emplace_back(std::make_shared<hydraulis::impl::CUDAEvent>(_local_device));
-      _attn_profile_end_event_list.emplace_back(std::make_shared<hydraulis::impl::CUDAEvent>(_local_device));
-      _corr_profile_start_event_list.emplace_back(std::make_shared<hydraulis::impl::CUDAEvent>(_local_device));
-      _corr_profile_end_event_list.emplace_back(std::make_shared<hydraulis::impl::CUDAEvent>(_local_device));
-      _grad_profile_start_event_list.emplace_back(std::make_shared<hydraulis::impl::CUDAEvent>(_local_device));
-      _grad_profile_end_event_list.emplace_back(std::make_shared<hydraulis::impl::CUDAEvent>(_local_device));
+      _comm_profile_start_event_list.emplace_back(CreateEvent(_local_device));
+      _comm_profile_end_event_list.emplace_back(CreateEvent(_local_device));
+      _attn_profile_start_event_list.emplace_back(CreateEvent(_local_device));
+      _attn_profile_end_event_list.emplace_back(CreateEvent(_local_device));
+      _corr_profile_start_event_list.emplace_back(CreateEvent(_local_device));
+      _corr_profile_end_event_list.emplace_back(CreateEvent(_local_device));
+      _grad_profile_start_event_list.emplace_back(CreateEvent(_local_device));
+      _grad_profile_end_event_list.emplace_back(CreateEvent(_local_device));
     }
   }  
   auto env = std::getenv("HYDRAULIS_PARALLEL_ATTN_SPLIT_PATTERN");
@@ -549,7 +550,7 @@ void AttnCommRing::ExecComm(const NDArray& send_data, const NDArray& recv_data,
   HT_ASSERT(send_data.is_defined() && recv_data.is_defined())
     << "ExecComm inputs should be allocated in advance";
   // auto comp_stream = Stream(_local_device, _stream_idx);
-  // auto start_event = std::make_shared<hydraulis::impl::CUDAEvent>(_local_device);
+  // auto start_event = CreateEvent(_local_device);
   // start_event->Record(comp_stream);
   // ring-send-recv
   auto dst_split_num = dst_devices.size();
@@ -593,7 +594,7 @@ void AttnCommRing::ExecComm(const NDArray& send_data, const NDArray& recv_data,
       HT_ASSERT(send_data_slice->storage() == send_data->storage())
         << "contiguous + slice should be inplace";
     }
-    ring_send_recv_tasks.push_back(_nccl_comm_group->ISend(send_data_slice, hydraulis::impl::comm::DeviceToWorldRank(dst_devices[i])));
+    ring_send_recv_tasks.push_back(_comm_group->ISend(send_data_slice, hydraulis::impl::comm::DeviceToWorldRank(dst_devices[i])));
     send_data_begin_pos[num_heads_dim] += send_data_slice_shape[num_heads_dim];
   }
   NDArrayList recv_data_slices;
@@ -603,13 +604,13 @@ void AttnCommRing::ExecComm(const NDArray& send_data, const NDArray& recv_data,
       HT_ASSERT(recv_data_slice->storage() == recv_data->storage())
         << "contiguous + slice should be inplace";
     }
-    ring_send_recv_tasks.push_back(_nccl_comm_group->IRecv(recv_data_slice, hydraulis::impl::comm::DeviceToWorldRank(src_devices[i])));
+    ring_send_recv_tasks.push_back(_comm_group->IRecv(recv_data_slice, hydraulis::impl::comm::DeviceToWorldRank(src_devices[i])));
     recv_data_begin_pos[num_heads_dim] += recv_data_slice_shape[num_heads_dim];
     recv_data_slices.emplace_back(std::move(recv_data_slice));
   }
   // 实际的ring comm
-  _nccl_comm_group->BatchedISendIRecv(ring_send_recv_tasks);
-  // auto end_event = std::make_shared<hydraulis::impl::CUDAEvent>(_local_device);
+  _comm_group->BatchedISendIRecv(ring_send_recv_tasks);
+  // auto end_event = CreateEvent(_local_device);
   // end_event->Record(comp_stream);
   // comp_stream.Sync();
   // HT_LOG_INFO << "src_split_num = " << src_split_num << ", dst_split_num = " << dst_split_num  << ", BatchedISendIRecv Time Elapse: " << end_event->TimeSince(*start_event) * 1.0 / 1e6 << "ms";
@@ -677,11 +678,11 @@ void AttnCommRing::Run(bool is_bwd) {
   // 通信与计算overlap
   // 首先要让通信和计算的stream同步一下
   // 因为之前prepare storage时在计算stream上用到了一些contiguous操作
-  HT_ASSERT(_nccl_comm_group->stream().stream_index() != _stream_idx)
+  HT_ASSERT(_comm_group->stream().stream_index() != _stream_idx)
     << "comm stream and comp stream shouldn't be the same stream";
-  auto comm_stream = _nccl_comm_group->stream();
+  auto comm_stream = _comm_group->stream();
   auto comp_stream = Stream(_local_device, _stream_idx);
-  auto tmp_event = std::make_unique<hydraulis::impl::CUDAEvent>(_local_device);
+  auto tmp_event = CreateEvent(_local_device);
   tmp_event->Record(comp_stream);
   tmp_event->Block(comm_stream);
   int64_t q_idx = _ring_idx; 
@@ -838,6 +839,17 @@ void AttnCommRing::Profile(const Operator& op, size_t micro_batch_id, bool is_bw
       s += " -> " + std::to_string(interval) + "ms(interval)" + " -> ";
     }
   }
+  // 开启tracing时把整个ring的通信与attn时间作为counter写入trace
+  if (hydraulis::impl::Tracer::enabled()) {
+    double comm_ms = 0, attn_ms = 0;
+    for (size_t i = 0; i < _ring_size; i++) {
+      comm_ms += _comm_profile_end_event_list.at(i)->TimeSince(*_comm_profile_start_event_list.at(i)) * 1.0 / 1e6;
+      attn_ms += _attn_profile_end_event_list.at(i)->TimeSince(*_attn_profile_start_event_list.at(i)) * 1.0 / 1e6;
+    }
+    std::string prefix = op->name() + (is_bwd ? " bwd" : " fwd");
+    hydraulis::impl::Tracer::Counter("parallel_attn", prefix + " comm time (ms)", comm_ms);
+    hydraulis::impl::Tracer::Counter("parallel_attn", prefix + " attn time (ms)", attn_ms);
+  }
   s += "\nAttn Start Time - Comm Start Time: ";
   for (size_t i = 0; i < _ring_size; i++) {
     auto time_cost = _attn_profile_start_event_list.at(i)->TimeSince(*_comm_profile_start_event_list.at(i)) * 1.0 / 1e6;
@@ -996,10 +1008,10 @@ void ParallelAttentionOpImpl::DoCompute(Operator& op,
       << "currently not support Ring-Attn w/ Packing";
     auto used_ranks = dynamic_cast<ExecutableGraph&>(op->graph()).GetUsedRanks();
     auto local_device = hydraulis::impl::comm::GetLocalDevice();
-    auto& nccl_comm_group = hydraulis::impl::comm::NCCLCommunicationGroup::GetOrCreate(used_ranks, local_device);
+    auto comm_group = hydraulis::impl::comm::GetOrCreateCommGroup(used_ranks, local_device);
     // HT_LOG_DEBUG << "[ParallelAttn]: construct fwd comm ring for " << local_device;
     auto attn_comm_ring = AttnCommRing(op,
-                                       nccl_comm_group, 
+                                       comm_group, 
                                        stream_idx,
                                        ring_idx,
                                        tp_group_list, 
@@ -1198,9 +1210,9 @@ void ParallelAttentionGradientOpImpl::DoCompute(Operator& op, const NDArrayList&
     HT_ASSERT(!_packing)
       << "currently not support Ring-Attn w/ Packing";
     auto used_ranks = dynamic_cast<ExecutableGraph&>(op->graph()).GetUsedRanks();
-    auto& nccl_comm_group = hydraulis::impl::comm::NCCLCommunicationGroup::GetOrCreate(used_ranks, hydraulis::impl::comm::GetLocalDevice());
+    auto comm_group = hydraulis::impl::comm::GetOrCreateCommGroup(used_ranks, hydraulis::impl::comm::GetLocalDevice());
     auto attn_comm_ring = AttnCommRing(op,
-                                       nccl_comm_group, 
+                                       comm_group, 
                                        stream_idx,
                                        ring_idx,
                                        tp_group_list, 
@@ -62,9 +62,9 @@ class AttnStorage {
  public: 
   AttnStorage(const std::shared_ptr<NDArrayStorage>& storage)
   : _storage(storage) {
-    _comm_event = std::make_shared<hydraulis::impl::CUDAEvent>(storage->device());
-    _attn_event = std::make_shared<hydraulis::impl::CUDAEvent>(storage->device());
-    _grad_event = std::make_shared<hydraulis::impl::CUDAEvent>(storage->device());
+    _comm_event = CreateEvent(storage->device());
+    _attn_event = CreateEvent(storage->device());
+    _grad_event = CreateEvent(storage->device());
   }
 
   const std::shared_ptr<NDArrayStorage>& storage() const {
@@ -110,11 +110,11 @@ class AttnStorage {
  protected:
   std::shared_ptr<NDArrayStorage> _storage;
   bool _is_comm{false};
-  std::shared_ptr<hydraulis::impl::CUDAEvent> _comm_event;
+  std::shared_ptr<Event> _comm_event;
   bool _is_attn{false};
-  std::shared_ptr<hydraulis::impl::CUDAEvent> _attn_event;
+  std::shared_ptr<Event> _attn_event;
   bool _is_grad{false};
-  std::shared_ptr<hydraulis::impl::CUDAEvent> _grad_event;
+  std::shared_ptr<Event> _grad_event;
 };
 
 class AttnBlock {
@@ -341,7 +341,7 @@ class AttnCtx {
 // 因为每个micro batch的seq len与batch size都可能不一样
 class AttnCommRing {
  public:
-  AttnCommRing(const Operator& op, const hydraulis::impl::comm::NCCLCommunicationGroup& nccl_comm_group, StreamIndex stream_idx, 
+  AttnCommRing(const Operator& op, const hydraulis::impl::comm::CommunicationGroup& comm_group, StreamIndex stream_idx, 
                int64_t ring_idx, const DeviceGroupList& tp_group_list, const std::vector<int64_t>& seq_len_list,
                int64_t batch_size, int64_t q_num_heads, int64_t kv_num_heads, int64_t head_dim,
                double softmax_scale, double p_dropout, size_t kv_storage_size = 2);
@@ -379,7 +379,7 @@ class AttnCommRing {
   // basic settings
   Device _local_device;
   StreamIndex _stream_idx;
-  hydraulis::impl::comm::NCCLCommunicationGroup _nccl_comm_group;
+  hydraulis::impl::comm::CommunicationGroup _comm_group;
   int64_t _ring_idx;
   int64_t _ring_size;
   DeviceGroupList _tp_group_list;
@@ -410,7 +410,7 @@ class AttnCommRing {
 
   // profile settings
   bool _need_profile{false};
-  std::vector<std::shared_ptr<hydraulis::impl::CUDAEvent>> _comm_profile_start_event_list, _comm_profile_end_event_list, _attn_profile_start_event_list, _attn_profile_end_event_list, _corr_profile_start_event_list, _corr_profile_end_event_list, _grad_profile_start_event_list, _grad_profile_end_event_list;
+  std::vector<std::shared_ptr<Event>> _comm_profile_start_event_list, _comm_profile_end_event_list, _attn_profile_start_event_list, _attn_profile_end_event_list, _corr_profile_start_event_list, _corr_profile_end_event_list, _grad_profile_start_event_list, _grad_profile_end_event_list;
 };
 
 /****************************************************************
@@ -1,6 +1,7 @@
 #include "hydraulis/graph/ops/SoftmaxCrossEntropySparse.h"
 #include "hydraulis/graph/headers.h"
 #include "hydraulis/graph/ops/kernel_links.h"
+#include "hydraulis/graph/executable_graph.h"
 #include <numeric>
 
 namespace hydraulis {
@@ -12,6 +13,39 @@ using SCESGradOpImpl = SoftmaxCrossEntropySparseGradientOpImpl;
 void SCESOpImpl::DoCompute(Operator& op, 
                            const NDArrayList& inputs, NDArrayList& outputs,
                            RuntimeContext& ctx) const {
+  bool save_for_backward = op->requires_grad(0) && op->graph().type() == GraphType::EXECUTABLE
+                           && !dynamic_cast<ExecutableGraph&>(op->graph()).is_inference();
+  if (op->instantiation_ctx().placement.is_cpu() && save_for_backward) {
+    // 与VocabParallel的CPU实现相同：单遍扫描logits得到每行的(max, sum-exp, x[label])，
+    // 合并出loss与每行的lse，只为反向保存lse，反向由logits重新计算softmax
+    NDArray preds = NDArray::contiguous(inputs.at(0), op->instantiation_ctx().stream_index);
+    NDArray labels = NDArray::contiguous(inputs.at(1), op->instantiation_ctx().stream_index);
+    int64_t vocab = preds->shape(preds->ndim() - 1);
+    HTShape output_shape = HTShape(preds->shape().begin(), preds->shape().end() - 1);
+    NDArray logits = NDArray::view(preds, {preds->numel() / vocab, vocab});
+    NDArray stats = NDArray::empty({logits->shape(0), 3}, preds->device(), preds->dtype(),
+                                   op->instantiation_ctx().stream_index);
+    NDArray log_sum_exp = NDArray::empty(output_shape, preds->device(), preds->dtype(),
+                                         op->instantiation_ctx().stream_index);
+    NDArray unreduced = reduction() == kNONE
+      ? outputs.at(0)
+      : NDArray::empty(output_shape, preds->device(), preds->dtype(),
+                       op->instantiation_ctx().stream_index);
+    HT_DISPATCH_KERNEL_CPU_ONLY(op->instantiation_ctx().placement.type(), type(),
+                                hydraulis::impl::VocabParallelCrossEntropyStats, logits,
+                                labels, 0, vocab, ignored_index(), stats,
+                                op->instantiation_ctx().stream());
+    HT_DISPATCH_KERNEL_CPU_ONLY(op->instantiation_ctx().placement.type(), type(),
+                                hydraulis::impl::VocabParallelCrossEntropyCombine, stats,
+                                labels, ignored_index(), unreduced, log_sum_exp,
+                                op->instantiation_ctx().stream());
+    if (reduction() != kNONE)
+      NDArray::reduce(unreduced, reduction(), HTAxes(), false,
+                      op->instantiation_ctx().stream_index, outputs.at(0));
+    ctx.get_or_create(op->id()).put_ndarray("log_sum_exp", log_sum_exp);
+    NDArray::MarkUsedBy({preds, labels, stats, log_sum_exp}, op->instantiation_ctx().stream());
+    return;
+  }
   NDArray::sceloss(inputs.at(0), inputs.at(1), ignored_index(), reduction(),
                    op->instantiation_ctx().stream_index, outputs.at(0));
 }
@@ -64,13 +98,13 @@ void SCESOpImpl::DoDeduceHeterProp(const std::vector<int32_t>& inputs_hetero_dim
 void SCESGradOpImpl::DoCompute(Operator& op, 
                                const NDArrayList& inputs, NDArrayList& outputs,
                                RuntimeContext& ctx) const {
-    HTShape output_shape = HTShape(inputs.at(0)->shape().begin(), inputs.at(0)->shape().end() - 1);
-    NDArray broadcasted = reduction() == kNONE
-      ? inputs.at(2)
-      : NDArray::empty(output_shape, inputs.at(0)->device(),
-                       inputs.at(0)->dtype(),
-                       op->instantiation_ctx().stream_index);
-    if (reduction() == kMEAN) {
+  HTShape output_shape = HTShape(inputs.at(0)->shape().begin(), inputs.at(0)->shape().end() - 1);
+  NDArray broadcasted = reduction() == kNONE
+    ? inputs.at(2)
+    : NDArray::empty(output_shape, inputs.at(0)->device(),
+                     inputs.at(0)->dtype(),
+                     op->instantiation_ctx().stream_index);
+  if (reduction() == kMEAN) {
     HT_DISPATCH_KERNEL_CPU_AND_CUDA(
       op->instantiation_ctx().placement.type(), type(), hydraulis::impl::BroadcastShapeMul, inputs.at(2),
       1.0f / broadcasted->numel(), broadcasted, HTAxes(), op->instantiation_ctx().stream());
@@ -79,6 +113,30 @@ void SCESGradOpImpl::DoCompute(Operator& op,
                                     hydraulis::impl::BroadcastShape, inputs.at(2),
                                     broadcasted, HTAxes(), op->instantiation_ctx().stream());
   }
+  // 前向没有保存lse时（例如不在executable graph中执行）回退到单独的梯度kernel
+  if (op->instantiation_ctx().placement.is_cpu()
+      && ctx.get_or_create(op->fw_op_id()).contains_ndarray("log_sum_exp")) {
+    // 由logits与前向保存的每行lse重新计算softmax，(softmax - onehot) * grad_loss在同一遍扫描中写出
+    NDArray log_sum_exp = ctx.get_or_create(op->fw_op_id()).pop_ndarray("log_sum_exp");
+    NDArray preds = NDArray::contiguous(inputs.at(0), op->instantiation_ctx().stream_index);
+    NDArray labels = NDArray::contiguous(inputs.at(1), op->instantiation_ctx().stream_index);
+    NDArray grad_loss = NDArray::contiguous(broadcasted, op->instantiation_ctx().stream_index);
+    int64_t vocab = preds->shape(preds->ndim() - 1);
+    HTShape logits_shape = {preds->numel() / vocab, vocab};
+    NDArray output = outputs.at(0)->is_contiguous()
+      ? NDArray::view(outputs.at(0), logits_shape)
+      : NDArray::empty(logits_shape, preds->device(), preds->dtype(),
+                       op->instantiation_ctx().stream_index);
+    HT_DISPATCH_KERNEL_CPU_ONLY(op->instantiation_ctx().placement.type(), type(),
+                                hydraulis::impl::VocabParallelCrossEntropyLogitsGradient,
+                                NDArray::view(preds, logits_shape), log_sum_exp, labels, 0,
+                                ignored_index(), grad_loss, output, op->instantiation_ctx().stream());
+    if (!outputs.at(0)->is_contiguous())
+      NDArray::copy(NDArray::view(output, outputs.at(0)->shape()),
+                    op->instantiation_ctx().stream_index, outputs.at(0));
+    NDArray::MarkUsedBy({preds, labels, grad_loss, log_sum_exp, output}, op->instantiation_ctx().stream());
+    return;
+  }
   HT_DISPATCH_KERNEL_CPU_AND_CUDA(
     op->instantiation_ctx().placement.type(), type(), hydraulis::impl::SoftmaxCrossEntropySparseGradient,
     inputs.at(0), inputs.at(1), broadcasted, outputs.at(0), ignored_index(), op->instantiation_ctx().stream());
@@ -55,37 +55,6 @@ void VocabParallelCrossEntropyOpImpl::DoCompute(
   } else { 
     // tp vocab parallel loss
     DeviceGroup _comm_group = get_devices_by_dim(op->input(0), 1);
-    auto ranks = hydraulis::impl::comm::DeviceGroupToWorldRanks(_comm_group);
-    hydraulis::impl::comm::NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream()); // do allreduce 3 times  
-    // HT_LOG_INFO << hydraulis::impl::comm::GetLocalDevice() << ": VocabParallelCrossEntropyOp: comm_group: " << _comm_group;
-    // loss per token = - log(e^x / sum(e^x)) = log(sum(e^x) / e^x)=log(sum(e^x)) - x; where x = x_ori - x_max
-    // 1. x = x_ori - x_max
-    NDArray reduce_max_partial = NDArray::reduce(preds, kMAX, {-1}, true, op->instantiation_ctx().stream_index); // split1 -> partial, cuda malloc
-    NDArray reduce_max = reduce_max_partial;
-    HT_DISPATCH_KERNEL_CPU_AND_CUDA(op->instantiation_ctx().placement.type(), type(), // partial -> dup, inplace
-                                    hydraulis::impl::AllReduce, reduce_max_partial,
-                                    reduce_max, kMAX, _comm_group,
-                                    op->instantiation_ctx().stream());
-    NDArray vocab_parallel_logits = preds - reduce_max; // cuda malloc
-    NDArray::MarkUsedBy({preds, labels, reduce_max_partial, vocab_parallel_logits}, op->instantiation_ctx().stream());
-
-    // 2. log(sum(e^x))
-    NDArray exp_logits = NDArray::exp(vocab_parallel_logits, op->instantiation_ctx().stream_index); // cuda malloc
-    NDArray sum_exp_logits_partial = NDArray::reduce(exp_logits, kSUM, {-1}, true, op->instantiation_ctx().stream_index); // split1 -> partial, cuda malloc
-    NDArray sum_exp_logits = sum_exp_logits_partial;
-    HT_DISPATCH_KERNEL_CPU_AND_CUDA(op->instantiation_ctx().placement.type(), type(), // partial -> dup, inplace
-                                    hydraulis::impl::AllReduce, sum_exp_logits_partial,
-                                    sum_exp_logits, kSUM, _comm_group,
-                                    op->instantiation_ctx().stream());
-    // store softmax for backward compute
-    // NDArray softmax = exp_logits / sum_exp_logits;
-    NDArray softmax = NDArray::div(exp_logits, sum_exp_logits, op->instantiation_ctx().stream_index, exp_logits); // inplace
-    OpRuntimeContext& op_ctx = ctx.get_or_create(op->id());
-    op_ctx.put_ndarray("softmax", softmax);
-    NDArray log_sum_exp_logits = NDArray::log(sum_exp_logits, op->instantiation_ctx().stream_index, sum_exp_logits); // inplace
-    NDArray::MarkUsedBy({exp_logits, sum_exp_logits_partial, softmax}, op->instantiation_ctx().stream());
-
-    // 3. x[label]
     // Get the partition's vocab indecies, label should in range [vocab_start_index, vocab_end_index)]
     auto vocab_size_per_partition = preds->shape(1);
     auto local_device_index = op->output(0)->local_placement_group().get_index(op->placement());
@@ -93,20 +62,81 @@ void VocabParallelCrossEntropyOpImpl::DoCompute(
     auto vocab_start_index = vocab_size_per_partition * vocab_range_index;
     auto vocab_end_index = vocab_start_index + vocab_size_per_partition;
     HTShape predict_logits_shape = {preds->shape(0), 1};
-    NDArray predict_logits_partial = NDArray::empty(predict_logits_shape, preds->device(), preds->dtype()); // cuda malloc
-    HT_DISPATCH_KERNEL_CUDA_ONLY(op->instantiation_ctx().placement.type(), type(),
-                                hydraulis::impl::VocabParallelCrossEntropy, vocab_parallel_logits,
-                                labels, vocab_start_index, vocab_end_index, ignored_index(),
-                                predict_logits_partial, log_sum_exp_logits, op->instantiation_ctx().stream());
-    NDArray predict_logits = predict_logits_partial;
-    HT_DISPATCH_KERNEL_CPU_AND_CUDA(op->instantiation_ctx().placement.type(), type(), // partial -> dup, inplace
-                                    hydraulis::impl::AllReduce, predict_logits_partial,
-                                    predict_logits, kSUM, _comm_group,
-                                    op->instantiation_ctx().stream());
-    NDArray::MarkUsedBy({predict_logits_partial}, op->instantiation_ctx().stream());
+    OpRuntimeContext& op_ctx = ctx.get_or_create(op->id());
+    NDArray loss_unreduced;
+    if (op->instantiation_ctx().placement.is_cpu()) {
+      // CPU上每个rank单遍扫描本地logits得到每行的(max, sum-exp, x[label])，
+      // TP rank之间只AllGather这[batch_size * seq_len, 3]的统计量，再按rank顺序合并得到每行的lse与loss；
+      // 反向由logits与每行的lse重新计算softmax，不再生成和保存与logits同样大小的中间结果
+      HTShape stats_shape = {preds->shape(0), 3};
+      HTShape gathered_stats_shape = {preds->shape(0) * static_cast<int64_t>(_comm_group.num_devices()), 3};
+      NDArray stats = NDArray::empty(stats_shape, preds->device(), preds->dtype(),
+                                     op->instantiation_ctx().stream_index);
+      NDArray gathered_stats = NDArray::empty(gathered_stats_shape, preds->device(), preds->dtype(),
+                                              op->instantiation_ctx().stream_index);
+      NDArray log_sum_exp_logits = NDArray::empty(predict_logits_shape, preds->device(), preds->dtype(),
+                                                  op->instantiation_ctx().stream_index);
+      loss_unreduced = NDArray::empty(predict_logits_shape, preds->device(), preds->dtype(),
+                                      op->instantiation_ctx().stream_index);
+      HT_DISPATCH_KERNEL_CPU_ONLY(op->instantiation_ctx().placement.type(), type(),
+                                  hydraulis::impl::VocabParallelCrossEntropyStats, preds,
+                                  labels, vocab_start_index, vocab_end_index, ignored_index(),
+                                  stats, op->instantiation_ctx().stream());
+      HT_DISPATCH_KERNEL_CPU_ONLY(op->instantiation_ctx().placement.type(), type(),
+                                  hydraulis::impl::AllGather, stats, gathered_stats,
+                                  _comm_group, 0, op->instantiation_ctx().stream());
+      HT_DISPATCH_KERNEL_CPU_ONLY(op->instantiation_ctx().placement.type(), type(),
+                                  hydraulis::impl::VocabParallelCrossEntropyCombine, gathered_stats,
+                                  labels, ignored_index(), loss_unreduced, log_sum_exp_logits,
+                                  op->instantiation_ctx().stream());
+      op_ctx.put_ndarray("log_sum_exp", log_sum_exp_logits);
+      NDArray::MarkUsedBy({preds, labels, stats, gathered_stats, log_sum_exp_logits}, op->instantiation_ctx().stream());
+    } else {
+      auto ranks = hydraulis::impl::comm::DeviceGroupToWorldRanks(_comm_group);
+      hydraulis::impl::comm::NCCLCommunicationGroup::GetOrCreate(ranks, op->instantiation_ctx().stream()); // do allreduce 3 times  
+      // HT_LOG_INFO << hydraulis::impl::comm::GetLocalDevice() << ": VocabParallelCrossEntropyOp: comm_group: " << _comm_group;
+      // loss per token = - log(e^x / sum(e^x)) = log(sum(e^x) / e^x)=log(sum(e^x)) - x; where x = x_ori - x_max
+      // 1. x = x_ori - x_max
+      NDArray reduce_max_partial = NDArray::reduce(preds, kMAX, {-1}, true, op->instantiation_ctx().stream_index); // split1 -> partial, cuda malloc
+      NDArray reduce_max = reduce_max_partial;
+      HT_DISPATCH_KERNEL_CPU_AND_CUDA(op->instantiation_ctx().placement.type(), type(), // partial -> dup, inplace
+                                      hydraulis::impl::AllReduce, reduce_max_partial,
+                                      reduce_max, kMAX, _comm_group,
+                                      op->instantiation_ctx().stream());
+      NDArray vocab_parallel_logits = preds - reduce_max; // cuda malloc
+      NDArray::MarkUsedBy({preds, labels, reduce_max_partial, vocab_parallel_logits}, op->instantiation_ctx().stream());
 
-    // 4. log(sum(e^x)) - x[label], shape = [batch_size * seq_len, 1]
-    NDArray loss_unreduced = NDArray::sub(log_sum_exp_logits, predict_logits, op->instantiation_ctx().stream_index, log_sum_exp_logits); // inplace
+      // 2. log(sum(e^x))
+      NDArray exp_logits = NDArray::exp(vocab_parallel_logits, op->instantiation_ctx().stream_index); // cuda malloc
+      NDArray sum_exp_logits_partial = NDArray::reduce(exp_logits, kSUM, {-1}, true, op->instantiation_ctx().stream_index); // split1 -> partial, cuda malloc
+      NDArray sum_exp_logits = sum_exp_logits_partial;
+      HT_DISPATCH_KERNEL_CPU_AND_CUDA(op->instantiation_ctx().placement.type(), type(), // partial -> dup, inplace
+                                      hydraulis::impl::AllReduce, sum_exp_logits_partial,
+                                      sum_exp_logits, kSUM, _comm_group,
+                                      op->instantiation_ctx().stream());
+      // store softmax for backward compute
+      // NDArray softmax = exp_logits / sum_exp_logits;
+      NDArray softmax = NDArray::div(exp_logits, sum_exp_logits, op->instantiation_ctx().stream_index, exp_logits); // inplace
+      op_ctx.put_ndarray("softmax", softmax);
+      NDArray log_sum_exp_logits = NDArray::log(sum_exp_logits, op->instantiation_ctx().stream_index, sum_exp_logits); // inplace
+      NDArray::MarkUsedBy({exp_logits, sum_exp_logits_partial, softmax}, op->instantiation_ctx().stream());
+
+      // 3. x[label]
+      NDArray predict_logits_partial = NDArray::empty(predict_logits_shape, preds->device(), preds->dtype()); // cuda malloc
+      HT_DISPATCH_KERNEL_CUDA_ONLY(op->instantiation_ctx().placement.type(), type(),
+                                  hydraulis::impl::VocabParallelCrossEntropy, vocab_parallel_logits,
+                                  labels, vocab_start_index, vocab_end_index, ignored_index(),
+                                  predict_logits_partial, log_sum_exp_logits, op->instantiation_ctx().stream());
+      NDArray predict_logits = predict_logits_partial;
+      HT_DISPATCH_KERNEL_CPU_AND_CUDA(op->instantiation_ctx().placement.type(), type(), // partial -> dup, inplace
+                                      hydraulis::impl::AllReduce, predict_logits_partial,
+                                      predict_logits, kSUM, _comm_group,
+                                      op->instantiation_ctx().stream());
+      NDArray::MarkUsedBy({predict_logits_partial}, op->instantiation_ctx().stream());
+
+      // 4. log(sum(e^x)) - x[label], shape = [batch_size * seq_len, 1]
+      loss_unreduced = NDArray::sub(log_sum_exp_logits, predict_logits, op->instantiation_ctx().stream_index, log_sum_exp_logits); // inplace
+    }
     // if use ignored_index, please use reduce SUM, and divide the sum by unignored num extraly
     if (reduction() != kNONE) {
       NDArray::reduce(loss_unreduced, reduction(), HTAxes(), false, 
@@ -204,13 +234,23 @@ void VocabParallelCrossEntropyGradientOpImpl::DoCompute(
     auto vocab_range_index = op->input(0)->get_local_distributed_states().map_device_to_state_index(local_device_index)[1];
     auto vocab_start_index = vocab_size_per_partition * vocab_range_index;
     auto vocab_end_index = vocab_start_index + vocab_size_per_partition;
-    NDArray softmax = ctx.get_or_create(op->fw_op_id()).pop_ndarray("softmax");
+    if (op->instantiation_ctx().placement.is_cpu()) {
+      // 由logits与前向保存的每行lse重新计算softmax，梯度与softmax在同一遍扫描中写出
+      NDArray log_sum_exp = ctx.get_or_create(op->fw_op_id()).pop_ndarray("log_sum_exp");
+      HT_DISPATCH_KERNEL_CPU_ONLY(op->instantiation_ctx().placement.type(), type(),
+                                  hydraulis::impl::VocabParallelCrossEntropyLogitsGradient, preds,
+                                  log_sum_exp, labels, vocab_start_index, ignored_index(),
+                                  broadcasted, outputs.at(0), op->instantiation_ctx().stream());
+      NDArray::MarkUsedBy({preds, labels, grad_output, broadcasted, log_sum_exp}, op->instantiation_ctx().stream());
+    } else {
+      NDArray softmax = ctx.get_or_create(op->fw_op_id()).pop_ndarray("softmax");
 
-    HT_DISPATCH_KERNEL_CUDA_ONLY(op->instantiation_ctx().placement.type(), type(),
-                                hydraulis::impl::VocabParallelCrossEntropyGradient, softmax,
-                                labels, vocab_start_index, vocab_end_index, ignored_index(), 
-                                broadcasted, outputs.at(0), op->instantiation_ctx().stream());
-    NDArray::MarkUsedBy({preds, labels, grad_output, broadcasted, softmax}, op->instantiation_ctx().stream()); 
+      HT_DISPATCH_KERNEL_CUDA_ONLY(op->instantiation_ctx().placement.type(), type(),
+                                  hydraulis::impl::VocabParallelCrossEntropyGradient, softmax,
+                                  labels, vocab_start_index, vocab_end_index, ignored_index(), 
+                                  broadcasted, outputs.at(0), op->instantiation_ctx().stream());
+      NDArray::MarkUsedBy({preds, labels, grad_output, broadcasted, softmax}, op->instantiation_ctx().stream()); 
+    }
   }                              
 }
 
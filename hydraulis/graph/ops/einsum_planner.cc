@@ -0,0 +1,743 @@
+#include "hydraulis/graph/ops/einsum_planner.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <sstream>
+
+namespace hydraulis {
+namespace graph {
+
+std::mutex EinsumPlanner::_plan_cache_mutex;
+EinsumPlanner::PlanCacheList EinsumPlanner::_plan_lru;
+std::unordered_map<std::string, EinsumPlanner::PlanCacheList::iterator> EinsumPlanner::_plan_cache;
+
+namespace {
+
+inline bool contains(const std::vector<int>& labels, int label) {
+  return std::find(labels.begin(), labels.end(), label) != labels.end();
+}
+
+inline std::vector<int> concat(const std::vector<int>& a, const std::vector<int>& b,
+                               const std::vector<int>& c) {
+  std::vector<int> ret(a);
+  ret.insert(ret.end(), b.begin(), b.end());
+  ret.insert(ret.end(), c.begin(), c.end());
+  return ret;
+}
+
+inline bool same_labels(std::vector<int> a, std::vector<int> b) {
+  std::sort(a.begin(), a.end());
+  std::sort(b.begin(), b.end());
+  return a == b;
+}
+
+// 按照labels排列array的维度，不存在的label插入大小为1的维度，不拷贝
+NDArray LabelView(const NDArray& array, const std::vector<int>& labels,
+                  const std::vector<int>& order) {
+  HTShape shape;
+  HTStride stride;
+  for (auto label : order) {
+    auto it = std::find(labels.begin(), labels.end(), label);
+    if (it != labels.end()) {
+      shape.push_back(array->shape(it - labels.begin()));
+      stride.push_back(array->stride(it - labels.begin()));
+    } else {
+      shape.push_back(1);
+      stride.push_back(-1);
+    }
+  }
+  if (shape.empty()) {
+    shape.push_back(1);
+    stride.push_back(1);
+  }
+  for (size_t i = shape.size(); i-- > 0;) {
+    if (stride[i] == -1)
+      stride[i] = i + 1 < shape.size() ? shape[i + 1] * stride[i + 1] : 1;
+  }
+  auto meta = NDArrayMeta().set_dtype(array->dtype())
+                           .set_shape(shape)
+                           .set_stride(stride)
+                           .set_device(array->device());
+  return NDArray(meta, array->storage(), array->storage_offset());
+}
+
+// 忽略大小为1的维度后是否连续
+bool IsDense(const NDArray& array, const std::vector<int>& labels,
+             const std::vector<int>& order) {
+  int64_t expected = 1;
+  for (size_t i = order.size(); i-- > 0;) {
+    auto it = std::find(labels.begin(), labels.end(), order[i]);
+    if (it == labels.end())
+      continue;
+    auto dim = it - labels.begin();
+    if (array->shape(dim) == 1)
+      continue;
+    if (array->stride(dim) != expected)
+      return false;
+    expected *= array->shape(dim);
+  }
+  return true;
+}
+
+// 按照array中的stride从大到小排列labels，使得合并后的维度尽可能连续
+std::vector<int> SortByStride(const NDArray& array, const std::vector<int>& labels,
+                              std::vector<int> group) {
+  std::stable_sort(group.begin(), group.end(), [&](int a, int b) {
+    auto dim_a = std::find(labels.begin(), labels.end(), a) - labels.begin();
+    auto dim_b = std::find(labels.begin(), labels.end(), b) - labels.begin();
+    return array->stride(dim_a) > array->stride(dim_b);
+  });
+  return group;
+}
+
+int64_t GroupSize(const EinsumPlan& plan, const std::vector<int>& group) {
+  int64_t size = 1;
+  for (auto label : group)
+    size *= plan.label_sizes[label];
+  return size;
+}
+
+HTShape GroupShape(const EinsumPlan& plan, const std::vector<int>& group) {
+  HTShape shape;
+  for (auto label : group)
+    shape.push_back(plan.label_sizes[label]);
+  if (shape.empty())
+    shape.push_back(1);
+  return shape;
+}
+
+// GEMM的一个输入：逻辑上为[batch, outer, inner]
+// layout为[batch, outer, inner]或[batch, inner, outer]时直接使用view，否则拷贝
+struct GemmOperand {
+  NDArray array;
+  bool trans;
+};
+
+GemmOperand MakeGemmOperand(const EinsumPlan& plan, const NDArray& array,
+                            const std::vector<int>& labels, const std::vector<int>& batch,
+                            const std::vector<int>& outer, const std::vector<int>& inner,
+                            StreamIndex stream_id) {
+  int64_t b = GroupSize(plan, batch), o = GroupSize(plan, outer), i = GroupSize(plan, inner);
+  auto order = concat(batch, outer, inner);
+  if (IsDense(array, labels, order))
+    return {NDArray::view(LabelView(array, labels, order), {b, o, i}), false};
+  auto trans_order = concat(batch, inner, outer);
+  if (IsDense(array, labels, trans_order))
+    return {NDArray::view(LabelView(array, labels, trans_order), {b, i, o}), true};
+  auto copied = NDArray::contiguous(LabelView(array, labels, order), stream_id);
+  return {NDArray::view(copied, {b, o, i}), false};
+}
+
+int64_t GemmOperandCopyNumel(const EinsumPlan& plan, const NDArray& array,
+                             const std::vector<int>& labels, const std::vector<int>& batch,
+                             const std::vector<int>& outer, const std::vector<int>& inner) {
+  if (IsDense(array, labels, concat(batch, outer, inner)) ||
+      IsDense(array, labels, concat(batch, inner, outer)))
+    return 0;
+  return array->numel();
+}
+
+struct GemmConfig {
+  bool swap;
+  std::vector<int> batch, m, k, n;
+  bool direct;
+  int64_t copy_numel;
+};
+
+} // namespace
+
+std::ostream& operator<<(std::ostream& os, const EinsumPlan& plan) {
+  auto print_labels = [&](const std::vector<int>& labels) {
+    for (auto label : labels)
+      os << plan.label_names[label];
+  };
+  size_t num_operands = plan.operands.size();
+  os << "einsum plan (" << plan.flops << " flops): ";
+  for (size_t i = 0; i < plan.contractions.size(); i++) {
+    const auto& c = plan.contractions[i];
+    os << "[" << c.lhs << "," << c.rhs << "->" << num_operands + i << "] b=";
+    print_labels(c.batch);
+    os << " m=";
+    print_labels(c.lhs_only);
+    os << " n=";
+    print_labels(c.rhs_only);
+    os << " k=";
+    print_labels(c.contracted);
+    os << "; ";
+  }
+  return os;
+}
+
+std::vector<std::string> EinsumPlanner::ExpandEllipsis(const std::vector<std::string>& dims,
+                                                       size_t ndim, int elli_len) {
+  int num_labels = 0;
+  for (const auto& label : dims) {
+    if (label != "...")
+      num_labels++;
+  }
+  std::vector<std::string> ret;
+  for (const auto& label : dims) {
+    if (label == "...") {
+      int cur_elli_len = static_cast<int>(ndim) - num_labels;
+      HT_ASSERT(cur_elli_len >= 0 && cur_elli_len <= elli_len)
+        << "Invalid ellipsis of " << dims << " with " << ndim << " dims";
+      for (int k = elli_len - cur_elli_len; k < elli_len; k++)
+        ret.emplace_back("..." + std::to_string(k));
+    } else {
+      ret.emplace_back(label);
+    }
+  }
+  return ret;
+}
+
+std::shared_ptr<const EinsumPlan>
+EinsumPlanner::GetOrCreatePlan(const std::vector<std::vector<std::string>>& input_dims,
+                               const std::vector<std::string>& output_dims,
+                               const HTShapeList& input_shapes) {
+  std::ostringstream key_os;
+  for (size_t i = 0; i < input_dims.size(); i++) {
+    for (const auto& label : input_dims[i])
+      key_os << label << " ";
+    key_os << input_shapes[i] << ",";
+  }
+  key_os << "->";
+  for (const auto& label : output_dims)
+    key_os << label << " ";
+  auto key = key_os.str();
+  std::lock_guard<std::mutex> lock(_plan_cache_mutex);
+  auto it = _plan_cache.find(key);
+  if (it != _plan_cache.end()) {
+    _plan_lru.splice(_plan_lru.begin(), _plan_lru, it->second);
+    return it->second->second;
+  }
+  auto plan = std::make_shared<const EinsumPlan>(MakePlan(input_dims, output_dims, input_shapes));
+  HT_LOG_DEBUG << "[Einsum] " << key << ": " << *plan;
+  _plan_lru.emplace_front(key, plan);
+  _plan_cache.emplace(std::move(key), _plan_lru.begin());
+  // 被淘汰的plan仍可能被正在执行的op持有，由shared_ptr保证其有效
+  while (_plan_lru.size() > PlanCacheCapacity()) {
+    _plan_cache.erase(_plan_lru.back().first);
+    _plan_lru.pop_back();
+  }
+  return plan;
+}
+
+size_t EinsumPlanner::PlanCacheSize() {
+  std::lock_guard<std::mutex> lock(_plan_cache_mutex);
+  return _plan_lru.size();
+}
+
+size_t EinsumPlanner::PlanCacheCapacity() {
+  static const size_t capacity = []() -> size_t {
+    const char* env = std::getenv("HYDRAULIS_EINSUM_PLAN_CACHE_SIZE");
+    if (env == nullptr)
+      return 1024;
+    auto value = std::atol(env);
+    HT_VALUE_ERROR_IF(value <= 0)
+      << "HYDRAULIS_EINSUM_PLAN_CACHE_SIZE should be positive, got " << env;
+    return static_cast<size_t>(value);
+  }();
+  return capacity;
+}
+
+EinsumPlan EinsumPlanner::MakePlan(const std::vector<std::vector<std::string>>& input_dims,
+                                   const std::vector<std::string>& output_dims,
+                                   const HTShapeList& input_shapes) {
+  EinsumPlan plan;
+  std::unordered_map<std::string, int> label_ids;
+  auto get_label = [&](const std::string& name) {
+    auto it = label_ids.find(name);
+    if (it != label_ids.end())
+      return it->second;
+    int id = plan.label_names.size();
+    label_ids.emplace(name, id);
+    plan.label_names.push_back(name);
+    plan.label_sizes.push_back(1);
+    return id;
+  };
+
+  // 统计每个label的大小，大小为1的维度可以broadcast
+  size_t num_operands = input_dims.size();
+  std::vector<std::vector<int>> raw_labels(num_operands);
+  for (size_t i = 0; i < num_operands; i++) {
+    HT_ASSERT(input_dims[i].size() == input_shapes[i].size())
+      << "Einsum operand " << i << " has " << input_dims[i].size()
+      << " labels but shape " << input_shapes[i];
+    for (size_t d = 0; d < input_dims[i].size(); d++) {
+      int label = get_label(input_dims[i][d]);
+      raw_labels[i].push_back(label);
+      int64_t size = input_shapes[i][d];
+      auto& label_size = plan.label_sizes[label];
+      HT_ASSERT(size == label_size || size == 1 || label_size == 1)
+        << "Einsum label " << input_dims[i][d] << " has inconsistent sizes "
+        << label_size << " and " << size;
+      if (size != 1)
+        label_size = size;
+    }
+  }
+  for (const auto& name : output_dims)
+    plan.output_labels.push_back(get_label(name));
+
+  // 对角线与broadcast
+  plan.operands.resize(num_operands);
+  for (size_t i = 0; i < num_operands; i++) {
+    auto& operand = plan.operands[i];
+    std::vector<int> labels = raw_labels[i];
+    HTShape sizes = input_shapes[i];
+    bool has_repeat = true;
+    while (has_repeat) {
+      has_repeat = false;
+      for (size_t p = 0; p < labels.size() && !has_repeat; p++) {
+        for (size_t q = p + 1; q < labels.size(); q++) {
+          if (labels[p] == labels[q]) {
+            HT_ASSERT(sizes[p] == sizes[q])
+              << "Repeated einsum label " << plan.label_names[labels[p]]
+              << " should have the same size";
+            operand.diagonals.emplace_back(p, q);
+            labels.erase(labels.begin() + q);
+            sizes.erase(sizes.begin() + q);
+            has_repeat = true;
+            break;
+          }
+        }
+      }
+    }
+    for (size_t d = labels.size(); d-- > 0;) {
+      if (sizes[d] == 1 && plan.label_sizes[labels[d]] != 1) {
+        operand.squeeze_dims.push_back(d);
+        labels.erase(labels.begin() + d);
+      }
+    }
+    operand.labels = std::move(labels);
+  }
+
+  // 只出现在一个输入中且不在输出中的label直接求和
+  std::vector<int> label_count(plan.label_names.size(), 0);
+  for (const auto& operand : plan.operands) {
+    for (auto label : operand.labels)
+      label_count[label]++;
+  }
+  for (auto& operand : plan.operands) {
+    std::vector<int> kept;
+    for (size_t d = 0; d < operand.labels.size(); d++) {
+      int label = operand.labels[d];
+      if (label_count[label] == 1 && !contains(plan.output_labels, label))
+        operand.sum_dims.push_back(d);
+      else
+        kept.push_back(label);
+    }
+    operand.labels = std::move(kept);
+  }
+  for (auto size : plan.label_sizes) {
+    if (size == 0)
+      plan.has_zero_size = true;
+  }
+  PlanContractionOrder(plan);
+  return plan;
+}
+
+// 代价为每次contraction的FLOPs加上中间结果的大小
+// 不超过kMaxOptimalOperands个输入时对所有子集做DP，否则每次贪心地选择代价最小的一对
+void EinsumPlanner::PlanContractionOrder(EinsumPlan& plan) {
+  size_t n = plan.operands.size();
+  if (n <= 1)
+    return;
+  size_t num_labels = plan.label_names.size();
+  std::vector<bool> in_output(num_labels, false);
+  for (auto label : plan.output_labels)
+    in_output[label] = true;
+
+  auto labels_size = [&](const std::vector<int>& labels) {
+    double size = 1;
+    for (auto label : labels)
+      size *= plan.label_sizes[label];
+    return size;
+  };
+  auto union_size = [&](const std::vector<int>& a, const std::vector<int>& b) {
+    double size = labels_size(a);
+    for (auto label : b) {
+      if (!contains(a, label))
+        size *= plan.label_sizes[label];
+    }
+    return size;
+  };
+  auto make_contraction = [&](int lhs, int rhs, const std::vector<int>& lhs_labels,
+                              const std::vector<int>& rhs_labels, const std::vector<int>& keep) {
+    EinsumContraction c;
+    c.lhs = lhs;
+    c.rhs = rhs;
+    for (auto label : lhs_labels) {
+      if (!contains(rhs_labels, label))
+        c.lhs_only.push_back(label);
+      else if (contains(keep, label))
+        c.batch.push_back(label);
+      else
+        c.contracted.push_back(label);
+    }
+    for (auto label : rhs_labels) {
+      if (!contains(lhs_labels, label))
+        c.rhs_only.push_back(label);
+    }
+    plan.flops += 2 * union_size(lhs_labels, rhs_labels);
+    plan.contractions.emplace_back(std::move(c));
+    return static_cast<int>(n + plan.contractions.size() - 1);
+  };
+
+  if (n <= kMaxOptimalOperands) {
+    size_t num_masks = 1ul << n;
+    // 子集contraction之后仍需保留的label：在输出中或者在子集之外的输入中
+    std::vector<std::vector<int>> keep(num_masks);
+    std::vector<int> total(num_labels, 0);
+    for (const auto& operand : plan.operands) {
+      for (auto label : operand.labels)
+        total[label]++;
+    }
+    for (size_t mask = 1; mask < num_masks; mask++) {
+      std::vector<int> count(num_labels, 0);
+      for (size_t i = 0; i < n; i++) {
+        if (mask & (1ul << i)) {
+          for (auto label : plan.operands[i].labels)
+            count[label]++;
+        }
+      }
+      for (size_t label = 0; label < num_labels; label++) {
+        if (count[label] > 0 && (in_output[label] || count[label] < total[label]))
+          keep[mask].push_back(label);
+      }
+    }
+    std::vector<double> cost(num_masks, std::numeric_limits<double>::infinity());
+    std::vector<size_t> split(num_masks, 0);
+    std::vector<size_t> masks(num_masks - 1);
+    for (size_t mask = 1; mask < num_masks; mask++)
+      masks[mask - 1] = mask;
+    std::stable_sort(masks.begin(), masks.end(), [](size_t a, size_t b) {
+      return __builtin_popcountl(a) < __builtin_popcountl(b);
+    });
+    for (auto mask : masks) {
+      if (__builtin_popcountl(mask) == 1) {
+        cost[mask] = 0;
+        continue;
+      }
+      double result_size = labels_size(keep[mask]);
+      for (size_t a = (mask - 1) & mask; a > 0; a = (a - 1) & mask) {
+        size_t b = mask ^ a;
+        if (a < b)
+          continue;
+        double c = cost[a] + cost[b] + union_size(keep[a], keep[b]) + result_size;
+        if (c < cost[mask]) {
+          cost[mask] = c;
+          split[mask] = a;
+        }
+      }
+    }
+    std::function<int(size_t)> build = [&](size_t mask) -> int {
+      if (__builtin_popcountl(mask) == 1)
+        return __builtin_ctzl(mask);
+      size_t a = split[mask], b = mask ^ split[mask];
+      int lhs = build(a);
+      int rhs = build(b);
+      return make_contraction(lhs, rhs, keep[a], keep[b], keep[mask]);
+    };
+    build(num_masks - 1);
+    return;
+  }
+
+  std::vector<int> slots(n);
+  std::vector<std::vector<int>> slot_labels(n);
+  for (size_t i = 0; i < n; i++) {
+    slots[i] = i;
+    slot_labels[i] = plan.operands[i].labels;
+  }
+  while (slots.size() > 1) {
+    std::vector<int> count(num_labels, 0);
+    for (const auto& labels : slot_labels) {
+      for (auto label : labels)
+        count[label]++;
+    }
+    double best = std::numeric_limits<double>::infinity();
+    size_t best_i = 0, best_j = 1;
+    std::vector<int> best_keep;
+    for (size_t i = 0; i < slots.size(); i++) {
+      for (size_t j = i + 1; j < slots.size(); j++) {
+        std::vector<int> keep;
+        for (size_t label = 0; label < num_labels; label++) {
+          int cur = contains(slot_labels[i], label) + contains(slot_labels[j], label);
+          if (cur > 0 && (in_output[label] || count[label] > cur))
+            keep.push_back(label);
+        }
+        double c = union_size(slot_labels[i], slot_labels[j]) + labels_size(keep);
+        if (c < best) {
+          best = c;
+          best_i = i;
+          best_j = j;
+          best_keep = std::move(keep);
+        }
+      }
+    }
+    int slot = make_contraction(slots[best_i], slots[best_j], slot_labels[best_i],
+                                slot_labels[best_j], best_keep);
+    slots.erase(slots.begin() + best_j);
+    slot_labels.erase(slot_labels.begin() + best_j);
+    slots[best_i] = slot;
+    slot_labels[best_i] = std::move(best_keep);
+  }
+}
+
+NDArray EinsumPlanner::Execute(const EinsumPlan& plan, const NDArrayList& inputs,
+                               StreamIndex stream_id, NDArray& output) {
+  HT_ASSERT(inputs.size() == plan.operands.size())
+    << "Einsum plan expects " << plan.operands.size() << " inputs, got " << inputs.size();
+  bool write_output = output.is_defined();
+  if (write_output) {
+    HT_ASSERT(output->is_contiguous())
+      << "Output of einsum should be contiguous";
+    HT_ASSERT(static_cast<int64_t>(output->numel()) == GroupSize(plan, plan.output_labels))
+      << "Output of einsum has " << output->numel() << " elements, but the plan produces "
+      << GroupShape(plan, plan.output_labels);
+  }
+  if (plan.has_zero_size) {
+    if (write_output)
+      return NDArray::arrayset(output, 0, stream_id);
+    return NDArray::full(GroupShape(plan, plan.output_labels), 0, inputs.front()->device(),
+                         inputs.front()->dtype(), stream_id);
+  }
+
+  size_t num_slots = plan.operands.size() + plan.contractions.size();
+  NDArrayList arrays(num_slots);
+  std::vector<std::vector<int>> labels(num_slots);
+  for (size_t i = 0; i < plan.operands.size(); i++) {
+    const auto& operand = plan.operands[i];
+    NDArray x = inputs[i];
+    for (const auto& diagonal : operand.diagonals) {
+      x = NDArray::diagonal(x, diagonal.first, diagonal.second, 0, stream_id);
+      x = NDArray::movedim(x, -1, diagonal.first, stream_id);
+    }
+    for (auto dim : operand.squeeze_dims)
+      x = NDArray::squeeze(x, dim);
+    if (!operand.sum_dims.empty())
+      x = NDArray::sum(x, operand.sum_dims, false, stream_id);
+    arrays[i] = x;
+    labels[i] = operand.labels;
+  }
+
+  bool written = false;
+  for (size_t c = 0; c < plan.contractions.size(); c++) {
+    const auto& contraction = plan.contractions[c];
+    size_t slot = plan.operands.size() + c;
+    bool is_last = c + 1 == plan.contractions.size();
+    // 最后一次contraction的结果维度顺序与输出相同时直接写入output
+    bool can_write = is_last && write_output &&
+                     same_labels(concat(contraction.batch, contraction.lhs_only, contraction.rhs_only),
+                                 plan.output_labels);
+    std::vector<int> result_labels;
+
+    if (contraction.contracted.empty()) {
+      // 没有需要求和的维度，使用broadcast的乘法
+      auto order = can_write ? plan.output_labels
+                             : concat(contraction.batch, contraction.lhs_only, contraction.rhs_only);
+      auto lhs = LabelView(arrays[contraction.lhs], labels[contraction.lhs], order);
+      auto rhs = LabelView(arrays[contraction.rhs], labels[contraction.rhs], order);
+      if (can_write) {
+        auto out = NDArray::view(output, GroupShape(plan, order));
+        arrays[slot] = NDArray::mul(lhs, rhs, stream_id, out);
+        written = true;
+      } else {
+        arrays[slot] = NDArray::mul(lhs, rhs, stream_id);
+      }
+      labels[slot] = std::move(order);
+      continue;
+    }
+
+    // 枚举batch与contracted维度的顺序、是否交换左右，选择拷贝最少的GEMM
+    std::vector<GemmConfig> configs;
+    for (bool swap : {false, true}) {
+      int l = swap ? contraction.rhs : contraction.lhs;
+      int r = swap ? contraction.lhs : contraction.rhs;
+      const auto& m = swap ? contraction.rhs_only : contraction.lhs_only;
+      const auto& n = swap ? contraction.lhs_only : contraction.rhs_only;
+      auto m_order = SortByStride(arrays[l], labels[l], m);
+      auto n_order = SortByStride(arrays[r], labels[r], n);
+      std::vector<std::vector<int>> k_orders = {
+        SortByStride(arrays[l], labels[l], contraction.contracted),
+        SortByStride(arrays[r], labels[r], contraction.contracted)};
+      std::vector<std::vector<int>> batch_orders = {
+        SortByStride(arrays[l], labels[l], contraction.batch),
+        SortByStride(arrays[r], labels[r], contraction.batch)};
+      bool direct = false;
+      if (can_write) {
+        size_t nb = contraction.batch.size(), nm = m.size();
+        std::vector<int> out_b(plan.output_labels.begin(), plan.output_labels.begin() + nb);
+        std::vector<int> out_m(plan.output_labels.begin() + nb, plan.output_labels.begin() + nb + nm);
+        std::vector<int> out_n(plan.output_labels.begin() + nb + nm, plan.output_labels.end());
+        if (same_labels(out_b, contraction.batch) && same_labels(out_m, m) && same_labels(out_n, n)) {
+          direct = true;
+          batch_orders = {out_b};
+          m_order = out_m;
+          n_order = out_n;
+        }
+      }
+      for (const auto& batch_order : batch_orders) {
+        for (const auto& k_order : k_orders) {
+          int64_t copy_numel =
+            GemmOperandCopyNumel(plan, arrays[l], labels[l], batch_order, m_order, k_order) +
+            GemmOperandCopyNumel(plan, arrays[r], labels[r], batch_order, k_order, n_order);
+          if (write_output && is_last && !direct)
+            copy_numel += output->numel();
+          configs.push_back({swap, batch_order, m_order, k_order, n_order, direct, copy_numel});
+        }
+      }
+    }
+    const auto& config = *std::min_element(configs.begin(), configs.end(),
+      [](const GemmConfig& a, const GemmConfig& b) {
+        return a.copy_numel < b.copy_numel;
+      });
+    int l = config.swap ? contraction.rhs : contraction.lhs;
+    int r = config.swap ? contraction.lhs : contraction.rhs;
+    auto lhs = MakeGemmOperand(plan, arrays[l], labels[l], config.batch, config.m, config.k, stream_id);
+    auto rhs = MakeGemmOperand(plan, arrays[r], labels[r], config.batch, config.n, config.k, stream_id);
+    // rhs以[batch, n, k]的形式构造，因此其转置标记取反
+    result_labels = concat(config.batch, config.m, config.n);
+    if (config.direct) {
+      NDArray out = NDArray::view(output, {GroupSize(plan, config.batch),
+                                           GroupSize(plan, config.m),
+                                           GroupSize(plan, config.n)});
+      NDArray::bmm(lhs.array, rhs.array, lhs.trans, !rhs.trans, stream_id, out);
+      arrays[slot] = NDArray::view(output, GroupShape(plan, result_labels));
+      written = true;
+    } else {
+      auto out = NDArray::bmm(lhs.array, rhs.array, lhs.trans, !rhs.trans, stream_id);
+      arrays[slot] = NDArray::view(out, GroupShape(plan, result_labels));
+    }
+    labels[slot] = std::move(result_labels);
+  }
+
+  const auto& result = arrays.back();
+  const auto& result_labels = labels.back();
+  if (written)
+    return output;
+  auto result_view = LabelView(result, result_labels, plan.output_labels);
+  if (!write_output)
+    return result_view;
+  auto out = NDArray::view(output, result_view->shape());
+  NDArray::copy(result_view, stream_id, out);
+  return output;
+}
+
+namespace {
+
+// 将一个operand（如"ab..."）拆分为label，"..."作为一个label
+std::vector<std::string> SplitEinsumOperand(const std::string& operand) {
+  std::vector<std::string> dims;
+  for (size_t i = 0; i < operand.size(); i++) {
+    if (operand.compare(i, 3, "...") == 0) {
+      dims.emplace_back("...");
+      i += 2;
+    } else if (operand[i] != ' ') {
+      dims.emplace_back(1, operand[i]);
+    }
+  }
+  return dims;
+}
+
+} // namespace
+
+double CheckEinsumPlan(const std::string& equation, const HTShapeList& shapes) {
+  auto arrow = equation.find("->");
+  HT_VALUE_ERROR_IF(arrow == std::string::npos)
+    << "Einsum equation to check should have an explicit output: " << equation;
+  std::vector<std::vector<std::string>> raw_input_dims;
+  std::string lhs = equation.substr(0, arrow);
+  for (size_t begin = 0;;) {
+    auto end = lhs.find(',', begin);
+    raw_input_dims.push_back(SplitEinsumOperand(lhs.substr(begin, end - begin)));
+    if (end == std::string::npos)
+      break;
+    begin = end + 1;
+  }
+  HT_VALUE_ERROR_IF(raw_input_dims.size() != shapes.size())
+    << "Einsum equation " << equation << " has " << raw_input_dims.size()
+    << " operands, got " << shapes.size() << " shapes";
+  auto num_labels = [](const std::vector<std::string>& dims) {
+    return static_cast<int>(std::count_if(dims.begin(), dims.end(),
+                                          [](const std::string& d) { return d != "..."; }));
+  };
+  int elli_len = 0;
+  for (size_t i = 0; i < shapes.size(); i++)
+    elli_len = std::max(elli_len, static_cast<int>(shapes[i].size()) - num_labels(raw_input_dims[i]));
+  std::vector<std::vector<std::string>> input_dims;
+  for (size_t i = 0; i < shapes.size(); i++)
+    input_dims.push_back(EinsumPlanner::ExpandEllipsis(raw_input_dims[i], shapes[i].size(), elli_len));
+  auto raw_output_dims = SplitEinsumOperand(equation.substr(arrow + 2));
+  bool output_has_elli = std::find(raw_output_dims.begin(), raw_output_dims.end(), "...") != raw_output_dims.end();
+  auto output_dims = EinsumPlanner::ExpandEllipsis(
+    raw_output_dims, num_labels(raw_output_dims) + (output_has_elli ? elli_len : 0), elli_len);
+
+  NDArrayList inputs;
+  for (size_t i = 0; i < shapes.size(); i++)
+    inputs.push_back(NDArray::randn(shapes[i], Device(kCPU), kFloat32, 0, 1, 2024 + i, kBlockingStream));
+  auto plan = EinsumPlanner::GetOrCreatePlan(input_dims, output_dims, shapes);
+  auto result = NDArray::contiguous(EinsumPlanner::Execute(*plan, inputs, kBlockingStream), kBlockingStream);
+
+  // 参照：遍历所有label的取值，逐元素累加
+  std::vector<std::string> names;
+  HTShape sizes;
+  auto label_of = [&](const std::string& name) -> size_t {
+    auto it = std::find(names.begin(), names.end(), name);
+    if (it != names.end())
+      return it - names.begin();
+    names.push_back(name);
+    sizes.push_back(1);
+    return names.size() - 1;
+  };
+  std::vector<std::vector<size_t>> input_labels(shapes.size());
+  for (size_t i = 0; i < shapes.size(); i++) {
+    for (size_t d = 0; d < shapes[i].size(); d++) {
+      auto label = label_of(input_dims[i][d]);
+      input_labels[i].push_back(label);
+      sizes[label] = std::max(sizes[label], shapes[i][d]);
+    }
+  }
+  std::vector<size_t> output_labels;
+  for (const auto& name : output_dims)
+    output_labels.push_back(label_of(name));
+  int64_t num_points = 1, output_numel = 1;
+  for (auto size : sizes)
+    num_points *= size;
+  for (auto label : output_labels)
+    output_numel *= sizes[label];
+  HT_VALUE_ERROR_IF(num_points > (1 << 24))
+    << "Einsum " << equation << " is too large to check element by element";
+  HT_ASSERT(result->numel() == output_numel)
+    << "Einsum plan of " << equation << " produces " << result->shape()
+    << ", expected " << output_numel << " elements";
+  std::vector<double> expected(output_numel, 0);
+  std::vector<int64_t> index(sizes.size(), 0);
+  for (int64_t p = 0; p < num_points; p++) {
+    double value = 1;
+    for (size_t i = 0; i < shapes.size(); i++) {
+      int64_t offset = 0;
+      for (size_t d = 0; d < shapes[i].size(); d++)
+        offset = offset * shapes[i][d] + (shapes[i][d] == 1 ? 0 : index[input_labels[i][d]]);
+      value *= inputs[i]->data_ptr<float>()[offset];
+    }
+    int64_t out_offset = 0;
+    for (auto label : output_labels)
+      out_offset = out_offset * sizes[label] + index[label];
+    expected[out_offset] += value;
+    for (size_t l = sizes.size(); l-- > 0;) {
+      if (++index[l] < sizes[l])
+        break;
+      index[l] = 0;
+    }
+  }
+  double max_error = 0;
+  const float* out = result->data_ptr<float>();
+  for (int64_t k = 0; k < output_numel; k++)
+    max_error = std::max(max_error, std::abs(out[k] - expected[k]));
+  return max_error;
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "hydraulis/core/ndarray.h"
+#include "hydraulis/graph/common.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+// 单个输入在contraction之前的预处理（全部为view，除了sum）
+struct EinsumOperandPlan {
+  // 重复的label取对角线，每一项为(dim1, dim2)，取完后对角线移回dim1
+  std::vector<std::pair<int64_t, int64_t>> diagonals;
+  // broadcast的维度（该输入中为1，其余输入中大于1），从大到小排列
+  HTAxes squeeze_dims;
+  // 只出现在该输入中且不在输出中的维度，直接求和
+  HTAxes sum_dims;
+  // 预处理之后每一维对应的label
+  std::vector<int> labels;
+};
+
+// 两个中间结果的contraction，对应一次batched GEMM
+// lhs: [batch, lhs_only, contracted]，rhs: [batch, contracted, rhs_only]
+struct EinsumContraction {
+  int lhs;
+  int rhs;
+  std::vector<int> batch;
+  std::vector<int> lhs_only;
+  std::vector<int> rhs_only;
+  std::vector<int> contracted;
+};
+
+struct EinsumPlan {
+  std::vector<std::string> label_names;
+  HTShape label_sizes;
+  std::vector<EinsumOperandPlan> operands;
+  // 第i次contraction的结果存放在slot operands.size() + i
+  std::vector<EinsumContraction> contractions;
+  std::vector<int> output_labels;
+  bool has_zero_size{false};
+  double flops{0};
+};
+
+std::ostream& operator<<(std::ostream& os, const EinsumPlan& plan);
+
+// einsum的执行计划
+// 1、选择pairwise contraction的顺序（不超过kMaxOptimalOperands个输入时穷举，否则贪心），代价为FLOPs与中间结果的大小
+// 2、每次contraction转化为一次BatchMatMul，输入的layout允许时（通过转置）直接使用view而不拷贝
+// 计划按照(equation, shapes)缓存，正向与反向共用
+// 缓存为进程内所有einsum共享的LRU，动态shape下也不会无限增长
+class EinsumPlanner {
+ public:
+  // input_dims与output_dims中的"..."已经展开
+  static std::shared_ptr<const EinsumPlan> GetOrCreatePlan(const std::vector<std::vector<std::string>>& input_dims,
+                                                           const std::vector<std::string>& output_dims,
+                                                           const HTShapeList& input_shapes);
+
+  // 返回维度按照output_labels排列的结果（可能是view）
+  static NDArray Execute(const EinsumPlan& plan, const NDArrayList& inputs,
+                         StreamIndex stream_id) {
+    NDArray output;
+    return Execute(plan, inputs, stream_id, output);
+  }
+
+  // 结果写入output，最后一次GEMM的输出layout与output相同时直接写入而不拷贝
+  static NDArray Execute(const EinsumPlan& plan, const NDArrayList& inputs,
+                         StreamIndex stream_id, NDArray& output);
+
+  // 将einsum的一个operand（可能含"..."）展开为label列表，"..."右对齐
+  static std::vector<std::string> ExpandEllipsis(const std::vector<std::string>& dims,
+                                                 size_t ndim, int elli_len);
+
+  static size_t PlanCacheSize();
+
+  // HYDRAULIS_EINSUM_PLAN_CACHE_SIZE: 缓存的plan数目的上限，默认为1024
+  static size_t PlanCacheCapacity();
+
+ protected:
+  static EinsumPlan MakePlan(const std::vector<std::vector<std::string>>& input_dims,
+                             const std::vector<std::string>& output_dims,
+                             const HTShapeList& input_shapes);
+
+  static void PlanContractionOrder(EinsumPlan& plan);
+
+  static constexpr size_t kMaxOptimalOperands = 8;
+
+  using PlanCacheList = std::list<std::pair<std::string, std::shared_ptr<const EinsumPlan>>>;
+
+  static std::mutex _plan_cache_mutex;
+  // 最近使用的plan在最前面，超过上限时淘汰最后面的
+  static PlanCacheList _plan_lru;
+  static std::unordered_map<std::string, PlanCacheList::iterator> _plan_cache;
+};
+
+// 在CPU上用plan执行equation（需要显式给出"->"，可以包含"..."），与逐元素求和的参照比较，返回最大误差
+double CheckEinsumPlan(const std::string& equation, const HTShapeList& shapes);
+
+} // namespace graph
+} // namespace hydraulis
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "hydraulis/core/stream.h"
+#include "hydraulis/impl/utils/fused_utils.h"
 
 namespace hydraulis {
 namespace impl {
@@ -24,6 +25,8 @@ DECLARE_KERNEL_CPU_AND_CUDA(Abs, const NDArray&, NDArray&, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(AbsGradient, const NDArray&, const NDArray&, NDArray&, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(Adam, const NDArray&, NDArray&, NDArray&, NDArray&, NDArray&,
                             float, float, float, float, float, bool, const Stream&);
+DECLARE_KERNEL_CPU(AdamOffload, const NDArray&, NDArray&, NDArray&, NDArray&, NDArray&,
+                   int64_t, float, float, float, float, float, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(Arange, double, double, NDArray&, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(ArraySet, NDArray&, double, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(AddConst, const NDArray&, double, NDArray&,
@@ -178,6 +181,8 @@ DECLARE_KERNEL_CUDA(FlashAttnVarlenGradient, const NDArray&, const NDArray&, con
                     NDArray&, const int, const int, const float, const float, 
                     const bool, const bool, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(Floor, const NDArray&, NDArray&, const Stream&);
+DECLARE_KERNEL_CPU(FusedGroup, const NDArrayList&, const FusedProgram&, NDArrayList&,
+                   const Stream&);
 DECLARE_KERNEL_CUDA(FusedLayerNorm, const NDArray&, const NDArray&,
                     const NDArray&, NDArray&, NDArray&, NDArray&,
                     int64_t, float,
@@ -324,6 +329,8 @@ DECLARE_KERNEL_CPU_AND_CUDA(SoftmaxCrossEntropySparse, const NDArray&, const NDA
 DECLARE_KERNEL_CPU_AND_CUDA(SoftmaxCrossEntropySparseGradient, const NDArray&,
                             const NDArray&, const NDArray&, NDArray&, const int64_t,
                             const Stream&);
+DECLARE_KERNEL_CPU(SoftmaxCrossEntropySparseFused, const NDArray&, const NDArray&,
+                   NDArray&, NDArray&, const int64_t, double, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(Sqrt, const NDArray&, NDArray&, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(SubConst, const NDArray&, double, NDArray&,
                             const Stream&);
@@ -350,6 +357,14 @@ DECLARE_KERNEL_CUDA(VocabParallelCrossEntropy, const NDArray&, const NDArray&,
 DECLARE_KERNEL_CUDA(VocabParallelCrossEntropyGradient, const NDArray&, const NDArray&, 
                     const int64_t, const int64_t, const int64_t, const NDArray&, 
                     NDArray&, const Stream&);                    
+DECLARE_KERNEL_CPU(VocabParallelCrossEntropyStats, const NDArray&, const NDArray&,
+                   const int64_t, const int64_t, const int64_t, NDArray&,
+                   const Stream&);
+DECLARE_KERNEL_CPU(VocabParallelCrossEntropyCombine, const NDArray&, const NDArray&,
+                   const int64_t, NDArray&, NDArray&, const Stream&);
+DECLARE_KERNEL_CPU(VocabParallelCrossEntropyLogitsGradient, const NDArray&, const NDArray&,
+                   const NDArray&, const int64_t, const int64_t, const NDArray&,
+                   NDArray&, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(Where, const NDArray&, const NDArray&,
                             const NDArray&, NDArray&, const Stream&);
 DECLARE_KERNEL_CPU_AND_CUDA(NormalInits, NDArray&, double, double, uint64_t,
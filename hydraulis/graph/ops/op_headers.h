@@ -25,6 +25,7 @@
 #include "hydraulis/graph/ops/Exp.h"
 #include "hydraulis/graph/ops/EmbeddingLookup.h"
 #include "hydraulis/graph/ops/Floor.h"
+#include "hydraulis/graph/ops/FusedGroup.h"
 #include "hydraulis/graph/ops/Gather.h"
 #include "hydraulis/graph/ops/Gelu.h"
 #include "hydraulis/graph/ops/group.h"
@@ -4,6 +4,8 @@
 #include "hydraulis/impl/communication/nccl_comm_group.h"
 #include "hydraulis/impl/communication/comm_group.h"
 #include "hydraulis/graph/ops/kernel_links.h"
+#include "hydraulis/graph/executable_graph.h"
+#include "hydraulis/graph/offload/optimizer_cpu_offload.h"
 
 namespace hydraulis {
 namespace graph {
@@ -69,6 +71,17 @@ void AdamOpImpl::DoCompute(Operator& op, const NDArrayList& inputs,
   // 后续要支持param冗余
   HT_ASSERT(op->input(0)->cur_ds_union().check_equal(op->input(1)->cur_ds_union()))
     << "Currently only support equal ds union for param and grad";
+  // ZeRO-Offload: 交给host上的engine异步更新，param在本轮update结束前写回
+  // 混合精度时这里的param即为host上的master，写回的是device上的transfer param
+  if (op->graph().type() == GraphType::EXECUTABLE) {
+    auto* offload = dynamic_cast<ExecutableGraph&>(op->graph()).optimizer_offload();
+    if (offload != nullptr && offload->HasParam(op->input(0)->id())) {
+      offload->SubmitAdam(op->input(0)->id(), grad, param, mean, variance, step,
+                          {learning_rate(), beta1(), beta2(), eps(), weight_decay()},
+                          op->instantiation_ctx().stream());
+      return;
+    }
+  }
   // 这里直接更新即可
   // 如何得到符合ds的grad以及后续的transfer param则交给exec graph中的comm op来做
   HT_DISPATCH_KERNEL_CPU_AND_CUDA(op->instantiation_ctx().placement.type(),
@@ -10,8 +10,10 @@ NDArrayList VariableOpImpl::DoAllocOutputs(Operator& op,
   if (_init != nullptr) {
     Graph::AllocVariableData(op->output(0), *_init);
   } else {
+    // strided的数据（例如从numpy借用的view）需要拷贝成连续的
     if (_copy_provided_data || dtype() != _provided_data->dtype() ||
-        op->instantiation_ctx().placement != _provided_data->device()) {
+        op->instantiation_ctx().placement != _provided_data->device() ||
+        !_provided_data->is_contiguous()) {
       Graph::AllocVariableData(op->output(0),
                                ProvidedInitializer(_provided_data));
     } else {
@@ -48,7 +50,8 @@ NDArrayList ParallelVariableOpImpl::DoAllocOutputs(Operator& op,
     auto& provided_data = _multi_provided_data.empty() ? 
       _provided_data : _multi_provided_data[op->graph().OPTIMIZE_STRATEGY_ID]; 
     if (_copy_provided_data || dtype() != provided_data->dtype() ||
-        op->instantiation_ctx().placement != provided_data->device()) {
+        op->instantiation_ctx().placement != provided_data->device() ||
+        !provided_data->is_contiguous()) {
       HT_LOG_DEBUG << hydraulis::impl::comm::GetLocalDevice() << ": " << op << " inits by provided data.";
       Graph::AllocVariableData(op->output(0),
                                ProvidedInitializer(provided_data));
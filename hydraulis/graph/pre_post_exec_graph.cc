@@ -2,8 +2,12 @@
 #include "hydraulis/graph/switch_exec_graph.h"
 #include "hydraulis/graph/operator.h"
 #include "hydraulis/graph/subgraph.h"
+#include "hydraulis/graph/offload/activation_cpu_offload.h"
+#include "hydraulis/graph/offload/optimizer_cpu_offload.h"
+#include "hydraulis/graph/grad_bucket.h"
 #include "hydraulis/impl/communication/comm_group.h"
 #include "hydraulis/impl/communication/nccl_comm_group.h"
+#include <algorithm>
 
 namespace hydraulis {
 namespace graph {
@@ -41,6 +45,8 @@ void ExecutableGraph::ResetVariableDataInner(const Tensor& tensor,
     _add_on_inits[tensor->id()] = std::unique_ptr<Initializer>(init.copy());
   } else {
     init.Init(GetVariableDataInner(tensor));
+    if (_optimizer_offload != nullptr && _optimizer_offload->HasParam(tensor->id()))
+      _optimizer_offload->InvalidateMaster(tensor->id());
   }
 }
 
@@ -84,7 +90,19 @@ NDArray& ExecutableGraph::AllocVariableDataInner(const Tensor& tensor,
   bool is_param = (_parameter_ops.find(tensor->producer()->id()) != _parameter_ops.end());
   bool is_optvar = (_optimizer_variable_ops.find(tensor->producer()->id()) != _optimizer_variable_ops.end());
   // TODO: better compatibility with hot switch and quantization
-  if ((_use_origin_param_and_optimizer_buffer || _use_origin_param_and_optimizer_buckets) && (is_param || is_optvar)) {
+  // ZeRO-Offload: optimizer states是host bucket上的view
+  if (_optimizer_offload != nullptr && is_optvar) {
+    auto& host_buckets = _host_optimizer_buckets_map[tensor->dtype()];
+    HT_ASSERT(host_buckets->HasTensor(tensor))
+      << "Cannot find opt var " << tensor << " in the host optimizer buckets";
+    auto bucket = host_buckets->GetTensorBucket(tensor);
+    HT_ASSERT(bucket->IsAllocated())
+      << "must have alloced in PreRun, but found " << tensor << " not allocated";
+    _preserved_data[tensor->id()] = NDArray(NDArrayMeta(tensor->meta()).set_device(kCPU), 
+                                            bucket->AsStorage(), 
+                                            bucket->GetElementOffest(tensor));
+  }
+  else if ((_use_origin_param_and_optimizer_buffer || _use_origin_param_and_optimizer_buckets) && (is_param || is_optvar)) {
     if (_use_origin_param_and_optimizer_buckets) {
       HT_ASSERT(_origin_param_and_optimizer_buckets_map[tensor->dtype()]->HasTensor(tensor))
         << "Cannot find param " << tensor << " in the origin param and optimizer buckets";
@@ -92,7 +110,8 @@ NDArray& ExecutableGraph::AllocVariableDataInner(const Tensor& tensor,
       auto bucket = _origin_param_and_optimizer_buckets_map[tensor->dtype()]->GetTensorBucket(tensor);
       HT_ASSERT(bucket->IsAllocated())
         << "must have alloced in AllocRuntimeBuffer, but found " << tensor << " not allocated";
-      _preserved_data[tensor->id()] = NDArray(tensor->meta(), 
+      // ZeRO-Offload的host master在host上
+      _preserved_data[tensor->id()] = NDArray(NDArrayMeta(tensor->meta()).set_device(bucket->AsStorage()->device()), 
                                               bucket->AsStorage(), 
                                               bucket->GetElementOffest(tensor));
     }
@@ -163,6 +182,12 @@ void ExecutableGraph::RegisterVariableDataInner(const Tensor& tensor,
   }
 }
 
+// 分配的规则见offload_scheduler.h中的AssignOffloadHostSlots
+void ExecutableGraph::AssignOffloadHostSlots(const std::vector<std::pair<int32_t, size_t>>& tasks,
+                                             size_t num_micro_batches) {
+  _offload_host_slots = graph::AssignOffloadHostSlots(tasks, num_micro_batches);
+}
+
 void ExecutableGraph::PreRun(std::vector<RuntimeContext>& runtime_ctx_list) {
   // some run-only-once (unrelated to pp) op could alloc and compute in advance
   // 1、fragile non-param varaible (alloc and compute)
@@ -170,6 +195,30 @@ void ExecutableGraph::PreRun(std::vector<RuntimeContext>& runtime_ctx_list) {
   // 3、transfer param (alloc and compute)
   // 4、grad (just alloc)
   auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  // ZeRO-Offload时如果bucket中的param在device上只以低精度的transfer param参与计算
+  // （即bridge subgraph只是本地的cast），则fp32的origin param直接放在host上作为master，device上不再保留
+  std::unordered_map<OpId, std::shared_ptr<SubGraph>> bridge_subgraphs(_optimize_compute_bridge_subgraph_sorted.begin(),
+                                                                        _optimize_compute_bridge_subgraph_sorted.end());
+  auto is_host_master_bucket = [&](const std::shared_ptr<ParamBuffer>& bucket) -> bool {
+    if (_host_optimizer_buckets_map.empty())
+      return false;
+    for (const auto& param : bucket->tensor_list()) {
+      auto it = _transfer_map.find(param->id());
+      auto subgraph_it = bridge_subgraphs.find(param->producer()->id());
+      if (it == _transfer_map.end() || subgraph_it == bridge_subgraphs.end())
+        return false;
+      const auto& transfer_param = it->second;
+      if (transfer_param->placement() != local_device 
+          || transfer_param->dtype() == param->dtype()
+          || transfer_param->numel() != param->numel())
+        return false;
+      for (auto& op_ref : subgraph_it->second->ops_topo()) {
+        if (is_communication_op(op_ref.get()))
+          return false;
+      }
+    }
+    return true;
+  };
   // ---------- param ----------
   if (_run_level != RunLevel::COMPUTE_ONLY 
       && !_is_transfer_param_hot_switch 
@@ -179,6 +228,13 @@ void ExecutableGraph::PreRun(std::vector<RuntimeContext>& runtime_ctx_list) {
       const auto& buckets = it->second->buckets();
       for (const auto& bucket : buckets) {
         if (!bucket->IsEmpty() && !bucket->IsAllocated()) {
+          if (is_host_master_bucket(bucket)) {
+            // origin param即为ZeRO-Offload的host master
+            bucket->Bind(OptimizerCPUOffload::AllocHostStorage(local_device, bucket->size()));
+            HT_LOG_DEBUG << local_device << ": alloc host origin param bucket"
+              << ", the size is " << bucket->size();
+            continue;
+          }
           // alloc origin param and opt var
           bucket->Alloc(Stream(local_device, kBlockingStream));
           HT_LOG_DEBUG << local_device << ": alloc origin param and opt var bucket"
@@ -187,6 +243,43 @@ void ExecutableGraph::PreRun(std::vector<RuntimeContext>& runtime_ctx_list) {
       }
     }
   }
+  // ---------- ZeRO-Offload ----------
+  // optimizer states绑定到host上，并按照origin param的bucket顺序登记param
+  // origin param在host上的bucket以transfer param的低精度传输，并直接作为master
+  if (_run_level != RunLevel::COMPUTE_ONLY 
+      && !_host_optimizer_buckets_map.empty()
+      && _optimizer_offload == nullptr) {
+    for (auto it = _host_optimizer_buckets_map.begin();
+         it != _host_optimizer_buckets_map.end(); ++it) {
+      for (const auto& bucket : it->second->buckets()) {
+        if (!bucket->IsEmpty() && !bucket->IsAllocated()) {
+          bucket->Bind(OptimizerCPUOffload::AllocHostStorage(local_device, bucket->size()));
+          HT_LOG_DEBUG << local_device << ": alloc host opt var bucket"
+            << ", the size is " << bucket->size();
+        }
+      }
+    }
+    _optimizer_offload = std::make_shared<OptimizerCPUOffload>(local_device);
+    size_t bucket_id = 0;
+    for (int i = 0; i < static_cast<int>(DataType::NUM_DATA_TYPES); i++) {
+      auto it = _origin_param_and_optimizer_buckets_map.find(static_cast<DataType>(i));
+      if (it == _origin_param_and_optimizer_buckets_map.end())
+        continue;
+      for (const auto& bucket : it->second->buckets()) {
+        if (bucket->IsEmpty())
+          continue;
+        bool host_master = is_host_master_bucket(bucket);
+        for (const auto& param : bucket->tensor_list()) {
+          auto dtype = host_master ? _transfer_map[param->id()]->dtype() : param->dtype();
+          _optimizer_offload->AddParam(param->id(), bucket_id, param->numel(), dtype);
+        }
+        if (host_master)
+          _optimizer_offload->BindMaster(bucket_id, bucket->AsStorage());
+        bucket_id++;
+      }
+    }
+    _optimizer_offload->Alloc();
+  }
   for (auto it = _transfer_param_buffer_map.begin();
        it != _transfer_param_buffer_map.end(); ++it) {
     if (!it->second->IsEmpty() && !it->second->IsAllocated()) {
@@ -204,6 +297,7 @@ void ExecutableGraph::PreRun(std::vector<RuntimeContext>& runtime_ctx_list) {
     HT_ASSERT(it != _transfer_map.end())
       << "The transfer map does not consist of " << param_op->output(0) << " " << param_op->output(0)->dtype();
     auto& transfer_param = it->second;
+    NDArray transfer_param_data;
     // param是local的
     if (param_op->output(0)->placement() == local_device) {
       is_param_local = true;
@@ -213,7 +307,7 @@ void ExecutableGraph::PreRun(std::vector<RuntimeContext>& runtime_ctx_list) {
       is_transfer_param_local = true;
       HT_ASSERT(!_transfer_param_buffer_map[transfer_param->dtype()]->IsEmpty())
         << "The transfer param buffer of " << DataType2Str(transfer_param->dtype()) << " should not be empty";
-      auto transfer_param_data = NDArray(transfer_param->meta(),
+      transfer_param_data = NDArray(transfer_param->meta(),
                                           _transfer_param_buffer_map[transfer_param->dtype()]->AsStorage(), 
                                           _transfer_param_buffer_map[transfer_param->dtype()]->GetElementOffest(transfer_param));
       // 添加runtime allocation
@@ -230,9 +324,16 @@ void ExecutableGraph::PreRun(std::vector<RuntimeContext>& runtime_ctx_list) {
         _preserved_data[transfer_param->id()] = transfer_param_data;
       }
     }
+    // ZeRO-Offload的host master：transfer param由OptimizerCPUOffload写回，不需要执行subgraph
+    if (_run_level != RunLevel::COMPUTE_ONLY && _optimizer_offload != nullptr
+        && _optimizer_offload->HasHostMaster(param_op->output(0)->id())) {
+      // 分配并初始化host上的origin param
+      param_op->Compute({}, runtime_ctx_list[0]);
+      _optimizer_offload->BindDeviceParam(param_op->output(0)->id(), transfer_param_data);
+    }
     // 执行该subgraph
     // COMPUTE_ONLY模式或者热切换了transfer param后不需要再执行
-    if (_run_level != RunLevel::COMPUTE_ONLY && !_is_transfer_param_hot_switch) {
+    else if (_run_level != RunLevel::COMPUTE_ONLY && !_is_transfer_param_hot_switch) {
       Tensor2NDArrayMap tensor2data = {};
       // param是local的则先执行
       if (is_param_local) {
@@ -288,6 +389,10 @@ void ExecutableGraph::PreRun(std::vector<RuntimeContext>& runtime_ctx_list) {
       }
     }
   }
+  // host master初始化或被改写后写回device上的transfer param
+  if (_run_level != RunLevel::COMPUTE_ONLY && _optimizer_offload != nullptr) {
+    _optimizer_offload->WriteBackMasters();
+  }
   // 其余var直接正常compute
   for (const auto& op_ref : _execute_plan.local_placeholder_variable_ops) {
     auto& op = op_ref.get();
@@ -351,6 +456,79 @@ void ExecutableGraph::PreRun(std::vector<RuntimeContext>& runtime_ctx_list) {
         }
       }
     }
+    // grad bucketing时reduce后的grad直接放在current grad buffer中
+    if (_grad_bucket_reducer != nullptr) {
+      for (auto it = _current_grad_buffer_map.begin();
+           it != _current_grad_buffer_map.end(); ++it) {
+        if (_grad_bucket_reducer->OutputNumel(it->first) == 0) {
+          continue;
+        }
+        if (!it->second->IsAllocated()) {
+          it->second->Alloc(Stream(local_device, kBlockingStream));
+          HT_LOG_DEBUG << local_device << ": alloc current grad buffer for grad bucketing"
+            << ", the size is " << it->second->size();
+        }
+        if (!_grad_bucket_reducer->IsBound(it->first)) {
+          _grad_bucket_reducer->Bind(it->first, it->second->AsNDArray());
+        }
+      }
+    }
+  }
+  // ---------- activation offload ----------
+  // offload到host上的activation直接写入pinned host buffer中
+  // buffer按照AssignOffloadHostSlots的分配在micro batch之间复用，大小不够时才重新分配
+  if (!_offload_host_tensors.empty() && _run_level != RunLevel::ALLOC) {
+    HT_ASSERT(_offload_host_slots.size() == runtime_ctx_list.size())
+      << "offload host slots are not assigned for " << runtime_ctx_list.size() << " micro batches";
+    size_t num_slots = *std::max_element(_offload_host_slots.begin(), _offload_host_slots.end()) + 1;
+    if (_offload_host_buffers.size() < num_slots)
+      _offload_host_buffers.resize(num_slots);
+    std::vector<std::vector<HTShape>> shapes_list(runtime_ctx_list.size());
+    std::vector<std::vector<size_t>> offsets_list(runtime_ctx_list.size());
+    std::vector<size_t> slot_bytes(num_slots, 0);
+    for (size_t micro_batch_id = 0; micro_batch_id < runtime_ctx_list.size(); micro_batch_id++) {
+      auto& shape_plan = runtime_ctx_list[micro_batch_id].shape_plan();
+      auto& shapes = shapes_list[micro_batch_id];
+      shapes.reserve(_offload_host_tensors.size());
+      std::vector<size_t> tensor_bytes;
+      tensor_bytes.reserve(_offload_host_tensors.size());
+      for (const auto& offload_tensor : _offload_host_tensors) {
+        // offload tensor与其输入的shape相同
+        auto it = shape_plan.find(offload_tensor->producer()->input(0)->id());
+        HT_ASSERT(it != shape_plan.end())
+          << "can't find the shape of " << offload_tensor->producer()->input(0)
+          << " from the current shape plan";
+        shapes.push_back(it->second);
+        tensor_bytes.push_back(NumEl(it->second) * DataType2Size(offload_tensor->dtype()));
+      }
+      size_t host_bytes = 0;
+      offsets_list[micro_batch_id] = LayoutOffloadHostBuffer(tensor_bytes, _offload_host_alignment, &host_bytes);
+      auto& bytes = slot_bytes[_offload_host_slots[micro_batch_id]];
+      bytes = std::max(bytes, host_bytes);
+    }
+    for (size_t slot = 0; slot < num_slots; slot++) {
+      auto& host_buffer = _offload_host_buffers[slot];
+      if (host_buffer == nullptr || host_buffer->size() < slot_bytes[slot]) {
+        host_buffer = ActivationCPUOffload::AllocPinnedHostStorage(slot_bytes[slot]);
+        HT_LOG_DEBUG << local_device << ": alloc offload host buffer " << slot << " of " << num_slots
+          << ", the size is " << slot_bytes[slot];
+      }
+    }
+    for (size_t micro_batch_id = 0; micro_batch_id < runtime_ctx_list.size(); micro_batch_id++) {
+      auto& runtime_ctx = runtime_ctx_list[micro_batch_id];
+      const auto& shapes = shapes_list[micro_batch_id];
+      const auto& offsets = offsets_list[micro_batch_id];
+      const auto& host_buffer = _offload_host_buffers[_offload_host_slots[micro_batch_id]];
+      for (size_t i = 0; i < _offload_host_tensors.size(); i++) {
+        const auto& offload_tensor = _offload_host_tensors[i];
+        auto offload_data = NDArray(NDArrayMeta().set_shape(shapes[i])
+                                                 .set_dtype(offload_tensor->dtype())
+                                                 .set_device(Device(kCPU)),
+                                    host_buffer,
+                                    offsets[i] / DataType2Size(offload_tensor->dtype()));
+        runtime_ctx.add_runtime_allocation(offload_tensor->id(), offload_data);
+      }
+    }
   }
 }
 
@@ -360,17 +538,44 @@ void ExecutableGraph::PostRun(std::vector<RuntimeContext>& runtime_ctx_list, Ten
     << "RunLevel::COMPUTE_ONLY shouldn't call PostRun()";
   auto num_micro_batches = runtime_ctx_list.size();
   auto micro_batch_id = num_micro_batches - 1;
+  // 发起尚未发起的bucket（部分grad可能没有产生）
+  if (_grad_bucket_reducer != nullptr && _overlap_grad_reduce) {
+    RecordGradBuckets(_grad_bucket_reducer->Flush(), tensor2data, micro_batch_id);
+  }
+  _run_param_events.clear();
   for (const auto& [param_id, cur_subgraph] : _compute_optimize_bridge_subgraph_sorted) {
     // 执行该subgraph
     // HT_LOG_INFO << cur_subgraph->global_name() << " run begin";
     cur_subgraph->run(tensor2data, _preserved_data, runtime_ctx_list[micro_batch_id], micro_batch_id, SubGraphOpType::UPDATE, true,
                       [this](Operator& op, Tensor2NDArrayMap& tensor2data, size_t micro_batch_id) { return PostOpHandler(op, tensor2data, micro_batch_id); });
     // HT_LOG_INFO << cur_subgraph->global_name() << " run end";
+    if (_record_run_param_events) {
+      RecordRunParamEvents(*cur_subgraph);
+    }
   }
   _terminate_subgraph->run(tensor2data, _preserved_data, runtime_ctx_list[micro_batch_id], micro_batch_id, SubGraphOpType::UPDATE, true,
                            [this](Operator& op, Tensor2NDArrayMap& tensor2data, size_t micro_batch_id) { return PostOpHandler(op, tensor2data, micro_batch_id); });
 }
 
+void ExecutableGraph::RecordRunParamEvents(const SubGraph& subgraph) {
+  auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  for (const auto& op_ref : subgraph.update_ops_topo()) {
+    auto& op = op_ref.get();
+    if (!is_optimizer_update_op(op) || op->placement() != local_device) {
+      continue;
+    }
+    // param以及optimizer states（例如Adam的mean和variance）都是update算子的variable输入
+    for (const auto& input : op->inputs()) {
+      if (!is_variable_op(input->producer())) {
+        continue;
+      }
+      auto event = CreateEvent(op->placement());
+      event->Record(op->instantiation_ctx().stream());
+      _run_param_events[input->id()] = std::move(event);
+    }
+  }
+}
+
 OpHandlerStatus ExecutableGraph::PostOpHandler(Operator& op, Tensor2NDArrayMap& tensor2data, size_t micro_batch_id) {
   // HT_LOG_INFO << "PostOpHandler for " << op << " begin to run";
   OpHandlerStatus status;
@@ -8,6 +8,9 @@
 #include <ctime>
 #include <iostream>
 #include <fstream>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
 
 namespace hydraulis {
 namespace graph {
@@ -22,7 +25,9 @@ DECLARE_HT_EXCEPTION(nvml_error);
     << "NVML call " << #f << " failed: " << nvmlErrorString(result)
 
 static std::once_flag nvml_init_flag;
+static std::mutex memory_profilers_mutex;
 static std::unordered_map<Device, std::shared_ptr<CUDAProfiler>> cuda_memory_profilers;
+static std::unordered_map<Device, std::shared_ptr<CPUProfiler>> cpu_memory_profilers;
 
 static void NVML_Init_Once() {
   std::call_once(nvml_init_flag, []() {
@@ -36,11 +41,12 @@ static void NVML_Init_Once() {
   });
 }
 
-std::ostream& operator<<(std::ostream& os, const CUDAMemoryInfo& memory_info) {
+std::ostream& operator<<(std::ostream& os, const MemoryInfo& memory_info) {
   os << "{";
   os << "\"mempool reserved\": " << memory_info.mempool_reserved
-    << "\"mempool peak reserved\": " << memory_info.mempool_peak_reserved
+    << ", \"mempool peak reserved\": " << memory_info.mempool_peak_reserved
     << ", \"mempool allocated\": " << memory_info.mempool_allocated
+    << ", \"mempool peak allocated\": " << memory_info.mempool_peak_allocated
     << ", \"all reserved\": " << memory_info.all_reserved
     << ", \"limit\": " << memory_info.limit;
   os << "}";
@@ -59,6 +65,9 @@ std::ostream& operator<<(std::ostream& os, const MicroBatchMemoryInfo& micro_bat
 }
 
 std::shared_ptr<CUDAProfiler> GetCUDAProfiler(const Device& device) {
+  HT_ASSERT(device.is_cuda())
+    << "Cannot get cuda profiler for " << device;
+  std::lock_guard<std::mutex> lock(memory_profilers_mutex);
   auto it = cuda_memory_profilers.find(device);
   if (it == cuda_memory_profilers.end()) {
     auto insertion = cuda_memory_profilers.emplace(device, std::make_shared<CUDAProfiler>(device));
@@ -69,7 +78,140 @@ std::shared_ptr<CUDAProfiler> GetCUDAProfiler(const Device& device) {
   return it->second;
 }
 
-CUDAMemoryInfo CUDAProfiler::GetCurrMemoryInfo() {
+std::shared_ptr<MemoryProfiler> GetMemoryProfiler(const Device& device) {
+  if (device.is_cuda())
+    return GetCUDAProfiler(device);
+  HT_ASSERT(device.is_cpu())
+    << "Memory profiler is not supported for " << device;
+  std::lock_guard<std::mutex> lock(memory_profilers_mutex);
+  auto it = cpu_memory_profilers.find(device);
+  if (it == cpu_memory_profilers.end()) {
+    auto insertion = cpu_memory_profilers.emplace(device, std::make_shared<CPUProfiler>(device));
+    HT_ASSERT(insertion.second)
+      << "Failed to insert the cpu memory profiler for " << device;
+    it = insertion.first;
+  }
+  return it->second;
+}
+
+MemoryInfo MemoryProfiler::GetCurrMemoryInfo() {
+  auto memory_info = MemoryInfo();
+  memory_info.mempool_allocated = _mempool->GetCurrAllocated() / (1024 * 1024);
+  memory_info.mempool_reserved = _mempool->GetCurrReserved() / (1024 * 1024);
+  memory_info.mempool_peak_allocated = _mempool->GetPeakAllocated() / (1024 * 1024);
+  memory_info.mempool_peak_reserved = _mempool->GetPeakReserved() / (1024 * 1024);
+  return memory_info;
+}
+
+void MemoryProfiler::PrintCurrMemoryInfo(const std::string& prefix) {
+  
+  auto memory_info = GetCurrMemoryInfo();
+  HT_LOG_INFO << "[" << prefix << "] " << _device << ": "
+    << "all reserved memory (" << (_device.is_cuda() ? "nvidia-smi" : "rss") << ") = " << memory_info.all_reserved << " MiB"
+    << ", mempool reserved memory = " << memory_info.mempool_reserved << " MiB"
+    << ", mempool peak reserved memory = " << memory_info.mempool_peak_reserved << " MiB"
+    << ", mempool allocated memory = " << memory_info.mempool_allocated << " MiB"
+    << ", mempool peak allocated memory = " << memory_info.mempool_peak_allocated << " MiB";
+}
+
+void MemoryProfiler::ClearOpRecords() {
+  _op_records.clear();
+}
+
+void MemoryProfiler::RecordOp(const Operator& op, size_t micro_batch_id, size_t allocated_before,
+                              const NDArrayList& inputs, const NDArrayList& outputs) {
+  OpMemoryRecord record;
+  record.op_name = op->name();
+  record.op_type = op->type();
+  record.micro_batch_id = micro_batch_id;
+  record.allocated = _mempool->GetCurrAllocated();
+  record.reserved = _mempool->GetCurrReserved();
+  record.allocated_delta = static_cast<int64_t>(record.allocated) - static_cast<int64_t>(allocated_before);
+  record.new_malloc_bytes = 0;
+  // 与checkOutputsMemory一致：inplace的输出以及从已有的空间中切分出来的输出不计入
+  for (size_t i = 0; i < outputs.size() && i < op->num_outputs(); i++) {
+    const auto& output = outputs[i];
+    if (!output.is_defined() || output->storage() == nullptr || !output->storage()->is_new_malloc())
+      continue;
+    bool is_inplace = std::any_of(inputs.begin(), inputs.end(), [&](const NDArray& input) {
+      return input.is_defined() && input->storage() == output->storage();
+    });
+    if (is_inplace)
+      continue;
+    auto num_bytes = output->storage()->size();
+    record.new_malloc_bytes += num_bytes;
+    record.new_malloc_outputs.emplace_back(op->output(i)->name(), num_bytes);
+  }
+  _op_records.emplace_back(std::move(record));
+}
+
+void MemoryProfiler::DumpOpRecords(std::ostream& os, size_t top_k) const {
+  auto to_mib = [](double bytes) {
+    return bytes / (1024 * 1024);
+  };
+  size_t peak_idx = 0;
+  for (size_t i = 0; i < _op_records.size(); i++) {
+    if (_op_records[i].allocated > _op_records[peak_idx].allocated)
+      peak_idx = i;
+  }
+  // 按op（跨micro batch累加）统计新申请的空间
+  std::map<std::string, std::pair<size_t, int64_t>> per_op;
+  for (const auto& record : _op_records) {
+    auto& entry = per_op[record.op_name];
+    entry.first += record.new_malloc_bytes;
+    entry.second += record.allocated_delta;
+  }
+  std::vector<std::pair<std::string, std::pair<size_t, int64_t>>> sorted(per_op.begin(), per_op.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto& x, const auto& y) {
+    return x.second.first > y.second.first;
+  });
+  os << "{" << std::endl;
+  os << "\"device\": \"" << _device << "\"," << std::endl;
+  if (!_op_records.empty()) {
+    const auto& peak = _op_records[peak_idx];
+    os << "\"peak\": {\"op\": \"" << peak.op_name << "\", \"micro batch id\": " << peak.micro_batch_id
+      << ", \"allocated\": " << to_mib(peak.allocated) << ", \"reserved\": " << to_mib(peak.reserved) << "}," << std::endl;
+  }
+  os << "\"top ops\": [";
+  for (size_t i = 0; i < std::min(top_k, sorted.size()); i++) {
+    os << (i == 0 ? "" : ",") << std::endl << "  {\"op\": \"" << sorted[i].first
+      << "\", \"new malloc\": " << to_mib(sorted[i].second.first)
+      << ", \"allocated delta\": " << to_mib(sorted[i].second.second) << "}";
+  }
+  os << std::endl << "]," << std::endl;
+  os << "\"timeline\": [";
+  for (size_t i = 0; i < _op_records.size(); i++) {
+    const auto& record = _op_records[i];
+    os << (i == 0 ? "" : ",") << std::endl << "  {\"op\": \"" << record.op_name
+      << "\", \"type\": \"" << record.op_type
+      << "\", \"micro batch id\": " << record.micro_batch_id
+      << ", \"allocated\": " << to_mib(record.allocated)
+      << ", \"reserved\": " << to_mib(record.reserved)
+      << ", \"allocated delta\": " << to_mib(record.allocated_delta)
+      << ", \"new malloc\": [";
+    for (size_t j = 0; j < record.new_malloc_outputs.size(); j++) {
+      os << (j == 0 ? "" : ", ") << "{\"tensor\": \"" << record.new_malloc_outputs[j].first
+        << "\", \"size\": " << to_mib(record.new_malloc_outputs[j].second) << "}";
+    }
+    os << "]}";
+  }
+  os << std::endl << "]" << std::endl;
+  os << "}";
+}
+
+MemoryInfo CPUProfiler::GetCurrMemoryInfo() {
+  auto memory_info = MemoryProfiler::GetCurrMemoryInfo();
+  auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  memory_info.limit = static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * page_size / (1024 * 1024);
+  // /proc/self/statm的第二项为resident set size（单位为page）
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0, resident_pages = 0;
+  if (statm >> total_pages >> resident_pages)
+    memory_info.all_reserved = resident_pages * page_size / (1024 * 1024);
+  return memory_info;
+}
+
+MemoryInfo CUDAProfiler::GetCurrMemoryInfo() {
 
   NVML_Init_Once();
 
@@ -79,25 +221,12 @@ CUDAMemoryInfo CUDAProfiler::GetCurrMemoryInfo() {
   NVML_CALL(nvmlDeviceGetHandleByIndex(device_index, &nvml_device));
   NVML_CALL(nvmlDeviceGetMemoryInfo(nvml_device, &memory));
 
-  auto cuda_memory_info = CUDAMemoryInfo();
+  auto cuda_memory_info = MemoryProfiler::GetCurrMemoryInfo();
   cuda_memory_info.limit = memory.total / (1024 * 1024);
   cuda_memory_info.all_reserved = memory.used / (1024 * 1024);
-  cuda_memory_info.mempool_allocated = _mempool->GetCurrAllocated() / (1024 * 1024);
-  cuda_memory_info.mempool_reserved = _mempool->GetCurrReserved() / (1024 * 1024);
-  cuda_memory_info.mempool_peak_reserved = _mempool->GetPeakReserved() / (1024 * 1024);
   return cuda_memory_info;
 }
 
-void CUDAProfiler::PrintCurrMemoryInfo(const std::string& prefix) {
-  
-  auto cuda_memory_info = GetCurrMemoryInfo();
-  HT_LOG_INFO << "[" << prefix << "] " << _device << ": "
-    << "all reserved memory (nvidia-smi) = " << cuda_memory_info.all_reserved << " MiB"
-    << ", mempool reserved memory = " << cuda_memory_info.mempool_reserved << " MiB"
-    << ", mempool peak reserved memory = " << cuda_memory_info.mempool_peak_reserved << " MiB"
-    << ", mempool allocated memory = " << cuda_memory_info.mempool_allocated << " MiB";
-}
-
 void CUDAProfiler::PrintNvlinkStart() {
 
   // 只需要一个机器profile即可
@@ -223,7 +352,7 @@ void checkOutputsMemory(const Operator& op, size_t micro_batch_id, const NDArray
         continue;
       }
       HT_LOG_DEBUG << local_device << ": micro batch " << micro_batch_id << " " << op->output(i)
-        << " malloc new GPU memory with shape = " << output->shape()
+        << " malloc new memory on " << output->device() << " with shape = " << output->shape()
         << ", ptr id = " << output->storage()->ptr_id();
       malloc_outputs_map[output->storage()->ptr_id()] = std::make_pair(micro_batch_id, op->output(i));
     } else {
@@ -18,47 +18,97 @@ enum class MEMORY_PROFILE_LEVEL : int8_t {
   WARN
 };
 
-class CUDAMemoryInfo {
+class MemoryInfo {
   public:
     // 单位都是MiB
     size_t mempool_reserved{0};
     size_t mempool_peak_reserved{0};
     size_t mempool_allocated{0};
-    size_t all_reserved{0};
+    size_t mempool_peak_allocated{0};
+    size_t all_reserved{0}; // 整个device（CPU上为当前进程的RSS）
     size_t limit{0};
 };
 
+using CUDAMemoryInfo = MemoryInfo;
+
 class MicroBatchMemoryInfo {
   public:
     // 单位都是MiB
     bool is_forward;
     size_t stage_id;
     size_t micro_batch_id;
-    CUDAMemoryInfo begin_memory_info;
-    CUDAMemoryInfo end_memory_info;
+    MemoryInfo begin_memory_info;
+    MemoryInfo end_memory_info;
 };
 
-class CUDAProfiler {
+// 单个op执行前后memory pool的变化，用于把显存/内存的占用归因到op与tensor上
+class OpMemoryRecord {
   public:
-    CUDAProfiler(const Device& device)
-    : _device(device) {
-      _mempool = std::dynamic_pointer_cast<hydraulis::impl::CUDACachingMemoryPool>(GetMemoryPool(device));  
+    // 单位都是bytes
+    std::string op_name;
+    std::string op_type;
+    size_t micro_batch_id;
+    int64_t allocated_delta; // op执行前后allocated的变化（包括workspace等临时申请）
+    size_t new_malloc_bytes; // 输出中新申请（而非inplace或复用）的部分
+    std::vector<std::pair<std::string, size_t>> new_malloc_outputs;
+    size_t allocated; // op执行后的allocated与reserved，构成timeline
+    size_t reserved;
+};
+
+// 与设备无关的memory profiler
+// 基于memory pool提供的统计得到MemoryInfo，子类负责补充整个设备的占用与上限
+class MemoryProfiler {
+  public:
+    MemoryProfiler(const Device& device)
+    : _device(device), _mempool(GetMemoryPool(device)) {}
+
+    virtual ~MemoryProfiler() = default;
+
+    virtual MemoryInfo GetCurrMemoryInfo();
+
+    void PrintCurrMemoryInfo(const std::string& prefix);
+
+    size_t GetCurrAllocatedBytes() {
+      return _mempool->GetCurrAllocated();
     }
+
+    // op粒度的归因与timeline
+    void ClearOpRecords();
+    void RecordOp(const Operator& op, size_t micro_batch_id, size_t allocated_before,
+                  const NDArrayList& inputs, const NDArrayList& outputs);
+    const std::vector<OpMemoryRecord>& op_records() const {
+      return _op_records;
+    }
+    // 写入峰值、占用最多的top_k个op以及完整的timeline（json）
+    void DumpOpRecords(std::ostream& os, size_t top_k = 20) const;
+
+  protected:
+    Device _device;
+    std::shared_ptr<MemoryPool> _mempool;
+    std::vector<OpMemoryRecord> _op_records;
+};
+
+class CPUProfiler : public MemoryProfiler {
+  public:
+    CPUProfiler(const Device& device)
+    : MemoryProfiler(device) {}
+
+    MemoryInfo GetCurrMemoryInfo() override;
+};
+
+class CUDAProfiler : public MemoryProfiler {
+  public:
+    CUDAProfiler(const Device& device)
+    : MemoryProfiler(device) {}
     
     // profile memory
-    CUDAMemoryInfo GetCurrMemoryInfo();
-    void PrintCurrMemoryInfo(const std::string& prefix);
+    MemoryInfo GetCurrMemoryInfo() override;
 
     // profile NVLink
     void PrintNvlinkStart();
     void PrintNvlinkEnd();
 
   protected:
-    Device _device;
-
-    // profile memory
-    std::shared_ptr<hydraulis::impl::CUDACachingMemoryPool> _mempool;
-
     // profile NVLink
     unsigned int _device_count = 0; // 有多少个GPU
     std::vector<unsigned int> _nvlink_counts; // 每个GPU有多少条NVLink
@@ -68,7 +118,10 @@ class CUDAProfiler {
 
 std::shared_ptr<CUDAProfiler> GetCUDAProfiler(const Device& device);
 
-std::ostream& operator<<(std::ostream& os, const CUDAMemoryInfo& memory_info);
+// 根据设备类型返回CPUProfiler或CUDAProfiler
+std::shared_ptr<MemoryProfiler> GetMemoryProfiler(const Device& device);
+
+std::ostream& operator<<(std::ostream& os, const MemoryInfo& memory_info);
 
 std::ostream& operator<<(std::ostream& os, const MicroBatchMemoryInfo& micro_batch_memory_info);
 
@@ -0,0 +1,339 @@
+#include "hydraulis/graph/recompute/memory_budget_planner.h"
+#include "hydraulis/graph/ops/Communication.h"
+#include "hydraulis/impl/communication/comm_group.h"
+#include <cstdlib>
+#include <limits>
+
+namespace hydraulis {
+namespace graph {
+
+// helper functions
+namespace {
+  constexpr size_t MiB = 1024 * 1024;
+  // 背包的容量最多离散为这么多份
+  constexpr size_t kMaxKnapsackUnits = 4096;
+  // 没有profile结果时，按照访存带宽估计前向的时间（bytes per ms）
+  constexpr double kEstimatedHBMBytesPerMs = 1e9;
+  // 每个offload的tensor的固定开销（ms），用于在时间相同时优先选择KEEP
+  constexpr double kOffloadLaunchMs = 0.01;
+
+  inline double get_env_double(const char* name, double default_val) {
+    const char* env = std::getenv(name);
+    if (env == nullptr)
+      return default_val;
+    return std::atof(env);
+  }
+
+  inline bool any_bw_consumer(const Tensor& tensor) {
+    return Tensor::any_consumer_of(tensor, [](const OpRef& op_ref) -> bool {
+      return op_ref.get()->is_bw_op();
+    });
+  }
+
+  inline size_t ceil_div(size_t a, size_t b) {
+    return (a + b - 1) / b;
+  }
+
+  inline size_t policy_bytes(const LayerActivationCost& layer, ActivationPolicy policy) {
+    switch (policy) {
+      case ActivationPolicy::KEEP:
+        return layer.saved_bytes;
+      case ActivationPolicy::RECOMPUTE:
+        return layer.boundary_bytes;
+      case ActivationPolicy::OFFLOAD:
+        return 0;
+      default:
+        HT_NOT_IMPLEMENTED << "unsupported activation policy";
+        __builtin_unreachable();
+    }
+  }
+
+  inline double policy_time(const LayerActivationCost& layer, ActivationPolicy policy) {
+    switch (policy) {
+      case ActivationPolicy::KEEP:
+        return 0;
+      case ActivationPolicy::RECOMPUTE:
+        return layer.recompute_ms;
+      case ActivationPolicy::OFFLOAD:
+        return layer.offload_ms;
+      default:
+        HT_NOT_IMPLEMENTED << "unsupported activation policy";
+        __builtin_unreachable();
+    }
+  }
+} // namespace
+
+std::string ActivationPolicy2Str(const ActivationPolicy& policy) {
+  switch (policy) {
+    case ActivationPolicy::KEEP:
+      return "keep";
+    case ActivationPolicy::RECOMPUTE:
+      return "recompute";
+    case ActivationPolicy::OFFLOAD:
+      return "offload";
+    default:
+      HT_VALUE_ERROR << "Unrecognizable activation policy: " << static_cast<int>(policy);
+      __builtin_unreachable();
+  }
+}
+
+std::ostream& operator<<(std::ostream& os, const ActivationPolicy& policy) {
+  os << ActivationPolicy2Str(policy);
+  return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const MemoryBudgetPlan& plan) {
+  size_t num_policies[static_cast<int>(ActivationPolicy::NUM_ACTIVATION_POLICIES)] = {0};
+  for (const auto& layer : plan.layers) {
+    num_policies[static_cast<int>(layer.policy)]++;
+  }
+  os << "budget = " << plan.budget_bytes / MiB << " MiB"
+     << ", static = " << plan.static_bytes / MiB << " MiB"
+     << ", predicted peak = " << plan.peak_bytes_before / MiB << " MiB -> "
+     << plan.peak_bytes_after / MiB << " MiB"
+     << ", added time = " << plan.added_time_ms << " ms"
+     << ", layers (keep/recompute/offload) = "
+     << num_policies[static_cast<int>(ActivationPolicy::KEEP)] << "/"
+     << num_policies[static_cast<int>(ActivationPolicy::RECOMPUTE)] << "/"
+     << num_policies[static_cast<int>(ActivationPolicy::OFFLOAD)];
+  return os;
+}
+
+bool MemoryBudgetPlanner::enabled() {
+  return get_env_double("HYDRAULIS_MEMORY_BUDGET_MB", 0) > 0;
+}
+
+// 与Recompute::IsNoRecomputedOp保持一致
+bool MemoryBudgetPlanner::IsNoPlannedOp(Operator& op) {
+  if (is_comm_op(op)) {
+    auto& comm_op_impl = reinterpret_cast<CommOpImpl&>(op->body());
+    uint64_t comm_type = comm_op_impl.get_comm_type(op, hydraulis::impl::comm::GetLocalDevice());
+    return comm_type == PEER_TO_PEER_RECV_OP ||
+           comm_type == PEER_TO_PEER_SEND_OP ||
+           comm_type == BATCHED_ISEND_IRECV_OP;
+  } else {
+    return is_variable_op(op) ||
+           is_placeholder_op(op);
+  }
+}
+
+size_t MemoryBudgetPlanner::TensorBytes(const Tensor& tensor, const Tensor2ShapeMap& shape_plan) {
+  auto it = shape_plan.find(tensor->id());
+  const HTShape& shape = it != shape_plan.end() ? it->second : tensor->shape();
+  size_t numel = 1;
+  for (auto dim : shape) {
+    // 无法确定的shape不计入
+    if (dim < 0)
+      return 0;
+    numel *= static_cast<size_t>(dim);
+  }
+  return numel * DataType2Size(tensor->dtype());
+}
+
+// 分组背包：每个layer恰好选择一个policy
+// dp[i][c]表示前i个layer使用不超过c份显存时的最小额外时间
+void MemoryBudgetPlanner::SolveKnapsack(MemoryBudgetPlan& plan, size_t activation_budget_bytes) {
+  auto& layers = plan.layers;
+  size_t num_layers = layers.size();
+  size_t unit = std::max<size_t>(ceil_div(activation_budget_bytes, kMaxKnapsackUnits), 1);
+  size_t capacity = activation_budget_bytes / unit;
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  constexpr int num_policies = static_cast<int>(ActivationPolicy::NUM_ACTIVATION_POLICIES);
+  bool allow_offload = false;
+  const char* env = std::getenv("HYDRAULIS_MEMORY_BUDGET_OFFLOAD");
+  if (env != nullptr && std::string(env) == "ON")
+    allow_offload = true;
+
+  auto is_allowed = [&](const LayerActivationCost& layer, ActivationPolicy policy) -> bool {
+    if (layer.fixed)
+      return policy == layer.policy;
+    return policy != ActivationPolicy::OFFLOAD || allow_offload;
+  };
+
+  std::vector<std::vector<double>> dp(num_layers + 1, std::vector<double>(capacity + 1, inf));
+  std::vector<std::vector<int8_t>> choice(num_layers + 1, std::vector<int8_t>(capacity + 1, -1));
+  std::fill(dp[0].begin(), dp[0].end(), 0);
+  for (size_t i = 1; i <= num_layers; i++) {
+    const auto& layer = layers[i - 1];
+    for (int p = 0; p < num_policies; p++) {
+      auto policy = static_cast<ActivationPolicy>(p);
+      if (!is_allowed(layer, policy))
+        continue;
+      // 向上取整，保证预测的峰值不会被低估
+      size_t weight = ceil_div(policy_bytes(layer, policy), unit);
+      double time = policy_time(layer, policy);
+      for (size_t c = weight; c <= capacity; c++) {
+        double cand = dp[i - 1][c - weight] + time;
+        // 严格小于，时间相同时优先选择编号较小的policy（即KEEP）
+        if (cand < dp[i][c]) {
+          dp[i][c] = cand;
+          choice[i][c] = static_cast<int8_t>(p);
+        }
+      }
+    }
+  }
+
+  if (dp[num_layers][capacity] == inf) {
+    // 预算无法满足，退化为每个layer选择显存最小的policy
+    plan.fits = false;
+    for (auto& layer : layers) {
+      if (layer.fixed)
+        continue;
+      auto best = ActivationPolicy::KEEP;
+      for (int p = 0; p < num_policies; p++) {
+        auto policy = static_cast<ActivationPolicy>(p);
+        if (is_allowed(layer, policy) && policy_bytes(layer, policy) < policy_bytes(layer, best))
+          best = policy;
+      }
+      layer.policy = best;
+    }
+    return;
+  }
+
+  size_t c = capacity;
+  for (size_t i = num_layers; i > 0; i--) {
+    auto policy = static_cast<ActivationPolicy>(choice[i][c]);
+    layers[i - 1].policy = policy;
+    c -= ceil_div(policy_bytes(layers[i - 1], policy), unit);
+  }
+}
+
+MemoryBudgetPlan MemoryBudgetPlanner::Plan(const OpRefList& topo_order, const Tensor2ShapeMap& shape_plan) {
+  auto& local_device = hydraulis::impl::comm::GetLocalDevice();
+  MemoryBudgetPlan plan;
+  plan.budget_bytes = static_cast<size_t>(get_env_double("HYDRAULIS_MEMORY_BUDGET_MB", 0) * MiB);
+  double pcie_bytes_per_ms = get_env_double("HYDRAULIS_MEMORY_BUDGET_PCIE_BW", 16) * 1e6;
+  size_t num_inflight = std::max<size_t>(
+    static_cast<size_t>(get_env_double("HYDRAULIS_MEMORY_BUDGET_INFLIGHT_MICRO_BATCHES", 1)), 1);
+  HT_VALUE_ERROR_IF(pcie_bytes_per_ms <= 0)
+    << "HYDRAULIS_MEMORY_BUDGET_PCIE_BW should be positive";
+
+  // 按照module subgraph将前向算子划分为layer
+  std::unordered_map<std::string, size_t> layer_idx;
+  std::unordered_map<OpId, size_t> op_to_layer;
+  for (auto& op_ref : topo_order) {
+    auto& op = op_ref.get();
+    if (!op->placement_group().contains(local_device) || op->is_bw_op())
+      continue;
+    if (is_variable_op(op)) {
+      Operator::for_each_output_tensor(op, [&](const Tensor& tensor) {
+        plan.static_bytes += TensorBytes(tensor, shape_plan);
+      });
+      continue;
+    }
+    if (IsNoPlannedOp(op))
+      continue;
+    auto subgraph = op->graph().GetSubGraph(op);
+    std::string name = subgraph != nullptr ? subgraph->global_name() : "";
+    auto it = layer_idx.find(name);
+    if (it == layer_idx.end()) {
+      it = layer_idx.emplace(name, plan.layers.size()).first;
+      plan.layers.emplace_back();
+      plan.layers.back().name = name;
+    }
+    op_to_layer.emplace(op->id(), it->second);
+    auto& layer = plan.layers[it->second];
+    layer.ops.push_back(op_ref);
+    if (op->op_meta().get_recompute(op->graph().COMPUTE_STRATEGY_ID, op->suggested_hetero_id())) {
+      layer.fixed = true;
+      layer.policy = ActivationPolicy::RECOMPUTE;
+    } else if (op->op_meta().is_cpu_offload && !layer.fixed) {
+      layer.fixed = true;
+      layer.policy = ActivationPolicy::OFFLOAD;
+    }
+  }
+
+  // 统计每个layer需要保存到反向的activation
+  // 其中被其他layer的前向算子使用的输出作为recompute时的checkpoint
+  for (auto& layer : plan.layers) {
+    size_t num_saved_tensors = 0;
+    for (auto& op_ref : layer.ops) {
+      auto& op = op_ref.get();
+      auto cur_layer = op_to_layer[op->id()];
+      Operator::for_each_output_tensor(op, [&](const Tensor& tensor) {
+        if (!any_bw_consumer(tensor))
+          return;
+        size_t bytes = TensorBytes(tensor, shape_plan);
+        layer.saved_bytes += bytes;
+        num_saved_tensors++;
+        bool is_boundary = Tensor::any_consumer_of(tensor, [&](const OpRef& consumer) -> bool {
+          if (consumer.get()->is_bw_op())
+            return false;
+          auto it = op_to_layer.find(consumer.get()->id());
+          return it == op_to_layer.end() || it->second != cur_layer;
+        });
+        if (is_boundary)
+          layer.boundary_bytes += bytes;
+      });
+    }
+    auto subgraph = layer.ops.empty() ? nullptr : layer.ops.front().get()->graph().GetSubGraph(layer.ops.front().get());
+    double fwd_ms, bwd_ms;
+    if (subgraph != nullptr && subgraph->already_profiled()) {
+      fwd_ms = subgraph->fwd_time() * 1.0 / 1e6;
+      bwd_ms = subgraph->bwd_time() * 1.0 / 1e6;
+    } else {
+      // 前向大多是访存密集的，按照读写activation估计
+      fwd_ms = 2.0 * layer.saved_bytes / kEstimatedHBMBytesPerMs;
+      bwd_ms = 2.0 * fwd_ms;
+    }
+    layer.recompute_ms = fwd_ms;
+    // D2H发生在前向，H2D发生在反向，分别与该layer的计算overlap
+    double d2h_ms = layer.saved_bytes / pcie_bytes_per_ms;
+    double h2d_ms = layer.saved_bytes / pcie_bytes_per_ms;
+    layer.offload_ms = std::max(d2h_ms - fwd_ms, 0.0) + std::max(h2d_ms - bwd_ms, 0.0)
+                       + kOffloadLaunchMs * num_saved_tensors;
+  }
+
+  size_t activation_bytes_before = 0;
+  for (const auto& layer : plan.layers) {
+    activation_bytes_before += policy_bytes(layer, layer.policy);
+  }
+  plan.peak_bytes_before = plan.static_bytes + num_inflight * activation_bytes_before;
+
+  if (plan.budget_bytes <= plan.static_bytes) {
+    HT_LOG_WARN << local_device << ": [Memory Budget] static memory " << plan.static_bytes / MiB
+                << " MiB already exceeds the budget " << plan.budget_bytes / MiB << " MiB";
+    SolveKnapsack(plan, 0);
+  } else {
+    SolveKnapsack(plan, (plan.budget_bytes - plan.static_bytes) / num_inflight);
+  }
+
+  size_t activation_bytes_after = 0;
+  for (const auto& layer : plan.layers) {
+    activation_bytes_after += policy_bytes(layer, layer.policy);
+    plan.added_time_ms += policy_time(layer, layer.policy);
+  }
+  plan.peak_bytes_after = plan.static_bytes + num_inflight * activation_bytes_after;
+  return plan;
+}
+
+bool MemoryBudgetPlanner::ApplyMemoryBudget(const OpRefList& topo_order, const Tensor2ShapeMap& shape_plan) {
+  auto& local_device = hydraulis::impl::comm::GetLocalDevice();
+  auto plan = Plan(topo_order, shape_plan);
+  bool changed = false;
+  for (auto& layer : plan.layers) {
+    if (layer.fixed || layer.policy == ActivationPolicy::KEEP)
+      continue;
+    HT_LOG_DEBUG << local_device << ": [Memory Budget] " << layer.policy << " layer " << layer.name
+                 << " (" << layer.saved_bytes / MiB << " MiB saved activations)";
+    for (auto& op_ref : layer.ops) {
+      auto& op = op_ref.get();
+      // exec graph中的op只对应一种strategy，因此直接覆盖
+      if (layer.policy == ActivationPolicy::RECOMPUTE)
+        op->op_meta().set_multi_recompute({{true}});
+      else
+        op->op_meta().set_is_cpu_offload(true);
+    }
+    changed = true;
+  }
+  if (plan.fits) {
+    HT_LOG_INFO << local_device << ": [Memory Budget] " << plan;
+  } else {
+    HT_LOG_WARN << local_device << ": [Memory Budget] cannot fit the budget, "
+                << "fall back to the minimum memory policies: " << plan;
+  }
+  return changed;
+}
+
+} // namespace graph
+} // namespace hydraulis
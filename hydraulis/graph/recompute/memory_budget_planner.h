@@ -0,0 +1,71 @@
+#pragma once
+
+#include "hydraulis/graph/common.h"
+#include "hydraulis/graph/executable_graph.h"
+#include "hydraulis/graph/graph.h"
+
+namespace hydraulis {
+namespace graph {
+
+enum class ActivationPolicy : int8_t {
+  KEEP = 0,
+  RECOMPUTE,
+  OFFLOAD,
+  NUM_ACTIVATION_POLICIES
+};
+
+std::string ActivationPolicy2Str(const ActivationPolicy&);
+std::ostream& operator<<(std::ostream&, const ActivationPolicy&);
+
+// 以layer（即op所属的module subgraph）为粒度的activation开销
+struct LayerActivationCost {
+  std::string name;
+  OpRefList ops; // 该layer中输出被反向算子使用的前向算子
+  size_t saved_bytes{0}; // KEEP时需要保存到反向的activation
+  size_t boundary_bytes{0}; // RECOMPUTE时仍需保存的layer输出（即checkpoint）
+  double recompute_ms{0}; // RECOMPUTE额外的前向时间
+  double offload_ms{0}; // OFFLOAD无法被计算overlap的传输时间
+  bool fixed{false}; // 用户已经手动标记了recompute或offload
+  ActivationPolicy policy{ActivationPolicy::KEEP};
+};
+
+struct MemoryBudgetPlan {
+  std::vector<LayerActivationCost> layers;
+  size_t budget_bytes{0};
+  size_t static_bytes{0}; // 非activation的显存（parameters与optimizer states）
+  size_t peak_bytes_before{0};
+  size_t peak_bytes_after{0};
+  double added_time_ms{0};
+  bool fits{true};
+};
+
+std::ostream& operator<<(std::ostream&, const MemoryBudgetPlan&);
+
+// 在recompute与activation offload pass之前运行
+// 给定每个device的显存预算，以layer为单位在{KEEP, RECOMPUTE, OFFLOAD}中做选择（分组背包DP）
+// 使得预测的显存峰值不超过预算且额外开销最小
+// 最终的决策写回op_meta中已有的recompute与cpu offload标记，由后续的pass负责实际插入算子
+// HYDRAULIS_MEMORY_BUDGET_MB: 每个device的显存预算，不设置则不开启
+// HYDRAULIS_MEMORY_BUDGET_OFFLOAD: ON则允许选择offload（默认只选择recompute）
+// HYDRAULIS_MEMORY_BUDGET_PCIE_BW: offload使用的PCIe带宽（GB/s）
+// HYDRAULIS_MEMORY_BUDGET_INFLIGHT_MICRO_BATCHES: 同时存活的micro batch数目（例如1F1B中的warmup数）
+class MemoryBudgetPlanner {
+ public:
+  static bool enabled();
+
+  static MemoryBudgetPlan Plan(const OpRefList& topo_order, const Tensor2ShapeMap& shape_plan);
+
+  // 返回是否修改了任何op的标记
+  static bool ApplyMemoryBudget(const OpRefList& topo_order, const Tensor2ShapeMap& shape_plan);
+
+  // shape plan中没有的tensor使用其自身的shape，无法确定的shape记为0
+  static size_t TensorBytes(const Tensor& tensor, const Tensor2ShapeMap& shape_plan);
+
+ protected:
+  static bool IsNoPlannedOp(Operator& op);
+
+  static void SolveKnapsack(MemoryBudgetPlan& plan, size_t activation_budget_bytes);
+};
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,203 @@
+#include "hydraulis/graph/replay_log.h"
+#include "hydraulis/impl/communication/comm_group.h"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+
+std::string JoinIndices(const std::vector<size_t>& indices) {
+  std::ostringstream os;
+  for (size_t i = 0; i < indices.size(); i++)
+    os << (i == 0 ? "" : ",") << indices[i];
+  return os.str();
+}
+
+std::vector<std::string> Split(const std::string& str, char delim) {
+  std::vector<std::string> items;
+  if (str.empty())
+    return items;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, delim))
+    items.push_back(item);
+  // 以分隔符结尾时getline不会得到最后一个空的元素
+  if (str.back() == delim)
+    items.emplace_back();
+  return items;
+}
+
+std::vector<size_t> ParseIndices(const std::string& str) {
+  std::vector<size_t> indices;
+  for (const auto& item : Split(str, ','))
+    indices.push_back(std::stoull(item));
+  return indices;
+}
+
+} // namespace
+
+std::string ReplayStep::ToString() const {
+  std::ostringstream os;
+  os << "step=" << step
+     << " compute_strategy=" << compute_strategy_id
+     << " optimize_strategy=" << optimize_strategy_id
+     << " run_level=" << run_level
+     << " num_micro_batches=" << num_micro_batches
+     << " exec_plan=" << exec_plan
+     << " switch_from=" << switch_from
+     << " pre_switched=" << (pre_switched ? 1 : 0)
+     << " shape_plans=" << JoinIndices(shape_plans)
+     << " order=" << JoinIndices(micro_batch_order)
+     << " feed_shapes=";
+  for (size_t i = 0; i < feed_shapes.size(); i++)
+    os << (i == 0 ? "" : "|") << feed_shapes[i];
+  return os.str();
+}
+
+ReplayStep ReplayStep::Parse(const std::string& line) {
+  ReplayStep step;
+  std::istringstream is(line);
+  std::string field;
+  while (is >> field) {
+    auto pos = field.find('=');
+    HT_VALUE_ERROR_IF(pos == std::string::npos)
+      << "Invalid field " << field << " in replay log line: " << line;
+    std::string key = field.substr(0, pos);
+    std::string value = field.substr(pos + 1);
+    if (key == "step")
+      step.step = std::stoull(value);
+    else if (key == "compute_strategy")
+      step.compute_strategy_id = std::stoi(value);
+    else if (key == "optimize_strategy")
+      step.optimize_strategy_id = std::stoi(value);
+    else if (key == "run_level")
+      step.run_level = std::stoi(value);
+    else if (key == "num_micro_batches")
+      step.num_micro_batches = std::stoi(value);
+    else if (key == "exec_plan")
+      step.exec_plan = std::stoull(value);
+    else if (key == "switch_from")
+      step.switch_from = std::stoll(value);
+    else if (key == "pre_switched")
+      step.pre_switched = std::stoi(value) != 0;
+    else if (key == "shape_plans")
+      step.shape_plans = ParseIndices(value);
+    else if (key == "order")
+      step.micro_batch_order = ParseIndices(value);
+    else if (key == "feed_shapes")
+      step.feed_shapes = Split(value, '|');
+    else
+      HT_VALUE_ERROR << "Unknown field " << key << " in replay log line: " << line;
+  }
+  return step;
+}
+
+bool ReplayStep::operator==(const ReplayStep& other) const {
+  return step == other.step &&
+         compute_strategy_id == other.compute_strategy_id &&
+         optimize_strategy_id == other.optimize_strategy_id &&
+         run_level == other.run_level &&
+         num_micro_batches == other.num_micro_batches &&
+         exec_plan == other.exec_plan &&
+         switch_from == other.switch_from &&
+         pre_switched == other.pre_switched &&
+         shape_plans == other.shape_plans &&
+         micro_batch_order == other.micro_batch_order &&
+         feed_shapes == other.feed_shapes;
+}
+
+std::ostream& operator<<(std::ostream& os, const ReplayStep& step) {
+  os << step.ToString();
+  return os;
+}
+
+std::string FeedShapesToString(const Tensor2ShapeMap& feed_shapes) {
+  std::vector<TensorId> ids;
+  ids.reserve(feed_shapes.size());
+  for (const auto& kv : feed_shapes)
+    ids.push_back(kv.first);
+  std::sort(ids.begin(), ids.end());
+  std::ostringstream os;
+  for (size_t i = 0; i < ids.size(); i++) {
+    os << (i == 0 ? "" : ";") << ids[i] << ":";
+    const auto& shape = feed_shapes.at(ids[i]);
+    for (size_t j = 0; j < shape.size(); j++)
+      os << (j == 0 ? "" : "x") << shape[j];
+  }
+  return os.str();
+}
+
+std::unique_ptr<ReplayLog> ReplayLog::FromEnv() {
+  const char* env = std::getenv("HYDRAULIS_REPLAY");
+  if (env == nullptr || std::string(env) == "OFF")
+    return nullptr;
+  ReplayMode mode;
+  if (std::string(env) == "RECORD") {
+    mode = ReplayMode::RECORD;
+  } else if (std::string(env) == "REPLAY") {
+    mode = ReplayMode::REPLAY;
+  } else {
+    HT_RUNTIME_ERROR << "Unknown hydraulis replay mode: " + std::string(env);
+  }
+  const char* path = std::getenv("HYDRAULIS_REPLAY_LOG_FILE");
+  HT_RUNTIME_ERROR_IF(path == nullptr)
+    << "HYDRAULIS_REPLAY=" << env << " requires HYDRAULIS_REPLAY_LOG_FILE";
+  return std::make_unique<ReplayLog>(mode, std::string(path));
+}
+
+void ReplayLog::Open() {
+  if (_opened)
+    return;
+  _opened = true;
+  // 各个rank的exec graph与micro batch可能不同，因此分别记录
+  std::string path = _path + "_" + std::to_string(hydraulis::impl::comm::GetWorldRank()) + ".txt";
+  if (_mode == ReplayMode::RECORD) {
+    _record_file.open(path, std::ios_base::out | std::ios_base::trunc);
+    HT_RUNTIME_ERROR_IF(!_record_file.is_open())
+      << "Failed to open the replay log " << path << " for recording";
+    HT_LOG_INFO << "Recording micro batch plans and strategy switches to " << path;
+    return;
+  }
+  std::ifstream file(path);
+  HT_RUNTIME_ERROR_IF(!file.is_open())
+    << "Failed to open the replay log " << path;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    _replay_steps.push_back(ReplayStep::Parse(line));
+  }
+  HT_LOG_INFO << "Replaying " << _replay_steps.size() << " steps from " << path;
+}
+
+const ReplayStep& ReplayLog::Expected() {
+  HT_ASSERT(_mode == ReplayMode::REPLAY)
+    << "Only the replay mode has expected steps";
+  Open();
+  HT_RUNTIME_ERROR_IF(_step >= _replay_steps.size())
+    << "The replay log " << _path << " only has " << _replay_steps.size()
+    << " steps, but step " << _step << " is run";
+  return _replay_steps[_step];
+}
+
+void ReplayLog::Commit(ReplayStep step) {
+  Open();
+  step.step = _step;
+  if (_mode == ReplayMode::RECORD) {
+    // 每个step都flush，进程异常退出时log仍然完整
+    _record_file << step << std::endl;
+  } else {
+    const auto& expected = Expected();
+    HT_RUNTIME_ERROR_IF(step != expected)
+      << "Step " << _step << " diverges from the replay log " << _path
+      << "\n  recorded: " << expected
+      << "\n  replayed: " << step;
+  }
+  _step++;
+}
+
+} // namespace graph
+} // namespace hydraulis
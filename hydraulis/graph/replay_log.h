@@ -0,0 +1,93 @@
+#pragma once
+
+#include "hydraulis/graph/common.h"
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+enum class ReplayMode : int8_t {
+  OFF = 0,
+  RECORD, // 将每个step的决策追加到log中
+  REPLAY, // 按照log中的决策运行，并核对每个step是否与log一致
+};
+
+// 一个step中影响执行顺序的所有决策
+struct ReplayStep {
+  size_t step{0};
+  int compute_strategy_id{0};
+  int optimize_strategy_id{0};
+  int run_level{0};
+  int num_micro_batches{0};
+  size_t exec_plan{0};
+  int64_t switch_from{-1};               // 热切换前的exec plan，-1表示没有热切换
+  bool pre_switched{false};              // param和opt-states是否已经预切换
+  std::vector<size_t> shape_plans;       // 按原顺序的每个micro batch的shape plan
+  std::vector<size_t> micro_batch_order; // 空表示按原顺序执行
+  std::vector<std::string> feed_shapes;  // 每个micro batch中各个feed的shape
+
+  // 一行文本，各个字段以key=value的形式用空格分隔
+  std::string ToString() const;
+
+  static ReplayStep Parse(const std::string& line);
+
+  bool operator==(const ReplayStep& other) const;
+
+  bool operator!=(const ReplayStep& other) const {
+    return !(*this == other);
+  }
+};
+
+std::ostream& operator<<(std::ostream& os, const ReplayStep& step);
+
+// 将一个micro batch中各个feed的shape按照tensor id的顺序拼接为字符串
+std::string FeedShapesToString(const Tensor2ShapeMap& feed_shapes);
+
+/******************************************************
+ * micro batch plan与策略切换决策的record/replay
+ *
+ * HYDRAULIS_REPLAY=RECORD时，每个step的策略、shape plan、micro batch顺序以及热切换
+ * 都会追加到HYDRAULIS_REPLAY_LOG_FILE_<rank>.txt中；HYDRAULIS_REPLAY=REPLAY时读取该log，
+ * micro batch顺序直接使用log中的结果（不再依赖调度器的代价模型与环境变量），
+ * 策略与run level由driver通过Expected()（python中为graph.replay_expected_step()）读取后按照记录运行，
+ * exec plan与热切换由这些输入决定，所有决策逐个step核对，第一个不一致的step会直接报错。
+ * 配合确定性模式（HYDRAULIS_DETERMINISTIC=ON），可以在CPU机器上逐step复现线上的问题。
+ ******************************************************/
+class ReplayLog {
+ public:
+  ReplayLog(ReplayMode mode, std::string path)
+  : _mode(mode), _path(std::move(path)) {}
+
+  // 未设置HYDRAULIS_REPLAY时返回nullptr
+  static std::unique_ptr<ReplayLog> FromEnv();
+
+  ReplayMode mode() const {
+    return _mode;
+  }
+
+  size_t step() const {
+    return _step;
+  }
+
+  // 回放时当前step在log中的记录
+  const ReplayStep& Expected();
+
+  // 记录当前step（回放时则与log核对），并进入下一个step
+  void Commit(ReplayStep step);
+
+ protected:
+  void Open();
+
+  ReplayMode _mode;
+  std::string _path;
+  bool _opened{false};
+  size_t _step{0};
+  std::ofstream _record_file;
+  std::vector<ReplayStep> _replay_steps;
+};
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,88 @@
+#include "hydraulis/graph/shape_bucketing.h"
+#include <cmath>
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+
+NDArray PadDim0(const NDArray& input, int64_t size, double pad_value) {
+  HTShape pad_shape = input->shape();
+  pad_shape[0] = size - input->shape(0);
+  auto pad = NDArray::full(pad_shape, pad_value, input->device(), input->dtype(), kBlockingStream);
+  return NDArray::cat({input, pad}, 0, kBlockingStream);
+}
+
+} // namespace
+
+int64_t ShapeBucketLadder::Bucket(int64_t size) const {
+  auto align_up = [&](double value) {
+    int64_t ceiled = static_cast<int64_t>(std::ceil(value));
+    return (ceiled + _alignment - 1) / _alignment * _alignment;
+  };
+  double bucket = _min_size;
+  while (align_up(bucket) < size)
+    bucket *= _ratio;
+  return align_up(bucket);
+}
+
+std::ostream& operator<<(std::ostream& os, const ShapePlanStats& stats) {
+  os << "shape plan hits = " << stats.num_hits << "/" << stats.num_lookups
+     << " (" << stats.hit_rate() * 100 << "%)"
+     << ", padded tokens = " << stats.num_padded_tokens << "/" << (stats.num_tokens + stats.num_padded_tokens)
+     << " (" << stats.padding_ratio() * 100 << "%)";
+  return os;
+}
+
+FeedDict ShapeBucketPolicy::Apply(const FeedDict& feed_dict, int num_micro_batches,
+                                  ShapePlanStats& stats) const {
+  FeedDict bucketed_feed_dict;
+  bucketed_feed_dict.reserve(feed_dict.size());
+  // 同一个micro batch中的token feed长度相同，只统计一次
+  std::vector<int64_t> num_tokens(num_micro_batches, 0);
+  std::vector<int64_t> num_bucketed_tokens(num_micro_batches, 0);
+  for (const auto& kv : feed_dict) {
+    auto& bucketed = bucketed_feed_dict[kv.first];
+    auto pad_it = _token_pad_values.find(kv.first);
+    bool is_token = pad_it != _token_pad_values.end();
+    bool is_cu_seqlens = _cu_seqlens.find(kv.first) != _cu_seqlens.end();
+    if ((!is_token && !is_cu_seqlens) || kv.second.size() != static_cast<size_t>(num_micro_batches)) {
+      bucketed = kv.second;
+      continue;
+    }
+    bucketed.reserve(kv.second.size());
+    for (int i = 0; i < num_micro_batches; i++) {
+      const auto& feed = kv.second[i];
+      HT_VALUE_ERROR_IF(feed->ndim() < 1)
+        << "Feed of tensor " << kv.first << " should be at least 1-D to be bucketed, got " << feed->shape();
+      int64_t size = feed->shape(0);
+      if (is_token) {
+        int64_t bucket = _token_ladder.Bucket(size);
+        num_tokens[i] = std::max(num_tokens[i], size);
+        num_bucketed_tokens[i] = std::max(num_bucketed_tokens[i], bucket);
+        bucketed.push_back(bucket == size ? feed : PadDim0(feed, bucket, pad_it->second));
+      } else {
+        HT_VALUE_ERROR_IF(feed->ndim() != 1 || size < 1)
+          << "cu_seqlens of tensor " << kv.first << " should be a non-empty 1-D array, got " << feed->shape();
+        int64_t bucket = _seq_ladder.Bucket(size);
+        if (bucket == size) {
+          bucketed.push_back(feed);
+          continue;
+        }
+        // 补上长度为0的序列
+        auto last = NDArray::to(NDArray::slice(feed, {size - 1}, {1}, kBlockingStream),
+                                Device(kCPU), kInt64, kBlockingStream);
+        Stream(last->device(), kBlockingStream).Sync();
+        bucketed.push_back(PadDim0(feed, bucket, static_cast<double>(last->data_ptr<int64_t>()[0])));
+      }
+    }
+  }
+  for (int i = 0; i < num_micro_batches; i++) {
+    stats.num_tokens += num_tokens[i];
+    stats.num_padded_tokens += num_bucketed_tokens[i] - num_tokens[i];
+  }
+  return bucketed_feed_dict;
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "hydraulis/graph/common.h"
+#include "hydraulis/core/ndarray.h"
+#include <ostream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace hydraulis {
+namespace graph {
+
+// 由min_size * ratio^k（向上对齐到alignment）组成的一组bucket
+class ShapeBucketLadder {
+ public:
+  ShapeBucketLadder(double ratio = 1.125, int64_t min_size = 128, int64_t alignment = 1)
+  : _ratio(ratio), _min_size(min_size), _alignment(alignment) {
+    HT_VALUE_ERROR_IF(_ratio <= 1)
+      << "The ratio of the bucket ladder should be greater than 1, got " << _ratio;
+    HT_VALUE_ERROR_IF(_min_size <= 0 || _alignment <= 0)
+      << "The min size and the alignment of the bucket ladder should be positive"
+      << ", got " << _min_size << " and " << _alignment;
+  }
+
+  // 不小于size的最小的bucket
+  int64_t Bucket(int64_t size) const;
+
+  double ratio() const {
+    return _ratio;
+  }
+
+  int64_t min_size() const {
+    return _min_size;
+  }
+
+  int64_t alignment() const {
+    return _alignment;
+  }
+
+ protected:
+  double _ratio;
+  int64_t _min_size;
+  int64_t _alignment;
+};
+
+struct ShapePlanStats {
+  size_t num_lookups{0}; // 每个micro batch匹配一次shape plan
+  size_t num_hits{0};
+  int64_t num_tokens{0};        // padding前的token数
+  int64_t num_padded_tokens{0}; // bucketing补上的token数
+
+  double hit_rate() const {
+    return num_lookups == 0 ? 0 : static_cast<double>(num_hits) / num_lookups;
+  }
+
+  // padding的token占padding后的token的比例
+  double padding_ratio() const {
+    int64_t total = num_tokens + num_padded_tokens;
+    return total == 0 ? 0 : static_cast<double>(num_padded_tokens) / total;
+  }
+};
+
+std::ostream& operator<<(std::ostream& os, const ShapePlanStats& stats);
+
+/******************************************************
+ * 动态长度下的shape bucketing
+ *
+ * 每个step的packed长度几乎都不同，每个新的长度都需要DeduceShapePlan，并带来新的显存分配模式。
+ * 开启后，token feed（如input_ids、labels）的第0维向上padding到token ladder中的bucket，
+ * padding的位置填入各自的pad value；cu_seqlens feed按照seq ladder用最后一个元素padding，
+ * 即补上长度为0的序列。padding的token不属于任何序列，与packing时为了对齐而补上的token一样
+ * 不参与attention，label的pad value应为loss的ignored index。
+ * 以少量的padding换取稳定的shape plan pool以及allocator的复用。
+ ******************************************************/
+class ShapeBucketPolicy {
+ public:
+  ShapeBucketPolicy(ShapeBucketLadder token_ladder,
+                    std::unordered_map<TensorId, double> token_pad_values,
+                    TensorIdSet cu_seqlens,
+                    ShapeBucketLadder seq_ladder = ShapeBucketLadder(2, 2, 1))
+  : _token_ladder(std::move(token_ladder)),
+    _token_pad_values(std::move(token_pad_values)),
+    _cu_seqlens(std::move(cu_seqlens)),
+    _seq_ladder(std::move(seq_ladder)) {}
+
+  // 对各个micro batch的feed做padding，并在stats中累计padding前后的token数
+  // 只有一个NDArray（即在executor中才按micro batch切分）的feed保持不变
+  FeedDict Apply(const FeedDict& feed_dict, int num_micro_batches,
+                 ShapePlanStats& stats) const;
+
+  const ShapeBucketLadder& token_ladder() const {
+    return _token_ladder;
+  }
+
+  const ShapeBucketLadder& seq_ladder() const {
+    return _seq_ladder;
+  }
+
+ protected:
+  ShapeBucketLadder _token_ladder;
+  std::unordered_map<TensorId, double> _token_pad_values;
+  TensorIdSet _cu_seqlens;
+  ShapeBucketLadder _seq_ladder;
+};
+
+} // namespace graph
+} // namespace hydraulis
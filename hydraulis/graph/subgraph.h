@@ -228,6 +228,10 @@ class SubGraph {
       return _fwd_time + _bwd_time + _update_time;
     }
 
+    bool already_profiled() const {
+      return _already_profiled;
+    }
+
     void set_fwd_time(int64_t fwd_time) {
       _fwd_time = fwd_time;
     }
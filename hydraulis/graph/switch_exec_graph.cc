@@ -14,6 +14,7 @@
 #include "hydraulis/impl/communication/comm_group.h"
 #include "hydraulis/impl/communication/nccl_comm_group.h"
 #include "hydraulis/impl/memory/CUDACachingMemoryPool.cuh"
+#include "hydraulis/impl/profiler/trace.h"
 #include "hydraulis/core/device.h"
 #include "hydraulis/core/dtype.h"
 #include "hydraulis/core/ndarray_meta.h"
@@ -28,7 +29,6 @@ namespace hydraulis {
 namespace graph {
 
 static std::unordered_map<DeviceGroup, std::once_flag> warmup_flags;
-static std::unordered_map<std::pair<Device, Device>, P2PRoute> all_routes;
 
 std::ostream& operator<<(std::ostream& os, const SwitchExecGraph& switcher) {
   os << "switch_exec_graph(" << switcher.SwitchGraphPair().first->name() << ", " 
@@ -70,25 +70,14 @@ static std::unordered_set<Key> KeysUnion(const std::unordered_set<Key>& set1, co
   return result;
 }
 
-static const P2PRoute& GetP2PRoute(const Device& from, const Device& to) {
-  auto p2p_pair = std::make_pair(from, to);
-  auto it = all_routes.find(p2p_pair);
-  if (it != all_routes.end()) {
-    return it->second;
-  }
-  if (Device::compare_hostname(from, to) != 0) {
-    all_routes[p2p_pair] = P2PRoute(P2P_ROUTE_LEVEL::NET);
-  } else {
-    // TODO: 非A100/A800
-    all_routes[p2p_pair] = P2PRoute(P2P_ROUTE_LEVEL::NVLINK);
-  }
-  return all_routes[p2p_pair];
-}
-
 // nccl存在一些冷启动的开销
 // 先简单地进行一个小的all-to-all
 static void WarmUpComm(const std::unordered_set<Device>& comm_set, const StreamIndex comm_stream_idx) {
   auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  // cpu backends have no such overhead
+  if (!local_device.is_cuda()) {
+    return;
+  }
   std::vector<int> ranks(comm_set.size());
   std::transform(comm_set.begin(), comm_set.end(), ranks.begin(), 
                  [&](const Device& device) { return hydraulis::impl::comm::DeviceToWorldRank(device); });
@@ -165,10 +154,14 @@ void ParamBuffer::Alloc(const Stream& stream,
     << "ParamBuffer cannot simutaneouly use two of the three: nccl buffer malloc, caching mempool malloc and async malloc";
   TIK(alloc_time);
   auto local_device = hydraulis::impl::comm::GetLocalDevice(); 
-  hydraulis::cuda::CUDADeviceGuard guard(local_device.index());
+  hydraulis::cuda::CUDADeviceGuard guard(local_device.is_cuda() ? local_device.index() : -1);
   HT_LOG_DEBUG << local_device << ": " << _name << " param buffer"
     << " will alloc " << (double)_buffer_size / (1024 * 1024) << " MiB";  
-  if (use_nccl) {
+  if (local_device.is_cpu()) {
+    // host buffers (e.g., ranks of the threaded world) simply go to the cpu mempool
+    _storage = std::make_shared<NDArrayStorage>(AllocFromMemoryPool(local_device, _buffer_size, stream));
+    _raw_ptr = _storage->mutable_data();
+  } else if (use_nccl) {
     HT_ASSERT(comm != nullptr)
       << "nccl buffer registration must have a communicator";
     void* reg_handle;                                     
@@ -264,7 +257,8 @@ void ParamBuffer::Bind(const std::shared_ptr<NDArrayStorage>& storage) {
     << " will bind " << (double)_buffer_size / (1024 * 1024) << " MiB";  
   HT_ASSERT(!_is_allocated)
     << "ParamBuffer " << _name << " bind can only used when the storage is not allocated yet";
-  HT_ASSERT(storage->device() == local_device)
+  // ZeRO-Offload时optimizer states绑定在host上
+  HT_ASSERT(storage->device() == local_device || storage->device().is_cpu())
     << "ParamBuffer " << _name << " device should equal to the storage device to bind"
     << ", but find ParamBuffer device " << local_device << " != storage device " << storage->device();
   HT_ASSERT(storage->size() == _buffer_size)
@@ -346,36 +340,34 @@ void ParamSlice::AddNeededSliceInst(const Device& device, const Tensor& tensor)
   _switcher->RecordTensorInfo(tensor, name());
 }
 
-// TODO: 修改greedy算法
+SwitchSliceDemand ParamSlice::CommDemand() const {
+  HT_ASSERT(_needed_slice_instances.size() == _needed_devices.size() && _owned_slice_instances.size() == _owned_devices.size())
+    << "something wrong with the size";
+  size_t bytes = 0;
+  if (!_owned_slice_instances.empty()) {
+    bytes = numel() * DataType2Size(_owned_slice_instances[0]->dtype());
+  }
+  return SwitchSliceDemand{bytes, _owned_devices, _needed_devices};
+}
+
+// 按照SwitchPlanner规划的结果建立通信关系
 void ParamSlice::ParamSliceComm(Device2DTListPairMap& send_mapping,
                                 Device2DTListPairMap& recv_mapping) {
   auto needed_len = _needed_slice_instances.size();
-  auto owned_len = _owned_slice_instances.size();
-  HT_ASSERT(needed_len == _needed_devices.size() && owned_len == _owned_devices.size())
-    << "something wrong with the size";
-  if (owned_len == 0) {
-    // 该slice无法进行热切换
-    // 需要从CPU/SSD中加载
-    // TODO
-    HT_RUNTIME_ERROR << "NotImplementedError: hot switch doesn't work";
-  }
+  HT_ASSERT(_planned_senders.size() == needed_len)
+    << name() << " should be planned before ParamSliceComm";
   for (size_t i = 0; i < needed_len; ++i) {
     auto& needed_device = _needed_devices[i];
-    bool already_owned = false;
-    size_t already_owned_slice_instance_num = 0;
-    // 先扫一遍，如果自己已经有了，那么就不需要通信了
-    for (size_t j = 0; j < owned_len; ++j) {
-      if (needed_device == _owned_devices[j]) {
-        already_owned = true;
-        already_owned_slice_instance_num= j;
-        break;
-      }
-    }
-    if (already_owned) {
+    auto send_num = _planned_senders[i];
+    if (send_num < 0) {
+      // 自己已经有了，那么就不需要通信了
       // 只需要替换即可
       // 不需要记录在send/recv的mapping中
+      auto it = std::find(_owned_devices.begin(), _owned_devices.end(), needed_device);
+      HT_ASSERT(it != _owned_devices.end())
+        << needed_device << " doesn't own the " << name() << " param slice";
       auto& old_tensor = _needed_slice_instances[i];
-      auto& new_tensor = _owned_slice_instances[already_owned_slice_instance_num];
+      auto& new_tensor = _owned_slice_instances[std::distance(_owned_devices.begin(), it)];
       HT_ASSERT(old_tensor->num_consumers() == 1)
         << "the slice instance should only used once (by a single concatenate op)";
       auto& consumer = old_tensor->consumer(0);
@@ -391,128 +383,10 @@ void ParamSlice::ParamSliceComm(Device2DTListPairMap& send_mapping,
     } else {
       // 需要通信
       // 通信关系会记录在send/recv的mapping中
-      Tensor send_tensor; // TBD
-      Device send_device; // TBD
+      auto& send_tensor = _owned_slice_instances[send_num];
+      auto& send_device = _owned_devices[send_num];
       auto& recv_tensor = _needed_slice_instances[i];
       auto& recv_device = _needed_devices[i];
-      // 不同的算法
-      // FCFS or round-robin
-      if (_switcher->_algorithm_level == SWITCH_ALGORITHM_LEVEL::FCFS
-          || _switcher->_algorithm_level == SWITCH_ALGORITHM_LEVEL::ROUND_ROBIN
-          || _switcher->_algorithm_level == SWITCH_ALGORITHM_LEVEL::MULTI_NODE_ROUND_ROBIN) {
-        send_tensor = _owned_slice_instances[_round_robin];
-        send_device = _owned_devices[_round_robin];
-        // 更新轮询次数
-        // 多node情形下要额外考虑跨机间通信
-        // 尽可能将其避免（除非避免不了）
-        if (_switcher->_algorithm_level == SWITCH_ALGORITHM_LEVEL::MULTI_NODE_ROUND_ROBIN) {
-          size_t round = 0, max_round = _owned_slice_instances.size();
-          while (round < max_round) {
-            send_tensor = _owned_slice_instances[(_round_robin + round) % max_round];
-            send_device = _owned_devices[(_round_robin + round) % max_round];
-            const auto& p2p_route = GetP2PRoute(send_device, recv_device);
-            if (p2p_route.route_level() >= P2P_ROUTE_LEVEL::NET) {
-              round++;
-            } else {
-              break;
-            }
-          }
-        }
-        if (_switcher->_algorithm_level == SWITCH_ALGORITHM_LEVEL::ROUND_ROBIN
-            || _switcher->_algorithm_level == SWITCH_ALGORITHM_LEVEL::MULTI_NODE_ROUND_ROBIN) {
-          _round_robin++;
-        }
-        if (_round_robin == _owned_slice_instances.size()) {
-          _round_robin = 0;
-        }
-      } 
-      // 按照已经通信的次数进行greedy（即选取已通信中p2p次数最小的）
-      if (_switcher->_algorithm_level == SWITCH_ALGORITHM_LEVEL::GREEDY) {
-        std::pair<Device, Device> best_p2p;
-        size_t best_send_num;
-        auto& p2p_val_mapping = _switcher->_p2p_val_mapping;
-        size_t min_val = std::numeric_limits<size_t>::max();
-        for (size_t j = 0; j < owned_len; ++j) {
-          // p2p是双向通路
-          // 规定device编号小的在前
-          std::pair<Device, Device> p2p;
-          if (_owned_devices[j] < recv_device) {
-            p2p = std::make_pair(_owned_devices[j], recv_device);
-          } else {
-            p2p = std::make_pair(recv_device, _owned_devices[j]);
-          }
-          auto it = p2p_val_mapping.find(p2p);
-          // 相当于通信了0次
-          if (it == p2p_val_mapping.end()) {
-            best_p2p = p2p;
-            best_send_num = j;
-            break;
-          }
-          // 选择通信次数最小的
-          if (it->second < min_val) {
-            min_val = it->second;
-            best_p2p = p2p;
-            best_send_num = j;
-          }
-        }
-        // 更新p2p_val_mapping
-        p2p_val_mapping[best_p2p] += 1;
-        send_tensor = _owned_slice_instances[best_send_num];
-        send_device = _owned_devices[best_send_num];
-      }
-      // 2024.2.25
-      // 修正版greedy
-      if (_switcher->_algorithm_level == SWITCH_ALGORITHM_LEVEL::NEW_GREEDY) {
-        size_t best_send_num, round = 0;
-        auto& intra_device_val_mapping = _switcher->_intra_device_val_mapping;
-        auto& inter_device_val_mapping = _switcher->_inter_device_val_mapping;
-        size_t min_val = std::numeric_limits<size_t>::max();
-        for (size_t j = 0; j < owned_len; ++j) {
-          const auto& p2p_route = GetP2PRoute(_owned_devices[j], recv_device);
-          // 能不跨机，就不跨机
-          if (p2p_route.route_level() >= P2P_ROUTE_LEVEL::NET) {
-            round++;
-            continue;
-          }
-          auto it = intra_device_val_mapping.find(_owned_devices[j]);
-          // 相当于通信为0
-          if (it == intra_device_val_mapping.end()) {
-            best_send_num = j;
-            break;
-          }
-          // 选择通信量除以带宽最小的
-          if (it->second < min_val) {
-            min_val = it->second;
-            best_send_num = j;
-          }
-        }
-        // 如果不得不跨机，那么再扫一遍
-        if (round == owned_len) {
-          for (size_t j = 0; j < owned_len; ++j) {
-            auto it = inter_device_val_mapping.find(_owned_devices[j]);
-            // 相当于通信为0
-            if (it == inter_device_val_mapping.end()) {
-              best_send_num = j;
-              break;
-            }
-            // 选择通信量除以带宽最小的
-            if (it->second < min_val) {
-              min_val = it->second;
-              best_send_num = j;
-            }
-          }
-        }
-        // 更新device_val_mapping
-        const auto& p2p_route = GetP2PRoute(_owned_devices[best_send_num], recv_device);
-        if (p2p_route.route_level() >= P2P_ROUTE_LEVEL::NET) {
-          inter_device_val_mapping[_owned_devices[best_send_num]] += numel();
-        } else {
-          intra_device_val_mapping[_owned_devices[best_send_num]] += numel();
-        }
-        send_tensor = _owned_slice_instances[best_send_num];
-        send_device = _owned_devices[best_send_num];
-      }
-      // 建立通信关系
       auto recv_it = recv_mapping.find(recv_device);
       auto send_it = send_mapping.find(send_device);
       HT_ASSERT(send_it != send_mapping.end() && recv_it != recv_mapping.end())
@@ -538,6 +412,26 @@ void ParamBlock::ParamBlockComm(Device2DTListPairMap& send_mapping,
   }
 }
 
+// 规划与通信的建立是分开的
+// 规划只依赖于每个ParamSlice的owned/needed devices以及拓扑
+void SwitchExecGraph::PlanParamBlocksComm() {
+  std::vector<SwitchSliceDemand> demands;
+  for (auto& param_block_ptr : _param_blocks) {
+    for (auto& param_slice_ptr : param_block_ptr->GetParamSlices()) {
+      demands.emplace_back(param_slice_ptr->CommDemand());
+    }
+  }
+  SwitchPlanner planner(_algorithm_level);
+  _switch_plan = planner.Plan(demands);
+  size_t demand_idx = 0;
+  for (auto& param_block_ptr : _param_blocks) {
+    for (auto& param_slice_ptr : param_block_ptr->GetParamSlices()) {
+      param_slice_ptr->SetPlannedSenders(_switch_plan.senders[demand_idx++]);
+    }
+  }
+  HT_LOG_DEBUG << hydraulis::impl::comm::GetLocalDevice() << ": " << _switch_plan;
+}
+
 // 递归地为ParamBlock创建所有的ParamSlices
 void SwitchExecGraph::CreateParamBlock(ParamBlock& block,
                                       std::vector<int32_t>& slice_num, 
@@ -963,6 +857,10 @@ void SwitchExecGraph::MakeCommGraph(SWITCH_MODE switch_mode, SWITCH_LEVEL switch
     }
     */
     auto define_param_id = define_param->id();
+    // 切分没有变化的param不进入comm graph，由CopyResidentParams直接本地拷贝
+    if (_resident_param_ids.find(define_param_id) != _resident_param_ids.end()) {
+      continue;
+    }
     auto before_it = before_mapping.find(define_param_id);
     bool is_before_active = before_it != before_mapping.end();
     auto after_it = after_mapping.find(define_param_id);
@@ -1132,7 +1030,7 @@ void SwitchExecGraph::MakeCommGraph(SWITCH_MODE switch_mode, SWITCH_LEVEL switch
 
   // 从全局的ParamBlocks视角出发
   // 选择最优的通信方案
-  // 目前最优的是对于每一个ParamBlock的每一个ParamSlice，采用round-robin的算法
+  PlanParamBlocksComm();
   for (auto& param_block_ptr : _param_blocks) {
     param_block_ptr->ParamBlockComm(_send_mapping, _recv_mapping);
   }
@@ -1265,6 +1163,21 @@ void SwitchExecGraph::MakeCommGraph(SWITCH_MODE switch_mode, SWITCH_LEVEL switch
       // now only support buffer when concat happens on a single axis while the other axis is not
       HandleConcatBuffer(comm_result, buffer_comm_results, comp_stream_idx);
     }
+    // 切分没有变化的param不经过comm graph，但after param buffer之后会bind到concat buffer上
+    // 因此按照after param buffer的布局构建concat buffer，并用after param本身占位
+    if (!_resident_params.empty()) {
+      auto after_param_buffer = after_graph->_origin_param_and_optimizer_buckets_map[_dtype]->GetBucket(_bucket_num);
+      std::unordered_map<TensorId, Tensor> after_param_to_buffer_tensor;
+      for (size_t i = 0; i < _comm_results.size(); i++) {
+        after_param_to_buffer_tensor[_comm_results_mapping[_comm_results[i]->id()]->id()] = buffer_comm_results[i];
+      }
+      TensorList ordered_buffer_tensors;
+      for (const auto& after_param : after_param_buffer->tensor_list()) {
+        auto it = after_param_to_buffer_tensor.find(after_param->id());
+        ordered_buffer_tensors.push_back(it != after_param_to_buffer_tensor.end() ? it->second : after_param);
+      }
+      buffer_comm_results = std::move(ordered_buffer_tensors);
+    }
     _concat_buffer = std::make_shared<ParamBuffer>("concat", buffer_comm_results);
     // HT_LOG_INFO << local_device << ": concat buffer has " << _concat_buffer->_tensor_list.size() << " tensor";
   }
@@ -1273,7 +1186,7 @@ void SwitchExecGraph::MakeCommGraph(SWITCH_MODE switch_mode, SWITCH_LEVEL switch
   HT_LOG_DEBUG << local_device << ": make a new comm graph end...";
 }
 
-void SwitchExecGraph::BufferBatchedIsendIrecvExec(const hydraulis::impl::comm::NCCLCommunicationGroup& comm_nccl_group) {
+void SwitchExecGraph::BufferBatchedIsendIrecvExec(const hydraulis::impl::comm::CommunicationGroup& comm_group) {
   auto local_device = hydraulis::impl::comm::GetLocalDevice();
   NDArrayList send_data_list;
   NDArrayList recv_data_list;
@@ -1287,22 +1200,22 @@ void SwitchExecGraph::BufferBatchedIsendIrecvExec(const hydraulis::impl::comm::N
     const auto& send_to_device = kv.first;
     auto send_data = kv.second->AsNDArray();
     HT_LOG_TRACE << local_device << " send to " << send_to_device << ": " << kv.second->tensor_list();
-    tasks.push_back(comm_nccl_group->ISend(send_data, hydraulis::impl::comm::DeviceToWorldRank(send_to_device)));
+    tasks.push_back(comm_group->ISend(send_data, hydraulis::impl::comm::DeviceToWorldRank(send_to_device)));
     send_data_list.push_back(std::move(send_data));
   }
   for (const auto& kv : _recv_buffers) {
     const auto& recv_from_device = kv.first;
     auto recv_data = kv.second->AsNDArray();
     HT_LOG_TRACE << local_device << " recv from " << recv_from_device << ": " << kv.second->tensor_list();
-    tasks.push_back(comm_nccl_group->IRecv(recv_data, hydraulis::impl::comm::DeviceToWorldRank(recv_from_device)));
+    tasks.push_back(comm_group->IRecv(recv_data, hydraulis::impl::comm::DeviceToWorldRank(recv_from_device)));
     recv_data_list.push_back(std::move(recv_data));
   }
-  comm_nccl_group->BatchedISendIRecv(tasks);
+  comm_group->BatchedISendIRecv(tasks);
   HT_LOG_DEBUG << local_device << ": BufferBatchedIsendIrecvExec is done";
 }
 
 void SwitchExecGraph::BufferBatchedIsendIrecv(const Operator& op,
-                                              const hydraulis::impl::comm::NCCLCommunicationGroup& comm_nccl_group,
+                                              const hydraulis::impl::comm::CommunicationGroup& comm_group,
                                               Tensor2NDArrayMap& tensor2data,
                                               Tensor2IntMap& tensor2degrees,
                                               const StreamIndex comp_stream_idx) {
@@ -1357,14 +1270,14 @@ void SwitchExecGraph::BufferBatchedIsendIrecv(const Operator& op,
     NDArrayMeta input_meta = input->meta();
     NDArrayMeta buffer_data_meta = input_meta.set_shape(input->shape()); // contiguous meta!!!
     auto buffer_data = NDArray(buffer_data_meta, buffer->AsStorage(), buffer->GetElementOffest(input));
-    auto event = std::make_unique<hydraulis::impl::CUDAEvent>(local_device);
+    auto event = CreateEvent(local_device);
     auto stream = Stream(local_device, comp_stream_idx);
     event->Record(stream);
     _buffer_transfer_events.emplace_back(std::move(event));
     NDArray::contiguous(data, comp_stream_idx, buffer_data); // data ---> buffer_data
     NDArray::MarkUsedBy(data, stream);
     NDArray::MarkUsedBy(buffer_data, stream);
-    event = std::make_unique<hydraulis::impl::CUDAEvent>(local_device);
+    event = CreateEvent(local_device);
     event->Record(stream);
     _buffer_transfer_events.emplace_back(std::move(event));
     // free memory after op async compute complete
@@ -1386,10 +1299,10 @@ void SwitchExecGraph::BufferBatchedIsendIrecv(const Operator& op,
     HT_ASSERT(!recv_buffer->IsAllocated())
       << "recv buffer shouldn't be allocated yet";
     // use_nccl=true will slow down
-    recv_buffer->Alloc(op_stream, false, comm_nccl_group->GetComm());
+    recv_buffer->Alloc(op_stream);
   }
   op->instantiation_ctx().start[0]->Record(op_stream);
-  BufferBatchedIsendIrecvExec(comm_nccl_group); // 执行BufferBatchedIsendIrecv
+  BufferBatchedIsendIrecvExec(comm_group); // 执行BufferBatchedIsendIrecv
   op->instantiation_ctx().stop[0]->Record(op_stream);
   // HT_LOG_INFO << "BufferBatchedIsendIrecvExec end";
   // 清空send的buffer
@@ -1418,6 +1331,147 @@ void SwitchExecGraph::BufferBatchedIsendIrecv(const Operator& op,
 // context switch
 // 将before graph中的所有params以尽量高效的方式
 // 重新分配到after graph中
+// 增量切换
+// 两个策略往往共享大部分的切分（例如只有pp的边界发生了变化）
+// 此时只需要通信发生变化的部分
+// slice粒度的复用由SwitchPlanner完成（已拥有的slice不会通信）
+// 这里处理param粒度：切分没有变化的param不进入comm graph，直接本地复用
+// 若bucket中的所有param都没有变化，则整个bucket都不需要通信
+bool SwitchExecGraph::DiffParams(SWITCH_MODE switch_mode,
+                                 const std::shared_ptr<ParamBuffer>& before_param_buffer,
+                                 const std::shared_ptr<ParamBuffer>& after_param_buffer) {
+  if (_is_diffed) {
+    return _is_all_resident;
+  }
+  _is_diffed = true;
+  _is_all_resident = false;
+  _is_same_layout = false;
+  _resident_param_ids.clear();
+  _resident_params.clear();
+  // grad不存在_preserved_data，暂不考虑
+  if (switch_mode != SWITCH_MODE::SWITCH_ORIGIN_PARAM_AND_OPTIMIZER) {
+    return false;
+  }
+  auto& before_mapping = _define_graph->GetPlan(_switch_plan_pair.first).tensor_to_exec_tensor_mapping;
+  auto& after_mapping = _define_graph->GetPlan(_switch_plan_pair.second).tensor_to_exec_tensor_mapping;
+  bool is_all_resident = true;
+  // 注意这里只依赖全局的ds union与device group union
+  // 从而保证所有rank得出一致的结论（否则会有rank在等待通信）
+  for (auto& define_param_ref : _define_graph_params_and_opt_vars) {
+    auto& define_param = define_param_ref.get();
+    auto before_it = before_mapping.find(define_param->id());
+    auto after_it = after_mapping.find(define_param->id());
+    bool is_before_active = before_it != before_mapping.end();
+    bool is_after_active = after_it != after_mapping.end();
+    if (!is_before_active && !is_after_active) {
+      continue;
+    }
+    if (is_before_active != is_after_active) {
+      is_all_resident = false;
+      continue;
+    }
+    auto& before_param = before_it->second;
+    auto& after_param = after_it->second;
+    if (before_param->global_shape() != after_param->global_shape()
+        || before_param->dtype() != after_param->dtype()
+        || !before_param->cur_ds_union().check_equal(after_param->cur_ds_union())
+        || !before_param->placement_group_union().check_equal(after_param->placement_group_union())) {
+      is_all_resident = false;
+      continue;
+    }
+    _resident_param_ids.insert(define_param->id());
+    if (before_param_buffer->HasTensor(before_param)) {
+      HT_ASSERT(after_param_buffer->HasTensor(after_param))
+        << after_param << " should be in the after buffer as " << before_param << " is in the before buffer";
+      _resident_params.emplace_back(before_param, after_param);
+    }
+  }
+  _is_all_resident = is_all_resident;
+  if (!_is_all_resident) {
+    return false;
+  }
+  // 本地的buffer布局一致时可以直接共享storage
+  // 否则退化为本地的拷贝（仍然不需要任何通信）
+  _is_same_layout = before_param_buffer->size() == after_param_buffer->size()
+                    && before_param_buffer->tensor_list().size() == _resident_params.size();
+  for (const auto& kv : _resident_params) {
+    if (!_is_same_layout) {
+      break;
+    }
+    _is_same_layout = kv.first->shape() == kv.second->shape()
+                      && before_param_buffer->GetByteOffest(kv.first) == after_param_buffer->GetByteOffest(kv.second);
+  }
+  return true;
+}
+
+void SwitchExecGraph::AliasResidentParams(const std::shared_ptr<ParamBuffer>& before_param_buffer,
+                                          const std::shared_ptr<ParamBuffer>& after_param_buffer,
+                                          const StreamIndex comp_stream_idx) {
+  HT_ASSERT(_is_all_resident)
+    << "only resident params can be aliased";
+  if (_resident_params.empty()) {
+    return;
+  }
+  auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  if (!_is_same_layout) {
+    after_param_buffer->Alloc(Stream(local_device, comp_stream_idx));
+    CopyResidentParams(after_param_buffer, comp_stream_idx);
+    before_param_buffer->Free();
+    return;
+  }
+  // 直接共享storage
+  // after graph只需等待before graph中的update完成
+  auto& before_preserved_data = _switch_graph_pair.first->_preserved_data;
+  auto& after_preserved_data = _switch_graph_pair.second->_preserved_data;
+  auto& run_param_events = _switch_graph_pair.first->_run_param_events;
+  after_param_buffer->Bind(before_param_buffer->AsStorage());
+  for (const auto& kv : _resident_params) {
+    auto& before_param = kv.first;
+    auto& after_param = kv.second;
+    auto after_param_data = NDArray(after_param->meta(),
+                                    after_param_buffer->AsStorage(), 
+                                    after_param_buffer->GetElementOffest(after_param));
+    auto event_it = run_param_events.find(before_param->id());
+    if (event_it != run_param_events.end()) {
+      _switch_graph_pair.second->_switch_param_events[after_param->id()] = std::move(event_it->second);
+      run_param_events.erase(event_it);
+    }
+    before_preserved_data.erase(before_param->id());
+    after_preserved_data[after_param->id()] = after_param_data;
+  }
+  before_param_buffer->Free();
+}
+
+void SwitchExecGraph::CopyResidentParams(const std::shared_ptr<ParamBuffer>& dst_buffer,
+                                         const StreamIndex comp_stream_idx) {
+  auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  auto& before_preserved_data = _switch_graph_pair.first->_preserved_data;
+  auto& after_preserved_data = _switch_graph_pair.second->_preserved_data;
+  auto& run_param_events = _switch_graph_pair.first->_run_param_events;
+  for (const auto& kv : _resident_params) {
+    auto& before_param = kv.first;
+    auto& after_param = kv.second;
+    // 只需等待该param在before graph中的update完成
+    auto event_it = run_param_events.find(before_param->id());
+    if (event_it != run_param_events.end()) {
+      event_it->second->Block(Stream(local_device, comp_stream_idx));
+      run_param_events.erase(event_it);
+    }
+    auto before_param_data_it = before_preserved_data.find(before_param->id());
+    HT_ASSERT(before_param_data_it != before_preserved_data.end())
+      << "something wrong, the data of " << before_param << " to switch in the before graph is not available";
+    auto after_param_data = NDArray(after_param->meta(),
+                                    dst_buffer->AsStorage(), 
+                                    dst_buffer->GetElementOffest(after_param));
+    NDArray::copy(before_param_data_it->second, comp_stream_idx, after_param_data);
+    auto event = CreateEvent(local_device);
+    event->Record(Stream(local_device, comp_stream_idx));
+    _switch_graph_pair.second->_switch_param_events[after_param->id()] = std::move(event);
+    before_preserved_data.erase(before_param->id());
+    after_preserved_data[after_param->id()] = after_param_data;
+  }
+}
+
 void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode, 
                                    SWITCH_LEVEL switch_level, 
                                    std::string switch_name,
@@ -1426,6 +1480,7 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
 
   // utils
   auto local_device = hydraulis::impl::comm::GetLocalDevice();
+  HT_TRACE_SPAN(switch_span, "switch", switch_name);
   auto is_feed_dict_op = [&](const Operator& op) -> bool {
     return Operator::all_output_tensors_of(op, [&](const Tensor& tensor) {
       return _comm_feed_dict.find(tensor->id()) != _comm_feed_dict.end();
@@ -1509,6 +1564,20 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
     }
   }
 
+  // 所有param都已经驻留在目标device上
+  // 直接复用而不需要建立comm graph
+  if (_comm_graph == nullptr && DiffParams(switch_mode, before_param_buffer, after_param_buffer)) {
+    if (switch_level == SWITCH_LEVEL::TOPO) {
+      return;
+    }
+    AliasResidentParams(before_param_buffer, after_param_buffer, comp_stream_idx);
+    HT_LOG_INFO << local_device << ": " << switch_name << " from " << _switch_graph_pair.first->name()
+      << " to " << _switch_graph_pair.second->name() << " is skipped, all params are resident"
+      << ", moved 0 MiB and skipped " << (double)after_param_buffer->size() / (1024 * 1024) << " MiB"
+      << (_is_same_layout ? " (aliased)" : " (local copy)");
+    return;
+  }
+
   // 如果有cache好的_comm_graph
   // 那么直接使用即可
   // 否则需要重新建立
@@ -1529,6 +1598,7 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
     }
   } else {
     TIK(switch_params_making);
+    HT_TRACE_SPAN(making_span, "switch", switch_name + " making graph & plan");
     HT_ASSERT(_comm_results.empty())
       << "no comm result should exist";
     // *建图*
@@ -1573,12 +1643,17 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
   }
 
   // 如果该device不用参与该次热切换
-  // 这里直接返回即可
+  // 此时本地只可能有切分没有变化的param，直接本地拷贝即可
   if (_comm_set.find(local_device) == _comm_set.end()) {
+    if (switch_level != SWITCH_LEVEL::TOPO && !_resident_params.empty()) {
+      after_param_buffer->Alloc(Stream(local_device, comp_stream_idx));
+      CopyResidentParams(after_param_buffer, comp_stream_idx);
+      before_param_buffer->Free();
+    }
     return;
   }
   if (_profile_level <= SWITCH_PROFILE_LEVEL::MEMORY) {
-    GetCUDAProfiler(local_device)->PrintCurrMemoryInfo("switch exec graph before warm up");
+    GetMemoryProfiler(local_device)->PrintCurrMemoryInfo("switch exec graph before warm up");
   }
   // 热启动nccl的all-to-all通信
   // warm up the comm group
@@ -1587,7 +1662,7 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
   std::transform(_comm_set.begin(), _comm_set.end(), comm_ranks.begin(), 
                  [&](const Device& device) { return hydraulis::impl::comm::DeviceToWorldRank(device); });
   std::sort(comm_ranks.begin(), comm_ranks.end());
-  auto& comm_nccl_group = hydraulis::impl::comm::NCCLCommunicationGroup::GetOrCreate(comm_ranks, Stream(local_device, comm_stream_idx));
+  auto comm_group = hydraulis::impl::comm::GetOrCreateCommGroup(comm_ranks, Stream(local_device, comm_stream_idx));
   if (_bucket_num == -1) {
     std::call_once(warmup_flags[comm_device_group], 
                    WarmUpComm, 
@@ -1608,12 +1683,12 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
     // 这里对参与热切换的rank进行同步
     std::vector<Device> devices(_comm_set.begin(), _comm_set.end());
     DeviceGroup device_group{devices};
-    auto& group = hydraulis::impl::comm::NCCLCommunicationGroup::GetOrCreate(hydraulis::impl::comm::DeviceGroupToWorldRanks(device_group), local_device);
+    auto group = hydraulis::impl::comm::GetOrCreateCommGroup(hydraulis::impl::comm::DeviceGroupToWorldRanks(device_group), local_device);
     if (_comm_set.size() >= 2) {
       group->Barrier(true);
     }
     if (_profile_level <= SWITCH_PROFILE_LEVEL::MEMORY) {
-      GetCUDAProfiler(local_device)->PrintCurrMemoryInfo("switch exec graph begin");
+      GetMemoryProfiler(local_device)->PrintCurrMemoryInfo("switch exec graph begin");
     }
     if (_profile_level <= SWITCH_PROFILE_LEVEL::NVLINK) {
       GetCUDAProfiler(local_device)->PrintNvlinkStart();
@@ -1622,6 +1697,7 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
   
   // 启动！
   TIK(switch_params_running); // 开始计时
+  HT_TRACE_SPAN(running_span, "switch", switch_name + " running");
   Tensor2NDArrayMap tensor2data;
   Tensor2IntMap tensor2degrees;
   std::set<TensorId> useful_tensors;
@@ -1675,11 +1751,11 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
     }
     if (!send_buffer->IsAllocated()) {
       // use_nccl=true will slow down
-      send_buffer->Alloc(Stream(local_device, comm_stream_idx), false, comm_nccl_group->GetComm());
+      send_buffer->Alloc(Stream(local_device, comm_stream_idx));
     }
   }
   if (_profile_level <= SWITCH_PROFILE_LEVEL::MEMORY) {
-    GetCUDAProfiler(local_device)->PrintCurrMemoryInfo("switch exec graph after alloc send buffers");
+    GetMemoryProfiler(local_device)->PrintCurrMemoryInfo("switch exec graph after alloc send buffers");
   }
   // 运行topo
   for (auto& op_ref : _comm_topo) {
@@ -1693,6 +1769,14 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
         << "feed dict op must be a placeholder in the comm graph";
       auto tensor_id = op->output(0)->id();
       tensor2data[tensor_id] = _comm_feed_dict[tensor_id][0];
+      // 等待该param在before graph中的最后一次使用（update）完成
+      // 从而可以与上一个step的尾部overlap
+      auto& run_param_events = _switch_graph_pair.first->_run_param_events;
+      auto event_it = run_param_events.find(_comm_feed_dict_mapping[tensor_id]->id());
+      if (event_it != run_param_events.end()) {
+        event_it->second->Block(Stream(local_device, comp_stream_idx));
+        run_param_events.erase(event_it);
+      }
       // 清feed_dict
       _comm_feed_dict.erase(tensor_id);
       // 清before_graph的_preserved_data
@@ -1711,7 +1795,7 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
     // 特殊处理2
     // 使用聚合的buffer进行通信
     if (is_batched_isend_irecv_op(op)) {
-      BufferBatchedIsendIrecv(op, comm_nccl_group, tensor2data, tensor2degrees, comp_stream_idx);
+      BufferBatchedIsendIrecv(op, comm_group, tensor2data, tensor2degrees, comp_stream_idx);
       continue;
     }
     // 特殊处理3
@@ -1777,13 +1861,13 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
         if (switch_mode == SWITCH_MODE::SWITCH_ORIGIN_PARAM 
             || switch_mode == SWITCH_MODE::SWITCH_TRANSFER_PARAM
             || switch_mode == SWITCH_MODE::SWITCH_ORIGIN_PARAM_AND_OPTIMIZER) {
-          auto event = std::make_unique<hydraulis::impl::CUDAEvent>(op->placement());
+          auto event = CreateEvent(op->placement());
           event->Record(op->instantiation_ctx().stream());
           _switch_graph_pair.second->_switch_param_events[it->second->id()] = std::move(event);
         }
         // 如果是grad
         else {
-          auto event = std::make_unique<hydraulis::impl::CUDAEvent>(op->placement());
+          auto event = CreateEvent(op->placement());
           event->Record(op->instantiation_ctx().stream());
           _switch_graph_pair.second->_switch_grad_events[it->second->id()] = std::move(event);
         }
@@ -1791,6 +1875,15 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
     }
   }
   HT_LOG_DEBUG << "switch exec graph topo end";
+  // 切分没有变化的param直接拷贝到concat buffer中after param对应的位置
+  if (!_resident_params.empty()) {
+    HT_ASSERT(_use_concat_buffer)
+      << "resident params can only be copied into the concat buffer";
+    if (!_concat_buffer->IsAllocated()) {
+      _concat_buffer->Alloc(Stream(local_device, comp_stream_idx));
+    }
+    CopyResidentParams(_concat_buffer, comp_stream_idx);
+  }
   // 将结果赋值给after graph
   for (const auto& kv : _comm_results_mapping) {
     auto it = tensor2data.find(kv.first);
@@ -1866,10 +1959,13 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
     if (_comm_set.size() >= 2) {
       std::vector<Device> devices(_comm_set.begin(), _comm_set.end());
       DeviceGroup device_group{devices};
-      auto& group = hydraulis::impl::comm::NCCLCommunicationGroup::GetOrCreate(hydraulis::impl::comm::DeviceGroupToWorldRanks(device_group), local_device);
+      auto group = hydraulis::impl::comm::GetOrCreateCommGroup(hydraulis::impl::comm::DeviceGroupToWorldRanks(device_group), local_device);
       group->Barrier(true);
     }
-    HT_LOG_WARN << local_device << ": " << switch_name << " running time = " << COST_MSEC(switch_params_running) << " ms";
+    HT_LOG_WARN << local_device << ": " << switch_name << " running time = " << COST_MSEC(switch_params_running) << " ms"
+      << ", predicted time = " << _switch_plan.predicted_time_ms << " ms";
+    hydraulis::impl::Tracer::Counter("switch", "switch running time (ms)", COST_MSEC(switch_params_running));
+    hydraulis::impl::Tracer::Counter("switch", "switch predicted time (ms)", _switch_plan.predicted_time_ms);
     char* switch_log_file = std::getenv("HYDRAULIS_SWITCH_LOG_FILE");
     if (switch_log_file != nullptr && hydraulis::impl::comm::GetWorldRank() == 0) {
       std::ofstream file;
@@ -1882,7 +1978,7 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
       }
     }
     if (_profile_level <= SWITCH_PROFILE_LEVEL::MEMORY) {
-      GetCUDAProfiler(local_device)->PrintCurrMemoryInfo("switch exec graph end");
+      GetMemoryProfiler(local_device)->PrintCurrMemoryInfo("switch exec graph end");
     }
     if (_profile_level <= SWITCH_PROFILE_LEVEL::NVLINK) {
       GetCUDAProfiler(local_device)->PrintNvlinkEnd();
@@ -1892,8 +1988,18 @@ void SwitchExecGraph::SwitchParams(SWITCH_MODE switch_mode,
   
   // memory debug use
   // hydraulis::impl::comm::EmptyNCCLCache();
+  // moved为本地接收的字节数，skipped为本地已拥有而不需要通信的字节数
+  auto recv_it = _switch_plan.recv_bytes.find(local_device);
+  auto kept_it = _switch_plan.kept_bytes.find(local_device);
+  size_t moved_bytes = recv_it != _switch_plan.recv_bytes.end() ? recv_it->second : 0;
+  size_t skipped_bytes = kept_it != _switch_plan.kept_bytes.end() ? kept_it->second : 0;
+  for (const auto& kv : _resident_params) {
+    skipped_bytes += kv.second->numel() * DataType2Size(kv.second->dtype());
+  }
   HT_LOG_INFO << local_device << ": " << switch_name << " from " << _switch_graph_pair.first->name()
-   << " to " << _switch_graph_pair.second->name() << " is done (async)";
+    << " to " << _switch_graph_pair.second->name() << " is done (async)"
+    << ", moved " << (double)moved_bytes / (1024 * 1024) << " MiB"
+    << " and skipped " << (double)skipped_bytes / (1024 * 1024) << " MiB";
   // HT_RUNTIME_ERROR << local_device << ": breakpoint";
 }
 
@@ -2169,6 +2275,7 @@ Tensor ComplexExecComm::Instantiate(StreamIndex comm_stream_idx, bool ignore_sha
   }
   HT_ASSERT(_param_blocks.size() == 1)
     << "size wrong";
+  PlanParamBlocksComm();
   for (auto& param_block_ptr : _param_blocks) {
     param_block_ptr->ParamBlockComm(_send_mapping, _recv_mapping);
   }
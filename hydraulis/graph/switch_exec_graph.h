@@ -9,6 +9,7 @@
 #include "hydraulis/graph/tensor.h"
 #include "hydraulis/graph/operator.h"
 #include "hydraulis/graph/init/initializer.h"
+#include "hydraulis/graph/switch_planner.h"
 #include "hydraulis/impl/communication/comm_group.h"
 #include "hydraulis/impl/communication/nccl_comm_group.h"
 #include <nccl.h>
@@ -17,20 +18,10 @@ namespace hydraulis {
 namespace graph {
 
 using ExecGraphPair = std::pair<std::shared_ptr<ExecutableGraph>, std::shared_ptr<ExecutableGraph>>;
-using Device2Val = std::unordered_map<Device, size_t>;
-using DevicePair2Val = std::unordered_map<std::pair<Device, Device>, size_t>;
 using Device2DTListPairMap = std::unordered_map<Device, std::pair<std::vector<Device>, std::vector<Tensor>>>;
 
 std::ostream& operator<<(std::ostream& os, const SwitchExecGraph& switcher);
 
-enum class SWITCH_ALGORITHM_LEVEL : int8_t {
-  FCFS = 0,
-  ROUND_ROBIN,
-  MULTI_NODE_ROUND_ROBIN,
-  GREEDY,
-  NEW_GREEDY
-};
-
 enum class SWITCH_PROFILE_LEVEL : int8_t {
   TRACE = 0,
   MEMORY,
@@ -53,26 +44,6 @@ enum class SWITCH_LEVEL : int8_t {
   DIRECT_BIND
 };
 
-enum class P2P_ROUTE_LEVEL : int8_t {
-  NVLINK = 0,
-  PCIE,
-  NET
-};
-
-class P2PRoute {
-  public:
-    P2PRoute(const P2P_ROUTE_LEVEL& route_level = P2P_ROUTE_LEVEL::NVLINK):
-      _route_level(route_level) {   
-      }
-
-    const P2P_ROUTE_LEVEL& route_level() const {
-      return _route_level;
-    }
-  
-  protected:
-    P2P_ROUTE_LEVEL _route_level;
-};
-
 class ParamBuffer {
   protected:
     friend class SwitchExecGraph;
@@ -383,6 +354,15 @@ class ParamSlice {
 
     void AddNeededSliceInst(const Device& device, const Tensor& tensor);
 
+    // 该slice的通信需求（交给SwitchPlanner进行规划）
+    SwitchSliceDemand CommDemand() const;
+
+    void SetPlannedSenders(const std::vector<int32_t>& senders) {
+      HT_ASSERT(senders.size() == _needed_devices.size())
+        << "planned senders should be aligned with the needed devices";
+      _planned_senders = senders;
+    }
+
     void ParamSliceComm(Device2DTListPairMap& send_mapping, Device2DTListPairMap& recv_mapping);
 
   protected:
@@ -399,8 +379,8 @@ class ParamSlice {
     std::vector<Device> _owned_devices;
     std::vector<Device> _needed_devices;
 
-    // level 0, round-robin alg
-    size_t _round_robin = 0;
+    // 规划的结果：每个needed device从哪个owned device接收（-1表示自己已有）
+    std::vector<int32_t> _planned_senders;
 };
 
 class ParamBlock {
@@ -551,6 +531,8 @@ class SwitchExecGraph {
           _algorithm_level = SWITCH_ALGORITHM_LEVEL::MULTI_NODE_ROUND_ROBIN;
         } else if (algorithm_level == "ROUND_ROBIN") {
           _algorithm_level = SWITCH_ALGORITHM_LEVEL::ROUND_ROBIN;
+        } else if (algorithm_level == "MIN_MAKESPAN") {
+          _algorithm_level = SWITCH_ALGORITHM_LEVEL::MIN_MAKESPAN;
         } else if (algorithm_level == "FCFS") {
           _algorithm_level = SWITCH_ALGORITHM_LEVEL::FCFS;
         } else {
@@ -620,15 +602,34 @@ class SwitchExecGraph {
                                int32_t uncontiguous_multiple, int32_t uncontiguous_slice_multiple,
                                const StreamIndex comp_stream_idx);
     
+    // 逐个比较切换前后param的ds union与device group union
+    // 一致的param已经驻留在目标device上，不进入comm graph
+    // 返回是否全部一致（此时不需要任何通信）
+    bool DiffParams(SWITCH_MODE switch_mode,
+                    const std::shared_ptr<ParamBuffer>& before_param_buffer,
+                    const std::shared_ptr<ParamBuffer>& after_param_buffer);
+
+    // 直接复用before graph中已驻留的param（不建立comm graph）
+    void AliasResidentParams(const std::shared_ptr<ParamBuffer>& before_param_buffer,
+                             const std::shared_ptr<ParamBuffer>& after_param_buffer,
+                             const StreamIndex comp_stream_idx);
+
+    // 将本地已驻留的param拷贝到dst_buffer中after param对应的位置
+    void CopyResidentParams(const std::shared_ptr<ParamBuffer>& dst_buffer,
+                            const StreamIndex comp_stream_idx);
+
+    // 从全局的ParamBlocks视角出发规划通信方案（不涉及任何实际通信）
+    void PlanParamBlocksComm();
+
     void MakeCommGraph(SWITCH_MODE switch_mode,
                        SWITCH_LEVEL switch_level,
                        const StreamIndex comp_stream_idx,
                        const StreamIndex comm_stream_idx);
 
-    void BufferBatchedIsendIrecvExec(const hydraulis::impl::comm::NCCLCommunicationGroup& comm_nccl_group);
+    void BufferBatchedIsendIrecvExec(const hydraulis::impl::comm::CommunicationGroup& comm_group);
     
     void BufferBatchedIsendIrecv(const Operator& op,
-                                 const hydraulis::impl::comm::NCCLCommunicationGroup& comm_nccl_group,
+                                 const hydraulis::impl::comm::CommunicationGroup& comm_group,
                                  Tensor2NDArrayMap& tensor2data,
                                  Tensor2IntMap& tensor2degrees,
                                  const StreamIndex comp_stream_idx);
@@ -663,18 +664,22 @@ class SwitchExecGraph {
 
     // comm plan related
     SWITCH_ALGORITHM_LEVEL _algorithm_level = SWITCH_ALGORITHM_LEVEL::NEW_GREEDY; // 采用的算法
-    DevicePair2Val _p2p_val_mapping; // deprecated: 记录了每两个device之间的p2p通信通路的总value（目前value是指次数）
-    // 同一个device的intra和inter的通信可以overlap
-    Device2Val _intra_device_val_mapping; // 记录intra node的device通信的value（目前value指发送数据的量除以带宽）（**热切换场景下接收数据的量固定）
-    Device2Val _inter_device_val_mapping; // 记录inter node的device通信的value（目前value指发送数据的量除以带宽）（**热切换场景下接收数据的量固定）
+    SwitchPlan _switch_plan; // 规划得到的通信方案（包括每条通路的字节数与预测时间）
     Device2DTListPairMap _send_mapping; // 记录了每个device要send的(device, tensor)的pair
     Device2DTListPairMap _recv_mapping; // 记录了每个device要recv的(device, placeholder的tensor（之后会替换）)的pair
     std::vector<std::shared_ptr<ParamBlock>> _param_blocks; // 记录了graph所包含的所有的抽象ParamBlock
 
+    // incremental switch related
+    bool _is_diffed = false; // 是否已经进行过DiffParams
+    bool _is_all_resident = false; // 是否所有param都已经驻留在目标device上
+    std::unordered_set<TensorId> _resident_param_ids; // 切分没有变化的define graph param
+    bool _is_same_layout = false; // 切换前后的buffer布局是否一致（一致则可以直接共享storage）
+    std::vector<std::pair<Tensor, Tensor>> _resident_params; // 本地已驻留的(before param, after param)
+
     // memory optimization related
     std::unordered_map<Device, std::shared_ptr<ParamBuffer>> _send_buffers; // 记录通信时给每个device聚合发送时所用的buffer
     std::unordered_map<Device, std::shared_ptr<ParamBuffer>> _recv_buffers; // 记录通信时从每个device聚合接收时所用的buffer
-    std::vector<std::unique_ptr<hydraulis::impl::CUDAEvent>> _buffer_transfer_events; // 记录将原先的param构成一长条buffer的events
+    std::vector<std::unique_ptr<Event>> _buffer_transfer_events; // 记录将原先的param构成一长条buffer的events
     bool _use_concat_buffer = true; // 是否对concat算子的输出做一个buffer
     std::shared_ptr<ParamBuffer> _concat_buffer; // 通信后从_recv_buffers里concat形成的所有param构成的buffer
 
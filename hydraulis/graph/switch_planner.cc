@@ -0,0 +1,386 @@
+#include "hydraulis/graph/switch_planner.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+
+namespace hydraulis {
+namespace graph {
+
+static double GetEnvDouble(const char* name, double default_value) {
+  char* env = std::getenv(name);
+  if (env == nullptr) {
+    return default_value;
+  }
+  return std::stod(env);
+}
+
+static inline int RouteClass(P2P_ROUTE_LEVEL route_level) {
+  // 机内与跨机的通信使用不同的硬件，可以overlap
+  return route_level >= P2P_ROUTE_LEVEL::NET ? 1 : 0;
+}
+
+SwitchTopology::SwitchTopology() {
+  set_bandwidth(P2P_ROUTE_LEVEL::NVLINK, 150);
+  set_bandwidth(P2P_ROUTE_LEVEL::PCIE, 20);
+  set_bandwidth(P2P_ROUTE_LEVEL::NET, 12.5);
+  set_latency(P2P_ROUTE_LEVEL::NVLINK, 10);
+  set_latency(P2P_ROUTE_LEVEL::PCIE, 15);
+  set_latency(P2P_ROUTE_LEVEL::NET, 30);
+}
+
+SwitchTopology SwitchTopology::FromEnv() {
+  SwitchTopology topology;
+  char* intra_env = std::getenv("HYDRAULIS_SWITCH_TOPO_INTRA_ROUTE");
+  if (intra_env != nullptr) {
+    std::string intra_route = intra_env;
+    std::transform(intra_route.begin(), intra_route.end(), intra_route.begin(), ::toupper);
+    if (intra_route == "NVLINK") {
+      topology.SetIntraNodeRoute(P2P_ROUTE_LEVEL::NVLINK);
+    } else if (intra_route == "PCIE") {
+      topology.SetIntraNodeRoute(P2P_ROUTE_LEVEL::PCIE);
+    } else {
+      HT_RUNTIME_ERROR << "NotImplementedError";
+    }
+  }
+  const std::vector<std::pair<P2P_ROUTE_LEVEL, std::string>> levels = {
+    {P2P_ROUTE_LEVEL::NVLINK, "NVLINK"},
+    {P2P_ROUTE_LEVEL::PCIE, "PCIE"},
+    {P2P_ROUTE_LEVEL::NET, "NET"}
+  };
+  for (const auto& level : levels) {
+    std::string prefix = "HYDRAULIS_SWITCH_TOPO_" + level.second;
+    topology.set_bandwidth(level.first, GetEnvDouble((prefix + "_BW").c_str(),
+                                                     topology.bandwidth(level.first) / 1e9));
+    topology.set_latency(level.first, GetEnvDouble((prefix + "_LATENCY").c_str(),
+                                                   topology.latency(level.first) / 1e-6));
+  }
+  return topology;
+}
+
+const P2PRoute& SwitchTopology::GetP2PRoute(const Device& from, const Device& to) const {
+  auto p2p_pair = std::make_pair(from, to);
+  auto it = _routes.find(p2p_pair);
+  if (it != _routes.end()) {
+    return it->second;
+  }
+  if (Device::compare_hostname(from, to) != 0) {
+    _routes[p2p_pair] = P2PRoute(P2P_ROUTE_LEVEL::NET);
+  } else {
+    _routes[p2p_pair] = P2PRoute(_intra_node_route);
+  }
+  return _routes[p2p_pair];
+}
+
+void SwitchTopology::SetP2PRoute(const Device& from, const Device& to, P2P_ROUTE_LEVEL route_level) {
+  _routes[std::make_pair(from, to)] = P2PRoute(route_level);
+  _routes[std::make_pair(to, from)] = P2PRoute(route_level);
+}
+
+std::ostream& operator<<(std::ostream& os, const SwitchPlan& plan) {
+  os << "switch_plan(transfers=" << plan.num_transfers
+    << ", moved=" << (double)plan.moved_bytes / (1024 * 1024) << " MiB"
+    << ", reused=" << (double)plan.reused_bytes / (1024 * 1024) << " MiB"
+    << ", links=" << plan.link_bytes.size()
+    << ", predicted time=" << plan.predicted_time_ms << " ms)";
+  return os;
+}
+
+double SwitchPlanner::PredictTime(const DevicePair2Val& link_bytes) const {
+  // [device][route class]
+  std::unordered_map<Device, std::array<double, 2>> send_time, recv_time;
+  double makespan = 0;
+  for (const auto& kv : link_bytes) {
+    const auto& send_device = kv.first.first;
+    const auto& recv_device = kv.first.second;
+    auto route_level = _topology.GetP2PRoute(send_device, recv_device).route_level();
+    auto cls = RouteClass(route_level);
+    auto time = _topology.TransferTime(route_level, kv.second);
+    auto& send = send_time[send_device][cls];
+    auto& recv = recv_time[recv_device][cls];
+    send += time;
+    recv += time;
+    makespan = std::max({makespan, send, recv});
+  }
+  return makespan * 1e3;
+}
+
+SwitchPlan SwitchPlanner::Plan(const std::vector<SwitchSliceDemand>& demands) const {
+  SwitchPlan plan;
+  plan.senders.resize(demands.size());
+  // 需要通信的(demand, needed)
+  std::vector<std::pair<size_t, size_t>> transfers;
+  for (size_t i = 0; i < demands.size(); ++i) {
+    const auto& demand = demands[i];
+    if (demand.owned_devices.empty()) {
+      // 该slice无法进行热切换
+      // 需要从CPU/SSD中加载
+      // TODO
+      HT_RUNTIME_ERROR << "NotImplementedError: hot switch doesn't work";
+    }
+    plan.senders[i].resize(demand.needed_devices.size(), -1);
+    for (size_t j = 0; j < demand.needed_devices.size(); ++j) {
+      // 如果自己已经有了，那么就不需要通信了
+      auto it = std::find(demand.owned_devices.begin(), demand.owned_devices.end(),
+                          demand.needed_devices[j]);
+      if (it != demand.owned_devices.end()) {
+        plan.senders[i][j] = -1;
+        plan.reused_bytes += demand.bytes;
+        plan.kept_bytes[demand.needed_devices[j]] += demand.bytes;
+      } else {
+        transfers.emplace_back(i, j);
+      }
+    }
+  }
+
+  auto route_level_of = [&](const Device& from, const Device& to) {
+    return _topology.GetP2PRoute(from, to).route_level();
+  };
+
+  if (_algorithm_level == SWITCH_ALGORITHM_LEVEL::MIN_MAKESPAN) {
+    // bottleneck-link aware的LPT贪心
+    // 大的slice先分配，每次选择使得收发两端端口的完成时间最小的发送方
+    std::stable_sort(transfers.begin(), transfers.end(),
+                     [&](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+                       return demands[a.first].bytes > demands[b.first].bytes;
+                     });
+    std::unordered_map<Device, std::array<double, 2>> send_time, recv_time;
+    for (const auto& transfer : transfers) {
+      const auto& demand = demands[transfer.first];
+      const auto& recv_device = demand.needed_devices[transfer.second];
+      int32_t best_send_num = 0;
+      double best_cost = std::numeric_limits<double>::max();
+      double best_add = std::numeric_limits<double>::max();
+      for (size_t k = 0; k < demand.owned_devices.size(); ++k) {
+        const auto& send_device = demand.owned_devices[k];
+        auto route_level = route_level_of(send_device, recv_device);
+        auto cls = RouteClass(route_level);
+        // 同一对device之间的slice会被聚合，延迟只需计算一次
+        bool new_link = plan.link_bytes.find(std::make_pair(send_device, recv_device)) == plan.link_bytes.end();
+        double add = demand.bytes / _topology.bandwidth(route_level)
+                     + (new_link ? _topology.latency(route_level) : 0);
+        double cost = std::max(send_time[send_device][cls], recv_time[recv_device][cls]) + add;
+        if (cost < best_cost || (cost == best_cost && add < best_add)) {
+          best_cost = cost;
+          best_add = add;
+          best_send_num = k;
+        }
+      }
+      const auto& send_device = demand.owned_devices[best_send_num];
+      auto route_level = route_level_of(send_device, recv_device);
+      auto cls = RouteClass(route_level);
+      bool new_link = plan.link_bytes.find(std::make_pair(send_device, recv_device)) == plan.link_bytes.end();
+      double add = demand.bytes / _topology.bandwidth(route_level)
+                   + (new_link ? _topology.latency(route_level) : 0);
+      send_time[send_device][cls] += add;
+      recv_time[recv_device][cls] += add;
+      plan.senders[transfer.first][transfer.second] = best_send_num;
+      plan.link_bytes[std::make_pair(send_device, recv_device)] += demand.bytes;
+    }
+  } else {
+    // 以下算法与slice的遍历顺序相关
+    std::vector<size_t> round_robins(demands.size(), 0);
+    DevicePair2Val p2p_val_mapping; // 记录了每两个device之间的p2p通信通路的总value（目前value是指次数）
+    // 同一个device的intra和inter的通信可以overlap
+    Device2Val intra_device_val_mapping; // 记录intra node的device发送数据的量
+    Device2Val inter_device_val_mapping; // 记录inter node的device发送数据的量
+    for (const auto& transfer : transfers) {
+      const auto& demand = demands[transfer.first];
+      const auto& owned_devices = demand.owned_devices;
+      const auto& recv_device = demand.needed_devices[transfer.second];
+      size_t owned_len = owned_devices.size();
+      size_t best_send_num = 0;
+      // FCFS or round-robin
+      if (_algorithm_level == SWITCH_ALGORITHM_LEVEL::FCFS
+          || _algorithm_level == SWITCH_ALGORITHM_LEVEL::ROUND_ROBIN
+          || _algorithm_level == SWITCH_ALGORITHM_LEVEL::MULTI_NODE_ROUND_ROBIN) {
+        auto& round_robin = round_robins[transfer.first];
+        best_send_num = round_robin;
+        // 多node情形下要额外考虑跨机间通信
+        // 尽可能将其避免（除非避免不了）
+        if (_algorithm_level == SWITCH_ALGORITHM_LEVEL::MULTI_NODE_ROUND_ROBIN) {
+          size_t round = 0;
+          while (round < owned_len) {
+            best_send_num = (round_robin + round) % owned_len;
+            if (route_level_of(owned_devices[best_send_num], recv_device) >= P2P_ROUTE_LEVEL::NET) {
+              round++;
+            } else {
+              break;
+            }
+          }
+        }
+        if (_algorithm_level == SWITCH_ALGORITHM_LEVEL::ROUND_ROBIN
+            || _algorithm_level == SWITCH_ALGORITHM_LEVEL::MULTI_NODE_ROUND_ROBIN) {
+          round_robin++;
+        }
+        if (round_robin == owned_len) {
+          round_robin = 0;
+        }
+      }
+      // 按照已经通信的次数进行greedy（即选取已通信中p2p次数最小的）
+      if (_algorithm_level == SWITCH_ALGORITHM_LEVEL::GREEDY) {
+        std::pair<Device, Device> best_p2p;
+        size_t min_val = std::numeric_limits<size_t>::max();
+        for (size_t j = 0; j < owned_len; ++j) {
+          // p2p是双向通路
+          // 规定device编号小的在前
+          std::pair<Device, Device> p2p;
+          if (owned_devices[j] < recv_device) {
+            p2p = std::make_pair(owned_devices[j], recv_device);
+          } else {
+            p2p = std::make_pair(recv_device, owned_devices[j]);
+          }
+          auto it = p2p_val_mapping.find(p2p);
+          // 相当于通信了0次
+          if (it == p2p_val_mapping.end()) {
+            best_p2p = p2p;
+            best_send_num = j;
+            break;
+          }
+          // 选择通信次数最小的
+          if (it->second < min_val) {
+            min_val = it->second;
+            best_p2p = p2p;
+            best_send_num = j;
+          }
+        }
+        p2p_val_mapping[best_p2p] += 1;
+      }
+      // 2024.2.25
+      // 修正版greedy
+      if (_algorithm_level == SWITCH_ALGORITHM_LEVEL::NEW_GREEDY) {
+        size_t round = 0;
+        size_t min_val = std::numeric_limits<size_t>::max();
+        for (size_t j = 0; j < owned_len; ++j) {
+          // 能不跨机，就不跨机
+          if (route_level_of(owned_devices[j], recv_device) >= P2P_ROUTE_LEVEL::NET) {
+            round++;
+            continue;
+          }
+          auto it = intra_device_val_mapping.find(owned_devices[j]);
+          // 相当于通信为0
+          if (it == intra_device_val_mapping.end()) {
+            best_send_num = j;
+            break;
+          }
+          // 选择通信量最小的
+          if (it->second < min_val) {
+            min_val = it->second;
+            best_send_num = j;
+          }
+        }
+        // 如果不得不跨机，那么再扫一遍
+        if (round == owned_len) {
+          for (size_t j = 0; j < owned_len; ++j) {
+            auto it = inter_device_val_mapping.find(owned_devices[j]);
+            if (it == inter_device_val_mapping.end()) {
+              best_send_num = j;
+              break;
+            }
+            if (it->second < min_val) {
+              min_val = it->second;
+              best_send_num = j;
+            }
+          }
+        }
+        if (route_level_of(owned_devices[best_send_num], recv_device) >= P2P_ROUTE_LEVEL::NET) {
+          inter_device_val_mapping[owned_devices[best_send_num]] += demand.bytes;
+        } else {
+          intra_device_val_mapping[owned_devices[best_send_num]] += demand.bytes;
+        }
+      }
+      plan.senders[transfer.first][transfer.second] = static_cast<int32_t>(best_send_num);
+      plan.link_bytes[std::make_pair(owned_devices[best_send_num], recv_device)] += demand.bytes;
+    }
+  }
+
+  plan.num_transfers = transfers.size();
+  for (const auto& kv : plan.link_bytes) {
+    plan.send_bytes[kv.first.first] += kv.second;
+    plan.recv_bytes[kv.first.second] += kv.second;
+    plan.moved_bytes += kv.second;
+  }
+  plan.predicted_time_ms = PredictTime(plan.link_bytes);
+  return plan;
+}
+
+std::vector<SwitchPlannerBenchmarkResult> BenchmarkSwitchPlanner(size_t num_nodes, size_t gpus_per_node,
+                                                                 size_t before_tp, size_t after_tp,
+                                                                 size_t num_params, size_t param_mb) {
+  size_t num_devices = num_nodes * gpus_per_node;
+  HT_VALUE_ERROR_IF(num_devices == 0 || before_tp == 0 || after_tp == 0 || num_params == 0
+                    || num_devices % before_tp != 0 || num_devices % after_tp != 0)
+    << "Cannot benchmark the switch planner with " << num_nodes << " x " << gpus_per_node
+    << " devices, before_tp = " << before_tp << ", after_tp = " << after_tp
+    << " and num_params = " << num_params;
+  std::vector<Device> devices;
+  for (size_t n = 0; n < num_nodes; n++) {
+    for (size_t g = 0; g < gpus_per_node; g++) {
+      devices.emplace_back(kCUDA, g, "node" + std::to_string(n));
+    }
+  }
+  // 两种切分的公共细分
+  size_t num_slices = std::lcm(before_tp, after_tp);
+  size_t after_dp = num_devices / after_tp;
+  std::vector<SwitchSliceDemand> demands;
+  for (size_t p = 0; p < num_params; p++) {
+    size_t param_bytes = param_mb * 1024 * 1024 * (p % 4 + 1) / 4;
+    for (size_t s = 0; s < num_slices; s++) {
+      SwitchSliceDemand demand;
+      demand.bytes = param_bytes / num_slices;
+      for (size_t d = 0; d < num_devices; d++) {
+        if (d % before_tp == s / (num_slices / before_tp))
+          demand.owned_devices.push_back(devices[d]);
+        if (d / after_dp == s / (num_slices / after_tp))
+          demand.needed_devices.push_back(devices[d]);
+      }
+      demands.push_back(std::move(demand));
+    }
+  }
+
+  // 与热切换相同的拓扑，但不读取环境变量，保证结果可以复现
+  SwitchTopology topology;
+  const std::vector<std::pair<SWITCH_ALGORITHM_LEVEL, std::string>> algorithms = {
+    {SWITCH_ALGORITHM_LEVEL::FCFS, "FCFS"},
+    {SWITCH_ALGORITHM_LEVEL::ROUND_ROBIN, "ROUND_ROBIN"},
+    {SWITCH_ALGORITHM_LEVEL::MULTI_NODE_ROUND_ROBIN, "MULTI_NODE_ROUND_ROBIN"},
+    {SWITCH_ALGORITHM_LEVEL::GREEDY, "GREEDY"},
+    {SWITCH_ALGORITHM_LEVEL::NEW_GREEDY, "NEW_GREEDY"},
+    {SWITCH_ALGORITHM_LEVEL::MIN_MAKESPAN, "MIN_MAKESPAN"}
+  };
+  auto rank_of = [&](const Device& device) {
+    return static_cast<int32_t>(std::find(devices.begin(), devices.end(), device) - devices.begin());
+  };
+  std::vector<SwitchPlannerBenchmarkResult> results;
+  for (const auto& algorithm : algorithms) {
+    SwitchPlanner planner(algorithm.first, topology);
+    auto start = std::chrono::steady_clock::now();
+    auto plan = planner.Plan(demands);
+    SwitchPlannerBenchmarkResult result;
+    result.algorithm = algorithm.second;
+    result.plan_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.predicted_time_ms = plan.predicted_time_ms;
+    result.num_transfers = plan.num_transfers;
+    result.moved_bytes = plan.moved_bytes;
+    result.reused_bytes = plan.reused_bytes;
+    for (const auto& kv : plan.link_bytes) {
+      bool inter_node = topology.GetP2PRoute(kv.first.first, kv.first.second).route_level() >= P2P_ROUTE_LEVEL::NET;
+      result.link_bytes.push_back({rank_of(kv.first.first), rank_of(kv.first.second), kv.second, inter_node});
+      result.max_link_bytes = std::max(result.max_link_bytes, kv.second);
+      if (inter_node)
+        result.inter_node_bytes += kv.second;
+    }
+    std::sort(result.link_bytes.begin(), result.link_bytes.end(),
+              [](const SwitchLinkBytes& a, const SwitchLinkBytes& b) {
+                return std::make_pair(a.send_rank, a.recv_rank) < std::make_pair(b.send_rank, b.recv_rank);
+              });
+    HT_LOG_DEBUG << "[SwitchPlanner] " << result.algorithm << ": " << plan;
+    results.push_back(std::move(result));
+  }
+  return results;
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include "hydraulis/core/device.h"
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+namespace hydraulis {
+namespace graph {
+
+using Device2Val = std::unordered_map<Device, size_t>;
+using DevicePair2Val = std::unordered_map<std::pair<Device, Device>, size_t>;
+
+enum class SWITCH_ALGORITHM_LEVEL : int8_t {
+  FCFS = 0,
+  ROUND_ROBIN,
+  MULTI_NODE_ROUND_ROBIN,
+  GREEDY,
+  NEW_GREEDY,
+  MIN_MAKESPAN
+};
+
+enum class P2P_ROUTE_LEVEL : int8_t {
+  NVLINK = 0,
+  PCIE,
+  NET
+};
+
+class P2PRoute {
+  public:
+    P2PRoute(const P2P_ROUTE_LEVEL& route_level = P2P_ROUTE_LEVEL::NVLINK):
+      _route_level(route_level) {
+      }
+
+    const P2P_ROUTE_LEVEL& route_level() const {
+      return _route_level;
+    }
+
+  protected:
+    P2P_ROUTE_LEVEL _route_level;
+};
+
+// 描述devices之间的拓扑
+// 包括每两个device之间的route level以及每种route的带宽与延迟
+class SwitchTopology {
+  public:
+    // 默认：跨机为NET，机内为NVLINK（A100/A800）
+    SwitchTopology();
+
+    // HYDRAULIS_SWITCH_TOPO_INTRA_ROUTE (NVLINK or PCIE)
+    // HYDRAULIS_SWITCH_TOPO_{NVLINK,PCIE,NET}_BW (GB/s)
+    // HYDRAULIS_SWITCH_TOPO_{NVLINK,PCIE,NET}_LATENCY (us)
+    static SwitchTopology FromEnv();
+
+    const P2PRoute& GetP2PRoute(const Device& from, const Device& to) const;
+
+    // 手动指定两个device之间的route（双向）
+    void SetP2PRoute(const Device& from, const Device& to, P2P_ROUTE_LEVEL route_level);
+
+    void SetIntraNodeRoute(P2P_ROUTE_LEVEL route_level) {
+      HT_ASSERT(route_level != P2P_ROUTE_LEVEL::NET)
+        << "intra node route cannot be NET";
+      _intra_node_route = route_level;
+      _routes.clear();
+    }
+
+    // bytes per second
+    double bandwidth(P2P_ROUTE_LEVEL route_level) const {
+      return _bandwidth[static_cast<int>(route_level)];
+    }
+
+    void set_bandwidth(P2P_ROUTE_LEVEL route_level, double gbps) {
+      HT_ASSERT(gbps > 0) << "bandwidth should be positive";
+      _bandwidth[static_cast<int>(route_level)] = gbps * 1e9;
+    }
+
+    // seconds
+    double latency(P2P_ROUTE_LEVEL route_level) const {
+      return _latency[static_cast<int>(route_level)];
+    }
+
+    void set_latency(P2P_ROUTE_LEVEL route_level, double us) {
+      HT_ASSERT(us >= 0) << "latency should be non-negative";
+      _latency[static_cast<int>(route_level)] = us * 1e-6;
+    }
+
+    // 传输bytes在该route上的耗时（秒）
+    double TransferTime(P2P_ROUTE_LEVEL route_level, size_t bytes) const {
+      return latency(route_level) + bytes / bandwidth(route_level);
+    }
+
+  protected:
+    P2P_ROUTE_LEVEL _intra_node_route{P2P_ROUTE_LEVEL::NVLINK};
+    double _bandwidth[3];
+    double _latency[3];
+    mutable std::unordered_map<std::pair<Device, Device>, P2PRoute> _routes;
+};
+
+// 一个ParamSlice的通信需求
+// 即哪些device拥有该slice，哪些device需要该slice
+struct SwitchSliceDemand {
+  size_t bytes;
+  std::vector<Device> owned_devices;
+  std::vector<Device> needed_devices;
+};
+
+// 通信方案
+// 只依赖于devices与拓扑，不依赖于任何tensor，因此可以离线地规划与评估
+struct SwitchPlan {
+  // senders[i][j]表示第i个demand的needed_devices[j]从owned_devices的哪一个接收
+  // -1表示自己已经拥有，不需要通信
+  std::vector<std::vector<int32_t>> senders;
+  DevicePair2Val link_bytes; // 每个(send device, recv device)通路上的字节数
+  Device2Val send_bytes;
+  Device2Val recv_bytes;
+  Device2Val kept_bytes; // 每个device自己已经拥有而不需要通信的字节数
+  size_t num_transfers{0};
+  size_t moved_bytes{0};
+  size_t reused_bytes{0};
+  double predicted_time_ms{0}; // 按照拓扑预测的切换时间
+};
+
+std::ostream& operator<<(std::ostream& os, const SwitchPlan& plan);
+
+// ParamBlockComm的纯规划部分
+// 给定所有ParamSlice的通信需求，按照算法决定每个needed device的发送方
+class SwitchPlanner {
+  public:
+    SwitchPlanner(SWITCH_ALGORITHM_LEVEL algorithm_level = SWITCH_ALGORITHM_LEVEL::NEW_GREEDY,
+                  SwitchTopology topology = SwitchTopology::FromEnv()):
+      _algorithm_level(algorithm_level),
+      _topology(std::move(topology)) {
+    }
+
+    SwitchPlan Plan(const std::vector<SwitchSliceDemand>& demands) const;
+
+    // 预测时间（毫秒）
+    // 每个device的发送与接收各自串行，机内与跨机的通信可以overlap
+    // 同一对device之间的所有slice会聚合到一个buffer中，因此只计算一次延迟
+    double PredictTime(const DevicePair2Val& link_bytes) const;
+
+    SWITCH_ALGORITHM_LEVEL algorithm_level() const {
+      return _algorithm_level;
+    }
+
+    const SwitchTopology& topology() const {
+      return _topology;
+    }
+
+  protected:
+    SWITCH_ALGORITHM_LEVEL _algorithm_level;
+    SwitchTopology _topology;
+};
+
+struct SwitchLinkBytes {
+  int32_t send_rank;
+  int32_t recv_rank;
+  size_t bytes;
+  bool inter_node;
+};
+
+struct SwitchPlannerBenchmarkResult {
+  std::string algorithm;
+  double plan_ms{0}; // 规划本身的耗时
+  double predicted_time_ms{0}; // 按照拓扑预测的makespan
+  size_t num_transfers{0};
+  size_t moved_bytes{0};
+  size_t reused_bytes{0};
+  size_t inter_node_bytes{0};
+  size_t max_link_bytes{0};
+  std::vector<SwitchLinkBytes> link_bytes; // 按(send_rank, recv_rank)排序
+};
+
+// 在num_nodes * gpus_per_node个device的合成拓扑上，用所有算法规划一次热切换并比较预测的makespan
+// 切换前param按before_tp切分（TP组在机内连续），切换后按after_tp切分（TP rank按device编号分块）
+// 第p个param的大小为param_mb * (p % 4 + 1) / 4 MiB
+std::vector<SwitchPlannerBenchmarkResult> BenchmarkSwitchPlanner(size_t num_nodes = 2,
+                                                                 size_t gpus_per_node = 8,
+                                                                 size_t before_tp = 2,
+                                                                 size_t after_tp = 8,
+                                                                 size_t num_params = 64,
+                                                                 size_t param_mb = 16);
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,484 @@
+#include "hydraulis/graph/topo_sort.h"
+#include "hydraulis/common/except.h"
+#include "hydraulis/common/logging.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace hydraulis {
+namespace graph {
+
+void DenseTopoGraph::Finalize() {
+  int32_t n = num_nodes();
+  HT_ASSERT(pred_offsets.back() == static_cast<int32_t>(preds.size()))
+    << "pred_offsets does not match preds";
+  std::sort(extra_edges.begin(), extra_edges.end());
+  extra_edges.erase(std::unique(extra_edges.begin(), extra_edges.end()), extra_edges.end());
+
+  // 前驱与额外边转为后继（CSR）
+  succ_offsets.assign(n + 1, 0);
+  in_degrees.assign(n, 0);
+  for (int32_t v = 0; v < n; v++) {
+    for (int32_t k = pred_offsets[v]; k < pred_offsets[v + 1]; k++)
+      succ_offsets[preds[k] + 1]++;
+    in_degrees[v] = pred_offsets[v + 1] - pred_offsets[v];
+  }
+  for (const auto& edge : extra_edges) {
+    succ_offsets[edge.first + 1]++;
+    in_degrees[edge.second]++;
+  }
+  for (int32_t v = 0; v < n; v++)
+    succ_offsets[v + 1] += succ_offsets[v];
+  succs.resize(succ_offsets[n]);
+  std::vector<int32_t> cursor(succ_offsets.begin(), succ_offsets.end() - 1);
+  for (int32_t v = 0; v < n; v++)
+    for (int32_t k = pred_offsets[v]; k < pred_offsets[v + 1]; k++)
+      succs[cursor[preds[k]]++] = v;
+  for (const auto& edge : extra_edges)
+    succs[cursor[edge.first]++] = edge.second;
+
+  // 逆着前驱做一遍Kahn，求到目标op的最长距离
+  // 没有被展开的消费者（即不在图中）的op深度为0
+  depths.assign(n, 0);
+  std::vector<int32_t> num_pending(n, 0);
+  for (auto p : preds)
+    num_pending[p]++;
+  std::vector<int32_t> stack;
+  stack.reserve(n);
+  for (int32_t v = 0; v < n; v++)
+    if (num_pending[v] == 0)
+      stack.push_back(v);
+  while (!stack.empty()) {
+    int32_t c = stack.back();
+    stack.pop_back();
+    for (int32_t k = pred_offsets[c]; k < pred_offsets[c + 1]; k++) {
+      int32_t p = preds[k];
+      depths[p] = std::max(depths[p], depths[c] + 1);
+      if (--num_pending[p] == 0)
+        stack.push_back(p);
+    }
+  }
+
+  sources.clear();
+  for (int32_t v = 0; v < n; v++)
+    if (in_degrees[v] == 0)
+      sources.push_back(v);
+
+  consumer_offsets.clear();
+  consumers.clear();
+  if (!has_memory_info())
+    return;
+  int32_t num_t = num_tensors();
+  HT_ASSERT(tensor_offsets.back() == num_t && input_offsets.back() == static_cast<int32_t>(inputs.size()))
+    << "tensor_offsets or input_offsets does not match";
+  consumer_offsets.assign(num_t + 1, 0);
+  for (auto t : inputs)
+    consumer_offsets[t + 1]++;
+  for (int32_t t = 0; t < num_t; t++)
+    consumer_offsets[t + 1] += consumer_offsets[t];
+  consumers.resize(inputs.size());
+  cursor.assign(consumer_offsets.begin(), consumer_offsets.end() - 1);
+  for (int32_t v = 0; v < n; v++)
+    for (int32_t k = input_offsets[v]; k < input_offsets[v + 1]; k++)
+      consumers[cursor[inputs[k]]++] = v;
+}
+
+std::vector<int32_t> DenseTopoSort(const DenseTopoGraph& graph, bool memory_aware) {
+  int32_t n = graph.num_nodes();
+  HT_ASSERT(static_cast<int32_t>(graph.in_degrees.size()) == n)
+    << "DenseTopoGraph should be finalized before sorting";
+  memory_aware = memory_aware && graph.has_memory_info();
+
+  // 非memory_aware时rank与delta都为0，就是按照(depth, seq)排序
+  // memory_aware时rank为0表示不增加存活的大小，
+  // 为2表示没有输入、且没有哪个后继的前驱都已经可以执行的op
+  // （例如很晚才会用到的mask，提前执行只会延长其输出的存活时间），其余为1
+  struct Entry {
+    int8_t rank;
+    int64_t delta;
+    int32_t depth;
+    int32_t node;
+    int64_t seq;
+    int32_t version;
+  };
+  auto cmp = [](const Entry& x, const Entry& y) {
+    return std::tie(x.rank, x.delta, x.depth, x.seq) > std::tie(y.rank, y.delta, y.depth, y.seq);
+  };
+  std::priority_queue<Entry, std::vector<Entry>, decltype(cmp)> ready_queue(cmp);
+
+  enum : int8_t { PENDING = 0, READY, DONE };
+  std::vector<int32_t> in_degrees(graph.in_degrees);
+  std::vector<int8_t> states(n, PENDING);
+  std::vector<int64_t> seqs(n, 0);
+  std::vector<int32_t> versions;
+  std::vector<int32_t> remaining_uses;
+  std::vector<int64_t> output_bytes;
+  if (memory_aware) {
+    versions.assign(n, 0);
+    remaining_uses.resize(graph.num_tensors());
+    for (int32_t t = 0; t < graph.num_tensors(); t++)
+      remaining_uses[t] = graph.consumer_offsets[t + 1] - graph.consumer_offsets[t];
+    output_bytes.assign(n, 0);
+    for (int32_t v = 0; v < n; v++)
+      for (int32_t t = graph.tensor_offsets[v]; t < graph.tensor_offsets[v + 1]; t++)
+        output_bytes[v] += graph.tensor_bytes[t];
+  }
+
+  auto delta_of = [&](int32_t v) -> int64_t {
+    if (!memory_aware)
+      return 0;
+    int64_t delta = output_bytes[v];
+    for (int32_t k = graph.input_offsets[v]; k < graph.input_offsets[v + 1]; k++) {
+      int32_t t = graph.inputs[k];
+      if (remaining_uses[t] == 1)
+        delta -= graph.tensor_bytes[t];
+    }
+    return delta;
+  };
+  // 前驱（包括额外边）中尚未变为可执行的数目，为0时其所有前驱都可以立即执行
+  std::vector<int32_t> num_pending_preds;
+  if (memory_aware)
+    num_pending_preds = graph.in_degrees;
+  auto rank_of = [&](int32_t v, int64_t delta) -> int8_t {
+    if (!memory_aware || delta <= 0)
+      return 0;
+    if (graph.pred_offsets[v + 1] > graph.pred_offsets[v])
+      return 1;
+    for (int32_t k = graph.succ_offsets[v]; k < graph.succ_offsets[v + 1]; k++)
+      if (num_pending_preds[graph.succs[k]] == 0)
+        return 1;
+    return 2;
+  };
+  int64_t next_seq = 0;
+  std::function<void(int32_t)> update;
+  auto push = [&](int32_t v) {
+    bool newly_ready = states[v] == PENDING;
+    std::vector<int32_t> demanded;
+    if (newly_ready) {
+      states[v] = READY;
+      seqs[v] = next_seq++;
+      if (memory_aware) {
+        for (int32_t k = graph.succ_offsets[v]; k < graph.succ_offsets[v + 1]; k++)
+          if (--num_pending_preds[graph.succs[k]] == 0)
+            demanded.push_back(graph.succs[k]);
+      }
+    }
+    int64_t delta = delta_of(v);
+    ready_queue.push({rank_of(v, delta), delta, graph.depths[v], v, seqs[v],
+                      memory_aware ? versions[v] : 0});
+    // 后继的前驱都已经可以执行时，其中没有输入的前驱的rank变小
+    for (auto u : demanded) {
+      for (int32_t j = graph.pred_offsets[u]; j < graph.pred_offsets[u + 1]; j++) {
+        int32_t p = graph.preds[j];
+        if (p != v && graph.pred_offsets[p + 1] == graph.pred_offsets[p])
+          update(p);
+      }
+    }
+  };
+  // 已经可以执行的op的rank或delta变小时重新入队，旧的entry在出队时丢弃
+  update = [&](int32_t v) {
+    if (states[v] == READY) {
+      versions[v]++;
+      push(v);
+    }
+  };
+
+  for (auto v : graph.sources)
+    push(v);
+  std::vector<int32_t> order;
+  order.reserve(n);
+  while (!ready_queue.empty()) {
+    auto entry = ready_queue.top();
+    ready_queue.pop();
+    int32_t v = entry.node;
+    // 过期的entry（delta已经更新过）
+    if (states[v] == DONE || (memory_aware && entry.version != versions[v]))
+      continue;
+    states[v] = DONE;
+    order.push_back(v);
+    if (memory_aware) {
+      // 某个tensor只剩一个消费者时，该消费者的delta变小
+      for (int32_t k = graph.input_offsets[v]; k < graph.input_offsets[v + 1]; k++) {
+        int32_t t = graph.inputs[k];
+        if (--remaining_uses[t] != 1)
+          continue;
+        for (int32_t j = graph.consumer_offsets[t]; j < graph.consumer_offsets[t + 1]; j++) {
+          int32_t u = graph.consumers[j];
+          if (states[u] != DONE) {
+            update(u);
+            break;
+          }
+        }
+      }
+    }
+    for (int32_t k = graph.succ_offsets[v]; k < graph.succ_offsets[v + 1]; k++) {
+      int32_t u = graph.succs[k];
+      if (--in_degrees[u] == 0)
+        push(u);
+    }
+  }
+  HT_LOG_DEBUG_IF(static_cast<int32_t>(order.size()) != n)
+    << "topo sort: only " << order.size() << " of " << n << " ops are sorted";
+  return order;
+}
+
+int64_t PeakLiveBytes(const DenseTopoGraph& graph, const std::vector<int32_t>& order) {
+  HT_ASSERT(graph.has_memory_info() && !graph.consumer_offsets.empty())
+    << "PeakLiveBytes requires the memory info of a finalized DenseTopoGraph";
+  std::vector<int32_t> remaining_uses(graph.num_tensors());
+  for (int32_t t = 0; t < graph.num_tensors(); t++)
+    remaining_uses[t] = graph.consumer_offsets[t + 1] - graph.consumer_offsets[t];
+  int64_t live_bytes = 0, peak_bytes = 0;
+  for (auto v : order) {
+    for (int32_t t = graph.tensor_offsets[v]; t < graph.tensor_offsets[v + 1]; t++)
+      live_bytes += graph.tensor_bytes[t];
+    // 执行时输入与输出同时存活
+    peak_bytes = std::max(peak_bytes, live_bytes);
+    for (int32_t k = graph.input_offsets[v]; k < graph.input_offsets[v + 1]; k++) {
+      int32_t t = graph.inputs[k];
+      if (--remaining_uses[t] == 0)
+        live_bytes -= graph.tensor_bytes[t];
+    }
+  }
+  return peak_bytes;
+}
+
+/******************************************************
+ * Benchmark
+ ******************************************************/
+
+namespace {
+
+// 每个op只有一个输出
+struct SyntheticGraph {
+  std::vector<std::vector<int32_t>> inputs; // 按照op id
+  std::vector<std::vector<int32_t>> consumers;
+  std::vector<int64_t> bytes;
+  std::vector<int32_t> targets;
+
+  int32_t AddOp(std::vector<int32_t> op_inputs, int64_t op_bytes) {
+    int32_t id = inputs.size();
+    for (auto input : op_inputs)
+      consumers[input].push_back(id);
+    inputs.push_back(std::move(op_inputs));
+    consumers.emplace_back();
+    bytes.push_back(op_bytes);
+    return id;
+  }
+
+  int32_t num_ops() const {
+    return inputs.size();
+  }
+};
+
+// 类似transformer的layer：每个micro batch有各自的前向与逐个op的反向（输入梯度与权重梯度），
+// 权重梯度按照micro batch的顺序依次累加后更新
+// 各个micro batch之间没有依赖，交错的方式决定了activation的峰值
+SyntheticGraph MakeSyntheticGraph(int32_t num_layers, int32_t num_micro_batches) {
+  constexpr int64_t kActBytes = 4 << 20;
+  constexpr int64_t kWeightBytes = 2 << 20;
+  SyntheticGraph g;
+  // 每个micro batch中带权重的op的权重梯度，按照op在前向中的位置
+  std::vector<std::vector<int32_t>> wgrads;
+  for (int32_t m = 0; m < num_micro_batches; m++) {
+    std::vector<int32_t> fwd_ops;
+    std::vector<bool> has_weight;
+    auto add_fwd = [&](std::vector<int32_t> op_inputs, int64_t op_bytes, bool weighted) {
+      int32_t id = g.AddOp(std::move(op_inputs), op_bytes);
+      fwd_ops.push_back(id);
+      has_weight.push_back(weighted);
+      return id;
+    };
+    int32_t h = add_fwd({}, kActBytes, true); // embedding
+    for (int32_t l = 0; l < num_layers; l++) {
+      int32_t ln1 = add_fwd({h}, kActBytes, true);
+      int32_t q = add_fwd({ln1}, kActBytes, true);
+      int32_t k = add_fwd({ln1}, kActBytes, true);
+      int32_t v = add_fwd({ln1}, kActBytes, true);
+      int32_t attn = add_fwd({q, k, v}, kActBytes, false);
+      int32_t proj = add_fwd({attn}, kActBytes, true);
+      int32_t add1 = add_fwd({h, proj}, kActBytes, false);
+      int32_t ln2 = add_fwd({add1}, kActBytes, true);
+      int32_t fc1 = add_fwd({ln2}, 4 * kActBytes, true);
+      int32_t mask = add_fwd({}, 4 * kActBytes, false); // dropout mask
+      int32_t act = add_fwd({fc1, mask}, 4 * kActBytes, false);
+      int32_t fc2 = add_fwd({act}, kActBytes, true);
+      h = add_fwd({add1, fc2}, kActBytes, false);
+    }
+    // 反向：dgrads[op]为op对其输入的梯度
+    std::unordered_map<int32_t, int32_t> dgrads;
+    std::vector<int32_t> mb_wgrads;
+    for (int32_t i = static_cast<int32_t>(fwd_ops.size()) - 1; i >= 0; i--) {
+      int32_t f = fwd_ops[i];
+      std::vector<int32_t> contribs;
+      for (auto c : g.consumers[f])
+        if (dgrads.find(c) != dgrads.end())
+          contribs.push_back(dgrads[c]);
+      int32_t grad;
+      if (contribs.empty())
+        grad = g.AddOp({}, g.bytes[f]); // loss的梯度
+      else if (contribs.size() == 1)
+        grad = contribs.front();
+      else
+        grad = g.AddOp(contribs, g.bytes[f]); // 梯度累加
+      std::vector<int32_t> saved = g.inputs[f];
+      saved.insert(saved.begin(), grad);
+      if (!g.inputs[f].empty())
+        dgrads[f] = g.AddOp(saved, kActBytes);
+      if (has_weight[i])
+        mb_wgrads.push_back(g.AddOp(saved, kWeightBytes));
+    }
+    wgrads.push_back(std::move(mb_wgrads));
+  }
+  for (size_t i = 0; i < wgrads.front().size(); i++) {
+    int32_t acc = wgrads.front()[i];
+    for (int32_t m = 1; m < num_micro_batches; m++)
+      acc = g.AddOp({acc, wgrads[m][i]}, kWeightBytes);
+    g.targets.push_back(g.AddOp({acc}, 0)); // update
+  }
+  return g;
+}
+
+// 原先Graph::TopoSort的做法：以id为key的哈希表，逐个target做relax的BFS，
+// 比较时查哈希表的优先队列
+std::vector<int32_t> LegacyTopoSort(const SyntheticGraph& g) {
+  std::unordered_map<int32_t, int32_t> in_degrees;
+  std::unordered_map<int32_t, int32_t> heuristic_deps;
+  std::unordered_set<int32_t> visited;
+  std::vector<int32_t> zero_in_degree_ops;
+  auto cmp = [&heuristic_deps](int32_t lhs, int32_t rhs) {
+    return heuristic_deps[lhs] > heuristic_deps[rhs];
+  };
+  std::priority_queue<int32_t, std::vector<int32_t>, decltype(cmp)> topo_queue(cmp);
+  auto traverse_bfs = [&](int32_t root) {
+    std::queue<int32_t> bfs_queue;
+    bfs_queue.push(root);
+    while (!bfs_queue.empty()) {
+      int32_t op = bfs_queue.front();
+      bfs_queue.pop();
+      int32_t op_in_degrees = g.inputs[op].size();
+      in_degrees[op] = op_in_degrees;
+      if (op_in_degrees == 0 && visited.find(op) == visited.end()) {
+        zero_in_degree_ops.push_back(op);
+        visited.insert(op);
+        continue;
+      }
+      for (auto producer : g.inputs[op]) {
+        if (heuristic_deps.find(producer) == heuristic_deps.end() ||
+            heuristic_deps[producer] < heuristic_deps[op] + 1) {
+          heuristic_deps[producer] = heuristic_deps[op] + 1;
+          bfs_queue.push(producer);
+        }
+      }
+    }
+  };
+  for (auto target : g.targets) {
+    if (heuristic_deps.find(target) != heuristic_deps.end())
+      continue;
+    heuristic_deps[target] = 0;
+    traverse_bfs(target);
+  }
+  for (auto op : zero_in_degree_ops)
+    topo_queue.push(op);
+  std::vector<int32_t> ret;
+  while (!topo_queue.empty()) {
+    int32_t op = topo_queue.top();
+    topo_queue.pop();
+    ret.push_back(op);
+    for (auto consumer : g.consumers[op]) {
+      if (in_degrees.find(consumer) == in_degrees.end())
+        continue;
+      if (--in_degrees[consumer] == 0)
+        topo_queue.push(consumer);
+    }
+  }
+  return ret;
+}
+
+// 与Graph::TopoSort相同：从targets出发按发现顺序编号（仍需一次以id为key的查找），之后全部用下标
+DenseTopoGraph BuildDenseTopoGraph(const SyntheticGraph& g) {
+  DenseTopoGraph dense;
+  std::unordered_map<int32_t, int32_t> op_indices;
+  std::vector<int32_t> nodes;
+  op_indices.reserve(g.num_ops());
+  nodes.reserve(g.num_ops());
+  dense.pred_offsets.reserve(g.num_ops() + 1);
+  auto get_or_add = [&](int32_t op) -> int32_t {
+    auto it = op_indices.find(op);
+    if (it != op_indices.end())
+      return it->second;
+    int32_t index = nodes.size();
+    op_indices.emplace(op, index);
+    nodes.push_back(op);
+    return index;
+  };
+  for (auto target : g.targets)
+    get_or_add(target);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    for (auto producer : g.inputs[nodes[i]])
+      dense.preds.push_back(get_or_add(producer));
+    dense.pred_offsets.push_back(dense.preds.size());
+  }
+  for (size_t i = 0; i < nodes.size(); i++) {
+    dense.tensor_bytes.push_back(g.bytes[nodes[i]]);
+    dense.tensor_offsets.push_back(dense.tensor_bytes.size());
+    // 每个op只有一个输出，tensor下标即op下标
+    size_t begin = dense.inputs.size();
+    dense.inputs.insert(dense.inputs.end(), dense.preds.begin() + dense.pred_offsets[i],
+                        dense.preds.begin() + dense.pred_offsets[i + 1]);
+    std::sort(dense.inputs.begin() + begin, dense.inputs.end());
+    dense.inputs.erase(std::unique(dense.inputs.begin() + begin, dense.inputs.end()), dense.inputs.end());
+    dense.input_offsets.push_back(dense.inputs.size());
+  }
+  dense.Finalize();
+  return dense;
+}
+
+template <typename Fn>
+double TimeMs(int num_iters, Fn&& fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_iters; i++)
+    fn();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() / num_iters;
+}
+
+} // namespace
+
+TopoSortBenchmarkResult BenchmarkTopoSort(int32_t num_ops, int num_iters) {
+  HT_VALUE_ERROR_IF(num_ops <= 0 || num_iters <= 0)
+    << "num_ops and num_iters should be positive, got " << num_ops << " and " << num_iters;
+  constexpr int32_t kNumMicroBatches = 4;
+  int32_t ops_per_layer = MakeSyntheticGraph(2, kNumMicroBatches).num_ops() -
+                          MakeSyntheticGraph(1, kNumMicroBatches).num_ops();
+  auto g = MakeSyntheticGraph(std::max(1, num_ops / ops_per_layer), kNumMicroBatches);
+  TopoSortBenchmarkResult result;
+  result.num_ops = g.num_ops();
+
+  std::vector<int32_t> legacy_order, dense_order, memory_aware_order;
+  // 原先的实现太慢，只运行一次
+  result.legacy_ms = TimeMs(1, [&]() { legacy_order = LegacyTopoSort(g); });
+  DenseTopoGraph dense;
+  result.dense_ms = TimeMs(num_iters, [&]() {
+    dense = BuildDenseTopoGraph(g);
+    dense_order = DenseTopoSort(dense);
+  });
+  result.memory_aware_ms = TimeMs(num_iters, [&]() {
+    dense = BuildDenseTopoGraph(g);
+    memory_aware_order = DenseTopoSort(dense, true);
+  });
+  HT_ASSERT(legacy_order.size() == dense_order.size() &&
+            dense_order.size() == memory_aware_order.size())
+    << "Sorted " << legacy_order.size() << ", " << dense_order.size() << " and "
+    << memory_aware_order.size() << " ops with different implementations";
+  result.dense_peak_bytes = PeakLiveBytes(dense, dense_order);
+  result.memory_aware_peak_bytes = PeakLiveBytes(dense, memory_aware_order);
+  return result;
+}
+
+} // namespace graph
+} // namespace hydraulis
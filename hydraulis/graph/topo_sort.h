@@ -0,0 +1,84 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include <utility>
+#include <vector>
+
+namespace hydraulis {
+namespace graph {
+
+// Graph::TopoSort的核心部分
+// op与tensor都用稠密的下标表示，全程迭代实现，不使用递归与哈希表
+struct DenseTopoGraph {
+  /* 以下由调用者填写，op按照下标顺序依次填写 */
+
+  // op i的前驱为preds[pred_offsets[i], pred_offsets[i + 1])
+  // 重数与op的in_degrees一致，被stop_at截断的op没有前驱
+  std::vector<int32_t> pred_offsets{0};
+  std::vector<int32_t> preds;
+  // 额外的依赖边(from, to)，例如inplace op需要排在同一tensor的其他消费者之后
+  std::vector<std::pair<int32_t, int32_t>> extra_edges;
+
+  // 以下仅在按显存排序时需要
+  // op i的输出tensor为[tensor_offsets[i], tensor_offsets[i + 1])
+  std::vector<int32_t> tensor_offsets{0};
+  std::vector<int64_t> tensor_bytes;
+  // op i读取的tensor（去重）为inputs[input_offsets[i], input_offsets[i + 1])
+  std::vector<int32_t> input_offsets{0};
+  std::vector<int32_t> inputs;
+
+  /* 以下由Finalize计算 */
+
+  std::vector<int32_t> succ_offsets;
+  std::vector<int32_t> succs;
+  std::vector<int32_t> in_degrees;
+  // 沿前驱到目标op的最长距离，作为排序的启发式（越小越先）
+  std::vector<int32_t> depths;
+  // 入度为0的op，按照下标顺序
+  std::vector<int32_t> sources;
+  // tensor i的消费者为consumers[consumer_offsets[i], consumer_offsets[i + 1])
+  std::vector<int32_t> consumer_offsets;
+  std::vector<int32_t> consumers;
+
+  int32_t num_nodes() const {
+    return static_cast<int32_t>(pred_offsets.size()) - 1;
+  }
+
+  int32_t num_tensors() const {
+    return static_cast<int32_t>(tensor_bytes.size());
+  }
+
+  bool has_memory_info() const {
+    return tensor_offsets.size() == pred_offsets.size() &&
+           input_offsets.size() == pred_offsets.size();
+  }
+
+  void Finalize();
+};
+
+// 返回按照拓扑序排列的op下标，存在环时只返回能排出的部分
+// 可执行的op中按照(depth, 变为可执行的先后)选择
+// memory_aware时优先选择使存活tensor的总大小增加最少的op
+// （输出的大小减去以该op为最后一个消费者的输入的大小），不改变依赖关系
+std::vector<int32_t> DenseTopoSort(const DenseTopoGraph& graph, bool memory_aware = false);
+
+// 按照order执行时存活tensor大小之和的峰值
+// tensor在产生时分配，在最后一个消费者执行后释放，没有消费者的tensor一直存活
+int64_t PeakLiveBytes(const DenseTopoGraph& graph, const std::vector<int32_t>& order);
+
+struct TopoSortBenchmarkResult {
+  int32_t num_ops{0};
+  double legacy_ms{0}; // 原先基于哈希表与逐个relax的BFS的实现
+  double dense_ms{0};
+  double memory_aware_ms{0};
+  int64_t dense_peak_bytes{0};
+  int64_t memory_aware_peak_bytes{0};
+};
+
+// 在num_ops个op的合成图上比较各个实现（取num_iters次的平均）
+// 合成图由4个micro batch的前向与反向组成，权重梯度在micro batch之间累加
+// 原先的实现只运行一次
+TopoSortBenchmarkResult BenchmarkTopoSort(int32_t num_ops = 100000, int num_iters = 5);
+
+} // namespace graph
+} // namespace hydraulis
@@ -1,3 +1,20 @@
 #include "hydraulis/impl/communication/comm_group.h"
+#include "hydraulis/impl/communication/nccl_comm_group.h"
+#include "hydraulis/impl/communication/shm_comm_group.h"
 
-// Empty file for CMake.
+namespace hydraulis {
+namespace impl {
+namespace comm {
+
+CommunicationGroup GetOrCreateCommGroup(const std::vector<int>& world_ranks,
+                                        const Stream& stream) {
+  if (stream.device().is_cuda())
+    return NCCLCommunicationGroup::GetOrCreate(world_ranks, stream);
+  HT_ASSERT(stream.device().is_cpu())
+    << "Cannot create communication group for stream " << stream << ".";
+  return GetOrCreateCPUCommGroup(world_ranks, stream);
+}
+
+} // namespace comm
+} // namespace impl
+} // namespace hydraulis
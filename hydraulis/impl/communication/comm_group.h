@@ -18,10 +18,15 @@ using hydraulis::operator<<;
 struct CommTask {
   std::function<void()> fn;
   NDArrayList data;
+  // Optional non-blocking step for backends that interleave batched p2p
+  // operations. It returns true once the task has completed.
+  std::function<bool()> progress;
 
   CommTask() = default;
-  CommTask(std::function<void()> fn_, NDArrayList data_)
-  : fn(std::move(fn_)), data(std::move(data_)) {}
+  CommTask(std::function<void()> fn_, NDArrayList data_,
+           std::function<bool()> progress_ = {})
+  : fn(std::move(fn_)), data(std::move(data_)),
+    progress(std::move(progress_)) {}
 };
 
 class CommunicationGroupDef : public shared_ptr_target {
@@ -232,6 +237,29 @@ int DeviceToWorldRank(const Device& device);
 const Device& WorldRankToDevice(int rank);
 std::vector<int> DeviceGroupToWorldRanks(const DeviceGroup& device_group);
 
+// Rendezvous through the RPC server. When HYDRAULIS_RPC_TREE_ARITY >= 2 (and
+// the server supports batched RPCs), ranks form a k-ary tree per host and
+// then across hosts, and barriers/broadcasts fan in and out through it.
+// Otherwise every rank talks to the server directly.
+bool UseTreeRendezvous();
+void RPCBarrier(const std::vector<int>& world_ranks);
+// Broadcasts with the same tag must be issued in the same order on all ranks.
+std::string RPCBroadcast(const std::string& payload, int src,
+                         const std::vector<int>& world_ranks,
+                         const std::string& tag = "bcast");
+
+// NCCL for CUDA streams, and the CPU backend (see `GetOrCreateCPUCommGroup`)
+// for CPU streams. Implemented in `comm_group.cc`.
+CommunicationGroup GetOrCreateCommGroup(const std::vector<int>& world_ranks,
+                                        const Stream& stream);
+
+inline CommunicationGroup GetOrCreateCommGroup(const std::vector<int>& world_ranks,
+                                               const Device& device) {
+  return GetOrCreateCommGroup(
+    world_ranks,
+    Stream(device, world_ranks.size() != 2 ? kCollectiveStream : kP2PStream));
+}
+
 } // namespace comm
 } // namespace impl
 } // namespace hydraulis
@@ -702,6 +702,18 @@ void NCCLCommunicationGroupDef::CreateNCCLUniqueId(
   // Walkaround: communication groups handle ndarrays only
   NDArray id_arr = NDArray::empty({sizeof(ncclUniqueId)}, Device(kCPU), kUInt8,
                                   kBlockingStream);
+  if (UseTreeRendezvous()) {
+    // 沿着rendezvous tree分发，每个key只有不超过k个rank等待
+    std::string nccl_id;
+    if (GetWorldRank() == world_ranks[0]) {
+      NCCL_CALL(ncclGetUniqueId(&id));
+      nccl_id.assign(reinterpret_cast<const char*>(&id), sizeof(ncclUniqueId));
+    }
+    nccl_id = RPCBroadcast(nccl_id, world_ranks[0], world_ranks,
+                           "nccl_" + std::to_string(stream.stream_index()));
+    memcpy(&id, nccl_id.data(), sizeof(ncclUniqueId));
+    return;
+  }
   if (GetWorldRank() == world_ranks[0]) {
     NCCL_CALL(ncclGetUniqueId(&id));
     std::string nccl_id;
@@ -1,5 +1,7 @@
 #include "hydraulis/impl/communication/rpc_client.h"
 #include "hydraulis/common/logging.h"
+#include "hydraulis/common/except.h"
+#include <cstdlib>
 
 namespace hydraulis {
 
@@ -156,6 +158,9 @@ DeviceInfoReply DeviceClient::GetDeviceInfo(int rank) {
 }
 
 int DeviceClient::CommitNcclId(const std::string& nccl_id, const std::vector<int>& world_rank, int stream_id) {
+  if (SupportsBatchedRPC())
+    return MultiPut({{NcclIdKey(world_rank, stream_id), nccl_id}});
+
   // Data we are sending to the server.
   CommitNcclIdRequest request;
   request.set_nccl_id(nccl_id);
@@ -183,6 +188,10 @@ int DeviceClient::CommitNcclId(const std::string& nccl_id, const std::vector<int
 }
 
 std::string DeviceClient::GetNcclId(const std::vector<int>& world_rank, int stream_id) {
+  // server端阻塞等待，而不是轮询
+  if (SupportsBatchedRPC())
+    return MultiGet({NcclIdKey(world_rank, stream_id)}).front();
+
   // Data we are sending to the server.
   GetNcclIdRequest request;
   for (auto rank: world_rank)
@@ -676,5 +685,169 @@ void DeviceClient::LaunchHeartBeat(int rank) {
   this->start();
 }
 
+bool DeviceClient::SupportsBatchedRPC() {
+  std::call_once(_batched_rpc_probe_flag, [this]() {
+    const char* env = std::getenv("HYDRAULIS_RPC_BATCHED");
+    if (env != nullptr && std::string(env) == "0")
+      _use_batched_rpc = false;
+    if (!_use_batched_rpc)
+      return;
+    // 旧的python server没有实现批量RPC，此时退化为逐个key的RPC
+    MultiPutRequest request;
+    MultiPutReply reply;
+    ClientContext context;
+    Status status = stub_->MultiPut(&context, request, &reply);
+    if (status.error_code() == grpc::StatusCode::UNIMPLEMENTED) {
+      HT_LOG_INFO << "The rpc server does not support batched RPCs, fall back to per-key RPCs";
+      _use_batched_rpc = false;
+    } else if (!status.ok()) {
+      HT_LOG_ERROR << status.error_code() << ": " << status.error_message();
+      __builtin_unreachable();
+    }
+  });
+  return _use_batched_rpc;
+}
+
+int DeviceClient::MultiPut(const KeyValueList& kvs) {
+  // Data we are sending to the server.
+  MultiPutRequest request;
+  for (const auto& kv : kvs) {
+    auto* entry = request.add_kvs();
+    entry->set_key(kv.first);
+    entry->set_value(kv.second);
+  }
+
+  // Container for the data we expect from the server.
+  MultiPutReply reply;
+
+  // Context for the client. It could be used to convey extra information to
+  // the server and/or tweak certain RPC behaviors.
+  ClientContext context;
+
+  // The actual RPC.
+  Status status = stub_->MultiPut(&context, request, &reply);
+
+  // Act upon its status.
+  if (status.ok()) {
+    return reply.status();
+  } else {
+    HT_LOG_ERROR << status.error_code() << ": " << status.error_message();
+    __builtin_unreachable();
+  }
+}
+
+std::vector<std::string> DeviceClient::MultiGet(const std::vector<std::string>& keys, int64_t timeout_ms,
+                                                bool remove) {
+  // Data we are sending to the server.
+  MultiGetRequest request;
+  for (const auto& key : keys)
+    request.add_keys(key);
+  request.set_timeout_ms(timeout_ms);
+  request.set_remove(remove);
+
+  // Container for the data we expect from the server.
+  MultiGetReply reply;
+
+  // Context for the client. It could be used to convey extra information to
+  // the server and/or tweak certain RPC behaviors.
+  ClientContext context;
+
+  // The actual RPC.
+  Status status = stub_->MultiGet(&context, request, &reply);
+
+  // Act upon its status.
+  if (status.ok()) {
+    HT_RUNTIME_ERROR_IF(reply.status() == 0)
+      << "MultiGet of " << keys.size() << " keys timed out after " << timeout_ms << " ms";
+    std::vector<std::string> values;
+    values.reserve(reply.kvs_size());
+    for (const auto& kv : reply.kvs())
+      values.emplace_back(kv.value());
+    return values;
+  } else {
+    HT_LOG_ERROR << status.error_code() << ": " << status.error_message();
+    __builtin_unreachable();
+  }
+}
+
+KeyValueList DeviceClient::Watch(const std::string& prefix, int count, int64_t timeout_ms) {
+  // Data we are sending to the server.
+  WatchRequest request;
+  request.set_prefix(prefix);
+  request.set_count(count);
+  request.set_timeout_ms(timeout_ms);
+
+  // Container for the data we expect from the server.
+  WatchReply reply;
+
+  // Context for the client. It could be used to convey extra information to
+  // the server and/or tweak certain RPC behaviors.
+  ClientContext context;
+
+  // The actual RPC.
+  Status status = stub_->Watch(&context, request, &reply);
+
+  // Act upon its status.
+  if (status.ok()) {
+    HT_RUNTIME_ERROR_IF(reply.status() == 0)
+      << "Watch of " << count << " keys with prefix \"" << prefix
+      << "\" timed out after " << timeout_ms << " ms";
+    KeyValueList kvs;
+    kvs.reserve(reply.kvs_size());
+    for (const auto& kv : reply.kvs())
+      kvs.emplace_back(kv.key(), kv.value());
+    return kvs;
+  } else {
+    HT_LOG_ERROR << status.error_code() << ": " << status.error_message();
+    __builtin_unreachable();
+  }
+}
+
+namespace {
+
+// Watch返回的key形如"<prefix><rank>"
+template <typename T, typename F>
+std::vector<T> GatherByRank(const KeyValueList& kvs, const std::string& prefix, int world_size, F&& decode) {
+  std::vector<T> values(world_size);
+  for (const auto& kv : kvs) {
+    int rank = std::stoi(kv.first.substr(prefix.size()));
+    HT_ASSERT(rank >= 0 && rank < world_size)
+      << "Got unexpected key " << kv.first << " (world size = " << world_size << ")";
+    values[rank] = decode(kv.second);
+  }
+  return values;
+}
+
+} // namespace
+
+std::vector<std::string> DeviceClient::AllGatherHostNames(const std::string& hostname, int rank, int world_size) {
+  if (SupportsBatchedRPC()) {
+    MultiPut({{HostNameKey(rank), hostname}});
+    const std::string prefix = "hostname/";
+    return GatherByRank<std::string>(Watch(prefix, world_size), prefix, world_size,
+                                     [](const std::string& value) { return value; });
+  }
+  CommitHostName(hostname, rank);
+  std::vector<std::string> hostnames;
+  hostnames.reserve(world_size);
+  for (int i = 0; i < world_size; i++)
+    hostnames.emplace_back(GetHostName(i));
+  return hostnames;
+}
+
+std::vector<DeviceInfoReply> DeviceClient::AllGatherDeviceInfos(const DeviceInfoReply& info, int rank, int world_size) {
+  if (SupportsBatchedRPC()) {
+    MultiPut({{DeviceInfoKey(rank), EncodeDeviceInfo(info)}});
+    const std::string prefix = "device/";
+    return GatherByRank<DeviceInfoReply>(Watch(prefix, world_size), prefix, world_size, DecodeDeviceInfo);
+  }
+  CommitDeviceInfo(info.type, info.index, info.multiplex, rank);
+  std::vector<DeviceInfoReply> infos;
+  infos.reserve(world_size);
+  for (int i = 0; i < world_size; i++)
+    infos.emplace_back(GetDeviceInfo(i));
+  return infos;
+}
+
 } //namespace hydraulis
 
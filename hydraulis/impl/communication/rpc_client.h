@@ -3,6 +3,7 @@
 #include "hydraulis/impl/communication/rpc_client_impl.h"
 #include <grpcpp/grpcpp.h>
 #include <thread>
+#include <mutex>
 #include "hydraulis/impl/communication/rpc/hydraulisrpc.grpc.pb.h"
 
 using json = nlohmann::json;
@@ -16,8 +17,10 @@ namespace hydraulis {
 class DeviceClient : public DeviceClientImpl {
  public:
   DeviceClient(int64_t time_interval = 5): _time_interval(time_interval) {}
-  DeviceClient(std::shared_ptr<Channel> channel, int64_t time_interval = 5)
-      : stub_(DeviceController::NewStub(channel)), _time_interval(time_interval) {
+  // use_batched_rpc为false时总是使用逐个key的RPC（用于对比）
+  DeviceClient(std::shared_ptr<Channel> channel, int64_t time_interval = 5, bool use_batched_rpc = true)
+      : stub_(DeviceController::NewStub(channel)), _time_interval(time_interval),
+        _use_batched_rpc(use_batched_rpc) {
   }
 
   int Connect(const std::string& hostname) override;
@@ -74,8 +77,23 @@ class DeviceClient : public DeviceClientImpl {
 
   void LaunchHeartBeat(int rank) override;
 
+  bool SupportsBatchedRPC() override;
+
+  int MultiPut(const KeyValueList& kvs) override;
+
+  std::vector<std::string> MultiGet(const std::vector<std::string>& keys, int64_t timeout_ms = -1,
+                                    bool remove = false) override;
+
+  KeyValueList Watch(const std::string& prefix, int count, int64_t timeout_ms = -1) override;
+
+  std::vector<std::string> AllGatherHostNames(const std::string& hostname, int rank, int world_size) override;
+
+  std::vector<DeviceInfoReply> AllGatherDeviceInfos(const DeviceInfoReply& info, int rank, int world_size) override;
+
  private:
   std::unique_ptr<DeviceController::Stub> stub_;
+  bool _use_batched_rpc = true;
+  std::once_flag _batched_rpc_probe_flag;
   std::thread heartbeatThread;
   bool running = false;
   int64_t _time_interval;
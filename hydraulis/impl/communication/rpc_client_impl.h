@@ -3,6 +3,7 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 #include "hydraulis/utils/json/json.hpp"
 
 using json = nlohmann::json;
@@ -15,6 +16,39 @@ struct DeviceInfoReply {
   int multiplex;
 };
 
+using KeyValueList = std::vector<std::pair<std::string, std::string>>;
+
+// 批量RPC使用的key，server上的CommitHostName/CommitDeviceInfo/CommitNcclId等
+// 也写入同样的key，因此新旧两种RPC可以混用
+inline std::string HostNameKey(int rank) {
+  return "hostname/" + std::to_string(rank);
+}
+
+inline std::string DeviceInfoKey(int rank) {
+  return "device/" + std::to_string(rank);
+}
+
+inline std::string NcclIdKey(const std::vector<int>& world_rank, int stream_id) {
+  std::string key = "nccl/";
+  for (auto rank : world_rank)
+    key += std::to_string(rank) + ",";
+  return key + "/" + std::to_string(stream_id);
+}
+
+inline std::string EncodeDeviceInfo(const DeviceInfoReply& info) {
+  return std::to_string(info.type) + "," + std::to_string(info.index) + "," + std::to_string(info.multiplex);
+}
+
+inline DeviceInfoReply DecodeDeviceInfo(const std::string& value) {
+  DeviceInfoReply info;
+  auto first = value.find(',');
+  auto second = value.find(',', first + 1);
+  info.type = std::stoi(value.substr(0, first));
+  info.index = std::stoi(value.substr(first + 1, second - first - 1));
+  info.multiplex = std::stoi(value.substr(second + 1));
+  return info;
+}
+
 class DeviceClientImpl {
  public:
   DeviceClientImpl() {}
@@ -72,6 +106,23 @@ class DeviceClientImpl {
   virtual int HeartBeat(int rank) {}
 
   virtual void LaunchHeartBeat(int rank) {};
+
+  // 批量的key-value RPC（MultiGet与Watch会阻塞直到数据就绪）
+  virtual bool SupportsBatchedRPC() { return false; }
+
+  virtual int MultiPut(const KeyValueList& kvs) {}
+
+  // remove为true时server返回后即删除这些key（只有一个读者的key）
+  virtual std::vector<std::string> MultiGet(const std::vector<std::string>& keys, int64_t timeout_ms = -1,
+                                            bool remove = false) {}
+
+  virtual KeyValueList Watch(const std::string& prefix, int count, int64_t timeout_ms = -1) {}
+
+  // 所有rank交换hostname与device info
+  // server支持时使用一次MultiPut加一次Watch，否则退化为逐个rank的Get
+  virtual std::vector<std::string> AllGatherHostNames(const std::string& hostname, int rank, int world_size) {}
+
+  virtual std::vector<DeviceInfoReply> AllGatherDeviceInfos(const DeviceInfoReply& info, int rank, int world_size) {}
 };
 
 } //namespace hydraulis
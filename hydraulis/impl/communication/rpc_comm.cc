@@ -1,6 +1,8 @@
 #include "hydraulis/impl/stream/CPUStream.h"
 #include "hydraulis/impl/utils/ndarray_utils.h"
 #include "hydraulis/impl/communication/rpc_client.h"
+#include "hydraulis/impl/communication/rpc_tree.h"
+#include "hydraulis/impl/communication/threaded_world.h"
 #include <numeric>
 #include <mutex>
 
@@ -67,22 +69,46 @@ static void RPC_Init_Once() {
   });
 }
 
+// Inside a threaded world, ranks and devices are served by the world itself
+// and the RPC server is never contacted.
+static inline bool InThreadedWorld() {
+  return ThreadedWorld::IsRunning();
+}
+
+static inline int GetThreadedWorldRank() {
+  int rank = ThreadedWorld::CurrentRank();
+  HT_ASSERT(rank >= 0)
+    << "The calling thread does not belong to any rank of the threaded world.";
+  return rank;
+}
+
 int GetWorldRank() {
+  if (InThreadedWorld())
+    return GetThreadedWorldRank();
   RPC_Init_Once();
   return rpc_world_rank;
 }
 
 int GetWorldSize() {
+  if (InThreadedWorld())
+    return ThreadedWorld::Size();
   RPC_Init_Once();
   return rpc_world_size;
 }
 
 std::vector<int> GetWorldRanks() {
+  if (InThreadedWorld()) {
+    std::vector<int> ranks(ThreadedWorld::Size());
+    std::iota(ranks.begin(), ranks.end(), 0);
+    return ranks;
+  }
   RPC_Init_Once();
   return rpc_world_ranks;
 }
 
 std::shared_ptr<DeviceClientImpl> GetLocalClient() {
+  HT_ASSERT(!InThreadedWorld())
+    << "RPC is not available inside a threaded world.";
   RPC_Init_Once();
   return local_client;
 }
@@ -105,13 +131,8 @@ DeviceGroup global_device_group;
 
 std::vector<std::string> AllGatherHostnames(std::vector<int> ranks) {
   std::string local_hostname = Device::GetLocalHostname();
-  local_client->CommitHostName(local_hostname, rpc_world_rank); 
-  std::vector<std::string> hostnames;
-  hostnames.reserve(ranks.size());
-  for (int rank = 0; rank < ranks.size(); rank++) {
-    std::string rank_hostname = local_client->GetHostName(rank);
-    hostnames.emplace_back(rank_hostname);
-  }
+  // 一次MultiPut加一次Watch（server不支持时退化为逐个rank的GetHostName）
+  auto hostnames = local_client->AllGatherHostNames(local_hostname, rpc_world_rank, ranks.size());
   HT_LOG_INFO << "RPC:" << local_hostname << " " << hostnames;
   return hostnames;
 }
@@ -126,10 +147,13 @@ void SetUpDeviceMappingWithAssignedLocalDevice(const Device& local_device) {
 
   device_to_rank_mapping.reserve(world_size);
   rank_to_device_mapping.reserve(world_size);
-  local_client->CommitDeviceInfo(static_cast<int>(local_device.type()), local_device.index(), 
-                                 local_device.multiplex(), rpc_world_rank);
+  DeviceInfoReply local_info;
+  local_info.type = static_cast<int>(local_device.type());
+  local_info.index = local_device.index();
+  local_info.multiplex = local_device.multiplex();
+  auto device_infos = local_client->AllGatherDeviceInfos(local_info, rpc_world_rank, world_size);
   for (int rank = 0; rank < world_size; rank++) {
-    DeviceInfoReply reply = local_client->GetDeviceInfo(rank);
+    const DeviceInfoReply& reply = device_infos[rank];
     Device rank_device(static_cast<DeviceType>(reply.type),
                        reply.index, hostnames[rank],
                        reply.multiplex);
@@ -180,6 +204,12 @@ void SetUpDeviceMappingAndAssignLocalDevice(
 } // namespace
 
 void SetUpDeviceMappingWithAssignedLocalDeviceOnce(const Device& local_device) {
+  if (InThreadedWorld()) {
+    HT_ASSERT(local_device == GetLocalDevice())
+      << "Rank " << GetWorldRank() << " of the threaded world is bound to "
+      << GetLocalDevice() << ", got " << local_device;
+    return;
+  }
   if (!device_to_rank_mapping.empty()) {
     HT_LOG_WARN << "Device mapping has been set up.";
     return;
@@ -192,6 +222,8 @@ Device SetUpDeviceMappingAndAssignLocalDeviceOnce(
   const std::map<DeviceType, int>& resources,
   const std::vector<int64_t>& device_idxs,
   const std::string server_address) {
+  if (InThreadedWorld())
+    return GetLocalDevice();
   rpc_world_size = resources.find(kCUDA)->second;
   HT_LOG_INFO << server_address;
   global_server_address = server_address;
@@ -205,16 +237,22 @@ Device SetUpDeviceMappingAndAssignLocalDeviceOnce(
 }
 
 bool IsGlobalDeviceGroupReady() {
+  if (InThreadedWorld())
+    return true;
   return !global_device_group.empty();
 }
 
 const DeviceGroup& GetGlobalDeviceGroup() {
+  if (InThreadedWorld())
+    return ThreadedWorld::GetDeviceGroup();
   HT_ASSERT(!device_to_rank_mapping.empty())
     << "Please set up the device mapping in advance.";
   return global_device_group;
 }
 
 const Device& GetLocalDevice() {
+  if (InThreadedWorld())
+    return ThreadedWorld::Devices().at(GetThreadedWorldRank());
   if (rank_to_device_mapping.empty())
     return Device();
   HT_ASSERT(!rank_to_device_mapping.empty())
@@ -223,6 +261,8 @@ const Device& GetLocalDevice() {
 }
 
 int GetRankOfLocalHost() {
+  if (InThreadedWorld())
+    return GetThreadedWorldRank();
   int world_rank = GetWorldRank(), local_rank = 0;
   for (int i = 0; i < world_rank; i++)
     if (rank_to_device_mapping[i].local())
@@ -231,6 +271,13 @@ int GetRankOfLocalHost() {
 }
 
 int DeviceToWorldRank(const Device& device) {
+  if (InThreadedWorld()) {
+    const auto& devices = ThreadedWorld::Devices();
+    auto it = std::find(devices.begin(), devices.end(), device);
+    HT_ASSERT(it != devices.end())
+      << "Cannot find device " << device << " in the threaded world.";
+    return std::distance(devices.begin(), it);
+  }
   auto it = device_to_rank_mapping.find(device);
   HT_ASSERT(it != device_to_rank_mapping.end())
     << "Cannot find device " << device << ".";
@@ -238,6 +285,8 @@ int DeviceToWorldRank(const Device& device) {
 }
 
 const Device& WorldRankToDevice(int rank) {
+  if (InThreadedWorld())
+    return ThreadedWorld::Devices().at(rank);
   HT_ASSERT(rank < rank_to_device_mapping.size())
     << "Cannot find rank " << rank << ".";
   return rank_to_device_mapping[rank];
@@ -252,6 +301,97 @@ std::vector<int> DeviceGroupToWorldRanks(const DeviceGroup& device_group) {
   return ranks;
 }
 
+/******************************************************
+ * Rendezvous over RPC
+ ******************************************************/
+
+namespace {
+static std::mutex tree_rendezvous_mutex;
+static std::unordered_map<std::string, std::shared_ptr<TreeRendezvous>> tree_rendezvous;
+static std::unordered_map<std::string, int64_t> flat_broadcast_generations;
+
+std::string WorldRanksKey(const std::vector<int>& world_ranks) {
+  std::string key;
+  for (auto rank : world_ranks)
+    key += std::to_string(rank) + ",";
+  return key;
+}
+
+int GetTreeRendezvousArity() {
+  static int arity = []() {
+    const char* env = std::getenv("HYDRAULIS_RPC_TREE_ARITY");
+    return env == nullptr ? 0 : std::atoi(env);
+  }();
+  return arity;
+}
+
+std::shared_ptr<TreeRendezvous> GetOrCreateTreeRendezvous(const std::vector<int>& world_ranks) {
+  auto key = WorldRanksKey(world_ranks);
+  std::lock_guard<std::mutex> lock(tree_rendezvous_mutex);
+  auto it = tree_rendezvous.find(key);
+  if (it == tree_rendezvous.end()) {
+    std::vector<std::string> hostnames;
+    hostnames.reserve(world_ranks.size());
+    for (auto rank : world_ranks)
+      hostnames.push_back(WorldRankToDevice(rank).hostname());
+    RendezvousTree tree(world_ranks, hostnames, GetTreeRendezvousArity());
+    it = tree_rendezvous.emplace(key, std::make_shared<TreeRendezvous>(
+      GetLocalClient(), GetWorldRank(), std::move(tree), key)).first;
+  }
+  return it->second;
+}
+} // namespace
+
+bool UseTreeRendezvous() {
+  // 树需要知道每个rank所在的host，因此device mapping建立之前总是使用平铺的方式
+  return GetTreeRendezvousArity() >= 2 && !InThreadedWorld() &&
+         IsGlobalDeviceGroupReady() && GetLocalClient()->SupportsBatchedRPC();
+}
+
+void RPCBarrier(const std::vector<int>& world_ranks) {
+  if (UseTreeRendezvous()) {
+    GetOrCreateTreeRendezvous(world_ranks)->Barrier();
+    return;
+  }
+  GetLocalClient()->Barrier(GetWorldRank(), world_ranks);
+}
+
+std::string RPCBroadcast(const std::string& payload, int src, const std::vector<int>& world_ranks,
+                         const std::string& tag) {
+  if (UseTreeRendezvous())
+    return GetOrCreateTreeRendezvous(world_ranks)->Broadcast(payload, src, tag);
+  // 平铺的方式：src写入，其他rank直接从server读取
+  int64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(tree_rendezvous_mutex);
+    generation = ++flat_broadcast_generations[WorldRanksKey(world_ranks) + tag];
+  }
+  // 每个rank一个key，读到后即删除，server上不会随着step累积key
+  auto prefix = "bcast/" + WorldRanksKey(world_ranks) + "/" + tag + "/" + std::to_string(generation) + "/";
+  auto client = GetLocalClient();
+  bool batched = client->SupportsBatchedRPC();
+  if (GetWorldRank() == src) {
+    KeyValueList kvs;
+    for (auto rank : world_ranks) {
+      if (rank != src)
+        kvs.emplace_back(prefix + std::to_string(rank), payload);
+    }
+    if (batched) {
+      client->MultiPut(kvs);
+    } else {
+      for (const auto& kv : kvs)
+        client->PutBytes(kv.first, kv.second);
+    }
+    return payload;
+  }
+  auto key = prefix + std::to_string(GetWorldRank());
+  if (batched)
+    return client->MultiGet({key}, -1, true).front();
+  auto value = client->GetBytes(key);
+  client->RemoveBytes(key);
+  return value;
+}
+
 } // namespace comm
 } // namespace impl
 } // namespace hydraulis
@@ -0,0 +1,729 @@
+#include "hydraulis/impl/communication/rpc_server.h"
+#include "hydraulis/impl/communication/rpc_client.h"
+#include "hydraulis/impl/communication/rpc_tree.h"
+#include "hydraulis/core/device.h"
+#include "hydraulis/common/logging.h"
+#include "hydraulis/common/except.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <numeric>
+
+namespace hydraulis {
+
+namespace {
+
+inline bool StartsWith(const std::string& str, const std::string& prefix) {
+  return str.size() >= prefix.size() && str.compare(0, prefix.size(), prefix) == 0;
+}
+
+// 不同类型的数据放在不同的命名空间中
+inline std::string TypedKey(const std::string& type, const std::string& key) {
+  return type + "/" + key;
+}
+
+template <typename T>
+inline std::string EncodePOD(T value) {
+  std::string bytes(sizeof(T), '\0');
+  std::memcpy(bytes.data(), &value, sizeof(T));
+  return bytes;
+}
+
+template <typename T>
+inline T DecodePOD(const std::string& bytes) {
+  HT_ASSERT(bytes.size() == sizeof(T))
+    << "Value size mismatched: " << bytes.size() << " vs. " << sizeof(T);
+  T value;
+  std::memcpy(&value, bytes.data(), sizeof(T));
+  return value;
+}
+
+inline std::string RanksKey(const google::protobuf::RepeatedField<int32_t>& ranks) {
+  std::string key;
+  for (auto rank : ranks)
+    key += std::to_string(rank) + ",";
+  return key;
+}
+
+const grpc::Status kShutdownStatus(grpc::StatusCode::CANCELLED, "The rpc server is shutting down");
+
+constexpr int64_t kRemoveTimeoutMs = 1000;
+
+} // namespace
+
+/******************************************************
+ * KVStore
+ ******************************************************/
+
+KVStore::KVStore() {
+  _timer_thread = std::thread(&KVStore::TimerLoop, this);
+}
+
+KVStore::~KVStore() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopped = true;
+  }
+  _timer_cv.notify_all();
+  if (_timer_thread.joinable())
+    _timer_thread.join();
+}
+
+KeyValueList KVStore::Collect(const Waiter& waiter) const {
+  KeyValueList kvs;
+  if (waiter.is_watch) {
+    for (auto it = _kvs.lower_bound(waiter.prefix);
+         it != _kvs.end() && StartsWith(it->first, waiter.prefix); it++)
+      kvs.emplace_back(it->first, it->second);
+  } else {
+    kvs.reserve(waiter.keys.size());
+    for (const auto& key : waiter.keys)
+      kvs.emplace_back(key, _kvs.at(key));
+  }
+  return kvs;
+}
+
+size_t KVStore::WaitMissingKeys(const WaiterPtr& waiter) {
+  std::unordered_set<std::string> missing;
+  for (const auto& key : waiter->keys) {
+    if (_kvs.find(key) == _kvs.end())
+      missing.insert(key);
+  }
+  waiter->num_missing = missing.size();
+  for (const auto& key : missing)
+    _key_waiters[key].push_back(waiter);
+  return missing.size();
+}
+
+void KVStore::Complete(ReadyList& ready) {
+  for (auto& item : ready)
+    item.first->callback(true, std::move(item.second));
+  ready.clear();
+}
+
+void KVStore::MultiPut(const KeyValueList& kvs) {
+  ReadyList ready;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& kv : kvs) {
+      auto insertion = _kvs.insert_or_assign(kv.first, kv.second);
+      if (!insertion.second)
+        continue;
+      // 新的key才会改变waiter的状态
+      auto it = _key_waiters.find(kv.first);
+      if (it != _key_waiters.end()) {
+        auto waiters = std::move(it->second);
+        _key_waiters.erase(it);
+        for (auto& waiter : waiters) {
+          if (waiter->done || --waiter->num_missing > 0)
+            continue;
+          // 等待期间已经到达的key可能被Remove，重新登记缺失的key
+          if (WaitMissingKeys(waiter) > 0)
+            continue;
+          waiter->done = true;
+          ready.emplace_back(waiter, Collect(*waiter));
+        }
+      }
+      for (auto& watcher : _watchers) {
+        if (!watcher->done && StartsWith(kv.first, watcher->prefix) &&
+            ++watcher->num_matched >= watcher->count) {
+          watcher->done = true;
+          ready.emplace_back(watcher, Collect(*watcher));
+        }
+      }
+    }
+    _watchers.erase(std::remove_if(_watchers.begin(), _watchers.end(),
+                                   [](const WaiterPtr& watcher) { return watcher->done; }),
+                    _watchers.end());
+  }
+  Complete(ready);
+}
+
+void KVStore::MultiGet(const std::vector<std::string>& keys, Callback callback, int64_t timeout_ms) {
+  auto waiter = std::make_shared<Waiter>();
+  waiter->keys = keys;
+  waiter->callback = std::move(callback);
+  KeyValueList kvs;
+  bool ready = false;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (WaitMissingKeys(waiter) == 0) {
+      kvs = Collect(*waiter);
+      waiter->done = ready = true;
+    } else {
+      AddDeadline(waiter, timeout_ms);
+    }
+  }
+  // 释放锁之后waiter可能已经被其他线程完成，这里只处理立即就绪的情形
+  if (ready)
+    waiter->callback(true, std::move(kvs));
+}
+
+void KVStore::Watch(const std::string& prefix, size_t count, Callback callback, int64_t timeout_ms) {
+  auto waiter = std::make_shared<Waiter>();
+  waiter->is_watch = true;
+  waiter->prefix = prefix;
+  waiter->count = count;
+  waiter->callback = std::move(callback);
+  KeyValueList kvs;
+  bool ready = false;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _kvs.lower_bound(prefix); it != _kvs.end() && StartsWith(it->first, prefix); it++)
+      waiter->num_matched++;
+    if (waiter->num_matched >= count) {
+      kvs = Collect(*waiter);
+      waiter->done = ready = true;
+    } else {
+      _watchers.push_back(waiter);
+      AddDeadline(waiter, timeout_ms);
+    }
+  }
+  // 释放锁之后waiter可能已经被其他线程完成，这里只处理立即就绪的情形
+  if (ready)
+    waiter->callback(true, std::move(kvs));
+}
+
+bool KVStore::Remove(const std::string& key) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_kvs.erase(key) == 0)
+    return false;
+  for (auto& watcher : _watchers) {
+    if (StartsWith(key, watcher->prefix))
+      watcher->num_matched--;
+  }
+  return true;
+}
+
+void KVStore::CancelAll() {
+  std::vector<WaiterPtr> waiters;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& kv : _key_waiters)
+      waiters.insert(waiters.end(), kv.second.begin(), kv.second.end());
+    waiters.insert(waiters.end(), _watchers.begin(), _watchers.end());
+    _key_waiters.clear();
+    _watchers.clear();
+    _deadlines.clear();
+    // 同一个waiter可能等待多个key
+    std::sort(waiters.begin(), waiters.end());
+    waiters.erase(std::unique(waiters.begin(), waiters.end()), waiters.end());
+    waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                 [](const WaiterPtr& waiter) { return waiter->done; }),
+                  waiters.end());
+    for (auto& waiter : waiters)
+      waiter->done = true;
+  }
+  for (auto& waiter : waiters)
+    waiter->callback(false, {});
+}
+
+void KVStore::AddDeadline(const WaiterPtr& waiter, int64_t timeout_ms) {
+  if (timeout_ms <= 0)
+    return;
+  auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+  bool earliest = _deadlines.empty() || deadline < _deadlines.begin()->first;
+  _deadlines.emplace(deadline, waiter);
+  if (earliest)
+    _timer_cv.notify_one();
+}
+
+void KVStore::TimerLoop() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (!_stopped) {
+    if (_deadlines.empty()) {
+      _timer_cv.wait(lock);
+      continue;
+    }
+    auto deadline = _deadlines.begin()->first;
+    if (Clock::now() < deadline) {
+      _timer_cv.wait_until(lock, deadline);
+      continue;
+    }
+    std::vector<WaiterPtr> expired;
+    while (!_deadlines.empty() && _deadlines.begin()->first <= Clock::now()) {
+      auto waiter = _deadlines.begin()->second.lock();
+      _deadlines.erase(_deadlines.begin());
+      if (waiter == nullptr || waiter->done)
+        continue;
+      waiter->done = true;
+      if (waiter->is_watch) {
+        _watchers.erase(std::remove(_watchers.begin(), _watchers.end(), waiter), _watchers.end());
+      } else {
+        for (const auto& key : waiter->keys) {
+          auto it = _key_waiters.find(key);
+          if (it == _key_waiters.end())
+            continue;
+          auto& waiters = it->second;
+          waiters.erase(std::remove(waiters.begin(), waiters.end(), waiter), waiters.end());
+          if (waiters.empty())
+            _key_waiters.erase(it);
+        }
+      }
+      expired.push_back(std::move(waiter));
+    }
+    lock.unlock();
+    for (auto& waiter : expired)
+      waiter->callback(false, {});
+    lock.lock();
+  }
+}
+
+/******************************************************
+ * DeviceControllerServer
+ ******************************************************/
+
+grpc::ServerUnaryReactor* DeviceControllerServer::GetOrWait(grpc::CallbackServerContext* context,
+                                                            const std::string& key,
+                                                            std::function<void(const std::string&)> fill) {
+  auto* reactor = context->DefaultReactor();
+  _store.MultiGet({key}, [reactor, fill](bool ok, KeyValueList&& kvs) {
+    if (!ok) {
+      reactor->Finish(kShutdownStatus);
+      return;
+    }
+    fill(kvs.front().second);
+    reactor->Finish(grpc::Status::OK);
+  });
+  return reactor;
+}
+
+template <typename Reply>
+grpc::ServerUnaryReactor* DeviceControllerServer::RemoveOrTimeout(grpc::CallbackServerContext* context,
+                                                                  const std::string& type,
+                                                                  const std::string& key,
+                                                                  Reply* reply) {
+  auto* reactor = context->DefaultReactor();
+  auto typed_key = TypedKey(type, key);
+  _store.MultiGet({typed_key}, [this, reactor, reply, typed_key, key](bool ok, KeyValueList&&) {
+    if (ok && _store.Remove(typed_key))
+      reply->set_message("already remove:" + key);
+    else
+      reply->set_message("not found:" + key);
+    reactor->Finish(grpc::Status::OK);
+  }, kRemoveTimeoutMs);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::Connect(grpc::CallbackServerContext* context,
+                                                          const ConnectRequest* request,
+                                                          ConnectReply* reply) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto nodename = "node-" + request->hostname();
+    if (_local_world_sizes.find(nodename) == _local_world_sizes.end()) {
+      _local_world_sizes[nodename] = 0;
+      _nodenames.push_back(nodename);
+    }
+    _local_world_sizes[nodename]++;
+    _world_size++;
+  }
+  reply->set_status(1);
+  auto* reactor = context->DefaultReactor();
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::GetRank(grpc::CallbackServerContext* context,
+                                                          const RankRequest* request,
+                                                          RankReply* reply) {
+  int rank = 0;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // rank按照node的注册顺序连续编号
+    auto nodename = "node-" + request->name();
+    for (const auto& name : _nodenames) {
+      if (name == nodename) {
+        rank += _local_ranks[nodename]++;
+        break;
+      }
+      rank += _local_world_sizes[name];
+    }
+    _last_heartbeats[rank] = Clock::now();
+    _num_ranks++;
+  }
+  HT_LOG_DEBUG << request->name() << " gets rank " << rank;
+  reply->set_rank(rank);
+  auto* reactor = context->DefaultReactor();
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::CommitHostName(grpc::CallbackServerContext* context,
+                                                                 const CommitHostNameRequest* request,
+                                                                 CommitHostNameReply* reply) {
+  _store.MultiPut({{HostNameKey(request->rank()), request->hostname()}});
+  reply->set_status(1);
+  auto* reactor = context->DefaultReactor();
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::GetHostName(grpc::CallbackServerContext* context,
+                                                              const GetHostNameRequest* request,
+                                                              GetHostNameReply* reply) {
+  return GetOrWait(context, HostNameKey(request->rank()), [reply](const std::string& value) {
+    reply->set_hostname(value);
+  });
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::CommitDeviceInfo(grpc::CallbackServerContext* context,
+                                                                   const CommitDeviceInfoRequest* request,
+                                                                   CommitDeviceInfoReply* reply) {
+  DeviceInfoReply info;
+  info.type = request->type();
+  info.index = request->index();
+  info.multiplex = request->multiplex();
+  _store.MultiPut({{DeviceInfoKey(request->rank()), EncodeDeviceInfo(info)}});
+  reply->set_status(1);
+  auto* reactor = context->DefaultReactor();
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::GetDeviceInfo(grpc::CallbackServerContext* context,
+                                                                const GetDeviceInfoRequest* request,
+                                                                GetDeviceInfoReply* reply) {
+  return GetOrWait(context, DeviceInfoKey(request->rank()), [reply](const std::string& value) {
+    auto info = DecodeDeviceInfo(value);
+    reply->set_type(info.type);
+    reply->set_index(info.index);
+    reply->set_multiplex(info.multiplex);
+  });
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::CommitNcclId(grpc::CallbackServerContext* context,
+                                                               const CommitNcclIdRequest* request,
+                                                               CommitNcclIdReply* reply) {
+  std::vector<int> world_rank(request->world_rank().begin(), request->world_rank().end());
+  _store.MultiPut({{NcclIdKey(world_rank, request->stream_id()), request->nccl_id()}});
+  reply->set_status(1);
+  auto* reactor = context->DefaultReactor();
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::GetNcclId(grpc::CallbackServerContext* context,
+                                                            const GetNcclIdRequest* request,
+                                                            GetNcclIdReply* reply) {
+  std::vector<int> world_rank(request->world_rank().begin(), request->world_rank().end());
+  return GetOrWait(context, NcclIdKey(world_rank, request->stream_id()), [reply](const std::string& value) {
+    reply->set_nccl_id(value);
+  });
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::Exit(grpc::CallbackServerContext* context,
+                                                       const ExitRequest* request, ExitReply* reply) {
+  size_t num_exited;
+  int world_size;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _exited.insert(request->rank());
+    num_exited = _exited.size();
+    world_size = _world_size;
+  }
+  HT_LOG_INFO << num_exited << " of " << world_size << " ranks have exited";
+  reply->set_status(1);
+  auto* reactor = context->DefaultReactor();
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+#define DEFINE_TYPED_KV_RPCS(Type, type, Encode, Decode)                        \
+  grpc::ServerUnaryReactor* DeviceControllerServer::Put##Type(                 \
+    grpc::CallbackServerContext* context, const Put##Type##Request* request,   \
+    Put##Type##Reply* reply) {                                                 \
+    _store.MultiPut({{TypedKey(#type, request->key()), Encode(request->value())}}); \
+    reply->set_status(1);                                                      \
+    auto* reactor = context->DefaultReactor();                                 \
+    reactor->Finish(grpc::Status::OK);                                         \
+    return reactor;                                                            \
+  }                                                                            \
+  grpc::ServerUnaryReactor* DeviceControllerServer::Get##Type(                 \
+    grpc::CallbackServerContext* context, const Get##Type##Request* request,   \
+    Get##Type##Reply* reply) {                                                 \
+    return GetOrWait(context, TypedKey(#type, request->key()),                 \
+                     [reply](const std::string& value) {                       \
+                       reply->set_value(Decode(value));                        \
+                     });                                                       \
+  }                                                                            \
+  grpc::ServerUnaryReactor* DeviceControllerServer::Remove##Type(              \
+    grpc::CallbackServerContext* context, const Remove##Type##Request* request, \
+    Remove##Type##Reply* reply) {                                              \
+    return RemoveOrTimeout(context, #type, request->key(), reply);             \
+  }
+
+#define HT_RPC_IDENTITY(x) (x)
+
+DEFINE_TYPED_KV_RPCS(Double, double, EncodePOD<double>, DecodePOD<double>)
+DEFINE_TYPED_KV_RPCS(Int, int, EncodePOD<int64_t>, DecodePOD<int64_t>)
+DEFINE_TYPED_KV_RPCS(String, string, HT_RPC_IDENTITY, HT_RPC_IDENTITY)
+DEFINE_TYPED_KV_RPCS(Bytes, bytes, HT_RPC_IDENTITY, HT_RPC_IDENTITY)
+DEFINE_TYPED_KV_RPCS(Json, json, HT_RPC_IDENTITY, HT_RPC_IDENTITY)
+
+#undef HT_RPC_IDENTITY
+#undef DEFINE_TYPED_KV_RPCS
+
+grpc::ServerUnaryReactor* DeviceControllerServer::Barrier(grpc::CallbackServerContext* context,
+                                                          const BarrierRequest* request,
+                                                          BarrierReply* reply) {
+  auto* reactor = context->DefaultReactor();
+  std::vector<std::pair<grpc::ServerUnaryReactor*, BarrierReply*>> released;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& barrier = _barriers[RanksKey(request->world_rank())];
+    barrier.waiters.emplace_back(reactor, reply);
+    // 最后一个到达的请求释放所有请求，之后同一组ranks的barrier重新计数
+    if (++barrier.num_arrived >= static_cast<size_t>(request->world_rank_size())) {
+      released = std::move(barrier.waiters);
+      barrier = BarrierState();
+    }
+  }
+  for (auto& waiter : released) {
+    waiter.second->set_status(1);
+    waiter.first->Finish(grpc::Status::OK);
+  }
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::HeartBeat(grpc::CallbackServerContext* context,
+                                                            const HeartBeatRequest* request,
+                                                            HeartBeatReply* reply) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _last_heartbeats[request->rank()] = Clock::now();
+  }
+  reply->set_status(1);
+  auto* reactor = context->DefaultReactor();
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::MultiPut(grpc::CallbackServerContext* context,
+                                                           const MultiPutRequest* request,
+                                                           MultiPutReply* reply) {
+  KeyValueList kvs;
+  kvs.reserve(request->kvs_size());
+  for (const auto& kv : request->kvs())
+    kvs.emplace_back(kv.key(), kv.value());
+  _store.MultiPut(kvs);
+  reply->set_status(1);
+  auto* reactor = context->DefaultReactor();
+  reactor->Finish(grpc::Status::OK);
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::MultiGet(grpc::CallbackServerContext* context,
+                                                           const MultiGetRequest* request,
+                                                           MultiGetReply* reply) {
+  auto* reactor = context->DefaultReactor();
+  std::vector<std::string> keys(request->keys().begin(), request->keys().end());
+  bool remove = request->remove();
+  _store.MultiGet(keys, [this, reactor, reply, remove](bool ok, KeyValueList&& kvs) {
+    reply->set_status(ok ? 1 : 0);
+    // 只有一个读者的key（例如rendezvous的key）读完即删除，避免server上的key不断累积
+    if (ok && remove) {
+      for (const auto& kv : kvs)
+        _store.Remove(kv.first);
+    }
+    for (auto& kv : kvs) {
+      auto* entry = reply->add_kvs();
+      entry->set_key(std::move(kv.first));
+      entry->set_value(std::move(kv.second));
+    }
+    reactor->Finish(grpc::Status::OK);
+  }, request->timeout_ms());
+  return reactor;
+}
+
+grpc::ServerUnaryReactor* DeviceControllerServer::Watch(grpc::CallbackServerContext* context,
+                                                        const WatchRequest* request,
+                                                        WatchReply* reply) {
+  auto* reactor = context->DefaultReactor();
+  _store.Watch(request->prefix(), std::max(request->count(), 0),
+               [reactor, reply](bool ok, KeyValueList&& kvs) {
+    reply->set_status(ok ? 1 : 0);
+    for (auto& kv : kvs) {
+      auto* entry = reply->add_kvs();
+      entry->set_key(std::move(kv.first));
+      entry->set_value(std::move(kv.second));
+    }
+    reactor->Finish(grpc::Status::OK);
+  }, request->timeout_ms());
+  return reactor;
+}
+
+void DeviceControllerServer::CheckHeartBeats() {
+  if (_heartbeat_timeout_s <= 0)
+    return;
+  auto now = Clock::now();
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (const auto& kv : _last_heartbeats) {
+    if (_exited.find(kv.first) != _exited.end())
+      continue;
+    auto interval = std::chrono::duration_cast<std::chrono::seconds>(now - kv.second).count();
+    if (interval > _heartbeat_timeout_s) {
+      HT_LOG_WARN << "Rank " << kv.first << " has no heartbeat for " << interval
+                  << " seconds and is regarded as exited";
+      _exited.insert(kv.first);
+    }
+  }
+}
+
+bool DeviceControllerServer::AllExited() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _num_ranks > 0 && static_cast<int>(_exited.size()) >= _num_ranks;
+}
+
+void DeviceControllerServer::CancelAll() {
+  _store.CancelAll();
+  std::vector<std::pair<grpc::ServerUnaryReactor*, BarrierReply*>> cancelled;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& kv : _barriers) {
+      cancelled.insert(cancelled.end(), kv.second.waiters.begin(), kv.second.waiters.end());
+      kv.second = BarrierState();
+    }
+  }
+  for (auto& waiter : cancelled)
+    waiter.first->Finish(kShutdownStatus);
+}
+
+void RunDeviceControllerServer(const std::string& address, int64_t heartbeat_timeout_s) {
+  DeviceControllerServer service(heartbeat_timeout_s);
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort(address, grpc::InsecureServerCredentials());
+  builder.RegisterService(&service);
+  std::unique_ptr<grpc::Server> server = builder.BuildAndStart();
+  HT_RUNTIME_ERROR_IF(server == nullptr)
+    << "Failed to start the rpc server on " << address;
+  HT_LOG_INFO << "Server started, listening on " << address;
+  while (!service.AllExited()) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    service.CheckHeartBeats();
+  }
+  service.CancelAll();
+  server->Shutdown();
+  HT_LOG_INFO << "Server stopped";
+}
+
+double BenchmarkRPCStartup(const std::string& address, int num_ranks, bool use_batched_rpc, int tp_size) {
+  HT_VALUE_ERROR_IF(num_ranks <= 0 || tp_size <= 0)
+    << "Invalid num_ranks " << num_ranks << " or tp_size " << tp_size;
+  std::vector<int> all_ranks(num_ranks);
+  std::iota(all_ranks.begin(), all_ranks.end(), 0);
+  const std::string hostname = "bench";
+  const std::string fake_nccl_id(128, 'x');
+  std::vector<std::exception_ptr> errors(num_ranks);
+  std::vector<std::thread> threads;
+  threads.reserve(num_ranks);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_ranks; i++) {
+    threads.emplace_back([&, i]() {
+      try {
+        // 每个虚拟rank使用独立的channel，模拟独立的进程
+        grpc::ChannelArguments args;
+        args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        DeviceClient client(grpc::CreateCustomChannel(address, grpc::InsecureChannelCredentials(), args),
+                            5, use_batched_rpc);
+        client.Connect(hostname);
+        client.Barrier(0, all_ranks);
+        int rank = client.GetRank(hostname);
+        client.AllGatherHostNames(hostname, rank, num_ranks);
+        DeviceInfoReply info;
+        info.type = static_cast<int>(kCUDA);
+        info.index = rank % tp_size;
+        info.multiplex = 0;
+        client.AllGatherDeviceInfos(info, rank, num_ranks);
+        // 全局的以及tp组内的nccl id
+        std::vector<int> tp_ranks;
+        for (int r = rank / tp_size * tp_size; r < std::min(num_ranks, (rank / tp_size + 1) * tp_size); r++)
+          tp_ranks.push_back(r);
+        for (const auto& group : {all_ranks, tp_ranks}) {
+          if (rank == group.front())
+            client.CommitNcclId(fake_nccl_id, group, 0);
+          else
+            client.GetNcclId(group, 0);
+        }
+        client.Barrier(rank, all_ranks);
+        client.Exit(rank);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  double elapsed_ms = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+  for (auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+  HT_LOG_INFO << "[RPC Startup] " << num_ranks << " ranks, "
+              << (use_batched_rpc ? "batched" : "per-key") << " rpc: " << elapsed_ms << " ms";
+  return elapsed_ms;
+}
+
+double BenchmarkRPCBarrier(const std::string& address, int num_ranks, int ranks_per_host,
+                           int arity, int num_iters) {
+  HT_VALUE_ERROR_IF(num_ranks <= 0 || ranks_per_host <= 0 || num_iters <= 0)
+    << "Invalid num_ranks " << num_ranks << ", ranks_per_host " << ranks_per_host
+    << " or num_iters " << num_iters;
+  std::vector<int> all_ranks(num_ranks);
+  std::iota(all_ranks.begin(), all_ranks.end(), 0);
+  std::vector<std::string> hostnames(num_ranks);
+  for (int i = 0; i < num_ranks; i++)
+    hostnames[i] = "bench-host-" + std::to_string(i / ranks_per_host);
+  std::vector<double> latencies(num_ranks, 0);
+  std::vector<std::exception_ptr> errors(num_ranks);
+  std::vector<std::thread> threads;
+  threads.reserve(num_ranks);
+  for (int i = 0; i < num_ranks; i++) {
+    threads.emplace_back([&, i]() {
+      try {
+        grpc::ChannelArguments args;
+        args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        auto client = std::make_shared<DeviceClient>(
+          grpc::CreateCustomChannel(address, grpc::InsecureChannelCredentials(), args));
+        client->Connect(hostnames[i]);
+        client->Barrier(0, all_ranks);
+        int rank = client->GetRank(hostnames[i]);
+        std::unique_ptr<TreeRendezvous> tree;
+        if (arity >= 2)
+          tree = std::make_unique<TreeRendezvous>(client, rank, RendezvousTree(all_ranks, hostnames, arity),
+                                                  "bench");
+        auto barrier = [&]() {
+          if (tree != nullptr)
+            tree->Barrier();
+          else
+            client->Barrier(rank, all_ranks);
+        };
+        // 预热一次，之后所有rank大致同时开始
+        barrier();
+        auto start = std::chrono::steady_clock::now();
+        for (int iter = 0; iter < num_iters; iter++)
+          barrier();
+        latencies[rank] = std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start).count() / num_iters;
+        client->Exit(rank);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  for (auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+  // 最慢的rank决定了barrier的延迟
+  double latency = *std::max_element(latencies.begin(), latencies.end());
+  HT_LOG_INFO << "[RPC Barrier] " << num_ranks << " ranks (" << ranks_per_host << " per host), "
+              << (arity >= 2 ? std::to_string(arity) + "-ary tree" : std::string("flat"))
+              << ": " << latency << " ms per barrier";
+  return latency;
+}
+
+} //namespace hydraulis
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "hydraulis/impl/communication/rpc_client_impl.h"
+#include <grpcpp/grpcpp.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "hydraulis/impl/communication/rpc/hydraulisrpc.grpc.pb.h"
+
+namespace hydraulis {
+
+/******************************************************
+ * Native coordination server
+ *
+ * python版本的server在Get系列RPC与Barrier中轮询（或者在condition上等待），
+ * 每个阻塞的请求都会占用server线程池中的一个线程，rank较多时启动时间主要花在这里。
+ * 这里使用grpc的callback API：数据未就绪时只登记一个waiter，
+ * 由写入数据的请求完成等待的请求，不占用线程也不轮询。
+ ******************************************************/
+
+// 事件驱动的key-value store
+class KVStore {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // ok为false表示超时，回调在锁外执行
+  using Callback = std::function<void(bool ok, KeyValueList&& kvs)>;
+
+  KVStore();
+
+  ~KVStore();
+
+  void MultiPut(const KeyValueList& kvs);
+
+  // 所有key都存在时回调，kvs按照keys的顺序
+  // timeout_ms不大于0时一直等待
+  void MultiGet(const std::vector<std::string>& keys, Callback callback, int64_t timeout_ms = -1);
+
+  // 以prefix开头的key的数目不少于count时回调，kvs按照key排序
+  void Watch(const std::string& prefix, size_t count, Callback callback, int64_t timeout_ms = -1);
+
+  bool Remove(const std::string& key);
+
+  // 以ok=false完成所有waiter
+  void CancelAll();
+
+ protected:
+  struct Waiter {
+    bool is_watch{false};
+    bool done{false};
+    std::vector<std::string> keys; // MultiGet
+    size_t num_missing{0};
+    std::string prefix; // Watch
+    size_t count{0};
+    size_t num_matched{0};
+    Callback callback;
+  };
+  using WaiterPtr = std::shared_ptr<Waiter>;
+  using ReadyList = std::vector<std::pair<WaiterPtr, KeyValueList>>;
+
+  KeyValueList Collect(const Waiter& waiter) const;
+
+  // 把MultiGet的waiter登记到当前缺失的key上，返回缺失的key的数目
+  size_t WaitMissingKeys(const WaiterPtr& waiter);
+
+  void AddDeadline(const WaiterPtr& waiter, int64_t timeout_ms);
+
+  void TimerLoop();
+
+  static void Complete(ReadyList& ready);
+
+  mutable std::mutex _mutex;
+  std::map<std::string, std::string> _kvs; // 有序，便于按前缀查找
+  std::unordered_map<std::string, std::vector<WaiterPtr>> _key_waiters;
+  std::vector<WaiterPtr> _watchers;
+  std::multimap<Clock::time_point, std::weak_ptr<Waiter>> _deadlines;
+  std::condition_variable _timer_cv;
+  bool _stopped{false};
+  std::thread _timer_thread;
+};
+
+class DeviceControllerServer final : public DeviceController::CallbackService {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // heartbeat_timeout_s不大于0时不检查心跳
+  DeviceControllerServer(int64_t heartbeat_timeout_s = 10)
+  : _heartbeat_timeout_s(heartbeat_timeout_s) {}
+
+  grpc::ServerUnaryReactor* Connect(grpc::CallbackServerContext* context,
+                                    const ConnectRequest* request, ConnectReply* reply) override;
+
+  grpc::ServerUnaryReactor* GetRank(grpc::CallbackServerContext* context,
+                                    const RankRequest* request, RankReply* reply) override;
+
+  grpc::ServerUnaryReactor* CommitHostName(grpc::CallbackServerContext* context,
+                                           const CommitHostNameRequest* request,
+                                           CommitHostNameReply* reply) override;
+
+  grpc::ServerUnaryReactor* GetHostName(grpc::CallbackServerContext* context,
+                                        const GetHostNameRequest* request,
+                                        GetHostNameReply* reply) override;
+
+  grpc::ServerUnaryReactor* CommitDeviceInfo(grpc::CallbackServerContext* context,
+                                             const CommitDeviceInfoRequest* request,
+                                             CommitDeviceInfoReply* reply) override;
+
+  grpc::ServerUnaryReactor* GetDeviceInfo(grpc::CallbackServerContext* context,
+                                          const GetDeviceInfoRequest* request,
+                                          GetDeviceInfoReply* reply) override;
+
+  grpc::ServerUnaryReactor* CommitNcclId(grpc::CallbackServerContext* context,
+                                         const CommitNcclIdRequest* request,
+                                         CommitNcclIdReply* reply) override;
+
+  grpc::ServerUnaryReactor* GetNcclId(grpc::CallbackServerContext* context,
+                                      const GetNcclIdRequest* request, GetNcclIdReply* reply) override;
+
+  grpc::ServerUnaryReactor* Exit(grpc::CallbackServerContext* context,
+                                 const ExitRequest* request, ExitReply* reply) override;
+
+  grpc::ServerUnaryReactor* PutDouble(grpc::CallbackServerContext* context,
+                                      const PutDoubleRequest* request, PutDoubleReply* reply) override;
+
+  grpc::ServerUnaryReactor* GetDouble(grpc::CallbackServerContext* context,
+                                      const GetDoubleRequest* request, GetDoubleReply* reply) override;
+
+  grpc::ServerUnaryReactor* RemoveDouble(grpc::CallbackServerContext* context,
+                                         const RemoveDoubleRequest* request,
+                                         RemoveDoubleReply* reply) override;
+
+  grpc::ServerUnaryReactor* PutInt(grpc::CallbackServerContext* context,
+                                   const PutIntRequest* request, PutIntReply* reply) override;
+
+  grpc::ServerUnaryReactor* GetInt(grpc::CallbackServerContext* context,
+                                   const GetIntRequest* request, GetIntReply* reply) override;
+
+  grpc::ServerUnaryReactor* RemoveInt(grpc::CallbackServerContext* context,
+                                      const RemoveIntRequest* request, RemoveIntReply* reply) override;
+
+  grpc::ServerUnaryReactor* PutString(grpc::CallbackServerContext* context,
+                                      const PutStringRequest* request, PutStringReply* reply) override;
+
+  grpc::ServerUnaryReactor* GetString(grpc::CallbackServerContext* context,
+                                      const GetStringRequest* request, GetStringReply* reply) override;
+
+  grpc::ServerUnaryReactor* RemoveString(grpc::CallbackServerContext* context,
+                                         const RemoveStringRequest* request,
+                                         RemoveStringReply* reply) override;
+
+  grpc::ServerUnaryReactor* PutBytes(grpc::CallbackServerContext* context,
+                                     const PutBytesRequest* request, PutBytesReply* reply) override;
+
+  grpc::ServerUnaryReactor* GetBytes(grpc::CallbackServerContext* context,
+                                     const GetBytesRequest* request, GetBytesReply* reply) override;
+
+  grpc::ServerUnaryReactor* RemoveBytes(grpc::CallbackServerContext* context,
+                                        const RemoveBytesRequest* request,
+                                        RemoveBytesReply* reply) override;
+
+  grpc::ServerUnaryReactor* PutJson(grpc::CallbackServerContext* context,
+                                    const PutJsonRequest* request, PutJsonReply* reply) override;
+
+  grpc::ServerUnaryReactor* GetJson(grpc::CallbackServerContext* context,
+                                    const GetJsonRequest* request, GetJsonReply* reply) override;
+
+  grpc::ServerUnaryReactor* RemoveJson(grpc::CallbackServerContext* context,
+                                       const RemoveJsonRequest* request, RemoveJsonReply* reply) override;
+
+  grpc::ServerUnaryReactor* Barrier(grpc::CallbackServerContext* context,
+                                    const BarrierRequest* request, BarrierReply* reply) override;
+
+  grpc::ServerUnaryReactor* HeartBeat(grpc::CallbackServerContext* context,
+                                      const HeartBeatRequest* request, HeartBeatReply* reply) override;
+
+  grpc::ServerUnaryReactor* MultiPut(grpc::CallbackServerContext* context,
+                                     const MultiPutRequest* request, MultiPutReply* reply) override;
+
+  grpc::ServerUnaryReactor* MultiGet(grpc::CallbackServerContext* context,
+                                     const MultiGetRequest* request, MultiGetReply* reply) override;
+
+  grpc::ServerUnaryReactor* Watch(grpc::CallbackServerContext* context,
+                                  const WatchRequest* request, WatchReply* reply) override;
+
+  // 心跳超时的rank视为已退出
+  void CheckHeartBeats();
+
+  // 所有取得过rank的进程都已退出
+  bool AllExited();
+
+  // 以CANCELLED结束所有仍在等待的请求（shutdown之前调用）
+  void CancelAll();
+
+ protected:
+  // key不存在时等待，写入后再通过fill填充reply
+  grpc::ServerUnaryReactor* GetOrWait(grpc::CallbackServerContext* context, const std::string& key,
+                                      std::function<void(const std::string&)> fill);
+
+  // 与python server一致：最多等待1s，之后返回"not found:<key>"
+  template <typename Reply>
+  grpc::ServerUnaryReactor* RemoveOrTimeout(grpc::CallbackServerContext* context,
+                                            const std::string& type, const std::string& key,
+                                            Reply* reply);
+
+  struct BarrierState {
+    size_t num_arrived{0};
+    std::vector<std::pair<grpc::ServerUnaryReactor*, BarrierReply*>> waiters;
+  };
+
+  KVStore _store;
+  int64_t _heartbeat_timeout_s;
+
+  std::mutex _mutex;
+  std::vector<std::string> _nodenames;
+  std::unordered_map<std::string, int> _local_world_sizes;
+  std::unordered_map<std::string, int> _local_ranks;
+  int _world_size{0};
+  int _num_ranks{0}; // 调用过GetRank的进程数
+  std::unordered_map<int, Clock::time_point> _last_heartbeats;
+  std::unordered_set<int> _exited;
+  std::unordered_map<std::string, BarrierState> _barriers;
+};
+
+// 在address（如"0.0.0.0:23457"）上启动server，阻塞直到所有rank退出
+void RunDeviceControllerServer(const std::string& address, int64_t heartbeat_timeout_s = 10);
+
+// 在当前进程中用num_ranks个线程模拟各个rank的启动流程
+// （Connect、Barrier、GetRank、交换hostname与device info、交换nccl id）
+// 返回从开始到所有rank完成的时间（ms）
+double BenchmarkRPCStartup(const std::string& address, int num_ranks, bool use_batched_rpc,
+                           int tp_size = 8);
+
+// 用num_ranks个线程模拟ranks_per_host个rank一台机器的集群，测量barrier的平均延迟（ms）
+// arity不小于2时使用k叉树的barrier，否则所有rank直接在server上barrier
+double BenchmarkRPCBarrier(const std::string& address, int num_ranks, int ranks_per_host = 8,
+                           int arity = 0, int num_iters = 20);
+
+} //namespace hydraulis
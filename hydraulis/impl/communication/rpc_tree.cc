@@ -0,0 +1,126 @@
+#include "hydraulis/impl/communication/rpc_tree.h"
+#include "hydraulis/common/except.h"
+#include <algorithm>
+#include <map>
+
+namespace hydraulis {
+
+RendezvousTree::RendezvousTree(const std::vector<int>& world_ranks,
+                               const std::vector<std::string>& hostnames, int arity)
+: _arity(arity) {
+  HT_VALUE_ERROR_IF(world_ranks.empty())
+    << "Cannot build a rendezvous tree over no ranks";
+  HT_VALUE_ERROR_IF(world_ranks.size() != hostnames.size())
+    << "Got " << world_ranks.size() << " ranks but " << hostnames.size() << " hostnames";
+  HT_VALUE_ERROR_IF(arity < 2)
+    << "The arity of a rendezvous tree should be at least 2, got " << arity;
+  // 按照host分组（host按照其上最小的rank排序），组内按rank排序
+  std::map<std::string, std::vector<int>> host_ranks;
+  for (size_t i = 0; i < world_ranks.size(); i++)
+    host_ranks[hostnames[i]].push_back(world_ranks[i]);
+  std::vector<std::vector<int>> groups;
+  groups.reserve(host_ranks.size());
+  for (auto& kv : host_ranks) {
+    std::sort(kv.second.begin(), kv.second.end());
+    groups.push_back(std::move(kv.second));
+  }
+  std::sort(groups.begin(), groups.end(),
+            [](const std::vector<int>& x, const std::vector<int>& y) { return x.front() < y.front(); });
+  std::vector<int> leaders;
+  leaders.reserve(groups.size());
+  for (const auto& group : groups) {
+    Link(group);
+    leaders.push_back(group.front());
+  }
+  Link(leaders);
+  _root = leaders.front();
+  _parents[_root] = -1;
+}
+
+void RendezvousTree::Link(const std::vector<int>& nodes) {
+  for (size_t i = 0; i < nodes.size(); i++) {
+    _children[nodes[i]];
+    if (i == 0)
+      continue;
+    int parent = nodes[(i - 1) / _arity];
+    _parents[nodes[i]] = parent;
+    _children[parent].push_back(nodes[i]);
+  }
+}
+
+int RendezvousTree::depth() const {
+  int max_depth = 0;
+  for (const auto& kv : _parents) {
+    int d = 0;
+    for (int rank = kv.first; _parents.at(rank) != -1; rank = _parents.at(rank))
+      d++;
+    max_depth = std::max(max_depth, d);
+  }
+  return max_depth;
+}
+
+TreeRendezvous::TreeRendezvous(std::shared_ptr<DeviceClientImpl> client, int rank,
+                               RendezvousTree tree, std::string group_key)
+: _client(std::move(client)), _rank(rank), _tree(std::move(tree)), _group_key(std::move(group_key)) {
+  HT_VALUE_ERROR_IF(!_client->SupportsBatchedRPC())
+    << "Tree rendezvous requires a server supporting batched RPCs";
+}
+
+std::string TreeRendezvous::NextPrefix(const std::string& tag) {
+  return "tree/" + _group_key + "/" + tag + "/" + std::to_string(++_generations[tag]) + "/";
+}
+
+void TreeRendezvous::PutDown(const std::string& prefix, const std::string& value) {
+  const auto& children = _tree.children(_rank);
+  if (children.empty())
+    return;
+  KeyValueList kvs;
+  kvs.reserve(children.size());
+  for (auto child : children)
+    kvs.emplace_back(prefix + "down/" + std::to_string(child), value);
+  _client->MultiPut(kvs);
+}
+
+std::string TreeRendezvous::GetDown(const std::string& prefix) {
+  return _client->MultiGet({prefix + "down/" + std::to_string(_rank)}, -1, true).front();
+}
+
+void TreeRendezvous::Barrier() {
+  auto prefix = NextPrefix("barrier");
+  const auto& children = _tree.children(_rank);
+  int parent = _tree.parent(_rank);
+  // 汇聚：等待所有子节点到达后再通知父节点，读到的up key随即删除
+  if (!children.empty()) {
+    std::vector<std::string> keys;
+    keys.reserve(children.size());
+    for (auto child : children)
+      keys.push_back(prefix + "up/" + std::to_string(child));
+    _client->MultiGet(keys, -1, true);
+  }
+  if (parent != -1) {
+    _client->MultiPut({{prefix + "up/" + std::to_string(_rank), ""}});
+    GetDown(prefix);
+  }
+  // 分发：每个子节点等待并删除自己的down key
+  PutDown(prefix, "");
+}
+
+std::string TreeRendezvous::Broadcast(const std::string& payload, int src, const std::string& tag) {
+  auto prefix = NextPrefix(tag);
+  int root = _tree.root();
+  int parent = _tree.parent(_rank);
+  std::string value;
+  if (_rank == src)
+    value = payload;
+  // src不是根时先交给根
+  if (_rank == src && src != root)
+    _client->MultiPut({{prefix + "src", payload}});
+  if (_rank == root && src != root)
+    value = _client->MultiGet({prefix + "src"}, -1, true).front();
+  else if (parent != -1)
+    value = GetDown(prefix);
+  PutDown(prefix, value);
+  return value;
+}
+
+} //namespace hydraulis
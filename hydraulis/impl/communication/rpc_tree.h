@@ -0,0 +1,89 @@
+#pragma once
+
+#include "hydraulis/impl/communication/rpc_client_impl.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hydraulis {
+
+/******************************************************
+ * Hierarchical rendezvous
+ *
+ * 平铺的barrier中所有rank都在同一个key上等待，server需要一次唤醒所有rank。
+ * 这里ranks组成k叉树：先在每个host内部组成树（以host上最小的rank为根），
+ * 各host的根再组成树。barrier与broadcast沿着树先汇聚再分发，
+ * 每个key只有不超过k个rank在等待。
+ * 仍然通过server的key-value store通信（需要MultiPut/MultiGet）。
+ ******************************************************/
+
+class RendezvousTree {
+ public:
+  // hostnames[i]是world_ranks[i]所在的host
+  RendezvousTree(const std::vector<int>& world_ranks, const std::vector<std::string>& hostnames,
+                 int arity);
+
+  int root() const {
+    return _root;
+  }
+
+  // 根节点返回-1
+  int parent(int rank) const {
+    return _parents.at(rank);
+  }
+
+  const std::vector<int>& children(int rank) const {
+    return _children.at(rank);
+  }
+
+  int arity() const {
+    return _arity;
+  }
+
+  // 最深的叶子到根的边数
+  int depth() const;
+
+ protected:
+  // 按照nodes的顺序组成k叉树，nodes[0]为根
+  void Link(const std::vector<int>& nodes);
+
+  int _arity;
+  int _root;
+  std::unordered_map<int, int> _parents;
+  std::unordered_map<int, std::vector<int>> _children;
+};
+
+class TreeRendezvous {
+ public:
+  // group_key用于区分不同的rank集合，需要在各个rank上一致
+  TreeRendezvous(std::shared_ptr<DeviceClientImpl> client, int rank, RendezvousTree tree,
+                 std::string group_key);
+
+  void Barrier();
+
+  // src上的payload沿着树发给所有rank，返回收到的payload
+  // 同一个tag的broadcast需要在各个rank上按相同的顺序调用
+  std::string Broadcast(const std::string& payload, int src, const std::string& tag = "bcast");
+
+  const RendezvousTree& tree() const {
+    return _tree;
+  }
+
+ protected:
+  std::string NextPrefix(const std::string& tag);
+
+  // 给每个子节点写一个单独的down key，子节点读到后即删除，server上不会累积key
+  void PutDown(const std::string& prefix, const std::string& value);
+
+  std::string GetDown(const std::string& prefix);
+
+  std::shared_ptr<DeviceClientImpl> _client;
+  int _rank;
+  RendezvousTree _tree;
+  std::string _group_key;
+  // 每个tag已经完成的次数，用于生成互不冲突的key
+  std::unordered_map<std::string, int64_t> _generations;
+};
+
+} //namespace hydraulis
@@ -0,0 +1,975 @@
+#include "hydraulis/impl/communication/shm_comm_group.h"
+#include "hydraulis/impl/communication/mpi_comm_group.h"
+#include "hydraulis/impl/communication/thread_comm_group.h"
+#include "hydraulis/impl/communication/threaded_world.h"
+#include "hydraulis/impl/stream/CPUStream.h"
+#include "hydraulis/impl/utils/ndarray_utils.h"
+#include "hydraulis/impl/utils/dispatch.h"
+#include <sys/mman.h>
+#include <chrono>
+#include <cmath>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <mutex>
+#include <thread>
+
+namespace hydraulis {
+namespace impl {
+namespace comm {
+
+using hydraulis::operator<<;
+
+namespace {
+
+constexpr uint64_t SHM_REGION_MAGIC = 0x4854534d52474e31ULL; // "HTSMRGN1"
+constexpr int SPINS_BEFORE_YIELD = 1 << 10;
+constexpr size_t REDUCE_TILE_SIZE = 256;
+
+struct alignas(HT_SHM_CACHE_LINE_SIZE) SHMRegionHeader {
+  std::atomic<uint64_t> magic;
+  int32_t size;
+  uint64_t slot_bytes;
+  uint64_t p2p_chunk_bytes;
+  uint64_t p2p_num_chunks;
+};
+
+inline size_t align_up(size_t x, size_t alignment) {
+  return (x + alignment - 1) / alignment * alignment;
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+template <typename Pred>
+inline void spin_until(Pred&& pred,
+                       const std::atomic<bool>* abort = nullptr) {
+  int spins = 0;
+  while (!pred()) {
+    if (++spins < SPINS_BEFORE_YIELD) {
+      cpu_relax();
+    } else {
+      HT_RUNTIME_ERROR_IF(abort != nullptr && abort->load(std::memory_order_relaxed))
+        << "Aborted waiting for peers in shared memory transport.";
+      std::this_thread::yield();
+    }
+  }
+}
+
+inline size_t get_env_size(const char* name, size_t default_value) {
+  char* env = std::getenv(name);
+  if (env == nullptr)
+    return default_value;
+  auto value = std::stoll(env);
+  HT_VALUE_ERROR_IF(value <= 0) << name << " must be positive, got " << env;
+  return static_cast<size_t>(value);
+}
+
+template <typename spec_t>
+struct SHMAccType {
+  using type = spec_t;
+};
+
+template <>
+struct SHMAccType<float16> {
+  using type = float;
+};
+
+template <>
+struct SHMAccType<bfloat16> {
+  using type = float;
+};
+
+// Reduce `num_srcs` buffers into `dst` tile by tile. Sources are always
+// visited in rank order, so every rank derives bitwise-identical results.
+template <typename spec_t, typename Op>
+void reduce_buffers(const char* const* srcs, int num_srcs, size_t offset,
+                    char* dst, size_t numel, bool mean, Op op) {
+  using acc_t = typename SHMAccType<spec_t>::type;
+  acc_t acc[REDUCE_TILE_SIZE];
+  auto* out = reinterpret_cast<spec_t*>(dst);
+  for (size_t begin = 0; begin < numel; begin += REDUCE_TILE_SIZE) {
+    size_t len = std::min(REDUCE_TILE_SIZE, numel - begin);
+    const auto* in0 =
+      reinterpret_cast<const spec_t*>(srcs[0]) + offset + begin;
+    for (size_t i = 0; i < len; i++)
+      acc[i] = static_cast<acc_t>(in0[i]);
+    for (int q = 1; q < num_srcs; q++) {
+      const auto* in =
+        reinterpret_cast<const spec_t*>(srcs[q]) + offset + begin;
+      for (size_t i = 0; i < len; i++)
+        acc[i] = op(acc[i], static_cast<acc_t>(in[i]));
+    }
+    if (mean) {
+      for (size_t i = 0; i < len; i++)
+        acc[i] = acc[i] / static_cast<acc_t>(num_srcs);
+    }
+    for (size_t i = 0; i < len; i++)
+      out[begin + i] = static_cast<spec_t>(acc[i]);
+  }
+}
+
+void reduce_buffers(const char* const* srcs, int num_srcs, size_t offset,
+                    char* dst, size_t numel, DataType dtype,
+                    ReductionType red_type) {
+  HT_DISPATCH_INTEGER_AND_FLOATING_TYPES(
+    dtype, spec_t, "SHMReduce", [&]() {
+      using acc_t = typename SHMAccType<spec_t>::type;
+      switch (red_type) {
+        case kSUM:
+        case kMEAN:
+          reduce_buffers<spec_t>(
+            srcs, num_srcs, offset, dst, numel, red_type == kMEAN,
+            [](acc_t x, acc_t y) { return x + y; });
+          break;
+        case kPROD:
+          reduce_buffers<spec_t>(srcs, num_srcs, offset, dst, numel, false,
+                                 [](acc_t x, acc_t y) { return x * y; });
+          break;
+        case kMAX:
+          reduce_buffers<spec_t>(
+            srcs, num_srcs, offset, dst, numel, false,
+            [](acc_t x, acc_t y) { return x < y ? y : x; });
+          break;
+        case kMIN:
+          reduce_buffers<spec_t>(
+            srcs, num_srcs, offset, dst, numel, false,
+            [](acc_t x, acc_t y) { return y < x ? y : x; });
+          break;
+        default:
+          HT_NOT_IMPLEMENTED << "Reduction type " << red_type
+                             << " is not supported for SHM.";
+      }
+    });
+}
+
+inline size_t to_num_bytes(const NDArray& data) {
+  if (data->dtype() == kFloat4 || data->dtype() == kNFloat4)
+    return (data->numel() + 1) / 2;
+  return data->numel() * DataType2Size(data->dtype());
+}
+
+} // namespace
+
+/******************************************************
+ * SHMTransport
+ ******************************************************/
+
+SHMTransportConfig SHMTransportConfig::FromEnv() {
+  SHMTransportConfig config;
+  config.slot_bytes = align_up(
+    get_env_size("HYDRAULIS_SHM_SLOT_SIZE_KB", config.slot_bytes >> 10) << 10,
+    HT_SHM_CACHE_LINE_SIZE);
+  config.p2p_chunk_bytes = align_up(
+    get_env_size("HYDRAULIS_SHM_P2P_CHUNK_SIZE_KB", config.p2p_chunk_bytes >> 10)
+      << 10,
+    HT_SHM_CACHE_LINE_SIZE);
+  config.p2p_num_chunks =
+    get_env_size("HYDRAULIS_SHM_P2P_NUM_CHUNKS", config.p2p_num_chunks);
+  return config;
+}
+
+size_t SHMTransport::RequiredBytes(int size,
+                                   const SHMTransportConfig& config) {
+  size_t n = static_cast<size_t>(size);
+  return sizeof(SHMRegionHeader) + n * sizeof(SHMFlag) +
+    2 * n * config.slot_bytes + n * n * sizeof(Channel) +
+    n * n * config.p2p_num_chunks * config.p2p_chunk_bytes;
+}
+
+void SHMTransport::InitializeRegion(void* base, int size,
+                                    const SHMTransportConfig& config) {
+  auto* header = reinterpret_cast<SHMRegionHeader*>(base);
+  header->size = size;
+  header->slot_bytes = config.slot_bytes;
+  header->p2p_chunk_bytes = config.p2p_chunk_bytes;
+  header->p2p_num_chunks = config.p2p_num_chunks;
+  auto* flags = reinterpret_cast<SHMFlag*>(header + 1);
+  for (int i = 0; i < size; i++)
+    new (&flags[i].value) std::atomic<uint64_t>(0);
+  auto* channels = reinterpret_cast<Channel*>(
+    reinterpret_cast<char*>(flags + size) + 2 * size * config.slot_bytes);
+  for (int i = 0; i < size * size; i++) {
+    new (&channels[i].head.value) std::atomic<uint64_t>(0);
+    new (&channels[i].tail.value) std::atomic<uint64_t>(0);
+  }
+  header->magic.store(SHM_REGION_MAGIC, std::memory_order_release);
+}
+
+SHMTransport::SHMTransport(void* base, int rank, int size,
+                           const SHMTransportConfig& config)
+: _config(config), _rank(rank), _size(size) {
+  HT_ASSERT(rank >= 0 && rank < size)
+    << "Invalid rank " << rank << " for size " << size << ".";
+  HT_ASSERT(config.slot_bytes % HT_SHM_CACHE_LINE_SIZE == 0 &&
+            config.p2p_chunk_bytes % HT_SHM_CACHE_LINE_SIZE == 0)
+    << "Shared memory slots must be aligned with cache lines.";
+  auto* header = reinterpret_cast<SHMRegionHeader*>(base);
+  spin_until([header]() {
+    return header->magic.load(std::memory_order_acquire) == SHM_REGION_MAGIC;
+  });
+  HT_ASSERT(header->size == size &&
+            header->slot_bytes == config.slot_bytes &&
+            header->p2p_chunk_bytes == config.p2p_chunk_bytes &&
+            header->p2p_num_chunks == config.p2p_num_chunks)
+    << "Shared memory region was initialized with a different config.";
+  _barrier_flags = reinterpret_cast<SHMFlag*>(header + 1);
+  _slots = reinterpret_cast<char*>(_barrier_flags + size);
+  _channels = reinterpret_cast<Channel*>(_slots + 2 * size * config.slot_bytes);
+  _rings = reinterpret_cast<char*>(_channels + size * size);
+}
+
+size_t SHMTransport::slice_numel(size_t numel, size_t item_size) const {
+  size_t items_per_line = std::max<size_t>(1, HT_SHM_CACHE_LINE_SIZE / item_size);
+  size_t per_rank = (numel + _size - 1) / _size;
+  return align_up(per_rank, items_per_line);
+}
+
+void SHMTransport::Barrier() {
+  uint64_t round = ++_round;
+  _barrier_flags[_rank].value.store(round, std::memory_order_release);
+  for (int q = 0; q < _size; q++) {
+    if (q == _rank)
+      continue;
+    auto& flag = _barrier_flags[q].value;
+    spin_until([&flag, round]() {
+      return flag.load(std::memory_order_acquire) >= round;
+    }, _abort_flag);
+  }
+}
+
+void SHMTransport::AllReduce(const void* send_buf, void* recv_buf,
+                             size_t numel, DataType dtype,
+                             ReductionType red_type) {
+  size_t item_size = DataType2Size(dtype);
+  size_t chunk_numel = _config.slot_bytes / item_size;
+  const char* src = static_cast<const char*>(send_buf);
+  char* dst = static_cast<char*>(recv_buf);
+  std::vector<const char*> srcs(_size);
+  for (size_t off = 0; off < numel; off += chunk_numel) {
+    size_t len = std::min(chunk_numel, numel - off);
+    size_t per_rank = slice_numel(len, item_size);
+    // round 1: stage the chunk and reduce the slice owned by this rank
+    int set = current_set();
+    std::memcpy(slot(set, _rank), src + off * item_size, len * item_size);
+    Barrier();
+    for (int q = 0; q < _size; q++)
+      srcs[q] = slot(set, q);
+    size_t begin = std::min(len, per_rank * _rank);
+    size_t end = std::min(len, begin + per_rank);
+    int next_set = current_set();
+    if (end > begin)
+      reduce_buffers(srcs.data(), _size, begin,
+                     slot(next_set, _rank) + begin * item_size, end - begin,
+                     dtype, red_type);
+    // round 2: gather the reduced slices of all ranks
+    Barrier();
+    for (int q = 0; q < _size; q++) {
+      size_t q_begin = std::min(len, per_rank * q);
+      size_t q_end = std::min(len, q_begin + per_rank);
+      if (q_end > q_begin)
+        std::memcpy(dst + (off + q_begin) * item_size,
+                    slot(next_set, q) + q_begin * item_size,
+                    (q_end - q_begin) * item_size);
+    }
+  }
+}
+
+void SHMTransport::AllGather(const void* send_buf, void* recv_buf,
+                             size_t bytes_per_rank) {
+  const char* src = static_cast<const char*>(send_buf);
+  char* dst = static_cast<char*>(recv_buf);
+  for (size_t off = 0; off < bytes_per_rank; off += _config.slot_bytes) {
+    size_t len = std::min(_config.slot_bytes, bytes_per_rank - off);
+    int set = current_set();
+    std::memcpy(slot(set, _rank), src + off, len);
+    Barrier();
+    for (int q = 0; q < _size; q++)
+      std::memcpy(dst + q * bytes_per_rank + off, slot(set, q), len);
+  }
+}
+
+void SHMTransport::ReduceScatter(const void* send_buf, void* recv_buf,
+                                 size_t numel_per_rank, DataType dtype,
+                                 ReductionType red_type) {
+  size_t item_size = DataType2Size(dtype);
+  size_t items_per_line = std::max<size_t>(1, HT_SHM_CACHE_LINE_SIZE / item_size);
+  size_t chunk_numel = _config.slot_bytes / _size / item_size;
+  chunk_numel = std::max(items_per_line, chunk_numel / items_per_line * items_per_line);
+  HT_ASSERT(chunk_numel * _size * item_size <= _config.slot_bytes)
+    << "Shared memory slot of " << _config.slot_bytes
+    << " bytes is too small for ReduceScatter over " << _size << " ranks.";
+  const char* src = static_cast<const char*>(send_buf);
+  char* dst = static_cast<char*>(recv_buf);
+  std::vector<const char*> srcs(_size);
+  for (size_t off = 0; off < numel_per_rank; off += chunk_numel) {
+    size_t len = std::min(chunk_numel, numel_per_rank - off);
+    int set = current_set();
+    // stage the chunk destined to every rank, one cache-aligned slice each
+    for (int q = 0; q < _size; q++)
+      std::memcpy(slot(set, _rank) + q * chunk_numel * item_size,
+                  src + (q * numel_per_rank + off) * item_size,
+                  len * item_size);
+    Barrier();
+    for (int q = 0; q < _size; q++)
+      srcs[q] = slot(set, q);
+    reduce_buffers(srcs.data(), _size, _rank * chunk_numel,
+                   dst + off * item_size, len, dtype, red_type);
+  }
+}
+
+void SHMTransport::Broadcast(void* buf, size_t bytes, int root) {
+  char* data = static_cast<char*>(buf);
+  for (size_t off = 0; off < bytes; off += _config.slot_bytes) {
+    size_t len = std::min(_config.slot_bytes, bytes - off);
+    int set = current_set();
+    if (_rank == root)
+      std::memcpy(slot(set, root), data + off, len);
+    Barrier();
+    if (_rank != root)
+      std::memcpy(data + off, slot(set, root), len);
+  }
+}
+
+bool SHMTransport::TrySend(const void* buf, size_t bytes, int receiver,
+                           size_t& offset) {
+  auto& ch = channel(_rank, receiver);
+  char* chunks = ring(_rank, receiver);
+  const char* src = static_cast<const char*>(buf);
+  while (offset < bytes) {
+    uint64_t tail = ch.tail.value.load(std::memory_order_relaxed);
+    uint64_t head = ch.head.value.load(std::memory_order_acquire);
+    if (tail - head >= _config.p2p_num_chunks)
+      return false;
+    size_t len = std::min(_config.p2p_chunk_bytes, bytes - offset);
+    std::memcpy(chunks + (tail % _config.p2p_num_chunks) * _config.p2p_chunk_bytes,
+                src + offset, len);
+    ch.tail.value.store(tail + 1, std::memory_order_release);
+    offset += len;
+  }
+  return true;
+}
+
+bool SHMTransport::TryRecv(void* buf, size_t bytes, int sender,
+                           size_t& offset) {
+  auto& ch = channel(sender, _rank);
+  const char* chunks = ring(sender, _rank);
+  char* dst = static_cast<char*>(buf);
+  while (offset < bytes) {
+    uint64_t head = ch.head.value.load(std::memory_order_relaxed);
+    uint64_t tail = ch.tail.value.load(std::memory_order_acquire);
+    if (tail == head)
+      return false;
+    size_t len = std::min(_config.p2p_chunk_bytes, bytes - offset);
+    std::memcpy(dst + offset,
+                chunks + (head % _config.p2p_num_chunks) * _config.p2p_chunk_bytes,
+                len);
+    ch.head.value.store(head + 1, std::memory_order_release);
+    offset += len;
+  }
+  return true;
+}
+
+void SHMTransport::Send(const void* buf, size_t bytes, int receiver) {
+  size_t offset = 0;
+  spin_until([&]() { return TrySend(buf, bytes, receiver, offset); },
+             _abort_flag);
+}
+
+void SHMTransport::Recv(void* buf, size_t bytes, int sender) {
+  size_t offset = 0;
+  spin_until([&]() { return TryRecv(buf, bytes, sender, offset); },
+             _abort_flag);
+}
+
+/******************************************************
+ * SHMCommunicationGroup
+ ******************************************************/
+
+namespace {
+
+static std::mutex shm_create_group_mutex;
+static std::atomic<uint64_t> shm_segment_counter{0};
+static std::vector<std::map<std::vector<int>, SHMCommunicationGroup>>
+  shm_comm_groups((HT_NUM_STREAMS_PER_DEVICE) + 1);
+
+std::string GetSHMSegmentKey(const std::vector<int>& world_ranks,
+                             StreamIndex stream_id) {
+  std::string key = "SHM_SEGMENT";
+  for (auto rank : world_ranks)
+    key += "_" + std::to_string(rank);
+  return key + "@" + std::to_string(stream_id);
+}
+
+} // namespace
+
+SHMCommunicationGroupDef::SHMCommunicationGroupDef(
+  const std::vector<int>& world_ranks, const Stream& stream)
+: CommunicationGroupDef(world_ranks, stream) {
+  HT_ASSERT(_stream.device().is_cpu())
+    << "SHM communication group must be initialized with "
+    << "a stream related with CPU. Got " << _stream << ".";
+  HT_ASSERT(IsIntraNodeGroup(_world_ranks))
+    << "SHM communication group requires all ranks " << _world_ranks
+    << " to be on the local host.";
+  _rank = GetGroupRank(_world_ranks);
+  _size = _world_ranks.size();
+  HT_ASSERT(_rank >= 0 && _rank < _size)
+    << "The current rank " << GetWorldRank() << " is not included in the group "
+    << _world_ranks << ".";
+
+  auto config = SHMTransportConfig::FromEnv();
+  _segment_bytes = SHMTransport::RequiredBytes(_size, config);
+  auto key = GetSHMSegmentKey(_world_ranks, _stream.stream_index());
+  int fd = -1;
+  if (_rank == 0) {
+    _segment_name = "/hydraulis_shm_" + std::to_string(getpid()) + "_" +
+      std::to_string(shm_segment_counter++);
+    fd = shm_open(_segment_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    HT_RUNTIME_ERROR_IF(fd < 0)
+      << "Failed to create shared memory segment " << _segment_name << ": "
+      << std::strerror(errno);
+    HT_RUNTIME_ERROR_IF(ftruncate(fd, _segment_bytes) != 0)
+      << "Failed to resize shared memory segment " << _segment_name
+      << " to " << _segment_bytes << " bytes: " << std::strerror(errno);
+  } else {
+    _segment_name = GetLocalClient()->GetString(key);
+    fd = shm_open(_segment_name.c_str(), O_RDWR, 0600);
+    HT_RUNTIME_ERROR_IF(fd < 0)
+      << "Failed to open shared memory segment " << _segment_name << ": "
+      << std::strerror(errno);
+  }
+  _segment = mmap(nullptr, _segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+  close(fd);
+  HT_RUNTIME_ERROR_IF(_segment == MAP_FAILED)
+    << "Failed to map shared memory segment " << _segment_name << ": "
+    << std::strerror(errno);
+  if (_rank == 0) {
+    SHMTransport::InitializeRegion(_segment, _size, config);
+    GetLocalClient()->PutString(key, _segment_name);
+  }
+  _transport.reset(new SHMTransport(_segment, _rank, _size, config));
+  // Once everyone has mapped the segment, the name is no longer needed.
+  // Unlinking it right away ensures nothing leaks even if we crash later.
+  RPCBarrier(_world_ranks);
+  if (_rank == 0) {
+    shm_unlink(_segment_name.c_str());
+    GetLocalClient()->RemoveString(key);
+  }
+
+  HT_LOG_DEBUG << "Initialized SHM comm group for " << _world_ranks
+               << " with stream " << _stream << " and segment "
+               << _segment_name << " (" << _segment_bytes << " bytes).";
+}
+
+SHMCommunicationGroupDef::SHMCommunicationGroupDef(
+  const std::vector<int>& world_ranks, const Stream& stream, void* region,
+  const SHMTransportConfig& config)
+: CommunicationGroupDef(world_ranks, stream) {
+  HT_ASSERT(_stream.device().is_cpu())
+    << "SHM communication group must be initialized with "
+    << "a stream related with CPU. Got " << _stream << ".";
+  _rank = GetGroupRank(_world_ranks);
+  _size = _world_ranks.size();
+  HT_ASSERT(_rank >= 0 && _rank < _size)
+    << "The current rank " << GetWorldRank() << " is not included in the group "
+    << _world_ranks << ".";
+  _transport.reset(new SHMTransport(region, _rank, _size, config));
+}
+
+SHMCommunicationGroupDef::~SHMCommunicationGroupDef() {
+  Sync();
+  _transport.reset();
+  if (_segment != nullptr && _segment != MAP_FAILED)
+    munmap(_segment, _segment_bytes);
+}
+
+void SHMCommunicationGroupDef::Broadcast(NDArray& data, int broadcaster) {
+  HT_ASSERT_CPU_DEVICE(data);
+  void* buf = data->raw_data_ptr();
+  size_t bytes = to_num_bytes(data);
+  int root = world_to_group_rank(broadcaster);
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [buf, bytes, root, this]() { _transport->Broadcast(buf, bytes, root); },
+    "SHM_Broadcast(broadcaster=" + std::to_string(broadcaster) + ")");
+  NDArray::MarkUsedBy(data, _stream);
+}
+
+void SHMCommunicationGroupDef::AllReduce(const NDArray& input, NDArray& output,
+                                         ReductionType red_type) {
+  HT_ASSERT_CPU_DEVICE(input);
+  HT_ASSERT_CPU_DEVICE(output);
+  HT_ASSERT_EXCHANGABLE(input, output);
+  const void* send_buf = input->raw_data_ptr();
+  void* recv_buf = output->raw_data_ptr();
+  auto numel = input->numel();
+  auto dtype = input->dtype();
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [send_buf, recv_buf, numel, dtype, red_type, this]() {
+      _transport->AllReduce(send_buf, recv_buf, numel, dtype, red_type);
+    },
+    "SHM_AllReduce(reduction=" + ReductionType2Str(red_type) + ")");
+  NDArray::MarkUsedBy({input, output}, _stream);
+}
+
+void SHMCommunicationGroupDef::AllReduceCoalesce(const NDArrayList& inputs,
+                                                 NDArrayList& outputs,
+                                                 NDArray contiguous_buffers,
+                                                 ReductionType red_type) {
+  size_t numel = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    HT_ASSERT_CPU_DEVICE(inputs[i]);
+    HT_ASSERT_CPU_DEVICE(outputs[i]);
+    HT_ASSERT_EXCHANGABLE(inputs[i], outputs[i]);
+    HT_ASSERT_SAME_DTYPE(inputs[0], inputs[i]);
+    numel += inputs[i]->numel();
+  }
+  if (numel == 0)
+    return;
+  auto dtype = inputs[0]->dtype();
+  HT_ASSERT(contiguous_buffers->numel() == 0 ||
+            (contiguous_buffers->numel() >= numel &&
+             contiguous_buffers->dtype() == dtype))
+    << "Invalid contiguous buffer for AllReduceCoalesce: "
+    << contiguous_buffers->meta();
+  void* buffer_ptr = contiguous_buffers->numel() > 0
+    ? contiguous_buffers->raw_data_ptr() : nullptr;
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [inputs, outputs, buffer_ptr, numel, dtype, red_type, this]() {
+      if (buffer_ptr == nullptr) {
+        for (size_t i = 0; i < inputs.size(); i++)
+          _transport->AllReduce(inputs[i]->raw_data_ptr(),
+                                outputs[i]->raw_data_ptr(), inputs[i]->numel(),
+                                dtype, red_type);
+        return;
+      }
+      size_t item_size = DataType2Size(dtype);
+      char* buffer = static_cast<char*>(buffer_ptr);
+      size_t offset = 0;
+      for (auto& input : inputs) {
+        std::memcpy(buffer + offset, input->raw_data_ptr(),
+                    input->numel() * item_size);
+        offset += input->numel() * item_size;
+      }
+      _transport->AllReduce(buffer, buffer, numel, dtype, red_type);
+      offset = 0;
+      for (auto& output : outputs) {
+        std::memcpy(output->raw_data_ptr(), buffer + offset,
+                    output->numel() * item_size);
+        offset += output->numel() * item_size;
+      }
+    },
+    "SHM_AllReduceCoalesce(reduction=" + ReductionType2Str(red_type) + ")");
+  NDArray::MarkUsedBy(inputs, _stream);
+  NDArray::MarkUsedBy(outputs, _stream);
+}
+
+void SHMCommunicationGroupDef::AllGather(const NDArray& input, NDArray& output,
+                                         int32_t gather_dim) {
+  HT_ASSERT_CPU_DEVICE(input);
+  HT_ASSERT_CPU_DEVICE(output);
+  HT_ASSERT_SAME_DTYPE(input, output);
+  HT_ASSERT(input->shape(gather_dim) * _size == output->shape(gather_dim) &&
+            input->numel() * _size == output->numel())
+    << "Invalid shapes for AllGather: "
+    << "(send) " << input->shape() << " vs. "
+    << "(recv) " << output->shape() << ".";
+  const void* send_buf = input->raw_data_ptr();
+  void* recv_buf = output->raw_data_ptr();
+  size_t bytes = to_num_bytes(input);
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [send_buf, recv_buf, bytes, this]() {
+      _transport->AllGather(send_buf, recv_buf, bytes);
+    },
+    "SHM_AllGather");
+  NDArray::MarkUsedBy({input, output}, _stream);
+}
+
+void SHMCommunicationGroupDef::ReduceScatter(const NDArray& input,
+                                             NDArray& output,
+                                             int32_t scatter_dim,
+                                             ReductionType red_type) {
+  HT_ASSERT_CPU_DEVICE(input);
+  HT_ASSERT_CPU_DEVICE(output);
+  HT_ASSERT_SAME_DTYPE(input, output);
+  HT_ASSERT(input->shape(scatter_dim) == output->shape(scatter_dim) * _size &&
+            input->numel() == output->numel() * _size)
+    << "Invalid shapes for ReduceScatter: "
+    << "(send) " << input->shape() << " vs. "
+    << "(recv) " << output->shape() << ".";
+  const void* send_buf = input->raw_data_ptr();
+  void* recv_buf = output->raw_data_ptr();
+  auto numel = output->numel();
+  auto dtype = output->dtype();
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [send_buf, recv_buf, numel, dtype, red_type, this]() {
+      _transport->ReduceScatter(send_buf, recv_buf, numel, dtype, red_type);
+    },
+    "SHM_ReduceScatter(reduction=" + ReductionType2Str(red_type) + ")");
+  NDArray::MarkUsedBy({input, output}, _stream);
+}
+
+// Only the reducer needs the result, but reducing through the shared slots
+// costs the same as an all-reduce, so other ranks reduce into a scratch buffer.
+void SHMCommunicationGroupDef::Reduce(const NDArray& input, NDArray& output,
+                                      int reducer, ReductionType red_type) {
+  HT_ASSERT_CPU_DEVICE(input);
+  int root = world_to_group_rank(reducer);
+  const void* send_buf = input->raw_data_ptr();
+  void* recv_buf = nullptr;
+  std::shared_ptr<std::vector<char>> scratch;
+  if (_rank == root) {
+    HT_ASSERT_CPU_DEVICE(output);
+    HT_ASSERT_EXCHANGABLE(input, output);
+    recv_buf = output->raw_data_ptr();
+  } else {
+    scratch = std::make_shared<std::vector<char>>(to_num_bytes(input));
+    recv_buf = scratch->data();
+  }
+  auto numel = input->numel();
+  auto dtype = input->dtype();
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [send_buf, recv_buf, scratch, numel, dtype, red_type, this]() {
+      _transport->AllReduce(send_buf, recv_buf, numel, dtype, red_type);
+    },
+    "SHM_Reduce(reduction=" + ReductionType2Str(red_type) + ")");
+  NDArray::MarkUsedBy({input, output}, _stream);
+}
+
+// Gather and scatter go through the p2p rings between the root and each rank.
+void SHMCommunicationGroupDef::Gather(const NDArray& input, NDArray& output,
+                                      int gatherer) {
+  HT_ASSERT_CPU_DEVICE(input);
+  int root = world_to_group_rank(gatherer);
+  bool is_gatherer = root == _rank;
+  size_t bytes = to_num_bytes(input);
+  if (is_gatherer) {
+    HT_ASSERT_CPU_DEVICE(output);
+    HT_ASSERT_SAME_DTYPE(input, output);
+    HT_ASSERT(input->shape(0) * _size == output->shape(0) &&
+              input->numel() * _size == output->numel())
+      << "Invalid shapes for Gather: "
+      << "(send) " << input->shape() << " vs. "
+      << "(recv) " << output->shape() << ".";
+  }
+  const void* send_buf = input->raw_data_ptr();
+  char* recv_buf = is_gatherer ? static_cast<char*>(output->raw_data_ptr()) : nullptr;
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [send_buf, recv_buf, bytes, root, is_gatherer, this]() {
+      if (bytes == 0)
+        return;
+      if (!is_gatherer) {
+        _transport->Send(send_buf, bytes, root);
+        return;
+      }
+      for (int rank = 0; rank < _size; rank++) {
+        if (rank == _rank)
+          std::memcpy(recv_buf + rank * bytes, send_buf, bytes);
+        else
+          _transport->Recv(recv_buf + rank * bytes, bytes, rank);
+      }
+    },
+    "SHM_Gather(gatherer=" + std::to_string(gatherer) + ")");
+  NDArray::MarkUsedBy({input, output}, _stream);
+}
+
+void SHMCommunicationGroupDef::Scatter(const NDArray& input, NDArray& output,
+                                       int scatterer) {
+  HT_ASSERT_CPU_DEVICE(output);
+  int root = world_to_group_rank(scatterer);
+  bool is_scatterer = root == _rank;
+  size_t bytes = to_num_bytes(output);
+  if (is_scatterer) {
+    HT_ASSERT_CPU_DEVICE(input);
+    HT_ASSERT_SAME_DTYPE(input, output);
+    HT_ASSERT(input->shape(0) == output->shape(0) * _size &&
+              input->numel() == output->numel() * _size)
+      << "Invalid shapes for Scatter: "
+      << "(send) " << input->shape() << " vs. "
+      << "(recv) " << output->shape() << ".";
+  }
+  const char* send_buf = is_scatterer ? static_cast<const char*>(input->raw_data_ptr()) : nullptr;
+  void* recv_buf = output->raw_data_ptr();
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [send_buf, recv_buf, bytes, root, is_scatterer, this]() {
+      if (bytes == 0)
+        return;
+      if (!is_scatterer) {
+        _transport->Recv(recv_buf, bytes, root);
+        return;
+      }
+      for (int rank = 0; rank < _size; rank++) {
+        if (rank == _rank)
+          std::memcpy(recv_buf, send_buf + rank * bytes, bytes);
+        else
+          _transport->Send(send_buf + rank * bytes, bytes, rank);
+      }
+    },
+    "SHM_Scatter(scatterer=" + std::to_string(scatterer) + ")");
+  NDArray::MarkUsedBy({input, output}, _stream);
+}
+
+void SHMCommunicationGroupDef::Send(const NDArray& data, int receiver) {
+  int dst = world_to_group_rank(receiver);
+  HT_ASSERT(dst != _rank) << "Cannot send to self.";
+  size_t bytes = to_num_bytes(data);
+  if (bytes == 0)
+    return;
+  const void* send_buf = data->raw_data_ptr();
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [send_buf, bytes, dst, this]() { _transport->Send(send_buf, bytes, dst); },
+    "SHM_Send(receiver=" + std::to_string(receiver) + ")");
+  NDArray::MarkUsedBy(data, _stream);
+}
+
+void SHMCommunicationGroupDef::Recv(NDArray& data, int sender) {
+  int src = world_to_group_rank(sender);
+  HT_ASSERT(src != _rank) << "Cannot receive from self.";
+  size_t bytes = to_num_bytes(data);
+  if (bytes == 0)
+    return;
+  void* recv_buf = data->raw_data_ptr();
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [recv_buf, bytes, src, this]() { _transport->Recv(recv_buf, bytes, src); },
+    "SHM_Recv(sender=" + std::to_string(sender) + ")");
+  NDArray::MarkUsedBy(data, _stream);
+}
+
+// The sender copies straight from the NDArray into the ring of the receiver,
+// and the receiver copies straight out of it, without any packing.
+// The progress functions never block, so that batched sends and receives
+// can be interleaved without deadlocks even when the rings are full.
+CommTask SHMCommunicationGroupDef::ISend(const NDArray& data, int receiver) {
+  int dst = world_to_group_rank(receiver);
+  HT_ASSERT(dst != _rank) << "Cannot send to self.";
+  size_t bytes = to_num_bytes(data);
+  if (bytes == 0)
+    return CommTask();
+  const void* send_buf = data->raw_data_ptr();
+  auto offset = std::make_shared<size_t>(0);
+  auto progress = [send_buf, bytes, dst, offset, this]() {
+    return _transport->TrySend(send_buf, bytes, dst, *offset);
+  };
+  return CommTask(
+    [send_buf, bytes, dst, this]() { _transport->Send(send_buf, bytes, dst); },
+    {data}, progress);
+}
+
+CommTask SHMCommunicationGroupDef::IRecv(NDArray& data, int sender) {
+  int src = world_to_group_rank(sender);
+  HT_ASSERT(src != _rank) << "Cannot receive from self.";
+  size_t bytes = to_num_bytes(data);
+  if (bytes == 0)
+    return CommTask();
+  void* recv_buf = data->raw_data_ptr();
+  auto offset = std::make_shared<size_t>(0);
+  auto progress = [recv_buf, bytes, src, offset, this]() {
+    return _transport->TryRecv(recv_buf, bytes, src, *offset);
+  };
+  return CommTask(
+    [recv_buf, bytes, src, this]() { _transport->Recv(recv_buf, bytes, src); },
+    {data}, progress);
+}
+
+void SHMCommunicationGroupDef::BatchedISendIRecv(
+  const std::vector<CommTask>& tasks) {
+  auto* abort_flag = _transport->abort_flag();
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [tasks, abort_flag]() {
+      std::vector<const CommTask*> pending;
+      pending.reserve(tasks.size());
+      for (auto& task : tasks) {
+        if (task.progress)
+          pending.push_back(&task);
+        else if (task.fn)
+          task.fn();
+      }
+      spin_until([&pending]() {
+        pending.erase(
+          std::remove_if(pending.begin(), pending.end(),
+                         [](const CommTask* task) { return task->progress(); }),
+          pending.end());
+        return pending.empty();
+      }, abort_flag);
+    },
+    "SHM_BatchedISendIRecv");
+  for (auto& task : tasks) {
+    NDArray::MarkUsedBy(task.data, _stream);
+  }
+}
+
+void SHMCommunicationGroupDef::Barrier(bool sync) {
+  _latest_future = CPUStream(_stream).EnqueueTask(
+    [this]() { _transport->Barrier(); }, "SHM Barrier Wait");
+  if (sync)
+    Sync();
+}
+
+void SHMCommunicationGroupDef::Sync() {
+  // Surface the error of an aborted wait to the caller
+  if (_latest_future.valid())
+    _latest_future.get();
+}
+
+SHMCommunicationGroup&
+SHMCommunicationGroup::GetOrCreate(const std::vector<int>& world_ranks,
+                                   const Stream& stream) {
+  HT_ASSERT(stream.device().is_cpu())
+    << "The argument \"stream\" for "
+    << "SHMCommunicationGroup::GetOrCreate "
+    << "must be a CPU stream. Got " << stream << ".";
+  // Note: stream id could be -1, we shall shift it by one when accessing
+  int stream_id = static_cast<int>(stream.stream_index());
+
+  std::vector<int> ranks = world_ranks;
+  if (ranks.empty())
+    ranks = GetWorldRanks();
+  HT_ASSERT(CommunicationGroupDef::IsRanksValid(ranks))
+    << "Invalid world ranks: " << ranks;
+  HT_ASSERT(GetGroupRank(ranks) != -1)
+    << "Cannot get comm group " << ranks << " on rank " << GetWorldRank()
+    << ".";
+  auto it = shm_comm_groups[stream_id + 1].find(ranks);
+  if (it == shm_comm_groups[stream_id + 1].end()) {
+    std::unique_lock<std::mutex> lock(shm_create_group_mutex);
+    // double check for thread-safety
+    it = shm_comm_groups[stream_id + 1].find(ranks);
+    if (it == shm_comm_groups[stream_id + 1].end()) {
+      SHMCommunicationGroup comm_group(ranks, stream);
+      auto insertion = shm_comm_groups[stream_id + 1].insert(
+        {comm_group->world_ranks(), comm_group});
+      HT_ASSERT(insertion.second)
+        << "Failed to insert SHMCommunicationGroup for ranks "
+        << comm_group->world_ranks() << ".";
+      it = insertion.first;
+    }
+  }
+  return it->second;
+}
+
+bool IsIntraNodeGroup(const std::vector<int>& world_ranks) {
+  for (auto rank : world_ranks)
+    if (!WorldRankToDevice(rank).local())
+      return false;
+  return true;
+}
+
+CommunicationGroup GetOrCreateCPUCommGroup(const std::vector<int>& world_ranks,
+                                           const Stream& stream) {
+  static const std::string backend = []() {
+    char* env = std::getenv("HYDRAULIS_CPU_COMM_BACKEND");
+    std::string ret = env != nullptr ? env : "MPI";
+    HT_VALUE_ERROR_IF(ret != "MPI" && ret != "SHM" && ret != "AUTO")
+      << "HYDRAULIS_CPU_COMM_BACKEND should be MPI, SHM or AUTO, got " << ret;
+    return ret;
+  }();
+  if (ThreadedWorld::IsRunning())
+    return ThreadCommunicationGroup::GetOrCreate(world_ranks, stream);
+  if (backend == "SHM" ||
+      (backend == "AUTO" && world_ranks.size() > 1 &&
+       IsIntraNodeGroup(world_ranks)))
+    return SHMCommunicationGroup::GetOrCreate(world_ranks, stream);
+  return MPICommunicationGroup::GetOrCreate(world_ranks, stream);
+}
+
+std::vector<CPUCommBenchmarkResult> BenchmarkCPUCommBackends(size_t numel,
+                                                             int num_iters) {
+  HT_VALUE_ERROR_IF(numel == 0 || num_iters <= 0)
+    << "Invalid arguments for benchmarking CPU comm backends";
+  auto world_ranks = GetWorldRanks();
+  int size = static_cast<int>(world_ranks.size());
+  int rank = GetWorldRank();
+  HT_VALUE_ERROR_IF(size < 2 || !IsIntraNodeGroup(world_ranks))
+    << "Benchmarking CPU comm backends requires two or more ranks on one host";
+  Stream stream(Device(kCPU), kCollectiveStream);
+  std::vector<std::pair<std::string, CommunicationGroup>> groups = {
+    {"SHM", SHMCommunicationGroup::GetOrCreate(world_ranks, stream)},
+    {"MPI", MPICommunicationGroup::GetOrCreate(world_ranks, stream)}};
+
+  // Reduce-scatter needs the input to be a multiple of the world size.
+  size_t per_rank = (numel + size - 1) / size;
+  auto make_array = [](size_t n) {
+    return NDArray::empty({static_cast<int64_t>(n)}, Device(kCPU), kFloat32,
+                          kBlockingStream);
+  };
+  auto input = NDArray::randn({static_cast<int64_t>(per_rank * size)}, Device(kCPU),
+                              kFloat32, 0, 1, 1000 + rank, kBlockingStream);
+  auto p2p_input = NDArray::randn({static_cast<int64_t>(numel)}, Device(kCPU),
+                                  kFloat32, 0, 1, 2000 + rank, kBlockingStream);
+  int next = world_ranks[(rank + 1) % size];
+  int prev = world_ranks[(rank + size - 1) % size];
+
+  using Op = std::function<NDArray(CommunicationGroup&)>;
+  std::vector<std::pair<std::string, Op>> ops = {
+    {"AllReduce", [&](CommunicationGroup& group) {
+      auto output = make_array(per_rank * size);
+      group->AllReduce(input, output, kSUM);
+      return output;
+    }},
+    {"AllGather", [&](CommunicationGroup& group) {
+      auto output = make_array(per_rank * size * size);
+      group->AllGather(input, output);
+      return output;
+    }},
+    {"ReduceScatter", [&](CommunicationGroup& group) {
+      auto output = make_array(per_rank);
+      group->ReduceScatter(input, output, 0, kSUM);
+      return output;
+    }},
+    {"Broadcast", [&](CommunicationGroup& group) {
+      auto output = NDArray::copy(input, kBlockingStream);
+      group->Broadcast(output, world_ranks.front());
+      return output;
+    }},
+    {"BatchedISendIRecv", [&](CommunicationGroup& group) {
+      auto output = make_array(p2p_input->numel());
+      group->BatchedISendIRecv({group->ISend(p2p_input, next),
+                                group->IRecv(output, prev)});
+      return output;
+    }},
+  };
+
+  using Clock = std::chrono::steady_clock;
+  std::vector<CPUCommBenchmarkResult> results;
+  for (auto& [name, op] : ops) {
+    CPUCommBenchmarkResult result;
+    result.op = name;
+    NDArrayList outputs;
+    for (auto& [backend, group] : groups) {
+      // warm up, e.g., the first touch of the shared memory
+      op(group);
+      group->Sync();
+      group->Barrier(true);
+      auto start = Clock::now();
+      NDArray output;
+      for (int i = 0; i < num_iters; i++) {
+        output = op(group);
+        group->Sync();
+      }
+      double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / num_iters;
+      (backend == "SHM" ? result.shm_ms : result.mpi_ms) = ms;
+      outputs.push_back(output);
+    }
+    const float* x = outputs[0]->data_ptr<float>();
+    const float* y = outputs[1]->data_ptr<float>();
+    for (int64_t k = 0; k < outputs[0]->numel(); k++)
+      result.max_abs_diff = std::max(result.max_abs_diff, static_cast<double>(std::abs(x[k] - y[k])));
+    HT_LOG_DEBUG << "[CPU comm] " << name << ": SHM " << result.shm_ms
+                 << " ms vs. MPI " << result.mpi_ms << " ms";
+    results.push_back(std::move(result));
+  }
+  return results;
+}
+
+} // namespace comm
+} // namespace impl
+} // namespace hydraulis
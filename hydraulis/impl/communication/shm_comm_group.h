@@ -0,0 +1,270 @@
+#pragma once
+
+#include "hydraulis/impl/communication/comm_group.h"
+#include <atomic>
+#include <future>
+
+namespace hydraulis {
+namespace impl {
+namespace comm {
+
+class SHMCommunicationGroupDef;
+class SHMCommunicationGroup;
+
+constexpr size_t HT_SHM_CACHE_LINE_SIZE = 64;
+
+// A monotonic counter that occupies a whole cache line,
+// so that flags of different ranks never share a line.
+struct alignas(HT_SHM_CACHE_LINE_SIZE) SHMFlag {
+  std::atomic<uint64_t> value;
+  char padding[HT_SHM_CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "Shared memory flags require lock-free 64-bit atomics.");
+
+struct SHMTransportConfig {
+  // Staging bytes of each rank for collectives (there are two sets of them).
+  size_t slot_bytes{1 << 20};
+  // Chunk bytes and number of chunks of each directed p2p ring.
+  size_t p2p_chunk_bytes{1 << 18};
+  size_t p2p_num_chunks{4};
+
+  // HYDRAULIS_SHM_SLOT_SIZE_KB, HYDRAULIS_SHM_P2P_CHUNK_SIZE_KB
+  // and HYDRAULIS_SHM_P2P_NUM_CHUNKS override the defaults.
+  static SHMTransportConfig FromEnv();
+};
+
+/******************************************************
+ * Lock-free transport over a memory region that is mapped by every rank
+ * of a group. The region is either a POSIX shared memory segment
+ * (ranks are processes on the same host) or plain host memory
+ * (ranks are threads of the same process).
+ *
+ * Layout of the region:
+ *   | header | barrier flags (size) | slots (2 x size) | p2p rings (size x size) |
+ * Collectives proceed in rounds. In each round a rank only writes
+ * its own slot of the current set, arrives at the barrier,
+ * and then reads the slots of others. Two sets are used alternately,
+ * so a single barrier per round is sufficient.
+ ******************************************************/
+class SHMTransport {
+ public:
+  SHMTransport(void* base, int rank, int size,
+               const SHMTransportConfig& config);
+
+  static size_t RequiredBytes(int size, const SHMTransportConfig& config);
+
+  // Must be called by exactly one rank before any other rank attaches.
+  static void InitializeRegion(void* base, int size,
+                               const SHMTransportConfig& config);
+
+  void AllReduce(const void* send_buf, void* recv_buf, size_t numel,
+                 DataType dtype, ReductionType red_type);
+
+  void AllGather(const void* send_buf, void* recv_buf, size_t bytes_per_rank);
+
+  void ReduceScatter(const void* send_buf, void* recv_buf,
+                     size_t numel_per_rank, DataType dtype,
+                     ReductionType red_type);
+
+  void Broadcast(void* buf, size_t bytes, int root);
+
+  void Barrier();
+
+  // Non-blocking progress of a p2p transfer. `offset` records the number of
+  // bytes that have been transferred, and it returns true on completion.
+  bool TrySend(const void* buf, size_t bytes, int receiver, size_t& offset);
+
+  bool TryRecv(void* buf, size_t bytes, int sender, size_t& offset);
+
+  void Send(const void* buf, size_t bytes, int receiver);
+
+  void Recv(void* buf, size_t bytes, int sender);
+
+  // Blocking waits throw once `*flag` is set, e.g., when a peer has failed
+  // and will never arrive. Null (the default) waits forever.
+  void set_abort_flag(const std::atomic<bool>* flag) noexcept {
+    _abort_flag = flag;
+  }
+
+  const std::atomic<bool>* abort_flag() const noexcept {
+    return _abort_flag;
+  }
+
+  int rank() const noexcept {
+    return _rank;
+  }
+
+  int size() const noexcept {
+    return _size;
+  }
+
+ protected:
+  struct Channel {
+    SHMFlag head; // number of chunks consumed by the receiver
+    SHMFlag tail; // number of chunks produced by the sender
+  };
+
+  char* slot(int set, int rank) const {
+    return _slots + (static_cast<size_t>(set) * _size + rank) * _config.slot_bytes;
+  }
+
+  Channel& channel(int sender, int receiver) const {
+    return _channels[sender * _size + receiver];
+  }
+
+  char* ring(int sender, int receiver) const {
+    return _rings + static_cast<size_t>(sender * _size + receiver) *
+      _config.p2p_num_chunks * _config.p2p_chunk_bytes;
+  }
+
+  // The set to write in the upcoming round.
+  int current_set() const noexcept {
+    return static_cast<int>(_round & 1);
+  }
+
+  // Slices of a chunk reduced by each rank are aligned with cache lines.
+  size_t slice_numel(size_t numel, size_t item_size) const;
+
+  const SHMTransportConfig _config;
+  const int _rank;
+  const int _size;
+  uint64_t _round{0};
+  SHMFlag* _barrier_flags;
+  char* _slots;
+  Channel* _channels;
+  char* _rings;
+  const std::atomic<bool>* _abort_flag{nullptr};
+};
+
+class SHMCommunicationGroupDef : public CommunicationGroupDef {
+ protected:
+  friend class SHMCommunicationGroup;
+  struct constructor_access_key {};
+  SHMCommunicationGroupDef(const std::vector<int>& world_ranks,
+                           const Stream& stream);
+  // Attach to an initialized region whose lifetime is managed by the caller.
+  SHMCommunicationGroupDef(const std::vector<int>& world_ranks,
+                           const Stream& stream, void* region,
+                           const SHMTransportConfig& config);
+
+ public:
+  SHMCommunicationGroupDef(const constructor_access_key&,
+                           const std::vector<int>& world_ranks,
+                           const Stream& stream)
+  : SHMCommunicationGroupDef(world_ranks, stream) {}
+
+  SHMCommunicationGroupDef(const constructor_access_key&,
+                           const std::vector<int>& world_ranks)
+  : SHMCommunicationGroupDef(
+      world_ranks,
+      Stream(kCPU, world_ranks.size() != 2 ? kCollectiveStream : kP2PStream)) {}
+
+  ~SHMCommunicationGroupDef();
+
+  void Broadcast(NDArray& data, int broadcaster) override;
+
+  void AllReduce(const NDArray& input, NDArray& output,
+                 ReductionType red_type = kSUM) override;
+
+  void AllReduceCoalesce(const NDArrayList& inputs, NDArrayList& outputs,
+                         NDArray contiguous_buffers,
+                         ReductionType red_type = kSUM) override;
+
+  void AllGather(const NDArray& input, NDArray& output, int32_t gather_dim = 0) override;
+
+  void ReduceScatter(const NDArray& input, NDArray& output,
+                     int32_t scatter_dim = 0, ReductionType red_type = kSUM) override;
+
+  void Reduce(const NDArray& input, NDArray& output, int reducer,
+              ReductionType red_type = kSUM) override;
+
+  void Gather(const NDArray& input, NDArray& output, int gatherer) override;
+
+  void Scatter(const NDArray& input, NDArray& output, int scatterer) override;
+
+  void Send(const NDArray& data, int receiver) override;
+
+  void Recv(NDArray& data, int sender) override;
+
+  CommTask ISend(const NDArray& data, int receiver) override;
+
+  CommTask IRecv(NDArray& data, int sender) override;
+
+  void BatchedISendIRecv(const std::vector<CommTask>& tasks) override;
+
+  void Barrier(bool sync = false) override;
+
+  void Sync() override;
+
+  std::string backend() const override {
+    return "SHM";
+  }
+
+ protected:
+  std::string _segment_name;
+  void* _segment{nullptr};
+  size_t _segment_bytes{0};
+  std::unique_ptr<SHMTransport> _transport;
+  std::future<void> _latest_future;
+};
+
+class SHMCommunicationGroup final
+: public CommGroupWrapper<SHMCommunicationGroupDef> {
+ protected:
+  SHMCommunicationGroup(const std::vector<int>& world_ranks)
+  : CommGroupWrapper<SHMCommunicationGroupDef>(
+      make_ptr<SHMCommunicationGroupDef>(
+        SHMCommunicationGroupDef::constructor_access_key(), world_ranks)) {}
+
+  SHMCommunicationGroup(const std::vector<int>& world_ranks,
+                        const Stream& stream)
+  : CommGroupWrapper<SHMCommunicationGroupDef>(
+      make_ptr<SHMCommunicationGroupDef>(
+        SHMCommunicationGroupDef::constructor_access_key(), world_ranks,
+        stream)) {}
+
+ public:
+  SHMCommunicationGroup() = default;
+
+  static SHMCommunicationGroup& GetOrCreate(const std::vector<int>& world_ranks,
+                                            const Stream& stream);
+
+  static SHMCommunicationGroup& GetOrCreate(const std::vector<int>& world_ranks,
+                                            Device device = {kCPU}) {
+    return GetOrCreate(
+      world_ranks,
+      Stream(device, world_ranks.size() != 2 ? kCollectiveStream : kP2PStream));
+  }
+};
+
+// Whether all ranks reside on the local host so that they can share memory.
+bool IsIntraNodeGroup(const std::vector<int>& world_ranks);
+
+// Select the backend of CPU communication groups according to
+// HYDRAULIS_CPU_COMM_BACKEND, which could be "MPI" (default), "SHM",
+// or "AUTO" (SHM for intra-node groups and MPI otherwise).
+// Inside a threaded world, the THREAD backend is always used.
+CommunicationGroup GetOrCreateCPUCommGroup(const std::vector<int>& world_ranks,
+                                           const Stream& stream);
+
+struct CPUCommBenchmarkResult {
+  std::string op;
+  double shm_ms{0};
+  double mpi_ms{0};
+  // Outputs of the two backends on the same inputs.
+  double max_abs_diff{0};
+};
+
+// Time AllReduce, AllGather, ReduceScatter, Broadcast and a ring of
+// BatchedISendIRecv on an SHM group and an MPI group of all world ranks,
+// with float32 arrays of `numel` elements per rank. Must be called by every
+// rank of an intra-node world. Returns the average time per call on the
+// calling rank.
+std::vector<CPUCommBenchmarkResult> BenchmarkCPUCommBackends(size_t numel = 1 << 20,
+                                                             int num_iters = 20);
+
+} // namespace comm
+} // namespace impl
+} // namespace hydraulis
@@ -0,0 +1,235 @@
+#include "hydraulis/impl/communication/thread_comm_group.h"
+#include "hydraulis/impl/communication/threaded_world.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace hydraulis {
+namespace impl {
+namespace comm {
+
+using hydraulis::operator<<;
+
+namespace {
+
+// Groups are cached per rank, since all ranks share the same process.
+static std::mutex thread_create_group_mutex;
+static std::vector<std::map<std::pair<int, std::vector<int>>, ThreadCommunicationGroup>>
+  thread_comm_groups((HT_NUM_STREAMS_PER_DEVICE) + 1);
+
+std::string GetThreadRegionKey(const std::vector<int>& world_ranks,
+                               StreamIndex stream_id) {
+  std::string key = "THREAD_REGION";
+  for (auto rank : world_ranks)
+    key += "_" + std::to_string(rank);
+  return key + "@" + std::to_string(stream_id);
+}
+
+void* GetOrCreateThreadRegion(const std::vector<int>& world_ranks,
+                              StreamIndex stream_id,
+                              const SHMTransportConfig& config) {
+  int size = static_cast<int>(world_ranks.size());
+  return ThreadedWorld::GetOrCreateSharedRegion(
+    GetThreadRegionKey(world_ranks, stream_id),
+    SHMTransport::RequiredBytes(size, config),
+    [size, &config](void* region) {
+      SHMTransport::InitializeRegion(region, size, config);
+    });
+}
+
+} // namespace
+
+ThreadCommunicationGroupDef::ThreadCommunicationGroupDef(
+  const std::vector<int>& world_ranks, const Stream& stream)
+: SHMCommunicationGroupDef(
+    world_ranks, stream,
+    GetOrCreateThreadRegion(world_ranks, stream.stream_index(),
+                            SHMTransportConfig::FromEnv()),
+    SHMTransportConfig::FromEnv()) {
+  _transport->set_abort_flag(&ThreadedWorld::FailureFlag());
+  HT_LOG_DEBUG << "Initialized THREAD comm group for " << _world_ranks
+               << " on rank " << GetWorldRank() << " with stream " << _stream
+               << ".";
+}
+
+ThreadCommunicationGroup&
+ThreadCommunicationGroup::GetOrCreate(const std::vector<int>& world_ranks,
+                                      const Stream& stream) {
+  HT_ASSERT(stream.device().is_cpu())
+    << "The argument \"stream\" for "
+    << "ThreadCommunicationGroup::GetOrCreate "
+    << "must be a CPU stream. Got " << stream << ".";
+  HT_ASSERT(ThreadedWorld::IsRunning())
+    << "ThreadCommunicationGroup requires a running threaded world.";
+  // Note: stream id could be -1, we shall shift it by one when accessing
+  int stream_id = static_cast<int>(stream.stream_index());
+
+  std::vector<int> ranks = world_ranks;
+  if (ranks.empty())
+    ranks = GetWorldRanks();
+  HT_ASSERT(CommunicationGroupDef::IsRanksValid(ranks))
+    << "Invalid world ranks: " << ranks;
+  HT_ASSERT(GetGroupRank(ranks) != -1)
+    << "Cannot get comm group " << ranks << " on rank " << GetWorldRank()
+    << ".";
+  auto key = std::make_pair(GetWorldRank(), ranks);
+  // Unlike other backends, groups are created concurrently by many ranks,
+  // so the lookup must be guarded as well.
+  std::unique_lock<std::mutex> lock(thread_create_group_mutex);
+  auto it = thread_comm_groups[stream_id + 1].find(key);
+  if (it == thread_comm_groups[stream_id + 1].end()) {
+    ThreadCommunicationGroup comm_group(ranks, stream);
+    auto insertion = thread_comm_groups[stream_id + 1].insert({key, comm_group});
+    HT_ASSERT(insertion.second)
+      << "Failed to insert ThreadCommunicationGroup for ranks "
+      << comm_group->world_ranks() << ".";
+    it = insertion.first;
+  }
+  return it->second;
+}
+
+void ThreadCommunicationGroup::Clear() {
+  std::unique_lock<std::mutex> lock(thread_create_group_mutex);
+  for (auto& groups : thread_comm_groups)
+    groups.clear();
+}
+
+namespace {
+
+// Integral values keep the reduced sums exact in float32.
+inline float CheckValue(int rank, size_t i) {
+  return static_cast<float>((rank + 1) * static_cast<int>(i % 7));
+}
+
+NDArray MakeCheckArray(int rank, size_t numel) {
+  auto ret = NDArray::empty({static_cast<int64_t>(numel)}, GetLocalDevice(),
+                            kFloat32, kBlockingStream);
+  float* ptr = ret->data_ptr<float>();
+  for (size_t i = 0; i < numel; i++)
+    ptr[i] = CheckValue(rank, i);
+  return ret;
+}
+
+} // namespace
+
+std::vector<ThreadCollectiveCheck> CheckThreadCollectives(int world_size,
+                                                          size_t numel) {
+  HT_VALUE_ERROR_IF(world_size < 2 || numel == 0)
+    << "Invalid arguments for checking thread collectives";
+  std::vector<ThreadCollectiveCheck> checks = {
+    {"AllReduce"}, {"AllGather"}, {"SendRecv"},
+    {"ReduceScatter"}, {"Broadcast"}, {"BatchedISendIRecv"}};
+  std::mutex checks_mutex;
+  ThreadedWorld::Run(world_size, [&](int rank) {
+    auto& comm_group = ThreadCommunicationGroup::GetOrCreate(
+      GetWorldRanks(), Stream(GetLocalDevice(), kCollectiveStream));
+    auto input = MakeCheckArray(rank, numel);
+    std::vector<double> errors(checks.size(), 0);
+
+    auto reduced = NDArray::empty_like(input, kBlockingStream);
+    comm_group->AllReduce(input, reduced, kSUM);
+    comm_group->Sync();
+    const float* reduced_ptr = reduced->data_ptr<float>();
+    for (size_t i = 0; i < numel; i++) {
+      double expected = (i % 7) * world_size * (world_size + 1) / 2;
+      errors[0] = std::max(errors[0], std::abs(reduced_ptr[i] - expected));
+    }
+
+    auto gathered = NDArray::empty({static_cast<int64_t>(numel * world_size)},
+                                   GetLocalDevice(), kFloat32, kBlockingStream);
+    comm_group->AllGather(input, gathered);
+    comm_group->Sync();
+    const float* gathered_ptr = gathered->data_ptr<float>();
+    for (int r = 0; r < world_size; r++)
+      for (size_t i = 0; i < numel; i++)
+        errors[1] = std::max<double>(
+          errors[1], std::abs(gathered_ptr[r * numel + i] - CheckValue(r, i)));
+
+    // Pass the input along a ring. Rank 0 sends first and the others receive
+    // first, so that blocking transfers larger than the p2p ring cannot deadlock.
+    auto received = NDArray::empty_like(input, kBlockingStream);
+    int next = (rank + 1) % world_size;
+    int prev = (rank + world_size - 1) % world_size;
+    if (rank == 0) {
+      comm_group->Send(input, next);
+      comm_group->Recv(received, prev);
+    } else {
+      comm_group->Recv(received, prev);
+      comm_group->Send(input, next);
+    }
+    comm_group->Sync();
+    const float* received_ptr = received->data_ptr<float>();
+    for (size_t i = 0; i < numel; i++)
+      errors[2] = std::max<double>(
+        errors[2], std::abs(received_ptr[i] - CheckValue(prev, i)));
+
+    // The input of reduce-scatter is padded to a multiple of the world size.
+    size_t per_rank = (numel + world_size - 1) / world_size;
+    auto scatter_input = MakeCheckArray(rank, per_rank * world_size);
+    auto scattered = NDArray::empty({static_cast<int64_t>(per_rank)},
+                                    GetLocalDevice(), kFloat32, kBlockingStream);
+    comm_group->ReduceScatter(scatter_input, scattered, 0, kSUM);
+    comm_group->Sync();
+    const float* scattered_ptr = scattered->data_ptr<float>();
+    for (size_t i = 0; i < per_rank; i++) {
+      double expected = ((rank * per_rank + i) % 7) * world_size * (world_size + 1) / 2;
+      errors[3] = std::max(errors[3], std::abs(scattered_ptr[i] - expected));
+    }
+
+    // The last rank broadcasts, so that the root is not the first group rank.
+    int root = world_size - 1;
+    auto broadcasted = rank == root ? MakeCheckArray(rank, numel)
+                                    : NDArray::empty_like(input, kBlockingStream);
+    if (rank != root)
+      std::fill_n(broadcasted->data_ptr<float>(), numel, -1.0f);
+    comm_group->Broadcast(broadcasted, root);
+    comm_group->Sync();
+    const float* broadcasted_ptr = broadcasted->data_ptr<float>();
+    for (size_t i = 0; i < numel; i++)
+      errors[4] = std::max<double>(
+        errors[4], std::abs(broadcasted_ptr[i] - CheckValue(root, i)));
+
+    // All ranks send and receive at the same time, which only completes
+    // if the batched transfers progress together.
+    auto batched_received = NDArray::empty_like(input, kBlockingStream);
+    comm_group->BatchedISendIRecv({comm_group->ISend(input, next),
+                                   comm_group->IRecv(batched_received, prev)});
+    comm_group->Sync();
+    const float* batched_ptr = batched_received->data_ptr<float>();
+    for (size_t i = 0; i < numel; i++)
+      errors[5] = std::max<double>(
+        errors[5], std::abs(batched_ptr[i] - CheckValue(prev, i)));
+
+    std::lock_guard<std::mutex> lock(checks_mutex);
+    for (size_t k = 0; k < checks.size(); k++)
+      checks[k].max_abs_error = std::max(checks[k].max_abs_error, errors[k]);
+  });
+  return checks;
+}
+
+std::string CheckThreadedWorldFailure(int world_size, int fail_rank) {
+  HT_VALUE_ERROR_IF(world_size < 2 || fail_rank < 0 || fail_rank >= world_size)
+    << "Invalid arguments for checking threaded world failures";
+  try {
+    ThreadedWorld::Run(world_size, [&](int rank) {
+      auto& comm_group = ThreadCommunicationGroup::GetOrCreate(
+        GetWorldRanks(), Stream(GetLocalDevice(), kCollectiveStream));
+      HT_RUNTIME_ERROR_IF(rank == fail_rank)
+        << "Rank " << rank << " failed on purpose";
+      comm_group->Barrier(true);
+      auto input = MakeCheckArray(rank, 1024);
+      auto output = NDArray::empty_like(input, kBlockingStream);
+      comm_group->AllReduce(input, output, kSUM);
+      comm_group->Sync();
+    });
+  } catch (const std::exception& e) {
+    return e.what();
+  }
+  HT_RUNTIME_ERROR << "The failure of rank " << fail_rank
+                   << " was not re-thrown by the threaded world";
+  __builtin_unreachable();
+}
+
+} // namespace comm
+} // namespace impl
+} // namespace hydraulis
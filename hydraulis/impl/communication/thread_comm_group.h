@@ -0,0 +1,80 @@
+#pragma once
+
+#include "hydraulis/impl/communication/shm_comm_group.h"
+
+namespace hydraulis {
+namespace impl {
+namespace comm {
+
+class ThreadCommunicationGroupDef;
+class ThreadCommunicationGroup;
+
+// Communication among ranks of the threaded world. It shares the transport
+// of SHM groups, but the region is plain host memory of the process
+// so neither RPC nor POSIX shared memory is involved.
+class ThreadCommunicationGroupDef : public SHMCommunicationGroupDef {
+ protected:
+  friend class ThreadCommunicationGroup;
+  struct constructor_access_key {};
+  ThreadCommunicationGroupDef(const std::vector<int>& world_ranks,
+                              const Stream& stream);
+
+ public:
+  ThreadCommunicationGroupDef(const constructor_access_key&,
+                              const std::vector<int>& world_ranks,
+                              const Stream& stream)
+  : ThreadCommunicationGroupDef(world_ranks, stream) {}
+
+  std::string backend() const override {
+    return "THREAD";
+  }
+};
+
+class ThreadCommunicationGroup final
+: public CommGroupWrapper<ThreadCommunicationGroupDef> {
+ protected:
+  ThreadCommunicationGroup(const std::vector<int>& world_ranks,
+                           const Stream& stream)
+  : CommGroupWrapper<ThreadCommunicationGroupDef>(
+      make_ptr<ThreadCommunicationGroupDef>(
+        ThreadCommunicationGroupDef::constructor_access_key(), world_ranks,
+        stream)) {}
+
+ public:
+  ThreadCommunicationGroup() = default;
+
+  static ThreadCommunicationGroup& GetOrCreate(const std::vector<int>& world_ranks,
+                                               const Stream& stream);
+
+  static ThreadCommunicationGroup& GetOrCreate(const std::vector<int>& world_ranks,
+                                               Device device = {kCPU}) {
+    return GetOrCreate(
+      world_ranks,
+      Stream(device, world_ranks.size() != 2 ? kCollectiveStream : kP2PStream));
+  }
+
+  // Release the groups of all ranks. Called when a threaded world ends.
+  static void Clear();
+};
+
+struct ThreadCollectiveCheck {
+  std::string op;
+  double max_abs_error{0};
+};
+
+// Run collectives of THREAD groups (AllReduce, AllGather, Send/Recv,
+// ReduceScatter, Broadcast and BatchedISendIRecv) in a threaded world of
+// `world_size` ranks and compare the outputs with values computed on the host.
+// THREAD groups share the transport of SHM groups, so this also checks SHM.
+// Returns the errors of every rank, merged by taking the maximum.
+std::vector<ThreadCollectiveCheck> CheckThreadCollectives(int world_size = 4,
+                                                          size_t numel = 100003);
+
+// Let `fail_rank` throw while the other ranks wait for it in a barrier and
+// an all-reduce. Returns the message re-thrown by ThreadedWorld::Run,
+// which must be the error of `fail_rank` rather than a hang.
+std::string CheckThreadedWorldFailure(int world_size = 4, int fail_rank = 1);
+
+} // namespace comm
+} // namespace impl
+} // namespace hydraulis
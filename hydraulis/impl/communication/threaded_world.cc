@@ -0,0 +1,163 @@
+#include "hydraulis/impl/communication/threaded_world.h"
+#include "hydraulis/impl/communication/thread_comm_group.h"
+#include "hydraulis/impl/stream/CPUStream.h"
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace hydraulis {
+namespace impl {
+namespace comm {
+
+namespace {
+
+static thread_local int threaded_world_rank = -1;
+static std::atomic<bool> threaded_world_running{false};
+static std::atomic<bool> threaded_world_failed{false};
+static int threaded_world_size = 0;
+static std::vector<Device> threaded_world_devices;
+static DeviceGroup threaded_world_device_group;
+
+static std::mutex shared_region_mutex;
+static std::unordered_map<std::string, std::shared_ptr<void>> shared_regions;
+
+} // namespace
+
+ThreadedRankGuard::ThreadedRankGuard(int rank)
+: _prev_rank(threaded_world_rank) {
+  threaded_world_rank = rank;
+}
+
+ThreadedRankGuard::~ThreadedRankGuard() {
+  threaded_world_rank = _prev_rank;
+}
+
+void ThreadedWorld::Run(int world_size, const std::function<void(int)>& fn) {
+  HT_VALUE_ERROR_IF(world_size < 1 || world_size > HT_MAX_DEVICE_MULTIPLEX)
+    << "World size of the threaded world should be within [1, "
+    << HT_MAX_DEVICE_MULTIPLEX << "], got " << world_size;
+  HT_RUNTIME_ERROR_IF(threaded_world_running.exchange(true))
+    << "Another threaded world is running.";
+
+  threaded_world_failed = false;
+  threaded_world_size = world_size;
+  threaded_world_devices.clear();
+  for (int rank = 0; rank < world_size; rank++)
+    threaded_world_devices.push_back(RankToDevice(rank));
+  threaded_world_device_group = DeviceGroup(threaded_world_devices);
+  HT_LOG_DEBUG << "Launching a threaded world of " << world_size
+               << " ranks: " << threaded_world_device_group;
+
+  std::vector<std::exception_ptr> errors(world_size);
+  std::atomic<int> first_failed_rank{-1};
+  // Peers waiting for a failed rank in collectives would never return,
+  // so the failure is published to them right away (see FailureFlag).
+  auto on_failure = [&errors, &first_failed_rank](int rank) {
+    errors[rank] = std::current_exception();
+    int expected = -1;
+    first_failed_rank.compare_exchange_strong(expected, rank);
+    threaded_world_failed = true;
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(world_size);
+  for (int rank = 0; rank < world_size; rank++) {
+    threads.emplace_back([rank, &fn, &on_failure]() {
+      ThreadedRankGuard guard(rank);
+      try {
+        fn(rank);
+        SynchronizeAllCPUStreams();
+      } catch (const std::exception& e) {
+        HT_LOG_ERROR << "Rank " << rank << " of the threaded world failed: "
+                     << e.what();
+        on_failure(rank);
+      } catch (...) {
+        on_failure(rank);
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  // A failed rank skips its own synchronization, and its pending tasks
+  // may still touch the shared regions. Since SynchronizeAllCPUStreams
+  // only drains the streams of the calling rank, drain every rank here
+  // before releasing the groups and regions.
+  for (int rank = 0; rank < world_size; rank++) {
+    ThreadedRankGuard guard(rank);
+    try {
+      SynchronizeAllCPUStreams();
+    } catch (...) {
+      // The error (if any) has been recorded by the rank itself.
+    }
+  }
+
+  ThreadCommunicationGroup::Clear();
+  {
+    std::lock_guard<std::mutex> lock(shared_region_mutex);
+    shared_regions.clear();
+  }
+  threaded_world_device_group = DeviceGroup();
+  threaded_world_devices.clear();
+  threaded_world_size = 0;
+  threaded_world_running = false;
+
+  // Errors of peers are mostly aborted collectives, so the root cause
+  // is the one raised first.
+  if (first_failed_rank >= 0)
+    std::rethrow_exception(errors[first_failed_rank]);
+}
+
+bool ThreadedWorld::IsRunning() {
+  return threaded_world_running.load();
+}
+
+bool ThreadedWorld::Failed() {
+  return threaded_world_failed.load();
+}
+
+const std::atomic<bool>& ThreadedWorld::FailureFlag() {
+  return threaded_world_failed;
+}
+
+int ThreadedWorld::Size() {
+  return threaded_world_size;
+}
+
+int ThreadedWorld::CurrentRank() {
+  return threaded_world_rank;
+}
+
+const std::vector<Device>& ThreadedWorld::Devices() {
+  return threaded_world_devices;
+}
+
+const DeviceGroup& ThreadedWorld::GetDeviceGroup() {
+  return threaded_world_device_group;
+}
+
+void* ThreadedWorld::GetOrCreateSharedRegion(
+  const std::string& key, size_t bytes,
+  const std::function<void(void*)>& init_fn) {
+  HT_ASSERT(IsRunning())
+    << "Shared regions are only available in a running threaded world.";
+  std::lock_guard<std::mutex> lock(shared_region_mutex);
+  auto it = shared_regions.find(key);
+  if (it == shared_regions.end()) {
+    constexpr size_t alignment = 64;
+    size_t aligned_bytes = (bytes + alignment - 1) / alignment * alignment;
+    void* ptr = std::aligned_alloc(alignment, aligned_bytes);
+    HT_RUNTIME_ERROR_IF(ptr == nullptr)
+      << "Failed to allocate " << aligned_bytes << " bytes for region " << key;
+    if (init_fn)
+      init_fn(ptr);
+    it = shared_regions.emplace(key, std::shared_ptr<void>(ptr, std::free)).first;
+  }
+  return it->second.get();
+}
+
+} // namespace comm
+} // namespace impl
+} // namespace hydraulis
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "hydraulis/core/device.h"
+#include <atomic>
+#include <functional>
+
+namespace hydraulis {
+namespace impl {
+namespace comm {
+
+/******************************************************
+ * A world of virtual ranks that live as threads of the current process.
+ * Each rank is bound to the CPU device Device(kCPU, 0, "", rank),
+ * i.e., ranks are told apart by the multiplex field since the index
+ * of CPU devices is always zero. The rank of the calling thread is
+ * used by GetWorldRank/GetLocalDevice/... and by CPU streams, so that
+ * every rank owns its streams and hence its task queues.
+ *
+ * It is meant for running distributed strategies on machines
+ * without GPUs, mostly for correctness checks and overhead profiling.
+ ******************************************************/
+class ThreadedWorld {
+ public:
+  // Launch `world_size` threads, and call `fn(rank)` on each of them.
+  // The first exception is re-thrown after all ranks have returned.
+  static void Run(int world_size, const std::function<void(int)>& fn);
+
+  static bool IsRunning();
+
+  // Whether any rank of the current run has failed. Once set, thread
+  // collectives and barriers throw instead of waiting for the failed rank.
+  static bool Failed();
+
+  static const std::atomic<bool>& FailureFlag();
+
+  static int Size();
+
+  // The rank of the calling thread, or -1 if it does not belong to any rank.
+  static int CurrentRank();
+
+  static Device RankToDevice(int rank) {
+    return Device(kCPU, 0, "", static_cast<uint8_t>(rank));
+  }
+
+  static const std::vector<Device>& Devices();
+
+  static const DeviceGroup& GetDeviceGroup();
+
+  // Host memory which is shared by all ranks during the current run.
+  // The first caller of a key allocates the memory and calls `init_fn`
+  // on it before anyone else could see it.
+  static void* GetOrCreateSharedRegion(const std::string& key, size_t bytes,
+                                       const std::function<void(void*)>& init_fn);
+};
+
+// Bind the calling thread to a rank of the threaded world (-1 for none).
+class ThreadedRankGuard {
+ public:
+  explicit ThreadedRankGuard(int rank);
+  ~ThreadedRankGuard();
+
+ private:
+  int _prev_rank;
+};
+
+} // namespace comm
+} // namespace impl
+} // namespace hydraulis
@@ -1,6 +1,6 @@
 #include "hydraulis/core/ndarray.h"
 #include "hydraulis/core/stream.h"
-#include "hydraulis/impl/communication/mpi_comm_group.h"
+#include "hydraulis/impl/communication/shm_comm_group.h"
 #include "hydraulis/impl/utils/common_utils.h"
 
 namespace hydraulis {
@@ -11,7 +11,7 @@ using namespace hydraulis::impl::comm;
 void AllReduceCpu(const NDArray& input, NDArray& output, ReductionType red_type,
                   const DeviceGroup& device_group, const Stream& stream) {
   auto ranks = DeviceGroupToWorldRanks(device_group);
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(ranks, stream);
   comm_group->AllReduce(input, output, red_type);
   NDArray::MarkUsedBy({input, output}, stream);
 }
@@ -19,7 +19,7 @@ void AllReduceCpu(const NDArray& input, NDArray& output, ReductionType red_type,
 void AllGatherCpu(const NDArray& input, NDArray& output,
                   const DeviceGroup& device_group, int32_t gather_dim, const Stream& stream) {
   auto ranks = DeviceGroupToWorldRanks(device_group);
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(ranks, stream);
   comm_group->AllGather(input, output, gather_dim);      
   NDArray::MarkUsedBy({input, output}, stream);            
 }
@@ -27,21 +27,21 @@ void AllGatherCpu(const NDArray& input, NDArray& output,
 void ReduceScatterCpu(const NDArray& input, NDArray& output, ReductionType red_type,
                       const DeviceGroup& device_group, int32_t scatter_dim, const Stream& stream) {
   auto ranks = DeviceGroupToWorldRanks(device_group);
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(ranks, stream);
   comm_group->ReduceScatter(input, output, scatter_dim, red_type);
   NDArray::MarkUsedBy({input, output}, stream);
 }
 
 void P2PSendCpu(const NDArray& data, const Device& dst, const std::vector<int>& comm_group_ranks, const Stream& stream) {
   auto dst_rank = DeviceToWorldRank(dst);
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(comm_group_ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(comm_group_ranks, stream);
   comm_group->Send(data, dst_rank);
   NDArray::MarkUsedBy({data}, stream);
 }
 
 void P2PRecvCpu(NDArray& data, const Device& src, const std::vector<int>& comm_group_ranks, const Stream& stream) {
   auto src_rank = DeviceToWorldRank(src);
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(comm_group_ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(comm_group_ranks, stream);
   comm_group->Recv(data, src_rank);
   NDArray::MarkUsedBy({data}, stream);
 }
@@ -53,7 +53,7 @@ void BatchedISendIRecvCpu(const NDArrayList& send_datas,
   std::vector<int> ranks(comm_deivces.size());
   std::transform(comm_deivces.begin(), comm_deivces.end(), ranks.begin(), [&](const Device& device) { return DeviceToWorldRank(device); });
   std::sort(ranks.begin(), ranks.end());
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(ranks, stream);
   std::vector<CommTask> tasks;
   tasks.reserve(send_datas.size() + recv_datas.size());
   for (int i = 0; i < send_datas.size(); i++) {
@@ -70,7 +70,7 @@ void BatchedISendIRecvCpu(const NDArrayList& send_datas,
 void BroadcastCommCpu(NDArray& data, int broadcaster,
                       const DeviceGroup& device_group, const Stream& stream) {
   auto ranks = DeviceGroupToWorldRanks(device_group);
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(ranks, stream);
   comm_group->Broadcast(data, broadcaster);
   NDArray::MarkUsedBy({data}, stream);
 }
@@ -78,7 +78,7 @@ void BroadcastCommCpu(NDArray& data, int broadcaster,
 void ReduceCommCpu(const NDArray& input, NDArray& output, int reducer,
                 const DeviceGroup& device_group, const Stream& stream) {
   auto ranks = DeviceGroupToWorldRanks(device_group);
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(ranks, stream);
   comm_group->Reduce(input, output, reducer);
   NDArray::MarkUsedBy({input, output}, stream);    
 }
@@ -86,7 +86,7 @@ void ReduceCommCpu(const NDArray& input, NDArray& output, int reducer,
 void GatherCpu(const NDArray& input, NDArray& output, int gatherer,
                 const DeviceGroup& device_group, const Stream& stream) {
   auto ranks = DeviceGroupToWorldRanks(device_group);
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(ranks, stream);
   comm_group->Gather(input, output, gatherer);
   NDArray::MarkUsedBy({input, output}, stream);  
 }
@@ -94,7 +94,7 @@ void GatherCpu(const NDArray& input, NDArray& output, int gatherer,
 void ScatterCpu(const NDArray& input, NDArray& output, int scatterer,
                 const DeviceGroup& device_group, const Stream& stream) {
   auto ranks = DeviceGroupToWorldRanks(device_group);
-  auto& comm_group = MPICommunicationGroup::GetOrCreate(ranks, stream);
+  auto comm_group = GetOrCreateCPUCommGroup(ranks, stream);
   comm_group->Scatter(input, output, scatterer);
   NDArray::MarkUsedBy({input, output}, stream);  
 }
@@ -7,6 +7,32 @@
 namespace hydraulis {
 namespace impl {
 
+namespace {
+
+// 按照行优先的顺序遍历shape，返回每个元素在from与to中的偏移（以元素为单位）
+template <typename Fn>
+void ForEachStridedOffset(const HTShape& shape, const HTStride& from_stride,
+                          const HTStride& to_stride, size_t numel, Fn&& fn) {
+  size_t ndim = shape.size();
+  HTShape index(ndim, 0);
+  int64_t from_offset = 0, to_offset = 0;
+  for (size_t i = 0; i < numel; i++) {
+    fn(from_offset, to_offset);
+    for (int64_t d = static_cast<int64_t>(ndim) - 1; d >= 0; d--) {
+      if (++index[d] < shape[d]) {
+        from_offset += from_stride[d];
+        to_offset += to_stride[d];
+        break;
+      }
+      from_offset -= (shape[d] - 1) * from_stride[d];
+      to_offset -= (shape[d] - 1) * to_stride[d];
+      index[d] = 0;
+    }
+  }
+}
+
+} // namespace
+
 void DataTransferCpu(const NDArray& from, NDArray& to, const Stream& stream) {
   HT_ASSERT_COPIABLE(from, to);
   size_t numel = from->numel();
@@ -21,6 +47,37 @@ void DataTransferCpu(const NDArray& from, NDArray& to, const Stream& stream) {
     return;
   }
   CPUStream cpu_stream(stream);
+  // 从numpy或dlpack借用的内存可能是strided的，此时逐元素拷贝
+  if (!from->is_contiguous() || !to->is_contiguous()) {
+    HT_ASSERT(from->dtype() != kFloat4 && from->dtype() != kNFloat4)
+      << "Strided data transfer of " << from->dtype() << " is not supported.";
+    auto _future = cpu_stream.EnqueueTask(
+    [from, to, to_ptr, from_ptr, numel]() {
+      if (from->dtype() == to->dtype()) {
+        size_t item_size = DataType2Size(from->dtype());
+        auto* bytes_from = reinterpret_cast<const char*>(from_ptr);
+        auto* bytes_to = reinterpret_cast<char*>(to_ptr);
+        ForEachStridedOffset(from->shape(), from->stride(), to->stride(), numel,
+          [&](int64_t from_offset, int64_t to_offset) {
+            memcpy(bytes_to + to_offset * item_size,
+                   bytes_from + from_offset * item_size, item_size);
+          });
+      } else {
+        HT_DISPATCH_PAIRED_SIGNED_INTEGER_AND_FLOATING_TYPES(
+          from->dtype(), to->dtype(), spec_a_t, spec_b_t, "DataTransferCpu", [&]() {
+            auto* typed_from_ptr = reinterpret_cast<spec_a_t*>(from_ptr);
+            auto* typed_to_ptr = reinterpret_cast<spec_b_t*>(to_ptr);
+            ForEachStridedOffset(from->shape(), from->stride(), to->stride(), numel,
+              [&](int64_t from_offset, int64_t to_offset) {
+                typed_to_ptr[to_offset] = static_cast<spec_b_t>(typed_from_ptr[from_offset]);
+              });
+          });
+      }
+    },
+    "DataTransfer");
+    NDArray::MarkUsedBy({from, to}, stream);
+    return;
+  }
   auto _future = cpu_stream.EnqueueTask(
   [from, to, to_ptr, from_ptr, numel]() {
     if (from->dtype() == to->dtype()) {
@@ -3,6 +3,7 @@
 #include "hydraulis/impl/utils/common_utils.h"
 #include "hydraulis/impl/utils/omp_utils.h"
 #include "hydraulis/impl/stream/CPUStream.h"
+#include <algorithm>
 
 namespace hydraulis {
 namespace impl {
@@ -37,17 +38,29 @@ void array_zero_set_cpu(spec_t* input, size_t size) {
   }
 }
 
+// 多个位置可能查找同一行，因此按列（而非按id）划分给各个线程：
+// 每个线程按照id的顺序依次累加自己负责的列，既没有写冲突，累加顺序也与线程数无关
 template <typename spec_t>
 void embedding_lookup_gradient_cpu(const spec_t* output_grad, const int64_t* ids,
-                                   size_t size, size_t length,
+                                   size_t size, size_t length, size_t input_row,
                                    spec_t* input_grad) {
+  constexpr size_t kColumnChunk = 16;
+  size_t num_ids = size / length;
+  size_t num_chunks = (length + kColumnChunk - 1) / kColumnChunk;
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static)
 #endif
-  for (size_t idx = 0; idx < size / length; ++idx) {
-    int id = int(ids[idx]);
-    for (size_t i = 0; i < length; i++) {
-      input_grad[length * id + i] +=  output_grad[length * idx + i];
+  for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+    size_t begin = chunk * kColumnChunk;
+    size_t end = std::min(begin + kColumnChunk, length);
+    for (size_t idx = 0; idx < num_ids; ++idx) {
+      int64_t id = ids[idx];
+      // 与前向一致，越界的id不产生梯度
+      if (id < 0 || id >= static_cast<int64_t>(input_row))
+        continue;
+      for (size_t i = begin; i < end; i++) {
+        input_grad[length * id + i] += output_grad[length * idx + i];
+      }
     }
   }
 }
@@ -103,6 +116,7 @@ void EmbeddingLookupGradientCpu(const NDArray& output_grad, const NDArray& id,
       HT_ASSERT(input_grad->shape(1) == output_grad->shape(i));
     }
   }
+  size_t input_row = input_grad->shape(0);
   size_t length = input_grad->shape(1);
   size_t size = input_grad->numel();
   if (size == 0 || length == 0)
@@ -110,11 +124,11 @@ void EmbeddingLookupGradientCpu(const NDArray& output_grad, const NDArray& id,
   HT_DISPATCH_INTEGER_AND_FLOATING_TYPES(
     input_grad->dtype(), spec_t, "EmbeddingLookupGradientCuda", [&]() {
       auto _future = cpu_stream.EnqueueTask(
-      [input_grad, output_grad, id, size, length]() {
+      [input_grad, output_grad, id, size, length, input_row]() {
       array_zero_set_cpu(input_grad->data_ptr<spec_t>(), size);
       embedding_lookup_gradient_cpu(output_grad->data_ptr<spec_t>(),
                                     id->data_ptr<int64_t>(), output_grad->numel(), length,
-                                    input_grad->data_ptr<spec_t>());
+                                    input_row, input_grad->data_ptr<spec_t>());
       },
       "EmbbedingLookupGradient");  
     });
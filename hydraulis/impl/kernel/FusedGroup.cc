@@ -0,0 +1,225 @@
+#include "hydraulis/core/ndarray.h"
+#include "hydraulis/core/stream.h"
+#include "hydraulis/impl/stream/CPUStream.h"
+#include "hydraulis/impl/utils/common_utils.h"
+#include "hydraulis/impl/utils/fused_utils.h"
+#include "hydraulis/impl/utils/omp_utils.h"
+#include <type_traits>
+
+namespace hydraulis {
+namespace impl {
+
+namespace {
+
+// 每个tile的元素个数，保证所有寄存器的tile能够放进L1/L2
+constexpr size_t kFusedTileSize = 1024;
+
+enum class FusedLoadMode : int8_t {
+  FULL = 0, // 与输出shape相同
+  SCALAR, // 只有一个元素
+  SUFFIX, // 与输出的最后若干维相同（例如bias）
+  GENERAL
+};
+
+struct FusedInputIndexer {
+  FusedLoadMode mode;
+  int64_t numel;
+  HTStride stride; // broadcast的维度stride为0
+};
+
+FusedInputIndexer MakeFusedInputIndexer(const HTShape& input_shape, const HTShape& output_shape) {
+  FusedInputIndexer indexer;
+  indexer.numel = NumEl(input_shape);
+  int64_t output_numel = NumEl(output_shape);
+  if (indexer.numel == output_numel) {
+    indexer.mode = FusedLoadMode::FULL;
+    return indexer;
+  }
+  if (indexer.numel == 1) {
+    indexer.mode = FusedLoadMode::SCALAR;
+    return indexer;
+  }
+  size_t ndim = output_shape.size();
+  HT_ASSERT(input_shape.size() <= ndim)
+    << "Cannot broadcast " << input_shape << " to " << output_shape;
+  size_t offset = ndim - input_shape.size();
+  // 去掉开头的1之后与输出的最后若干维相同
+  size_t first = 0;
+  while (first < input_shape.size() && input_shape[first] == 1)
+    first++;
+  bool is_suffix = true;
+  for (size_t i = first; i < input_shape.size(); i++) {
+    if (input_shape[i] != output_shape[offset + i]) {
+      is_suffix = false;
+      break;
+    }
+  }
+  if (is_suffix) {
+    indexer.mode = FusedLoadMode::SUFFIX;
+    return indexer;
+  }
+  indexer.mode = FusedLoadMode::GENERAL;
+  indexer.stride.assign(ndim, 0);
+  int64_t stride = 1;
+  for (size_t i = input_shape.size(); i-- > 0;) {
+    HT_ASSERT(input_shape[i] == 1 || input_shape[i] == output_shape[offset + i])
+      << "Cannot broadcast " << input_shape << " to " << output_shape;
+    if (input_shape[i] != 1)
+      indexer.stride[offset + i] = stride;
+    stride *= input_shape[i];
+  }
+  return indexer;
+}
+
+template <typename acc_t>
+inline void fused_apply_tile(const FusedInstr& instr, const acc_t* a, const acc_t* b,
+                             acc_t* out, size_t n) {
+  acc_t value = static_cast<acc_t>(instr.value);
+  // 将switch提到循环外，使得每条指令的循环都可以被向量化
+  #define FUSED_TILE_CASE(TYPE)                                               \
+    case FusedType::TYPE:                                                     \
+      _Pragma("omp simd")                                                     \
+      for (size_t j = 0; j < n; j++)                                          \
+        out[j] = fused_apply<acc_t>(FusedType::TYPE, a[j],                    \
+                                    b == nullptr ? acc_t(0) : b[j], value);   \
+      break;
+  switch (instr.type) {
+    FUSED_TILE_CASE(ADD)
+    FUSED_TILE_CASE(SUB)
+    FUSED_TILE_CASE(MUL)
+    FUSED_TILE_CASE(DIV)
+    FUSED_TILE_CASE(ADDCONST)
+    FUSED_TILE_CASE(SUBCONST)
+    FUSED_TILE_CASE(SUBFROMCONST)
+    FUSED_TILE_CASE(MULCONST)
+    FUSED_TILE_CASE(DIVCONST)
+    FUSED_TILE_CASE(DIVFROMCONST)
+    FUSED_TILE_CASE(NEGATE)
+    FUSED_TILE_CASE(RECIPROCAL)
+    FUSED_TILE_CASE(EXP)
+    FUSED_TILE_CASE(LOG)
+    FUSED_TILE_CASE(SQRT)
+    FUSED_TILE_CASE(RSQRT)
+    FUSED_TILE_CASE(ABS)
+    FUSED_TILE_CASE(RELU)
+    FUSED_TILE_CASE(SIGMOID)
+    FUSED_TILE_CASE(TANH)
+    FUSED_TILE_CASE(GELU)
+    FUSED_TILE_CASE(SILU)
+    default:
+      HT_NOT_IMPLEMENTED << "Unsupported fused type " << static_cast<int>(instr.type);
+  }
+  #undef FUSED_TILE_CASE
+}
+
+template <typename spec_t>
+void fused_group_cpu(const std::vector<const spec_t*>& inputs,
+                     const std::vector<FusedInputIndexer>& indexers,
+                     const FusedProgram& program, const HTShape& output_shape,
+                     size_t size, const std::vector<spec_t*>& outputs) {
+  // 半精度在float下计算
+  using acc_t = typename std::conditional<std::is_same<spec_t, double>::value, double, float>::type;
+  size_t num_tiles = DIVUP(size, kFusedTileSize);
+  int64_t ndim = output_shape.size();
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    std::vector<acc_t> regs(static_cast<size_t>(program.num_registers) * kFusedTileSize);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (size_t tile = 0; tile < num_tiles; tile++) {
+      size_t begin = tile * kFusedTileSize;
+      size_t n = std::min(kFusedTileSize, size - begin);
+      // load inputs
+      for (int32_t i = 0; i < program.num_inputs; i++) {
+        acc_t* reg = regs.data() + i * kFusedTileSize;
+        const spec_t* input = inputs[i];
+        const auto& indexer = indexers[i];
+        switch (indexer.mode) {
+          case FusedLoadMode::FULL:
+            for (size_t j = 0; j < n; j++)
+              reg[j] = static_cast<acc_t>(input[begin + j]);
+            break;
+          case FusedLoadMode::SCALAR:
+            std::fill(reg, reg + n, static_cast<acc_t>(input[0]));
+            break;
+          case FusedLoadMode::SUFFIX:
+            for (size_t j = 0; j < n; j++)
+              reg[j] = static_cast<acc_t>(input[(begin + j) % indexer.numel]);
+            break;
+          default:
+            for (size_t j = 0; j < n; j++)
+              reg[j] = static_cast<acc_t>(input[get_index(begin + j, ndim, indexer.stride.data(), output_shape.data())]);
+            break;
+        }
+      }
+      // evaluate the whole expression on the tile
+      for (const auto& instr : program.instrs) {
+        fused_apply_tile<acc_t>(instr, regs.data() + instr.src0 * kFusedTileSize,
+                                instr.src1 >= 0 ? regs.data() + instr.src1 * kFusedTileSize : nullptr,
+                                regs.data() + instr.dst * kFusedTileSize, n);
+      }
+      // store outputs
+      for (size_t k = 0; k < outputs.size(); k++) {
+        const acc_t* reg = regs.data() + program.output_registers[k] * kFusedTileSize;
+        spec_t* output = outputs[k] + begin;
+        for (size_t j = 0; j < n; j++)
+          output[j] = static_cast<spec_t>(reg[j]);
+      }
+    }
+  }
+}
+
+} // namespace
+
+void FusedGroupCpu(const NDArrayList& inputs, const FusedProgram& program,
+                   NDArrayList& outputs, const Stream& stream) {
+  HT_ASSERT(static_cast<int32_t>(inputs.size()) == program.num_inputs)
+    << "FusedGroup expects " << program.num_inputs << " inputs, got " << inputs.size();
+  HT_ASSERT(!outputs.empty() && outputs.size() == program.output_registers.size())
+    << "FusedGroup expects " << program.output_registers.size() << " outputs, got " << outputs.size();
+  const auto& output_shape = outputs.front()->shape();
+  for (const auto& input : inputs) {
+    HT_ASSERT_CPU_DEVICE(input);
+    HT_ASSERT_CONTIGUOUS(input);
+    HT_ASSERT(input->dtype() == outputs.front()->dtype())
+      << "Inputs of FusedGroup should have the same dtype as outputs";
+  }
+  for (const auto& output : outputs) {
+    HT_ASSERT_CPU_DEVICE(output);
+    HT_ASSERT_CONTIGUOUS(output);
+    HT_ASSERT(output->shape() == output_shape)
+      << "Outputs of FusedGroup should have the same shape";
+  }
+
+  size_t size = outputs.front()->numel();
+  if (size == 0)
+    return;
+  std::vector<FusedInputIndexer> indexers;
+  indexers.reserve(inputs.size());
+  for (const auto& input : inputs) {
+    indexers.emplace_back(MakeFusedInputIndexer(input->shape(), output_shape));
+  }
+  CPUStream cpu_stream(stream);
+
+  HT_DISPATCH_FLOATING_TYPES(
+    outputs.front()->dtype(), spec_t, "FusedGroupCpu", [&]() {
+      auto _future = cpu_stream.EnqueueTask(
+      [inputs, outputs, program, indexers, output_shape, size]() {
+        std::vector<const spec_t*> input_ptrs;
+        std::vector<spec_t*> output_ptrs;
+        for (const auto& input : inputs)
+          input_ptrs.push_back(input->data_ptr<spec_t>());
+        for (const auto& output : outputs)
+          output_ptrs.push_back(output->data_ptr<spec_t>());
+        fused_group_cpu<spec_t>(input_ptrs, indexers, program, output_shape, size, output_ptrs);
+      },"FusedGroup");
+    });
+  NDArray::MarkUsedBy(inputs, stream);
+  NDArray::MarkUsedBy(outputs, stream);
+}
+
+} // namespace impl
+} // namespace hydraulis
@@ -3,6 +3,8 @@
 #include "hydraulis/impl/utils/common_utils.h"
 #include "hydraulis/impl/utils/dnnl_utils.h"
 #include "hydraulis/impl/utils/omp_utils.h"
+#include "hydraulis/impl/utils/reduce_utils.h"
+#include "hydraulis/common/deterministic.h"
 #include "hydraulis/impl/stream/CPUStream.h"
 #include <cmath>
 
@@ -66,12 +68,13 @@ void LayerNormCpu(const NDArray& in_arr, const NDArray& ln_scale,
   }
 
   CPUStream cpu_stream(stream);
+  bool deterministic = IsDeterministic();
 
   HT_DISPATCH_INTEGER_AND_FLOATING_TYPES(
     in_arr->dtype(), spec_t, "LayerNormCpu", [&]() {
       cpu_stream.EnqueueTask(
       [stream, in_arr, ln_scale, ln_bias, mean_arr, var_arr, out_arr, temp_strideA, temp_strideC,
-       eps, last_dims, ndim]() {
+       eps, last_dims, ndim, deterministic]() {
       dnnl::engine eng(dnnl::engine::kind::cpu, 0);
       dnnl::stream engine_stream(eng);
       auto dnnltype = hydraulis::cpu::dtype_to_dnnltype(in_arr->dtype());
@@ -83,6 +86,9 @@ void LayerNormCpu(const NDArray& in_arr, const NDArray& ln_scale,
 
       if (in_arr->shape() == mean_arr->shape())
         hydraulis::cpu::read_from_dnnl_memory(mean_arr->data_ptr<spec_t>(), src_mem);
+      else if (deterministic)
+        hydraulis::cpu::fixed_order_reduce(in_arr->data_ptr<spec_t>(), in_arr->shape(), in_arr->stride(),
+                                           mean_arr->data_ptr<spec_t>(), mean_arr->shape(), mean_arr->stride(), true);
       else {
 
         // Create primitive descriptor.
@@ -111,6 +117,9 @@ void LayerNormCpu(const NDArray& in_arr, const NDArray& ln_scale,
       dst_mem = dnnl::memory(dst_md, eng, var_arr->data_ptr<spec_t>());
       if (in_arr->shape() == mean_arr->shape())
         hydraulis::cpu::read_from_dnnl_memory(var_arr->data_ptr<spec_t>(), src_mem);
+      else if (deterministic)
+        hydraulis::cpu::fixed_order_reduce(out_arr->data_ptr<spec_t>(), in_arr->shape(), in_arr->stride(),
+                                           var_arr->data_ptr<spec_t>(), var_arr->shape(), var_arr->stride(), true);
       else {
 
         // Create primitive descriptor.
@@ -208,12 +217,13 @@ void LayerNormGradientCpu(const NDArray& out_grads, const NDArray& in_arr,
   auto gscale_arr = NDArray::empty_like(in_arr, stream.stream_index());
 
   CPUStream cpu_stream(stream);
+  bool deterministic = IsDeterministic();
   HT_DISPATCH_FLOATING_TYPES(
     in_arr->dtype(), spec_t, "LayerNormGradientCpu", [&]() {
       cpu_stream.EnqueueTask(
       [stream, out_grads, in_arr, ln_scale, grad_scale, grad_bias, grad_arr, mean_arr, var_arr, 
       ds_arr, db_arr, dy_mul_x_arr, gscale_arr,
-      reduce_dims, eps, ndim, lastdims, total_elements, size]() {
+      reduce_dims, eps, ndim, lastdims, total_elements, size, deterministic]() {
       dnnl::engine eng(dnnl::engine::kind::cpu, 0);
       spec_t* ds = ds_arr->data_ptr<spec_t>();
       spec_t* db = db_arr->data_ptr<spec_t>();
@@ -240,6 +250,9 @@ void LayerNormGradientCpu(const NDArray& out_grads, const NDArray& in_arr,
 
       if (in_arr->shape() == ln_scale->shape())
         hydraulis::cpu::read_from_dnnl_memory(grad_bias->data_ptr<spec_t>(), src_mem);
+      else if (deterministic)
+        hydraulis::cpu::fixed_order_reduce(out_grads->data_ptr<spec_t>(), in_arr->shape(), in_arr->stride(),
+                                           grad_bias->data_ptr<spec_t>(), scale_shape, scale_stride, false);
       else {
 
         // Create primitive descriptor.
@@ -268,6 +281,9 @@ void LayerNormGradientCpu(const NDArray& out_grads, const NDArray& in_arr,
       scale_mem = dnnl::memory(scale_md, eng, grad_scale->data_ptr<spec_t>());
       if (in_arr->shape() == ln_scale->shape())
         hydraulis::cpu::read_from_dnnl_memory(grad_scale->data_ptr<spec_t>(), src_mem);
+      else if (deterministic)
+        hydraulis::cpu::fixed_order_reduce(gscale, in_arr->shape(), in_arr->stride(),
+                                           grad_scale->data_ptr<spec_t>(), scale_shape, scale_stride, false);
       else {
 
         // Create primitive descriptor.
@@ -290,6 +306,9 @@ void LayerNormGradientCpu(const NDArray& out_grads, const NDArray& in_arr,
       mean_mem = dnnl::memory(mean_md, eng, db);
       if (in_arr->shape() == mean_arr->shape())
         hydraulis::cpu::read_from_dnnl_memory(db, src_mem);
+      else if (deterministic)
+        hydraulis::cpu::fixed_order_reduce(out_grads->data_ptr<spec_t>(), in_arr->shape(), in_arr->stride(),
+                                           db, mean_arr->shape(), mean_arr->stride(), false);
       else {
 
         // Create primitive descriptor.
@@ -333,6 +352,9 @@ void LayerNormGradientCpu(const NDArray& out_grads, const NDArray& in_arr,
       mean_mem = dnnl::memory(mean_md, eng, ds);
       if (in_arr->shape() == ln_scale->shape())
         hydraulis::cpu::read_from_dnnl_memory(ds, mdst_mem);
+      else if (deterministic)
+        hydraulis::cpu::fixed_order_reduce(dy_mul_x, in_arr->shape(), in_arr->stride(),
+                                           ds, mean_arr->shape(), mean_arr->stride(), false);
       else {
 
         // Create primitive descriptor.
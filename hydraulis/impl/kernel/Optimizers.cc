@@ -138,5 +138,76 @@ void AdamCpu(const NDArray& grad, NDArray& param, NDArray& mean,
   NDArray::MarkUsedBy({grad, param, mean, variance}, stream);
 }
 
+// ZeRO-Offload中host上的更新：grad与param为低精度，master param为fp32
+// mean/variance为fp32或与grad相同的类型
+// 与AdamCuda一致，variance累积grad的平方，weight_decay暂不使用
+template <typename spec_t, typename state_t>
+void adam_offload_update_cpu(const spec_t* grad, float* master, state_t* mean,
+                             state_t* variance, spec_t* param, int64_t step,
+                             float lr, float beta1, float beta2, float eps,
+                             size_t size) {
+  float bias1 = 1 - std::pow(beta1, float(step));
+  float bias2 = std::sqrt(1 - std::pow(beta2, float(step)));
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (size_t idx = 0; idx < size; idx++) {
+    float g = static_cast<float>(grad[idx]);
+    float m = static_cast<float>(mean[idx]) * beta1 + g * (1 - beta1);
+    float v = static_cast<float>(variance[idx]) * beta2 + g * g * (1 - beta2);
+    float p = master[idx] - lr * (m / bias1) / (std::sqrt(v) / bias2 + eps);
+    mean[idx] = static_cast<state_t>(m);
+    variance[idx] = static_cast<state_t>(v);
+    master[idx] = p;
+    if (param != nullptr)
+      param[idx] = static_cast<spec_t>(p);
+  }
+}
+
+void AdamOffloadCpu(const NDArray& grad, NDArray& master, NDArray& mean,
+                    NDArray& variance, NDArray& param, int64_t step,
+                    float lr, float beta1, float beta2,
+                    float eps, float weight_decay,
+                    const Stream& stream) {
+  HT_ASSERT_CPU_DEVICE(grad);
+  HT_ASSERT_CPU_DEVICE(master);
+  HT_ASSERT_CPU_DEVICE(mean);
+  HT_ASSERT_CPU_DEVICE(variance);
+  HT_ASSERT(master->dtype() == kFloat32)
+    << "master param should be float32, got " << master->dtype();
+  HT_ASSERT(mean->dtype() == variance->dtype())
+    << "mean and variance should have the same dtype";
+  HT_ASSERT(mean->dtype() == kFloat32 || mean->dtype() == grad->dtype())
+    << "optimizer states should be float32 or the same as grad, got " << mean->dtype();
+  size_t size = grad->numel();
+  HT_ASSERT(master->numel() == size && mean->numel() == size && variance->numel() == size)
+    << "grad, master param and optimizer states should have the same size";
+  if (param.is_defined()) {
+    HT_ASSERT_CPU_DEVICE(param);
+    HT_ASSERT_EXCHANGABLE(grad, param);
+  }
+  if (size == 0)
+    return;
+  CPUStream cpu_stream(stream);
+  HT_DISPATCH_FLOATING_TYPES(grad->dtype(), spec_t, "AdamOffloadCpu", [&]() {
+    auto _future = cpu_stream.EnqueueTask(
+    [grad, master, mean, variance, param, step, lr, beta1, beta2, eps, size]() {
+      spec_t* param_ptr = param.is_defined() ? param->data_ptr<spec_t>() : nullptr;
+      if (mean->dtype() == kFloat32) {
+        adam_offload_update_cpu<spec_t, float>(
+          grad->data_ptr<spec_t>(), master->data_ptr<float>(),
+          mean->data_ptr<float>(), variance->data_ptr<float>(), param_ptr,
+          step, lr, beta1, beta2, eps, size);
+      } else {
+        adam_offload_update_cpu<spec_t, spec_t>(
+          grad->data_ptr<spec_t>(), master->data_ptr<float>(),
+          mean->data_ptr<spec_t>(), variance->data_ptr<spec_t>(), param_ptr,
+          step, lr, beta1, beta2, eps, size);
+      }
+    },"AdamOffload");
+  });
+  NDArray::MarkUsedBy({grad, master, mean, variance, param}, stream);
+}
+
 } // namespace impl
 } // namespace hydraulis
\ No newline at end of file
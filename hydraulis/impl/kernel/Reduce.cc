@@ -4,6 +4,8 @@
 #include "hydraulis/impl/utils/common_utils.h"
 #include "hydraulis/impl/utils/dnnl_utils.h"
 #include "hydraulis/impl/utils/omp_utils.h"
+#include "hydraulis/impl/utils/reduce_utils.h"
+#include "hydraulis/common/deterministic.h"
 
 namespace hydraulis {
 namespace impl {
@@ -28,8 +30,9 @@ void ReduceCpu(const NDArray& input, NDArray& output, const HTAxes& axes,
       out_stride[i] = stride_size;
       stride_size *= out_shape[i];
     }
+    bool deterministic = IsDeterministic();
     auto _future = cpu_stream.EnqueueTask(
-      [input, output, in_shape, in_stride, out_shape, out_stride, red_type]() {
+      [input, output, in_shape, in_stride, out_shape, out_stride, red_type, deterministic]() {
         dnnl::engine eng(dnnl::engine::kind::cpu, 0);
         auto dnnltype = hydraulis::cpu::dtype_to_dnnltype(input->dtype());
         auto src_md = dnnl::memory::desc(in_shape, dnnltype, in_stride);
@@ -49,6 +52,11 @@ void ReduceCpu(const NDArray& input, NDArray& output, const HTAxes& axes,
         if (in_shape == out_shape) {
           hydraulis::cpu::read_from_dnnl_memory(output->data_ptr<spec_t>(), src_mem);
         }
+        else if (deterministic) {
+          hydraulis::cpu::fixed_order_reduce(input->data_ptr<spec_t>(), in_shape, in_stride,
+                                             output->data_ptr<spec_t>(), out_shape, out_stride,
+                                             red_type == ReductionType::MEAN);
+        }
         else {
           // Create primitive descriptor.
           auto reduction_pd = dnnl::reduction::primitive_desc(
@@ -4,19 +4,93 @@
 #include "hydraulis/impl/utils/dnnl_utils.h"
 #include "hydraulis/impl/utils/omp_utils.h"
 #include "hydraulis/impl/stream/CPUStream.h"
+#include "hydraulis/common/deterministic.h"
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
 
 namespace hydraulis {
 namespace impl {
 
+// 确定性模式下的softmax：每一行由同一个线程按照固定的顺序求max与sum
+// 输入为连续的[outer, dim_size, inner]
+template <typename spec_t>
+void softmax_fixed_order_cpu(const spec_t* input, spec_t* output, int64_t outer,
+                             int64_t dim_size, int64_t inner) {
+  using acc_t = typename std::conditional<std::is_same<spec_t, double>::value, double, float>::type;
+  if (dim_size == 0)
+    return;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int64_t row = 0; row < outer * inner; row++) {
+    int64_t base = (row / inner) * dim_size * inner + row % inner;
+    acc_t max_value = static_cast<acc_t>(input[base]);
+    for (int64_t i = 1; i < dim_size; i++)
+      max_value = std::max(max_value, static_cast<acc_t>(input[base + i * inner]));
+    acc_t sum = 0;
+    for (int64_t i = 0; i < dim_size; i++)
+      sum += std::exp(static_cast<acc_t>(input[base + i * inner]) - max_value);
+    for (int64_t i = 0; i < dim_size; i++)
+      output[base + i * inner] =
+        static_cast<spec_t>(std::exp(static_cast<acc_t>(input[base + i * inner]) - max_value) / sum);
+  }
+}
+
+// dx = y * (dy - sum(dy * y))
+template <typename spec_t>
+void softmax_gradient_fixed_order_cpu(const spec_t* output, const spec_t* output_grad,
+                                      spec_t* input_grad, int64_t outer,
+                                      int64_t dim_size, int64_t inner) {
+  using acc_t = typename std::conditional<std::is_same<spec_t, double>::value, double, float>::type;
+  if (dim_size == 0)
+    return;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int64_t row = 0; row < outer * inner; row++) {
+    int64_t base = (row / inner) * dim_size * inner + row % inner;
+    acc_t dot = 0;
+    for (int64_t i = 0; i < dim_size; i++)
+      dot += static_cast<acc_t>(output_grad[base + i * inner]) * static_cast<acc_t>(output[base + i * inner]);
+    for (int64_t i = 0; i < dim_size; i++) {
+      acc_t y = static_cast<acc_t>(output[base + i * inner]);
+      input_grad[base + i * inner] =
+        static_cast<spec_t>(y * (static_cast<acc_t>(output_grad[base + i * inner]) - dot));
+    }
+  }
+}
+
+// 将axis前后的维度分别合并，得到[outer, dim_size, inner]
+static void softmax_split_dims(const HTShape& shape, int axis, int64_t& outer,
+                               int64_t& dim_size, int64_t& inner) {
+  outer = 1, inner = 1;
+  dim_size = shape[axis];
+  for (int i = 0; i < axis; i++)
+    outer *= shape[i];
+  for (size_t i = axis + 1; i < shape.size(); i++)
+    inner *= shape[i];
+}
+
 void SoftmaxCpu(const NDArray& input, NDArray& output, int64_t dim, const Stream& stream) {
   HT_ASSERT_CPU_DEVICE(input);
   HT_ASSERT_SAME_DEVICE(input, output);
 
   CPUStream cpu_stream(stream);
+  // 非连续的输入仍使用dnnl，其在给定线程数下同样可以复现
+  bool deterministic = IsDeterministic() && input->is_contiguous() && output->is_contiguous();
   HT_DISPATCH_INTEGER_AND_FLOATING_TYPES(
     input->dtype(), spec_t, "SoftmaxCuda", [&]() {
       auto _future = cpu_stream.EnqueueTask(
-        [stream, input, output, dim]() {
+        [stream, input, output, dim, deterministic]() {
+          if (deterministic) {
+            int64_t outer, dim_size, inner;
+            softmax_split_dims(input->shape(), dim >= 0 ? dim : dim + input->ndim(),
+                               outer, dim_size, inner);
+            softmax_fixed_order_cpu(input->data_ptr<spec_t>(), output->data_ptr<spec_t>(),
+                                    outer, dim_size, inner);
+            return;
+          }
           dnnl::engine eng(dnnl::engine::kind::cpu, 0);
           auto dnnltype = hydraulis::cpu::dtype_to_dnnltype(input->dtype());
           auto src_md = dnnl::memory::desc(input->shape(), dnnltype, input->stride());
@@ -56,10 +130,20 @@ void SoftmaxGradientCpu(const NDArray& input_Y, const NDArray& output_grad,
   HT_ASSERT_SAME_DEVICE(input_Y, input_grad);
 
   CPUStream cpu_stream(stream);
+  bool deterministic = IsDeterministic() && input_Y->is_contiguous() &&
+                       output_grad->is_contiguous() && input_grad->is_contiguous();
   HT_DISPATCH_INTEGER_AND_FLOATING_TYPES(
     input_Y->dtype(), spec_t, "SoftmaxGradientCuda", [&]() {
       auto _future = cpu_stream.EnqueueTask(
-        [stream, input_Y, output_grad, input_grad, dim]() {
+        [stream, input_Y, output_grad, input_grad, dim, deterministic]() {
+          if (deterministic) {
+            int64_t outer, dim_size, inner;
+            softmax_split_dims(input_Y->shape(), dim >= 0 ? dim : dim + input_Y->ndim(),
+                               outer, dim_size, inner);
+            softmax_gradient_fixed_order_cpu(input_Y->data_ptr<spec_t>(), output_grad->data_ptr<spec_t>(),
+                                             input_grad->data_ptr<spec_t>(), outer, dim_size, inner);
+            return;
+          }
           dnnl::engine eng(dnnl::engine::kind::cpu, 0);
           auto dnnltype = hydraulis::cpu::dtype_to_dnnltype(input_Y->dtype());
           auto src_md = dnnl::memory::desc(input_Y->shape(), dnnltype, input_Y->stride());
@@ -1,18 +1,34 @@
 #include "hydraulis/core/ndarray.h"
 #include "hydraulis/core/stream.h"
 #include "hydraulis/impl/utils/common_utils.h"
-#include "hydraulis/impl/utils/dnnl_utils.h"
 #include "hydraulis/impl/utils/omp_utils.h"
+#include "hydraulis/impl/utils/online_softmax.h"
 #include "hydraulis/impl/stream/CPUStream.h"
 
 namespace hydraulis {
 namespace impl {
+
+// 融合的log-softmax与loss：loss = sum(-y * (x - lse)) = lse * sum(y) - sum(y * x)，
+// 只需要每行的lse，不再需要与输入同样大小的log-softmax workspace
 template <typename spec_t>
-void softmax_cross_entropy_cpu(const spec_t* logsoftmax,
-                               const spec_t* label,
-                               spec_t* output, size_t size) {
-  for (size_t idx = 0; idx < size; ++idx) 
-    output[idx] = -logsoftmax[idx] * label[idx];
+void softmax_cross_entropy_cpu(const spec_t* input, const spec_t* label,
+                               spec_t* output, size_t n_rows, size_t n_cols) {
+  using acc_t = hydraulis::cpu::reduce_acc_t<spec_t>;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (size_t idx = 0; idx < n_rows; idx++) {
+    const spec_t* row = input + idx * n_cols;
+    const spec_t* y = label + idx * n_cols;
+    acc_t row_max, row_sum;
+    hydraulis::cpu::online_max_sum_exp(row, n_cols, row_max, row_sum);
+    acc_t label_sum = 0, label_dot = 0;
+    for (size_t j = 0; j < n_cols; j++) {
+      label_sum += static_cast<acc_t>(y[j]);
+      label_dot += static_cast<acc_t>(y[j]) * static_cast<acc_t>(row[j]);
+    }
+    output[idx] = static_cast<spec_t>((std::log(row_sum) + row_max) * label_sum - label_dot);
+  }
 }
 
 void SoftmaxCrossEntropyCpu(const NDArray& input, const NDArray& label,
@@ -21,92 +37,49 @@ void SoftmaxCrossEntropyCpu(const NDArray& input, const NDArray& label,
   HT_ASSERT(indim == label->ndim() && indim == output->ndim() + 1)
     << "Indim is " << indim << ", Label dim is " << label->ndim()
     << ", Output dim is " << output->ndim();
-  int n_ = 1;
+  size_t n_rows = 1;
   for (size_t i = 0; i < indim - 1; ++i) {
-    n_ *= input->shape(i);
+    n_rows *= input->shape(i);
   }
-  int c_ = input->shape(indim - 1);
-  size_t size = n_ * c_;
+  size_t n_cols = input->shape(indim - 1);
 
-  if (size == 0)
+  if (n_rows * n_cols == 0)
     return;
 
-  auto workspace = NDArray::empty(input->shape(), input->device(), kFloat32,
-                                  stream.stream_index());
   CPUStream cpu_stream(stream);
-  HT_DISPATCH_INTEGER_AND_FLOATING_TYPES(
-    input->dtype(), spec_t, "SoftmaxCrossEntropyCuda", [&]() {
-      cpu_stream.EnqueueTask(
-        [input, label, output, workspace, stream, size]() {
-        dnnl::engine eng(dnnl::engine::kind::cpu, 0);
-        void* workspace_ptr = workspace->raw_data_ptr();
-        dnnl::stream engine_stream(eng);
-        auto dnnltype = hydraulis::cpu::dtype_to_dnnltype(input->dtype());
-        auto src_md = dnnl::memory::desc(input->shape(), dnnltype, input->stride());
-        auto dst_md = dnnl::memory::desc(input->shape(), dnnltype, input->stride());
-        auto src_mem = dnnl::memory(src_md, eng, input->data_ptr<spec_t>());
-        auto dst_mem = dnnl::memory(dst_md, eng, workspace_ptr);
-
-        // Softmax axis.
-        const int axis = 1;
-        auto softmax_pd = dnnl::softmax_forward::primitive_desc(eng,
-                          dnnl::prop_kind::forward_training, 
-                          dnnl::algorithm::softmax_log, 
-                          src_md, dst_md, axis);
-
-        auto softmax_prim = dnnl::softmax_forward(softmax_pd);
-
-        std::unordered_map<int, dnnl::memory> softmax_args;
-        softmax_args.insert({DNNL_ARG_SRC, src_mem});
-        softmax_args.insert({DNNL_ARG_DST, dst_mem});
-
-        // Primitive execution.
-        softmax_prim.execute(engine_stream, softmax_args);
-        engine_stream.wait();
-
-
+  HT_DISPATCH_FLOATING_TYPES(
+    input->dtype(), spec_t, "SoftmaxCrossEntropyCpu", [&]() {
+      auto _future = cpu_stream.EnqueueTask(
+        [input, label, output, n_rows, n_cols]() {
         softmax_cross_entropy_cpu<spec_t>(
-          (const spec_t*) workspace_ptr, label->data_ptr<spec_t>(),
-          (spec_t*) workspace_ptr, size);
-
-        HTShape outshape = output->shape(); outshape.emplace_back(1);
-        HTShape outstride = output->stride(); outstride.emplace_back(1);
-        auto rsrc_md = dnnl::memory::desc(input->shape(), dnnltype, input->stride());
-        auto rdst_md = dnnl::memory::desc(outshape, dnnltype, outstride);
-
-        auto rsrc_mem = dnnl::memory(rsrc_md, eng, workspace_ptr);
-        auto rdst_mem = dnnl::memory(rdst_md, eng, output->data_ptr<spec_t>());
-
-        if (input->shape() == outshape)
-          hydraulis::cpu::read_from_dnnl_memory(output->data_ptr<spec_t>(), rsrc_mem);
-        else {
-          // Create primitive descriptor.
-          auto reduction_pd = dnnl::reduction::primitive_desc(
-                  eng, dnnl::algorithm::reduction_sum, rsrc_md, rdst_md, float(0.f), float(0.f));
-
-          // Create the primitive.
-          auto reduction_prim = dnnl::reduction(reduction_pd);
-
-          // Primitive arguments.
-          std::unordered_map<int, dnnl::memory> reduction_args;
-          reduction_args.insert({DNNL_ARG_SRC, rsrc_mem});
-          reduction_args.insert({DNNL_ARG_DST, rdst_mem});
-
-          // Primitive execution: Reduction (Sum).
-          reduction_prim.execute(engine_stream, reduction_args);
-          engine_stream.wait();
-        }
+          input->data_ptr<spec_t>(), label->data_ptr<spec_t>(),
+          output->data_ptr<spec_t>(), n_rows, n_cols);
         },"SoftmaxCrossEntropy");
   });
-  NDArray::MarkUsedBy({input, label, output, workspace}, stream);
+  NDArray::MarkUsedBy({input, label, output}, stream);
 } 
 
+// grad = (softmax(x) - y) * grad_loss，softmax在写梯度时按行重新计算
 template <typename spec_t>
 void softmax_cross_entropy_gradient_cpu(
-  const spec_t* pred, const spec_t* y_, const spec_t* grad_data,
-  spec_t* output_data, int last_dim, size_t size) {  
-  for (size_t idx = 0; idx < size; ++idx)
-    output_data[idx] = (pred[idx] - y_[idx]) * grad_data[idx / last_dim];
+  const spec_t* input, const spec_t* y_, const spec_t* grad_data,
+  spec_t* output_data, size_t n_rows, size_t n_cols) {
+  using acc_t = hydraulis::cpu::reduce_acc_t<spec_t>;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (size_t idx = 0; idx < n_rows; idx++) {
+    const spec_t* row = input + idx * n_cols;
+    const spec_t* y = y_ + idx * n_cols;
+    spec_t* out = output_data + idx * n_cols;
+    acc_t row_max, row_sum;
+    hydraulis::cpu::online_max_sum_exp(row, n_cols, row_max, row_sum);
+    acc_t log_sum_exp = std::log(row_sum) + row_max;
+    acc_t grad = static_cast<acc_t>(grad_data[idx]);
+    for (size_t j = 0; j < n_cols; j++)
+      out[j] = static_cast<spec_t>(
+        (std::exp(static_cast<acc_t>(row[j]) - log_sum_exp) - static_cast<acc_t>(y[j])) * grad);
+  }
 }
 
 void SoftmaxCrossEntropyGradientCpu(const NDArray& input_y,
@@ -117,53 +90,26 @@ void SoftmaxCrossEntropyGradientCpu(const NDArray& input_y,
             indim == grad->ndim() + 1)
     << "Indim is " << indim << ", Label dim is " << label->ndim()
     << ", Output dim is " << output->ndim();
-  int n_ = 1;
+  size_t n_rows = 1;
   for (size_t i = 0; i < indim - 1; ++i) {
-    n_ *= input_y->shape(i);
+    n_rows *= input_y->shape(i);
   }
-  int c_ = input_y->shape(indim - 1);
-  size_t size = n_ * c_;
+  size_t n_cols = input_y->shape(indim - 1);
+
+  if (n_rows * n_cols == 0)
+    return;
 
-  auto workspace = NDArray::empty(input_y->shape(), input_y->device(), kFloat32,
-                                  stream.stream_index());
   CPUStream cpu_stream(stream);
-  HT_DISPATCH_INTEGER_AND_FLOATING_TYPES(
-    input_y->dtype(), spec_t, "SoftmaxCrossEntropyCuda", [&]() {
+  HT_DISPATCH_FLOATING_TYPES(
+    input_y->dtype(), spec_t, "SoftmaxCrossEntropyGradientCpu", [&]() {
       auto _future = cpu_stream.EnqueueTask(
-        [input_y, label, grad, output, workspace, stream, c_, size]() {
-        void* workspace_ptr = workspace->raw_data_ptr();
-        
-        dnnl::engine eng(dnnl::engine::kind::cpu, 0);
-        dnnl::stream engine_stream(eng);
-        
-        auto src_md = dnnl::memory::desc(input_y->shape(), dnnl::memory::data_type::f32, input_y->stride());
-        auto dst_md = dnnl::memory::desc(input_y->shape(), dnnl::memory::data_type::f32, input_y->stride());
-        auto src_mem = dnnl::memory(src_md, eng, input_y->data_ptr<spec_t>());
-        auto dst_mem = dnnl::memory(dst_md, eng, workspace_ptr);
-
-        // Softmax axis.
-        const int axis = 1;
-        auto softmax_pd = dnnl::softmax_forward::primitive_desc(eng,
-                          dnnl::prop_kind::forward_training, 
-                          dnnl::algorithm::softmax_accurate, 
-                          src_md, dst_md, axis);
-
-        auto softmax_prim = dnnl::softmax_forward(softmax_pd);
-
-        std::unordered_map<int, dnnl::memory> softmax_args;
-        softmax_args.insert({DNNL_ARG_SRC, src_mem});
-        softmax_args.insert({DNNL_ARG_DST, dst_mem});
-
-        // Primitive execution.
-        softmax_prim.execute(engine_stream, softmax_args);
-        engine_stream.wait();
-
+        [input_y, label, grad, output, n_rows, n_cols]() {
         softmax_cross_entropy_gradient_cpu<spec_t>(
-            (const spec_t*) workspace_ptr, label->data_ptr<spec_t>(),
-            grad->data_ptr<spec_t>(), output->data_ptr<spec_t>(), c_, size);
+            input_y->data_ptr<spec_t>(), label->data_ptr<spec_t>(),
+            grad->data_ptr<spec_t>(), output->data_ptr<spec_t>(), n_rows, n_cols);
         },"SoftmaxCrossEntropyGradient");
     });
-  NDArray::MarkUsedBy({input_y, label, grad, output, workspace}, stream);
+  NDArray::MarkUsedBy({input_y, label, grad, output}, stream);
 }
 } // namespace impl
 } // namespace hydraulis
@@ -2,75 +2,84 @@
 #include "hydraulis/core/stream.h"
 #include "hydraulis/impl/utils/common_utils.h"
 #include "hydraulis/impl/utils/omp_utils.h"
+#include "hydraulis/impl/utils/online_softmax.h"
 #include "hydraulis/impl/stream/CPUStream.h"
 #include <cmath>
 
 namespace hydraulis {
 namespace impl {
 
+// 每行单遍计算online max/sum-exp，loss = log(sum) + max - x[label]
 template <typename spec_t>
 void softmax_cross_entropy_sparse_cpu(const spec_t* pred,
                                       const int64_t* label, 
                                       size_t n_rows, size_t n_cols,
                                       const int64_t ignored_index,
                                       spec_t* loss) {
+  using acc_t = hydraulis::cpu::reduce_acc_t<spec_t>;
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static)
 #endif
   for (size_t idx = 0; idx < n_rows; idx++) {
-    if(int64_t(label[idx])==ignored_index) {
+    if (label[idx] == ignored_index) {
       loss[idx] = 0;
-      return;
-    }  
-    spec_t maxval = pred[idx * n_cols];
-    for (size_t i = 1; i < n_cols; ++i) {
-      maxval = MAX(maxval, pred[idx * n_cols + i]);
+      continue;
     }
-
-    spec_t sum = 0;
-    for (size_t i = 0; i < n_cols; ++i) {
-      sum += std::exp(pred[idx * n_cols + i] - maxval);
-    }
-
-    size_t curid = idx * n_cols + int64_t(label[idx]);
-    loss[idx] = -(pred[curid] - maxval) + std::log(sum);
+    const spec_t* row = pred + idx * n_cols;
+    acc_t row_max, row_sum;
+    hydraulis::cpu::online_max_sum_exp(row, n_cols, row_max, row_sum);
+    loss[idx] = static_cast<spec_t>(std::log(row_sum) + row_max - static_cast<acc_t>(row[label[idx]]));
   }
 }
 
+// output可以与pred相同（原地写梯度）
 template <typename spec_t>
 void softmax_cross_entropy_sparse_gradient_cpu(const spec_t* pred, const int64_t* label,
                                                const spec_t* grad_loss, size_t n_rows, size_t n_cols,
                                                const int64_t ignored_index,
                                                spec_t* output) {
+  using acc_t = hydraulis::cpu::reduce_acc_t<spec_t>;
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static)
 #endif
   for (size_t idx = 0; idx < n_rows; idx++) {
-    if(int64_t(label[idx]) == ignored_index) {
-      for (size_t i = 0; i < n_cols; ++i) {
-          size_t curid = idx * n_cols + i;
-          output[curid] = 0;
-      }
-      return;        
-    }
-    
-    spec_t maxval = pred[idx * n_cols];
-
-    for (size_t i = 1; i < n_cols; ++i) {
-        maxval = MAX(maxval, pred[idx * n_cols + i]);
+    spec_t* out = output + idx * n_cols;
+    if (label[idx] == ignored_index) {
+      std::fill(out, out + n_cols, spec_t(0));
+      continue;
     }
+    const spec_t* row = pred + idx * n_cols;
+    acc_t row_max, row_sum;
+    hydraulis::cpu::online_max_sum_exp(row, n_cols, row_max, row_sum);
+    hydraulis::cpu::cross_entropy_row_gradient(row, n_cols, label[idx], std::log(row_sum) + row_max,
+                                               static_cast<acc_t>(grad_loss[idx]), out);
+  }
+}
 
-    spec_t sum = 0;
-    for (size_t i = 0; i < n_cols; ++i) {
-        sum += std::exp(pred[idx * n_cols + i] - maxval);
-    }
-    for (size_t i = 0; i < n_cols; ++i) {
-        size_t curid = idx * n_cols + i;
-        if(int64_t(i) == int64_t(label[idx]))
-          output[curid] = (std::exp(pred[curid] - maxval) / sum - 1.0) * grad_loss[idx];
-        else
-          output[curid] = (std::exp(pred[curid] - maxval) / sum) * grad_loss[idx];
+// 同一遍扫描中计算loss与梯度，梯度为(softmax - onehot) * grad_scale，grad可以与pred相同
+template <typename spec_t>
+void softmax_cross_entropy_sparse_fused_cpu(const spec_t* pred, const int64_t* label,
+                                            size_t n_rows, size_t n_cols,
+                                            const int64_t ignored_index, double grad_scale,
+                                            spec_t* loss, spec_t* grad) {
+  using acc_t = hydraulis::cpu::reduce_acc_t<spec_t>;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (size_t idx = 0; idx < n_rows; idx++) {
+    spec_t* out = grad + idx * n_cols;
+    if (label[idx] == ignored_index) {
+      loss[idx] = 0;
+      std::fill(out, out + n_cols, spec_t(0));
+      continue;
     }
+    const spec_t* row = pred + idx * n_cols;
+    acc_t row_max, row_sum;
+    hydraulis::cpu::online_max_sum_exp(row, n_cols, row_max, row_sum);
+    acc_t log_sum_exp = std::log(row_sum) + row_max;
+    loss[idx] = static_cast<spec_t>(log_sum_exp - static_cast<acc_t>(row[label[idx]]));
+    hydraulis::cpu::cross_entropy_row_gradient(row, n_cols, label[idx], log_sum_exp,
+                                               static_cast<acc_t>(grad_scale), out);
   }
 }
 
@@ -125,5 +134,37 @@ void SoftmaxCrossEntropySparseGradientCpu(const NDArray& pred, const NDArray& la
   NDArray::MarkUsedBy({pred, label, grad_loss, output}, stream);
 }
 
+// loss: [n_rows]，grad与pred的shape相同，传入pred本身时梯度直接覆盖logits
+void SoftmaxCrossEntropySparseFusedCpu(const NDArray& pred, const NDArray& label,
+                                       NDArray& loss, NDArray& grad,
+                                       const int64_t ignored_index, double grad_scale,
+                                       const Stream& stream) {
+  HT_ASSERT(pred->is_contiguous() && grad->is_contiguous())
+    << "SoftmaxCrossEntropySparseFused only supports contiguous logits and gradients";
+  HT_ASSERT(grad->shape() == pred->shape())
+    << "The gradient shape " << grad->shape() << " should be the same as the logits " << pred->shape();
+  size_t n_rows = 1;
+  for (size_t i = 0; i < pred->ndim() - 1; i++)
+    n_rows *= pred->shape(i);
+  size_t n_cols = pred->shape(pred->ndim() - 1);
+  HT_ASSERT(static_cast<size_t>(label->numel()) == n_rows && static_cast<size_t>(loss->numel()) == n_rows)
+    << "Expected " << n_rows << " labels and losses, got " << label->numel()
+    << " and " << loss->numel();
+
+  CPUStream cpu_stream(stream);
+  if (n_rows == 0)
+    return;
+  HT_DISPATCH_FLOATING_TYPES(
+    pred->dtype(), spec_t, "SoftmaxCrossEntropySparseFusedCpu", [&]() {
+      auto _future = cpu_stream.EnqueueTask(
+        [pred, label, loss, grad, n_rows, n_cols, ignored_index, grad_scale]() {
+        softmax_cross_entropy_sparse_fused_cpu(
+          pred->data_ptr<spec_t>(), label->data_ptr<int64_t>(), n_rows, n_cols,
+          ignored_index, grad_scale, loss->data_ptr<spec_t>(), grad->data_ptr<spec_t>());
+        },"SoftmaxCrossEntropySparseFused");
+    });
+  NDArray::MarkUsedBy({pred, label, loss, grad}, stream);
+}
+
 } // namespace impl
 } // namespace hydraulis
@@ -0,0 +1,177 @@
+#include "hydraulis/core/ndarray.h"
+#include "hydraulis/core/stream.h"
+#include "hydraulis/impl/utils/common_utils.h"
+#include "hydraulis/impl/utils/omp_utils.h"
+#include "hydraulis/impl/utils/online_softmax.h"
+#include "hydraulis/impl/stream/CPUStream.h"
+#include <cmath>
+
+namespace hydraulis {
+namespace impl {
+
+// vocab_parallel_logits: [batch_size * seq_len, vocab_size], splited by tp in vocab_size dimension
+// stats: [batch_size * seq_len, 3]，每行为本rank词表上的(max, sum(exp(x - max)), x[label])，
+// label不在本rank的词表内时x[label]为0
+template <typename spec_t>
+void vocab_parallel_cross_entropy_stats_cpu(const spec_t* vocab_parallel_logits,
+                                            const int64_t* labels,
+                                            size_t n_rows, size_t n_cols,
+                                            const int64_t vocab_start_index,
+                                            const int64_t vocab_end_index,
+                                            const int64_t ignored_index,
+                                            spec_t* stats) {
+  using acc_t = hydraulis::cpu::reduce_acc_t<spec_t>;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (size_t idx = 0; idx < n_rows; idx++) {
+    spec_t* row_stats = stats + idx * 3;
+    if (labels[idx] == ignored_index) {
+      row_stats[0] = 0;
+      row_stats[1] = 1;
+      row_stats[2] = 0;
+      continue;
+    }
+    const spec_t* row = vocab_parallel_logits + idx * n_cols;
+    acc_t row_max, row_sum;
+    hydraulis::cpu::online_max_sum_exp(row, n_cols, row_max, row_sum);
+    row_stats[0] = static_cast<spec_t>(row_max);
+    row_stats[1] = static_cast<spec_t>(row_sum);
+    bool in_range = labels[idx] >= vocab_start_index && labels[idx] < vocab_end_index;
+    row_stats[2] = in_range ? row[labels[idx] - vocab_start_index] : spec_t(0);
+  }
+}
+
+// gathered_stats: [tp * batch_size * seq_len, 3]，按rank顺序拼接的各个rank的stats
+// 按rank顺序合并(max, sum-exp)，结果与rank的完成顺序无关
+template <typename spec_t>
+void vocab_parallel_cross_entropy_combine_cpu(const spec_t* gathered_stats,
+                                              const int64_t* labels,
+                                              size_t n_rows, size_t num_ranks,
+                                              const int64_t ignored_index,
+                                              spec_t* loss, spec_t* log_sum_exp) {
+  using acc_t = hydraulis::cpu::reduce_acc_t<spec_t>;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (size_t idx = 0; idx < n_rows; idx++) {
+    if (labels[idx] == ignored_index) {
+      loss[idx] = 0;
+      log_sum_exp[idx] = 0;
+      continue;
+    }
+    acc_t row_max = -std::numeric_limits<acc_t>::infinity(), row_sum = 0, predicted_logit = 0;
+    for (size_t r = 0; r < num_ranks; r++) {
+      const spec_t* row_stats = gathered_stats + (r * n_rows + idx) * 3;
+      hydraulis::cpu::merge_max_sum_exp(row_max, row_sum, static_cast<acc_t>(row_stats[0]),
+                                        static_cast<acc_t>(row_stats[1]));
+      predicted_logit += static_cast<acc_t>(row_stats[2]);
+    }
+    acc_t lse = std::log(row_sum) + row_max;
+    log_sum_exp[idx] = static_cast<spec_t>(lse);
+    loss[idx] = static_cast<spec_t>(lse - predicted_logit);
+  }
+}
+
+// grad = (softmax - onehot) * grad_loss，softmax = exp(x - lse)由本地logits与每行的lse重新计算，
+// 不需要在前向保存与logits同样大小的softmax；output可以与logits相同
+template <typename spec_t>
+void vocab_parallel_cross_entropy_logits_gradient_cpu(const spec_t* vocab_parallel_logits,
+                                                      const spec_t* log_sum_exp,
+                                                      const int64_t* labels,
+                                                      size_t n_rows, size_t n_cols,
+                                                      const int64_t vocab_start_index,
+                                                      const int64_t ignored_index,
+                                                      const spec_t* grad_loss, spec_t* output) {
+  using acc_t = hydraulis::cpu::reduce_acc_t<spec_t>;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (size_t idx = 0; idx < n_rows; idx++) {
+    spec_t* out = output + idx * n_cols;
+    if (labels[idx] == ignored_index) {
+      std::fill(out, out + n_cols, spec_t(0));
+      continue;
+    }
+    hydraulis::cpu::cross_entropy_row_gradient(
+      vocab_parallel_logits + idx * n_cols, n_cols, labels[idx] - vocab_start_index,
+      static_cast<acc_t>(log_sum_exp[idx]), static_cast<acc_t>(grad_loss[idx]), out);
+  }
+}
+
+void VocabParallelCrossEntropyStatsCpu(const NDArray& vocab_parallel_logits, const NDArray& labels,
+                                       const int64_t vocab_start_index, const int64_t vocab_end_index,
+                                       const int64_t ignored_index, NDArray& stats,
+                                       const Stream& stream) {
+  size_t n_rows = vocab_parallel_logits->shape(0); // batch_size * seq_len
+  size_t n_cols = vocab_parallel_logits->shape(1); // vocab_size
+  HT_ASSERT(static_cast<size_t>(stats->numel()) == n_rows * 3)
+    << "Expected stats of shape [" << n_rows << ", 3], got " << stats->shape();
+  if (n_rows == 0)
+    return;
+  CPUStream cpu_stream(stream);
+  HT_DISPATCH_FLOATING_TYPES(
+    vocab_parallel_logits->dtype(), spec_t, "VocabParallelCrossEntropyStatsCpu", [&]() {
+      auto _future = cpu_stream.EnqueueTask(
+        [vocab_parallel_logits, labels, stats, n_rows, n_cols,
+         vocab_start_index, vocab_end_index, ignored_index]() {
+        vocab_parallel_cross_entropy_stats_cpu(
+          vocab_parallel_logits->data_ptr<spec_t>(), labels->data_ptr<int64_t>(),
+          n_rows, n_cols, vocab_start_index, vocab_end_index, ignored_index,
+          stats->data_ptr<spec_t>());
+        },"VocabParallelCrossEntropyStats");
+    });
+  NDArray::MarkUsedBy({vocab_parallel_logits, labels, stats}, stream);
+}
+
+void VocabParallelCrossEntropyCombineCpu(const NDArray& gathered_stats, const NDArray& labels,
+                                         const int64_t ignored_index, NDArray& loss,
+                                         NDArray& log_sum_exp, const Stream& stream) {
+  size_t n_rows = labels->numel();
+  if (n_rows == 0)
+    return;
+  HT_ASSERT(gathered_stats->numel() % (n_rows * 3) == 0)
+    << "Invalid gathered stats " << gathered_stats->shape() << " for " << n_rows << " rows";
+  size_t num_ranks = gathered_stats->numel() / (n_rows * 3);
+  CPUStream cpu_stream(stream);
+  HT_DISPATCH_FLOATING_TYPES(
+    gathered_stats->dtype(), spec_t, "VocabParallelCrossEntropyCombineCpu", [&]() {
+      auto _future = cpu_stream.EnqueueTask(
+        [gathered_stats, labels, loss, log_sum_exp, n_rows, num_ranks, ignored_index]() {
+        vocab_parallel_cross_entropy_combine_cpu(
+          gathered_stats->data_ptr<spec_t>(), labels->data_ptr<int64_t>(),
+          n_rows, num_ranks, ignored_index,
+          loss->data_ptr<spec_t>(), log_sum_exp->data_ptr<spec_t>());
+        },"VocabParallelCrossEntropyCombine");
+    });
+  NDArray::MarkUsedBy({gathered_stats, labels, loss, log_sum_exp}, stream);
+}
+
+void VocabParallelCrossEntropyLogitsGradientCpu(const NDArray& vocab_parallel_logits,
+                                                const NDArray& log_sum_exp,
+                                                const NDArray& labels,
+                                                const int64_t vocab_start_index,
+                                                const int64_t ignored_index,
+                                                const NDArray& grad_loss,
+                                                NDArray& output, const Stream& stream) {
+  size_t n_rows = vocab_parallel_logits->shape(0); // batch_size * seq_len
+  size_t n_cols = vocab_parallel_logits->shape(1); // vocab_size
+  if (n_rows == 0)
+    return;
+  CPUStream cpu_stream(stream);
+  HT_DISPATCH_FLOATING_TYPES(
+    vocab_parallel_logits->dtype(), spec_t, "VocabParallelCrossEntropyLogitsGradientCpu", [&]() {
+      auto _future = cpu_stream.EnqueueTask(
+        [vocab_parallel_logits, log_sum_exp, labels, grad_loss, output,
+         n_rows, n_cols, vocab_start_index, ignored_index]() {
+        vocab_parallel_cross_entropy_logits_gradient_cpu(
+          vocab_parallel_logits->data_ptr<spec_t>(), log_sum_exp->data_ptr<spec_t>(),
+          labels->data_ptr<int64_t>(), n_rows, n_cols, vocab_start_index, ignored_index,
+          grad_loss->data_ptr<spec_t>(), output->data_ptr<spec_t>());
+        },"VocabParallelCrossEntropyLogitsGradient");
+    });
+  NDArray::MarkUsedBy({vocab_parallel_logits, log_sum_exp, labels, grad_loss, output}, stream);
+}
+
+} // namespace impl
+} // namespace hydraulis
@@ -27,6 +27,14 @@ class CPUMemoryPool final : public MemoryPool {
 
   void PrintSummary();
 
+  size_t GetCurrAllocated() override {
+    return _allocated;
+  }
+
+  size_t GetPeakAllocated() override {
+    return _peak_allocated;
+  }
+
   inline size_t get_data_alignment() const noexcept {
     return 16;
   }
@@ -330,6 +330,7 @@ DataPtr CUDACachingMemoryPool::AllocDataSpace(size_t num_bytes,
     DeleteAvailableEvent(data_ptr.id);
   }
   _allocated += data_ptr.size;
+  _peak_allocated = MAX(_peak_allocated, _allocated);
   _alloc_cnt++;
   HT_LOG_TRACE << "ptr: " << data_ptr.id << ", alloc: " << data_ptr.size << ", stream: " << stream << ", is new malloc: " << data_ptr.is_new_malloc;
   return data_ptr;
@@ -652,6 +653,7 @@ DataPtr CUDACachingMemoryPool::BorrowDataSpace(void* ptr, size_t num_bytes,
   _reserved += num_bytes;
   _peak_reserved = MAX(_peak_reserved, _reserved);
   _allocated += num_bytes;
+  _peak_allocated = MAX(_peak_allocated, _allocated);
   _alloc_cnt++;
   return data_ptr;
 }
@@ -66,15 +66,19 @@ class CUDACachingMemoryPool final : public CUDAMemoryPool {
     return _memory_manager != nullptr;
   }
 
-  size_t GetCurrAllocated() {
+  size_t GetCurrAllocated() override {
     return _allocated;
   }
 
-  size_t GetCurrReserved() {
+  size_t GetCurrReserved() override {
     return _reserved;
   }
 
-  size_t GetPeakReserved() {
+  size_t GetPeakAllocated() override {
+    return _peak_allocated;
+  }
+
+  size_t GetPeakReserved() override {
     return _peak_reserved;
   }
 
@@ -277,6 +281,7 @@ class CUDACachingMemoryPool final : public CUDAMemoryPool {
   size_t _allocated{0};
   size_t _reserved{0}; // allocated size + cached size
   size_t _peak_reserved{0};
+  size_t _peak_allocated{0};
   uint64_t _alloc_cnt{0};
   uint64_t _free_cnt{0};
   uint64_t _mark_cnt{0};
@@ -26,6 +26,14 @@ class CUDAStreamOrderedMemoryPool final : public CUDAMemoryPool {
 
   void PrintSummary();
 
+  size_t GetCurrAllocated() override {
+    return _allocated;
+  }
+
+  size_t GetPeakAllocated() override {
+    return _peak_allocated;
+  }
+
  private:
   struct CudaDataPtrInfo {
     void* ptr;
@@ -0,0 +1,554 @@
+#include "hydraulis/impl/profiler/trace.h"
+#include "hydraulis/impl/communication/threaded_world.h"
+#include "hydraulis/utils/json/json.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+
+namespace hydraulis {
+namespace impl {
+
+std::atomic<bool> Tracer::_enabled{false};
+std::atomic<int> Tracer::_process_rank{0};
+std::atomic<uint64_t> Tracer::_epoch{0};
+
+namespace {
+
+// 单个线程的event buffer，由固定大小的chunk组成的链表
+// owner线程追加事件后以release语义发布size，导出线程以acquire语义读取，
+// 已发布的事件不会再被修改，因此导出时不需要加锁
+// Clear只推进全局的epoch而不修改buffer：owner在下一次追加时发现epoch变化，
+// 换上新的chunk链表并把旧的链表挂到retired上（RCU），
+// retired的chunk只在Clear时释放，而Clear与Export互斥，因此导出时读到的chunk不会被释放
+struct TraceBuffer {
+  static constexpr size_t kChunkSize = 1024;
+
+  struct Chunk {
+    TraceEvent events[kChunkSize];
+    std::atomic<size_t> size{0};
+    std::atomic<Chunk*> next{nullptr};
+    Chunk* next_retired{nullptr}; // 被retire的链表的头部之间的链接
+  };
+
+  TraceBuffer(uint64_t tid_, uint64_t epoch_)
+  : tid(tid_), epoch(epoch_), head(new Chunk()), tail(head.load()) {}
+
+  ~TraceBuffer() {
+    FreeChunks(head.load());
+    FreeRetired();
+  }
+
+  static void FreeChunks(Chunk* chunk) {
+    while (chunk != nullptr) {
+      auto* next = chunk->next.load();
+      delete chunk;
+      chunk = next;
+    }
+  }
+
+  // 只由owner线程调用，不加锁
+  void Append(TraceEvent&& event, uint64_t event_epoch) {
+    auto cur_epoch = Tracer::epoch();
+    // span在Clear之前开始
+    if (event_epoch != cur_epoch)
+      return;
+    if (epoch.load(std::memory_order_relaxed) != cur_epoch) {
+      auto* fresh = new Chunk();
+      auto* old = head.exchange(fresh, std::memory_order_acq_rel);
+      tail = fresh;
+      epoch.store(cur_epoch, std::memory_order_release);
+      old->next_retired = retired.load(std::memory_order_relaxed);
+      while (!retired.compare_exchange_weak(old->next_retired, old,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed)) {}
+    }
+    auto size = tail->size.load(std::memory_order_relaxed);
+    if (size == kChunkSize) {
+      auto* chunk = new Chunk();
+      tail->next.store(chunk, std::memory_order_release);
+      tail = chunk;
+      size = 0;
+    }
+    tail->events[size] = std::move(event);
+    tail->size.store(size + 1, std::memory_order_release);
+  }
+
+  // 只导出当前epoch的事件，owner在Clear之后还没有追加过时buffer中都是旧的事件
+  template <typename Fn>
+  void ForEach(Fn&& fn) const {
+    if (epoch.load(std::memory_order_acquire) != Tracer::epoch())
+      return;
+    for (auto* chunk = head.load(std::memory_order_acquire); chunk != nullptr;
+         chunk = chunk->next.load(std::memory_order_acquire)) {
+      auto size = chunk->size.load(std::memory_order_acquire);
+      for (size_t i = 0; i < size; i++)
+        fn(chunk->events[i]);
+    }
+  }
+
+  // 释放owner已经retire的chunk，需要与Export互斥
+  void FreeRetired() {
+    auto* list = retired.exchange(nullptr, std::memory_order_acquire);
+    while (list != nullptr) {
+      auto* next = list->next_retired;
+      FreeChunks(list);
+      list = next;
+    }
+  }
+
+  // 只能在owner线程已经退出时调用
+  void Reset(uint64_t cur_epoch) {
+    auto* chunk = head.load();
+    FreeChunks(chunk->next.load());
+    chunk->next.store(nullptr);
+    chunk->size.store(0);
+    tail = chunk;
+    epoch.store(cur_epoch);
+  }
+
+  const uint64_t tid;
+  std::string thread_name; // 由registry的锁保护
+  std::atomic<uint64_t> epoch; // buffer中事件所属的epoch
+  std::atomic<Chunk*> head;
+  Chunk* tail; // 只由owner访问
+  std::atomic<Chunk*> retired{nullptr};
+};
+
+// 所有线程的buffer，线程退出后其buffer仍然保留以便导出
+std::mutex& registry_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Export与Clear互斥，保证导出时读到的chunk不会被释放
+std::mutex& export_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::vector<std::shared_ptr<TraceBuffer>>& registry() {
+  static std::vector<std::shared_ptr<TraceBuffer>> buffers;
+  return buffers;
+}
+
+TraceBuffer& GetThreadBuffer() {
+  static thread_local std::shared_ptr<TraceBuffer> buffer = []() {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    auto ret = std::make_shared<TraceBuffer>(registry().size(), Tracer::epoch());
+    registry().push_back(ret);
+    return ret;
+  }();
+  return *buffer;
+}
+
+inline bool EndsWith(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() &&
+    str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string ReplaceRank(std::string path, int rank) {
+  const std::string placeholder = "{rank}";
+  auto pos = path.find(placeholder);
+  while (pos != std::string::npos) {
+    path.replace(pos, placeholder.size(), std::to_string(rank));
+    pos = path.find(placeholder, pos);
+  }
+  return path;
+}
+
+/******************************************************
+ * Chrome trace json
+ ******************************************************/
+
+void WriteChromeTrace(std::ostream& os,
+                      const std::vector<std::shared_ptr<TraceBuffer>>& buffers,
+                      const std::vector<std::string>& thread_names) {
+  using json = nlohmann::json;
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  auto sep = [&]() {
+    if (!first)
+      os << ",\n";
+    first = false;
+  };
+  std::set<int32_t> pids;
+  std::set<std::pair<int32_t, uint64_t>> tracks;
+  for (size_t i = 0; i < buffers.size(); i++) {
+    const auto& buffer = buffers[i];
+    buffer->ForEach([&](const TraceEvent& event) {
+      sep();
+      pids.insert(event.pid);
+      tracks.insert({event.pid, buffer->tid});
+      os << "{\"ph\":\"" << static_cast<char>(event.phase) << "\""
+         << ",\"cat\":" << json(event.category).dump()
+         << ",\"name\":" << json(event.name).dump()
+         << ",\"pid\":" << event.pid
+         << ",\"tid\":" << buffer->tid
+         << ",\"ts\":" << std::fixed << std::setprecision(3) << event.begin_ns / 1000.0;
+      if (event.phase == TraceEventPhase::COMPLETE) {
+        os << ",\"dur\":" << event.dur_ns / 1000.0;
+      } else if (event.phase == TraceEventPhase::INSTANT) {
+        os << ",\"s\":\"t\"";
+      }
+      os.unsetf(std::ios_base::floatfield);
+      os << ",\"args\":{";
+      if (event.phase == TraceEventPhase::COUNTER) {
+        os << json(event.name).dump() << ":" << event.value;
+      } else {
+        for (size_t j = 0; j < event.args.size(); j++) {
+          const auto& arg = event.args[j];
+          if (j > 0)
+            os << ",";
+          os << json(arg.key).dump() << ":";
+          if (arg.is_str)
+            os << json(arg.str_value).dump();
+          else
+            os << arg.int_value;
+        }
+      }
+      os << "}}";
+    });
+  }
+  // 每个rank一个process，每个线程一个thread
+  for (auto pid : pids) {
+    sep();
+    os << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << pid
+       << ",\"args\":{\"name\":\"rank " << pid << "\"}}";
+    sep();
+    os << "{\"ph\":\"M\",\"name\":\"process_sort_index\",\"pid\":" << pid
+       << ",\"args\":{\"sort_index\":" << pid << "}}";
+  }
+  for (const auto& track : tracks) {
+    const auto& name = thread_names[track.second];
+    sep();
+    os << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << track.first
+       << ",\"tid\":" << track.second << ",\"args\":{\"name\":"
+       << json(name.empty() ? "thread " + std::to_string(track.second) : name).dump()
+       << "}}";
+  }
+  os << "]}\n";
+}
+
+/******************************************************
+ * Perfetto protobuf
+ * 只用到了Trace/TracePacket/TrackDescriptor/TrackEvent中的少量字段，
+ * 因此直接手写编码而不依赖protobuf库
+ ******************************************************/
+
+class ProtoWriter {
+ public:
+  void Varint(uint64_t value) {
+    while (value >= 0x80) {
+      _buf.push_back(static_cast<char>((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    _buf.push_back(static_cast<char>(value));
+  }
+
+  void Tag(uint32_t field, uint32_t wire_type) {
+    Varint((static_cast<uint64_t>(field) << 3) | wire_type);
+  }
+
+  void Int(uint32_t field, uint64_t value) {
+    Tag(field, 0);
+    Varint(value);
+  }
+
+  void Double(uint32_t field, double value) {
+    Tag(field, 1);
+    char bytes[sizeof(double)];
+    std::memcpy(bytes, &value, sizeof(double));
+    _buf.append(bytes, sizeof(double));
+  }
+
+  void Bytes(uint32_t field, const std::string& value) {
+    Tag(field, 2);
+    Varint(value.size());
+    _buf.append(value);
+  }
+
+  void Message(uint32_t field, const ProtoWriter& msg) {
+    Bytes(field, msg._buf);
+  }
+
+  const std::string& str() const {
+    return _buf;
+  }
+
+ private:
+  std::string _buf;
+};
+
+// field numbers (perfetto/protos/perfetto/trace)
+constexpr uint32_t kTracePacket = 1;
+constexpr uint32_t kPacketTimestamp = 8;
+constexpr uint32_t kPacketSequenceId = 10;
+constexpr uint32_t kPacketTrackEvent = 11;
+constexpr uint32_t kPacketTrackDescriptor = 60;
+constexpr uint32_t kTrackUuid = 1;
+constexpr uint32_t kTrackName = 2;
+constexpr uint32_t kTrackProcess = 3;
+constexpr uint32_t kTrackThread = 4;
+constexpr uint32_t kTrackParentUuid = 5;
+constexpr uint32_t kTrackCounter = 8;
+constexpr uint32_t kProcessPid = 1;
+constexpr uint32_t kProcessName = 6;
+constexpr uint32_t kThreadPid = 1;
+constexpr uint32_t kThreadTid = 2;
+constexpr uint32_t kThreadName = 5;
+constexpr uint32_t kEventDebugAnnotations = 4;
+constexpr uint32_t kEventType = 9;
+constexpr uint32_t kEventTrackUuid = 11;
+constexpr uint32_t kEventCategories = 22;
+constexpr uint32_t kEventName = 23;
+constexpr uint32_t kEventDoubleCounterValue = 44;
+constexpr uint32_t kAnnotationIntValue = 4;
+constexpr uint32_t kAnnotationStringValue = 6;
+constexpr uint32_t kAnnotationName = 10;
+constexpr uint64_t kTypeSliceBegin = 1;
+constexpr uint64_t kTypeSliceEnd = 2;
+constexpr uint64_t kTypeInstant = 3;
+constexpr uint64_t kTypeCounter = 4;
+constexpr uint32_t kSequenceId = 1;
+
+inline uint64_t ProcessUuid(int32_t pid) {
+  return (static_cast<uint64_t>(pid) + 1) << 40;
+}
+
+inline uint64_t ThreadUuid(int32_t pid, uint64_t tid) {
+  return ProcessUuid(pid) | ((tid + 1) << 20);
+}
+
+void WritePacket(std::ostream& os, const ProtoWriter& packet) {
+  ProtoWriter trace;
+  trace.Message(kTracePacket, packet);
+  os.write(trace.str().data(), trace.str().size());
+}
+
+void WriteTrackEvent(std::ostream& os, uint64_t ts, uint64_t track_uuid,
+                     uint64_t type, const TraceEvent& event, bool with_name) {
+  ProtoWriter track_event;
+  track_event.Int(kEventType, type);
+  track_event.Int(kEventTrackUuid, track_uuid);
+  if (with_name) {
+    track_event.Bytes(kEventCategories, event.category);
+    track_event.Bytes(kEventName, event.name);
+    for (const auto& arg : event.args) {
+      ProtoWriter annotation;
+      annotation.Bytes(kAnnotationName, arg.key);
+      if (arg.is_str)
+        annotation.Bytes(kAnnotationStringValue, arg.str_value);
+      else
+        annotation.Int(kAnnotationIntValue, static_cast<uint64_t>(arg.int_value));
+      track_event.Message(kEventDebugAnnotations, annotation);
+    }
+  }
+  if (type == kTypeCounter)
+    track_event.Double(kEventDoubleCounterValue, event.value);
+  ProtoWriter packet;
+  packet.Int(kPacketTimestamp, ts);
+  packet.Int(kPacketSequenceId, kSequenceId);
+  packet.Message(kPacketTrackEvent, track_event);
+  WritePacket(os, packet);
+}
+
+void WritePerfettoTrace(std::ostream& os,
+                        const std::vector<std::shared_ptr<TraceBuffer>>& buffers,
+                        const std::vector<std::string>& thread_names) {
+  std::set<int32_t> pids;
+  std::set<std::pair<int32_t, uint64_t>> tracks;
+  std::map<std::pair<int32_t, std::string>, uint64_t> counter_tracks;
+  for (const auto& buffer : buffers) {
+    buffer->ForEach([&](const TraceEvent& event) {
+      pids.insert(event.pid);
+      tracks.insert({event.pid, buffer->tid});
+      if (event.phase == TraceEventPhase::COUNTER) {
+        auto key = std::make_pair(event.pid, event.name);
+        if (counter_tracks.find(key) == counter_tracks.end())
+          counter_tracks[key] = ProcessUuid(event.pid) | (counter_tracks.size() + 1);
+      }
+    });
+  }
+  // track descriptors
+  for (auto pid : pids) {
+    ProtoWriter process;
+    process.Int(kProcessPid, pid);
+    process.Bytes(kProcessName, "rank " + std::to_string(pid));
+    ProtoWriter desc;
+    desc.Int(kTrackUuid, ProcessUuid(pid));
+    desc.Message(kTrackProcess, process);
+    ProtoWriter packet;
+    packet.Message(kPacketTrackDescriptor, desc);
+    WritePacket(os, packet);
+  }
+  for (const auto& track : tracks) {
+    const auto& name = thread_names[track.second];
+    ProtoWriter thread;
+    thread.Int(kThreadPid, track.first);
+    thread.Int(kThreadTid, track.second);
+    thread.Bytes(kThreadName, name.empty() ? "thread " + std::to_string(track.second) : name);
+    ProtoWriter desc;
+    desc.Int(kTrackUuid, ThreadUuid(track.first, track.second));
+    desc.Int(kTrackParentUuid, ProcessUuid(track.first));
+    desc.Message(kTrackThread, thread);
+    ProtoWriter packet;
+    packet.Message(kPacketTrackDescriptor, desc);
+    WritePacket(os, packet);
+  }
+  for (const auto& kv : counter_tracks) {
+    ProtoWriter desc;
+    desc.Int(kTrackUuid, kv.second);
+    desc.Int(kTrackParentUuid, ProcessUuid(kv.first.first));
+    desc.Bytes(kTrackName, kv.first.second);
+    desc.Message(kTrackCounter, ProtoWriter());
+    ProtoWriter packet;
+    packet.Message(kPacketTrackDescriptor, desc);
+    WritePacket(os, packet);
+  }
+  // events
+  for (const auto& buffer : buffers) {
+    buffer->ForEach([&](const TraceEvent& event) {
+      auto uuid = ThreadUuid(event.pid, buffer->tid);
+      switch (event.phase) {
+        case TraceEventPhase::COMPLETE:
+          WriteTrackEvent(os, event.begin_ns, uuid, kTypeSliceBegin, event, true);
+          WriteTrackEvent(os, event.begin_ns + event.dur_ns, uuid, kTypeSliceEnd, event, false);
+          break;
+        case TraceEventPhase::INSTANT:
+          WriteTrackEvent(os, event.begin_ns, uuid, kTypeInstant, event, true);
+          break;
+        case TraceEventPhase::COUNTER:
+          WriteTrackEvent(os, event.begin_ns,
+                          counter_tracks[{event.pid, event.name}],
+                          kTypeCounter, event, false);
+          break;
+      }
+    });
+  }
+}
+
+// HYDRAULIS_TRACE_FILE
+struct TraceEnvInitializer {
+  TraceEnvInitializer() {
+    const char* env = std::getenv("HYDRAULIS_TRACE_FILE");
+    if (env == nullptr || std::string(env).empty())
+      return;
+    static std::string trace_file(env);
+    Tracer::Start();
+    auto status = std::atexit([]() {
+      Tracer::Stop();
+      try {
+        Tracer::Export(ReplaceRank(trace_file, Tracer::GetProcessRank()));
+      } catch (const std::exception& e) {
+        HT_LOG_WARN << "Failed to export trace: " << e.what();
+      }
+    });
+    HT_ASSERT(status == 0)
+      << "Failed to register the exit function for tracer.";
+  }
+};
+
+TraceEnvInitializer trace_env_initializer;
+
+} // namespace
+
+void Tracer::Start() {
+  _enabled.store(true);
+}
+
+void Tracer::Stop() {
+  _enabled.store(false);
+}
+
+void Tracer::Clear() {
+  HT_VALUE_ERROR_IF(enabled())
+    << "Cannot clear the trace events while tracing";
+  std::lock_guard<std::mutex> export_lock(export_mutex());
+  // 推进epoch之后，各个buffer中的事件都不再导出，由owner在下一次追加时换上新的chunk
+  auto cur_epoch = _epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  for (auto& buffer : registry()) {
+    buffer->FreeRetired();
+    // 只有registry持有的buffer的owner线程已经退出，直接清空
+    if (buffer.use_count() == 1)
+      buffer->Reset(cur_epoch);
+  }
+}
+
+void Tracer::Export(const std::string& path) {
+  std::lock_guard<std::mutex> export_lock(export_mutex());
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+  std::vector<std::string> thread_names;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    buffers = registry();
+    for (const auto& buffer : buffers)
+      thread_names.push_back(buffer->thread_name);
+  }
+  std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  HT_RUNTIME_ERROR_IF(!file.is_open())
+    << "Failed to open trace file " << path;
+  if (EndsWith(path, ".pb") || EndsWith(path, ".perfetto-trace"))
+    WritePerfettoTrace(file, buffers, thread_names);
+  else
+    WriteChromeTrace(file, buffers, thread_names);
+  HT_RUNTIME_ERROR_IF(!file.good())
+    << "Failed to write trace file " << path;
+  HT_LOG_INFO << "Exported trace events to " << path;
+}
+
+void Tracer::SetProcessRank(int rank) {
+  _process_rank.store(rank, std::memory_order_relaxed);
+}
+
+void Tracer::SetThreadName(const std::string& name) {
+  auto& buffer = GetThreadBuffer();
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  buffer.thread_name = name;
+}
+
+uint64_t Tracer::NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::Record(TraceEvent&& event, uint64_t epoch) {
+  // span开始之后tracing可能已经被关闭
+  if (!enabled())
+    return;
+  auto rank = comm::ThreadedWorld::CurrentRank();
+  event.pid = rank >= 0 ? rank : GetProcessRank();
+  GetThreadBuffer().Append(std::move(event), epoch);
+}
+
+void Tracer::Instant(const char* category, std::string name) {
+  if (!enabled())
+    return;
+  TraceEvent event;
+  event.category = category;
+  event.name = std::move(name);
+  event.phase = TraceEventPhase::INSTANT;
+  event.begin_ns = NowNs();
+  Record(std::move(event));
+}
+
+void Tracer::Counter(const char* category, std::string name, double value) {
+  if (!enabled())
+    return;
+  TraceEvent event;
+  event.category = category;
+  event.name = std::move(name);
+  event.phase = TraceEventPhase::COUNTER;
+  event.begin_ns = NowNs();
+  event.value = value;
+  Record(std::move(event));
+}
+
+} // namespace impl
+} // namespace hydraulis
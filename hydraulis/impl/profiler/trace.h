@@ -0,0 +1,171 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hydraulis {
+namespace impl {
+
+/******************************************************
+ * Structured tracing
+ *
+ * 每个线程向自己的event buffer中追加事件（只有owner线程写入，不需要加锁），
+ * 导出时按照rank（pid）与线程（tid）分成不同的track，
+ * 支持导出chrome trace json以及perfetto protobuf（均可在ui.perfetto.dev中打开）。
+ * 未开启时每个埋点只有一次relaxed的原子读。
+ *
+ * 环境变量HYDRAULIS_TRACE_FILE不为空时在启动时开启tracing并在退出时导出，
+ * 文件名中的{rank}会被替换为当前进程的rank。
+ *
+ * straggler、memory、switch与parallel attn的分析结果同样作为counter写入trace；
+ * 对应的HYDRAULIS_*_LOG_FILE仍然保留，elastic的straggler检测与trainer会解析这些文件。
+ ******************************************************/
+
+enum class TraceEventPhase : char {
+  COMPLETE = 'X',
+  INSTANT = 'i',
+  COUNTER = 'C',
+};
+
+struct TraceArg {
+  std::string key;
+  std::string str_value;
+  int64_t int_value{0};
+  bool is_str{false};
+};
+
+struct TraceEvent {
+  std::string name;
+  const char* category{""};
+  TraceEventPhase phase{TraceEventPhase::COMPLETE};
+  int32_t pid{0};
+  uint64_t begin_ns{0};
+  uint64_t dur_ns{0};
+  double value{0}; // 仅用于COUNTER
+  std::vector<TraceArg> args;
+};
+
+class Tracer {
+ public:
+  static inline bool enabled() {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+
+  static void Start();
+
+  static void Stop();
+
+  // 清空所有线程已记录的事件，需要在Stop之后调用
+  static void Clear();
+
+  // 导出目前为止记录的所有事件
+  // 后缀为.pb或.perfetto-trace时导出perfetto protobuf，否则导出chrome trace json
+  static void Export(const std::string& path);
+
+  // 不在threaded world中的线程的事件使用该rank作为pid
+  static void SetProcessRank(int rank);
+
+  static int GetProcessRank() {
+    return _process_rank.load(std::memory_order_relaxed);
+  }
+
+  // 设置当前线程对应的track的名字
+  static void SetThreadName(const std::string& name);
+
+  static uint64_t NowNs();
+
+  // Clear时加一，之前开始的span在Clear之后结束时不会再被记录
+  static uint64_t epoch() {
+    return _epoch.load(std::memory_order_acquire);
+  }
+
+  static void Record(TraceEvent&& event) {
+    Record(std::move(event), epoch());
+  }
+
+  // epoch为事件开始时的epoch
+  static void Record(TraceEvent&& event, uint64_t epoch);
+
+  static void Instant(const char* category, std::string name);
+
+  static void Counter(const char* category, std::string name, double value);
+
+ protected:
+  static std::atomic<bool> _enabled;
+  static std::atomic<int> _process_rank;
+  static std::atomic<uint64_t> _epoch;
+};
+
+// RAII的span，Begin之后在析构时记录一个COMPLETE事件
+class TraceSpan {
+ public:
+  TraceSpan() = default;
+
+  TraceSpan(const char* category, std::string name) {
+    Begin(category, std::move(name));
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  ~TraceSpan() {
+    End();
+  }
+
+  void Begin(const char* category, std::string name) {
+    _active = true;
+    _epoch = Tracer::epoch();
+    _event.category = category;
+    _event.name = std::move(name);
+    _event.begin_ns = Tracer::NowNs();
+  }
+
+  void AddArg(std::string key, int64_t value) {
+    if (!_active)
+      return;
+    TraceArg arg;
+    arg.key = std::move(key);
+    arg.int_value = value;
+    _event.args.push_back(std::move(arg));
+  }
+
+  void AddArg(std::string key, std::string value) {
+    if (!_active)
+      return;
+    TraceArg arg;
+    arg.key = std::move(key);
+    arg.str_value = std::move(value);
+    arg.is_str = true;
+    _event.args.push_back(std::move(arg));
+  }
+
+  void End() {
+    if (!_active)
+      return;
+    _active = false;
+    _event.dur_ns = Tracer::NowNs() - _event.begin_ns;
+    Tracer::Record(std::move(_event), _epoch);
+  }
+
+  bool active() const {
+    return _active;
+  }
+
+ private:
+  bool _active{false};
+  uint64_t _epoch{0};
+  TraceEvent _event;
+};
+
+} // namespace impl
+} // namespace hydraulis
+
+// 未开启tracing时category与name均不会被求值
+#define HT_TRACE_SPAN(var, category, name)                                     \
+  hydraulis::impl::TraceSpan var = hydraulis::impl::Tracer::enabled()          \
+    ? hydraulis::impl::TraceSpan((category), (name))                           \
+    : hydraulis::impl::TraceSpan()
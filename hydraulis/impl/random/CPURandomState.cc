@@ -1,4 +1,5 @@
 #include "hydraulis/impl/random/CPURandomState.h"
+#include "hydraulis/common/deterministic.h"
 #include <mutex>
 
 namespace hydraulis {
@@ -18,6 +19,12 @@ void SetCPURandomSeed(uint64_t seed) {
 }
 
 uint64_t GenNextRandomSeed() {
+  if (cpu_random_seed == 0 && IsDeterministic()) {
+    // 确定性模式下未设置种子时使用固定的种子
+    std::lock_guard<std::mutex> lock(cpu_random_state_mutex);
+    if (cpu_random_seed == 0)
+      SetCPURandomSeed(DeterministicSeed());
+  }
   if (cpu_random_seed != 0) {
     // Generate random seed from the seeded engine
     std::lock_guard<std::mutex> lock(cpu_random_state_mutex);
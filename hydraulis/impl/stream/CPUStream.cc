@@ -1,4 +1,6 @@
 #include "hydraulis/impl/stream/CPUStream.h"
+#include "hydraulis/impl/communication/threaded_world.h"
+#include "hydraulis/impl/profiler/trace.h"
 #include "hydraulis/utils/task_queue.h"
 #include <mutex>
 
@@ -7,27 +9,46 @@ namespace impl {
 
 namespace {
 
+// Owner 0 is the process itself, and owner (r + 1) is rank r
+// of the threaded world, which has its own set of streams.
+constexpr int HT_NUM_CPU_STREAM_OWNERS = HT_MAX_DEVICE_MULTIPLEX + 1;
+
 static std::once_flag
-  cpu_stream_task_queue_init_flags[HT_NUM_STREAMS_PER_DEVICE];
+  cpu_stream_task_queue_init_flags[HT_NUM_CPU_STREAM_OWNERS]
+                                  [HT_NUM_STREAMS_PER_DEVICE];
 static std::vector<std::unique_ptr<TaskQueue>>
-  cpu_stream_task_queues(HT_NUM_STREAMS_PER_DEVICE);
+  cpu_stream_task_queues(HT_NUM_CPU_STREAM_OWNERS * HT_NUM_STREAMS_PER_DEVICE);
+
+inline int GetCPUStreamOwner() {
+  return comm::ThreadedWorld::CurrentRank() + 1;
+}
+
+inline std::unique_ptr<TaskQueue>& GetTaskQueue(int owner,
+                                                StreamIndex stream_index) {
+  return cpu_stream_task_queues[owner * HT_NUM_STREAMS_PER_DEVICE +
+                                stream_index];
+}
 
-static void InitTaskQueueForCPUStream(StreamIndex stream_index) {
-  HT_ASSERT(cpu_stream_task_queues[stream_index] == nullptr)
+static void InitTaskQueueForCPUStream(int owner, StreamIndex stream_index) {
+  HT_ASSERT(GetTaskQueue(owner, stream_index) == nullptr)
     << "CPUStream task queues must be initialized by calling "
     << "InitTaskQueueForCPUStreamOnce";
-  cpu_stream_task_queues[stream_index].reset(
-    new TaskQueue("CPUStream(" + std::to_string(stream_index) + ")", 1));
+  std::string name = owner == 0
+    ? "CPUStream(" + std::to_string(stream_index) + ")"
+    : "CPUStream(rank=" + std::to_string(owner - 1) + ", " +
+      std::to_string(stream_index) + ")";
+  GetTaskQueue(owner, stream_index).reset(new TaskQueue(name, 1));
 }
 
-static void InitTaskQueueForCPUStreamOnce(StreamIndex stream_index) {
-  std::call_once(cpu_stream_task_queue_init_flags[stream_index],
-                 InitTaskQueueForCPUStream, stream_index);
+static void InitTaskQueueForCPUStreamOnce(int owner, StreamIndex stream_index) {
+  std::call_once(cpu_stream_task_queue_init_flags[owner][stream_index],
+                 InitTaskQueueForCPUStream, owner, stream_index);
 }
 
 } // namespace
 
-CPUStream::CPUStream(const Stream& stream) : _stream_id{stream.stream_index()} {
+CPUStream::CPUStream(const Stream& stream)
+: _stream_id{stream.stream_index()}, _owner{GetCPUStreamOwner()} {
   HT_ASSERT(stream.device().is_cpu())
     << "Initializing CPU stream "
     << "for non-host device: " << stream.device();
@@ -42,15 +63,38 @@ std::future<void> CPUStream::EnqueueTask(std::function<void()> f,
     f();
     return std::future<void>();
   } else {
-    InitTaskQueueForCPUStreamOnce(_stream_id);
-    return cpu_stream_task_queues[_stream_id]->Enqueue(f, name);
+    InitTaskQueueForCPUStreamOnce(_owner, _stream_id);
+    if (Tracer::enabled()) {
+      // 在worker线程上记录task的执行区间
+      StreamIndex stream_id = _stream_id;
+      f = [f, name, stream_id]() {
+        static thread_local bool named = false;
+        if (!named) {
+          Tracer::SetThreadName("cpu stream " + std::to_string(stream_id));
+          named = true;
+        }
+        HT_TRACE_SPAN(task_span, "cpu_stream", name.empty() ? std::string("task") : name);
+        task_span.AddArg("stream", stream_id);
+        f();
+      };
+    }
+    if (_owner > 0) {
+      // Tasks act on behalf of the rank that enqueues them.
+      int rank = _owner - 1;
+      return GetTaskQueue(_owner, _stream_id)->Enqueue(
+        [f, rank]() {
+          comm::ThreadedRankGuard guard(rank);
+          f();
+        }, name);
+    }
+    return GetTaskQueue(_owner, _stream_id)->Enqueue(f, name);
   }
 }
 
 void CPUStream::Sync() {
   if (_stream_id == kBlockingStream ||
-      cpu_stream_task_queues[_stream_id] == nullptr ||
-      !cpu_stream_task_queues[_stream_id]->running())
+      GetTaskQueue(_owner, _stream_id) == nullptr ||
+      !GetTaskQueue(_owner, _stream_id)->running())
     return;
   // Walkaround: Instead of blocking the task queues,
   // we create an event for simplicity.
@@ -60,7 +104,7 @@ void CPUStream::Sync() {
 }
 
 void SynchronizeAllCPUStreams() {
-  for (size_t i = 0; i < cpu_stream_task_queues.size(); i++)
+  for (size_t i = 0; i < HT_NUM_STREAMS_PER_DEVICE; i++)
     CPUStream(Stream(kCPU, i)).Sync();
 }
 
@@ -24,6 +24,8 @@ class CPUStream final {
 
  private:
   const StreamIndex _stream_id;
+  // Streams are private to each rank of the threaded world (if any).
+  const int _owner;
 };
 
 inline CPUStream GetCPUStream(StreamIndex stream_id) {
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include <cmath>
+#include <vector>
+
+namespace hydraulis {
+namespace impl {
+
+enum class FusedType : int8_t {
+  ADD = 0,
+  SUB,
+  MUL,
+  DIV,
+  ADDCONST,
+  SUBCONST,
+  SUBFROMCONST,
+  MULCONST,
+  DIVCONST,
+  DIVFROMCONST,
+  NEGATE,
+  RECIPROCAL,
+  EXP,
+  LOG,
+  SQRT,
+  RSQRT,
+  ABS,
+  RELU,
+  SIGMOID,
+  TANH,
+  GELU,
+  SILU,
+  UNKNOWN
+};
+
+inline bool IsBinaryFusedType(FusedType type) {
+  return type == FusedType::ADD || type == FusedType::SUB ||
+         type == FusedType::MUL || type == FusedType::DIV;
+}
+
+// 一条指令：dst = type(src0, src1, value)
+// src与dst均为寄存器编号，前num_inputs个寄存器为fused group的输入
+struct FusedInstr {
+  FusedType type;
+  int32_t src0;
+  int32_t src1{-1};
+  double value{0};
+  int32_t dst;
+
+  bool operator==(const FusedInstr& rhs) const {
+    return type == rhs.type && src0 == rhs.src0 && src1 == rhs.src1 &&
+           value == rhs.value && dst == rhs.dst;
+  }
+};
+
+// 一串elementwise算子组成的表达式
+// 所有寄存器的shape均为输出的shape，输入按照broadcast的规则读取
+struct FusedProgram {
+  int32_t num_inputs{0};
+  int32_t num_registers{0};
+  std::vector<FusedInstr> instrs;
+  std::vector<int32_t> output_registers;
+
+  bool operator==(const FusedProgram& rhs) const {
+    return num_inputs == rhs.num_inputs && num_registers == rhs.num_registers &&
+           instrs == rhs.instrs && output_registers == rhs.output_registers;
+  }
+};
+
+// 标量的计算
+template <typename acc_t>
+inline acc_t fused_apply(FusedType type, acc_t a, acc_t b, acc_t value) {
+  switch (type) {
+    case FusedType::ADD: return a + b;
+    case FusedType::SUB: return a - b;
+    case FusedType::MUL: return a * b;
+    case FusedType::DIV: return a / b;
+    case FusedType::ADDCONST: return a + value;
+    case FusedType::SUBCONST: return a - value;
+    case FusedType::SUBFROMCONST: return value - a;
+    case FusedType::MULCONST: return a * value;
+    case FusedType::DIVCONST: return a / value;
+    case FusedType::DIVFROMCONST: return value / a;
+    case FusedType::NEGATE: return -a;
+    case FusedType::RECIPROCAL: return acc_t(1) / a;
+    case FusedType::EXP: return std::exp(a);
+    case FusedType::LOG: return std::log(a);
+    case FusedType::SQRT: return std::sqrt(a);
+    case FusedType::RSQRT: return acc_t(1) / std::sqrt(a);
+    case FusedType::ABS: return std::abs(a);
+    case FusedType::RELU: return a > acc_t(0) ? a : acc_t(0);
+    case FusedType::SIGMOID: return acc_t(1) / (acc_t(1) + std::exp(-a));
+    case FusedType::TANH: return std::tanh(a);
+    case FusedType::GELU: return a * acc_t(0.5) * (acc_t(1) + std::erf(a * acc_t(0.70710678118654757274)));
+    case FusedType::SILU: return a / (acc_t(1) + std::exp(-a));
+    default: return a;
+  }
+}
+
+} // namespace impl
+} // namespace hydraulis
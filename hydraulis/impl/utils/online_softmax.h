@@ -0,0 +1,68 @@
+#pragma once
+
+#include "hydraulis/impl/utils/reduce_utils.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace hydraulis {
+namespace cpu {
+
+/******************************************************
+ * 按行的online max/sum-exp
+ *
+ * 每次处理一块相邻的元素：先求块内最大值，若超过当前最大值，则把已经累加的和
+ * 按新的最大值缩放，再累加块内的exp。块在L1中，因此整行只需要从内存中读一遍，
+ * 不再需要先求max再求sum的两遍扫描，对128k的词表尤其明显。
+ ******************************************************/
+template <typename spec_t, typename acc_t = reduce_acc_t<spec_t>>
+inline void online_max_sum_exp(const spec_t* row, int64_t n_cols,
+                               acc_t& row_max, acc_t& row_sum) {
+  constexpr int64_t kBlock = 512;
+  row_max = -std::numeric_limits<acc_t>::infinity();
+  row_sum = acc_t(0);
+  for (int64_t begin = 0; begin < n_cols; begin += kBlock) {
+    int64_t end = std::min(begin + kBlock, n_cols);
+    acc_t block_max = -std::numeric_limits<acc_t>::infinity();
+    for (int64_t j = begin; j < end; j++)
+      block_max = std::max(block_max, static_cast<acc_t>(row[j]));
+    if (block_max > row_max) {
+      row_sum *= std::exp(row_max - block_max);
+      row_max = block_max;
+    }
+    acc_t block_sum = acc_t(0);
+    for (int64_t j = begin; j < end; j++)
+      block_sum += std::exp(static_cast<acc_t>(row[j]) - row_max);
+    row_sum += block_sum;
+  }
+}
+
+// 合并两段的(max, sum-exp)，结果与两段拼接后一起计算的相同
+template <typename acc_t>
+inline void merge_max_sum_exp(acc_t& row_max, acc_t& row_sum,
+                              acc_t other_max, acc_t other_sum) {
+  if (other_max > row_max) {
+    row_sum = row_sum * std::exp(row_max - other_max) + other_sum;
+    row_max = other_max;
+  } else {
+    row_sum += other_sum * std::exp(other_max - row_max);
+  }
+}
+
+// 交叉熵对一行logits的梯度：(softmax - onehot(label)) * scale，其中softmax = exp(x - lse)。
+// label不在[0, n_cols)内时（例如属于其他TP rank的词表）没有onehot项。
+// out可以与row相同，即梯度原地写在logits上。
+template <typename spec_t, typename acc_t = reduce_acc_t<spec_t>>
+inline void cross_entropy_row_gradient(const spec_t* row, int64_t n_cols, int64_t label,
+                                       acc_t log_sum_exp, acc_t scale, spec_t* out) {
+  bool has_label = label >= 0 && label < n_cols;
+  // 原地写入时row[label]会被覆盖，需要先读出来
+  acc_t label_prob = has_label ? std::exp(static_cast<acc_t>(row[label]) - log_sum_exp) : acc_t(0);
+  for (int64_t j = 0; j < n_cols; j++)
+    out[j] = static_cast<spec_t>(std::exp(static_cast<acc_t>(row[j]) - log_sum_exp) * scale);
+  if (has_label)
+    out[label] = static_cast<spec_t>((label_prob - acc_t(1)) * scale);
+}
+
+} // namespace cpu
+} // namespace hydraulis
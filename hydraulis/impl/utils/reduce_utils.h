@@ -0,0 +1,98 @@
+#pragma once
+
+#include "hydraulis/common/macros.h"
+#include "hydraulis/core/ndarray_meta.h"
+#include "hydraulis/impl/utils/omp_utils.h"
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+namespace hydraulis {
+namespace cpu {
+
+// 归约时的累加类型：浮点（包括半精度）用float，double用double，整数用int64_t
+template <typename spec_t>
+using reduce_acc_t = typename std::conditional<
+  std::is_same<spec_t, double>::value, double,
+  typename std::conditional<std::is_integral<spec_t>::value, int64_t, float>::type>::type;
+
+/******************************************************
+ * 按固定顺序的归约
+ *
+ * dst的shape与src相同，只是被归约的维度为1。每个输出元素都由同一个线程按照
+ * 被归约元素的下标从小到大依次累加，结果与线程数以及调度无关（确定性模式下
+ * 代替dnnl的reduction）。
+ * 最内层维度被保留时，每次处理一组相邻的输出元素，使得按列归约时的访存仍然连续。
+ ******************************************************/
+template <typename spec_t>
+void fixed_order_reduce(const spec_t* src, const HTShape& src_shape, const HTStride& src_stride,
+                        spec_t* dst, const HTShape& dst_shape, const HTStride& dst_stride,
+                        bool mean) {
+  using acc_t = reduce_acc_t<spec_t>;
+  constexpr int64_t kMaxBlock = 64;
+  int ndim = src_shape.size();
+  HT_ASSERT(dst_shape.size() == src_shape.size())
+    << "The reduced shape " << dst_shape << " should have the same ndim as " << src_shape;
+  std::vector<int> kept_dims, reduced_dims;
+  int64_t num_outputs = 1, num_reduced = 1;
+  for (int d = 0; d < ndim; d++) {
+    if (dst_shape[d] == src_shape[d]) {
+      kept_dims.push_back(d);
+      num_outputs *= src_shape[d];
+    } else {
+      HT_ASSERT(dst_shape[d] == 1)
+        << "Cannot reduce " << src_shape << " to " << dst_shape;
+      reduced_dims.push_back(d);
+      num_reduced *= src_shape[d];
+    }
+  }
+  if (num_outputs == 0)
+    return;
+  // 被归约元素相对于输出元素起点的偏移，按照下标从小到大排列
+  std::vector<int64_t> reduced_offsets(num_reduced, 0);
+  for (int64_t r = 0; r < num_reduced; r++) {
+    int64_t rem = r;
+    for (int k = reduced_dims.size() - 1; k >= 0; k--) {
+      int d = reduced_dims[k];
+      reduced_offsets[r] += (rem % src_shape[d]) * src_stride[d];
+      rem /= src_shape[d];
+    }
+  }
+  bool inner_kept = !kept_dims.empty() && kept_dims.back() == ndim - 1 && src_stride[ndim - 1] == 1;
+  int64_t block = inner_kept ? std::min(kMaxBlock, num_outputs) : 1;
+  int64_t num_blocks = (num_outputs + block - 1) / block;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int64_t b = 0; b < num_blocks; b++) {
+    int64_t begin = b * block;
+    int64_t end = std::min(begin + block, num_outputs);
+    int64_t src_base[kMaxBlock], dst_offset[kMaxBlock];
+    acc_t acc[kMaxBlock];
+    for (int64_t o = begin; o < end; o++) {
+      int64_t rem = o, src_off = 0, dst_off = 0;
+      for (int k = kept_dims.size() - 1; k >= 0; k--) {
+        int d = kept_dims[k];
+        int64_t idx = rem % src_shape[d];
+        rem /= src_shape[d];
+        src_off += idx * src_stride[d];
+        dst_off += idx * dst_stride[d];
+      }
+      src_base[o - begin] = src_off;
+      dst_offset[o - begin] = dst_off;
+      acc[o - begin] = acc_t(0);
+    }
+    for (int64_t r = 0; r < num_reduced; r++) {
+      int64_t offset = reduced_offsets[r];
+      for (int64_t j = 0; j < end - begin; j++)
+        acc[j] += static_cast<acc_t>(src[src_base[j] + offset]);
+    }
+    for (int64_t j = 0; j < end - begin; j++) {
+      acc_t value = mean && num_reduced > 0 ? acc[j] / static_cast<acc_t>(num_reduced) : acc[j];
+      dst[dst_offset[j]] = static_cast<spec_t>(value);
+    }
+  }
+}
+
+} // namespace cpu
+} // namespace hydraulis
@@ -88,6 +88,10 @@ class ContextStore {
     _ctx_ndarray.insert({key, value});
   }
 
+  bool contains_ndarray(const std::string& key) const {
+    return _ctx_ndarray.find(key) != _ctx_ndarray.end();
+  }
+
   const NDArray& get_ndarray(const std::string& key) const {
     auto it = _ctx_ndarray.find(key);
     HT_ASSERT(it != _ctx_ndarray.end()) << "NDArray " << key << " not found";
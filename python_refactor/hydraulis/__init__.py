@@ -259,6 +259,51 @@ def profiler(enabled : bool = True, use_cpu : bool = False, use_cuda : bool = Fa
              record_shapes : bool = False , profile_memory : bool = False):
     return _ProfileContex(enabled, use_cpu, use_cuda, record_shapes, profile_memory)
 
+class _TraceContext(object):
+    def __init__(self, path : str = None, clear : bool = True):
+        self.path = path
+        self.clear = clear
+
+    def __enter__(self):
+        if self.clear:
+            _hydraulis_core._internal_context.clear_trace()
+        _hydraulis_core._internal_context.start_trace()
+        return self
+
+    def __exit__(self, e_type, e_value, e_trace):
+        _hydraulis_core._internal_context.stop_trace()
+        if self.path is not None:
+            self.export(self.path)
+
+    def export(self, path : str):
+        # .json for chrome trace, .pb/.perfetto-trace for perfetto protobuf
+        _hydraulis_core._internal_context.export_trace(path)
+
+def trace(path : str = None, clear : bool = True):
+    return _TraceContext(path, clear)
+
+class HostOverheadStats(object):
+    """Per-step host overhead of the executor phases, e.g., plan matching,
+    shape plan deduction, instantiation, switch setup, op dispatch and post run.
+    Rank -1 refers to the current process, otherwise a rank of the threaded world."""
+    def __init__(self, rank : int = -1):
+        self.rank = rank
+
+    def stats(self):
+        return _hydraulis_core._internal_context.get_host_overhead_stats(self.rank)
+
+    def summary(self):
+        return _hydraulis_core._internal_context.host_overhead_summary(self.rank)
+
+    def reset(self):
+        _hydraulis_core._internal_context.reset_host_overhead_stats(self.rank)
+
+    def __repr__(self):
+        return self.summary()
+
+def host_overhead_stats(rank : int = -1):
+    return HostOverheadStats(rank)
+
 class _SubGraphContext(object):
     def __init__(self, name = "global", module_type = ""):
         if name is None:
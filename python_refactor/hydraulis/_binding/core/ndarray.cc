@@ -5,6 +5,7 @@
 #include "hydraulis/_binding/utils/except.h"
 #include "hydraulis/_binding/utils/decl_utils.h"
 #include "hydraulis/_binding/utils/arg_parser.h"
+#include "hydraulis/_binding/utils/dlpack.h"
 #include "hydraulis/graph/ops/kernel_links.h"
 
 namespace hydraulis {
@@ -28,7 +29,7 @@ NDArray NDArrayCopyFromNDArrayCtor(const NDArray& ndarray,
 
 NDArray NDArrayCopyFromNumpyCtor(PyObject* obj, optional<DataType>&& dtype,
                                  optional<Device>&& device) {
-  return NDArrayCopyFromNDArrayCtor(NDArrayFromNumpy(obj), std::move(dtype),
+  return NDArrayCopyFromNDArrayCtor(NDArrayFromNumpy(obj, {}, kUndeterminedDataType, true), std::move(dtype),
                                     std::move(device));
 }
 
@@ -182,17 +183,17 @@ PyObject* PyNDArray_from_numpy(PyObject*, PyObject* args, PyObject* kwargs) {
   if (parsed_args.signature_index() == 0) {
     auto* array_obj = parsed_args.get_numpy_array(0);
     new(&self->ndarray) NDArray();
-    self->ndarray = NDArrayFromNumpy(array_obj);
+    self->ndarray = NDArrayFromNumpy(array_obj, {}, kUndeterminedDataType, true);
   } else if (parsed_args.signature_index() == 1) {
     auto* array_obj1 = parsed_args.get_numpy_array(0);
     HTShape dynamic_shape = parsed_args.get_int64_list(1);
     new(&self->ndarray) NDArray();
-    self->ndarray = NDArrayFromNumpy(array_obj1, dynamic_shape);
+    self->ndarray = NDArrayFromNumpy(array_obj1, dynamic_shape, kUndeterminedDataType, true);
   } else if (parsed_args.signature_index() == 2) {
     auto* array_obj1 = parsed_args.get_numpy_array(0);
     DataType dtype = parsed_args.get_dtype(1);
     new(&self->ndarray) NDArray();
-    self->ndarray = NDArrayFromNumpy(array_obj1, {}, dtype);
+    self->ndarray = NDArrayFromNumpy(array_obj1, {}, dtype, true);
   } else {
     Py_TYPE(self)->tp_free(self);
     HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
@@ -209,13 +210,14 @@ PyObject* PyNDArray_to_numpy(PyNDArray* self, PyObject* args,
   HT_VALUE_ERROR_IF(!self->ndarray.is_defined()) 
     << "NDArray is not defined";
   static PyArgParser parser({
-    "numpy(bool force=false, bool save=false)"
+    "numpy(bool force=false, bool save=false, bool non_blocking=false)"
   });
   auto parsed_args = parser.parse(args, kwargs);
   if (parsed_args.signature_index() == 0) {
     bool force = parsed_args.get_bool_or_default(0);
     bool save = parsed_args.get_bool_or_default(1);
-    return NDArrayToNumpy(self->ndarray, force, save);
+    bool non_blocking = parsed_args.get_bool_or_default(2);
+    return NDArrayToNumpy(self->ndarray, force, save, non_blocking);
   } else {
     HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
     __builtin_unreachable();
@@ -223,6 +225,40 @@ PyObject* PyNDArray_to_numpy(PyNDArray* self, PyObject* args,
   HT_PY_FUNC_END
 }
 
+PyObject* PyNDArray_from_dlpack(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "from_dlpack(py_obj data)",
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    return PyNDArray_New(NDArrayFromDLPack(parsed_args.get_py_obj(0)));
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+PyObject* PyNDArray_dlpack(PyNDArray* self, PyObject* args, 
+                           PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  HT_VALUE_ERROR_IF(!self->ndarray.is_defined()) 
+    << "NDArray is not defined";
+  // Only host arrays are exported, so the keyword arguments of 
+  // the DLPack protocol (`stream`, `max_version`, etc.) are ignored.
+  return NDArrayToDLPack(self->ndarray);
+  HT_PY_FUNC_END
+}
+
+PyObject* PyNDArray_dlpack_device(PyNDArray* self) {
+  HT_PY_FUNC_BEGIN
+  HT_VALUE_ERROR_IF(!self->ndarray->is_cpu())
+    << "Only host NDArrays support DLPack, got " << self->ndarray->device();
+  return Py_BuildValue("(ii)", static_cast<int>(kDLCPU), 0);
+  HT_PY_FUNC_END
+}
+
 PyObject* PyNDArray_to(PyNDArray* self, PyObject* args, PyObject* kwargs) {
   HT_PY_FUNC_BEGIN
   static PyArgParser parser({
@@ -398,6 +434,8 @@ std::vector<PyMethodDef> InitNDArrayPyMethodDefs() {
   AddPyMethodDefs(ret, {
     {"numpy", (PyCFunction) PyNDArray_to_numpy, METH_VARARGS | METH_KEYWORDS, nullptr }, 
     {"numel", (PyCFunction) PyNDArray_numel, METH_NOARGS, nullptr }, 
+    {"__dlpack__", (PyCFunction) PyNDArray_dlpack, METH_VARARGS | METH_KEYWORDS, nullptr }, 
+    {"__dlpack_device__", (PyCFunction) PyNDArray_dlpack_device, METH_NOARGS, nullptr }, 
     {"to", (PyCFunction) PyNDArray_to, METH_VARARGS | METH_KEYWORDS, nullptr }, 
     {"slice", (PyCFunction) PyNDArray_slice, METH_VARARGS | METH_KEYWORDS, nullptr }, 
     {"copy", (PyCFunction) PyNDArray_copy, METH_NOARGS, nullptr }, 
@@ -414,6 +452,7 @@ std::vector<PyMethodDef> InitNDArrayPyClassMethodDefs() {
   AddPyMethodDefs(ret, {
     // TODO: wrap from_numpy of NDArray in a capsule
     {"numpy_to_NDArray", (PyCFunction) PyNDArray_from_numpy, METH_VARARGS | METH_KEYWORDS, nullptr }, 
+    {"from_dlpack", (PyCFunction) PyNDArray_from_dlpack, METH_VARARGS | METH_KEYWORDS, nullptr }, 
     {nullptr}
   });
   AddPyMethodDefs(ret, hydraulis::impl::get_registered_ndarray_class_methods());
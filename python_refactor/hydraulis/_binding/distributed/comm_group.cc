@@ -3,6 +3,7 @@
 #include "hydraulis/_binding/utils/arg_parser.h"
 #include "hydraulis/_binding/utils/decl_utils.h"
 #include "hydraulis/_binding/utils/function_registry.h"
+#include "hydraulis/impl/communication/rpc_server.h"
 
 namespace hydraulis {
 
@@ -77,11 +78,61 @@ PyObject* CommGroup_GlobalCommBarrier(PyObject*, PyObject* args, PyObject* kwarg
   HT_PY_FUNC_BEGIN
   std::vector<int> all_ranks(hydraulis::impl::comm::GetWorldSize());
   std::iota(all_ranks.begin(), all_ranks.end(), 0);
-  hydraulis::impl::comm::GetLocalClient()->Barrier(0, all_ranks);
+  hydraulis::impl::comm::RPCBarrier(all_ranks);
   Py_RETURN_NONE;
   HT_PY_FUNC_END
 }
 
+// 阻塞直到所有rank退出，通常在单独的进程中调用
+PyObject* CommGroup_LaunchRPCServer(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({"launch_rpc_server(std::string address=\"0.0.0.0:23457\", int heartbeat_timeout=10)"});
+  auto parsed_args = parser.parse(args, kwargs);
+  std::string address = parsed_args.get_string_or_default(0);
+  int64_t heartbeat_timeout = parsed_args.get_int64_or_default(1);
+  {
+    py::gil_scoped_release release;
+    hydraulis::RunDeviceControllerServer(address, heartbeat_timeout);
+  }
+  Py_RETURN_NONE;
+  HT_PY_FUNC_END
+}
+
+PyObject* CommGroup_BenchmarkRPCStartup(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({"benchmark_rpc_startup(std::string server_address, int num_ranks, bool batched=true, int tp_size=8)"});
+  auto parsed_args = parser.parse(args, kwargs);
+  std::string server_address = parsed_args.get_string(0);
+  int num_ranks = parsed_args.get_int64(1);
+  bool batched = parsed_args.get_bool_or_default(2);
+  int tp_size = parsed_args.get_int64_or_default(3);
+  double elapsed_ms;
+  {
+    py::gil_scoped_release release;
+    elapsed_ms = hydraulis::BenchmarkRPCStartup(server_address, num_ranks, batched, tp_size);
+  }
+  return PyFloat_FromDouble(elapsed_ms);
+  HT_PY_FUNC_END
+}
+
+PyObject* CommGroup_BenchmarkRPCBarrier(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({"benchmark_rpc_barrier(std::string server_address, int num_ranks, int ranks_per_host=8, int arity=0, int num_iters=20)"});
+  auto parsed_args = parser.parse(args, kwargs);
+  std::string server_address = parsed_args.get_string(0);
+  int num_ranks = parsed_args.get_int64(1);
+  int ranks_per_host = parsed_args.get_int64_or_default(2);
+  int arity = parsed_args.get_int64_or_default(3);
+  int num_iters = parsed_args.get_int64_or_default(4);
+  double latency_ms;
+  {
+    py::gil_scoped_release release;
+    latency_ms = hydraulis::BenchmarkRPCBarrier(server_address, num_ranks, ranks_per_host, arity, num_iters);
+  }
+  return PyFloat_FromDouble(latency_ms);
+  HT_PY_FUNC_END
+}
+
 std::vector<PyMethodDef> InitCommGroupPyClassMethodDefs() {
   std::vector<PyMethodDef> ret = {{nullptr}};
   AddPyMethodDefs(ret, {
@@ -89,6 +140,9 @@ std::vector<PyMethodDef> InitCommGroupPyClassMethodDefs() {
     {"local_device", (PyCFunction) CommGroup_GetLocalDevice, METH_VARARGS | METH_KEYWORDS, nullptr }, 
     {"global_device_group", (PyCFunction) CommGroup_GetGlobalDeviceGroup, METH_VARARGS | METH_KEYWORDS, nullptr },    
     {"global_comm_barrier", (PyCFunction) CommGroup_GlobalCommBarrier, METH_VARARGS | METH_KEYWORDS, nullptr },     
+    {"launch_rpc_server", (PyCFunction) CommGroup_LaunchRPCServer, METH_VARARGS | METH_KEYWORDS, nullptr },
+    {"benchmark_rpc_startup", (PyCFunction) CommGroup_BenchmarkRPCStartup, METH_VARARGS | METH_KEYWORDS, nullptr },
+    {"benchmark_rpc_barrier", (PyCFunction) CommGroup_BenchmarkRPCBarrier, METH_VARARGS | METH_KEYWORDS, nullptr },
     {nullptr}
   });
   
@@ -0,0 +1,130 @@
+#include "hydraulis/_binding/graph/checkpoint.h"
+#include "hydraulis/_binding/core/device.h"
+#include "hydraulis/_binding/utils/except.h"
+#include "hydraulis/_binding/utils/arg_parser.h"
+#include "hydraulis/graph/graph.h"
+#include "hydraulis/impl/communication/comm_group.h"
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+
+// Returns false if the local device does not hold any shard of the tensor.
+bool GetLocalShardPlacement(Tensor tensor, const Device& local_device,
+                            DistributedStates& ds, int32_t& device_index) {
+  device_index = 0;
+  ds = DistributedStates();
+  if (!tensor->has_distributed_states())
+    return true;
+  HT_NOT_IMPLEMENTED_IF(tensor->cur_ds_union().is_hetero())
+    << "Sharded checkpointing of hetero tensor " << tensor << " is not supported yet";
+  auto dg_union = GetVariableDeviceGroupUnion(tensor);
+  if (!dg_union.has(local_device))
+    return false;
+  const auto& dg = dg_union.get(local_device);
+  device_index = dg.get_index(local_device);
+  ds = tensor->get_distributed_states();
+  return true;
+}
+
+} // namespace
+
+PyObject* PyLoadSafeTensorsSharded(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "load_safetensors_sharded(str path, List[Tensor] tensors, List[str] names, Device local_device=None, int num_threads=0)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto path = parsed_args.get_string(0);
+    auto tensors = parsed_args.get_tensor_list(1);
+    auto names = parsed_args.get_string_list(2);
+    // Fall back to the local device of this process when local_device is None.
+    auto local_device = parsed_args.has(3) ? parsed_args.get_device(3)
+                                           : hydraulis::impl::comm::GetLocalDevice();
+    auto num_threads = parsed_args.get_int64_or_default(4);
+    HT_VALUE_ERROR_IF(tensors.size() != names.size())
+      << "Got " << tensors.size() << " tensors but " << names.size() << " names";
+    {
+      py::gil_scoped_release release;
+      auto reader = std::make_shared<const SafeTensorsReader>(path, num_threads);
+      for (size_t i = 0; i < tensors.size(); i++) {
+        DistributedStates ds;
+        int32_t device_index;
+        if (!GetLocalShardPlacement(tensors[i], local_device, ds, device_index))
+          continue;
+        const auto& info = reader->GetInfo(names[i]);
+        HT_VALUE_ERROR_IF(info.shape != tensors[i]->global_shape())
+          << "Global shape of " << tensors[i] << " is " << tensors[i]->global_shape()
+          << ", but the shape of " << names[i] << " in the checkpoint is " << info.shape;
+        // The shard is read when the exec graph allocates the variable,
+        // directly into its slot of the param bucket.
+        Graph::ResetVariableData(tensors[i],
+                                 SafeTensorsShardInitializer(reader, names[i], ds, device_index));
+      }
+    }
+    Py_RETURN_NONE;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+PyObject* PySaveSafeTensorsSharded(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "save_safetensors_sharded(str path, List[Tensor] tensors, List[str] names, Device local_device=None, int num_threads=0)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto path = parsed_args.get_string(0);
+    auto tensors = parsed_args.get_tensor_list(1);
+    auto names = parsed_args.get_string_list(2);
+    // Fall back to the local device of this process when local_device is None.
+    auto local_device = parsed_args.has(3) ? parsed_args.get_device(3)
+                                           : hydraulis::impl::comm::GetLocalDevice();
+    auto num_threads = parsed_args.get_int64_or_default(4);
+    HT_VALUE_ERROR_IF(tensors.size() != names.size())
+      << "Got " << tensors.size() << " tensors but " << names.size() << " names";
+    {
+      py::gil_scoped_release release;
+      // Every rank must declare all tensors so that the headers are identical.
+      std::vector<std::pair<std::string, NDArrayMeta>> global_metas;
+      for (size_t i = 0; i < tensors.size(); i++) {
+        global_metas.emplace_back(names[i], NDArrayMeta().set_dtype(tensors[i]->dtype())
+                                                         .set_shape(tensors[i]->global_shape()));
+      }
+      SafeTensorsWriter writer(path, global_metas, {{"format", "hydraulis"}}, num_threads);
+      for (size_t i = 0; i < tensors.size(); i++) {
+        DistributedStates ds;
+        int32_t device_index;
+        if (!GetLocalShardPlacement(tensors[i], local_device, ds, device_index))
+          continue;
+        writer.SaveShard(names[i], ds, device_index, GetDetachedVariableData(tensors[i]));
+      }
+      writer.Finish();
+    }
+    Py_RETURN_NONE;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// NOLINTNEXTLINE
+PyMethodDef PyCheckpoint_methods[] = { 
+  {"load_safetensors_sharded", (PyCFunction) PyLoadSafeTensorsSharded, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"save_safetensors_sharded", (PyCFunction) PySaveSafeTensorsSharded, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {nullptr}
+};
+
+void AddCheckpointFunctionsToModule(py::module_& m) {
+  HT_RUNTIME_ERROR_IF(0 != PyModule_AddFunctions(m.ptr(), PyCheckpoint_methods))
+    << "Failed to add checkpoint functions";
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <Python.h>
+#include "hydraulis/graph/checkpoint/safetensors.h"
+#include "hydraulis/_binding/graph/tensor.h"
+#include "hydraulis/_binding/utils/pybind_common.h"
+
+namespace hydraulis {
+namespace graph {
+
+void AddCheckpointFunctionsToModule(py::module_&);
+
+} // namespace graph
+} // namespace hydraulis
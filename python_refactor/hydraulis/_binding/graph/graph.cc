@@ -7,6 +7,20 @@
 #include "hydraulis/graph/graph.h"
 #include "hydraulis/graph/eager_graph.h"
 #include "hydraulis/graph/define_and_run_graph.h"
+#include "hydraulis/graph/topo_sort.h"
+#include "hydraulis/graph/offload/optimizer_cpu_offload.h"
+#include "hydraulis/graph/offload/offload_scheduler.h"
+#include "hydraulis/graph/grad_bucket.h"
+#include "hydraulis/graph/deterministic_benchmark.h"
+#include "hydraulis/graph/cross_entropy_benchmark.h"
+#include "hydraulis/graph/switch_planner.h"
+#include "hydraulis/graph/micro_batch_scheduler.h"
+#include "hydraulis/graph/checkpoint/snapshot.h"
+#include "hydraulis/graph/ops/einsum_planner.h"
+#include "hydraulis/impl/communication/thread_comm_group.h"
+#include "hydraulis/impl/communication/shm_comm_group.h"
+#include "hydraulis/common/deterministic.h"
+#include "hydraulis/impl/random/CPURandomState.h"
 
 namespace hydraulis {
 namespace graph {
@@ -114,7 +128,8 @@ PyObject* PyGraph_run(PyGraph* self, PyObject* args, PyObject* kwargs) {
     "run(Tensor loss, List[Tensor] fetches, FeedDict feed_dict=None, int num_micro_batches=1, \
          int cur_strategy_id=0, int run_level=0, bool save_checkpoint=False, double grad_scale=1)",
     "run(Tensor loss, List[Tensor] fetches, FeedDict feed_dict=None, int num_micro_batches=1, \
-         int compute_strategy_id=0, int optimize_strategy_id=0, int run_level=0, bool save_checkpoint=False, double grad_scale=1)"
+         int compute_strategy_id=0, int optimize_strategy_id=0, int run_level=0, bool save_checkpoint=False, double grad_scale=1, \
+         Tensor micro_batch_cu_seqlens=None)"
   });
   auto parsed_args = parser.parse(args, kwargs);
   if (parsed_args.signature_index() == 0) {
@@ -152,7 +167,8 @@ PyObject* PyGraph_run(PyGraph* self, PyObject* args, PyObject* kwargs) {
       parsed_args.get_int64_or_default(5),
       static_cast<RunLevel>(parsed_args.get_int64_or_default(6)),
       parsed_args.get_bool_or_default(7),
-      parsed_args.get_float64_or_default(8)));
+      parsed_args.get_float64_or_default(8),
+      parsed_args.get_tensor_optional(9)));
   } else {
     HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
     __builtin_unreachable();
@@ -160,6 +176,70 @@ PyObject* PyGraph_run(PyGraph* self, PyObject* args, PyObject* kwargs) {
   HT_PY_FUNC_END
 }
 
+PyObject* PyGraph_request_pre_switch(PyGraph* self) {
+  HT_PY_FUNC_BEGIN
+  auto& graph = Graph::GetGraph(self->graph_id);
+  HT_ASSERT(graph.type() == GraphType::DEFINE_AND_RUN)
+    << "Currently only support pre-switch in define graph";
+  dynamic_cast<DefineAndRunGraph&>(graph).RequestPreSwitch();
+  Py_RETURN_NONE;
+  HT_PY_FUNC_END
+}
+
+PyObject* PyGraph_pre_switch(PyGraph* self, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "pre_switch(int compute_strategy_id=0, int optimize_strategy_id=0)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto& graph = Graph::GetGraph(self->graph_id);
+    HT_ASSERT(graph.type() == GraphType::DEFINE_AND_RUN)
+      << "Currently only support pre-switch in define graph";
+    Py_RETURN_BOOLEAN_COND(dynamic_cast<DefineAndRunGraph&>(graph).PreSwitch(
+      parsed_args.get_int64_or_default(0),
+      parsed_args.get_int64_or_default(1)));
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+PyObject* PyGraph_snapshot(PyGraph* self, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "snapshot(str dir, int step)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto& graph = Graph::GetGraph(self->graph_id);
+    HT_ASSERT(graph.type() == GraphType::DEFINE_AND_RUN)
+      << "Currently only support snapshot in define graph";
+    double stall_ms = dynamic_cast<DefineAndRunGraph&>(graph).Snapshot(
+      parsed_args.get_string(0),
+      parsed_args.get_int64(1));
+    return PyFloat_FromDouble(stall_ms);
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+PyObject* PyGraph_wait_snapshots(PyGraph* self) {
+  HT_PY_FUNC_BEGIN
+  auto& graph = Graph::GetGraph(self->graph_id);
+  HT_ASSERT(graph.type() == GraphType::DEFINE_AND_RUN)
+    << "Currently only support snapshot in define graph";
+  {
+    py::gil_scoped_release release;
+    dynamic_cast<DefineAndRunGraph&>(graph).WaitSnapshots();
+  }
+  Py_RETURN_NONE;
+  HT_PY_FUNC_END
+}
+
 PyObject* PyGraph_get_graph(PyObject*, PyObject* args, PyObject* kwargs) {
   HT_PY_FUNC_BEGIN
   static PyArgParser parser({
@@ -294,6 +374,828 @@ PyObject* PyPopGraphCtx(PyObject*, PyObject* args, PyObject* kwargs) {
   HT_PY_FUNC_END
 }
 
+namespace {
+
+inline void SetDictItem(PyObject* dict, const char* key, PyObject* value) {
+  PyDict_SetItemString(dict, key, value);
+  Py_DECREF(value);
+}
+
+} // namespace
+
+// Compares the topological sort implementations on a synthetic graph of about
+// num_ops ops. Returns {num_ops, legacy_ms, dense_ms, memory_aware_ms,
+// dense_peak_mb, memory_aware_peak_mb}.
+PyObject* PyBenchmarkTopoSort(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "benchmark_topo_sort(int num_ops=100000, int num_iters=5)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    TopoSortBenchmarkResult result;
+    {
+      py::gil_scoped_release release;
+      result = BenchmarkTopoSort(parsed_args.get_int64_or_default(0),
+                                 parsed_args.get_int64_or_default(1));
+    }
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "num_ops", PyLong_FromInteger(result.num_ops));
+    SetDictItem(py_dict, "legacy_ms", PyFloat_FromDouble(result.legacy_ms));
+    SetDictItem(py_dict, "dense_ms", PyFloat_FromDouble(result.dense_ms));
+    SetDictItem(py_dict, "memory_aware_ms", PyFloat_FromDouble(result.memory_aware_ms));
+    SetDictItem(py_dict, "dense_peak_mb", PyFloat_FromDouble(result.dense_peak_bytes / 1048576.0));
+    SetDictItem(py_dict, "memory_aware_peak_mb",
+                PyFloat_FromDouble(result.memory_aware_peak_bytes / 1048576.0));
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Runs the ZeRO-Offload optimizer update on CPU tensors and compares the
+// pipelined engine against updating the buckets one after another.
+// With host_master the fp32 masters are bound up front as in mixed-precision
+// training, otherwise they are initialized from the params on the first step.
+// Returns {num_chunks, serial_ms, pipelined_ms, predicted_serial_ms,
+// predicted_pipelined_ms, max_abs_error, max_master_error}.
+PyObject* PyBenchmarkOptimizerOffload(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "benchmark_optimizer_offload(int num_params=64, int numel_per_param=1048576, int num_buckets=8, int num_steps=3, bool low_precision=true, bool host_master=false)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    OptimizerOffloadBenchmarkResult result;
+    {
+      py::gil_scoped_release release;
+      result = BenchmarkOptimizerOffload(parsed_args.get_int64_or_default(0),
+                                         parsed_args.get_int64_or_default(1),
+                                         parsed_args.get_int64_or_default(2),
+                                         parsed_args.get_int64_or_default(3),
+                                         parsed_args.get_bool_or_default(4),
+                                         parsed_args.get_bool_or_default(5));
+    }
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "num_chunks", PyLong_FromInteger(result.num_chunks));
+    SetDictItem(py_dict, "serial_ms", PyFloat_FromDouble(result.serial_ms));
+    SetDictItem(py_dict, "pipelined_ms", PyFloat_FromDouble(result.pipelined_ms));
+    SetDictItem(py_dict, "predicted_serial_ms", PyFloat_FromDouble(result.predicted_serial_ms));
+    SetDictItem(py_dict, "predicted_pipelined_ms", PyFloat_FromDouble(result.predicted_pipelined_ms));
+    SetDictItem(py_dict, "max_abs_error", PyFloat_FromDouble(result.max_abs_error));
+    SetDictItem(py_dict, "max_master_error", PyFloat_FromDouble(result.max_master_error));
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Reduces num_grads CPU gradients one collective per tensor and then through
+// size-targeted buckets, over MPI/SHM or a threaded world of the given size.
+// Returns {num_buckets, per_tensor_ms, bucketed_ms, max_abs_error, timings}.
+PyObject* PyBenchmarkGradBucketing(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "benchmark_grad_bucketing(int num_grads=256, int numel_per_grad=16384, int bucket_mb=25, int first_bucket_mb=1, bool reduce_scatter=false, int threaded_world_size=0)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    GradBucketBenchmarkResult result;
+    {
+      py::gil_scoped_release release;
+      result = BenchmarkGradBucketing(parsed_args.get_int64_or_default(0),
+                                      parsed_args.get_int64_or_default(1),
+                                      parsed_args.get_int64_or_default(2),
+                                      parsed_args.get_int64_or_default(3),
+                                      parsed_args.get_bool_or_default(4),
+                                      parsed_args.get_int64_or_default(5));
+    }
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "num_buckets", PyLong_FromInteger(result.num_buckets));
+    SetDictItem(py_dict, "per_tensor_ms", PyFloat_FromDouble(result.per_tensor_ms));
+    SetDictItem(py_dict, "bucketed_ms", PyFloat_FromDouble(result.bucketed_ms));
+    SetDictItem(py_dict, "max_abs_error", PyFloat_FromDouble(result.max_abs_error));
+    PyObject* py_timings = PyList_New(result.timings.size());
+    if (!py_timings) {
+      Py_DECREF(py_dict);
+      return nullptr;
+    }
+    for (size_t i = 0; i < result.timings.size(); i++) {
+      PyObject* py_timing = PyDict_New();
+      if (!py_timing) {
+        Py_DECREF(py_timings);
+        Py_DECREF(py_dict);
+        return nullptr;
+      }
+      SetDictItem(py_timing, "num_grads", PyLong_FromInteger(result.timings[i].num_grads));
+      SetDictItem(py_timing, "num_bytes", PyLong_FromInteger(result.timings[i].num_bytes));
+      SetDictItem(py_timing, "launch_to_finish_ms", PyFloat_FromDouble(result.timings[i].launch_to_finish_ms));
+      PyList_SET_ITEM(py_timings, i, py_timing);
+    }
+    SetDictItem(py_dict, "timings", py_timings);
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Switches the CPU kernels to fixed-order reductions and race-free
+// scatter-adds for the kernels launched afterwards. A non-zero seed also
+// seeds the CPU random state (shuffles, dropout, initializers).
+PyObject* PySetDeterministic(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "set_deterministic(bool deterministic=true, int seed=0)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    SetDeterministic(parsed_args.get_bool_or_default(0));
+    auto seed = parsed_args.get_int64_or_default(1);
+    if (seed != 0)
+      hydraulis::impl::SetCPURandomSeed(static_cast<uint64_t>(seed));
+    Py_RETURN_NONE;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+PyObject* PyIsDeterministic(PyObject*) {
+  HT_PY_FUNC_BEGIN
+  return PyBool_FromLong(IsDeterministic());
+  HT_PY_FUNC_END
+}
+
+// Times the CPU kernels touched by the deterministic mode in both modes.
+// Returns {num_threads, default_ms, deterministic_ms, slowdown, timings}
+// where each timing is {kernel, default_ms, deterministic_ms,
+// bitwise_reproducible}.
+PyObject* PyBenchmarkDeterministicKernels(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "benchmark_deterministic_kernels(int num_tokens=4096, int hidden=1024, int vocab=32000, int num_iters=5)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    DeterministicBenchmarkResult result;
+    {
+      py::gil_scoped_release release;
+      result = BenchmarkDeterministicKernels(parsed_args.get_int64_or_default(0),
+                                             parsed_args.get_int64_or_default(1),
+                                             parsed_args.get_int64_or_default(2),
+                                             parsed_args.get_int64_or_default(3));
+    }
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "num_threads", PyLong_FromInteger(result.num_threads));
+    SetDictItem(py_dict, "default_ms", PyFloat_FromDouble(result.default_ms));
+    SetDictItem(py_dict, "deterministic_ms", PyFloat_FromDouble(result.deterministic_ms));
+    SetDictItem(py_dict, "slowdown", PyFloat_FromDouble(result.slowdown()));
+    PyObject* py_timings = PyList_New(result.timings.size());
+    if (!py_timings) {
+      Py_DECREF(py_dict);
+      return nullptr;
+    }
+    for (size_t i = 0; i < result.timings.size(); i++) {
+      PyObject* py_timing = PyDict_New();
+      if (!py_timing) {
+        Py_DECREF(py_timings);
+        Py_DECREF(py_dict);
+        return nullptr;
+      }
+      SetDictItem(py_timing, "kernel", PyUnicode_FromString(result.timings[i].kernel));
+      SetDictItem(py_timing, "default_ms", PyFloat_FromDouble(result.timings[i].default_ms));
+      SetDictItem(py_timing, "deterministic_ms", PyFloat_FromDouble(result.timings[i].deterministic_ms));
+      SetDictItem(py_timing, "bitwise_reproducible", PyBool_FromLong(result.timings[i].bitwise_reproducible));
+      PyList_SET_ITEM(py_timings, i, py_timing);
+    }
+    SetDictItem(py_dict, "timings", py_timings);
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Compares the separate sparse cross entropy forward/backward kernels with the
+// fused kernel that writes the gradient in place over the logits, token_chunk
+// tokens at a time. Returns {num_threads, separate_ms, fused_ms, speedup,
+// separate_extra_bytes, fused_extra_bytes, max_loss_diff, max_grad_diff}.
+PyObject* PyBenchmarkCrossEntropyKernels(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "benchmark_cross_entropy_kernels(int num_tokens=2048, int vocab=131072, int token_chunk=512, int num_iters=3)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    CrossEntropyBenchmarkResult result;
+    {
+      py::gil_scoped_release release;
+      result = BenchmarkCrossEntropyKernels(parsed_args.get_int64_or_default(0),
+                                            parsed_args.get_int64_or_default(1),
+                                            parsed_args.get_int64_or_default(2),
+                                            parsed_args.get_int64_or_default(3));
+    }
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "num_threads", PyLong_FromInteger(result.num_threads));
+    SetDictItem(py_dict, "separate_ms", PyFloat_FromDouble(result.separate_ms));
+    SetDictItem(py_dict, "fused_ms", PyFloat_FromDouble(result.fused_ms));
+    SetDictItem(py_dict, "speedup", PyFloat_FromDouble(result.speedup()));
+    SetDictItem(py_dict, "separate_extra_bytes", PyLong_FromInteger(result.separate_extra_bytes));
+    SetDictItem(py_dict, "fused_extra_bytes", PyLong_FromInteger(result.fused_extra_bytes));
+    SetDictItem(py_dict, "max_loss_diff", PyFloat_FromDouble(result.max_loss_diff));
+    SetDictItem(py_dict, "max_grad_diff", PyFloat_FromDouble(result.max_grad_diff));
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Checks the fused, in-place and vocab-parallel sparse cross entropy kernels
+// against the separate forward/backward kernels for each reduction, with some
+// ignored labels. Returns a list of {kernel, reduction, max_loss_diff,
+// max_grad_diff}.
+PyObject* PyCheckCrossEntropyKernels(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "check_cross_entropy_kernels(int num_tokens=64, int vocab=1000, int num_ranks=4)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    std::vector<CrossEntropyKernelCheck> checks;
+    {
+      py::gil_scoped_release release;
+      checks = CheckCrossEntropyKernels(parsed_args.get_int64_or_default(0),
+                                        parsed_args.get_int64_or_default(1),
+                                        parsed_args.get_int64_or_default(2));
+    }
+    PyObject* py_checks = PyList_New(checks.size());
+    if (!py_checks)
+      return nullptr;
+    for (size_t i = 0; i < checks.size(); i++) {
+      PyObject* py_check = PyDict_New();
+      if (!py_check) {
+        Py_DECREF(py_checks);
+        return nullptr;
+      }
+      SetDictItem(py_check, "kernel", PyUnicode_FromString(checks[i].kernel));
+      SetDictItem(py_check, "reduction", PyUnicode_FromString(checks[i].reduction));
+      SetDictItem(py_check, "max_loss_diff", PyFloat_FromDouble(checks[i].max_loss_diff));
+      SetDictItem(py_check, "max_grad_diff", PyFloat_FromDouble(checks[i].max_grad_diff));
+      PyList_SET_ITEM(py_checks, i, py_check);
+    }
+    return py_checks;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Schedules activation offload for items of (bytes, layer) under the given
+// bandwidth model. Returns {groups, item_to_group, prefetch_distance,
+// host_bytes, peak_prefetched_bytes, exposed_load_ms}, where groups is a list
+// of {items, layer, bytes, load_after_layer}.
+PyObject* PyOffloadSchedule(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "offload_schedule(List[int] item_bytes, List[int] item_layers, List[float] bwd_compute_ms, float d2h_gbps=12, float h2d_gbps=12, float latency_us=10, int coalesce_kb=1024, int max_prefetch_distance=2, int host_alignment=256)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto item_bytes = parsed_args.get_int64_list(0);
+    auto item_layers = parsed_args.get_int64_list(1);
+    auto bwd_compute_ms = parsed_args.get_float64_list(2);
+    HT_VALUE_ERROR_IF(item_bytes.size() != item_layers.size())
+      << "Got " << item_bytes.size() << " item bytes but " << item_layers.size() << " item layers";
+    std::vector<OffloadItem> items;
+    for (size_t i = 0; i < item_bytes.size(); i++)
+      items.push_back({static_cast<size_t>(item_bytes[i]), static_cast<size_t>(item_layers[i])});
+    OffloadScheduler scheduler(OffloadBandwidthModel(parsed_args.get_float64_or_default(3),
+                                                     parsed_args.get_float64_or_default(4),
+                                                     parsed_args.get_float64_or_default(5)),
+                               parsed_args.get_int64_or_default(6) * 1024,
+                               parsed_args.get_int64_or_default(7),
+                               parsed_args.get_int64_or_default(8));
+    auto schedule = scheduler.Schedule(items, bwd_compute_ms);
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    PyObject* py_groups = PyList_New(schedule.groups.size());
+    if (!py_groups) {
+      Py_DECREF(py_dict);
+      return nullptr;
+    }
+    for (size_t i = 0; i < schedule.groups.size(); i++) {
+      const auto& group = schedule.groups[i];
+      PyObject* py_group = PyDict_New();
+      if (!py_group) {
+        Py_DECREF(py_groups);
+        Py_DECREF(py_dict);
+        return nullptr;
+      }
+      SetDictItem(py_group, "items", PyLongList_FromIntegerList(group.items));
+      SetDictItem(py_group, "layer", PyLong_FromInteger(group.layer));
+      SetDictItem(py_group, "bytes", PyLong_FromInteger(group.bytes));
+      SetDictItem(py_group, "load_after_layer", PyLong_FromInteger(group.load_after_layer));
+      PyList_SET_ITEM(py_groups, i, py_group);
+    }
+    SetDictItem(py_dict, "groups", py_groups);
+    SetDictItem(py_dict, "item_to_group", PyLongList_FromIntegerList(schedule.item_to_group));
+    SetDictItem(py_dict, "prefetch_distance", PyLong_FromInteger(schedule.prefetch_distance));
+    SetDictItem(py_dict, "host_bytes", PyLong_FromInteger(schedule.host_bytes));
+    SetDictItem(py_dict, "peak_prefetched_bytes", PyLong_FromInteger(schedule.peak_prefetched_bytes));
+    SetDictItem(py_dict, "exposed_load_ms", PyFloat_FromDouble(schedule.exposed_load_ms));
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Assigns the activation offload host buffer of each micro batch for the
+// pipeline tasks of one stage, given as task types (0 for forward, 1 for
+// backward) and micro batch ids. Returns the buffer id of each micro batch.
+PyObject* PyAssignOffloadHostSlots(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "assign_offload_host_slots(List[int] task_types, List[int] micro_batch_ids, int num_micro_batches)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto task_types = parsed_args.get_int64_list(0);
+    auto micro_batch_ids = parsed_args.get_int64_list(1);
+    HT_VALUE_ERROR_IF(task_types.size() != micro_batch_ids.size())
+      << "Got " << task_types.size() << " task types but " << micro_batch_ids.size() << " micro batch ids";
+    std::vector<std::pair<int32_t, size_t>> tasks;
+    for (size_t i = 0; i < task_types.size(); i++)
+      tasks.emplace_back(static_cast<int32_t>(task_types[i]), static_cast<size_t>(micro_batch_ids[i]));
+    return PyLongList_FromIntegerList(AssignOffloadHostSlots(tasks, parsed_args.get_int64(2)));
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Executes the einsum plan of an explicit equation on random CPU inputs and
+// returns the max abs error against an element-wise reference. The shapes of
+// the operands are flattened into dims, with ndims giving the rank of each.
+PyObject* PyCheckEinsumPlan(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "check_einsum_plan(std::string equation, List[int] ndims, List[int] dims)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto equation = parsed_args.get_string(0);
+    auto ndims = parsed_args.get_int64_list(1);
+    auto dims = parsed_args.get_int64_list(2);
+    HTShapeList shapes;
+    size_t offset = 0;
+    for (auto ndim : ndims) {
+      HT_VALUE_ERROR_IF(ndim < 0 || offset + ndim > dims.size())
+        << "Got " << dims.size() << " dims for operands of ranks " << ndims;
+      shapes.emplace_back(dims.begin() + offset, dims.begin() + offset + ndim);
+      offset += ndim;
+    }
+    HT_VALUE_ERROR_IF(offset != dims.size())
+      << "Got " << dims.size() << " dims for operands of ranks " << ndims;
+    double max_error;
+    {
+      py::gil_scoped_release release;
+      max_error = CheckEinsumPlan(equation, shapes);
+    }
+    return PyFloat_FromDouble(max_error);
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Returns {size, capacity} of the process-wide einsum plan cache.
+PyObject* PyEinsumPlanCacheStats(PyObject*) {
+  HT_PY_FUNC_BEGIN
+  PyObject* py_dict = PyDict_New();
+  if (!py_dict)
+    return nullptr;
+  SetDictItem(py_dict, "size", PyLong_FromInteger(EinsumPlanner::PlanCacheSize()));
+  SetDictItem(py_dict, "capacity", PyLong_FromInteger(EinsumPlanner::PlanCacheCapacity()));
+  return py_dict;
+  HT_PY_FUNC_END
+}
+
+namespace {
+
+std::vector<MicroBatchCost> MakeMicroBatchCosts(const std::vector<int64_t>& num_tokens,
+                                                const std::vector<double>& attn_flops) {
+  HT_VALUE_ERROR_IF(!attn_flops.empty() && attn_flops.size() != num_tokens.size())
+    << "Got " << attn_flops.size() << " attention costs for "
+    << num_tokens.size() << " micro batches";
+  std::vector<MicroBatchCost> costs(num_tokens.size());
+  for (size_t i = 0; i < num_tokens.size(); i++) {
+    costs[i].num_tokens = num_tokens[i];
+    costs[i].attn_flops = attn_flops.empty() ? 0 : attn_flops[i];
+  }
+  return costs;
+}
+
+MicroBatchScheduler MakeMicroBatchScheduler(int64_t num_stages, double attn_cost,
+                                            int64_t max_inflight_tokens = 0) {
+  HT_VALUE_ERROR_IF(num_stages <= 0)
+    << "Invalid number of stages: " << num_stages;
+  StageCostModel model;
+  model.per_attn = attn_cost;
+  return MicroBatchScheduler(std::vector<StageCostModel>(num_stages, model),
+                             max_inflight_tokens);
+}
+
+} // namespace
+
+// Reorders micro batches with the 1F1B simulator and returns {order, makespan,
+// original_makespan, peak_inflight_tokens, original_peak_inflight_tokens}.
+PyObject* PyScheduleMicroBatches(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "schedule_micro_batches(List[int] num_tokens, List[float] attn_flops=[], int num_stages=4, float attn_cost=0, int max_inflight_tokens=0)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto costs = MakeMicroBatchCosts(parsed_args.get_int64_list(0),
+                                     parsed_args.get_float64_list_or_default(1));
+    auto scheduler = MakeMicroBatchScheduler(parsed_args.get_int64_or_default(2),
+                                             parsed_args.get_float64_or_default(3),
+                                             parsed_args.get_int64_or_default(4));
+    auto schedule = scheduler.Schedule(costs);
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "order", PyLongList_FromIntegerList(schedule.order));
+    SetDictItem(py_dict, "makespan", PyFloat_FromDouble(schedule.makespan));
+    SetDictItem(py_dict, "original_makespan", PyFloat_FromDouble(schedule.original_makespan));
+    SetDictItem(py_dict, "peak_inflight_tokens", PyLongList_FromIntegerList(schedule.peak_inflight_tokens));
+    SetDictItem(py_dict, "original_peak_inflight_tokens",
+                PyLongList_FromIntegerList(schedule.original_peak_inflight_tokens));
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Simulates 1F1B for a given order and returns {makespan, peak_inflight_tokens}.
+PyObject* PySimulateMicroBatches(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "simulate_micro_batches(List[int] num_tokens, List[int] order, List[float] attn_flops=[], int num_stages=4, float attn_cost=0)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto costs = MakeMicroBatchCosts(parsed_args.get_int64_list(0),
+                                     parsed_args.get_float64_list_or_default(2));
+    auto raw_order = parsed_args.get_int64_list(1);
+    std::vector<size_t> order(raw_order.begin(), raw_order.end());
+    std::vector<size_t> sorted_order = order;
+    std::sort(sorted_order.begin(), sorted_order.end());
+    bool is_permutation = sorted_order.size() == costs.size();
+    for (size_t i = 0; i < sorted_order.size() && is_permutation; i++)
+      is_permutation = sorted_order[i] == i;
+    HT_VALUE_ERROR_IF(!is_permutation)
+      << "The order " << order << " is not a permutation of "
+      << costs.size() << " micro batches";
+    auto scheduler = MakeMicroBatchScheduler(parsed_args.get_int64_or_default(3),
+                                             parsed_args.get_float64_or_default(4));
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "makespan", PyFloat_FromDouble(scheduler.Simulate(costs, order)));
+    SetDictItem(py_dict, "peak_inflight_tokens",
+                PyLongList_FromIntegerList(scheduler.PeakInflightTokens(costs, order)));
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Snapshots two host buffers under dir, restores them into zeroed buffers and
+// checks that an incomplete snapshot cannot be restored. Returns the stats
+// {step, num_bytes, stall_ms, save_ms} of the snapshot.
+PyObject* PyCheckSnapshotRoundTrip(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "check_snapshot_round_trip(std::string dir)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    SnapshotStats stats;
+    {
+      py::gil_scoped_release release;
+      stats = CheckSnapshotRoundTrip(parsed_args.get_string(0));
+    }
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "step", PyLong_FromInteger(stats.step));
+    SetDictItem(py_dict, "num_bytes", PyLong_FromInteger(stats.num_bytes));
+    SetDictItem(py_dict, "stall_ms", PyFloat_FromDouble(stats.stall_ms));
+    SetDictItem(py_dict, "save_ms", PyFloat_FromDouble(stats.save_ms));
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Runs every collective and p2p op of THREAD groups in a threaded world
+// and returns a list of {op, max_abs_error} against host-computed values.
+PyObject* PyCheckThreadCollectives(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "check_thread_collectives(int world_size=4, int numel=100003)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    std::vector<hydraulis::impl::comm::ThreadCollectiveCheck> checks;
+    {
+      py::gil_scoped_release release;
+      checks = hydraulis::impl::comm::CheckThreadCollectives(
+        parsed_args.get_int64_or_default(0), parsed_args.get_int64_or_default(1));
+    }
+    PyObject* py_checks = PyList_New(checks.size());
+    if (!py_checks)
+      return nullptr;
+    for (size_t i = 0; i < checks.size(); i++) {
+      PyObject* py_check = PyDict_New();
+      if (!py_check) {
+        Py_DECREF(py_checks);
+        return nullptr;
+      }
+      SetDictItem(py_check, "op", PyUnicode_FromString(checks[i].op));
+      SetDictItem(py_check, "max_abs_error", PyFloat_FromDouble(checks[i].max_abs_error));
+      PyList_SET_ITEM(py_checks, i, py_check);
+    }
+    return py_checks;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Times SHM against MPI groups on this rank; every rank of an intra-node
+// world (e.g. under mpirun) must call it. Returns a list of
+// {op, shm_ms, mpi_ms, max_abs_diff}.
+PyObject* PyBenchmarkCPUCommBackends(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "benchmark_cpu_comm_backends(int numel=1048576, int num_iters=20)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    std::vector<hydraulis::impl::comm::CPUCommBenchmarkResult> results;
+    {
+      py::gil_scoped_release release;
+      results = hydraulis::impl::comm::BenchmarkCPUCommBackends(
+        parsed_args.get_int64_or_default(0), parsed_args.get_int64_or_default(1));
+    }
+    PyObject* py_results = PyList_New(results.size());
+    if (!py_results)
+      return nullptr;
+    for (size_t i = 0; i < results.size(); i++) {
+      PyObject* py_result = PyDict_New();
+      if (!py_result) {
+        Py_DECREF(py_results);
+        return nullptr;
+      }
+      SetDictItem(py_result, "op", PyUnicode_FromString(results[i].op));
+      SetDictItem(py_result, "shm_ms", PyFloat_FromDouble(results[i].shm_ms));
+      SetDictItem(py_result, "mpi_ms", PyFloat_FromDouble(results[i].mpi_ms));
+      SetDictItem(py_result, "max_abs_diff", PyFloat_FromDouble(results[i].max_abs_diff));
+      PyList_SET_ITEM(py_results, i, py_result);
+    }
+    return py_results;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Makes fail_rank throw while its peers wait in collectives, and returns the
+// message re-thrown by the threaded world.
+PyObject* PyCheckThreadedWorldFailure(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "check_threaded_world_failure(int world_size=4, int fail_rank=1)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    std::string message;
+    {
+      py::gil_scoped_release release;
+      message = hydraulis::impl::comm::CheckThreadedWorldFailure(
+        parsed_args.get_int64_or_default(0), parsed_args.get_int64_or_default(1));
+    }
+    return PyUnicode_FromString(message);
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Plans one hot switch from before_tp to after_tp on a synthetic topology of
+// num_nodes x gpus_per_node devices with every switch algorithm. Returns a
+// list of {algorithm, plan_ms, predicted_time_ms, num_transfers, moved_bytes,
+// reused_bytes, inter_node_bytes, max_link_bytes, link_bytes}, where
+// link_bytes is a list of {send_rank, recv_rank, bytes, inter_node}.
+PyObject* PyBenchmarkSwitchPlanner(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "benchmark_switch_planner(int num_nodes=2, int gpus_per_node=8, int before_tp=2, int after_tp=8, int num_params=64, int param_mb=16)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    std::vector<SwitchPlannerBenchmarkResult> results;
+    {
+      py::gil_scoped_release release;
+      results = BenchmarkSwitchPlanner(parsed_args.get_int64_or_default(0),
+                                       parsed_args.get_int64_or_default(1),
+                                       parsed_args.get_int64_or_default(2),
+                                       parsed_args.get_int64_or_default(3),
+                                       parsed_args.get_int64_or_default(4),
+                                       parsed_args.get_int64_or_default(5));
+    }
+    PyObject* py_results = PyList_New(results.size());
+    if (!py_results)
+      return nullptr;
+    for (size_t i = 0; i < results.size(); i++) {
+      const auto& result = results[i];
+      PyObject* py_dict = PyDict_New();
+      PyObject* py_links = py_dict ? PyList_New(result.link_bytes.size()) : nullptr;
+      if (!py_links) {
+        Py_XDECREF(py_dict);
+        Py_DECREF(py_results);
+        return nullptr;
+      }
+      for (size_t j = 0; j < result.link_bytes.size(); j++) {
+        PyObject* py_link = PyDict_New();
+        if (!py_link) {
+          Py_DECREF(py_links);
+          Py_DECREF(py_dict);
+          Py_DECREF(py_results);
+          return nullptr;
+        }
+        SetDictItem(py_link, "send_rank", PyLong_FromInteger(result.link_bytes[j].send_rank));
+        SetDictItem(py_link, "recv_rank", PyLong_FromInteger(result.link_bytes[j].recv_rank));
+        SetDictItem(py_link, "bytes", PyLong_FromInteger(result.link_bytes[j].bytes));
+        SetDictItem(py_link, "inter_node", PyBool_FromLong(result.link_bytes[j].inter_node));
+        PyList_SET_ITEM(py_links, j, py_link);
+      }
+      SetDictItem(py_dict, "algorithm", PyUnicode_FromString(result.algorithm));
+      SetDictItem(py_dict, "plan_ms", PyFloat_FromDouble(result.plan_ms));
+      SetDictItem(py_dict, "predicted_time_ms", PyFloat_FromDouble(result.predicted_time_ms));
+      SetDictItem(py_dict, "num_transfers", PyLong_FromInteger(result.num_transfers));
+      SetDictItem(py_dict, "moved_bytes", PyLong_FromInteger(result.moved_bytes));
+      SetDictItem(py_dict, "reused_bytes", PyLong_FromInteger(result.reused_bytes));
+      SetDictItem(py_dict, "inter_node_bytes", PyLong_FromInteger(result.inter_node_bytes));
+      SetDictItem(py_dict, "max_link_bytes", PyLong_FromInteger(result.max_link_bytes));
+      SetDictItem(py_dict, "link_bytes", py_links);
+      PyList_SET_ITEM(py_results, i, py_dict);
+    }
+    return py_results;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Pads the feeds of token_feeds (with the matching pad_values) and cu_seqlens
+// up to a bucket ladder of ratio^k * min_size so that varying lengths reuse
+// the same shape plans. Passing ratio=0 disables bucketing.
+PyObject* PyGraph_set_shape_buckets(PyGraph* self, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "set_shape_buckets(float ratio=1.125, int min_size=128, int alignment=1, List[Tensor] token_feeds=None, List[float] pad_values=None, List[Tensor] cu_seqlens=None)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto& graph = Graph::GetGraph(self->graph_id);
+    HT_ASSERT(graph.type() == GraphType::DEFINE_AND_RUN)
+      << "Currently only support shape bucketing in define graph";
+    auto& define_graph = dynamic_cast<DefineAndRunGraph&>(graph);
+    auto ratio = parsed_args.get_float64_or_default(0);
+    if (ratio == 0) {
+      define_graph.SetShapeBucketPolicy(nullptr);
+      Py_RETURN_NONE;
+    }
+    auto token_feeds = parsed_args.get_tensor_list_or_empty(3);
+    auto pad_values = parsed_args.has(4) ? parsed_args.get_float64_list(4) : std::vector<double>();
+    HT_VALUE_ERROR_IF(!pad_values.empty() && pad_values.size() != token_feeds.size())
+      << "Got " << token_feeds.size() << " token feeds but " << pad_values.size() << " pad values";
+    std::unordered_map<TensorId, double> token_pad_values;
+    for (size_t i = 0; i < token_feeds.size(); i++)
+      token_pad_values[token_feeds[i]->id()] = pad_values.empty() ? 0 : pad_values[i];
+    TensorIdSet cu_seqlens;
+    for (const auto& tensor : parsed_args.get_tensor_list_or_empty(5))
+      cu_seqlens.insert(tensor->id());
+    define_graph.SetShapeBucketPolicy(std::make_unique<ShapeBucketPolicy>(
+      ShapeBucketLadder(ratio, parsed_args.get_int64_or_default(1), parsed_args.get_int64_or_default(2)),
+      std::move(token_pad_values), std::move(cu_seqlens)));
+    Py_RETURN_NONE;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Returns {num_lookups, num_hits, hit_rate, num_tokens, num_padded_tokens,
+// padding_ratio} accumulated since the last reset.
+PyObject* PyGraph_shape_plan_stats(PyGraph* self, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "shape_plan_stats(bool reset=false)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto& graph = Graph::GetGraph(self->graph_id);
+    HT_ASSERT(graph.type() == GraphType::DEFINE_AND_RUN)
+      << "Currently only support shape plan stats in define graph";
+    auto& define_graph = dynamic_cast<DefineAndRunGraph&>(graph);
+    auto stats = define_graph.shape_plan_stats();
+    if (parsed_args.get_bool_or_default(0))
+      define_graph.ResetShapePlanStats();
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "num_lookups", PyLong_FromInteger(stats.num_lookups));
+    SetDictItem(py_dict, "num_hits", PyLong_FromInteger(stats.num_hits));
+    SetDictItem(py_dict, "hit_rate", PyFloat_FromDouble(stats.hit_rate()));
+    SetDictItem(py_dict, "num_tokens", PyLong_FromInteger(stats.num_tokens));
+    SetDictItem(py_dict, "num_padded_tokens", PyLong_FromInteger(stats.num_padded_tokens));
+    SetDictItem(py_dict, "padding_ratio", PyFloat_FromDouble(stats.padding_ratio()));
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// Returns the recorded decisions of the next step when HYDRAULIS_REPLAY=REPLAY,
+// i.e. {step, compute_strategy_id, optimize_strategy_id, run_level,
+// num_micro_batches, exec_plan, switch_from, pre_switched}, and None otherwise.
+PyObject* PyGraph_replay_expected_step(PyGraph* self, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  auto& graph = Graph::GetGraph(self->graph_id);
+  HT_ASSERT(graph.type() == GraphType::DEFINE_AND_RUN)
+    << "Currently only support replay in define graph";
+  auto& define_graph = dynamic_cast<DefineAndRunGraph&>(graph);
+  const auto* step = define_graph.replay_expected_step();
+  if (step == nullptr)
+    Py_RETURN_NONE;
+  PyObject* py_dict = PyDict_New();
+  if (!py_dict)
+    return nullptr;
+  SetDictItem(py_dict, "step", PyLong_FromInteger(step->step));
+  SetDictItem(py_dict, "compute_strategy_id", PyLong_FromInteger(step->compute_strategy_id));
+  SetDictItem(py_dict, "optimize_strategy_id", PyLong_FromInteger(step->optimize_strategy_id));
+  SetDictItem(py_dict, "run_level", PyLong_FromInteger(step->run_level));
+  SetDictItem(py_dict, "num_micro_batches", PyLong_FromInteger(step->num_micro_batches));
+  SetDictItem(py_dict, "exec_plan", PyLong_FromInteger(step->exec_plan));
+  SetDictItem(py_dict, "switch_from", PyLong_FromInteger(step->switch_from));
+  SetDictItem(py_dict, "pre_switched", PyBool_FromLong(step->pre_switched));
+  return py_dict;
+  HT_PY_FUNC_END
+}
+
 // NOLINTNEXTLINE
 PyMethodDef PyGraphCtx_methods[] = {
   {"get_graph", (PyCFunction) PyGraph_get_graph, METH_VARARGS | METH_KEYWORDS, nullptr }, 
@@ -305,6 +1207,25 @@ PyMethodDef PyGraphCtx_methods[] = {
   {"make_new_define_and_run_graph", (PyCFunction) PyGraph_make_new_define_and_run_graph, METH_VARARGS | METH_KEYWORDS, nullptr }, 
   {"push_graph_ctx", (PyCFunction) PyPushGraphCtx, METH_VARARGS | METH_KEYWORDS, nullptr},
   {"pop_graph_ctx", (PyCFunction) PyPopGraphCtx, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"benchmark_topo_sort", (PyCFunction) PyBenchmarkTopoSort, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"benchmark_optimizer_offload", (PyCFunction) PyBenchmarkOptimizerOffload, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"benchmark_grad_bucketing", (PyCFunction) PyBenchmarkGradBucketing, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"set_deterministic", (PyCFunction) PySetDeterministic, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"is_deterministic", (PyCFunction) PyIsDeterministic, METH_NOARGS, nullptr},
+  {"benchmark_deterministic_kernels", (PyCFunction) PyBenchmarkDeterministicKernels, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"benchmark_cross_entropy_kernels", (PyCFunction) PyBenchmarkCrossEntropyKernels, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"check_cross_entropy_kernels", (PyCFunction) PyCheckCrossEntropyKernels, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"benchmark_switch_planner", (PyCFunction) PyBenchmarkSwitchPlanner, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"offload_schedule", (PyCFunction) PyOffloadSchedule, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"assign_offload_host_slots", (PyCFunction) PyAssignOffloadHostSlots, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"check_einsum_plan", (PyCFunction) PyCheckEinsumPlan, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"einsum_plan_cache_stats", (PyCFunction) PyEinsumPlanCacheStats, METH_NOARGS, nullptr},
+  {"check_snapshot_round_trip", (PyCFunction) PyCheckSnapshotRoundTrip, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"schedule_micro_batches", (PyCFunction) PyScheduleMicroBatches, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"simulate_micro_batches", (PyCFunction) PySimulateMicroBatches, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"check_thread_collectives", (PyCFunction) PyCheckThreadCollectives, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"check_threaded_world_failure", (PyCFunction) PyCheckThreadedWorldFailure, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"benchmark_cpu_comm_backends", (PyCFunction) PyBenchmarkCPUCommBackends, METH_VARARGS | METH_KEYWORDS, nullptr},
   {nullptr}
 };
 
@@ -322,8 +1243,15 @@ PyGetSetDef PyGraph_properties[] = {
 // NOLINTNEXTLINE
 PyMethodDef PyGraph_methods[] = {
   {"run", (PyCFunction) PyGraph_run, METH_VARARGS | METH_KEYWORDS, nullptr }, 
+  {"request_pre_switch", (PyCFunction) PyGraph_request_pre_switch, METH_NOARGS, nullptr }, 
+  {"pre_switch", (PyCFunction) PyGraph_pre_switch, METH_VARARGS | METH_KEYWORDS, nullptr }, 
+  {"snapshot", (PyCFunction) PyGraph_snapshot, METH_VARARGS | METH_KEYWORDS, nullptr },
+  {"wait_snapshots", (PyCFunction) PyGraph_wait_snapshots, METH_NOARGS, nullptr },
   {"set_num_strategy", (PyCFunction) PyGraph_set_num_strategy, METH_VARARGS | METH_KEYWORDS, nullptr },
   {"merge_strategy", (PyCFunction) PyGraph_merge_strategy, METH_VARARGS | METH_KEYWORDS, nullptr },  
+  {"set_shape_buckets", (PyCFunction) PyGraph_set_shape_buckets, METH_VARARGS | METH_KEYWORDS, nullptr },
+  {"shape_plan_stats", (PyCFunction) PyGraph_shape_plan_stats, METH_VARARGS | METH_KEYWORDS, nullptr },
+  {"replay_expected_step", (PyCFunction) PyGraph_replay_expected_step, METH_VARARGS | METH_KEYWORDS, nullptr },
   {nullptr}
 };
 
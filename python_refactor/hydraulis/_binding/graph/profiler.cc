@@ -6,6 +6,8 @@
 #include "hydraulis/_binding/utils/decl_utils.h"
 #include "hydraulis/_binding/utils/arg_parser.h"
 #include "hydraulis/impl/profiler/profiler.h"
+#include "hydraulis/impl/profiler/trace.h"
+#include "hydraulis/graph/host_overhead.h"
 
 namespace hydraulis {
 namespace impl {
@@ -81,10 +83,145 @@ PyObject* PyPopProfileCtx(PyObject*, PyObject* args, PyObject* kwargs) {
   HT_PY_FUNC_END
 }
 
+PyObject* PyStartTrace(PyObject*) {
+  HT_PY_FUNC_BEGIN
+  Tracer::Start();
+  Py_RETURN_NONE;
+  HT_PY_FUNC_END
+}
+
+PyObject* PyStopTrace(PyObject*) {
+  HT_PY_FUNC_BEGIN
+  Tracer::Stop();
+  Py_RETURN_NONE;
+  HT_PY_FUNC_END
+}
+
+PyObject* PyClearTrace(PyObject*) {
+  HT_PY_FUNC_BEGIN
+  Tracer::Clear();
+  Py_RETURN_NONE;
+  HT_PY_FUNC_END
+}
+
+PyObject* PyExportTrace(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "export_trace(str path)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto path = parsed_args.get_string(0);
+    {
+      py::gil_scoped_release release;
+      Tracer::Export(path);
+    }
+    Py_RETURN_NONE;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+namespace {
+
+inline void SetDictItem(PyObject* dict, const char* key, PyObject* value) {
+  PyDict_SetItemString(dict, key, value);
+  Py_DECREF(value);
+}
+
+} // namespace
+
+// Returns {phase: {steps, calls, total_ms, self_ms, mean_ms, min_ms, max_ms,
+// last_ms, p50_ms, p99_ms, histogram}} where histogram[i] counts the steps
+// whose time of the phase falls into [2^i, 2^(i+1)) us.
+PyObject* PyGetHostOverheadStats(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "get_host_overhead_stats(int rank=-1)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    using namespace hydraulis::graph;
+    auto& host_overhead = HostOverheadStats::Get(parsed_args.get_int64_or_default(0));
+    auto all_stats = host_overhead.stats();
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    for (size_t i = 0; i < all_stats.size(); i++) {
+      const auto& stats = all_stats[i];
+      if (stats.num_steps == 0)
+        continue;
+      PyObject* py_stats = PyDict_New();
+      SetDictItem(py_stats, "steps", PyLong_FromInteger(stats.num_steps));
+      SetDictItem(py_stats, "calls", PyLong_FromInteger(stats.num_calls));
+      SetDictItem(py_stats, "total_ms", PyFloat_FromDouble(stats.total_ns * 1e-6));
+      SetDictItem(py_stats, "self_ms", PyFloat_FromDouble(stats.self_ns * 1e-6));
+      SetDictItem(py_stats, "mean_ms", PyFloat_FromDouble(stats.MeanMs()));
+      SetDictItem(py_stats, "min_ms", PyFloat_FromDouble(stats.min_ns * 1e-6));
+      SetDictItem(py_stats, "max_ms", PyFloat_FromDouble(stats.max_ns * 1e-6));
+      SetDictItem(py_stats, "last_ms", PyFloat_FromDouble(stats.last_ns * 1e-6));
+      SetDictItem(py_stats, "p50_ms", PyFloat_FromDouble(stats.PercentileMs(0.5)));
+      SetDictItem(py_stats, "p99_ms", PyFloat_FromDouble(stats.PercentileMs(0.99)));
+      PyObject* py_histogram = PyList_New(stats.histogram.size());
+      for (size_t j = 0; j < stats.histogram.size(); j++)
+        PyList_SET_ITEM(py_histogram, j, PyLong_FromInteger(stats.histogram[j]));
+      SetDictItem(py_stats, "histogram", py_histogram);
+      SetDictItem(py_dict, HostPhase2Str(static_cast<HostPhase>(i)).c_str(), py_stats);
+    }
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+PyObject* PyHostOverheadSummary(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "host_overhead_summary(int rank=-1)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto summary = hydraulis::graph::HostOverheadStats::Get(
+      parsed_args.get_int64_or_default(0)).Summary();
+    return PyUnicode_FromString(summary.c_str());
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+PyObject* PyResetHostOverheadStats(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "reset_host_overhead_stats(int rank=-1)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    hydraulis::graph::HostOverheadStats::Get(parsed_args.get_int64_or_default(0)).Reset();
+    Py_RETURN_NONE;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
 PyMethodDef PyProfileCtx_methods[] = {
   {"make_new_profile", (PyCFunction) PyMakeNewProfile,  METH_VARARGS | METH_KEYWORDS, nullptr},
   {"push_profile_ctx", (PyCFunction) PyPushProfileCtx,  METH_VARARGS | METH_KEYWORDS, nullptr},
   {"pop_profile_ctx", (PyCFunction) PyPopProfileCtx,  METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"start_trace", (PyCFunction) PyStartTrace,  METH_NOARGS, nullptr},
+  {"stop_trace", (PyCFunction) PyStopTrace,  METH_NOARGS, nullptr},
+  {"clear_trace", (PyCFunction) PyClearTrace,  METH_NOARGS, nullptr},
+  {"export_trace", (PyCFunction) PyExportTrace,  METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"get_host_overhead_stats", (PyCFunction) PyGetHostOverheadStats,  METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"host_overhead_summary", (PyCFunction) PyHostOverheadSummary,  METH_VARARGS | METH_KEYWORDS, nullptr},
+  {"reset_host_overhead_stats", (PyCFunction) PyResetHostOverheadStats,  METH_VARARGS | METH_KEYWORDS, nullptr},
   {nullptr}
 };
 
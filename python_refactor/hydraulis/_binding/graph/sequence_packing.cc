@@ -0,0 +1,92 @@
+#include "hydraulis/_binding/graph/sequence_packing.h"
+#include "hydraulis/_binding/utils/except.h"
+#include "hydraulis/_binding/utils/arg_parser.h"
+#include "hydraulis/_binding/utils/python_primitives.h"
+
+namespace hydraulis {
+namespace graph {
+
+namespace {
+
+inline void SetDictItem(PyObject* dict, const char* key, PyObject* value) {
+  PyDict_SetItemString(dict, key, value);
+  Py_DECREF(value);
+}
+
+inline PyObject* PyFloatList_FromDoubleList(const std::vector<double>& values) {
+  auto* ret = PyList_New(values.size());
+  for (size_t i = 0; i < values.size(); i++)
+    PyList_SET_ITEM(ret, i, PyFloat_FromDouble(values[i]));
+  return ret;
+}
+
+} // namespace
+
+// Assigns sequences to num_bins packed micro batches so that the most
+// expensive one is as cheap as possible, where a sequence of length s costs
+// quadratic * s^2 + linear * s and every bin costs an extra `fixed`.
+// algorithm: 0 = auto, 1 = LPT, 2 = Karmarkar-Karp.
+// Returns a dict whose "assignment" holds the bin of every sequence.
+PyObject* PyPackSequences(PyObject*, PyObject* args, PyObject* kwargs) {
+  HT_PY_FUNC_BEGIN
+  static PyArgParser parser({
+    "pack_sequences(List[int] seqlens, int num_bins, float quadratic=0, float linear=1, float fixed=0, int max_tokens_per_bin=0, int max_seqs_per_bin=0, int algorithm=0, int max_local_search_steps=10000)"
+  });
+  auto parsed_args = parser.parse(args, kwargs);
+  if (parsed_args.signature_index() == 0) {
+    auto seqlens = parsed_args.get_int64_list(0);
+    auto num_bins = parsed_args.get_int64(1);
+    HT_VALUE_ERROR_IF(num_bins <= 0)
+      << "num_bins should be positive, got " << num_bins;
+    SequencePackingConstraints constraints;
+    constraints.num_bins = num_bins;
+    constraints.max_tokens_per_bin = parsed_args.get_int64_or_default(5);
+    constraints.max_seqs_per_bin = parsed_args.get_int64_or_default(6);
+    SequencePackingCostModel model;
+    model.quadratic = parsed_args.get_float64_or_default(2);
+    model.linear = parsed_args.get_float64_or_default(3);
+    model.fixed = parsed_args.get_float64_or_default(4);
+    auto algorithm = parsed_args.get_int64_or_default(7);
+    HT_VALUE_ERROR_IF(algorithm < 0 || algorithm > static_cast<int64_t>(SequencePackingAlgorithm::KARMARKAR_KARP))
+      << "Unknown sequence packing algorithm " << algorithm;
+    SequencePackingResult result;
+    {
+      py::gil_scoped_release release;
+      result = PackSequences(seqlens, model, constraints,
+                             static_cast<SequencePackingAlgorithm>(algorithm),
+                             parsed_args.get_int64_or_default(8));
+    }
+    PyObject* py_dict = PyDict_New();
+    if (!py_dict)
+      return nullptr;
+    SetDictItem(py_dict, "assignment", PyLongList_FromIntegerList(result.assignment));
+    SetDictItem(py_dict, "bin_costs", PyFloatList_FromDoubleList(result.bin_costs));
+    SetDictItem(py_dict, "bin_tokens", PyLongList_FromIntegerList(result.bin_tokens));
+    SetDictItem(py_dict, "bin_seqs", PyLongList_FromIntegerList(result.bin_seqs));
+    SetDictItem(py_dict, "max_cost", PyFloat_FromDouble(result.max_cost));
+    SetDictItem(py_dict, "lower_bound", PyFloat_FromDouble(result.lower_bound));
+    SetDictItem(py_dict, "feasible", PyBool_FromLong(result.feasible));
+    SetDictItem(py_dict, "algorithm", PyLong_FromInteger(static_cast<int64_t>(result.algorithm)));
+    SetDictItem(py_dict, "local_search_steps", PyLong_FromInteger(result.local_search_steps));
+    SetDictItem(py_dict, "elapsed_ms", PyFloat_FromDouble(result.elapsed_ms));
+    return py_dict;
+  } else {
+    HT_PY_PARSER_INCORRECT_SIGNATURE(parsed_args);
+    __builtin_unreachable();
+  }
+  HT_PY_FUNC_END
+}
+
+// NOLINTNEXTLINE
+PyMethodDef PySequencePacking_methods[] = { 
+  {"pack_sequences", (PyCFunction) PyPackSequences, METH_VARARGS | METH_KEYWORDS, nullptr},
+  {nullptr}
+};
+
+void AddSequencePackingFunctionsToModule(py::module_& m) {
+  HT_RUNTIME_ERROR_IF(0 != PyModule_AddFunctions(m.ptr(), PySequencePacking_methods))
+    << "Failed to add sequence packing functions";
+}
+
+} // namespace graph
+} // namespace hydraulis
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <Python.h>
+#include "hydraulis/graph/data/sequence_packing.h"
+#include "hydraulis/_binding/utils/pybind_common.h"
+
+namespace hydraulis {
+namespace graph {
+
+void AddSequencePackingFunctionsToModule(py::module_&);
+
+} // namespace graph
+} // namespace hydraulis
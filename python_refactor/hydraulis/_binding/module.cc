@@ -21,6 +21,8 @@
 #include "hydraulis/_binding/graph/init/initializer.h"
 #include "hydraulis/_binding/distributed/comm_group.h"
 #include "hydraulis/_binding/graph/profiler.h"
+#include "hydraulis/_binding/graph/checkpoint.h"
+#include "hydraulis/_binding/graph/sequence_packing.h"
 
 PYBIND11_MODULE(HT_CORE_PY_MODULE, m) {
   hydraulis::AddPyDeviceTypeToModule(m);
@@ -42,6 +44,8 @@ PYBIND11_MODULE(HT_CORE_PY_MODULE, m) {
   hydraulis::graph::AddPyAdamOptimizerTypeToModule(m);
   hydraulis::graph::AddPyDataloaderTypeToModule(m);
   hydraulis::graph::AddPyInitializerTypeToModule(m);
+  hydraulis::graph::AddCheckpointFunctionsToModule(m);
+  hydraulis::graph::AddSequencePackingFunctionsToModule(m);
   auto internal_sub_module = m.def_submodule("_internal_context");
   hydraulis::graph::AddOpContextManagingFunctionsToModule(internal_sub_module);
   hydraulis::graph::AddGraphContextManagingFunctionsToModule(internal_sub_module);
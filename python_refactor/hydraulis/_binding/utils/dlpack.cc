@@ -0,0 +1,191 @@
+#include "hydraulis/_binding/utils/dlpack.h"
+#include "hydraulis/_binding/utils/pybind_common.h"
+#include "hydraulis/_binding/utils/except.h"
+#include "hydraulis/core/memory_pool.h"
+
+namespace hydraulis {
+
+namespace {
+
+constexpr const char* kDLTensorCapsuleName = "dltensor";
+constexpr const char* kUsedDLTensorCapsuleName = "used_dltensor";
+
+// Owns the exported NDArray (and thus its storage)
+// as well as the shape/stride buffers referred by the DLTensor.
+struct NDArrayDLPackContext {
+  NDArray ndarray;
+  HTShape shape;
+  HTStride stride;
+  DLManagedTensor tensor;
+};
+
+void DeleteNDArrayDLPackContext(DLManagedTensor* self) {
+  delete reinterpret_cast<NDArrayDLPackContext*>(self->manager_ctx);
+}
+
+// Called when the capsule is garbage collected.
+// If it has not been consumed, we are still responsible for the tensor.
+void DLPackCapsuleDestructor(PyObject* capsule) {
+  if (!PyCapsule_IsValid(capsule, kDLTensorCapsuleName))
+    return;
+  auto* managed = reinterpret_cast<DLManagedTensor*>(
+    PyCapsule_GetPointer(capsule, kDLTensorCapsuleName));
+  if (managed != nullptr && managed->deleter != nullptr)
+    managed->deleter(managed);
+}
+
+DLDataType ToDLDataType(DataType dtype) {
+  DLDataType ret;
+  ret.lanes = 1;
+  ret.bits = static_cast<uint8_t>(DataType2Size(dtype) * 8);
+  switch (dtype) {
+    case kUInt8: ret.code = kDLUInt; break;
+    case kInt8:
+    case kInt16:
+    case kInt32:
+    case kInt64: ret.code = kDLInt; break;
+    case kFloat16:
+    case kFloat32:
+    case kFloat64: ret.code = kDLFloat; break;
+    case kBFloat16: ret.code = kDLBfloat; break;
+    case kBool: ret.code = kDLBool; break;
+    default:
+      HT_VALUE_ERROR << "Cannot export NDArray with type " << dtype
+        << " to DLPack";
+      __builtin_unreachable();
+  }
+  return ret;
+}
+
+DataType FromDLDataType(const DLDataType& dl_dtype) {
+  HT_VALUE_ERROR_IF(dl_dtype.lanes != 1)
+    << "Vectorized DLPack types (lanes = " << dl_dtype.lanes
+    << ") are not supported";
+  switch (dl_dtype.code) {
+    case kDLUInt:
+      if (dl_dtype.bits == 8) return kUInt8;
+      break;
+    case kDLInt:
+      if (dl_dtype.bits == 8) return kInt8;
+      if (dl_dtype.bits == 16) return kInt16;
+      if (dl_dtype.bits == 32) return kInt32;
+      if (dl_dtype.bits == 64) return kInt64;
+      break;
+    case kDLFloat:
+      if (dl_dtype.bits == 16) return kFloat16;
+      if (dl_dtype.bits == 32) return kFloat32;
+      if (dl_dtype.bits == 64) return kFloat64;
+      break;
+    case kDLBfloat:
+      if (dl_dtype.bits == 16) return kBFloat16;
+      break;
+    case kDLBool:
+      if (dl_dtype.bits == 8) return kBool;
+      break;
+    default:
+      break;
+  }
+  HT_VALUE_ERROR << "Cannot convert DLPack tensor with type code "
+    << static_cast<int>(dl_dtype.code) << " and "
+    << static_cast<int>(dl_dtype.bits) << " bits";
+  __builtin_unreachable();
+}
+
+} // namespace
+
+bool CheckDLPack(PyObject* obj) {
+  return PyCapsule_IsValid(obj, kDLTensorCapsuleName) ||
+    PyObject_HasAttrString(obj, "__dlpack__");
+}
+
+PyObject* NDArrayToDLPack(const NDArray& ndarray) {
+  HT_VALUE_ERROR_IF(!ndarray->is_cpu())
+    << "Only host NDArrays can be exported to DLPack, got "
+    << ndarray->device() << ". Please copy the data to host memory first";
+  auto* ctx = new NDArrayDLPackContext();
+  ctx->ndarray = ndarray;
+  ctx->shape = ndarray->shape();
+  ctx->stride = ndarray->stride();
+  auto& dl_tensor = ctx->tensor.dl_tensor;
+  try {
+    dl_tensor.dtype = ToDLDataType(ndarray->dtype());
+  } catch (...) {
+    delete ctx;
+    throw;
+  }
+  dl_tensor.data = ndarray->raw_data_ptr();
+  dl_tensor.device = {kDLCPU, 0};
+  dl_tensor.ndim = static_cast<int32_t>(ndarray->ndim());
+  dl_tensor.shape = ctx->shape.data();
+  dl_tensor.strides = ctx->stride.data();
+  dl_tensor.byte_offset = 0;
+  ctx->tensor.manager_ctx = ctx;
+  ctx->tensor.deleter = DeleteNDArrayDLPackContext;
+  auto* capsule = PyCapsule_New(&ctx->tensor, kDLTensorCapsuleName,
+                                DLPackCapsuleDestructor);
+  if (!capsule) {
+    delete ctx;
+    HT_RUNTIME_ERROR << "Failed to create DLPack capsule";
+  }
+  return capsule;
+}
+
+NDArray NDArrayFromDLPack(PyObject* obj) {
+  // Objects like numpy arrays or torch tensors export themselves
+  // via `__dlpack__`, which returns a new capsule.
+  py::object capsule;
+  if (PyCapsule_CheckExact(obj)) {
+    capsule = py::reinterpret_borrow<py::object>(obj);
+  } else {
+    auto* ret = PyObject_CallMethod(obj, "__dlpack__", nullptr);
+    if (!ret)
+      throw py::error_already_set();
+    capsule = py::reinterpret_steal<py::object>(ret);
+  }
+  HT_VALUE_ERROR_IF(!PyCapsule_IsValid(capsule.ptr(), kDLTensorCapsuleName))
+    << "Expected a DLPack capsule that has not been consumed";
+  auto* managed = reinterpret_cast<DLManagedTensor*>(
+    PyCapsule_GetPointer(capsule.ptr(), kDLTensorCapsuleName));
+  HT_RUNTIME_ERROR_IF(!managed) << "Failed to get DLPack tensor from capsule";
+  const auto& dl_tensor = managed->dl_tensor;
+  HT_VALUE_ERROR_IF(dl_tensor.device.device_type != kDLCPU &&
+                    dl_tensor.device.device_type != kDLCUDAHost)
+    << "Only host DLPack tensors are supported, got device type "
+    << static_cast<int>(dl_tensor.device.device_type);
+  auto dtype = FromDLDataType(dl_tensor.dtype);
+
+  auto ndim = static_cast<size_t>(dl_tensor.ndim);
+  HTShape shape(dl_tensor.shape, dl_tensor.shape + ndim);
+  // A null stride pointer means compact row-major layout.
+  HTStride stride = dl_tensor.strides != nullptr
+    ? HTStride(dl_tensor.strides, dl_tensor.strides + ndim)
+    : Shape2Stride(shape);
+  for (auto s : stride)
+    HT_VALUE_ERROR_IF(s < 0) << "Negative strides are not supported";
+  auto meta = NDArrayMeta().set_dtype(dtype).set_shape(shape)
+                           .set_stride(stride).set_device(kCPU);
+
+  int64_t borrow_size = 0;
+  if (meta.numel() > 0) {
+    int64_t last_offset = 0;
+    for (size_t i = 0; i < ndim; i++)
+      last_offset += (shape[i] - 1) * stride[i];
+    borrow_size = (last_offset + 1) * DataType2Size(dtype);
+  }
+  void* ptr = static_cast<char*>(dl_tensor.data) + dl_tensor.byte_offset;
+  // Mark the capsule as consumed so that its destructor does not
+  // release the tensor. From now on, the storage owns the tensor.
+  HT_RUNTIME_ERROR_IF(PyCapsule_SetName(capsule.ptr(), kUsedDLTensorCapsuleName) != 0)
+    << "Failed to consume DLPack capsule";
+  auto storage = std::make_shared<NDArrayStorage>(BorrowToMemoryPool(
+    Device(kCPU), ptr, borrow_size, [managed](DataPtr ptr) {
+      if (managed->deleter == nullptr || !Py_IsInitialized())
+        return;
+      // The producer's deleter may touch Python objects.
+      py::gil_scoped_acquire gil;
+      managed->deleter(managed);
+    }));
+  return NDArray(meta, storage);
+}
+
+} // namespace hydraulis
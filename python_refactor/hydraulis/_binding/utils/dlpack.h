@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Python.h>
+#include "hydraulis/core/ndarray.h"
+
+// Minimal declarations of the DLPack ABI (v0.8,
+// see https://github.com/dmlc/dlpack/blob/main/include/dlpack/dlpack.h).
+// We only declare the structures we need rather than depending on
+// the dlpack headers. The layouts must NOT be changed.
+
+extern "C" {
+
+typedef enum {
+  kDLCPU = 1,
+  kDLCUDA = 2,
+  kDLCUDAHost = 3,
+} DLDeviceType;
+
+typedef struct {
+  DLDeviceType device_type;
+  int32_t device_id;
+} DLDevice;
+
+typedef enum {
+  kDLInt = 0U,
+  kDLUInt = 1U,
+  kDLFloat = 2U,
+  kDLOpaqueHandle = 3U,
+  kDLBfloat = 4U,
+  kDLComplex = 5U,
+  kDLBool = 6U,
+} DLDataTypeCode;
+
+typedef struct {
+  uint8_t code;
+  uint8_t bits;
+  uint16_t lanes;
+} DLDataType;
+
+typedef struct {
+  void* data;
+  DLDevice device;
+  int32_t ndim;
+  DLDataType dtype;
+  int64_t* shape;
+  int64_t* strides;
+  uint64_t byte_offset;
+} DLTensor;
+
+typedef struct DLManagedTensor {
+  DLTensor dl_tensor;
+  void* manager_ctx;
+  void (*deleter)(struct DLManagedTensor* self);
+} DLManagedTensor;
+
+} // extern "C"
+
+namespace hydraulis {
+
+bool CheckDLPack(PyObject* obj);
+
+// Export a host NDArray as a "dltensor" capsule without copying.
+// The capsule keeps the storage alive until the consumer calls the deleter.
+PyObject* NDArrayToDLPack(const NDArray& ndarray);
+
+// Import a "dltensor" capsule (or an object implementing `__dlpack__`)
+// as an NDArray sharing the same memory. Strides and dtypes
+// (including bfloat16 and bool) are preserved.
+NDArray NDArrayFromDLPack(PyObject* obj);
+
+} // namespace hydraulis
@@ -99,6 +99,42 @@ class StorageWathcer {
   std::shared_ptr<NDArrayStorage> _storage;
 };
 
+// Unlike the blocking path, which synchronizes the host with every stream
+// of the device, the D2H copy is issued on a dedicated stream and the
+// half-precision conversion is enqueued on a host stream. The array may be
+// produced on any stream (e.g., collectives, offload or switch streams),
+// so the copy is ordered after all streams of the device by events, which
+// keeps the host from waiting on them. We release the GIL while waiting
+// for the copy so that other Python threads can make progress.
+NDArray PrepareHostDataNonBlocking(NDArray ndarray, bool save) {
+  if (!ndarray->is_cpu()) {
+    Stream d2h_stream(ndarray->device(), kD2HStream);
+    for (StreamIndex stream_id = kComputingStream;
+         stream_id < HT_NUM_STREAMS_PER_DEVICE; stream_id++) {
+      if (stream_id == kD2HStream)
+        continue;
+      auto produced = CreateEvent(ndarray->device(), false);
+      produced->Record(Stream(ndarray->device(), stream_id));
+      produced->Block(d2h_stream);
+    }
+    ndarray = NDArray::cpu(ndarray, kD2HStream);
+    auto copied = CreateEvent(d2h_stream.device(), false);
+    copied->Record(d2h_stream);
+    py::gil_scoped_release release;
+    copied->Sync();
+  }
+  if ((ndarray->dtype() == DataType::FLOAT16 || 
+       ndarray->dtype() == DataType::BFLOAT16) && !save) {
+    Stream host_stream(Device(kCPU), kComputingStream);
+    ndarray = NDArray::toFloat32(ndarray, kComputingStream);
+    auto converted = CreateEvent(Device(kCPU), false);
+    converted->Record(host_stream);
+    py::gil_scoped_release release;
+    converted->Sync();
+  }
+  return ndarray;
+}
+
 } // namespace
 
 bool CheckNumpyInt(PyObject* obj) {
@@ -143,7 +179,8 @@ DataType GetNumpyArrayDataType(PyObject* obj) {
   return FromNumpyDataType(PyArray_TYPE(numpy_array), element_size);
 }
 
-NDArray NDArrayFromNumpy(PyObject* obj, const HTShape& dynamic_shape, DataType datatype) {
+NDArray NDArrayFromNumpy(PyObject* obj, const HTShape& dynamic_shape, DataType datatype,
+                         bool borrow_strided) {
   auto* numpy_array = reinterpret_cast<PyArrayObject*>(obj);
   HT_VALUE_ERROR_IF(!PyArray_EquivByteorders(
       PyArray_DESCR(numpy_array)->byteorder, NPY_NATIVE))
@@ -151,16 +188,35 @@ NDArray NDArrayFromNumpy(PyObject* obj, const HTShape& dynamic_shape, DataType d
   
   bool writable = PyArray_ISWRITEABLE(numpy_array);
   HT_LOG_WARN_IF(!writable) << "The provided Numpy array is non-writable.";
-  HT_VALUE_ERROR_IF(!PyArray_IS_C_CONTIGUOUS(numpy_array))
-    << "Non-contiguous arrays are not supported yet.";
+
+  bool packed_dtype = datatype == kFloat4 || datatype == kNFloat4;
+  // Most consumers (feeds, dataloaders, CPU kernels) index the data linearly, 
+  // so strided arrays are copied into a contiguous array by default. 
+  // Only the explicit interop APIs borrow strided arrays as views. 
+  // Packed 4-bit types store two elements per byte and are always copied.
+  if (!PyArray_IS_C_CONTIGUOUS(numpy_array) && (!borrow_strided || packed_dtype)) {
+    PyObject* contiguous = PyArray_NewCopy(numpy_array, NPY_CORDER);
+    HT_RUNTIME_ERROR_IF(!contiguous) << "Failed to copy the non-contiguous Numpy array";
+    NDArray ret;
+    try {
+      ret = NDArrayFromNumpy(contiguous, dynamic_shape, datatype, false);
+    } catch (...) {
+      Py_DECREF(contiguous);
+      throw;
+    }
+    // the borrowed storage holds its own reference
+    Py_DECREF(contiguous);
+    return ret;
+  }
 
   auto ndim = static_cast<size_t>(PyArray_NDIM(numpy_array));
   auto shape = FromNumpyShape(PyArray_DIMS(numpy_array), ndim);
   auto element_size = static_cast<size_t>(PyArray_ITEMSIZE(numpy_array));
   auto stride = FromNumpyStride(PyArray_STRIDES(numpy_array), ndim, element_size);
-  HT_VALUE_ERROR_IF(stride != Shape2Stride(shape))
-    << "Strided arrays are not supported yet.";
-  if (datatype == kFloat4 || datatype == kNFloat4) {
+  // C-contiguous arrays may still carry arbitrary strides on size-1 dims
+  if (PyArray_IS_C_CONTIGUOUS(numpy_array))
+    stride = Shape2Stride(shape);
+  if (packed_dtype) {
     shape[ndim - 1] *= 2;
     for (int i = 0; i < ndim - 1; ++i) {
       stride[i] *= 2;
@@ -169,20 +225,34 @@ NDArray NDArrayFromNumpy(PyObject* obj, const HTShape& dynamic_shape, DataType d
   auto dtype = datatype == kUndeterminedDataType ? FromNumpyDataType(PyArray_TYPE(numpy_array), element_size)
                                                  : datatype;
   auto meta = NDArrayMeta().set_dtype(dtype).set_shape(shape).set_device(kCPU);
+  if (!packed_dtype)
+    meta.set_stride(stride);
 
   if (!dynamic_shape.empty())
     meta.set_dynamic_shape(dynamic_shape);
 
   void* ptr = PyArray_DATA(numpy_array);
   Py_INCREF(obj);
-  // TODO: mark non-writable and lazy copy on writing
-  int64_t borrow_size = (datatype == kFloat4 || datatype == kNFloat4) 
-                        ? ((meta.numel() + 1) / 2) * element_size 
-                        : meta.numel() * element_size;
+  // The borrowed bytes span from the first to the last addressable element.
+  // Writes to the NDArray are visible to the Numpy array and vice versa, 
+  // so callers that need a private buffer should copy explicitly 
+  // (e.g., variables are copied when the data is non-contiguous).
+  int64_t borrow_size = 0;
+  if (packed_dtype) {
+    borrow_size = ((meta.numel() + 1) / 2) * element_size;
+  } else if (meta.numel() > 0) {
+    int64_t last_offset = 0;
+    for (size_t i = 0; i < ndim; i++)
+      last_offset += (shape[i] - 1) * stride[i];
+    borrow_size = (last_offset + 1) * element_size;
+  }
   auto storage = std::make_shared<NDArrayStorage>(BorrowToMemoryPool(
     Device(kCPU), ptr, borrow_size, [obj](DataPtr ptr) {
-      py::call_guard<py::gil_scoped_acquire>();
-      // py::gil_scoped_acquire gil;
+      // The storage may be released by a non-Python thread 
+      // (e.g., the CPU stream workers), so we must hold the GIL.
+      if (!Py_IsInitialized())
+        return;
+      py::gil_scoped_acquire gil;
       Py_DECREF(obj);
     }));
 
@@ -200,12 +270,17 @@ NDArrayList NDArrayListFromNumpyList(PyObject* obj, const HTShape& dynamic_shape
   return ret;  
 }
 
-PyObject* NDArrayToNumpy(NDArray ndarray, bool force, bool save) {
+PyObject* NDArrayToNumpy(NDArray ndarray, bool force, bool save, 
+                         bool non_blocking) {
   if (!ndarray->is_cpu()) {
     HT_VALUE_ERROR_IF(!force) 
       << "Cannot convert data on " << ndarray->device().type() << " "
       << "to numpy array. Please set force=True or "
       << "copy the data to host memory first";
+  }
+  if (non_blocking) {
+    ndarray = PrepareHostDataNonBlocking(std::move(ndarray), save);
+  } else if (!ndarray->is_cpu()) {
     ndarray = NDArray::cpu(ndarray, kBlockingStream);
   }
   if (ndarray->dtype() == DataType::FLOAT4 || ndarray->dtype() == DataType::NFLOAT4) {
@@ -23,11 +23,17 @@ bool CheckNumpyArrayList(PyObject* obj);
 
 DataType GetNumpyArrayDataType(PyObject* obj);
 
-NDArray NDArrayFromNumpy(PyObject* obj, const HTShape& dynamic_shape = {}, DataType datatype = kUndeterminedDataType);
+// Non-contiguous arrays are copied into a contiguous array unless 
+// `borrow_strided` is set, in which case they are borrowed as strided views.
+NDArray NDArrayFromNumpy(PyObject* obj, const HTShape& dynamic_shape = {}, DataType datatype = kUndeterminedDataType,
+                         bool borrow_strided = false);
 
 NDArrayList NDArrayListFromNumpyList(PyObject* obj, const HTShape& dynamic_shape = {}, DataType datatype = kUndeterminedDataType);
 
-PyObject* NDArrayToNumpy(NDArray ndarray, bool force, bool save = false);
+// If `non_blocking` is set, the conversion waits on events of the 
+// transfer streams (with the GIL released) instead of the blocking stream.
+PyObject* NDArrayToNumpy(NDArray ndarray, bool force, bool save = false, 
+                         bool non_blocking = false);
 
 PyObject* NumpyFromSequences(PyObject* obj);
 
@@ -0,0 +1,47 @@
+import argparse
+import multiprocessing
+import time
+import hydraulis
+from hydraulisrpc_native_server import server_launch
+
+# Barrier latency vs. rank count on one box, flat (every rank waits on the
+# server directly) vs. a k-ary rendezvous tree (per host, then across hosts).
+# Virtual ranks are threads with their own channels; every run uses a fresh server.
+
+def bench(num_ranks, port, ranks_per_host, arity, num_iters):
+    p = multiprocessing.Process(target=server_launch, args=(port, 0))
+    p.start()
+    time.sleep(1)
+    try:
+        return hydraulis.benchmark_rpc_barrier("127.0.0.1:" + str(port), num_ranks,
+                                               ranks_per_host, arity, num_iters)
+    finally:
+        p.join(timeout=10)
+        if p.is_alive():
+            p.terminate()
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--num_ranks", type=str, default='8,32,64,128,256', help="comma separated rank counts"
+    )
+    parser.add_argument(
+        "--ranks_per_host", type=int, default=8, help="virtual ranks per host"
+    )
+    parser.add_argument(
+        "--arity", type=int, default=4, help="arity of the rendezvous tree"
+    )
+    parser.add_argument(
+        "--num_iters", type=int, default=20, help="barriers per measurement"
+    )
+    parser.add_argument(
+        "--port", type=int, default=23457, help="first server port"
+    )
+    args = parser.parse_args()
+    port = args.port
+    print(f"{'ranks':>8}{'flat(ms)':>12}{str(args.arity) + '-ary tree(ms)':>18}")
+    for num_ranks in [int(x) for x in args.num_ranks.split(',')]:
+        flat_ms = bench(num_ranks, port, args.ranks_per_host, 0, args.num_iters)
+        tree_ms = bench(num_ranks, port + 1, args.ranks_per_host, args.arity, args.num_iters)
+        port += 2
+        print(f"{num_ranks:>8}{flat_ms:>12.3f}{tree_ms:>18.3f}")
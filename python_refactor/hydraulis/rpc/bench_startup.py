@@ -0,0 +1,38 @@
+import argparse
+import multiprocessing
+import time
+import hydraulis
+from hydraulisrpc_native_server import server_launch
+
+# Startup benchmark of the coordination service on one box.
+# Each virtual rank is a thread with its own channel and runs the same rendezvous
+# as a real process: Connect, Barrier, GetRank, hostname and device info exchange,
+# then nccl id exchange for the world group and its tp group.
+
+def bench(num_ranks, port, batched, tp_size):
+    # a fresh server per run, since the exchanged keys persist in the server
+    p = multiprocessing.Process(target=server_launch, args=(port, 0))
+    p.start()
+    time.sleep(1)
+    try:
+        return hydraulis.benchmark_rpc_startup("127.0.0.1:" + str(port), num_ranks, batched, tp_size)
+    finally:
+        p.join(timeout=10)
+        if p.is_alive():
+            p.terminate()
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--num_ranks", type=int, default=256, help="num virtual ranks"
+    )
+    parser.add_argument(
+        "--tp_size", type=int, default=8, help="size of the tp groups exchanging nccl ids"
+    )
+    parser.add_argument(
+        "--port", type=int, default=23457, help="server's port"
+    )
+    args = parser.parse_args()
+    per_key_ms = bench(args.num_ranks, args.port, False, args.tp_size)
+    batched_ms = bench(args.num_ranks, args.port + 1, True, args.tp_size)
+    print(f"{args.num_ranks} ranks startup: per-key rpc {per_key_ms:.1f} ms, batched rpc {batched_ms:.1f} ms")
@@ -0,0 +1,24 @@
+import argparse
+import hydraulis
+
+# C++ coordination server: waiting requests are completed when their keys are put,
+# instead of polling (hydraulisrpc_polling_server.py) or holding a server thread
+# (hydraulisrpc_async_server.py). Besides the per-key RPCs it serves the batched
+# MultiPut/MultiGet/Watch RPCs, which the client uses for hostname, device info
+# and nccl id exchange.
+
+def server_launch(port, heartbeat_timeout=10):
+    # blocks until all ranks have exited (or missed their heartbeats)
+    hydraulis.launch_rpc_server("0.0.0.0:" + str(port), heartbeat_timeout)
+    print("Server Stopped.")
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--port", type=str, default='23457', help="server's port"
+    )
+    parser.add_argument(
+        "--heartbeat_timeout", type=int, default=10, help="seconds without heartbeat before a rank is regarded as exited, 0 to disable"
+    )
+    server_args = parser.parse_args()
+    server_launch(server_args.port, server_args.heartbeat_timeout)
@@ -90,7 +90,12 @@ if __name__ == '__main__':
     parser.add_argument(
         "--log_path", type=str, help="log folder path"
     )
+    parser.add_argument(
+        "--native_server", action="store_true", help="use the C++ event-driven rpc server"
+    )
     args = parser.parse_args()
+    if args.native_server:
+        from hydraulisrpc_native_server import server_launch
     p = multiprocessing.Process(target=server_launch, args=(args.server_port,))
     p.start()
     pssh(args)
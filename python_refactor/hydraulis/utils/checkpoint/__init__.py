@@ -1,11 +1,13 @@
 from .load_checkpoint import load_checkpoint, load_checkpoint_from_megatron
 from .save_checkpoint import save_checkpoint
 from .ht_safetensors import load_file, save_file, temp_load, temp_save,\
-                            temp_load_split, temp_save_split,load_model, save_model
+                            temp_load_split, temp_save_split,load_model, save_model,\
+                            load_split_mmap, save_split_mmap
 
 __all__ = ['load_checkpoint', 'save_checkpoint',
            'load_file', 'save_file', 
            'temp_load', 'temp_save',
            'temp_load_split', 'temp_save_split',
            'load_model', 'save_model',
+           'load_split_mmap', 'save_split_mmap',
            'load_checkpoint_from_megatron']
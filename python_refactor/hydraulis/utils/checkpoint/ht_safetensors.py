@@ -1192,6 +1192,45 @@ def temp_load_split(model: hydraulis.nn.Module, optimizer, filename: Union[str,
     return model
 
 
+def _state_dict_for_sharded_io(model: hydraulis.nn.Module, optimizer=None):
+    state_dict = OrderedDict(model.state_dict(format='hydraulis'))
+    if optimizer is not None:
+        for k, param in list(state_dict.items()):
+            for state_k, state_param in optimizer.get_states(param).items():
+                state_dict[k + "_" + state_k] = state_param
+    return state_dict
+
+
+def save_split_mmap(model: hydraulis.nn.Module, optimizer, filename: Union[str, os.PathLike],
+                    local_device=None, num_threads: int = 0):
+    """
+    Streaming sharded save. All ranks write their own shards (duplicated shards 
+    are written once) into a single safetensors file through pwrite, without 
+    gathering the full tensors.
+    """
+    os.makedirs(filename, exist_ok=True)
+    state_dict = _state_dict_for_sharded_io(model, optimizer)
+    archive_file = os.path.join(filename, WEIGHTS_NAME + WEIGHTS_FORMAT)
+    hydraulis.save_safetensors_sharded(archive_file, list(state_dict.values()), 
+                                       list(state_dict.keys()), local_device, num_threads)
+    return model
+
+
+def load_split_mmap(model: hydraulis.nn.Module, optimizer, filename: Union[str, os.PathLike],
+                    local_device=None, num_threads: int = 0):
+    """
+    Streaming sharded load. The safetensors file is mmaped and each rank only 
+    reads the byte ranges of its own shards, converting dtypes in parallel.
+    The shards are read lazily, when the executable graph allocates its param
+    buckets, straight into the bucket storage.
+    """
+    state_dict = _state_dict_for_sharded_io(model, optimizer)
+    archive_file = os.path.join(filename, WEIGHTS_NAME + WEIGHTS_FORMAT)
+    hydraulis.load_safetensors_sharded(archive_file, list(state_dict.values()), 
+                                       list(state_dict.keys()), local_device, num_threads)
+    return model
+
+
 def save(tensors: Dict[str, torch.Tensor], metadata: Optional[Dict[str, str]] = None) -> bytes:
     """
     Saves a dictionary of tensors into raw bytes in safetensors format.
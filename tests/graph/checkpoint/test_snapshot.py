@@ -0,0 +1,18 @@
+import tempfile
+import hydraulis
+
+# A snapshot of host buffers must restore byte for byte into zeroed buffers,
+# even when the sources are overwritten right after Snapshot returns, and a
+# snapshot without its completion marker must not be restored.
+
+def test_round_trip():
+    with tempfile.TemporaryDirectory(prefix="ht_snapshot_test_") as snapshot_dir:
+        stats = hydraulis.check_snapshot_round_trip(snapshot_dir)
+    assert stats["step"] == 1, stats
+    # 17 float32 and 6 int64 values
+    assert stats["num_bytes"] >= 17 * 4 + 6 * 8, stats
+    assert stats["stall_ms"] >= 0 and stats["save_ms"] >= 0, stats
+
+if __name__ == "__main__":
+    test_round_trip()
+    print("test_snapshot passed")
@@ -0,0 +1,89 @@
+import hydraulis
+
+# The activation offload scheduler only depends on tensor sizes, per-layer
+# backward times and the pipeline tasks, so it is checked on CPU alone:
+# coalescing of small activations, the chosen prefetch distance, and reuse of
+# the host buffer ring across micro batches.
+
+def align(x, alignment=256):
+    return (x + alignment - 1) // alignment * alignment
+
+def test_coalescing():
+    item_bytes = [100, 200, 300, 2000, 500, 100]
+    item_layers = [0, 0, 0, 0, 0, 1]
+    s = hydraulis.offload_schedule(item_bytes, item_layers, [1.0, 1.0], coalesce_kb=1)
+    groups = s["groups"]
+    assert [g["items"] for g in groups] == [[0, 1, 2], [3], [4], [5]], groups
+    for g_id, g in enumerate(groups):
+        assert len({item_layers[i] for i in g["items"]}) == 1, g
+        assert g["layer"] == item_layers[g["items"][0]], g
+        assert g["bytes"] == sum(align(item_bytes[i]) for i in g["items"]), g
+        for i in g["items"]:
+            assert s["item_to_group"][i] == g_id
+    # items are laid out group by group in the host buffer
+    assert s["host_bytes"] == sum(align(b) for b in item_bytes), s
+
+def test_prefetch_distance():
+    # one 921600-byte activation per layer, loaded in 0.9 ms at 1.024 GB/s,
+    # while the backward of each layer takes 1 ms
+    num_layers = 4
+    nbytes = 3600 * 256
+    kwargs = dict(h2d_gbps=1.024, latency_us=0)
+    args = ([nbytes] * num_layers, list(range(num_layers)), [1.0] * num_layers)
+    s = hydraulis.offload_schedule(*args, **kwargs)
+    # loading one layer ahead hides all but the first load, and a larger
+    # distance only holds more device memory
+    assert s["prefetch_distance"] == 1, s
+    assert abs(s["exposed_load_ms"] - 0.9) < 1e-6, s
+    assert s["peak_prefetched_bytes"] == 2 * nbytes, s
+    for g in s["groups"]:
+        assert g["load_after_layer"] == min(g["layer"] + 1, num_layers), g
+    # without prefetching every load is exposed
+    s0 = hydraulis.offload_schedule(*args, max_prefetch_distance=0, **kwargs)
+    assert s0["prefetch_distance"] == 0, s0
+    assert abs(s0["exposed_load_ms"] - 0.9 * num_layers) < 1e-6, s0
+    for g in s0["groups"]:
+        assert g["load_after_layer"] == g["layer"], g
+
+def pipedream_flush_tasks(num_stages, stage_id, num_micro_batches):
+    # the same tasks as ExecutableGraph::GeneratePipedreamFlushSchedule
+    warmup = min(num_micro_batches, num_stages - stage_id - 1)
+    remaining = num_micro_batches - warmup
+    tasks = [(0, i) for i in range(warmup)]
+    for i in range(remaining):
+        tasks += [(0, warmup + i), (1, i)]
+    tasks += [(1, remaining + i) for i in range(warmup)]
+    return tasks
+
+def check_ring(tasks, num_micro_batches, expected_slots):
+    slots = hydraulis.assign_offload_host_slots([t for t, _ in tasks], [m for _, m in tasks],
+                                                num_micro_batches)
+    assert len(slots) == num_micro_batches
+    assert len(set(slots)) == expected_slots, (tasks, slots)
+    # a slot is never handed to a forward while its previous micro batch
+    # still waits for the backward to load its activations back
+    has_backward = any(t == 1 for t, _ in tasks)
+    holder = {}
+    for t, m in tasks:
+        if t == 0:
+            assert holder.get(slots[m]) is None, (tasks, slots, m)
+            holder[slots[m]] = m if has_backward else None
+        else:
+            assert holder[slots[m]] == m, (tasks, slots, m)
+            holder[slots[m]] = None
+
+def test_ring_reuse():
+    for num_stages in (1, 2, 4):
+        for stage_id in range(num_stages):
+            for num_micro_batches in (1, 3, 8):
+                tasks = pipedream_flush_tasks(num_stages, stage_id, num_micro_batches)
+                check_ring(tasks, num_micro_batches,
+                           min(num_micro_batches, num_stages - stage_id))
+    # inference reuses a single buffer
+    check_ring([(0, i) for i in range(8)], 8, 1)
+
+if __name__ == "__main__":
+    test_coalescing()
+    test_prefetch_distance()
+    test_ring_reuse()
+    print("test_offload_scheduler passed")
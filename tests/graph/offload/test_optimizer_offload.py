@@ -0,0 +1,31 @@
+import hydraulis
+
+# ZeRO-Offload on CPU: the pipelined per-bucket update must match updating every
+# param one after another with the same Adam kernel, both when the fp32 master
+# is initialized from the params on the first step and when it is bound up front.
+
+def check(low_precision, host_master, num_params=12, num_buckets=4):
+    result = hydraulis.benchmark_optimizer_offload(num_params=num_params, numel_per_param=4096,
+                                                   num_buckets=num_buckets, num_steps=3,
+                                                   low_precision=low_precision,
+                                                   host_master=host_master)
+    assert result["num_chunks"] >= min(num_params, num_buckets), result
+    assert result["max_abs_error"] < 1e-6, result
+    assert result["max_master_error"] < 1e-6, result
+
+def test_first_step_master_init():
+    check(low_precision=False, host_master=False)
+    check(low_precision=True, host_master=False)
+
+def test_bound_host_master():
+    check(low_precision=True, host_master=True)
+
+def test_uneven_buckets():
+    check(low_precision=True, host_master=True, num_params=7, num_buckets=3)
+    check(low_precision=True, host_master=False, num_params=3, num_buckets=8)
+
+if __name__ == "__main__":
+    test_first_step_master_init()
+    test_bound_host_master()
+    test_uneven_buckets()
+    print("test_optimizer_offload passed")
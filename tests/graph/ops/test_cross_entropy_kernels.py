@@ -0,0 +1,29 @@
+import hydraulis
+
+# Sparse cross entropy on CPU: the fused kernel (separate and in-place gradient)
+# and the vocab-parallel stats/combine/lse-gradient path used by the CPU ops must
+# match the separate forward/backward kernels, ignored labels included.
+
+def check(num_tokens, vocab, num_ranks, atol=1e-5):
+    checks = hydraulis.check_cross_entropy_kernels(num_tokens=num_tokens, vocab=vocab,
+                                                   num_ranks=num_ranks)
+    covered = {(c["kernel"], c["reduction"]) for c in checks}
+    for kernel in ("fused", "in_place", "vocab_parallel"):
+        for reduction in ("none", "sum", "mean"):
+            assert (kernel, reduction) in covered, (kernel, reduction)
+    for c in checks:
+        assert c["max_loss_diff"] < atol, c
+        assert c["max_grad_diff"] < atol, c
+
+def test_single_rank():
+    # the path of the CPU SoftmaxCrossEntropySparseOp: lse stashed forward, gradient recomputed backward
+    check(num_tokens=64, vocab=1000, num_ranks=1)
+
+def test_vocab_parallel():
+    check(num_tokens=64, vocab=1000, num_ranks=4)
+    check(num_tokens=13, vocab=257, num_ranks=3)
+
+if __name__ == "__main__":
+    test_single_rank()
+    test_vocab_parallel()
+    print("test_cross_entropy_kernels passed")
@@ -0,0 +1,65 @@
+import os
+# a small cap so that the test can overflow the plan cache; it is read once
+os.environ["HYDRAULIS_EINSUM_PLAN_CACHE_SIZE"] = "16"
+import hydraulis
+
+# Einsum plans (contraction order, batched GEMMs on views, diagonals and
+# broadcasts) must match an element-wise reference on CPU, and the
+# process-wide plan cache must stay within its LRU cap under dynamic shapes.
+
+def check(equation, *shapes, atol=1e-4):
+    ndims = [len(s) for s in shapes]
+    dims = [d for s in shapes for d in s]
+    err = hydraulis.check_einsum_plan(equation, ndims, dims)
+    assert err < atol, (equation, shapes, err)
+
+def test_transpose():
+    check("ij->ji", (3, 5))
+    check("ijk->kij", (2, 3, 4))
+    check("ij,jk->ki", (3, 4), (4, 5))
+    check("bij,bjk->bki", (2, 3, 4), (2, 4, 5))
+    check("bhqd,bhkd->bhqk", (2, 3, 5, 8), (2, 3, 7, 8))
+    check("bqhd,bkhd->bhqk", (2, 5, 3, 8), (2, 7, 3, 8))
+
+def test_broadcast():
+    check("bij,bjk->bik", (1, 3, 4), (6, 4, 5))
+    check("bij,bjk->bik", (6, 3, 4), (1, 4, 5))
+    check("ij,j->ij", (3, 4), (4,))
+    check("i,j->ij", (3,), (4,))
+    check("bi,bi->b", (5, 1), (5, 7))
+
+def test_ellipsis():
+    check("...ij,...jk->...ik", (2, 3, 4, 5), (2, 3, 5, 6))
+    check("...ij,jk->...ik", (2, 3, 4, 5), (5, 6))
+    check("b...d,d->b...", (2, 3, 4, 8), (8,))
+    check("...i,...i->...", (4, 7), (1, 7))
+
+def test_repeated_index():
+    check("ii->i", (5, 5))
+    check("ii->", (5, 5))
+    check("bii->bi", (3, 4, 4))
+    check("iij,jk->ik", (3, 3, 4), (4, 2))
+    check("ij,ij->", (3, 4), (3, 4))
+
+def test_multi_operand():
+    check("ij,jk,kl->il", (3, 4), (4, 5), (5, 2))
+    check("ab,bc,cd,de->ae", (2, 3), (3, 4), (4, 5), (5, 2))
+    check("i,i,i->", (6,), (6,), (6,))
+
+def test_plan_cache_cap():
+    capacity = hydraulis.einsum_plan_cache_stats()["capacity"]
+    assert capacity == 16
+    # every sequence length is a new plan, as with dynamic shapes
+    for seq_len in range(1, 3 * capacity):
+        check("bij,bjk->bik", (2, seq_len, 4), (2, 4, 3))
+        assert hydraulis.einsum_plan_cache_stats()["size"] <= capacity
+    assert hydraulis.einsum_plan_cache_stats()["size"] == capacity
+
+if __name__ == "__main__":
+    test_transpose()
+    test_broadcast()
+    test_ellipsis()
+    test_repeated_index()
+    test_multi_operand()
+    test_plan_cache_cap()
+    print("test_einsum_planner passed")
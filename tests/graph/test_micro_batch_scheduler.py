@@ -0,0 +1,90 @@
+import random
+import hydraulis
+
+# The micro batch scheduler simulates 1F1B on every stage. Its makespan must
+# match an independent simulation, reordering must never be slower than the
+# original order, and the per-stage in-flight tokens must stay under the cap.
+
+def stage_tasks(num_stages, num_micro_batches):
+    # same as ExecutableGraph::GeneratePipedreamFlushSchedule
+    tasks = []
+    for stage_id in range(num_stages):
+        num_warmup = min(num_micro_batches, num_stages - stage_id - 1)
+        num_remaining = num_micro_batches - num_warmup
+        stage = [(True, i) for i in range(num_warmup)]
+        for i in range(num_remaining):
+            stage += [(True, num_warmup + i), (False, i)]
+        stage += [(False, num_remaining + i) for i in range(num_warmup)]
+        tasks.append(stage)
+    return tasks
+
+def reference_makespan(num_tokens, order, num_stages, backward_ratio=2.0):
+    num_micro_batches = len(order)
+    tasks = stage_tasks(num_stages, num_micro_batches)
+    fw_end = [[None] * num_micro_batches for _ in range(num_stages)]
+    bw_end = [[None] * num_micro_batches for _ in range(num_stages)]
+    next_task, stage_free = [0] * num_stages, [0.0] * num_stages
+    num_remaining = 2 * num_stages * num_micro_batches
+    while num_remaining > 0:
+        for s in range(num_stages):
+            while next_task[s] < len(tasks[s]):
+                is_forward, k = tasks[s][next_task[s]]
+                if is_forward:
+                    ready = 0.0 if s == 0 else fw_end[s - 1][k]
+                else:
+                    ready = fw_end[s][k] if s == num_stages - 1 else bw_end[s + 1][k]
+                if ready is None:
+                    break
+                cost = num_tokens[order[k]] * (1 if is_forward else backward_ratio)
+                stage_free[s] = max(stage_free[s], ready) + cost
+                (fw_end if is_forward else bw_end)[s][k] = stage_free[s]
+                next_task[s] += 1
+                num_remaining -= 1
+    return max(stage_free)
+
+def test_simulate():
+    # 2 stages, 2 unit micro batches: F0 F1 B0 B1 on stage 0 ends at 9
+    assert hydraulis.simulate_micro_batches([1, 1], [0, 1], num_stages=2)["makespan"] == 9
+    rng = random.Random(0)
+    for _ in range(20):
+        num_stages = rng.randint(1, 5)
+        num_tokens = [rng.randint(1, 64) for _ in range(rng.randint(1, 12))]
+        order = list(range(len(num_tokens)))
+        rng.shuffle(order)
+        result = hydraulis.simulate_micro_batches(num_tokens, order, num_stages=num_stages)
+        expected = reference_makespan(num_tokens, order, num_stages)
+        assert result["makespan"] == expected, (num_tokens, order, num_stages, result, expected)
+
+def test_schedule():
+    # long micro batches first leave a long cooldown; pairing them with short
+    # ones shortens it without raising any stage's peak
+    num_tokens = [8, 8, 8, 8, 1, 1, 1, 1]
+    schedule = hydraulis.schedule_micro_batches(num_tokens, num_stages=4)
+    assert sorted(schedule["order"]) == list(range(len(num_tokens))), schedule
+    assert schedule["makespan"] < schedule["original_makespan"], schedule
+    assert schedule["makespan"] == reference_makespan(num_tokens, schedule["order"], 4), schedule
+    assert all(p <= q for p, q in zip(schedule["peak_inflight_tokens"],
+                                      schedule["original_peak_inflight_tokens"])), schedule
+    rng = random.Random(1)
+    for _ in range(20):
+        num_stages = rng.randint(1, 5)
+        num_tokens = [rng.randint(1, 64) for _ in range(rng.randint(1, 12))]
+        schedule = hydraulis.schedule_micro_batches(num_tokens, num_stages=num_stages)
+        assert schedule["makespan"] <= schedule["original_makespan"], schedule
+        assert all(p <= q for p, q in zip(schedule["peak_inflight_tokens"],
+                                          schedule["original_peak_inflight_tokens"])), schedule
+
+def test_inflight_cap():
+    # a cap below the original peak takes precedence over the makespan
+    num_tokens = [8, 8, 8, 8, 1, 1, 1, 1]
+    schedule = hydraulis.schedule_micro_batches(num_tokens, num_stages=4, max_inflight_tokens=24)
+    assert max(schedule["original_peak_inflight_tokens"]) > 24, schedule
+    assert max(schedule["peak_inflight_tokens"]) <= 24, schedule
+    simulated = hydraulis.simulate_micro_batches(num_tokens, schedule["order"], num_stages=4)
+    assert simulated["peak_inflight_tokens"] == schedule["peak_inflight_tokens"], (schedule, simulated)
+
+if __name__ == "__main__":
+    test_simulate()
+    test_schedule()
+    test_inflight_cap()
+    print("test_micro_batch_scheduler passed")
@@ -0,0 +1,37 @@
+import hydraulis
+
+# SwitchPlanner on a synthetic topology: every algorithm must deliver the same
+# slices, so they only differ in how the moved bytes spread over the links.
+
+def check(**kwargs):
+    results = hydraulis.benchmark_switch_planner(**kwargs)
+    assert len(results) == 6, results
+    moved = {r["moved_bytes"] for r in results}
+    reused = {r["reused_bytes"] for r in results}
+    transfers = {r["num_transfers"] for r in results}
+    assert len(moved) == 1 and len(reused) == 1 and len(transfers) == 1, results
+    for r in results:
+        links = r["link_bytes"]
+        assert sum(link["bytes"] for link in links) == r["moved_bytes"], r["algorithm"]
+        assert sum(link["bytes"] for link in links if link["inter_node"]) == r["inter_node_bytes"], r["algorithm"]
+        assert all(link["send_rank"] != link["recv_rank"] for link in links), r["algorithm"]
+        assert r["predicted_time_ms"] > 0, r["algorithm"]
+    return {r["algorithm"]: r for r in results}
+
+def test_tp_regroup():
+    check(num_nodes=2, gpus_per_node=8, before_tp=2, after_tp=8, num_params=16, param_mb=4)
+
+def test_same_layout_moves_nothing():
+    results = hydraulis.benchmark_switch_planner(num_nodes=1, gpus_per_node=4, before_tp=1,
+                                                 after_tp=1, num_params=4, param_mb=1)
+    for r in results:
+        assert r["moved_bytes"] == 0 and r["num_transfers"] == 0, r
+
+if __name__ == "__main__":
+    for name, r in check().items():
+        print(f"{name:>24}: predicted {r['predicted_time_ms']:.3f} ms, "
+              f"moved {r['moved_bytes'] / 2**20:.1f} MiB ({r['inter_node_bytes'] / 2**20:.1f} MiB inter-node), "
+              f"max link {r['max_link_bytes'] / 2**20:.1f} MiB, planned in {r['plan_ms']:.2f} ms")
+    test_tp_regroup()
+    test_same_layout_moves_nothing()
+    print("test_switch_planner passed")
@@ -0,0 +1,29 @@
+import argparse
+import os
+import hydraulis
+
+# SHM groups must produce the same results as MPI groups and should not be
+# slower on one host. The MPI world is set up lazily, so every rank just runs
+# this script, e.g.
+#   mpirun -np 4 python tests/impl/communication/test_shm_comm_group.py
+
+def test_shm_vs_mpi(numel=1 << 20, num_iters=20):
+    results = hydraulis.benchmark_cpu_comm_backends(numel=numel, num_iters=num_iters)
+    assert {r["op"] for r in results} == {"AllReduce", "AllGather", "ReduceScatter",
+                                          "Broadcast", "BatchedISendIRecv"}, results
+    for r in results:
+        # reductions may sum in a different order than MPI
+        assert r["max_abs_diff"] <= 1e-4, r
+    return results
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--numel", type=int, default=1 << 20)
+    parser.add_argument("--num_iters", type=int, default=20)
+    args = parser.parse_args()
+    results = test_shm_vs_mpi(args.numel, args.num_iters)
+    if int(os.environ.get("OMPI_COMM_WORLD_RANK", "0")) == 0:
+        for r in results:
+            print(f"{r['op']:>18}: shm {r['shm_ms']:.3f} ms, mpi {r['mpi_ms']:.3f} ms, "
+                  f"speedup {r['mpi_ms'] / r['shm_ms']:.2f}x")
+        print("test_shm_comm_group passed")
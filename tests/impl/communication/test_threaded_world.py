@@ -0,0 +1,31 @@
+import threading
+import hydraulis
+
+# Collectives of THREAD groups must match host-computed values when the
+# ranks run as threads of one process, and a failed rank must abort its
+# peers' waits instead of hanging ThreadedWorld::Run.
+
+def test_collectives():
+    for world_size, numel in ((2, 1), (4, 100003), (3, 1 << 20)):
+        checks = hydraulis.check_thread_collectives(world_size=world_size, numel=numel)
+        assert {c["op"] for c in checks} == {"AllReduce", "AllGather", "ReduceScatter",
+                                             "Broadcast", "SendRecv", "BatchedISendIRecv"}, checks
+        for c in checks:
+            assert c["max_abs_error"] == 0, (world_size, numel, c)
+
+def test_failure_does_not_hang(timeout_s=60):
+    result = {}
+    def run():
+        result["message"] = hydraulis.check_threaded_world_failure(world_size=4, fail_rank=2)
+    # the binding releases the GIL, so a hang shows up as a join timeout
+    thread = threading.Thread(target=run, daemon=True)
+    thread.start()
+    thread.join(timeout_s)
+    assert not thread.is_alive(), "threaded world hung after a rank failed"
+    # the error of the failed rank, not an aborted peer, is re-thrown
+    assert "Rank 2 failed on purpose" in result["message"], result
+
+if __name__ == "__main__":
+    test_collectives()
+    test_failure_does_not_hang()
+    print("test_threaded_world passed")